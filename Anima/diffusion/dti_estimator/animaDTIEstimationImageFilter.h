@@ -51,6 +51,10 @@ public:
     itkSetMacro(B0Threshold, double)
     itkGetMacro(B0Threshold, double)
 
+    //! If on, estimates tensors by voxel blocks: batched log-linear solve followed by Levenberg-Marquardt on Cholesky parameters
+    itkSetMacro(FastEstimation, bool)
+    itkGetMacro(FastEstimation, bool)
+
     itkGetMacro(EstimatedB0Image, OutputB0ImageType *)
     itkGetMacro(EstimatedVarianceImage, OutputB0ImageType *)
 
@@ -63,6 +67,7 @@ protected:
         m_BValuesList.clear();
 
         m_B0Threshold = 0;
+        m_FastEstimation = false;
         m_EstimatedB0Image = NULL;
         m_EstimatedVarianceImage = NULL;
     }
@@ -80,6 +85,19 @@ protected:
                                  std::vector <double> &predictedValues, vnl_matrix <double> &rotationMatrix,
                                  vnl_matrix <double> &workTensor, vnl_diag_matrix <double> &workEigenValues);
 
+    //! Fast mode: gathers masked voxels in blocks and estimates them with EstimateBlockTensors
+    void BatchedThreadedGenerateData(const OutputImageRegionType &outputRegionForThread);
+
+    //! Log-linear estimates of a block of voxels as a single matrix product, then refined and written to the outputs
+    void EstimateBlockTensors(const vnl_matrix <double> &blockSignals, const std::vector <typename OutputImageType::IndexType> &blockIndexes);
+
+    //! Levenberg-Marquardt refinement of (B0, Cholesky factor) parameters of several voxels at once
+    void RefineBlockTensors(const vnl_matrix <double> &blockSignals, unsigned int numVoxels, std::vector <double> &parameters);
+
+    //! Least squares cost of (B0, Cholesky factor) parameters for a voxel, also computes J^T J and J^T r if normalMatrix is not null
+    double ComputeCholeskyCost(const vnl_matrix <double> &blockSignals, unsigned int voxel, const double *parameters,
+                               vnl_matrix <double> *normalMatrix, vnl_vector <double> *gradient);
+
     double ComputeB0AndVarianceFromTensorVector(const vnl_matrix <double> &tensorValue, const std::vector <double> &dwiSignal, double &outVarianceValue);
 
 private:
@@ -89,9 +107,12 @@ private:
     std::vector< vnl_vector_fixed<double,3> > m_GradientDirections;
 
     double m_B0Threshold;
+    bool m_FastEstimation;
     typename OutputB0ImageType::Pointer m_EstimatedB0Image, m_EstimatedVarianceImage;
 
     static const unsigned int m_NumberOfComponents = 6;
+    static const unsigned int m_BlockSize = 64;
+    static const unsigned int m_MaximumNumberOfRefinementIterations = 50;
 
     vnl_matrix <double> m_InitialMatrixSolver;
 };
@@ -4,6 +4,7 @@
 #include <itkImageRegionIterator.h>
 #include <itkImageRegionIteratorWithIndex.h>
 #include <itkImageRegionConstIterator.h>
+#include <itkImageRegionConstIteratorWithIndex.h>
 
 #include <vnl/algo/vnl_determinant.h>
 #include <vnl/algo/vnl_matrix_inverse.h>
@@ -13,6 +14,7 @@
 
 #include <animaVectorOperations.h>
 #include <animaBaseTensorTools.h>
+#include <animaCholeskyDecomposition.h>
 
 namespace anima
 {
@@ -159,6 +161,12 @@ void
 DTIEstimationImageFilter<InputPixelScalarType, OutputPixelScalarType>
 ::DynamicThreadedGenerateData(const OutputImageRegionType &outputRegionForThread)
 {
+    if (m_FastEstimation)
+    {
+        this->BatchedThreadedGenerateData(outputRegionForThread);
+        return;
+    }
+
     typedef itk::ImageRegionConstIterator <InputImageType> ImageIteratorType;
 
     unsigned int numInputs = this->GetNumberOfIndexedInputs();
@@ -336,6 +344,305 @@ DTIEstimationImageFilter<InputPixelScalarType, OutputPixelScalarType>
     }
 }
 
+template <class InputPixelScalarType, class OutputPixelScalarType>
+void
+DTIEstimationImageFilter<InputPixelScalarType, OutputPixelScalarType>
+::BatchedThreadedGenerateData(const OutputImageRegionType &outputRegionForThread)
+{
+    typedef itk::ImageRegionConstIterator <InputImageType> ImageIteratorType;
+
+    unsigned int numInputs = this->GetNumberOfIndexedInputs();
+    std::vector <ImageIteratorType> inIterators;
+    for (unsigned int i = 0;i < numInputs;++i)
+        inIterators.push_back(ImageIteratorType(this->GetInput(i),outputRegionForThread));
+
+    typedef itk::ImageRegionConstIteratorWithIndex <MaskImageType> MaskIteratorType;
+    MaskIteratorType maskIterator(this->GetComputationMask(),outputRegionForThread);
+
+    // Outputs outside of the mask are already zero from BeforeThreadedGenerateData
+    std::vector <typename OutputImageType::IndexType> blockIndexes;
+    blockIndexes.reserve(m_BlockSize);
+    vnl_matrix <double> blockSignals(numInputs,m_BlockSize);
+
+    while (!maskIterator.IsAtEnd())
+    {
+        if (maskIterator.Get() != 0)
+        {
+            unsigned int blockPosition = blockIndexes.size();
+            for (unsigned int i = 0;i < numInputs;++i)
+                blockSignals(i,blockPosition) = inIterators[i].Get();
+
+            blockIndexes.push_back(maskIterator.GetIndex());
+        }
+
+        for (unsigned int i = 0;i < numInputs;++i)
+            ++inIterators[i];
+
+        ++maskIterator;
+
+        bool blockFull = (blockIndexes.size() == m_BlockSize);
+        bool lastBlock = maskIterator.IsAtEnd() && (blockIndexes.size() > 0);
+        if (blockFull || lastBlock)
+        {
+            this->EstimateBlockTensors(blockSignals,blockIndexes);
+            blockIndexes.clear();
+        }
+    }
+}
+
+template <class InputPixelScalarType, class OutputPixelScalarType>
+void
+DTIEstimationImageFilter<InputPixelScalarType, OutputPixelScalarType>
+::EstimateBlockTensors(const vnl_matrix <double> &blockSignals, const std::vector <typename OutputImageType::IndexType> &blockIndexes)
+{
+    typedef typename OutputImageType::PixelType OutputPixelType;
+    typedef itk::SymmetricEigenAnalysis < vnl_matrix <double>, vnl_diag_matrix<double>, vnl_matrix <double> > EigenAnalysisType;
+
+    unsigned int numInputs = this->GetNumberOfIndexedInputs();
+    unsigned int numVoxels = blockIndexes.size();
+    const unsigned int numParameters = m_NumberOfComponents + 1;
+
+    // Log-linear estimates of the whole block as one matrix product
+    vnl_matrix <double> logSignals(numInputs,numVoxels);
+    for (unsigned int i = 0;i < numInputs;++i)
+    {
+        for (unsigned int j = 0;j < numVoxels;++j)
+            logSignals(i,j) = std::log(std::max(1.0e-6,blockSignals(i,j)));
+    }
+
+    vnl_matrix <double> linearEstimates = m_InitialMatrixSolver * logSignals;
+
+    // Bring eigenvalues back to admissible values and initialize (B0, Cholesky factor) parameters
+    OutputPixelType resVec(m_NumberOfComponents);
+    vnl_matrix <double> workTensor(3,3), eigenVectors(3,3), lowerFactor(3,3);
+    vnl_diag_matrix <double> eigenValues(3);
+    EigenAnalysisType eigen(3);
+
+    double minValue = 1.0e-7;
+    double maxValue = 1.0e-2;
+    std::vector <double> parameters(numVoxels * numParameters);
+    std::vector <double> dwi(numInputs);
+    double outVarianceValue;
+
+    for (unsigned int i = 0;i < numVoxels;++i)
+    {
+        for (unsigned int j = 0;j < m_NumberOfComponents;++j)
+            resVec[j] = linearEstimates(j + 1,i);
+
+        anima::GetTensorFromVectorRepresentation(resVec,workTensor);
+        eigen.ComputeEigenValuesAndVectors(workTensor,eigenValues,eigenVectors);
+        for (unsigned int j = 0;j < 3;++j)
+            eigenValues[j] = std::min(maxValue, std::max(eigenValues[j], minValue));
+
+        anima::RecomposeTensor(eigenValues,eigenVectors,workTensor);
+
+        // Lower triangular factor stored as L00, L10, L11, L20, L21, L22
+        double *voxelParameters = parameters.data() + i * numParameters;
+        voxelParameters[1] = std::sqrt(workTensor(0,0));
+        voxelParameters[2] = workTensor(1,0) / voxelParameters[1];
+        voxelParameters[3] = std::sqrt(std::max(workTensor(1,1) - voxelParameters[2] * voxelParameters[2], minValue));
+        voxelParameters[4] = workTensor(2,0) / voxelParameters[1];
+        voxelParameters[5] = (workTensor(2,1) - voxelParameters[4] * voxelParameters[2]) / voxelParameters[3];
+        voxelParameters[6] = std::sqrt(std::max(workTensor(2,2) - voxelParameters[4] * voxelParameters[4]
+                                                - voxelParameters[5] * voxelParameters[5], minValue));
+
+        for (unsigned int j = 0;j < numInputs;++j)
+            dwi[j] = blockSignals(j,i);
+
+        voxelParameters[0] = this->ComputeB0AndVarianceFromTensorVector(workTensor,dwi,outVarianceValue);
+    }
+
+    this->RefineBlockTensors(blockSignals,numVoxels,parameters);
+
+    for (unsigned int i = 0;i < numVoxels;++i)
+    {
+        const double *voxelParameters = parameters.data() + i * numParameters;
+        bool validEstimate = true;
+        for (unsigned int j = 0;j < numParameters;++j)
+        {
+            if (!std::isfinite(voxelParameters[j]))
+            {
+                validEstimate = false;
+                break;
+            }
+        }
+
+        resVec.Fill(0.0);
+        double outB0Value = 0;
+        outVarianceValue = 0;
+
+        if (validEstimate)
+        {
+            lowerFactor.fill(0.0);
+            lowerFactor(0,0) = voxelParameters[1];
+            lowerFactor(1,0) = voxelParameters[2];
+            lowerFactor(1,1) = voxelParameters[3];
+            lowerFactor(2,0) = voxelParameters[4];
+            lowerFactor(2,1) = voxelParameters[5];
+            lowerFactor(2,2) = voxelParameters[6];
+
+            workTensor = lowerFactor * lowerFactor.transpose();
+
+            // The refinement is unconstrained: eigenvalues are brought back to the bounds of the regular estimation
+            eigen.ComputeEigenValuesAndVectors(workTensor,eigenValues,eigenVectors);
+            for (unsigned int j = 0;j < 3;++j)
+                eigenValues[j] = std::min(maxValue, std::max(eigenValues[j], minValue));
+
+            anima::RecomposeTensor(eigenValues,eigenVectors,workTensor);
+            anima::GetVectorRepresentation(workTensor,resVec);
+
+            for (unsigned int j = 0;j < numInputs;++j)
+                dwi[j] = blockSignals(j,i);
+
+            outB0Value = this->ComputeB0AndVarianceFromTensorVector(workTensor,dwi,outVarianceValue);
+        }
+
+        this->GetOutput()->SetPixel(blockIndexes[i],resVec);
+        m_EstimatedB0Image->SetPixel(blockIndexes[i],outB0Value);
+        m_EstimatedVarianceImage->SetPixel(blockIndexes[i],outVarianceValue);
+
+        this->IncrementNumberOfProcessedPoints();
+    }
+}
+
+template <class InputPixelScalarType, class OutputPixelScalarType>
+void
+DTIEstimationImageFilter<InputPixelScalarType, OutputPixelScalarType>
+::RefineBlockTensors(const vnl_matrix <double> &blockSignals, unsigned int numVoxels, std::vector <double> &parameters)
+{
+    const unsigned int numParameters = m_NumberOfComponents + 1;
+
+    vnl_matrix <double> normalMatrix(numParameters,numParameters);
+    vnl_vector <double> gradient(numParameters), step(numParameters);
+    std::vector <double> candidateParameters(numParameters);
+    anima::CholeskyDecomposition cholSolver;
+
+    std::vector <double> costValues(numVoxels);
+    std::vector <double> dampingValues(numVoxels,1.0e-3);
+    std::vector <bool> activeVoxels(numVoxels,true);
+    unsigned int numActiveVoxels = numVoxels;
+
+    for (unsigned int i = 0;i < numVoxels;++i)
+        costValues[i] = this->ComputeCholeskyCost(blockSignals,i,parameters.data() + i * numParameters,ITK_NULLPTR,ITK_NULLPTR);
+
+    // Each iteration sweeps all voxels of the block that have not converged yet
+    for (unsigned int iter = 0;(iter < m_MaximumNumberOfRefinementIterations) && (numActiveVoxels > 0);++iter)
+    {
+        for (unsigned int i = 0;i < numVoxels;++i)
+        {
+            if (!activeVoxels[i])
+                continue;
+
+            double *voxelParameters = parameters.data() + i * numParameters;
+            this->ComputeCholeskyCost(blockSignals,i,voxelParameters,&normalMatrix,&gradient);
+
+            // Marquardt damping, scaled by the normal matrix diagonal
+            for (unsigned int j = 0;j < numParameters;++j)
+                normalMatrix(j,j) = std::max(normalMatrix(j,j) * (1.0 + dampingValues[i]), 1.0e-12);
+
+            cholSolver.SetInputMatrix(normalMatrix);
+            cholSolver.PerformDecomposition();
+            step = gradient;
+            cholSolver.SolveLinearSystemInPlace(step);
+
+            for (unsigned int j = 0;j < numParameters;++j)
+                candidateParameters[j] = voxelParameters[j] - step[j];
+
+            double candidateCost = this->ComputeCholeskyCost(blockSignals,i,candidateParameters.data(),ITK_NULLPTR,ITK_NULLPTR);
+
+            if (std::isfinite(candidateCost) && (candidateCost < costValues[i]))
+            {
+                double relativeDecrease = (costValues[i] - candidateCost) / costValues[i];
+                std::copy(candidateParameters.begin(),candidateParameters.end(),voxelParameters);
+                costValues[i] = candidateCost;
+                dampingValues[i] = std::max(dampingValues[i] / 10.0, 1.0e-10);
+
+                if (relativeDecrease < 1.0e-6)
+                {
+                    activeVoxels[i] = false;
+                    --numActiveVoxels;
+                }
+            }
+            else
+            {
+                dampingValues[i] *= 10.0;
+                if (dampingValues[i] > 1.0e10)
+                {
+                    activeVoxels[i] = false;
+                    --numActiveVoxels;
+                }
+            }
+        }
+    }
+}
+
+template <class InputPixelScalarType, class OutputPixelScalarType>
+double
+DTIEstimationImageFilter<InputPixelScalarType, OutputPixelScalarType>
+::ComputeCholeskyCost(const vnl_matrix <double> &blockSignals, unsigned int voxel, const double *parameters,
+                      vnl_matrix <double> *normalMatrix, vnl_vector <double> *gradient)
+{
+    const unsigned int numParameters = m_NumberOfComponents + 1;
+    unsigned int numInputs = this->GetNumberOfIndexedInputs();
+
+    double b0Value = parameters[0];
+    const double *lowerFactor = parameters + 1;
+
+    if (normalMatrix)
+    {
+        normalMatrix->fill(0.0);
+        gradient->fill(0.0);
+    }
+
+    double jacobianRow[m_NumberOfComponents + 1];
+    double costValue = 0;
+
+    for (unsigned int i = 0;i < numInputs;++i)
+    {
+        const vnl_vector_fixed <double,3> &gradDir = m_GradientDirections[i];
+        double bValue = m_BValuesList[i];
+
+        // u = L^T g, so that g^T D g = |u|^2
+        double u0 = lowerFactor[0] * gradDir[0] + lowerFactor[1] * gradDir[1] + lowerFactor[3] * gradDir[2];
+        double u1 = lowerFactor[2] * gradDir[1] + lowerFactor[4] * gradDir[2];
+        double u2 = lowerFactor[5] * gradDir[2];
+
+        double attenuation = std::exp(- bValue * (u0 * u0 + u1 * u1 + u2 * u2));
+        double residual = b0Value * attenuation - blockSignals(i,voxel);
+        costValue += residual * residual;
+
+        if (!normalMatrix)
+            continue;
+
+        double derivativeFactor = - 2.0 * b0Value * bValue * attenuation;
+        jacobianRow[0] = attenuation;
+        jacobianRow[1] = derivativeFactor * gradDir[0] * u0;
+        jacobianRow[2] = derivativeFactor * gradDir[1] * u0;
+        jacobianRow[3] = derivativeFactor * gradDir[1] * u1;
+        jacobianRow[4] = derivativeFactor * gradDir[2] * u0;
+        jacobianRow[5] = derivativeFactor * gradDir[2] * u1;
+        jacobianRow[6] = derivativeFactor * gradDir[2] * u2;
+
+        for (unsigned int j = 0;j < numParameters;++j)
+        {
+            (*gradient)[j] += jacobianRow[j] * residual;
+            for (unsigned int k = 0;k <= j;++k)
+                (*normalMatrix)(j,k) += jacobianRow[j] * jacobianRow[k];
+        }
+    }
+
+    if (normalMatrix)
+    {
+        for (unsigned int j = 0;j < numParameters;++j)
+        {
+            for (unsigned int k = 0;k < j;++k)
+                (*normalMatrix)(k,j) = (*normalMatrix)(j,k);
+        }
+    }
+
+    return costValue;
+}
+
 template <class InputPixelScalarType, class OutputPixelScalarType>
 double
 DTIEstimationImageFilter<InputPixelScalarType, OutputPixelScalarType>
@@ -29,6 +29,8 @@ int main(int argc,  char **argv)
     TCLAP::SwitchArg bvalueScaleArg("B","b-no-scale","Do not scale b-values according to gradient norm",cmd);
     TCLAP::ValueArg<std::string> computationMaskArg("m","mask","Computation mask", false,"","computation mask",cmd);
 
+    TCLAP::SwitchArg fastArg("F","fast","Fast estimation: batched log-linear solve and Levenberg-Marquardt refinement instead of exact BOBYQA optimization",cmd,false);
+
     TCLAP::ValueArg<unsigned int> b0ThrArg("t","b0thr","bot_treshold",false,0,"B0 threshold (default : 0)",cmd);
     TCLAP::ValueArg<unsigned int> nbpArg("p","numberofthreads","nb_thread",false,itk::MultiThreaderBase::GetGlobalDefaultNumberOfThreads(),"Number of threads to run on (default: all cores)",cmd);
     TCLAP::ValueArg<std::string> reorientArg("r","reorient","dwi_reoriented",false,"","Reorient DWI given as input",cmd);
@@ -108,6 +110,7 @@ int main(int argc,  char **argv)
         mainFilter->SetComputationMask(anima::readImage<MaskImageType>(computationMaskArg.getValue()));
 
     mainFilter->SetB0Threshold(b0ThrArg.getValue());
+    mainFilter->SetFastEstimation(fastArg.isSet());
     mainFilter->SetNumberOfWorkUnits(nbpArg.getValue());
     mainFilter->AddObserver(itk::ProgressEvent(), callback);
 
@@ -1,6 +1,7 @@
 #include <tclap/CmdLine.h>
 
 #include <animaShapesReader.h>
+#include <animaBinaryTractogramReader.h>
 
 #include <vtkSmartPointer.h>
 #include <vtkPoints.h>
@@ -29,51 +30,81 @@ int main(int argc, char **argv)
         return EXIT_FAILURE;
     }
 
-    anima::ShapesReader trackReader;
-    trackReader.SetFileName(inArg.getValue());
-    trackReader.Update();
+    std::vector <std::string> arrayNames;
+    std::vector <double> diseaseScores;
+    vtkIdType numFibers = 0;
 
-    using PolyDataPointer = vtkSmartPointer <vtkPolyData>;
-    PolyDataPointer dataTracks = trackReader.GetOutput();
-
-    vtkIdType numFibers = dataTracks->GetNumberOfCells();
-    unsigned int numArrays = dataTracks->GetPointData()->GetNumberOfArrays();
-    std::vector <vtkDoubleArray *> usefulArrays;
-    for (unsigned int i = 0;i < numArrays;++i)
+    // Adds up disease scores of fibers in dataTracks, arrays being found from the first call
+    auto accumulateScores = [&](vtkPolyData *dataTracks)
     {
-        if (dataTracks->GetPointData()->GetArray(i)->GetNumberOfComponents() == 1)
-            usefulArrays.push_back(dynamic_cast <vtkDoubleArray *> (dataTracks->GetPointData()->GetArray(i)));
-    }
+        unsigned int numArrays = dataTracks->GetPointData()->GetNumberOfArrays();
+        if (arrayNames.size() == 0)
+        {
+            for (unsigned int i = 0;i < numArrays;++i)
+            {
+                if (dataTracks->GetPointData()->GetArray(i)->GetNumberOfComponents() == 1)
+                    arrayNames.push_back(dataTracks->GetPointData()->GetArrayName(i));
+            }
 
-    numArrays = usefulArrays.size();
-    std::vector <double> diseaseScores(numArrays, 0.0);
-    std::vector <double> fiberDiseaseScores(numArrays, 0.0);
+            diseaseScores.resize(arrayNames.size(),0.0);
+        }
 
-    for (unsigned int i = 0;i < numFibers;++i)
-    {
-        vtkCell *cell = dataTracks->GetCell(i);
-        unsigned int numPointsInCell = cell->GetNumberOfPoints();
-        for (unsigned int j = 0;j < numArrays;++j)
-            fiberDiseaseScores[j] = 0.0;
+        std::vector <vtkDataArray *> usefulArrays(arrayNames.size());
+        for (unsigned int i = 0;i < arrayNames.size();++i)
+            usefulArrays[i] = dataTracks->GetPointData()->GetArray(arrayNames[i].c_str());
 
-        for (unsigned int j = 0;j < numPointsInCell;++j)
+        numArrays = usefulArrays.size();
+        std::vector <double> fiberDiseaseScores(numArrays, 0.0);
+
+        vtkIdType numChunkFibers = dataTracks->GetNumberOfCells();
+        numFibers += numChunkFibers;
+        for (unsigned int i = 0;i < numChunkFibers;++i)
         {
-            int ptId = cell->GetPointId(j);
+            vtkCell *cell = dataTracks->GetCell(i);
+            unsigned int numPointsInCell = cell->GetNumberOfPoints();
+            for (unsigned int j = 0;j < numArrays;++j)
+                fiberDiseaseScores[j] = 0.0;
+
+            for (unsigned int j = 0;j < numPointsInCell;++j)
+            {
+                int ptId = cell->GetPointId(j);
 
-            for (unsigned int k = 0;k < numArrays;++k)
-                fiberDiseaseScores[k] += (usefulArrays[k]->GetValue(ptId) != 0.0);
+                for (unsigned int k = 0;k < numArrays;++k)
+                    fiberDiseaseScores[k] += (usefulArrays[k]->GetComponent(ptId,0) != 0.0);
+            }
+
+            for (unsigned int j = 0;j < numArrays;++j)
+                diseaseScores[j] += fiberDiseaseScores[j] / numPointsInCell;
         }
+    };
+
+    if (anima::BinaryTractogramReader::IsBinaryTractogramFile(inArg.getValue()))
+    {
+        // Binary tractograms are streamed chunk by chunk
+        anima::BinaryTractogramReader binaryReader;
+        binaryReader.SetFileName(inArg.getValue());
+        binaryReader.Open();
 
-        for (unsigned int j = 0;j < numArrays;++j)
-            diseaseScores[j] += fiberDiseaseScores[j] / numPointsInCell;
+        for (unsigned int i = 0;i < binaryReader.GetNumberOfChunks();++i)
+            accumulateScores(binaryReader.ReadChunk(i));
     }
+    else
+    {
+        anima::ShapesReader trackReader;
+        trackReader.SetFileName(inArg.getValue());
+        trackReader.Update();
+
+        accumulateScores(trackReader.GetOutput());
+    }
+
+    unsigned int numArrays = arrayNames.size();
 
     std::ofstream file(resArg.getValue());
     file.precision(precisionArg.getValue());
 
     for (unsigned int i = 0;i < numArrays;++i)
     {
-        file << usefulArrays[i]->GetName();
+        file << arrayNames[i];
         diseaseScores[i] /= numFibers;
 
         file << "," << 100.0 * diseaseScores[i] << std::endl;
@@ -1,9 +1,13 @@
 #include <cmath>
 #include <sstream>
+#include <algorithm>
 
 #include <animaMCMFileReader.h>
 #include <animaShapesWriter.h>
 #include <animaShapesReader.h>
+#include <animaBinaryTractogramReader.h>
+#include <animaBinaryTractogramWriter.h>
+#include <animaVectorOperations.h>
 
 #include <tclap/CmdLine.h>
 
@@ -13,210 +17,439 @@
 #include <vtkPolyData.h>
 #include <vtkGenericCell.h>
 #include <vtkDoubleArray.h>
-#include <vtkGenericCell.h>
-
-#include <animaMCMLinearInterpolateImageFunction.h>
-#include <animaHyperbolicFunctions.h>
-#include <itkPoolMultiThreader.h>
 
-void ComputePropertiesOnOneCell(vtkCell *cell, anima::MCMLinearInterpolateImageFunction <anima::MCMImage <double, 3> > *mcmInterpolator,
-                                std::vector < vtkSmartPointer <vtkDoubleArray> > &myParameters, anima::MultiCompartmentModel *mcm)
-{   
-    typedef itk::VariableLengthVector <double> VectorType;
+#include <itkMultiThreaderBase.h>
 
+//! Properties extracted along tracks. Anisotropic ones are taken from the compartment best aligned with the track
+enum TrackPropertyType
+{
+    ParallelDiffusivity = 0,
+    PerpendicularDiffusivity,
+    MeanDiffusivity,
+    FractionalAnisotropy,
+    FreeWaterFraction,
+    IsotropicRestrictedWaterFraction
+};
+
+const unsigned int NumberOfAnisotropicProperties = 4;
+const unsigned int NumberOfProperties = 6;
+const char *PropertyKeys[NumberOfProperties] = {"AD", "RD", "MD", "FA", "FW", "IRW"};
+const char *PropertyNames[NumberOfProperties] = {"Parallel diffusivity", "Perpendicular diffusivity", "Mean diffusivity",
+                                                 "Fractional anisotropy", "Free water fraction", "Isotropic restricted water fraction"};
+
+/**
+ * Samples MCM properties along tracks without building interpolated models. Track points are first located in the image
+ * (base voxel and linear interpolation distances), then the parameters of all voxels reached by the tracks are
+ * computed once and cached in a flat array: compartment weights, orientations and requested properties only.
+ * At each point, the anisotropic compartment best aligned with the track is selected in each neighboring voxel and
+ * its properties are averaged with interpolation and compartment weights. Isotropic fractions are linearly interpolated.
+ * The cache is kept between calls to Sample so that chunks of a tractogram only compute parameters of new voxels.
+ */
+class TrackMCMSampler
+{
+public:
     typedef anima::MCMImage <double, 3> ModelImageType;
-    typedef ModelImageType::Pointer ModelImagePointer;
-
     typedef ModelImageType::IndexType IndexType;
-    typedef ModelImageType::PointType PointType;
-    
-    typedef anima::BaseCompartment CompartmentType;
-    typedef CompartmentType::Pointer CompartmentPointer;
-
     typedef anima::MultiCompartmentModel MCMType;
     typedef MCMType::Pointer MCMPointer;
 
-    int nbOfComponents = myParameters.size();
-    int nbOfIsotropicCompartment = mcm->GetNumberOfIsotropicCompartments();
-    int nbOfCompartment = mcm->GetNumberOfCompartments();
+    TrackMCMSampler(ModelImageType *image, const std::vector <TrackPropertyType> &properties, unsigned int numThreads);
 
-    vtkPoints *cellPts = cell->GetPoints();
-    vtkIdType nbOfCellPts = cellPts->GetNumberOfPoints();
+    void Sample(vtkPolyData *tracks, std::vector < vtkSmartPointer <vtkDoubleArray> > &outputArrays);
 
-    double currentPtPositionVTK[3];
-    double nextPtPositionVTK[3];
-    double lastPtPositionVTK[3];
+private:
+    struct PointInterpolationType
+    {
+        IndexType baseIndex;
+        double distances[3];
+    };
 
-    PointType currentPtPosition, nextPtPosition, lastPtPosition;
+    void ComputeTracksTraversal(vtkPolyData *tracks);
+    void CacheVoxelParameters();
+    void SampleTracks(vtkPolyData *tracks, std::vector < vtkSmartPointer <vtkDoubleArray> > &outputArrays);
 
-    itk::ContinuousIndex<double, 3> currentIndex;
-    std::vector <double> myParameterValues(nbOfComponents);
+    //! Returns neighbor index and overlap of linear interpolation, overlap being zero for neighbors outside the image
+    double GetNeighbor(const PointInterpolationType &interpolation, unsigned int neighbor, IndexType &neighborIndex);
 
-    vnl_vector <double> trackDirection(3);
-    VectorType outputModelVector;
-    MCMPointer workOutputModel = mcm->Clone();
-    vnl_vector <double> tempDirectionSphericalCordinate(3);
-    vnl_vector <double> tempDirection(3);
+    ModelImageType *m_ModelImage;
+    ModelImageType::RegionType m_Region;
+    MCMPointer m_ReferenceModel;
+    unsigned int m_NumberOfThreads;
 
-    int fwCompartmentIndex = -1;
-    int irwCompartmentIndex = -1;
+    std::vector <TrackPropertyType> m_Properties;
+    std::vector <unsigned int> m_AnisotropicProperties;
+    std::vector <unsigned int> m_IsotropicCompartments;
 
-    for (unsigned int i = 0;i < mcm->GetNumberOfIsotropicCompartments();++i)
+    std::vector <PointInterpolationType> m_PointInterpolations;
+
+    //! Cache slot of each voxel, -1 if not reached by tracks
+    std::vector <int> m_VoxelSlots;
+    std::vector <IndexType> m_SlotIndexes;
+    unsigned int m_NumberOfCachedSlots;
+
+    //! Per slot: non null model flag, isotropic weights, then for each anisotropic compartment weight, direction and properties
+    std::vector <double> m_VoxelCache;
+    unsigned int m_CompartmentStride;
+    unsigned int m_SlotStride;
+};
+
+TrackMCMSampler::TrackMCMSampler(ModelImageType *image, const std::vector <TrackPropertyType> &properties, unsigned int numThreads)
+{
+    m_ModelImage = image;
+    m_Region = image->GetLargestPossibleRegion();
+    m_ReferenceModel = image->GetDescriptionModel();
+    m_NumberOfThreads = numThreads;
+    m_Properties = properties;
+
+    for (unsigned int i = 0;i < m_Properties.size();++i)
     {
-        if (mcm->GetCompartment(i)->GetCompartmentType() == anima::FreeWater)
-            fwCompartmentIndex = i;
-        else if (mcm->GetCompartment(i)->GetCompartmentType() == anima::IsotropicRestrictedWater)
-            irwCompartmentIndex = i;
+        if (m_Properties[i] < NumberOfAnisotropicProperties)
+        {
+            m_AnisotropicProperties.push_back(m_Properties[i]);
+            continue;
+        }
+
+        anima::DiffusionModelCompartmentType compartmentType = (m_Properties[i] == FreeWaterFraction) ? anima::FreeWater :
+                                                                                                         anima::IsotropicRestrictedWater;
+        for (unsigned int j = 0;j < m_ReferenceModel->GetNumberOfIsotropicCompartments();++j)
+        {
+            if (m_ReferenceModel->GetCompartment(j)->GetCompartmentType() == compartmentType)
+            {
+                m_IsotropicCompartments.push_back(j);
+                break;
+            }
+        }
     }
 
-    for (int j = 0;j < nbOfCellPts;++j)
-    {
-        //Get the track direction
-        cellPts->GetPoint(j, currentPtPositionVTK);
-        int upperIndex = std::min((int)nbOfCellPts - 1,j + 1);
-        cellPts->GetPoint(upperIndex,nextPtPositionVTK);
-        int lowerIndex = std::max(0,j - 1);
-        cellPts->GetPoint(lowerIndex,lastPtPositionVTK);
+    unsigned int numAnisotropicCompartments = m_ReferenceModel->GetNumberOfCompartments() - m_ReferenceModel->GetNumberOfIsotropicCompartments();
+    m_CompartmentStride = 4 + m_AnisotropicProperties.size();
+    m_SlotStride = 1 + m_IsotropicCompartments.size() + numAnisotropicCompartments * m_CompartmentStride;
 
-        int ptId = cell->GetPointId(j);
+    m_VoxelSlots.assign(m_Region.GetNumberOfPixels(),-1);
+    m_NumberOfCachedSlots = 0;
+}
 
-        for (int k = 0; k < 3; ++k)
+double TrackMCMSampler::GetNeighbor(const PointInterpolationType &interpolation, unsigned int neighbor, IndexType &neighborIndex)
+{
+    double overlap = 1.0;
+    for (unsigned int i = 0;i < 3;++i)
+    {
+        if (neighbor & 1)
         {
-            currentPtPosition[k] = currentPtPositionVTK[k];
-            nextPtPosition[k] = nextPtPositionVTK[k];
-            lastPtPosition[k] = lastPtPositionVTK[k];
+            neighborIndex[i] = interpolation.baseIndex[i] + 1;
+            overlap *= interpolation.distances[i];
+        }
+        else
+        {
+            neighborIndex[i] = interpolation.baseIndex[i];
+            overlap *= 1.0 - interpolation.distances[i];
         }
 
-        for (int k = 0; k < 3; ++k)
-            trackDirection[k] = nextPtPosition[k] - lastPtPosition[k];
+        neighbor >>= 1;
+    }
 
-        if (trackDirection.two_norm() != 0)
-            trackDirection.normalize();
+    if (!m_Region.IsInside(neighborIndex))
+        return 0;
 
-        //Convert physical points to continuous index and interpolate
-        mcmInterpolator->GetInputImage()->TransformPhysicalPointToContinuousIndex(currentPtPosition, currentIndex);
+    return overlap;
+}
 
-        outputModelVector = mcmInterpolator->EvaluateAtContinuousIndex(currentIndex);
-        workOutputModel->SetModelVector(outputModelVector);
+void TrackMCMSampler::Sample(vtkPolyData *tracks, std::vector < vtkSmartPointer <vtkDoubleArray> > &outputArrays)
+{
+    // Get dummy cell so that it's thread safe
+    vtkSmartPointer <vtkGenericCell> dummyCell = vtkSmartPointer <vtkGenericCell>::New();
+    tracks->GetCell(0,dummyCell);
 
-        double totalWeight = 0;
-        for (int k = 0; k < nbOfCompartment; ++k)
-            totalWeight += workOutputModel->GetCompartmentWeight(k);
+    this->ComputeTracksTraversal(tracks);
+    this->CacheVoxelParameters();
+    this->SampleTracks(tracks,outputArrays);
+}
 
-        if (totalWeight == 0)
-        {
-            for (int k = 0; k < nbOfComponents; ++k)
-                myParameters[k]->SetValue(ptId, 0);
-            continue;
-        }
-        else if (std::abs(totalWeight - 1.0) > 0.0000001)
-            std::cout << "Error some weight is not equal to 1, weight : " << totalWeight << std::endl;
+void TrackMCMSampler::ComputeTracksTraversal(vtkPolyData *tracks)
+{
+    m_PointInterpolations.resize(tracks->GetNumberOfPoints());
 
-        // Find the closest fascicle direction from the workOutputModel to the current one
-        double maxDirectionDotProduct = -1;
-        double tempDotProduct = 0;
-        int digitOfSelectedCompartment = 0;
+    vtkPoints *trackPoints = tracks->GetPoints();
+    unsigned int numPoints = trackPoints->GetNumberOfPoints();
 
-        for (int k = nbOfIsotropicCompartment; k < nbOfCompartment; ++k)
-        {
-            tempDirectionSphericalCordinate[0] = workOutputModel->GetCompartment(k)->GetOrientationTheta();
-            tempDirectionSphericalCordinate[1] = workOutputModel->GetCompartment(k)->GetOrientationPhi();
-            tempDirectionSphericalCordinate[2] = 1;
+    itk::MultiThreaderBase::Pointer threader = itk::MultiThreaderBase::New();
+    threader->SetNumberOfWorkUnits(m_NumberOfThreads);
 
-            anima::TransformSphericalToCartesianCoordinates(tempDirectionSphericalCordinate, tempDirection);
+    const unsigned int chunkSize = 4096;
+    unsigned int numChunks = (numPoints + chunkSize - 1) / chunkSize;
+    threader->ParallelizeArray(0, numChunks, [&](itk::SizeValueType chunk)
+    {
+        unsigned int firstPoint = chunk * chunkSize;
+        unsigned int lastPoint = std::min(numPoints, firstPoint + chunkSize);
 
-            tempDotProduct = std::abs(dot_product(trackDirection, tempDirection));
+        double pointPositionVTK[3];
+        ModelImageType::PointType pointPosition;
+        itk::ContinuousIndex <double, 3> continuousIndex;
 
-            if (tempDotProduct > maxDirectionDotProduct)
+        for (unsigned int i = firstPoint;i < lastPoint;++i)
+        {
+            trackPoints->GetPoint(i,pointPositionVTK);
+            for (unsigned int j = 0;j < 3;++j)
+                pointPosition[j] = pointPositionVTK[j];
+
+            m_ModelImage->TransformPhysicalPointToContinuousIndex(pointPosition,continuousIndex);
+
+            PointInterpolationType &interpolation = m_PointInterpolations[i];
+            for (unsigned int j = 0;j < 3;++j)
             {
-                maxDirectionDotProduct = tempDotProduct;
-                digitOfSelectedCompartment = k;
+                interpolation.baseIndex[j] = itk::Math::Floor <itk::IndexValueType> (continuousIndex[j]);
+                interpolation.distances[j] = continuousIndex[j] - interpolation.baseIndex[j];
             }
         }
+    }, nullptr);
 
-        if (digitOfSelectedCompartment < nbOfIsotropicCompartment)
+    // Slots of voxels reached by tracks, added to those of previous calls
+    IndexType neighborIndex;
+    for (unsigned int i = 0;i < numPoints;++i)
+    {
+        for (unsigned int j = 0;j < 8;++j)
         {
-            std::cout << "The selected compartment is isotropic" << std::endl;
-            exit(-1);
+            if (this->GetNeighbor(m_PointInterpolations[i],j,neighborIndex) <= 0)
+                continue;
+
+            int &voxelSlot = m_VoxelSlots[m_ModelImage->ComputeOffset(neighborIndex)];
+            if (voxelSlot < 0)
+            {
+                voxelSlot = m_SlotIndexes.size();
+                m_SlotIndexes.push_back(neighborIndex);
+            }
         }
+    }
+}
 
-        CompartmentPointer outputCompartment = workOutputModel->GetCompartment(digitOfSelectedCompartment);
+void TrackMCMSampler::CacheVoxelParameters()
+{
+    // Only slots added since the last call are computed
+    unsigned int firstNewSlot = m_NumberOfCachedSlots;
+    unsigned int numSlots = m_SlotIndexes.size();
+    m_VoxelCache.resize(numSlots * m_SlotStride,0.0);
+    m_NumberOfCachedSlots = numSlots;
 
-        // Compute values from the selected compartment
-        myParameterValues[0] = outputCompartment->GetApparentParallelDiffusivity();
-        myParameterValues[1] = outputCompartment->GetApparentPerpendicularDiffusivity();
-        myParameterValues[2] = outputCompartment->GetApparentMeanDiffusivity();
-        myParameterValues[3] = outputCompartment->GetApparentFractionalAnisotropy();
-        unsigned int pos = 4;
-        if (fwCompartmentIndex != -1)
-        {
-            myParameterValues[pos] = workOutputModel->GetCompartmentWeight(fwCompartmentIndex);
-            ++pos;
-        }
+    unsigned int numIsotropicCompartments = m_ReferenceModel->GetNumberOfIsotropicCompartments();
+    unsigned int numCompartments = m_ReferenceModel->GetNumberOfCompartments();
 
-        if (irwCompartmentIndex != -1)
-        {
-            myParameterValues[pos] = workOutputModel->GetCompartmentWeight(irwCompartmentIndex);
-            ++pos;
-        }
+    itk::MultiThreaderBase::Pointer threader = itk::MultiThreaderBase::New();
+    threader->SetNumberOfWorkUnits(m_NumberOfThreads);
+
+    const unsigned int chunkSize = 1024;
+    unsigned int numChunks = (numSlots - firstNewSlot + chunkSize - 1) / chunkSize;
+    threader->ParallelizeArray(0, numChunks, [&](itk::SizeValueType chunk)
+    {
+        unsigned int firstSlot = firstNewSlot + chunk * chunkSize;
+        unsigned int lastSlot = std::min(numSlots, firstSlot + chunkSize);
 
-        for (int k = 0; k < nbOfComponents; ++k)
+        MCMPointer workModel = m_ReferenceModel->Clone();
+        vnl_vector <double> sphericalDirection(3), direction(3);
+        sphericalDirection[2] = 1.0;
+
+        for (unsigned int i = firstSlot;i < lastSlot;++i)
         {
-            if (std::isnan(myParameterValues[k]))
+            ModelImageType::PixelType modelVector = m_ModelImage->GetPixel(m_SlotIndexes[i]);
+            bool nullModel = true;
+            for (unsigned int j = 0;j < modelVector.GetSize();++j)
             {
-                std::cerr << "Output Nan for " << myParameters[k]->GetName() << " array" << std::endl;
-                exit(-1);
+                if (modelVector[j] != 0)
+                {
+                    nullModel = false;
+                    break;
+                }
             }
-        }
 
-        for (unsigned int i = 0;i < pos;++i)
-            myParameters[i]->SetValue(ptId, myParameterValues[i]);
-    }
-}
+            if (nullModel)
+                continue;
 
-typedef struct
-{
-    vtkPolyData *tracks;
-    anima::MCMLinearInterpolateImageFunction <anima::MCMImage <double, 3> > *mcmInterpolator;
-    std::vector < vtkSmartPointer <vtkDoubleArray> > myParameters;
-    anima::MultiCompartmentModel *mcm;
-} ThreaderArguments;
+            workModel->SetModelVector(modelVector);
+            double *slotValues = m_VoxelCache.data() + i * m_SlotStride;
+            slotValues[0] = 1.0;
 
-ITK_THREAD_RETURN_FUNCTION_CALL_CONVENTION ThreadLabeler(void *arg)
-{
-    itk::MultiThreaderBase::WorkUnitInfo *threadArgs = (itk::MultiThreaderBase::WorkUnitInfo *)arg;
-    unsigned int nbThread = threadArgs->WorkUnitID;
-    unsigned int numTotalThread = threadArgs->NumberOfWorkUnits;
+            for (unsigned int j = 0;j < m_IsotropicCompartments.size();++j)
+                slotValues[1 + j] = workModel->GetCompartmentWeight(m_IsotropicCompartments[j]);
 
-    ThreaderArguments *tmpArg = (ThreaderArguments *)threadArgs->UserData;
-    unsigned int nbTotalCells = tmpArg->tracks->GetNumberOfCells();
+            double *compartmentValues = slotValues + 1 + m_IsotropicCompartments.size();
+            for (unsigned int j = numIsotropicCompartments;j < numCompartments;++j)
+            {
+                compartmentValues[0] = workModel->GetCompartmentWeight(j);
+                if (compartmentValues[0] > 0)
+                {
+                    anima::BaseCompartment *compartment = workModel->GetCompartment(j);
+                    sphericalDirection[0] = compartment->GetOrientationTheta();
+                    sphericalDirection[1] = compartment->GetOrientationPhi();
+                    anima::TransformSphericalToCartesianCoordinates(sphericalDirection,direction);
+
+                    for (unsigned int k = 0;k < 3;++k)
+                        compartmentValues[1 + k] = direction[k];
+
+                    for (unsigned int k = 0;k < m_AnisotropicProperties.size();++k)
+                    {
+                        double propertyValue = 0;
+                        switch (m_AnisotropicProperties[k])
+                        {
+                            case ParallelDiffusivity:
+                                propertyValue = compartment->GetApparentParallelDiffusivity();
+                                break;
+
+                            case PerpendicularDiffusivity:
+                                propertyValue = compartment->GetApparentPerpendicularDiffusivity();
+                                break;
+
+                            case MeanDiffusivity:
+                                propertyValue = compartment->GetApparentMeanDiffusivity();
+                                break;
+
+                            case FractionalAnisotropy:
+                            default:
+                                propertyValue = compartment->GetApparentFractionalAnisotropy();
+                                break;
+                        }
+
+                        compartmentValues[4 + k] = propertyValue;
+                    }
+                }
+
+                compartmentValues += m_CompartmentStride;
+            }
+        }
+    }, nullptr);
+}
 
-    unsigned int step = nbTotalCells / numTotalThread;
-    unsigned int startIndex = nbThread * step;
-    unsigned int endIndex = (nbThread + 1) * step;
+void TrackMCMSampler::SampleTracks(vtkPolyData *tracks, std::vector < vtkSmartPointer <vtkDoubleArray> > &outputArrays)
+{
+    unsigned int numCells = tracks->GetNumberOfCells();
+    unsigned int numAnisotropicCompartments = m_ReferenceModel->GetNumberOfCompartments() - m_ReferenceModel->GetNumberOfIsotropicCompartments();
+    unsigned int numIsotropicValues = m_IsotropicCompartments.size();
+    unsigned int numAnisotropicValues = m_AnisotropicProperties.size();
 
-    if (nbThread == numTotalThread - 1)
-        endIndex = nbTotalCells;
+    itk::MultiThreaderBase::Pointer threader = itk::MultiThreaderBase::New();
+    threader->SetNumberOfWorkUnits(m_NumberOfThreads);
 
-    anima::MultiCompartmentModel::Pointer mcm = tmpArg->mcm->Clone();
-    vtkSmartPointer <vtkGenericCell> cell = vtkGenericCell::New();
-    for (int i = startIndex;i < endIndex;++i)
+    const unsigned int chunkSize = 256;
+    unsigned int numChunks = (numCells + chunkSize - 1) / chunkSize;
+    threader->ParallelizeArray(0, numChunks, [&](itk::SizeValueType chunk)
     {
-        tmpArg->tracks->GetCell(i,cell);
-        ComputePropertiesOnOneCell(cell, tmpArg->mcmInterpolator, tmpArg->myParameters, mcm);
-    }
+        unsigned int firstCell = chunk * chunkSize;
+        unsigned int lastCell = std::min(numCells, firstCell + chunkSize);
 
-    return ITK_THREAD_RETURN_DEFAULT_VALUE;
-}
+        vtkSmartPointer <vtkGenericCell> cell = vtkSmartPointer <vtkGenericCell>::New();
+        double nextPtPosition[3], lastPtPosition[3];
+        double trackDirection[3];
+        IndexType neighborIndex;
+        std::vector <double> isotropicValues(numIsotropicValues), anisotropicValues(numAnisotropicValues);
+
+        for (unsigned int i = firstCell;i < lastCell;++i)
+        {
+            tracks->GetCell(i,cell);
+            vtkPoints *cellPts = cell->GetPoints();
+            int nbOfCellPts = cellPts->GetNumberOfPoints();
 
+            for (int j = 0;j < nbOfCellPts;++j)
+            {
+                // Get the track direction
+                cellPts->GetPoint(std::min(nbOfCellPts - 1,j + 1),nextPtPosition);
+                cellPts->GetPoint(std::max(0,j - 1),lastPtPosition);
+
+                double directionNorm = 0;
+                for (unsigned int k = 0;k < 3;++k)
+                {
+                    trackDirection[k] = nextPtPosition[k] - lastPtPosition[k];
+                    directionNorm += trackDirection[k] * trackDirection[k];
+                }
+
+                directionNorm = std::sqrt(directionNorm);
+                if (directionNorm != 0)
+                {
+                    for (unsigned int k = 0;k < 3;++k)
+                        trackDirection[k] /= directionNorm;
+                }
+
+                vtkIdType ptId = cell->GetPointId(j);
+                const PointInterpolationType &interpolation = m_PointInterpolations[ptId];
+
+                std::fill(isotropicValues.begin(),isotropicValues.end(),0.0);
+                std::fill(anisotropicValues.begin(),anisotropicValues.end(),0.0);
+                double totalOverlap = 0;
+                double totalAnisotropicWeight = 0;
+
+                for (unsigned int k = 0;k < 8;++k)
+                {
+                    double overlap = this->GetNeighbor(interpolation,k,neighborIndex);
+                    if (overlap <= 0)
+                        continue;
+
+                    int voxelSlot = m_VoxelSlots[m_ModelImage->ComputeOffset(neighborIndex)];
+                    const double *slotValues = m_VoxelCache.data() + voxelSlot * m_SlotStride;
+                    if (slotValues[0] == 0)
+                        continue;
+
+                    totalOverlap += overlap;
+                    for (unsigned int l = 0;l < numIsotropicValues;++l)
+                        isotropicValues[l] += overlap * slotValues[1 + l];
+
+                    // Closest fascicle direction to the track one
+                    const double *compartmentValues = slotValues + 1 + numIsotropicValues;
+                    const double *selectedCompartment = 0;
+                    double maxDirectionDotProduct = -1;
+                    for (unsigned int l = 0;l < numAnisotropicCompartments;++l)
+                    {
+                        const double *currentCompartment = compartmentValues + l * m_CompartmentStride;
+                        if (currentCompartment[0] <= 0)
+                            continue;
+
+                        double dotProduct = std::abs(currentCompartment[1] * trackDirection[0] + currentCompartment[2] * trackDirection[1]
+                                                     + currentCompartment[3] * trackDirection[2]);
+
+                        if (dotProduct > maxDirectionDotProduct)
+                        {
+                            maxDirectionDotProduct = dotProduct;
+                            selectedCompartment = currentCompartment;
+                        }
+                    }
+
+                    if (!selectedCompartment)
+                        continue;
+
+                    double compartmentWeight = overlap * selectedCompartment[0];
+                    totalAnisotropicWeight += compartmentWeight;
+                    for (unsigned int l = 0;l < numAnisotropicValues;++l)
+                        anisotropicValues[l] += compartmentWeight * selectedCompartment[4 + l];
+                }
+
+                // Same rule as MCM linear interpolation: no value when most of the neighborhood is empty
+                if (totalOverlap < 0.5)
+                {
+                    for (unsigned int k = 0;k < outputArrays.size();++k)
+                        outputArrays[k]->SetValue(ptId,0);
+
+                    continue;
+                }
+
+                for (unsigned int k = 0;k < numAnisotropicValues;++k)
+                {
+                    if (totalAnisotropicWeight > 0)
+                        anisotropicValues[k] /= totalAnisotropicWeight;
+
+                    outputArrays[k]->SetValue(ptId,anisotropicValues[k]);
+                }
+
+                for (unsigned int k = 0;k < numIsotropicValues;++k)
+                    outputArrays[numAnisotropicValues + k]->SetValue(ptId,isotropicValues[k] / totalOverlap);
+            }
+        }
+    }, nullptr);
+}
 
 int main(int argc,  char **argv)
 {
     TCLAP::CmdLine cmd("INRIA / IRISA - VisAGeS/Empenn Team", ' ',ANIMA_VERSION);
 
-    TCLAP::ValueArg<std::string> inTrackArg("i","in-tracks","input tracks (.vtp,.vtk,.fds)",true,"","input tracks",cmd);
+    TCLAP::ValueArg<std::string> inTrackArg("i","in-tracks","input tracks (.vtp,.vtk,.fds,.atg)",true,"","input tracks",cmd);
     TCLAP::ValueArg<std::string> mcmArg("m","mcm","multi compartments model (.mcm)",true,"","multi compartments model",cmd);
-    TCLAP::ValueArg<std::string> outTrackArg("o","out-tracks","out tracks name (.vtp,.vtk,.fds)",true,"","output tracks",cmd);
+    TCLAP::ValueArg<std::string> outTrackArg("o","out-tracks","out tracks name (.vtp,.vtk,.fds,.atg)",true,"","output tracks",cmd);
+    TCLAP::ValueArg<std::string> propertiesArg("p","properties","Comma separated list of properties to extract among AD, RD, MD, FA, FW, IRW (default: all available)",false,"","properties",cmd);
 
     TCLAP::ValueArg<unsigned int> nbThreadsArg("T","nb-threads","Number of threads to run on (default: all available)",false,itk::MultiThreaderBase::GetGlobalDefaultNumberOfThreads(),"number of threads",cmd);
 
@@ -233,9 +466,6 @@ int main(int argc,  char **argv)
     typedef anima::MCMImage <double, 3> ModelImageType;
     typedef ModelImageType::Pointer ModelImagePointer;
 
-    typedef anima::MCMLinearInterpolateImageFunction <ModelImageType> mcmInterpolatorType;
-    typedef mcmInterpolatorType::Pointer mcmInterpolatorPointer;
-
     typedef anima::MultiCompartmentModel MCMType;
     typedef MCMType::Pointer MCMPointer;
 
@@ -246,84 +476,125 @@ int main(int argc,  char **argv)
     ModelImagePointer inputImage = mcmReader.GetModelVectorImage();
     MCMPointer mcm = inputImage->GetDescriptionModel();
 
-    anima::ShapesReader trackReader;
-    trackReader.SetFileName(inTrackArg.getValue());
-    trackReader.Update();
-
-    vtkSmartPointer<vtkPolyData> tracks = trackReader.GetOutput();
+    bool hasFW = false;
+    bool hasIRW = false;
+    for (unsigned int i = 0;i < mcm->GetNumberOfIsotropicCompartments();++i)
+    {
+        if (mcm->GetCompartment(i)->GetCompartmentType() == anima::FreeWater)
+            hasFW = true;
 
-    // Get dummy cell so that it's thread safe
-    vtkSmartPointer <vtkGenericCell> dummyCell = vtkGenericCell::New();
-    tracks->GetCell(0,dummyCell);
+        if (mcm->GetCompartment(i)->GetCompartmentType() == anima::IsotropicRestrictedWater)
+            hasIRW = true;
+    }
 
-    vtkIdType nbTotalPts = tracks->GetNumberOfPoints();
-    if (nbTotalPts == 0)
+    // Requested properties, anisotropic ones first
+    std::vector <bool> requestedProperties(NumberOfProperties,propertiesArg.getValue() == "");
+    std::stringstream propertiesStream(propertiesArg.getValue());
+    std::string propertyKey;
+    while (std::getline(propertiesStream,propertyKey,','))
     {
-        std::cout << "No points in track file, nothing to do" << std::endl;
-        return EXIT_SUCCESS;
+        bool knownProperty = false;
+        for (unsigned int i = 0;i < NumberOfProperties;++i)
+        {
+            if (propertyKey == PropertyKeys[i])
+            {
+                requestedProperties[i] = true;
+                knownProperty = true;
+            }
+        }
+
+        if (!knownProperty)
+        {
+            std::cerr << "Unknown property " << propertyKey << std::endl;
+            return EXIT_FAILURE;
+        }
     }
 
-    vtkIdType nbTotalCells = tracks->GetNumberOfCells();
+    requestedProperties[FreeWaterFraction] = requestedProperties[FreeWaterFraction] && hasFW;
+    requestedProperties[IsotropicRestrictedWaterFraction] = requestedProperties[IsotropicRestrictedWaterFraction] && hasIRW;
 
-    std::cout << "nbTotalPts : " << nbTotalPts << std::endl;
-    std::cout << "nbTotalCells : " << nbTotalCells << std::endl;
-
-    mcmInterpolatorPointer mcmInterpolator = mcmInterpolatorType::New();
-    mcmInterpolator->SetInputImage(inputImage);
-    mcmInterpolator->SetReferenceOutputModel(mcm);
+    std::vector <TrackPropertyType> properties;
+    for (unsigned int i = 0;i < NumberOfProperties;++i)
+    {
+        if (requestedProperties[i])
+            properties.push_back((TrackPropertyType)i);
+    }
 
-    int nbOfComponents = 4;
-    bool hasFW = false;
-    bool hasIRW = false;
-    for (unsigned int i = 0;i < mcm->GetNumberOfIsotropicCompartments();++i)
+    auto addPropertiesArrays = [&](vtkPolyData *tracks)
     {
-        if (mcm->GetCompartment(i)->GetCompartmentType() == anima::FreeWater)
+        vtkIdType nbTotalPts = tracks->GetNumberOfPoints();
+        std::vector < vtkSmartPointer <vtkDoubleArray> > myParameters(properties.size());
+        for (unsigned int i = 0;i < properties.size();++i)
         {
-            ++nbOfComponents;
-            hasFW = true;
+            myParameters[i] = vtkSmartPointer <vtkDoubleArray>::New();
+            myParameters[i]->SetNumberOfComponents(1);
+            myParameters[i]->SetNumberOfValues(nbTotalPts);
+            myParameters[i]->SetName(PropertyNames[properties[i]]);
         }
 
-        if (mcm->GetCompartment(i)->GetCompartmentType() == anima::IsotropicRestrictedWater)
+        return myParameters;
+    };
+
+    TrackMCMSampler sampler(inputImage,properties,nbThreadsArg.getValue());
+
+    if (anima::BinaryTractogramReader::IsBinaryTractogramFile(inTrackArg.getValue()) &&
+            anima::BinaryTractogramReader::IsBinaryTractogramFile(outTrackArg.getValue()))
+    {
+        // Binary tractograms are streamed chunk by chunk, the voxel cache growing with new voxels
+        anima::BinaryTractogramReader binaryReader;
+        binaryReader.SetFileName(inTrackArg.getValue());
+        binaryReader.Open();
+
+        std::cout << "nbTotalPts : " << binaryReader.GetNumberOfPoints() << std::endl;
+        std::cout << "nbTotalCells : " << binaryReader.GetNumberOfFibers() << std::endl;
+
+        anima::BinaryTractogramWriter binaryWriter;
+        binaryWriter.SetFileName(outTrackArg.getValue());
+        std::cout << "Writing tracks : " << outTrackArg.getValue() << std::endl;
+
+        // An input without chunks is read as one empty chunk so that the output file is still written
+        unsigned int numChunks = std::max(binaryReader.GetNumberOfChunks(),(unsigned int)1);
+        for (unsigned int i = 0;i < numChunks;++i)
         {
-            ++nbOfComponents;
-            hasIRW = true;
+            vtkSmartPointer <vtkPolyData> tracks = binaryReader.ReadChunk(i);
+            std::vector < vtkSmartPointer <vtkDoubleArray> > myParameters = addPropertiesArrays(tracks);
+
+            if (tracks->GetNumberOfCells() > 0)
+                sampler.Sample(tracks,myParameters);
+
+            for (unsigned int j = 0;j < myParameters.size();++j)
+                tracks->GetPointData()->AddArray(myParameters[j]);
+
+            binaryWriter.WriteChunk(tracks);
         }
-    }
 
-    std::vector < vtkSmartPointer <vtkDoubleArray> > myParameters(nbOfComponents);
-    for (int i = 0; i < nbOfComponents; ++i)
-    {
-        myParameters[i] = vtkDoubleArray::New();
-        myParameters[i]->SetNumberOfComponents(1);
-        myParameters[i]->SetNumberOfValues(nbTotalPts);
+        binaryWriter.Close();
+        return EXIT_SUCCESS;
     }
 
-    myParameters[0]->SetName("Parallel diffusivity");
-    myParameters[1]->SetName("Perpendicular diffusivity");
-    myParameters[2]->SetName("Mean diffusivity");
-    myParameters[3]->SetName("Fractional anisotropy");
-    unsigned int pos = 4;
-    if (hasFW)
+    anima::ShapesReader trackReader;
+    trackReader.SetFileName(inTrackArg.getValue());
+    trackReader.Update();
+
+    vtkSmartPointer<vtkPolyData> tracks = trackReader.GetOutput();
+
+    vtkIdType nbTotalPts = tracks->GetNumberOfPoints();
+    if (nbTotalPts == 0)
     {
-        myParameters[pos]->SetName("Free water fraction");
-        ++pos;
+        std::cout << "No points in track file, nothing to do" << std::endl;
+        return EXIT_SUCCESS;
     }
 
-    if (hasIRW)
-        myParameters[pos]->SetName("Isotropic restricted water fraction");
+    vtkIdType nbTotalCells = tracks->GetNumberOfCells();
 
-    ThreaderArguments tmpStr;
-    tmpStr.mcm = mcm;
-    tmpStr.mcmInterpolator = mcmInterpolator;
-    tmpStr.myParameters = myParameters;
-    tmpStr.tracks = tracks;
+    std::cout << "nbTotalPts : " << nbTotalPts << std::endl;
+    std::cout << "nbTotalCells : " << nbTotalCells << std::endl;
 
-    itk::PoolMultiThreader::Pointer mThreader = itk::PoolMultiThreader::New();
-    mThreader->SetNumberOfWorkUnits(nbThreadsArg.getValue());
-    mThreader->SetSingleMethod(ThreadLabeler,&tmpStr);
-    mThreader->SingleMethodExecute();
+    unsigned int nbOfComponents = properties.size();
+    std::vector < vtkSmartPointer <vtkDoubleArray> > myParameters = addPropertiesArrays(tracks);
+    sampler.Sample(tracks,myParameters);
 
-    for (int i = 0; i < nbOfComponents; ++i)
+    for (unsigned int i = 0;i < nbOfComponents;++i)
     {
         std::cout << "Add an array for " << myParameters[i]->GetName() << std::endl;
         tracks->GetPointData()->AddArray(myParameters[i]);
@@ -1,7 +1,6 @@
 #include <animaNODDICompartment.h>
 #include <animaVectorOperations.h>
-#include <animaErrorFunctions.h>
-#include <animaKummerFunctions.h>
+#include <animaFastSpecialFunctions.h>
 #include <animaWatsonDistribution.h>
 #include <animaMCMConstants.h>
 #include <boost/math/special_functions/legendre.hpp>
@@ -9,6 +8,30 @@
 namespace anima
 {
 
+namespace
+{
+
+//! Tables of M(-x, i + 1/2, 2i + 3/2) (signal) and M(-x, i + 3/2, 2i + 5/2) (axial derivative) for each Watson SH order
+const NegativeKummerFunctionTable &GetNODDIKummerTable(unsigned int order, bool derivative)
+{
+    const unsigned int numOrders = 7;
+    static const std::vector <NegativeKummerFunctionTable> kummerTables = []
+    {
+        std::vector <NegativeKummerFunctionTable> tables;
+        for (unsigned int i = 0;i < numOrders;++i)
+            tables.push_back(NegativeKummerFunctionTable(i + 0.5, 2.0 * i + 1.5));
+
+        for (unsigned int i = 0;i < numOrders;++i)
+            tables.push_back(NegativeKummerFunctionTable(i + 1.5, 2.0 * i + 2.5));
+
+        return tables;
+    }();
+
+    return kummerTables[derivative ? order + numOrders : order];
+}
+
+} // end of anonymous namespace
+
 void NODDICompartment::UpdateSignals(double bValue, const Vector3DType &gradient)
 {
     if (std::abs(bValue - m_CurrentBValue) < 1.0e-6 && anima::ComputeNorm(gradient - m_CurrentGradient) < 1.0e-6 && !m_ModifiedParameters)
@@ -50,7 +73,7 @@ void NODDICompartment::UpdateSignals(double bValue, const Vector3DType &gradient
         double coefVal = m_WatsonSHCoefficients[i];
         double sqrtVal = std::sqrt((4.0 * i + 1.0) / (4.0 * M_PI));
         double legendreVal = boost::math::legendre_p(2 * i, innerProd);
-        double kummerVal = anima::GetKummerFunctionValue(-x, i + 0.5, 2.0 * i + 1.5) * std::tgamma(i + 0.5) / std::tgamma(2.0 * i + 1.5);
+        double kummerVal = GetNODDIKummerTable(i,false).Evaluate(x) * std::tgamma(i + 0.5) / std::tgamma(2.0 * i + 1.5);
         double xPowVal = std::pow(-x, (double)i);
         double cVal = xPowVal * kummerVal;
         
@@ -64,7 +87,7 @@ void NODDICompartment::UpdateSignals(double bValue, const Vector3DType &gradient
         double cDerivVal = 0.0;
         if (m_EstimateAxialDiffusivity)
         {
-            cDerivVal = -xPowVal * anima::GetKummerFunctionValue(-x, i + 1.5, 2.0 * i + 2.5) * std::tgamma(i + 1.5) / std::tgamma(2.0 * i + 2.5);
+            cDerivVal = -xPowVal * GetNODDIKummerTable(i,true).Evaluate(x) * std::tgamma(i + 1.5) / std::tgamma(2.0 * i + 2.5);
             if (i > 0)
                 cDerivVal += xPowVal * i * kummerVal / x;
         }
@@ -491,7 +514,7 @@ void NODDICompartment::UpdateKappaValues()
         return;
     
     double kappa = this->GetOrientationConcentration();
-    double dawsonValue = anima::EvaluateDawsonIntegral(std::sqrt(kappa), true);
+    double dawsonValue = anima::FastEvaluateDawsonIntegral(std::sqrt(kappa), true);
     m_Tau1 = (1.0 / dawsonValue - 1.0) / (2.0 * kappa);
     m_Tau1Deriv = (1.0 - (1.0 - dawsonValue * (2.0 * kappa - 1.0)) / (2.0 * dawsonValue * dawsonValue)) / (2.0 * kappa * kappa);
     anima::GetStandardWatsonSHCoefficients(kappa,m_WatsonSHCoefficients,m_WatsonSHCoefficientDerivatives);
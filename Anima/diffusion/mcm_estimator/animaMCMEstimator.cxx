@@ -75,6 +75,7 @@ int main(int argc,  char **argv)
     TCLAP::ValueArg<double> xTolArg("x", "x-tol", "Tolerance for relative position in optimization (default: 0 -> 1.0e-4 or 1.0e-7 for bobyqa)", false, 0, "position relative tolerance", cmd);
     TCLAP::ValueArg<double> fTolArg("", "f-tol", "Tolerance for relative cost in optimization (default: 0 -> function of position tolerance)", false, 0, "cost relative tolerance", cmd);
     TCLAP::ValueArg<unsigned int> maxEvalArg("e", "max-eval", "Maximum evaluations (default: 0 -> function of number of unknowns)", false, 0, "max evaluations", cmd);
+    TCLAP::SwitchArg cachedSparseArg("", "cached-sparse-nnls", "Solve sparse sticks initialization through cached normal equations (faster, less accurate for ill-conditioned dictionaries)", cmd, false);
 
     TCLAP::ValueArg<unsigned int> nbThreadsArg("T", "nb-threads", "Number of threads to run on (default: all cores)", false, itk::MultiThreaderBase::GetGlobalDefaultNumberOfThreads(), "number of threads", cmd);
 
@@ -190,6 +191,7 @@ int main(int argc,  char **argv)
     filter->SetXTolerance(xTolArg.getValue());
     filter->SetFTolerance(fTolArg.getValue());
     filter->SetMaxEval(maxEvalArg.getValue());
+    filter->SetUseCachedSparseFactorizations(cachedSparseArg.isSet());
 
     filter->SetUseConstrainedDiffusivity(fixDiffArg.isSet());
     filter->SetUseConstrainedFreeWaterDiffusivity(!optFWDiffArg.isSet());
@@ -8,6 +8,7 @@
 #include <itkSingleValuedCostFunction.h>
 
 #include <animaMultiCompartmentModelCreator.h>
+#include <animaNNLSOptimizer.h>
 #include <itkCostFunction.h>
 #include <itkNonLinearOptimizer.h>
 
@@ -159,6 +160,9 @@ public:
     itkSetMacro(FTolerance, double)
     itkSetMacro(MaxEval, unsigned int)
 
+    //! Solve the sparse sticks NNLS through normal equations with cached factorizations (faster but squares the dictionary condition number)
+    itkSetMacro(UseCachedSparseFactorizations, bool)
+
 protected:
     MCMEstimatorImageFilter() : Superclass()
     {
@@ -209,6 +213,8 @@ protected:
         m_NumberOfImages = 0;
         m_ExternalMoseVolume = false;
 
+        m_UseCachedSparseFactorizations = false;
+
         m_MaxEval = 0;
         m_XTolerance = 0;
         m_FTolerance = 0;
@@ -309,6 +315,8 @@ private:
 
     //! Sparse dictionary for pre-, rough estimation of directions in sticks
     vnl_matrix <double> m_SparseSticksDictionary;
+    std::vector <anima::NNLSOptimizer::Pointer> m_SparseSticksOptimizers;
+    bool m_UseCachedSparseFactorizations;
     unsigned int m_NumberOfDictionaryEntries;
     std::vector < std::vector <double> > m_DictionaryDirections;
 
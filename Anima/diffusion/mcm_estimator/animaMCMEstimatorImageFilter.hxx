@@ -252,6 +252,15 @@ MCMEstimatorImageFilter<InputPixelType, OutputPixelType>
 
     // Sparse pre-computation
     this->InitializeDictionary();
+
+    m_SparseSticksOptimizers.resize(this->GetNumberOfWorkUnits());
+    for (unsigned int i = 0;i < this->GetNumberOfWorkUnits();++i)
+    {
+        m_SparseSticksOptimizers[i] = anima::NNLSOptimizer::New();
+        m_SparseSticksOptimizers[i]->SetDataMatrix(m_SparseSticksDictionary);
+        m_SparseSticksOptimizers[i]->SetSquaredProblem(false);
+        m_SparseSticksOptimizers[i]->SetUseCachedFactorizations(m_UseCachedSparseFactorizations);
+    }
 }
 
 template <class InputPixelType, class OutputPixelType>
@@ -1342,9 +1351,8 @@ MCMEstimatorImageFilter<InputPixelType, OutputPixelType>
     unsigned int numNonIsotropicComponents = complexModel->GetNumberOfCompartments() - numIsotropicComponents;
     unsigned int numCompartments = complexModel->GetNumberOfCompartments();
 
-    //First compute sparse solution as NNLS optmization
-    anima::NNLSOptimizer::Pointer sparseOptimizer = anima::NNLSOptimizer::New();
-    sparseOptimizer->SetDataMatrix(m_SparseSticksDictionary);
+    //First compute sparse solution as NNLS optmization, one optimizer per thread being reused across voxels
+    anima::NNLSOptimizer::Pointer sparseOptimizer = m_SparseSticksOptimizers[threadId];
 
     unsigned int dictionarySize = m_SparseSticksDictionary.cols();
     unsigned int numSignals = observedSignals.size();
@@ -1356,7 +1364,6 @@ MCMEstimatorImageFilter<InputPixelType, OutputPixelType>
         rightHandValues *= -1;
 
     sparseOptimizer->SetPoints(rightHandValues);
-    sparseOptimizer->SetSquaredProblem(false);
     sparseOptimizer->StartOptimization();
 
     // Get atom weights and determine the number of non null weighted components, first quartile of their weights
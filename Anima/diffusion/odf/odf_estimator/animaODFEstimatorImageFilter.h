@@ -127,6 +127,7 @@ private:
     bool m_Normalize;
     std::string m_FileNameSphereTesselation;
     std::vector < std::vector <double> > m_SphereSHSampling;
+    std::vector <double> m_SphereSHIntegrals;
 
     double m_Lambda;
     double m_SharpnessRatio; // See Descoteaux et al. TMI 2009, article plus appendix
@@ -134,6 +135,8 @@ private:
     bool m_UseAganjEstimation;
     double m_DeltaAganjRegularization;
     unsigned int m_LOrder;
+
+    static const unsigned int m_TileSize = 64;
 };
 
 } // end of namespace anima
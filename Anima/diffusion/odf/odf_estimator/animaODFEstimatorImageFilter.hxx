@@ -241,6 +241,17 @@ ODFEstimatorImageFilter<TInputPixelType,TOutputPixelType>
             m_SphereSHSampling.push_back(shData);
         }
         sphereIn.close();
+
+        // SH functions summed over the sphere once and for all, normalization being then a dot product per voxel
+        m_SphereSHIntegrals.resize(vectorLength);
+        for (unsigned int j = 0;j < vectorLength;++j)
+        {
+            long double integralValue = 0;
+            for (unsigned int i = 0;i < m_SphereSHSampling.size();++i)
+                integralValue += m_SphereSHSampling[i][j];
+
+            m_SphereSHIntegrals[j] = integralValue;
+        }
     }
     else
         m_Normalize = false;
@@ -262,7 +273,7 @@ ODFEstimatorImageFilter<TInputPixelType,TOutputPixelType>
     OutputIteratorType resIt(this->GetOutput(),outputRegionForThread);
 
     std::vector<InputIteratorType> diffusionIts(numGrads);
-    std::vector<InputIteratorType> b0Its(numGrads);
+    std::vector<InputIteratorType> b0Its(numB0);
     for (unsigned int i = 0;i < numGrads;++i)
         diffusionIts[i] = InputIteratorType(this->GetInput(m_GradientIndexes[i]),outputRegionForThread);
     for (unsigned int i = 0;i < numB0;++i)
@@ -276,137 +287,165 @@ ODFEstimatorImageFilter<TInputPixelType,TOutputPixelType>
     OutputScalarIteratorType outB0Itr(m_EstimatedB0Image, outputRegionForThread);
 
     itk::VariableLengthVector <TOutputPixelType> outputData(vectorLength);
-    std::vector <double> tmpData(numGrads,0);
+
+    // Consecutive voxels are processed by tiles, stored as matrices with one column per voxel. SH fit and signal prediction
+    // are then each a single matrix-matrix product. Columns after the number of voxels of the last (partial) tile hold
+    // values of the previous tile and are ignored
+    std::vector <double> tileRawSignals(m_TileSize * numGrads);
+    std::vector <double> tileB0Signals(m_TileSize * numB0);
+    std::vector <double> tileB0Values(m_TileSize);
+    std::vector <bool> tileValidVoxels(m_TileSize);
+    vnl_matrix <double> tileFitSignals(numGrads,m_TileSize,0.0);
+    vnl_matrix <double> tileCoefficients(vectorLength,m_TileSize,0.0);
+    vnl_matrix <double> tileScaledCoefficients(vectorLength,m_TileSize,0.0);
+    vnl_matrix <double> tilePredictedSignals(numGrads,m_TileSize,0.0);
+
     while (!diffusionIts[0].IsAtEnd())
     {
-        double b0Value = 0;
-        if (m_ReferenceB0Image.IsNotNull())
-            b0Value = refB0Itr.Get();
-        else
+        // Gather signals, fusing the Aganj transform into the copy
+        unsigned int numTileVoxels = 0;
+        while ((numTileVoxels < m_TileSize) && (!diffusionIts[0].IsAtEnd()))
         {
+            double b0Value = 0;
+            double *b0Signals = tileB0Signals.data() + numTileVoxels * numB0;
             for (unsigned int i = 0;i < numB0;++i)
-                b0Value += b0Its[i].Get();
-
-            b0Value /= numB0;
-        }
-
-        for (unsigned int i = 0;i < numGrads;++i)
-            tmpData[i] = diffusionIts[i].Get();
-
-        for (unsigned int i = 0;i < vectorLength;++i)
-            outputData[i] = 0;
+            {
+                b0Signals[i] = b0Its[i].Get();
+                b0Value += b0Signals[i];
+                ++b0Its[i];
+            }
 
-        if ((isZero(tmpData))||(b0Value <= 0))
-        {
-            resIt.Set(outputData);
-            outB0Itr.Set(0.0);
-            varItr.Set(0.0);
-            ++resIt;
-            ++outB0Itr;
-            ++varItr;
+            if (m_ReferenceB0Image.IsNotNull())
+            {
+                b0Value = refB0Itr.Get();
+                ++refB0Itr;
+            }
+            else
+                b0Value /= numB0;
 
+            double *rawSignals = tileRawSignals.data() + numTileVoxels * numGrads;
+            bool zeroSignal = true;
             for (unsigned int i = 0;i < numGrads;++i)
-                ++diffusionIts[i];
+            {
+                rawSignals[i] = diffusionIts[i].Get();
+                if (rawSignals[i] != 0)
+                    zeroSignal = false;
 
-            for (unsigned int i = 0;i < numB0;++i)
-                ++b0Its[i];
+                ++diffusionIts[i];
+            }
 
-            continue;
-        }
+            tileB0Values[numTileVoxels] = b0Value;
+            tileValidVoxels[numTileVoxels] = (!zeroSignal) && (b0Value > 0);
 
-        if (m_UseAganjEstimation)
-        {
-            for (unsigned int i = 0;i < numGrads;++i)
+            if (m_UseAganjEstimation && tileValidVoxels[numTileVoxels])
             {
-                double e = tmpData[i] / b0Value;
-
-                if (e < 0)
-                    tmpData[i] = m_DeltaAganjRegularization / 2.0;
-                else if (e < m_DeltaAganjRegularization)
-                    tmpData[i] = m_DeltaAganjRegularization / 2.0 + e * e / (2.0 * m_DeltaAganjRegularization);
-                else if (e < 1.0 - m_DeltaAganjRegularization)
-                    tmpData[i] = e;
-                else if (e < 1)
-                    tmpData[i] = 1.0 - m_DeltaAganjRegularization / 2.0 - (1.0 - e) * (1.0 - e) / (2.0 * m_DeltaAganjRegularization);
-                else
-                    tmpData[i] = 1.0 - m_DeltaAganjRegularization / 2.0;
-
-                tmpData[i] = std::log(-std::log(tmpData[i]));
+                for (unsigned int i = 0;i < numGrads;++i)
+                {
+                    double e = rawSignals[i] / b0Value;
+                    double fitValue;
+
+                    if (e < 0)
+                        fitValue = m_DeltaAganjRegularization / 2.0;
+                    else if (e < m_DeltaAganjRegularization)
+                        fitValue = m_DeltaAganjRegularization / 2.0 + e * e / (2.0 * m_DeltaAganjRegularization);
+                    else if (e < 1.0 - m_DeltaAganjRegularization)
+                        fitValue = e;
+                    else if (e < 1)
+                        fitValue = 1.0 - m_DeltaAganjRegularization / 2.0 - (1.0 - e) * (1.0 - e) / (2.0 * m_DeltaAganjRegularization);
+                    else
+                        fitValue = 1.0 - m_DeltaAganjRegularization / 2.0;
+
+                    tileFitSignals(i,numTileVoxels) = std::log(-std::log(fitValue));
+                }
             }
+            else
+            {
+                for (unsigned int i = 0;i < numGrads;++i)
+                    tileFitSignals(i,numTileVoxels) = rawSignals[i];
+            }
+
+            ++numTileVoxels;
         }
 
-        double zeroValue = 1.0;
-        if (b0Value > 0)
-        {
-            for (unsigned int i = 0;i < vectorLength;++i)
-                for (unsigned int j = 0;j < numGrads;++j)
-                    outputData[i] += m_TMatrix(i,j)*tmpData[j];
+        tileCoefficients = m_TMatrix * tileFitSignals;
 
+        // b0 normalization (or Aganj constant term), and coefficients scaled back for signal prediction
+        for (unsigned int v = 0;v < numTileVoxels;++v)
+        {
             if (!m_UseAganjEstimation)
             {
                 for (unsigned int i = 0;i < vectorLength;++i)
-                    outputData[i] /= b0Value;
+                    tileCoefficients(i,v) /= tileB0Values[v];
             }
             else
             {
-                zeroValue = outputData[0];
-                outputData[0] = 1/(2*sqrt(M_PI));
+                tileScaledCoefficients(0,v) = tileCoefficients(0,v);
+                tileCoefficients(0,v) = 1/(2*sqrt(M_PI));
             }
+
+            unsigned int startI = m_UseAganjEstimation ? 1 : 0;
+            for (unsigned int i = startI;i < vectorLength;++i)
+                tileScaledCoefficients(i,v) = tileCoefficients(i,v) / m_PVector[i];
         }
 
-        double noiseVariance = 0.0;
-        for (unsigned int i = 0;i < numGrads;++i)
+        tilePredictedSignals = m_BMatrix * tileScaledCoefficients;
+
+        for (unsigned int v = 0;v < numTileVoxels;++v)
         {
-            double signalSim = 0.0;
-            for (unsigned int j = 0;j < vectorLength;++j)
+            if (!tileValidVoxels[v])
             {
-                if ((j == 0) && (m_UseAganjEstimation))
-                    signalSim += m_BMatrix(i,j) * zeroValue;
-                else
-                    signalSim += m_BMatrix(i,j) * outputData[j] / m_PVector[j];
+                outputData.Fill(0.0);
+                resIt.Set(outputData);
+                outB0Itr.Set(0.0);
+                varItr.Set(0.0);
+
+                ++resIt;
+                ++outB0Itr;
+                ++varItr;
+                continue;
             }
 
-            if (!m_UseAganjEstimation)
-                signalSim *= b0Value;
-            else
-                signalSim = b0Value * std::exp(- std::exp(signalSim));
+            double b0Value = tileB0Values[v];
+            const double *rawSignals = tileRawSignals.data() + v * numGrads;
+            const double *b0Signals = tileB0Signals.data() + v * numB0;
 
-            double signalValue = diffusionIts[i].Get();
-            noiseVariance += (signalSim - signalValue) * (signalSim - signalValue);
-        }
-
-        for (unsigned int i = 0;i < numB0;++i)
-        {
-            double b0Signal = b0Its[i].Get();
-            noiseVariance += (b0Value - b0Signal) * (b0Value - b0Signal);
-        }
+            double noiseVariance = 0.0;
+            for (unsigned int i = 0;i < numGrads;++i)
+            {
+                double signalSim = tilePredictedSignals(i,v);
+                if (!m_UseAganjEstimation)
+                    signalSim *= b0Value;
+                else
+                    signalSim = b0Value * std::exp(- std::exp(signalSim));
 
-        noiseVariance /= (numGrads + numB0);
-        varItr.Set(noiseVariance);
+                noiseVariance += (signalSim - rawSignals[i]) * (signalSim - rawSignals[i]);
+            }
 
-        outB0Itr.Set(b0Value);
+            for (unsigned int i = 0;i < numB0;++i)
+                noiseVariance += (b0Value - b0Signals[i]) * (b0Value - b0Signals[i]);
 
-        if (m_Normalize)
-        {
-            long double integralODF = 0;
-            for (unsigned int i = 0;i < m_SphereSHSampling.size();++i)
-                for (unsigned int j = 0;j < vectorLength;++j)
-                    integralODF += m_SphereSHSampling[i][j]*outputData[j];
+            noiseVariance /= (numGrads + numB0);
+            varItr.Set(noiseVariance);
+            outB0Itr.Set(b0Value);
 
             for (unsigned int i = 0;i < vectorLength;++i)
-                outputData[i] /= integralODF;
-        }
+                outputData[i] = tileCoefficients(i,v);
 
-        resIt.Set(outputData);
-        ++resIt;
-        ++outB0Itr;
-        ++varItr;
+            if (m_Normalize)
+            {
+                long double integralODF = 0;
+                for (unsigned int j = 0;j < vectorLength;++j)
+                    integralODF += m_SphereSHIntegrals[j] * outputData[j];
 
-        for (unsigned int i = 0;i < numGrads;++i)
-            ++diffusionIts[i];
+                for (unsigned int i = 0;i < vectorLength;++i)
+                    outputData[i] /= integralODF;
+            }
 
-        for (unsigned int i = 0;i < numB0;++i)
-            ++b0Its[i];
+            resIt.Set(outputData);
+            ++resIt;
+            ++outB0Itr;
+            ++varItr;
+        }
     }
 }
     
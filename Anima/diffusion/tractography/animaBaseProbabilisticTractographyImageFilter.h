@@ -7,11 +7,10 @@
 #include <vtkSmartPointer.h>
 #include <itkProcessObject.h>
 #include <itkLinearInterpolateImageFunction.h>
-#include <mutex>
-#include <itkProgressReporter.h>
 
 #include <vector>
 #include <random>
+#include <atomic>
 
 namespace anima
 {
@@ -65,10 +64,11 @@ public:
     typedef std::vector <FiberType> FiberProcessVectorType;
     typedef std::vector <unsigned int> MembershipType;
 
+    //! Results are stored per seed so that the output does not depend on the threads scheduling
     typedef struct {
         BaseProbabilisticTractographyImageFilter *trackerPtr;
-        std::vector <FiberProcessVectorType> resultFibersFromThreads;
-        std::vector <ListType> resultWeightsFromThreads;
+        std::vector <FiberProcessVectorType> resultFibersFromSeeds;
+        std::vector <ListType> resultWeightsFromSeeds;
     } trackerArguments;
 
     struct pair_comparator
@@ -162,6 +162,10 @@ public:
     itkSetMacro(ModelDimension, unsigned int)
     itkGetMacro(ModelDimension, unsigned int)
 
+    //! Master random seed, tractograms are identical for a given seed whatever the number of threads
+    itkSetMacro(RandomSeed, unsigned int)
+    itkGetMacro(RandomSeed, unsigned int)
+
     void Update() ITK_OVERRIDE;
 
     void createVTKOutput(FiberProcessVectorType &filteredFibers, ListType &filteredWeights);
@@ -174,14 +178,18 @@ protected:
     //! Multithread util function
     static ITK_THREAD_RETURN_FUNCTION_CALL_CONVENTION ThreadTracker(void *arg);
 
-    //! Doing the thread work dispatch
-    void ThreadTrack(unsigned int numThread, FiberProcessVectorType &resultFibers, ListType &resultWeights);
+    //! Doing the thread work dispatch: seeds are grabbed from an atomic counter by chunks shrinking with remaining work
+    void ThreadTrack(unsigned int numThread, std::vector <FiberProcessVectorType> &resultFibers,
+                     std::vector <ListType> &resultWeights);
 
-    //! Doing the real tracking by calling ComputeFiber and merging its results
-    void ThreadedTrackComputer(unsigned int numThread, FiberProcessVectorType &resultFibers,
-                               ListType &resultWeights, unsigned int startSeedIndex,
+    //! Doing the real tracking by calling ComputeFiber and merging its results, stored at each seed index
+    void ThreadedTrackComputer(unsigned int numThread, std::vector <FiberProcessVectorType> &resultFibers,
+                               std::vector <ListType> &resultWeights, unsigned int startSeedIndex,
                                unsigned int endSeedIndex);
 
+    //! Counter based seed of the random stream of a seed point, derived from the master seed and the seed index
+    uint64_t ComputeSeedRandomSeed(unsigned int seedIndex);
+
     //! This little guy is the one handling probabilistic tracking
     FiberProcessVectorType ComputeFiber(FiberType &fiber, InterpolatorPointer &modelInterpolator,
                                         unsigned int numThread, ListType &resultWeights);
@@ -272,9 +280,10 @@ private:
 
     vtkSmartPointer<vtkPolyData> m_Output;
 
-    std::mutex m_LockHighestProcessedSeed;
-    int m_HighestProcessedSeed;
-    itk::ProgressReporter *m_ProgressReport;
+    unsigned int m_RandomSeed;
+
+    std::atomic <unsigned int> m_HighestProcessedSeed;
+    std::atomic <unsigned int> m_NumberOfProcessedSeeds;
 };
 
 }//end of namesapce
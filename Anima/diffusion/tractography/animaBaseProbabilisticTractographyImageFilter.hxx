@@ -55,17 +55,16 @@ BaseProbabilisticTractographyImageFilter <TInputModelImageType>
     m_InitialDirectionMode = Weight;
 
     m_Generators.clear();
+    m_RandomSeed = time(0);
 
     m_HighestProcessedSeed = 0;
-    m_ProgressReport = 0;
+    m_NumberOfProcessedSeeds = 0;
 }
 
 template <class TInputModelImageType>
 BaseProbabilisticTractographyImageFilter <TInputModelImageType>
 ::~BaseProbabilisticTractographyImageFilter()
 {
-    if (m_ProgressReport)
-        delete m_ProgressReport;
 }
 
 template <class TInputModelImageType>
@@ -76,41 +75,27 @@ BaseProbabilisticTractographyImageFilter <TInputModelImageType>
     this->PrepareTractography();
     m_Output = vtkPolyData::New();
 
-    if (m_ProgressReport)
-        delete m_ProgressReport;
-
-    unsigned int stepData = std::min((int)m_PointsToProcess.size(),100);
-    if (stepData == 0)
-        stepData = 1;
-
-    unsigned int numSteps = std::floor(m_PointsToProcess.size() / (double)stepData);
-    if (m_PointsToProcess.size() % stepData != 0)
-        numSteps++;
-
-    m_ProgressReport = new itk::ProgressReporter(this,0,numSteps);
+    m_HighestProcessedSeed = 0;
+    m_NumberOfProcessedSeeds = 0;
+    this->UpdateProgress(0.0);
 
     FiberProcessVectorType resultFibers;
     ListType resultWeights;
 
     trackerArguments tmpStr;
     tmpStr.trackerPtr = this;
-    tmpStr.resultFibersFromThreads.resize(this->GetNumberOfWorkUnits());
-    tmpStr.resultWeightsFromThreads.resize(this->GetNumberOfWorkUnits());
-
-    for (unsigned int i = 0;i < this->GetNumberOfWorkUnits();++i)
-    {
-        tmpStr.resultFibersFromThreads[i] = resultFibers;
-        tmpStr.resultWeightsFromThreads[i] = resultWeights;
-    }
+    tmpStr.resultFibersFromSeeds.resize(m_PointsToProcess.size());
+    tmpStr.resultWeightsFromSeeds.resize(m_PointsToProcess.size());
 
     this->GetMultiThreader()->SetNumberOfWorkUnits(this->GetNumberOfWorkUnits());
     this->GetMultiThreader()->SetSingleMethod(this->ThreadTracker,&tmpStr);
     this->GetMultiThreader()->SingleMethodExecute();
 
-    for (unsigned int j = 0;j < this->GetNumberOfWorkUnits();++j)
+    // Gathered in seed order, independently of which thread tracked each seed
+    for (unsigned int j = 0;j < m_PointsToProcess.size();++j)
     {
-        resultFibers.insert(resultFibers.end(),tmpStr.resultFibersFromThreads[j].begin(),tmpStr.resultFibersFromThreads[j].end());
-        resultWeights.insert(resultWeights.end(),tmpStr.resultWeightsFromThreads[j].begin(),tmpStr.resultWeightsFromThreads[j].end());
+        resultFibers.insert(resultFibers.end(),tmpStr.resultFibersFromSeeds[j].begin(),tmpStr.resultFibersFromSeeds[j].end());
+        resultWeights.insert(resultWeights.end(),tmpStr.resultWeightsFromSeeds[j].begin(),tmpStr.resultWeightsFromSeeds[j].end());
     }
 
     std::cout << "\nKept " << resultFibers.size() << " fibers after filtering" << std::endl;
@@ -134,14 +119,9 @@ BaseProbabilisticTractographyImageFilter <TInputModelImageType>
     m_NoiseInterpolator = ScalarInterpolatorType::New();
     m_NoiseInterpolator->SetInputImage(m_NoiseImage);
 
-    // Initialize random generator
+    // Initialize random generators, seeded again for each seed point when tracking
     m_Generators.resize(this->GetNumberOfWorkUnits());
 
-    std::mt19937 motherGenerator(time(0));
-
-    for (unsigned int i = 0;i < this->GetNumberOfWorkUnits();++i)
-        m_Generators[i] = std::mt19937(motherGenerator());
-
     bool is2d = m_InputModelImage->GetLargestPossibleRegion().GetSize()[2] == 1;
     if (is2d && (m_InitialColinearityDirection == Top))
         m_InitialColinearityDirection = Front;
@@ -272,7 +252,7 @@ BaseProbabilisticTractographyImageFilter <TInputModelImageType>
     unsigned int nbThread = threadArgs->WorkUnitID;
 
     trackerArguments *tmpArg = (trackerArguments *)threadArgs->UserData;
-    tmpArg->trackerPtr->ThreadTrack(nbThread,tmpArg->resultFibersFromThreads[nbThread],tmpArg->resultWeightsFromThreads[nbThread]);
+    tmpArg->trackerPtr->ThreadTrack(nbThread,tmpArg->resultFibersFromSeeds,tmpArg->resultWeightsFromSeeds);
 
     return ITK_THREAD_RETURN_DEFAULT_VALUE;
 }
@@ -280,49 +260,59 @@ BaseProbabilisticTractographyImageFilter <TInputModelImageType>
 template <class TInputModelImageType>
 void
 BaseProbabilisticTractographyImageFilter <TInputModelImageType>
-::ThreadTrack(unsigned int numThread, FiberProcessVectorType &resultFibers,
-              ListType &resultWeights)
+::ThreadTrack(unsigned int numThread, std::vector <FiberProcessVectorType> &resultFibers,
+              std::vector <ListType> &resultWeights)
 {
-    bool continueLoop = true;
     unsigned int highestToleratedSeedIndex = m_PointsToProcess.size();
+    unsigned int numThreads = std::max((unsigned int)this->GetNumberOfWorkUnits(),(unsigned int)1);
 
-    unsigned int stepData = std::min((int)m_PointsToProcess.size(),100);
-    if (stepData == 0)
-        stepData = 1;
-
-    while (continueLoop)
+    // Guided scheduling: chunks are a fraction of the remaining seeds, from 100 seeds down to a single one at the end
+    const unsigned int maximalChunkSize = 100;
+    unsigned int startPoint = m_HighestProcessedSeed.load();
+    while (startPoint < highestToleratedSeedIndex)
     {
-        m_LockHighestProcessedSeed.lock();
+        unsigned int chunkSize = (highestToleratedSeedIndex - startPoint) / (4 * numThreads);
+        chunkSize = std::max((unsigned int)1,std::min(chunkSize,maximalChunkSize));
+        unsigned int endPoint = std::min(startPoint + chunkSize,highestToleratedSeedIndex);
 
-        if (m_HighestProcessedSeed >= highestToleratedSeedIndex)
-        {
-            m_LockHighestProcessedSeed.unlock();
-            continueLoop = false;
+        // On failure, startPoint is updated to the current counter value
+        if (!m_HighestProcessedSeed.compare_exchange_weak(startPoint,endPoint))
             continue;
-        }
 
-        unsigned int startPoint = m_HighestProcessedSeed;
-        unsigned int endPoint = m_HighestProcessedSeed + stepData;
-        if (endPoint > highestToleratedSeedIndex)
-            endPoint = highestToleratedSeedIndex;
-
-        m_HighestProcessedSeed = endPoint;
+        this->ThreadedTrackComputer(numThread,resultFibers,resultWeights,startPoint,endPoint);
+        unsigned int numProcessedSeeds = m_NumberOfProcessedSeeds.fetch_add(endPoint - startPoint) + endPoint - startPoint;
 
-        m_LockHighestProcessedSeed.unlock();
+        // Progress is only reported by the first work unit to avoid locking
+        if (numThread == 0)
+        {
+            double ratio = std::floor(numProcessedSeeds * 100.0 / highestToleratedSeedIndex) / 100.0;
+            ratio = this->progressFixedToFloat(this->progressFloatToFixed(ratio));
 
-        this->ThreadedTrackComputer(numThread,resultFibers,resultWeights,startPoint,endPoint);
+            if (ratio != this->GetProgress())
+                this->UpdateProgress(ratio);
+        }
 
-        m_LockHighestProcessedSeed.lock();
-        m_ProgressReport->CompletedPixel();
-        m_LockHighestProcessedSeed.unlock();
+        startPoint = m_HighestProcessedSeed.load();
     }
 }
 
+template <class TInputModelImageType>
+uint64_t
+BaseProbabilisticTractographyImageFilter <TInputModelImageType>
+::ComputeSeedRandomSeed(unsigned int seedIndex)
+{
+    // SplitMix64 finalizer applied to a (master seed, seed index) counter
+    uint64_t z = ((uint64_t)m_RandomSeed << 32) + seedIndex + 0x9e3779b97f4a7c15ULL;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
 template <class TInputModelImageType>
 void
 BaseProbabilisticTractographyImageFilter <TInputModelImageType>
-::ThreadedTrackComputer(unsigned int numThread, FiberProcessVectorType &resultFibers,
-                        ListType &resultWeights, unsigned int startSeedIndex,
+::ThreadedTrackComputer(unsigned int numThread, std::vector <FiberProcessVectorType> &resultFibers,
+                        std::vector <ListType> &resultWeights, unsigned int startSeedIndex,
                         unsigned int endSeedIndex)
 {
     InterpolatorPointer modelInterpolator = this->GetModelInterpolator();
@@ -334,6 +324,11 @@ BaseProbabilisticTractographyImageFilter <TInputModelImageType>
     {
         m_SeedMask->TransformPhysicalPointToContinuousIndex(m_PointsToProcess[i][0],startIndex);
 
+        // Random stream only depends on the seed index
+        uint64_t seedRandomSeed = this->ComputeSeedRandomSeed(i);
+        std::seed_seq seedSequence{(uint32_t)seedRandomSeed, (uint32_t)(seedRandomSeed >> 32)};
+        m_Generators[numThread].seed(seedSequence);
+
         tmpFibers = this->ComputeFiber(m_PointsToProcess[i], modelInterpolator, numThread, tmpWeights);
 
         tmpFibers = this->FilterOutputFibers(tmpFibers, tmpWeights);
@@ -342,8 +337,8 @@ BaseProbabilisticTractographyImageFilter <TInputModelImageType>
         {
             if (tmpFibers[j].size() > m_MinLengthFiber / m_StepProgression)
             {
-                resultFibers.push_back(tmpFibers[j]);
-                resultWeights.push_back(tmpWeights[j]);
+                resultFibers[i].push_back(tmpFibers[j]);
+                resultWeights[i].push_back(tmpWeights[j]);
             }
         }
     }
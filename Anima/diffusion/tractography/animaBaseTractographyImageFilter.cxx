@@ -356,6 +356,7 @@ BaseTractographyImageFilter::ComputeFiber(BaseTractographyImageFilter::FiberType
     VectorType modelValue;
     modelValue.SetSize(1);
 
+    m_SeedingImage->TransformPhysicalPointToContinuousIndex(curPoint,curIndex);
     this->GetModelValue(curIndex,modelValue);
     // Go the forward way starting along initial direction provided
     while (continueLoop)
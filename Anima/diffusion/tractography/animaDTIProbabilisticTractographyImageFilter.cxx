@@ -64,7 +64,7 @@ DTIProbabilisticTractographyImageFilter::ProposeNewDirection(Vector3DType &oldDi
 //    else
 //        anima::SampleFromVMFDistribution(concentrationParameter,sampling_direction,resVec,random_generator);
 
-    anima::SampleFromWatsonDistribution(concentrationParameter,sampling_direction,resVec,3,random_generator);
+    anima::FastSampleFromWatsonDistribution(concentrationParameter,sampling_direction,resVec,random_generator);
     
     if (is2d)
     {
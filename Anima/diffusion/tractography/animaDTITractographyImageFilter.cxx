@@ -6,6 +6,8 @@
 #include <vtkPointData.h>
 #include <animaBaseTensorTools.h>
 
+#include <itkImageRegionConstIterator.h>
+
 namespace anima
 {
 
@@ -13,6 +15,10 @@ dtiTractographyImageFilter::dtiTractographyImageFilter()
 {
     m_StopFAThreshold = 0.1;
     m_StopADCThreshold = 2.0e-3;
+    m_PunctureWeight = 0.2;
+
+    m_UseFieldCache = false;
+    m_FieldNumberOfVoxels = 0;
 }
 
 dtiTractographyImageFilter::~dtiTractographyImageFilter()
@@ -27,17 +33,121 @@ void dtiTractographyImageFilter::SetInputImage(ModelImageType *input)
     m_DTIInterpolator->SetInputImage(this->GetInputImage());
 }
 
-bool dtiTractographyImageFilter::CheckModelCompatibility(VectorType &modelValue, itk::ThreadIdType threadId)
+void dtiTractographyImageFilter::PrepareTractography()
 {
-    typedef vnl_matrix <double> MatrixType;
+    this->Superclass::PrepareTractography();
 
-    itk::SymmetricEigenAnalysis <MatrixType,vnl_diag_matrix <double>,MatrixType> EigenAnalysis(3);
-    MatrixType tmpMat(3,3);
+    m_FieldCache.clear();
+    if (m_UseFieldCache)
+        this->BuildFieldCache();
+}
 
-    anima::GetTensorFromVectorRepresentation(modelValue,tmpMat);
+void dtiTractographyImageFilter::BuildFieldCache()
+{
+    ModelImageType *inputImage = this->GetInputImage();
+    ModelImageType::RegionType bufferedRegion = inputImage->GetBufferedRegion();
+
+    m_FieldStartIndex = bufferedRegion.GetIndex();
+    m_FieldSize = bufferedRegion.GetSize();
+    m_FieldNumberOfVoxels = bufferedRegion.GetNumberOfPixels();
+    m_FieldCache.resize(EigenValuesOffset * m_FieldNumberOfVoxels);
+
+    itk::ImageRegionConstIterator <ModelImageType> inputItr(inputImage,bufferedRegion);
+    unsigned int pos = 0;
+    while (!inputItr.IsAtEnd())
+    {
+        VectorType inputValue = inputItr.Get();
+        for (unsigned int i = 0;i < EigenValuesOffset;++i)
+            m_FieldCache[i * m_FieldNumberOfVoxels + pos] = inputValue[i];
+
+        ++inputItr;
+        ++pos;
+    }
+}
+
+void dtiTractographyImageFilter::GetCachedModelValue(ContinuousIndexType &index, VectorType &modelValue)
+{
+    // Neighbors outside the buffer are replaced by border voxels, as done by the linear interpolator
+    unsigned int baseOffset = 0;
+    unsigned int nextOffsets[3];
+    double distances[3];
+    unsigned int stride = 1;
+    for (unsigned int i = 0;i < 3;++i)
+    {
+        double relativeIndex = index[i] - m_FieldStartIndex[i];
+        relativeIndex = (relativeIndex > 0) ? relativeIndex : 0;
+        relativeIndex = std::min(relativeIndex,m_FieldSize[i] - 1.0);
+
+        unsigned int baseIndex = std::floor(relativeIndex);
+        distances[i] = relativeIndex - baseIndex;
+        nextOffsets[i] = (baseIndex + 1 < m_FieldSize[i]) ? stride : 0;
+        baseOffset += baseIndex * stride;
+        stride *= m_FieldSize[i];
+    }
+
+    double weights[8];
+    unsigned int offsets[8];
+    for (unsigned int i = 0;i < 8;++i)
+    {
+        weights[i] = 1.0;
+        offsets[i] = baseOffset;
+        for (unsigned int j = 0;j < 3;++j)
+        {
+            if ((i >> j) & 1)
+            {
+                weights[i] *= distances[j];
+                offsets[i] += nextOffsets[j];
+            }
+            else
+                weights[i] *= 1.0 - distances[j];
+        }
+    }
+
+    if (modelValue.GetSize() != PackedModelSize)
+        modelValue.SetSize(PackedModelSize);
+
+    bool zeroTensor = true;
+    for (unsigned int i = 0;i < EigenValuesOffset;++i)
+    {
+        const double *componentField = m_FieldCache.data() + i * m_FieldNumberOfVoxels;
+        double componentValue = 0;
+        for (unsigned int j = 0;j < 8;++j)
+            componentValue += weights[j] * componentField[offsets[j]];
+
+        modelValue[i] = componentValue;
+        if (componentValue != 0)
+            zeroTensor = false;
+    }
+
+    // Outside of the brain: the packed value is kept fully zero so that isZero stops fibers as on the uncached path
+    if (zeroTensor)
+    {
+        modelValue.Fill(0.0);
+        return;
+    }
+
+    double *modelData = modelValue.GetDataPointer();
+    anima::ComputeClosedFormSymmetricEigenSystem3x3(modelData,modelData + EigenValuesOffset,modelData + EigenVectorsOffset);
+}
+
+bool dtiTractographyImageFilter::CheckModelCompatibility(VectorType &modelValue, itk::ThreadIdType threadId)
+{
+    typedef vnl_matrix <double> MatrixType;
 
     vnl_diag_matrix <double> eVals(3);
-    EigenAnalysis.ComputeEigenValues(tmpMat,eVals);
+    if (this->IsPackedModelValue(modelValue))
+    {
+        for (unsigned int i = 0;i < 3;++i)
+            eVals[i] = modelValue[EigenValuesOffset + i];
+    }
+    else
+    {
+        itk::SymmetricEigenAnalysis <MatrixType,vnl_diag_matrix <double>,MatrixType> EigenAnalysis(3);
+        MatrixType tmpMat(3,3);
+
+        anima::GetTensorFromVectorRepresentation(modelValue,tmpMat);
+        EigenAnalysis.ComputeEigenValues(tmpMat,eVals);
+    }
 
     double meanEvals = 0;
     for (unsigned int i = 0;i < 3;++i)
@@ -75,12 +185,33 @@ bool dtiTractographyImageFilter::CheckIndexInImageBounds(ContinuousIndexType &in
 void
 dtiTractographyImageFilter::GetModelValue(ContinuousIndexType &index, VectorType &modelValue)
 {
+    if (m_FieldCache.size() != 0)
+    {
+        this->GetCachedModelValue(index,modelValue);
+        return;
+    }
+
     modelValue = m_DTIInterpolator->EvaluateAtContinuousIndex(index);
 }
 
 std::vector <dtiTractographyImageFilter::PointType>
 dtiTractographyImageFilter::GetModelPrincipalDirections(VectorType &modelValue, bool is2d, itk::ThreadIdType threadId)
 {
+    if (this->IsPackedModelValue(modelValue))
+    {
+        std::vector <PointType> resDir(1);
+        for (unsigned int i = 0;i < 3;++i)
+            resDir[0][i] = modelValue[EigenVectorsOffset + 6 + i];
+
+        if (is2d)
+        {
+            resDir[0][2] = 0;
+            anima::Normalize(resDir[0],resDir[0]);
+        }
+
+        return resDir;
+    }
+
     typedef vnl_matrix <double> MatrixType;
 
     itk::SymmetricEigenAnalysis <MatrixType,vnl_diag_matrix <double>,MatrixType> EigenAnalysis(3);
@@ -115,32 +246,54 @@ dtiTractographyImageFilter::GetNextDirection(PointType &previousDirection, Vecto
         anima::Revert(newDirection,newDirection);
 
     typedef vnl_matrix <double> MatrixType;
-    MatrixType tmpMat(3,3);
-
-    anima::GetTensorFromVectorRepresentation(modelValue,tmpMat,3,false);
-
     vnl_diag_matrix <double> eVals(3);
-    itk::SymmetricEigenAnalysis <MatrixType,vnl_diag_matrix <double>,MatrixType> EigenAnalysis(3);
-    MatrixType eVecs(3,3);
-    EigenAnalysis.ComputeEigenValuesAndVectors(tmpMat,eVals, eVecs);
-
     double sumEigs = 0.0;
-    for (unsigned int i = 0;i < 3;++i)
-    {
-        eVals[i] = std::exp(eVals[i]);
-        sumEigs += eVals[i];
-    }
-
-    anima::RecomposeTensor(eVals,eVecs,tmpMat);
 
     // Compute advected direction as in Weinstein et al.
     PointType advectedDirection;
 
-    for (unsigned int i = 0;i < 3;++i)
+    if (this->IsPackedModelValue(modelValue))
     {
-        advectedDirection[i] = 0.0;
-        for (unsigned int j = 0;j < 3;++j)
-            advectedDirection[i] += tmpMat(i,j) * previousDirection[j];
+        // Tensor exponential applied from the packed eigen system
+        advectedDirection.Fill(0.0);
+        for (unsigned int i = 0;i < 3;++i)
+        {
+            eVals[i] = std::exp(modelValue[EigenValuesOffset + i]);
+            sumEigs += eVals[i];
+
+            const double *eigenVector = modelValue.GetDataPointer() + EigenVectorsOffset + 3 * i;
+            double projection = 0.0;
+            for (unsigned int j = 0;j < 3;++j)
+                projection += eigenVector[j] * previousDirection[j];
+
+            for (unsigned int j = 0;j < 3;++j)
+                advectedDirection[j] += eVals[i] * projection * eigenVector[j];
+        }
+    }
+    else
+    {
+        MatrixType tmpMat(3,3);
+
+        anima::GetTensorFromVectorRepresentation(modelValue,tmpMat,3,false);
+
+        itk::SymmetricEigenAnalysis <MatrixType,vnl_diag_matrix <double>,MatrixType> EigenAnalysis(3);
+        MatrixType eVecs(3,3);
+        EigenAnalysis.ComputeEigenValuesAndVectors(tmpMat,eVals, eVecs);
+
+        for (unsigned int i = 0;i < 3;++i)
+        {
+            eVals[i] = std::exp(eVals[i]);
+            sumEigs += eVals[i];
+        }
+
+        anima::RecomposeTensor(eVals,eVecs,tmpMat);
+
+        for (unsigned int i = 0;i < 3;++i)
+        {
+            advectedDirection[i] = 0.0;
+            for (unsigned int j = 0;j < 3;++j)
+                advectedDirection[i] += tmpMat(i,j) * previousDirection[j];
+        }
     }
 
     anima::Normalize(advectedDirection,advectedDirection);
@@ -11,6 +11,10 @@ namespace anima
 /**
  * @brief DTI tractography image filter. Simple step by step tratpography, using advection-diffusion
  * tricks from Weinstein et al. 1999. Tensorlines: Advection-Diffusion based Propagation through Diffusion Tensor Fields.
+ *
+ * With UseFieldCache on, log-tensor components are packed once in a structure of arrays field shared by all threads.
+ * Each interpolated log-tensor is then decomposed a single time with a closed form solver, its eigen system being appended
+ * to the model value and reused by stopping criteria, principal direction and advection computations.
  */
 class ANIMATRACTOGRAPHY_EXPORT dtiTractographyImageFilter : public anima::BaseTractographyImageFilter
 {
@@ -40,6 +44,9 @@ public:
     itkGetMacro(PunctureWeight, double)
     itkSetMacro(PunctureWeight, double)
 
+    itkGetMacro(UseFieldCache, bool)
+    itkSetMacro(UseFieldCache, bool)
+
 protected:
     dtiTractographyImageFilter();
     virtual ~dtiTractographyImageFilter();
@@ -53,6 +60,21 @@ protected:
 
     virtual void ComputeAdditionalScalarMaps() ITK_OVERRIDE;
 
+    virtual void PrepareTractography() ITK_OVERRIDE;
+
+    //! Packs log-tensor components of the input image in m_FieldCache
+    void BuildFieldCache();
+
+    //! Linear interpolation in the field cache followed by closed form eigen decomposition, same boundary rules as the ITK interpolator
+    void GetCachedModelValue(ContinuousIndexType &index, VectorType &modelValue);
+
+    //! Packed model value: log-tensor components, log-eigenvalues (ascending) and eigenvectors (as rows)
+    static const unsigned int PackedModelSize = 18;
+    static const unsigned int EigenValuesOffset = 6;
+    static const unsigned int EigenVectorsOffset = 9;
+
+    bool IsPackedModelValue(VectorType &modelValue) {return modelValue.GetSize() == PackedModelSize;}
+
 private:
     ITK_DISALLOW_COPY_AND_ASSIGN(dtiTractographyImageFilter);
 
@@ -61,6 +83,14 @@ private:
     double m_PunctureWeight;
 
     DTIInterpolatorPointer m_DTIInterpolator;
+
+    bool m_UseFieldCache;
+
+    //! Log-tensor components, component by component over the buffered region
+    std::vector <double> m_FieldCache;
+    ModelImageType::IndexType m_FieldStartIndex;
+    ModelImageType::SizeType m_FieldSize;
+    unsigned int m_FieldNumberOfVoxels;
 };
 
 } // end of namespace anima
@@ -0,0 +1,262 @@
+#include <animaFibersLabelsQuery.h>
+
+#include <itkImageRegionConstIteratorWithIndex.h>
+#include <itkMultiThreaderBase.h>
+
+#include <vtkSmartPointer.h>
+#include <vtkGenericCell.h>
+#include <vtkPoints.h>
+
+#include <limits>
+#include <cmath>
+#include <algorithm>
+
+namespace anima
+{
+
+// Number of fibers processed by each thread call
+const unsigned int fibersChunkSize = 1024;
+
+FibersLabelsQuery::FibersLabelsQuery()
+{
+    m_LabelImage = ITK_NULLPTR;
+    m_NumberOfThreads = itk::MultiThreaderBase::GetGlobalDefaultNumberOfThreads();
+
+    m_NumberOfWords = 1;
+    m_EmptyMap = true;
+    m_LabelsMapUpToDate = false;
+    m_NumberOfFibers = 0;
+}
+
+unsigned int FibersLabelsQuery::AddFilterRule(const FilterRule &rule)
+{
+    m_FilterRules.push_back(rule);
+    m_LabelsMapUpToDate = false;
+    return m_FilterRules.size() - 1;
+}
+
+void FibersLabelsQuery::SetLabelBits(const std::vector <unsigned int> &labels, std::vector <LabelWordType> &bits)
+{
+    bits.assign(m_NumberOfWords,0);
+    for (unsigned int i = 0;i < labels.size();++i)
+    {
+        if (labels[i] >= m_LabelBitIndexes.size())
+            throw itk::ExceptionObject(__FILE__, __LINE__,"Rule label out of the label image type range",ITK_LOCATION);
+
+        unsigned int bitIndex = m_LabelBitIndexes[labels[i]];
+        bits[bitIndex / 64] |= (LabelWordType(1) << (bitIndex % 64));
+    }
+}
+
+void FibersLabelsQuery::BuildLabelsMap()
+{
+    if (!m_LabelImage)
+        throw itk::ExceptionObject(__FILE__, __LINE__,"Label image required for fibers labels query",ITK_LOCATION);
+
+    // Bits are only given to labels used in rules
+    m_LabelBitIndexes.assign(std::numeric_limits <unsigned short>::max() + 1,-1);
+    unsigned int numBits = 0;
+    for (unsigned int i = 0;i < m_FilterRules.size();++i)
+    {
+        const FilterRule &rule = m_FilterRules[i];
+        for (const std::vector <unsigned int> *labels : {&rule.touchLabels, &rule.endingsLabels, &rule.forbiddenLabels})
+        {
+            for (unsigned int j = 0;j < labels->size();++j)
+            {
+                unsigned int label = (*labels)[j];
+                if ((label < m_LabelBitIndexes.size()) && (m_LabelBitIndexes[label] < 0))
+                {
+                    m_LabelBitIndexes[label] = numBits;
+                    ++numBits;
+                }
+            }
+        }
+    }
+
+    m_NumberOfWords = std::max(1u, (numBits + 63) / 64);
+
+    m_RuleBitsets.resize(m_FilterRules.size());
+    for (unsigned int i = 0;i < m_FilterRules.size();++i)
+    {
+        this->SetLabelBits(m_FilterRules[i].touchLabels,m_RuleBitsets[i].touchBits);
+        this->SetLabelBits(m_FilterRules[i].endingsLabels,m_RuleBitsets[i].endingsBits);
+        this->SetLabelBits(m_FilterRules[i].forbiddenLabels,m_RuleBitsets[i].forbiddenBits);
+    }
+
+    // Bounding box of voxels holding a rule label
+    LabelImageType::IndexType minIndex, maxIndex;
+    m_EmptyMap = true;
+    typedef itk::ImageRegionConstIteratorWithIndex <LabelImageType> LabelIteratorType;
+    LabelIteratorType labelItr(m_LabelImage,m_LabelImage->GetLargestPossibleRegion());
+    while (!labelItr.IsAtEnd())
+    {
+        if (m_LabelBitIndexes[labelItr.Get()] >= 0)
+        {
+            LabelImageType::IndexType currentIndex = labelItr.GetIndex();
+            if (m_EmptyMap)
+            {
+                minIndex = currentIndex;
+                maxIndex = currentIndex;
+                m_EmptyMap = false;
+            }
+
+            for (unsigned int i = 0;i < 3;++i)
+            {
+                minIndex[i] = std::min(minIndex[i],currentIndex[i]);
+                maxIndex[i] = std::max(maxIndex[i],currentIndex[i]);
+            }
+        }
+
+        ++labelItr;
+    }
+
+    m_LabelsMap.clear();
+    if (m_EmptyMap)
+        return;
+
+    m_MapStartIndex = minIndex;
+    for (unsigned int i = 0;i < 3;++i)
+        m_MapSize[i] = maxIndex[i] - minIndex[i] + 1;
+
+    LabelImageType::RegionType mapRegion(m_MapStartIndex,m_MapSize);
+    m_LabelsMap.resize(mapRegion.GetNumberOfPixels());
+
+    labelItr = LabelIteratorType(m_LabelImage,mapRegion);
+    unsigned int pos = 0;
+    while (!labelItr.IsAtEnd())
+    {
+        m_LabelsMap[pos] = m_LabelBitIndexes[labelItr.Get()] + 1;
+        ++labelItr;
+        ++pos;
+    }
+}
+
+void FibersLabelsQuery::AddPointLabel(const double *pointPosition, LabelWordType *labelBits) const
+{
+    LabelImageType::PointType point;
+    for (unsigned int i = 0;i < 3;++i)
+        point[i] = pointPosition[i];
+
+    LabelImageType::IndexType index;
+    m_LabelImage->TransformPhysicalPointToIndex(point,index);
+
+    unsigned int offset = 0;
+    unsigned int stride = 1;
+    for (unsigned int i = 0;i < 3;++i)
+    {
+        long mapPosition = index[i] - m_MapStartIndex[i];
+        if ((mapPosition < 0) || (mapPosition >= (long)m_MapSize[i]))
+            return;
+
+        offset += mapPosition * stride;
+        stride *= m_MapSize[i];
+    }
+
+    unsigned short mapValue = m_LabelsMap[offset];
+    if (mapValue == 0)
+        return;
+
+    unsigned int bitIndex = mapValue - 1;
+    labelBits[bitIndex / 64] |= (LabelWordType(1) << (bitIndex % 64));
+}
+
+void FibersLabelsQuery::Update(vtkPolyData *tracks)
+{
+    if (!m_LabelsMapUpToDate)
+    {
+        this->BuildLabelsMap();
+        m_LabelsMapUpToDate = true;
+    }
+
+    m_NumberOfFibers = tracks->GetNumberOfCells();
+    m_FiberLabels.assign(m_NumberOfFibers * m_NumberOfWords,0);
+    m_FiberEndingsLabels.assign(m_NumberOfFibers * m_NumberOfWords,0);
+
+    if ((m_NumberOfFibers == 0) || m_EmptyMap)
+        return;
+
+    // Get dummy cell so that it's thread safe
+    vtkSmartPointer <vtkGenericCell> dummyCell = vtkSmartPointer <vtkGenericCell>::New();
+    tracks->GetCell(0,dummyCell);
+
+    itk::MultiThreaderBase::Pointer threader = itk::MultiThreaderBase::New();
+    threader->SetNumberOfWorkUnits(m_NumberOfThreads);
+
+    unsigned int numChunks = (m_NumberOfFibers + fibersChunkSize - 1) / fibersChunkSize;
+    threader->ParallelizeArray(0, numChunks, [&](itk::SizeValueType chunk)
+    {
+        unsigned int firstFiber = chunk * fibersChunkSize;
+        unsigned int lastFiber = std::min(m_NumberOfFibers, firstFiber + fibersChunkSize);
+
+        vtkSmartPointer <vtkGenericCell> cell = vtkSmartPointer <vtkGenericCell>::New();
+        double pointPosition[3];
+
+        for (unsigned int i = firstFiber;i < lastFiber;++i)
+        {
+            tracks->GetCell(i,cell);
+            vtkPoints *cellPts = cell->GetPoints();
+            unsigned int numCellPts = cellPts->GetNumberOfPoints();
+
+            // Endings are the first and last 5% of points, at least 5 points
+            unsigned int endingsSize = std::min(numCellPts, std::max(5u, static_cast <unsigned int> (std::floor(numCellPts / 20.0))));
+
+            LabelWordType *fiberLabels = m_FiberLabels.data() + i * m_NumberOfWords;
+            LabelWordType *fiberEndingsLabels = m_FiberEndingsLabels.data() + i * m_NumberOfWords;
+            for (unsigned int j = 0;j < numCellPts;++j)
+            {
+                cellPts->GetPoint(j,pointPosition);
+                this->AddPointLabel(pointPosition,fiberLabels);
+
+                if ((j < endingsSize) || (j + endingsSize >= numCellPts))
+                    this->AddPointLabel(pointPosition,fiberEndingsLabels);
+            }
+        }
+    }, nullptr);
+}
+
+bool FibersLabelsQuery::IsFiberKept(unsigned int fiberIndex, unsigned int ruleIndex) const
+{
+    const RuleBitsets &ruleBits = m_RuleBitsets[ruleIndex];
+    const LabelWordType *fiberLabels = m_FiberLabels.data() + fiberIndex * m_NumberOfWords;
+    const LabelWordType *fiberEndingsLabels = m_FiberEndingsLabels.data() + fiberIndex * m_NumberOfWords;
+
+    for (unsigned int i = 0;i < m_NumberOfWords;++i)
+    {
+        if ((fiberLabels[i] & ruleBits.forbiddenBits[i]) != 0)
+            return false;
+
+        if ((fiberLabels[i] & ruleBits.touchBits[i]) != ruleBits.touchBits[i])
+            return false;
+
+        if ((fiberEndingsLabels[i] & ruleBits.endingsBits[i]) != ruleBits.endingsBits[i])
+            return false;
+    }
+
+    return true;
+}
+
+void FibersLabelsQuery::ComputeKeptFibers(std::vector < std::vector <unsigned char> > &keptFibers) const
+{
+    unsigned int numRules = m_FilterRules.size();
+    keptFibers.resize(numRules);
+    for (unsigned int i = 0;i < numRules;++i)
+        keptFibers[i].resize(m_NumberOfFibers);
+
+    itk::MultiThreaderBase::Pointer threader = itk::MultiThreaderBase::New();
+    threader->SetNumberOfWorkUnits(m_NumberOfThreads);
+
+    unsigned int numChunks = (m_NumberOfFibers + fibersChunkSize - 1) / fibersChunkSize;
+    threader->ParallelizeArray(0, numChunks, [&](itk::SizeValueType chunk)
+    {
+        unsigned int firstFiber = chunk * fibersChunkSize;
+        unsigned int lastFiber = std::min(m_NumberOfFibers, firstFiber + fibersChunkSize);
+
+        for (unsigned int i = firstFiber;i < lastFiber;++i)
+        {
+            for (unsigned int j = 0;j < numRules;++j)
+                keptFibers[j][i] = this->IsFiberKept(i,j);
+        }
+    }, nullptr);
+}
+
+} // end namespace anima
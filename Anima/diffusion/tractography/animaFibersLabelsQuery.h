@@ -0,0 +1,99 @@
+#pragma once
+
+#include <itkImage.h>
+#include <vtkPolyData.h>
+
+#include <vector>
+#include <cstdint>
+
+#include "AnimaTractographyExport.h"
+
+namespace anima
+{
+
+/**
+ * @brief Label queries on a set of fibers. Labels visited by each fiber (and by its endings) are computed once, in
+ * parallel, as bitsets over the labels used by the filter rules. Any number of rules are then evaluated on those
+ * bitsets, so that several bundles may be extracted from a tractogram in a single pass over its points.
+ * Points are located in a cropped map of the label image, restricted to the bounding box of the voxels holding a rule label.
+ */
+class ANIMATRACTOGRAPHY_EXPORT FibersLabelsQuery
+{
+public:
+    typedef itk::Image <unsigned short, 3> LabelImageType;
+    typedef uint64_t LabelWordType;
+
+    //! A fiber is kept if it touches all touch labels, its endings touch all endings labels, and it avoids all forbidden labels
+    struct FilterRule
+    {
+        std::vector <unsigned int> touchLabels;
+        std::vector <unsigned int> endingsLabels;
+        std::vector <unsigned int> forbiddenLabels;
+    };
+
+    FibersLabelsQuery();
+    ~FibersLabelsQuery() {}
+
+    void SetLabelImage(LabelImageType *labelImage)
+    {
+        m_LabelImage = labelImage;
+        m_LabelsMapUpToDate = false;
+    }
+
+    void SetNumberOfThreads(unsigned int numThreads) {m_NumberOfThreads = numThreads;}
+
+    //! Adds a rule, to be done before Update. Returns the rule index
+    unsigned int AddFilterRule(const FilterRule &rule);
+    unsigned int GetNumberOfFilterRules() {return m_FilterRules.size();}
+
+    //! Computes labels visited by each fiber of tracks. May be called on successive chunks of a tractogram, the labels map
+    //! being built only once
+    void Update(vtkPolyData *tracks);
+
+    unsigned int GetNumberOfFibers() {return m_NumberOfFibers;}
+
+    //! Evaluates a rule on one fiber, Update has to be called before
+    bool IsFiberKept(unsigned int fiberIndex, unsigned int ruleIndex) const;
+
+    //! Evaluates all rules on all fibers in parallel, keptFibers[rule][fiber] is non zero if the fiber is kept
+    void ComputeKeptFibers(std::vector < std::vector <unsigned char> > &keptFibers) const;
+
+protected:
+    struct RuleBitsets
+    {
+        std::vector <LabelWordType> touchBits;
+        std::vector <LabelWordType> endingsBits;
+        std::vector <LabelWordType> forbiddenBits;
+    };
+
+    void BuildLabelsMap();
+    void SetLabelBits(const std::vector <unsigned int> &labels, std::vector <LabelWordType> &bits);
+
+    //! Adds bit of the label at point position to labelBits if any
+    void AddPointLabel(const double *pointPosition, LabelWordType *labelBits) const;
+
+private:
+    LabelImageType::Pointer m_LabelImage;
+    unsigned int m_NumberOfThreads;
+
+    std::vector <FilterRule> m_FilterRules;
+    std::vector <RuleBitsets> m_RuleBitsets;
+
+    //! Bit index of each rule label, -1 for labels used by no rule
+    std::vector <int> m_LabelBitIndexes;
+    unsigned int m_NumberOfWords;
+
+    //! Cropped labels map storing label bit index + 1 (0 for no rule label)
+    std::vector <unsigned short> m_LabelsMap;
+    LabelImageType::IndexType m_MapStartIndex;
+    LabelImageType::SizeType m_MapSize;
+    bool m_EmptyMap;
+    bool m_LabelsMapUpToDate;
+
+    //! Per fiber bitsets of visited labels and labels visited by fiber endings
+    std::vector <LabelWordType> m_FiberLabels;
+    std::vector <LabelWordType> m_FiberEndingsLabels;
+    unsigned int m_NumberOfFibers;
+};
+
+} // end namespace anima
@@ -109,7 +109,7 @@ ODFProbabilisticTractographyImageFilter::ProposeNewDirection(Vector3DType &oldDi
     //    else
     //        anima::SampleFromVMFDistribution(chosenKappa,sampling_direction,resVec,random_generator);
 
-    anima::SampleFromWatsonDistribution(chosenKappa,sampling_direction,resVec,3,random_generator);
+    anima::FastSampleFromWatsonDistribution(chosenKappa,sampling_direction,resVec,random_generator);
 
     if (is2d)
     {
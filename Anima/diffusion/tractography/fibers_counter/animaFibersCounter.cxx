@@ -2,14 +2,19 @@
 
 #include <animaReadWriteFunctions.h>
 #include <animaShapesReader.h>
+#include <animaBinaryTractogramReader.h>
 
 #include <vtkSmartPointer.h>
 #include <vtkPoints.h>
 #include <vtkPointData.h>
 #include <vtkPolyData.h>
-#include <vtkCell.h>
+#include <vtkGenericCell.h>
 
 #include <itkCastImageFilter.h>
+#include <itkImageRegionIterator.h>
+#include <itkMultiThreaderBase.h>
+
+#include <atomic>
 
 int main(int argc, char **argv)
 {
@@ -20,6 +25,7 @@ int main(int argc, char **argv)
     TCLAP::ValueArg<std::string> geomArg("g","geometry","Geometry image",true,"","geometry image",cmd);
 
     TCLAP::SwitchArg proportionArg("P","proportion","Output proportion of fibers going through each pixel",cmd,false);
+    TCLAP::ValueArg<unsigned int> nbThreadsArg("T","nb-threads","Number of threads to run on (default: all available)",false,itk::MultiThreaderBase::GetGlobalDefaultNumberOfThreads(),"number of threads",cmd);
 
     try
     {
@@ -33,57 +39,103 @@ int main(int argc, char **argv)
 
     typedef itk::Image <double, 3> OutputImageType;
     OutputImageType::Pointer outputImage = anima::readImage <OutputImageType> (geomArg.getValue());
-    outputImage->FillBuffer(0.0);
 
-    anima::ShapesReader trackReader;
-    trackReader.SetFileName(inArg.getValue());
-    trackReader.Update();
+    OutputImageType::RegionType region = outputImage->GetLargestPossibleRegion();
+    unsigned int numPixels = region.GetNumberOfPixels();
 
-    vtkSmartPointer <vtkPolyData> tracks = trackReader.GetOutput();
+    // Counts are shared by all threads, voxel offsets follow the image buffer order
+    std::vector < std::atomic <unsigned int> > fiberCounts(numPixels);
+    for (unsigned int i = 0;i < numPixels;++i)
+        fiberCounts[i] = 0;
 
-    vtkIdType nbCells = tracks->GetNumberOfCells();
-    double incrementFactor = 1.0;
-    if (proportionArg.isSet())
-        incrementFactor /= nbCells;
-
-    double ptVals[3];
-    OutputImageType::IndexType currentIndex;
-    OutputImageType::PointType currentPoint;
-    OutputImageType::RegionType region = outputImage->GetLargestPossibleRegion();
+    itk::MultiThreaderBase::Pointer threader = itk::MultiThreaderBase::New();
+    threader->SetNumberOfWorkUnits(nbThreadsArg.getValue());
 
-    // Explores individual fibers
-    for (int j = 0;j < nbCells;++j)
+    auto countTracks = [&](vtkPolyData *tracks)
     {
-        vtkCell *cell = tracks->GetCell(j);
-        vtkPoints *cellPts = cell->GetPoints();
-        vtkIdType nbPts = cellPts->GetNumberOfPoints();
-
-        // Explores points in fibers
-        for (int i = 0;i < nbPts;++i)
+        unsigned int nbCells = tracks->GetNumberOfCells();
+        if (nbCells == 0)
+            return;
+
+        // Get dummy cell so that it's thread safe
+        vtkSmartPointer <vtkGenericCell> dummyCell = vtkSmartPointer <vtkGenericCell>::New();
+        tracks->GetCell(0,dummyCell);
+
+        // Explores individual fibers by chunks
+        const unsigned int chunkSize = 1024;
+        unsigned int numChunks = (nbCells + chunkSize - 1) / chunkSize;
+        threader->ParallelizeArray(0, numChunks, [&](itk::SizeValueType chunk)
         {
-            cellPts->GetPoint(i,ptVals);
+            unsigned int firstCell = chunk * chunkSize;
+            unsigned int lastCell = std::min(nbCells, firstCell + chunkSize);
 
-            for (unsigned int k = 0;k < 3;++k)
-                currentPoint[k] = ptVals[k];
+            vtkSmartPointer <vtkGenericCell> cell = vtkSmartPointer <vtkGenericCell>::New();
+            double ptVals[3];
+            OutputImageType::IndexType currentIndex;
+            OutputImageType::PointType currentPoint;
 
-            outputImage->TransformPhysicalPointToIndex(currentPoint,currentIndex);
-            bool insideBuffer = true;
-            for (unsigned int k = 0;k < 3;++k)
+            for (unsigned int j = firstCell;j < lastCell;++j)
             {
-                if ((currentIndex[k] < 0)||(currentIndex[k] >= region.GetSize(k)))
+                tracks->GetCell(j,cell);
+                vtkPoints *cellPts = cell->GetPoints();
+                vtkIdType nbPts = cellPts->GetNumberOfPoints();
+
+                // Explores points in fibers
+                for (int i = 0;i < nbPts;++i)
                 {
-                    insideBuffer = false;
-                    break;
+                    cellPts->GetPoint(i,ptVals);
+
+                    for (unsigned int k = 0;k < 3;++k)
+                        currentPoint[k] = ptVals[k];
+
+                    outputImage->TransformPhysicalPointToIndex(currentPoint,currentIndex);
+                    if (!region.IsInside(currentIndex))
+                        continue;
+
+                    fiberCounts[outputImage->ComputeOffset(currentIndex)].fetch_add(1, std::memory_order_relaxed);
                 }
             }
+        }, nullptr);
+    };
 
-            if (!insideBuffer)
-                continue;
+    unsigned int nbCells = 0;
+    if (anima::BinaryTractogramReader::IsBinaryTractogramFile(inArg.getValue()))
+    {
+        // Binary tractograms are streamed chunk by chunk
+        anima::BinaryTractogramReader binaryReader;
+        binaryReader.SetFileName(inArg.getValue());
+        binaryReader.Open();
 
-            double countIndex = outputImage->GetPixel(currentIndex) + incrementFactor;
-            outputImage->SetPixel(currentIndex, countIndex);
+        for (unsigned int i = 0;i < binaryReader.GetNumberOfChunks();++i)
+        {
+            vtkSmartPointer <vtkPolyData> tracks = binaryReader.ReadChunk(i);
+            nbCells += tracks->GetNumberOfCells();
+            countTracks(tracks);
         }
     }
+    else
+    {
+        anima::ShapesReader trackReader;
+        trackReader.SetFileName(inArg.getValue());
+        trackReader.Update();
+
+        vtkSmartPointer <vtkPolyData> tracks = trackReader.GetOutput();
+        nbCells = tracks->GetNumberOfCells();
+        countTracks(tracks);
+    }
+
+    double incrementFactor = 1.0;
+    if (proportionArg.isSet())
+        incrementFactor /= nbCells;
+
+    itk::ImageRegionIterator <OutputImageType> outItr(outputImage,region);
+    unsigned int pos = 0;
+    while (!outItr.IsAtEnd())
+    {
+        outItr.Set(fiberCounts[pos] * incrementFactor);
+        ++outItr;
+        ++pos;
+    }
 
     if (proportionArg.isSet())
         anima::writeImage <OutputImageType> (outArg.getValue(),outputImage);
@@ -2,212 +2,89 @@
 
 #include <animaReadWriteFunctions.h>
 #include <animaShapesWriter.h>
-
 #include <animaShapesReader.h>
+#include <animaFibersLabelsQuery.h>
+#include <animaBinaryTractogramReader.h>
+#include <animaBinaryTractogramWriter.h>
+
 #include <vtkSmartPointer.h>
-#include <vtkPoints.h>
-#include <vtkPointData.h>
 #include <vtkPolyData.h>
 #include <vtkCleanPolyData.h>
-#include <vtkGenericCell.h>
 
-#include <itkNearestNeighborInterpolateImageFunction.h>
-#include <itkPoolMultiThreader.h>
+#include <fstream>
+#include <sstream>
+#include <memory>
+#include <algorithm>
 
-void FilterTracks(vtkPolyData *tracks, unsigned int startIndex, unsigned int endIndex,
-                  itk::NearestNeighborInterpolateImageFunction < itk::Image <unsigned short, 3> > * interpolator,
-                  const std::vector <unsigned int> &touchLabels, const std::vector <unsigned int> &endingsLabels,
-                  const std::vector <unsigned int> &forbiddenLabels)
+//! Error on a bundles file line, thrown as an ITK exception
+void throwBundlesFileError(const std::string &message, const std::string &fileName, unsigned int lineNumber)
 {
-    std::vector <unsigned int> seenLabels;
-    std::vector <unsigned int> seenEndingsLabels;
-    double pointPositionVTK[3];
-    itk::ContinuousIndex<double, 3> currentIndex;
-    typedef itk::Image <unsigned short, 3>::PointType PointType;
-    PointType pointPosition;
-
-    vtkSmartPointer <vtkGenericCell> cell = vtkGenericCell::New();
-    for (unsigned int i = startIndex;i < endIndex;++i)
-    {
-        // Inspect i-th cell
-        tracks->GetCell(i,cell);
-        vtkPoints *cellPts = cell->GetPoints();
-        vtkIdType numCellPts = cellPts->GetNumberOfPoints();
-        seenLabels.clear();
-        bool lineOk = true;
-
-        // First test endings, if not right, useless to continue
-        seenEndingsLabels.clear();
-        unsigned int upIndexStart = std::max(5, static_cast <int> (std::floor(numCellPts / 20.0)));
-        unsigned int lowIndexEnd = numCellPts - upIndexStart;
-
-        // Test fiber start
-        for (unsigned int j = 0;j < upIndexStart;++j)
-        {
-            cellPts->GetPoint(j, pointPositionVTK);
-            for (unsigned int k = 0; k < 3; ++k)
-                pointPosition[k] = pointPositionVTK[k];
-            interpolator->GetInputImage()->TransformPhysicalPointToContinuousIndex(pointPosition,currentIndex);
-            if (interpolator->IsInsideBuffer(currentIndex))
-            {
-                unsigned int value = static_cast <unsigned int> (std::round(interpolator->EvaluateAtContinuousIndex(currentIndex)));
-                for (unsigned int k = 0;k < endingsLabels.size();++k)
-                {
-                    if (value == endingsLabels[k])
-                    {
-                        bool alreadyIn = false;
-                        for (unsigned int l = 0;l < seenEndingsLabels.size();++l)
-                        {
-                            if (seenEndingsLabels[l] == value)
-                            {
-                                alreadyIn = true;
-                                break;
-                            }
-                        }
-
-                        if (!alreadyIn)
-                            seenEndingsLabels.push_back(value);
-
-                        break;
-                    }
-                }
-            }
-        }
-
-        // Test fiber end
-        for (unsigned int j = lowIndexEnd;j < numCellPts;++j)
-        {
-            cellPts->GetPoint(j, pointPositionVTK);
-            for (unsigned int k = 0; k < 3; ++k)
-                pointPosition[k] = pointPositionVTK[k];
-            interpolator->GetInputImage()->TransformPhysicalPointToContinuousIndex(pointPosition,currentIndex);
-            if (interpolator->IsInsideBuffer(currentIndex))
-            {
-                unsigned int value = static_cast <unsigned int> (std::round(interpolator->EvaluateAtContinuousIndex(currentIndex)));
-                for (unsigned int k = 0;k < endingsLabels.size();++k)
-                {
-                    if (value == endingsLabels[k])
-                    {
-                        bool alreadyIn = false;
-                        for (unsigned int l = 0;l < seenEndingsLabels.size();++l)
-                        {
-                            if (seenEndingsLabels[l] == value)
-                            {
-                                alreadyIn = true;
-                                break;
-                            }
-                        }
-
-                        if (!alreadyIn)
-                            seenEndingsLabels.push_back(value);
-
-                        break;
-                    }
-                }
-            }
-        }
+    std::ostringstream errorStream;
+    errorStream << message << " on line " << lineNumber << " of bundles file " << fileName;
+    throw itk::ExceptionObject(__FILE__, __LINE__,errorStream.str(),ITK_LOCATION);
+}
 
-        if (seenEndingsLabels.size() != endingsLabels.size())
-            lineOk = false;
+//! Reads bundles rules, one per line: output name followed by -t, -e and -f options with a single label each
+void readBundlesFile(const std::string &fileName, std::vector <std::string> &outputNames,
+                     std::vector <anima::FibersLabelsQuery::FilterRule> &rules)
+{
+    std::ifstream bundlesIn(fileName);
+    if (!bundlesIn.is_open())
+        throw itk::ExceptionObject(__FILE__, __LINE__,"Unable to read bundles file " + fileName,ITK_LOCATION);
 
-        // Then test forbidden and touched labels
-        if (lineOk)
+    std::string line;
+    unsigned int lineNumber = 0;
+    while (std::getline(bundlesIn,line))
+    {
+        ++lineNumber;
+        std::istringstream lineStream(line);
+        std::string outputName;
+        if (!(lineStream >> outputName))
+            continue;
+
+        anima::FibersLabelsQuery::FilterRule rule;
+        std::string optionName;
+        while (lineStream >> optionName)
         {
-            for (unsigned int j = 0;j < numCellPts;++j)
-            {
-                cellPts->GetPoint(j, pointPositionVTK);
-                for (unsigned int k = 0; k < 3; ++k)
-                    pointPosition[k] = pointPositionVTK[k];
-
-                interpolator->GetInputImage()->TransformPhysicalPointToContinuousIndex(pointPosition,currentIndex);
-
-                if (!interpolator->IsInsideBuffer(currentIndex))
-                    continue;
-
-                unsigned int value = static_cast <unsigned int> (std::round(interpolator->EvaluateAtContinuousIndex(currentIndex)));
-
-                for (unsigned int k = 0;k < forbiddenLabels.size();++k)
-                {
-                    if (value == forbiddenLabels[k])
-                    {
-                        lineOk = false;
-                        break;
-                    }
-                }
-
-                if (!lineOk)
-                    break;
-
-                for (unsigned int k = 0;k < touchLabels.size();++k)
-                {
-                    if (value == touchLabels[k])
-                    {
-                        bool alreadyIn = false;
-                        for (unsigned int l = 0;l < seenLabels.size();++l)
-                        {
-                            if (seenLabels[l] == value)
-                            {
-                                alreadyIn = true;
-                                break;
-                            }
-                        }
-
-                        if (!alreadyIn)
-                            seenLabels.push_back(value);
-
-                        break;
-                    }
-                }
-            }
+            std::string labelString;
+            if (!(lineStream >> labelString))
+                throwBundlesFileError("Missing label after option " + optionName,fileName,lineNumber);
+
+            // Labels are non negative integers, anything else (sign, decimals, trailing characters) is rejected
+            unsigned int label = 0;
+            std::istringstream labelStream(labelString);
+            if ((labelString.find_first_not_of("0123456789") != std::string::npos) || !(labelStream >> label))
+                throwBundlesFileError("Invalid label " + labelString + " after option " + optionName,fileName,lineNumber);
+
+            if (optionName == "-t")
+                rule.touchLabels.push_back(label);
+            else if (optionName == "-e")
+                rule.endingsLabels.push_back(label);
+            else if (optionName == "-f")
+                rule.forbiddenLabels.push_back(label);
+            else
+                throwBundlesFileError("Unknown option " + optionName,fileName,lineNumber);
         }
 
-        if (!lineOk || (seenLabels.size() != touchLabels.size()))
-            tracks->DeleteCell(i);
+        outputNames.push_back(outputName);
+        rules.push_back(rule);
     }
 }
 
-typedef struct
-{
-    vtkPolyData *tracks;
-    itk::NearestNeighborInterpolateImageFunction < itk::Image <unsigned short, 3> > *interpolator;
-    std::vector <unsigned int> touchLabels;
-    std::vector <unsigned int> endingsLabels;
-    std::vector <unsigned int> forbiddenLabels;
-} ThreaderArguments;
-
-ITK_THREAD_RETURN_FUNCTION_CALL_CONVENTION ThreadFilterer(void *arg)
-{
-    itk::MultiThreaderBase::WorkUnitInfo *threadArgs = (itk::MultiThreaderBase::WorkUnitInfo *)arg;
-    unsigned int nbThread = threadArgs->WorkUnitID;
-    unsigned int numTotalThread = threadArgs->NumberOfWorkUnits;
-
-    ThreaderArguments *tmpArg = (ThreaderArguments *)threadArgs->UserData;
-    unsigned int nbTotalCells = tmpArg->tracks->GetNumberOfCells();
-
-    unsigned int step = nbTotalCells / numTotalThread;
-    unsigned int startIndex = nbThread * step;
-    unsigned int endIndex = (nbThread + 1) * step;
-
-    if (nbThread == numTotalThread - 1)
-        endIndex = nbTotalCells;
-
-    FilterTracks(tmpArg->tracks, startIndex, endIndex, tmpArg->interpolator, tmpArg->touchLabels, tmpArg->endingsLabels, tmpArg->forbiddenLabels);
-
-    return ITK_THREAD_RETURN_DEFAULT_VALUE;
-}
-
 int main(int argc, char **argv)
 {
-    TCLAP::CmdLine cmd("Filters fibers from a vtp file using a label image and specifying with several -t and -f which labels should be touched or are forbidden for each fiber. INRIA / IRISA - VisAGeS/Empenn Team", ' ',ANIMA_VERSION);
+    TCLAP::CmdLine cmd("Filters fibers from a vtp file using a label image and specifying with several -t and -f which labels should be touched or are forbidden for each fiber. Several bundles may be extracted at once with -b. INRIA / IRISA - VisAGeS/Empenn Team", ' ',ANIMA_VERSION);
 
     TCLAP::ValueArg<std::string> inArg("i","input","input tracks file",true,"","input tracks",cmd);
     TCLAP::ValueArg<std::string> roiArg("r","roi","input ROI label image",true,"","ROI image",cmd);
-    TCLAP::ValueArg<std::string> outArg("o","output","output tracks name",true,"","output tracks",cmd);
+    TCLAP::ValueArg<std::string> outArg("o","output","output tracks name",false,"","output tracks",cmd);
 
     TCLAP::MultiArg<unsigned int> touchArg("t", "touch", "Labels that have to be touched",false,"touched labels",cmd);
     TCLAP::MultiArg<unsigned int> endingsArg("e", "endings", "Labels that have to be touched by the endings of the fibers",false,"endings labels",cmd);
     TCLAP::MultiArg<unsigned int> forbiddenArg("f", "forbid", "Labels that must not to be touched",false,"forbidden labels",cmd);
 
+    TCLAP::ValueArg<std::string> bundlesArg("b","bundles","Text file of bundles to extract in the same pass, one per line: output name followed by -t, -e, -f options (e.g. cst.vtp -t 1 -t 2 -f 3)",false,"","bundles file",cmd);
+
     TCLAP::ValueArg<unsigned int> nbThreadsArg("T","nb-threads","Number of threads to run on (default: all available)",false,itk::MultiThreaderBase::GetGlobalDefaultNumberOfThreads(),"number of threads",cmd);
     try
     {
@@ -219,12 +96,118 @@ int main(int argc, char **argv)
         return EXIT_FAILURE;
     }
 
-    typedef itk::Image <unsigned short, 3> ROIImageType;
+    std::vector <std::string> outputNames;
+    std::vector <anima::FibersLabelsQuery::FilterRule> rules;
+
+    try
+    {
+        if (outArg.getValue() != "")
+        {
+            anima::FibersLabelsQuery::FilterRule rule;
+            rule.touchLabels = touchArg.getValue();
+            rule.endingsLabels = endingsArg.getValue();
+            rule.forbiddenLabels = forbiddenArg.getValue();
+
+            outputNames.push_back(outArg.getValue());
+            rules.push_back(rule);
+        }
+
+        if (bundlesArg.getValue() != "")
+            readBundlesFile(bundlesArg.getValue(),outputNames,rules);
+    }
+    catch (itk::ExceptionObject &e)
+    {
+        std::cerr << e << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    if (rules.size() == 0)
+    {
+        std::cerr << "No output bundle given, use -o or -b" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    for (unsigned int i = 0;i < rules.size();++i)
+    {
+        if (rules[i].endingsLabels.size() > 2)
+            std::cerr << "Endings consider only the two ending points of each fiber. Having more than two labels will lead to empty bundles (" << outputNames[i] << ")" << std::endl;
+    }
+
+    typedef anima::FibersLabelsQuery::LabelImageType ROIImageType;
     ROIImageType::Pointer roiImage = anima::readImage <ROIImageType> (roiArg.getValue());
 
-    typedef itk::NearestNeighborInterpolateImageFunction <ROIImageType> InterpolatorType;
-    InterpolatorType::Pointer interpolator = InterpolatorType::New();
-    interpolator->SetInputImage(roiImage);
+    // Labels visited by each fiber are computed once for all bundles
+    anima::FibersLabelsQuery labelsQuery;
+    labelsQuery.SetLabelImage(roiImage);
+    labelsQuery.SetNumberOfThreads(nbThreadsArg.getValue());
+    for (unsigned int i = 0;i < rules.size();++i)
+        labelsQuery.AddFilterRule(rules[i]);
+
+    std::vector < std::vector <unsigned char> > keptFibers;
+
+    bool streamTracks = anima::BinaryTractogramReader::IsBinaryTractogramFile(inArg.getValue());
+    for (unsigned int i = 0;i < outputNames.size();++i)
+        streamTracks &= anima::BinaryTractogramReader::IsBinaryTractogramFile(outputNames[i]);
+
+    if (streamTracks)
+    {
+        // Binary tractograms are filtered chunk by chunk, kept fibers being appended to each bundle
+        try
+        {
+            anima::BinaryTractogramReader binaryReader;
+            binaryReader.SetFileName(inArg.getValue());
+            binaryReader.Open();
+
+            std::vector < std::unique_ptr <anima::BinaryTractogramWriter> > bundleWriters(rules.size());
+            for (unsigned int i = 0;i < rules.size();++i)
+            {
+                bundleWriters[i].reset(new anima::BinaryTractogramWriter);
+                bundleWriters[i]->SetFileName(outputNames[i]);
+            }
+
+            std::vector <unsigned int> numKeptFibers(rules.size(),0);
+            std::vector <vtkIdType> keptCellIds;
+            // An input without chunks is read as one empty chunk so that empty bundle files are still written
+            unsigned int numChunks = std::max(binaryReader.GetNumberOfChunks(),(unsigned int)1);
+            for (unsigned int i = 0;i < numChunks;++i)
+            {
+                vtkSmartPointer <vtkPolyData> tracks = binaryReader.ReadChunk(i);
+                labelsQuery.Update(tracks);
+                labelsQuery.ComputeKeptFibers(keptFibers);
+
+                for (unsigned int j = 0;j < rules.size();++j)
+                {
+                    keptCellIds.clear();
+                    for (unsigned int k = 0;k < keptFibers[j].size();++k)
+                    {
+                        if (keptFibers[j][k])
+                            keptCellIds.push_back(k);
+                    }
+
+                    // Empty bundles still get their file from the last chunk
+                    if ((keptCellIds.size() == 0) && ((i != numChunks - 1) || (numKeptFibers[j] != 0)))
+                        continue;
+
+                    bundleWriters[j]->WriteChunk(tracks,keptCellIds);
+                    numKeptFibers[j] += keptCellIds.size();
+                }
+            }
+
+            for (unsigned int i = 0;i < rules.size();++i)
+            {
+                std::cout << "Kept " << numKeptFibers[i] << " after filtering" << std::endl;
+                std::cout << "Writing tracks: " << outputNames[i] << std::endl;
+                bundleWriters[i]->Close();
+            }
+        }
+        catch (itk::ExceptionObject &e)
+        {
+            std::cerr << e << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        return EXIT_SUCCESS;
+    }
 
     anima::ShapesReader trackReader;
     trackReader.SetFileName(inArg.getValue());
@@ -232,45 +215,52 @@ int main(int argc, char **argv)
 
     vtkSmartPointer <vtkPolyData> tracks = trackReader.GetOutput();
 
-    // Get dummy cell so that it's thread safe
-    vtkSmartPointer <vtkGenericCell> dummyCell = vtkGenericCell::New();
-    tracks->GetCell(0,dummyCell);
-
-    std::vector <unsigned int> touchLabels = touchArg.getValue();
-    std::vector <unsigned int> endingsLabels = endingsArg.getValue();
-    std::vector <unsigned int> forbiddenLabels = forbiddenArg.getValue();
-
-    if (endingsLabels.size() > 2)
-        std::cerr << "Endings consider only the two ending points of each fiber. Having more than two labels will lead to empty bundles" << std::endl;
-
-    ThreaderArguments tmpStr;
-    tmpStr.interpolator = interpolator;
-    tmpStr.tracks = tracks;
-    tmpStr.touchLabels = touchLabels;
-    tmpStr.endingsLabels = endingsLabels;
-    tmpStr.forbiddenLabels = forbiddenLabels;
-
-    itk::PoolMultiThreader::Pointer mThreader = itk::PoolMultiThreader::New();
-    mThreader->SetNumberOfWorkUnits(nbThreadsArg.getValue());
-    mThreader->SetSingleMethod(ThreadFilterer,&tmpStr);
-    mThreader->SingleMethodExecute();
-
-    // Final pruning of removed cells
-    tracks->RemoveDeletedCells();
-
-    // Out of security, but apparently does not do much
-    vtkSmartPointer <vtkCleanPolyData> vtkCleaner = vtkSmartPointer <vtkCleanPolyData>::New();
-    vtkCleaner->SetInputData(tracks);
-    vtkCleaner->Update();
-    tracks->ShallowCopy(vtkCleaner->GetOutput());
-
-    std::cout << "Kept " << tracks->GetNumberOfCells() << " after filtering" << std::endl;
-
-    anima::ShapesWriter writer;
-    writer.SetInputData(tracks);
-    writer.SetFileName(outArg.getValue());
-    std::cout << "Writing tracks: " << outArg.getValue() << std::endl;
-    writer.Update();
+    try
+    {
+        labelsQuery.Update(tracks);
+        labelsQuery.ComputeKeptFibers(keptFibers);
+    }
+    catch (itk::ExceptionObject &e)
+    {
+        std::cerr << e << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    unsigned int nbCells = tracks->GetNumberOfCells();
+    for (unsigned int i = 0;i < rules.size();++i)
+    {
+        vtkSmartPointer <vtkPolyData> bundle = tracks;
+        if (i != rules.size() - 1)
+        {
+            // Input tracks are modified only for the last bundle
+            bundle = vtkSmartPointer <vtkPolyData>::New();
+            bundle->DeepCopy(tracks);
+        }
+
+        bundle->BuildCells();
+        for (unsigned int j = 0;j < nbCells;++j)
+        {
+            if (!keptFibers[i][j])
+                bundle->DeleteCell(j);
+        }
+
+        // Final pruning of removed cells
+        bundle->RemoveDeletedCells();
+
+        // Out of security, but apparently does not do much
+        vtkSmartPointer <vtkCleanPolyData> vtkCleaner = vtkSmartPointer <vtkCleanPolyData>::New();
+        vtkCleaner->SetInputData(bundle);
+        vtkCleaner->Update();
+        bundle->ShallowCopy(vtkCleaner->GetOutput());
+
+        std::cout << "Kept " << bundle->GetNumberOfCells() << " after filtering" << std::endl;
+
+        anima::ShapesWriter writer;
+        writer.SetInputData(bundle);
+        writer.SetFileName(outputNames[i]);
+        std::cout << "Writing tracks: " << outputNames[i] << std::endl;
+        writer.Update();
+    }
 
     return EXIT_SUCCESS;
 }
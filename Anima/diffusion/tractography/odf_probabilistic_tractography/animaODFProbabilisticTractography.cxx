@@ -66,6 +66,7 @@ int main(int argc,  char*  argv[])
     TCLAP::SwitchArg averageClustersArg("M","average-clusters","Output only cluster mean",cmd,false);
     TCLAP::SwitchArg addLocalDataArg("L","local-data","Add local data information to output tracks",cmd);
 
+    TCLAP::ValueArg<unsigned int> randomSeedArg("","random-seed","Random seed, tractograms are reproducible for a given seed whatever the number of threads (default: current time)",false,0,"random seed",cmd);
     TCLAP::ValueArg<unsigned int> nbThreadsArg("T","nb-threads","Number of threads to run on (default: all available)",false,itk::MultiThreaderBase::GetGlobalDefaultNumberOfThreads(),"number of threads",cmd);
 
     try
@@ -86,6 +87,9 @@ int main(int argc,  char*  argv[])
     MainFilterType::Pointer odfTracker = MainFilterType::New();
 
     odfTracker->SetNumberOfWorkUnits(nbThreadsArg.getValue());
+
+    if (randomSeedArg.isSet())
+        odfTracker->SetRandomSeed(randomSeedArg.getValue());
     odfTracker->SetInputModelImage(anima::readImage <InputModelImageType> (odfArg.getValue()));
 
     odfTracker->SetInitialColinearityDirection((MainFilterType::ColinearityDirectionType)colinearityModeArg.getValue());
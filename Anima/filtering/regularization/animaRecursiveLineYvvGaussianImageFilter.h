@@ -4,6 +4,7 @@
 #include <itkNumericTraits.h>
 #include <itkVector.h>
 #include <itkVariableLengthVector.h>
+#include <itkDefaultConvertPixelTraits.h>
 
 namespace anima
 {
@@ -106,142 +107,16 @@ protected:
      * filter. */
     virtual void SetUp(ScalarRealType spacing);
 
-    /** Apply the Recursive Filter to an array of data.  This method is called
-     * for each line of the volume. Parameter "scratch" is a scratch
-     * area used for internal computations that is the same size as the
-     * parameters "outs" and "data". The scratch area must be allocated
-     * outside of this routine (this avoids memory allocation and
-     * deallocation in the inner loop of the overall algorithm. */
-    void FilterDataArray(RealType *outs, const RealType *data, unsigned int ln,
-                         RealType &sV0, RealType &sV1, RealType &sV2);
-
-    /** Utility function to compute causal part for any type */
-    template <class T>
-    inline void ComputeCausalPart(T &out, const T &data, T &V0, T &V1, T &V2)
-    {
-        out = data + V0 * m_B1 + V1 * m_B2 + V2 * m_B3;
-        V2 = V1;V1 = V0;V0 = out;
-    }
-
-    /** Utility function to compute causal part for ITK vector type */
-    template <class T>
-    inline void ComputeCausalPart(itk::VariableLengthVector<T> &out, const itk::VariableLengthVector<T> &data,
-                                  itk::VariableLengthVector<T> &V0, itk::VariableLengthVector<T> &V1,
-                                  itk::VariableLengthVector<T> &V2)
-    {
-        unsigned int vSize = data.GetSize();
-        if (out.GetSize() != vSize)
-            out.SetSize(vSize);
-
-        for (unsigned int i = 0;i < vSize;++i)
-        {
-            out[i] = data[i] + V0[i] * m_B1 + V1[i] * m_B2 + V2[i] * m_B3;
-            V2[i] = V1[i];V1[i] = V0[i];V0[i] = out[i];
-        }
-    }
-
-    /** Utility function to compute causal part for any type */
-    template <class T>
-    inline void ComputeAntiCausalPart(T &out, T &data, T &V0, T &V1, T &V2)
-    {
-        out = data * m_B + V0 * m_B1 + V1 * m_B2 + V2 * m_B3;
-        V2 = V1;V1 = V0;V0 = out;
-    }
-
-    /** Utility function to compute causal part for ITK vector type */
-    template <class T>
-    inline void ComputeAntiCausalPart(itk::VariableLengthVector<T> &out, itk::VariableLengthVector<T> &data,
-                                      itk::VariableLengthVector<T> &V0, itk::VariableLengthVector<T> &V1,
-                                      itk::VariableLengthVector<T> &V2)
-    {
-        unsigned int vSize = data.GetSize();
-        for (unsigned int i = 0;i < vSize;++i)
-        {
-            out[i] = data[i] * m_B + V0[i] * m_B1 + V1[i] * m_B2 + V2[i] * m_B3;
-            V2[i] = V1[i];V1[i] = V0[i];V0[i] = out[i];
-        }
-    }
-
-    template <class T>
-    inline void ComputeCausalBase(const T &data, T &V0, T &V1, T &V2)
-    {
-        V0 = data / (1.0 - m_B1 - m_B2 - m_B3);V1 = V0;V2 = V1;
-    }
-
-    template <class T>
-    inline void ComputeCausalBase(const itk::VariableLengthVector<T> &data, itk::VariableLengthVector<T> &V0,
-                                  itk::VariableLengthVector<T> &V1, itk::VariableLengthVector<T> &V2)
-    {
-        unsigned int vSize = data.GetSize();
-        if (V0.GetSize() != vSize)
-            V0.SetSize(vSize);
-        if (V1.GetSize() != vSize)
-            V1.SetSize(vSize);
-        if (V2.GetSize() != vSize)
-            V2.SetSize(vSize);
-
-        for (unsigned int i = 0;i < vSize;++i)
-        {
-            V0[i] = data[i] / (1.0 - m_B1 - m_B2 - m_B3);V1[i] = V0[i];V2[i] = V1[i];
-        }
-    }
-
-    template <class T>
-    inline void ComputeAntiCausalBase(const T &data, T *outs, T &V0, T &V1, T &V2, unsigned int ln)
-    {
-        // Handle outside values according to Triggs and Sdika
-        const T u_p = data / (1.0 - m_B1 - m_B2 - m_B3);
-        const T v_p = u_p / (1.0 - m_B1 - m_B2 - m_B3);
-
-        V0 = v_p;
-        V1 = v_p;
-        V2 = v_p;
-
-        for (unsigned int i = 0;i < 3;++i)
-        {
-            V0 += (outs[ln - 1 - i] - u_p) * m_MMatrix(0,i);
-            V1 += (outs[ln - 1 - i] - u_p) * m_MMatrix(1,i);
-            V2 += (outs[ln - 1 - i] - u_p) * m_MMatrix(2,i);
-        }
-
-        // This was not in the 2006 Triggs paper but sounds quite logical since m_B is not one
-        V0 *= m_B;
-        V1 *= m_B;
-        V2 *= m_B;
-    }
-
-    template <class T>
-    inline void ComputeAntiCausalBase(const itk::VariableLengthVector<T> &data, itk::VariableLengthVector<T> *outs,
-                                      itk::VariableLengthVector<T> &V0, itk::VariableLengthVector<T> &V1,
-                                      itk::VariableLengthVector<T> &V2, unsigned int ln)
-    {
-        unsigned int vSize = data.GetSize();
-        // Handle outside values according to Triggs and Sdika
-        double factor = 1.0 / (1.0 - m_B1 - m_B2 - m_B3);
-
-        for (unsigned int i = 0;i < vSize;++i)
-        {
-            V0[i] = data[i] * factor * factor;
-            V1[i] = data[i] * factor * factor;
-            V2[i] = data[i] * factor * factor;
-        }
-
-        for (unsigned int i = 0;i < 3;++i)
-            for (unsigned int j = 0;j < vSize;++j)
-        {
-            V0[j] += (outs[ln - 1 - i][j] - data[j] * factor) * m_MMatrix(0,i);
-            V1[j] += (outs[ln - 1 - i][j] - data[j] * factor) * m_MMatrix(1,i);
-            V2[j] += (outs[ln - 1 - i][j] - data[j] * factor) * m_MMatrix(2,i);
-        }
-
-        // This was not in the 2006 Triggs paper but sounds quite logical since m_B is not one
-        for (unsigned int i = 0;i < vSize;++i)
-        {
-            V0[i] *= m_B;
-            V1[i] *= m_B;
-            V2[i] *= m_B;
-        }
-    }
+    /** Apply the Recursive Filter to a block of lines at once. Data is stored in a flat scalar array,
+     * position along the line being the slowest varying index. Each row holds blockWidth values,
+     * i.e. all components of several adjacent lines, so that the recursion on a row is applied to
+     * contiguous values and may be vectorized. Parameters sV0 to sV2 are work arrays of size
+     * blockWidth, allocated outside of this routine to avoid memory allocation in the inner loop. */
+    void FilterDataBlock(ScalarRealType *outs, const ScalarRealType *data, unsigned int ln, unsigned int blockWidth,
+                         ScalarRealType *sV0, ScalarRealType *sV1, ScalarRealType *sV2);
+
+    /** Number of scalar values (lines times components) targeted for a block filtered at once */
+    static const unsigned int m_BlockScalarWidth = 32;
 
     /** Causal and anti-causal coefficients that multiply the input data. These are already divided by B0 */
     ScalarRealType m_B1;
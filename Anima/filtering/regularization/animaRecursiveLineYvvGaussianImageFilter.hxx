@@ -5,7 +5,8 @@
 #include <itkImageLinearIteratorWithIndex.h>
 #include <itkImageLinearConstIteratorWithIndex.h>
 #include <itkProgressReporter.h>
-#include <new>
+#include <vector>
+#include <algorithm>
 
 
 namespace anima
@@ -102,40 +103,108 @@ RecursiveLineYvvGaussianImageFilter<TInputImage,TOutputImage>
 }
 
 /**
- * Apply Recursive Filter
+ * Apply Recursive Filter on a block of lines
  */
 template <typename TInputImage, typename TOutputImage>
 void
 RecursiveLineYvvGaussianImageFilter<TInputImage,TOutputImage>
-::FilterDataArray(RealType *outs,const RealType *data, unsigned int ln,
-                  RealType &sV0, RealType &sV1, RealType &sV2)
+::FilterDataBlock(ScalarRealType *outs, const ScalarRealType *data, unsigned int ln, unsigned int blockWidth,
+                  ScalarRealType *sV0, ScalarRealType *sV1, ScalarRealType *sV2)
 {
+    // Local copies of the coefficients, so that they are not reloaded at each write in the inner loops
+    const ScalarRealType b1 = m_B1;
+    const ScalarRealType b2 = m_B2;
+    const ScalarRealType b3 = m_B3;
+    const ScalarRealType b = m_B;
+    const ScalarRealType baseFactor = 1.0 / (1.0 - b1 - b2 - b3);
+
+    ScalarRealType mMatrix[3][3];
+    for (unsigned int i = 0;i < 3;++i)
+    {
+        for (unsigned int j = 0;j < 3;++j)
+            mMatrix[i][j] = m_MMatrix(i,j);
+    }
+
     /**
      * Causal direction pass
      */
 
     // this value is assumed to exist from the border to infinity.
-    this->ComputeCausalBase(data[0],sV0,sV1,sV2);
+    for (unsigned int k = 0;k < blockWidth;++k)
+    {
+        sV0[k] = data[k] * baseFactor;
+        sV1[k] = sV0[k];
+        sV2[k] = sV0[k];
+    }
 
     /**
      * Recursively filter the rest
      */
-    for( unsigned int i=0; i<ln; i++ )
-        this->ComputeCausalPart(outs[i],data[i],sV0,sV1,sV2);
+    for (unsigned int i = 0;i < ln;++i)
+    {
+        const ScalarRealType *dataRow = data + i * blockWidth;
+        ScalarRealType *outRow = outs + i * blockWidth;
+
+        for (unsigned int k = 0;k < blockWidth;++k)
+        {
+            ScalarRealType outValue = dataRow[k] + sV0[k] * b1 + sV1[k] * b2 + sV2[k] * b3;
+            sV2[k] = sV1[k];
+            sV1[k] = sV0[k];
+            sV0[k] = outValue;
+            outRow[k] = outValue;
+        }
+    }
 
     /**
      * AntiCausal direction pass
      */
-    this->ComputeAntiCausalBase(data[ln-1],outs,sV0,sV1,sV2,ln);
 
-    outs[ln-1] = sV0;
+    // Handle outside values according to Triggs and Sdika
+    const ScalarRealType *lastDataRow = data + (ln - 1) * blockWidth;
+    for (unsigned int k = 0;k < blockWidth;++k)
+    {
+        const ScalarRealType u_p = lastDataRow[k] * baseFactor;
+        const ScalarRealType v_p = u_p * baseFactor;
+
+        ScalarRealType v0 = v_p;
+        ScalarRealType v1 = v_p;
+        ScalarRealType v2 = v_p;
+
+        for (unsigned int i = 0;i < 3;++i)
+        {
+            ScalarRealType diffValue = outs[(ln - 1 - i) * blockWidth + k] - u_p;
+            v0 += diffValue * mMatrix[0][i];
+            v1 += diffValue * mMatrix[1][i];
+            v2 += diffValue * mMatrix[2][i];
+        }
+
+        // This was not in the 2006 Triggs paper but sounds quite logical since m_B is not one
+        sV0[k] = v0 * b;
+        sV1[k] = v1 * b;
+        sV2[k] = v2 * b;
+    }
+
+    ScalarRealType *lastOutRow = outs + (ln - 1) * blockWidth;
+    for (unsigned int k = 0;k < blockWidth;++k)
+        lastOutRow[k] = sV0[k];
+
     /**
      * Recursively filter the rest
      */
-    for (int i=ln-2; i >= 0; i--)
-        this->ComputeAntiCausalPart(outs[i],outs[i],sV0,sV1,sV2);
-}
+    for (int i = ln - 2;i >= 0;--i)
+    {
+        ScalarRealType *outRow = outs + i * blockWidth;
 
+        for (unsigned int k = 0;k < blockWidth;++k)
+        {
+            ScalarRealType outValue = outRow[k] * b + sV0[k] * b1 + sV1[k] * b2 + sV2[k] * b3;
+            sV2[k] = sV1[k];
+            sV1[k] = sV0[k];
+            sV0[k] = outValue;
+            outRow[k] = outValue;
+        }
+    }
+}
 
 //
 // we need all of the image in just the "Direction" we are separated into
@@ -215,7 +284,7 @@ RecursiveLineYvvGaussianImageFilter<TInputImage,TOutputImage>
 
 /**
  * Compute Recursive filter
- * line by line in one of the dimensions
+ * on blocks of adjacent lines in one of the dimensions
  */
 template <typename TInputImage, typename TOutputImage>
 void
@@ -227,12 +296,18 @@ RecursiveLineYvvGaussianImageFilter<TInputImage,TOutputImage>
     typedef itk::ImageLinearConstIteratorWithIndex< TInputImage >  InputConstIteratorType;
     typedef itk::ImageLinearIteratorWithIndex< TOutputImage >      OutputIteratorType;
 
+    typedef itk::DefaultConvertPixelTraits <InputPixelType> InputConvertType;
+    typedef itk::DefaultConvertPixelTraits <OutputPixelType> OutputConvertType;
+    typedef typename OutputConvertType::ComponentType OutputComponentType;
+
     typedef itk::ImageRegion< TInputImage::ImageDimension > RegionType;
 
     typename TInputImage::ConstPointer   inputImage(    this->GetInputImage ()   );
     typename TOutputImage::Pointer       outputImage(   this->GetOutput()        );
 
     RegionType region = outputRegionForThread;
+    if (region.GetNumberOfPixels() == 0)
+        return;
 
     InputConstIteratorType  inputIterator(  inputImage,  region );
     OutputIteratorType      outputIterator( outputImage, region );
@@ -240,59 +315,69 @@ RecursiveLineYvvGaussianImageFilter<TInputImage,TOutputImage>
     inputIterator.SetDirection(  this->m_Direction );
     outputIterator.SetDirection( this->m_Direction );
 
-
     const unsigned int ln = region.GetSize()[ this->m_Direction ];
+    const unsigned int numberOfLines = region.GetNumberOfPixels() / ln;
 
-    RealType *inps = 0;
-    RealType *outs = 0;
-    RealType workData0, workData1, workData2;
+    inputIterator.GoToBegin();
+    outputIterator.GoToBegin();
 
-    try  // this try is intended to catch an eventual AbortException.
-    {
-        inps = new RealType[ln];
-        outs = new RealType[ln];
+    // Lines are gathered by blocks of adjacent lines (in the order of the linear iterator). When filtering along
+    // a non contiguous axis, adjacent lines share cache lines, making the gather act as a cache-blocked transpose.
+    // Components of all lines in a block are then filtered together on contiguous memory.
+    const unsigned int numberOfComponents = itk::NumericTraits <InputPixelType>::GetLength(inputIterator.Get());
+    const unsigned int linesPerBlock = (numberOfComponents >= m_BlockScalarWidth) ? 1 : m_BlockScalarWidth / numberOfComponents;
+    const unsigned int maxBlockWidth = linesPerBlock * numberOfComponents;
+
+    std::vector <ScalarRealType> inps(ln * maxBlockWidth);
+    std::vector <ScalarRealType> outs(ln * maxBlockWidth);
+    std::vector <ScalarRealType> workData0(maxBlockWidth), workData1(maxBlockWidth), workData2(maxBlockWidth);
 
-        inputIterator.GoToBegin();
-        outputIterator.GoToBegin();
+    OutputPixelType outputValue;
+    itk::NumericTraits <OutputPixelType>::SetLength(outputValue, numberOfComponents);
 
-        while( !inputIterator.IsAtEnd() && !outputIterator.IsAtEnd() )
+    unsigned int processedLines = 0;
+    while (processedLines < numberOfLines)
+    {
+        const unsigned int linesInBlock = std::min(linesPerBlock, numberOfLines - processedLines);
+        const unsigned int blockWidth = linesInBlock * numberOfComponents;
+
+        for (unsigned int l = 0;l < linesInBlock;++l)
         {
-            unsigned int i=0;
-            while( !inputIterator.IsAtEndOfLine() )
+            unsigned int pos = l * numberOfComponents;
+            while (!inputIterator.IsAtEndOfLine())
             {
-                inps[i++]      = inputIterator.Get();
+                const InputPixelType &inputValue = inputIterator.Get();
+                for (unsigned int c = 0;c < numberOfComponents;++c)
+                    inps[pos + c] = InputConvertType::GetNthComponent(c, inputValue);
+
+                pos += blockWidth;
                 ++inputIterator;
             }
 
-            this->FilterDataArray( outs, inps, ln, workData0, workData1, workData2 );
+            inputIterator.NextLine();
+        }
+
+        this->FilterDataBlock(outs.data(), inps.data(), ln, blockWidth,
+                              workData0.data(), workData1.data(), workData2.data());
 
-            unsigned int j=0;
-            while( !outputIterator.IsAtEndOfLine() )
+        for (unsigned int l = 0;l < linesInBlock;++l)
+        {
+            unsigned int pos = l * numberOfComponents;
+            while (!outputIterator.IsAtEndOfLine())
             {
-                outputIterator.Set( static_cast<OutputPixelType>( outs[j++] ) );
+                for (unsigned int c = 0;c < numberOfComponents;++c)
+                    OutputConvertType::SetNthComponent(c, outputValue, static_cast <OutputComponentType> (outs[pos + c]));
+
+                outputIterator.Set(outputValue);
+                pos += blockWidth;
                 ++outputIterator;
             }
 
-            inputIterator.NextLine();
             outputIterator.NextLine();
         }
-    }
-    catch( itk::ProcessAborted  & )
-    {
-        // Consider cases where memory allocation may fail or the process
-        // is aborted.
 
-        // release locally allocated memory, if memory allocation fails
-        // then we will delete a NULL pointer, which is a valid operation
-        delete [] outs;
-        delete [] inps;
-
-        // rethrow same exception
-        throw;
+        processedLines += linesInBlock;
     }
-
-    delete [] outs;
-    delete [] inps;
 }
 
 
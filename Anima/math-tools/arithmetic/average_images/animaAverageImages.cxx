@@ -1,432 +1,289 @@
 #include <animaReadWriteFunctions.h>
+#include <animaImageGeometryFunctions.h>
 #include <itkImageRegionIterator.h>
-#include <itkMultiplyImageFilter.h>
-#include <itkDivideImageFilter.h>
-#include <itkMaskImageFilter.h>
-#include <itkCastImageFilter.h>
+#include <itkMultiThreaderBase.h>
 
-#include <animaLogTensorImageFilter.h>
+#include <animaBaseTensorTools.h>
 #include <animaExpTensorImageFilter.h>
 
 #include <tclap/CmdLine.h>
 
-int main(int argc, char **argv)
+//! Next non empty line of a list file, returns false when none is left
+bool getNextImageName(std::ifstream &imageIn, std::ifstream &masksIn, std::string &imageName, std::string &maskName)
 {
-    TCLAP::CmdLine cmd("INRIA / IRISA - VisAGeS/Empenn Team", ' ',ANIMA_VERSION);
-    
-    TCLAP::ValueArg<std::string> inArg("i","inputfiles","Input image list in text file",true,"","input image list",cmd);
-    TCLAP::ValueArg<std::string> maskArg("m","maskfiles","Input masks list in text file (mask images should contain only zeros or ones)",false,"","input masks list",cmd);
-    TCLAP::ValueArg<std::string> weightsArg("w","weights","Weights list in text file",false,"","input weights list",cmd);
-    TCLAP::ValueArg<std::string> outArg("o","outputfile","Output image",true,"","output image",cmd);
-	
-    try
-    {
-        cmd.parse(argc,argv);
-    }
-    catch (TCLAP::ArgException& e)
-    {
-        std::cerr << "Error: " << e.error() << "for argument " << e.argId() << std::endl;
-        return EXIT_FAILURE;
-    }
-    
-    std::ifstream imageIn(inArg.getValue());
-
     char refN[2048];
-    imageIn.getline(refN,2048);
-    while ((strcmp(refN,"") == 0)&&(!imageIn.eof()))
+    char maskN[2048];
+
+    while (!imageIn.eof())
+    {
         imageIn.getline(refN,2048);
 
-    itk::ImageIOBase::Pointer imageIO = itk::ImageIOFactory::CreateImageIO(refN, itk::IOFileModeEnum::ReadMode);
+        if (masksIn.is_open())
+            masksIn.getline(maskN,2048);
 
-    if (!imageIO)
-    {
-        std::cerr << "Unable to read input image " << inArg.getValue() << std::endl;
-        return EXIT_FAILURE;
-    }
+        if (strcmp(refN,"") == 0)
+            continue;
 
-    imageIO->SetFileName(refN);
-    imageIO->ReadImageInformation();
+        imageName = refN;
+        if (masksIn.is_open())
+            maskName = maskN;
 
-    // Return to file start
-    imageIn.clear();
-    imageIn.seekg(0, std::ios::beg);
+        return true;
+    }
 
-    bool vectorImage = (imageIO->GetNumberOfComponents() > 1);
-    bool tensorImage = (imageIO->GetNumberOfComponents() == 6);
+    return false;
+}
 
-    using ImageType = itk::Image <long double, 3>;
-    using SaveImageType = itk::Image <double, 3>;
-    using VectorImageType = itk::VectorImage <long double, 3>;
-    using SaveVectorImageType = itk::VectorImage <double, 3>;
-    typedef itk::MultiplyImageFilter <ImageType, ImageType, ImageType> MultiplyFilterType;
-    typedef itk::DivideImageFilter <ImageType, ImageType, ImageType> DivideFilterType;
-    typedef itk::MultiplyImageFilter <VectorImageType, ImageType, VectorImageType> MultiplyVectorFilterType;
-    typedef itk::DivideImageFilter <VectorImageType, ImageType, VectorImageType> DivideVectorFilterType;
-
-    using CastFilterType = itk::CastImageFilter <ImageType, SaveImageType>;
-    using CastVectorFilterType = itk::CastImageFilter <VectorImageType, SaveVectorImageType>;
-
-	std::ifstream masksIn;
-	if (maskArg.getValue() != "")
-		masksIn.open(maskArg.getValue());
-	
-    std::ifstream weightsIn;
-    if (weightsArg.getValue() != "")
-        weightsIn.open(weightsArg.getValue());
+/**
+ * Average images in a single pass per input: each image (and its mask) is read once, multiplied by its weight and mask,
+ * possibly log-transformed (tensors), and accumulated in the same loop into flat buffers.
+ * Peak memory is thus one input, its mask and the accumulation buffers whatever the number of inputs.
+ */
+template <class ImageType>
+typename ImageType::Pointer
+averageImages(std::ifstream &imageIn, std::ifstream &masksIn, std::ifstream &weightsIn, bool tensorImage, unsigned int nThreads)
+{
+    using MaskImageType = itk::Image <float, ImageType::ImageDimension>;
+    using LECalculatorType = anima::LogEuclideanTensorCalculator <double>;
 
+    itk::MultiThreaderBase::Pointer threader = itk::MultiThreaderBase::New();
+    threader->SetNumberOfWorkUnits(nThreads);
+
+    typename ImageType::Pointer outputImage;
+    std::vector <long double> sumValues;
+    std::vector <long double> sumMasks;
     double sumWeights = 0;
-    char maskN[2048];
-	
-    if (!vectorImage)
-	{
-        ImageType::Pointer tmpOutput;
-        ImageType::Pointer tmpSumMasks;
-		
-		while (tmpOutput.IsNull())
-		{
-			imageIn.getline(refN,2048);
 
-            if (masksIn.is_open())
-                masksIn.getline(maskN,2048);
-            if (strcmp(refN,"") == 0)
-                continue;
-			            
-            tmpOutput = anima::readImage <ImageType> (refN);
-            double imageWeight = 1.0;
-            if (weightsIn.is_open())
-                weightsIn >> imageWeight;
-
-            std::cout << "Adding image " << refN << " with weight " << imageWeight << "..." << std::endl;
-
-            sumWeights += imageWeight;
-			
-            if (imageWeight != 1.0)
-            {
-                MultiplyFilterType::Pointer multiplyFilter = MultiplyFilterType::New();
-                multiplyFilter->SetInput1(tmpOutput);
-                multiplyFilter->SetConstant(imageWeight);
-                multiplyFilter->Update();
+    unsigned int numPixels = 0;
+    unsigned int numComponents = 1;
+    unsigned int tensorDimension = 3;
 
-                tmpOutput = multiplyFilter->GetOutput();
-                tmpOutput->DisconnectPipeline();
-            }
+    // Chunks of pixels processed by each thread call
+    const unsigned int chunkSize = 4096;
 
-			if (masksIn.is_open())
-            {
-                tmpSumMasks = anima::readImage <ImageType> (maskN);
+    std::string imageName, maskName;
+    while (getNextImageName(imageIn,masksIn,imageName,maskName))
+    {
+        double imageWeight = 1.0;
+        if (weightsIn.is_open())
+            weightsIn >> imageWeight;
 
-                MultiplyFilterType::Pointer maskFilter = MultiplyFilterType::New();
-                maskFilter->SetInput1(tmpOutput);
-                maskFilter->SetInput2(tmpSumMasks);
-                maskFilter->Update();
+        std::cout << "Adding image " << imageName << " with weight " << imageWeight << "..." << std::endl;
 
-                tmpOutput = maskFilter->GetOutput();
-                tmpOutput->DisconnectPipeline();
+        sumWeights += imageWeight;
 
-                if (imageWeight != 1.0)
-                {
-                    MultiplyFilterType::Pointer multiplyMaskFilter = MultiplyFilterType::New();
-                    multiplyMaskFilter->SetInput1(tmpSumMasks);
-                    multiplyMaskFilter->SetConstant(imageWeight);
-                    multiplyMaskFilter->Update();
+        typename ImageType::Pointer inputImage = anima::readImage <ImageType> (imageName);
 
-                    tmpSumMasks = multiplyMaskFilter->GetOutput();
-                    tmpSumMasks->DisconnectPipeline();
-                }
-            }
-		}
-		
-		while(!imageIn.eof())
-		{
-            imageIn.getline(refN,2048);
+        if (outputImage.IsNull())
+        {
+            // Keep first image as the output geometry holder, its buffer is reused at the end
+            outputImage = inputImage;
+            numPixels = outputImage->GetLargestPossibleRegion().GetNumberOfPixels();
+            numComponents = outputImage->GetNumberOfComponentsPerPixel();
+            tensorDimension = std::floor((std::sqrt((double)(8 * numComponents + 1)) - 1) / 2.0);
 
+            sumValues.assign(numPixels * numComponents,0.0);
             if (masksIn.is_open())
-                masksIn.getline(maskN,2048);
-            if (strcmp(refN,"") == 0)
-                continue;
-
-            double imageWeight = 1.0;
-            if (weightsIn.is_open())
-                weightsIn >> imageWeight;
-
-            sumWeights += imageWeight;
+                sumMasks.assign(numPixels,0.0);
+        }
+        else
+        {
+            // Flat buffers below are indexed with the first image layout
+            anima::checkImageGeometryAndComponents(outputImage.GetPointer(),inputImage.GetPointer(),imageName);
+        }
 
-            std::cout << "Adding image " << refN << " with weight " << imageWeight << "..." << std::endl;
-			
-            ImageType::Pointer tmpImage = anima::readImage <ImageType> (refN);
+        double *inputBuffer = inputImage->GetBufferPointer();
 
-            itk::ImageRegionIterator <ImageType> tmpIt(tmpImage,tmpImage->GetLargestPossibleRegion());
-            itk::ImageRegionIterator <ImageType> resIt(tmpOutput,tmpImage->GetLargestPossibleRegion());
-			
-			if (masksIn.is_open())
-            {
-                ImageType::Pointer tmpMask = anima::readImage <ImageType> (maskN);
-                
-                itk::ImageRegionIterator <ImageType> tmpMaskIt(tmpMask,tmpImage->GetLargestPossibleRegion());
-                itk::ImageRegionIterator <ImageType> sumMasksIt(tmpSumMasks,tmpImage->GetLargestPossibleRegion());
-				
-				while (!sumMasksIt.IsAtEnd())
-				{
-					if (tmpMaskIt.Get() == 0)
-					{
-						++tmpMaskIt;
-						++sumMasksIt;
-						++tmpIt;
-						++resIt;
-						continue;
-					}
-					
-                    sumMasksIt.Set(sumMasksIt.Get() + imageWeight * tmpMaskIt.Get());
-                    resIt.Set(resIt.Get() + imageWeight * tmpIt.Get());
-					
-					++tmpMaskIt;
-					++sumMasksIt;
-					++tmpIt;
-					++resIt;
-				}
-			}
-			else
-			{
-				while (!resIt.IsAtEnd())
-				{
-                    resIt.Set(resIt.Get() + imageWeight * tmpIt.Get());
-					++tmpIt;
-					++resIt;
-				}
-            }
-		}
-		
+        typename MaskImageType::Pointer maskImage;
+        float *maskBuffer = 0;
         if (masksIn.is_open())
-            masksIn.close();
+        {
+            maskImage = anima::readImage <MaskImageType> (maskName);
+            anima::checkImageGeometry(outputImage.GetPointer(),maskImage.GetPointer(),maskName);
+            maskBuffer = maskImage->GetBufferPointer();
+        }
 
-        if (weightsIn.is_open())
-            weightsIn.close();
-
-        if (tmpSumMasks.IsNotNull())
-		{
-            DivideFilterType::Pointer divideFilter = DivideFilterType::New();
-            divideFilter->SetInput1(tmpOutput);
-            divideFilter->SetInput2(tmpSumMasks);
-            divideFilter->Update();
-
-            typedef itk::MaskImageFilter <ImageType, ImageType, ImageType> MaskFilterType;
-            MaskFilterType::Pointer maskFilter = MaskFilterType::New();
-            maskFilter->SetInput(divideFilter->GetOutput());
-            maskFilter->SetMaskImage(tmpSumMasks);
-            maskFilter->Update();
-
-            tmpOutput = maskFilter->GetOutput();
-            tmpOutput->DisconnectPipeline();
-		}
-		else
-		{
-            DivideFilterType::Pointer divideFilter = DivideFilterType::New();
-            divideFilter->SetInput1(tmpOutput);
-            divideFilter->SetConstant(sumWeights);
-            divideFilter->Update();
-
-            tmpOutput = divideFilter->GetOutput();
-            tmpOutput->DisconnectPipeline();
-		}
-
-        CastFilterType::Pointer castFilter = CastFilterType::New();
-        castFilter->SetInput(tmpOutput);
-        castFilter->Update();
-        
-        anima::writeImage <SaveImageType> (outArg.getValue(),castFilter->GetOutput());
-	}
-	else // vecArg is activated
-	{		
-        VectorImageType::Pointer outputData;
-        ImageType::Pointer tmpSumMasks;
-		
-		while (outputData.IsNull())
-		{
-			imageIn.getline(refN,2048);
+        unsigned int numChunks = (numPixels + chunkSize - 1) / chunkSize;
+        threader->ParallelizeArray(0, numChunks, [&](itk::SizeValueType chunk)
+        {
+            unsigned int firstPixel = chunk * chunkSize;
+            unsigned int lastPixel = std::min(numPixels, firstPixel + chunkSize);
 
-            if (masksIn.is_open())
-                masksIn.getline(maskN,2048);
-            if (strcmp(refN,"") == 0)
-                continue;
-			
-            outputData = anima::readImage <VectorImageType> (refN);
+            LECalculatorType::Pointer leCalculator;
+            vnl_matrix <double> tmpTensor(tensorDimension, tensorDimension);
+            vnl_matrix <double> tmpLogTensor(tensorDimension, tensorDimension);
+            itk::VariableLengthVector <double> tensorVector;
             if (tensorImage)
+                leCalculator = LECalculatorType::New();
+
+            for (unsigned int i = firstPixel;i < lastPixel;++i)
             {
-                using LogFilterType = anima::LogTensorImageFilter <long double, 3>;
-                LogFilterType::Pointer logFilter = LogFilterType::New();
-                logFilter->SetInput(outputData);
-                logFilter->Update();
+                double pixelWeight = imageWeight;
+                if (maskBuffer)
+                {
+                    if (maskBuffer[i] == 0)
+                        continue;
+
+                    pixelWeight *= maskBuffer[i];
+                    sumMasks[i] += pixelWeight;
+                }
+
+                double *pixelValues = inputBuffer + i * numComponents;
+                if (tensorImage)
+                {
+                    bool zeroTensor = true;
+                    for (unsigned int j = 0;j < numComponents;++j)
+                    {
+                        if (pixelValues[j] != 0)
+                        {
+                            zeroTensor = false;
+                            break;
+                        }
+                    }
+
+                    if (!zeroTensor)
+                    {
+                        tensorVector.SetData(pixelValues,numComponents,false);
+                        anima::GetTensorFromVectorRepresentation(tensorVector,tmpTensor,tensorDimension);
+                        leCalculator->GetTensorLogarithm(tmpTensor,tmpLogTensor);
+                        anima::GetVectorRepresentation(tmpLogTensor,tensorVector,numComponents,true);
+                    }
+                }
 
-                outputData = logFilter->GetOutput();
-                outputData->DisconnectPipeline();
+                long double *sumPixelValues = sumValues.data() + i * numComponents;
+                for (unsigned int j = 0;j < numComponents;++j)
+                    sumPixelValues[j] += pixelWeight * pixelValues[j];
             }
+        }, nullptr);
+    }
 
-            double imageWeight = 1.0;
-            if (weightsIn.is_open())
-                weightsIn >> imageWeight;
+    if (outputImage.IsNull())
+        throw itk::ExceptionObject(__FILE__, __LINE__,"No input image found in list",ITK_LOCATION);
 
-            std::cout << "Adding image " << refN << " with weight " << imageWeight << "..." << std::endl;
+    // Final normalization, written directly into the output buffer
+    double *outputBuffer = outputImage->GetBufferPointer();
+    unsigned int numChunks = (numPixels + chunkSize - 1) / chunkSize;
+    threader->ParallelizeArray(0, numChunks, [&](itk::SizeValueType chunk)
+    {
+        unsigned int firstPixel = chunk * chunkSize;
+        unsigned int lastPixel = std::min(numPixels, firstPixel + chunkSize);
 
-            sumWeights += imageWeight;
+        for (unsigned int i = firstPixel;i < lastPixel;++i)
+        {
+            long double normalizationValue = sumWeights;
+            if (sumMasks.size() != 0)
+                normalizationValue = sumMasks[i];
 
-            if (imageWeight != 1.0)
+            for (unsigned int j = 0;j < numComponents;++j)
             {
-                MultiplyVectorFilterType::Pointer multiplyFilter = MultiplyVectorFilterType::New();
-                multiplyFilter->SetInput1(outputData);
-                multiplyFilter->SetConstant(imageWeight);
-                multiplyFilter->Update();
-
-                outputData = multiplyFilter->GetOutput();
-                outputData->DisconnectPipeline();
+                unsigned int pos = i * numComponents + j;
+                if (normalizationValue != 0)
+                    outputBuffer[pos] = sumValues[pos] / normalizationValue;
+                else
+                    outputBuffer[pos] = 0;
             }
+        }
+    }, nullptr);
 
-            if (masksIn.is_open())
-            {
-                tmpSumMasks = anima::readImage <ImageType> (maskN);
+    return outputImage;
+}
 
-                MultiplyVectorFilterType::Pointer maskFilter = MultiplyVectorFilterType::New();
-                maskFilter->SetInput1(outputData);
-                maskFilter->SetInput2(tmpSumMasks);
-                maskFilter->Update();
+int main(int argc, char **argv)
+{
+    TCLAP::CmdLine cmd("INRIA / IRISA - VisAGeS/Empenn Team", ' ',ANIMA_VERSION);
 
-                outputData = maskFilter->GetOutput();
-                outputData->DisconnectPipeline();
+    TCLAP::ValueArg<std::string> inArg("i","inputfiles","Input image list in text file",true,"","input image list",cmd);
+    TCLAP::ValueArg<std::string> maskArg("m","maskfiles","Input masks list in text file (mask images should contain only zeros or ones)",false,"","input masks list",cmd);
+    TCLAP::ValueArg<std::string> weightsArg("w","weights","Weights list in text file",false,"","input weights list",cmd);
+    TCLAP::ValueArg<std::string> outArg("o","outputfile","Output image",true,"","output image",cmd);
 
-                if (imageWeight != 1.0)
-                {
-                    MultiplyFilterType::Pointer multiplyMaskFilter = MultiplyFilterType::New();
-                    multiplyMaskFilter->SetInput1(tmpSumMasks);
-                    multiplyMaskFilter->SetConstant(imageWeight);
-                    multiplyMaskFilter->Update();
+    TCLAP::ValueArg<unsigned int> nbpArg("T","numberofthreads","Number of threads to run on (default : all cores)",false,itk::MultiThreaderBase::GetGlobalDefaultNumberOfThreads(),"number of threads",cmd);
 
-                    tmpSumMasks = multiplyMaskFilter->GetOutput();
-                    tmpSumMasks->DisconnectPipeline();
-                }
-            }
-		}
-		
-		while(!imageIn.eof())
-		{
-			imageIn.getline(refN,2048);
-			
-            if (masksIn.is_open())
-                masksIn.getline(maskN,2048);
-            if (strcmp(refN,"") == 0)
-                continue;
-			
-            double imageWeight = 1.0;
-            if (weightsIn.is_open())
-                weightsIn >> imageWeight;
+    try
+    {
+        cmd.parse(argc,argv);
+    }
+    catch (TCLAP::ArgException& e)
+    {
+        std::cerr << "Error: " << e.error() << "for argument " << e.argId() << std::endl;
+        return EXIT_FAILURE;
+    }
 
-            sumWeights += imageWeight;
+    std::ifstream imageIn(inArg.getValue());
 
-            std::cout << "Adding image " << refN << " with weight " << imageWeight << "..." << std::endl;
+    char refN[2048];
+    imageIn.getline(refN,2048);
+    while ((strcmp(refN,"") == 0)&&(!imageIn.eof()))
+        imageIn.getline(refN,2048);
 
-            VectorImageType::Pointer tmpImage = anima::readImage <VectorImageType> (refN);
-            if (tensorImage)
-            {
-                using LogFilterType = anima::LogTensorImageFilter <long double, 3>;
-                LogFilterType::Pointer logFilter = LogFilterType::New();
-                logFilter->SetInput(tmpImage);
-                logFilter->Update();
+    itk::ImageIOBase::Pointer imageIO = itk::ImageIOFactory::CreateImageIO(refN, itk::IOFileModeEnum::ReadMode);
 
-                tmpImage = logFilter->GetOutput();
-                tmpImage->DisconnectPipeline();
-            }
-            
-			itk::ImageRegionIterator <VectorImageType> tmpIt(tmpImage,tmpImage->GetLargestPossibleRegion());
-			itk::ImageRegionIterator <VectorImageType> resIt(outputData,tmpImage->GetLargestPossibleRegion());
-            
-			if (masksIn.is_open())
-            {
-                ImageType::Pointer tmpMask = anima::readImage <ImageType> (maskN);
-                
-                itk::ImageRegionIterator <ImageType> tmpMaskIt(tmpMask,tmpImage->GetLargestPossibleRegion());
-                itk::ImageRegionIterator <ImageType> sumMasksIt(tmpSumMasks,tmpImage->GetLargestPossibleRegion());
-				
-				while (!sumMasksIt.IsAtEnd())
-				{
-					if (tmpMaskIt.Get() == 0)
-					{
-						++tmpMaskIt;
-						++sumMasksIt;
-						++tmpIt;
-						++resIt;
-						continue;
-					}
-					
-                    sumMasksIt.Set(sumMasksIt.Get() + imageWeight * tmpMaskIt.Get());
-                    resIt.Set(resIt.Get() + imageWeight * tmpIt.Get());
-					
-					++tmpMaskIt;
-					++sumMasksIt;
-					++tmpIt;
-					++resIt;
-				}
-			}
-			else
-			{
-				while (!resIt.IsAtEnd())
-				{
-                    resIt.Set(resIt.Get() + imageWeight * tmpIt.Get());
-					++tmpIt;
-					++resIt;
-				}
-			}
-		}
+    if (!imageIO)
+    {
+        std::cerr << "Unable to read input image " << inArg.getValue() << std::endl;
+        return EXIT_FAILURE;
+    }
 
-        if (masksIn.is_open())
-            masksIn.close();
+    imageIO->SetFileName(refN);
+    imageIO->ReadImageInformation();
 
-        if (weightsIn.is_open())
-            weightsIn.close();
-		
-        if (tmpSumMasks.IsNotNull())
+    // Return to file start
+    imageIn.clear();
+    imageIn.seekg(0, std::ios::beg);
+
+    bool vectorImage = (imageIO->GetNumberOfComponents() > 1);
+    bool tensorImage = (imageIO->GetNumberOfComponents() == 6);
+
+    using ImageType = itk::Image <double, 3>;
+    using VectorImageType = itk::VectorImage <double, 3>;
+
+    std::ifstream masksIn;
+    if (maskArg.getValue() != "")
+        masksIn.open(maskArg.getValue());
+
+    std::ifstream weightsIn;
+    if (weightsArg.getValue() != "")
+        weightsIn.open(weightsArg.getValue());
+
+    try
+    {
+        if (!vectorImage)
         {
-            DivideVectorFilterType::Pointer divideFilter = DivideVectorFilterType::New();
-            divideFilter->SetInput1(outputData);
-            divideFilter->SetInput2(tmpSumMasks);
-            divideFilter->Update();
-
-            typedef itk::MaskImageFilter <VectorImageType, ImageType, VectorImageType> MaskFilterType;
-            MaskFilterType::Pointer maskFilter = MaskFilterType::New();
-            maskFilter->SetInput(divideFilter->GetOutput());
-            maskFilter->SetMaskImage(tmpSumMasks);
-            maskFilter->Update();
-
-            outputData = maskFilter->GetOutput();
-            outputData->DisconnectPipeline();
+            ImageType::Pointer outputImage = averageImages <ImageType> (imageIn,masksIn,weightsIn,false,nbpArg.getValue());
+            anima::writeImage <ImageType> (outArg.getValue(),outputImage);
         }
         else
         {
-            DivideVectorFilterType::Pointer divideFilter = DivideVectorFilterType::New();
-            divideFilter->SetInput1(outputData);
-            divideFilter->SetConstant(sumWeights);
-            divideFilter->Update();
-
-            outputData = divideFilter->GetOutput();
-            outputData->DisconnectPipeline();
-        }
+            VectorImageType::Pointer outputImage = averageImages <VectorImageType> (imageIn,masksIn,weightsIn,tensorImage,nbpArg.getValue());
 
-        if (tensorImage)
-        {
-            using ExpFilterType = anima::ExpTensorImageFilter <long double, 3>;
-            ExpFilterType::Pointer expFilter = ExpFilterType::New();
-            expFilter->SetInput(outputData);
-            expFilter->Update();
+            if (tensorImage)
+            {
+                using ExpFilterType = anima::ExpTensorImageFilter <double, 3>;
+                ExpFilterType::Pointer expFilter = ExpFilterType::New();
+                expFilter->SetInput(outputImage);
+                expFilter->SetNumberOfWorkUnits(nbpArg.getValue());
+                expFilter->Update();
+
+                outputImage = expFilter->GetOutput();
+                outputImage->DisconnectPipeline();
+            }
 
-            outputData = expFilter->GetOutput();
-            outputData->DisconnectPipeline();
+            anima::writeImage <VectorImageType> (outArg.getValue(),outputImage);
         }
-        
-        CastVectorFilterType::Pointer castFilter = CastVectorFilterType::New();
-        castFilter->SetInput(outputData);
-        castFilter->Update();
+    }
+    catch (itk::ExceptionObject &e)
+    {
+        std::cerr << e << std::endl;
+        return EXIT_FAILURE;
+    }
 
-        anima::writeImage <SaveVectorImageType> (outArg.getValue(),castFilter->GetOutput());
-	}
+    if (masksIn.is_open())
+        masksIn.close();
+
+    if (weightsIn.is_open())
+        weightsIn.close();
 
     imageIn.close();
-	
+
 	return EXIT_SUCCESS;
 }
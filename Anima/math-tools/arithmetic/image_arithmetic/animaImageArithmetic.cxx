@@ -1,184 +1,155 @@
 #include <tclap/CmdLine.h>
 
 #include <animaReadWriteFunctions.h>
+#include <animaImageGeometryFunctions.h>
 #include <itkImage.h>
 #include <itkVectorImage.h>
 #include <itkImageRegionIterator.h>
+#include <itkImageRegionConstIterator.h>
+#include <itkMultiThreaderBase.h>
 
-#include <itkAddImageFilter.h>
-#include <itkSubtractImageFilter.h>
-#include <itkDivideImageFilter.h>
-#include <itkMultiplyImageFilter.h>
-#include <itkPowImageFilter.h>
+//! Power is only applied to scalar values
+inline void applyPower(double &value, double powConstant)
+{
+    value = std::pow(value,powConstant);
+}
+
+template <class PixelType>
+inline void applyPower(PixelType &value, double powConstant)
+{
+}
+
+template <class PixelType>
+inline void addConstantValue(PixelType &value, double constant)
+{
+    value += constant;
+}
+
+template <class ValueType>
+inline void addConstantValue(itk::VariableLengthVector <ValueType> &value, double constant)
+{
+    for (unsigned int i = 0;i < value.GetSize();++i)
+        value[i] += constant;
+}
 
+/**
+ * Computes ( (I * m * M) / (D * d) + A + a - s - S)^P in a single multi-threaded pass over the input,
+ * operand images being read beforehand and no intermediate image being allocated.
+ */
 template <class ImageType>
 void computeArithmetic (std::string &inStr, std::string &outStr, std::string &multImStr, std::string &divImStr, std::string &addImStr,
                         std::string &subImStr, double multConstant, double divideConstant, double addConstant, double subConstant,
                         double powConstant, unsigned int nThreads)
 {
     typedef itk::Image <double, ImageType::ImageDimension> WorkImageType;
-    typedef itk::AddImageFilter <ImageType,ImageType,ImageType> AddFilterType;
-    typedef itk::AddImageFilter <ImageType,WorkImageType,ImageType> AddConstantFilterType;
-    typedef itk::SubtractImageFilter <ImageType,ImageType,ImageType> SubtractFilterType;
-    typedef itk::SubtractImageFilter <ImageType,WorkImageType,ImageType> SubtractConstantFilterType;
-
-    typedef itk::MultiplyImageFilter <ImageType,WorkImageType,ImageType> MultiplyFilterType;
-    typedef itk::DivideImageFilter <ImageType,WorkImageType,ImageType> DivideFilterType;
-        
+    typedef typename ImageType::RegionType RegionType;
+    typedef typename ImageType::PixelType PixelType;
+
     typename ImageType::Pointer currentImage = anima::readImage <ImageType> (inStr);
     currentImage->DisconnectPipeline();
-    
+
+    typename WorkImageType::Pointer multImage, divImage;
+    typename ImageType::Pointer addedImage, subtractedImage;
+
     if (multImStr != "")
     {
-        typedef itk::ImageFileReader <WorkImageType> MultiplyReaderType;
-        typename MultiplyReaderType::Pointer multImReader = MultiplyReaderType::New();
-        multImReader->SetFileName(multImStr);
-        multImReader->Update();
-        
-        typename MultiplyFilterType::Pointer multFilter = MultiplyFilterType::New();
-        multFilter->SetInput1(currentImage);
-        multFilter->SetInput2(multImReader->GetOutput());
-        multFilter->SetNumberOfWorkUnits(nThreads);
-        multFilter->InPlaceOn();
-        
-        multFilter->Update();
-        currentImage = multFilter->GetOutput();
-        currentImage->DisconnectPipeline();
-    }
-    
-    if (multConstant != 1.0)
-    {
-        typename MultiplyFilterType::Pointer multFilter = MultiplyFilterType::New();
-        multFilter->SetInput1(currentImage);
-        multFilter->SetConstant(multConstant);
-        multFilter->SetNumberOfWorkUnits(nThreads);
-        multFilter->InPlaceOn();
-        
-        multFilter->Update();
-        currentImage = multFilter->GetOutput();
-        currentImage->DisconnectPipeline();
+        multImage = anima::readImage <WorkImageType> (multImStr);
+        anima::checkImageGeometry(currentImage.GetPointer(),multImage.GetPointer(),multImStr);
     }
-    
-    if ((divideConstant != 0.0)&&(divideConstant != 1.0))
-    {
-        typename DivideFilterType::Pointer divFilter = DivideFilterType::New();
-        divFilter->SetInput1(currentImage);
-        divFilter->SetConstant(divideConstant);
-        divFilter->SetNumberOfWorkUnits(nThreads);
-        divFilter->InPlaceOn();
-        
-        divFilter->Update();
-        currentImage = divFilter->GetOutput();
-        currentImage->DisconnectPipeline();
-    }
-    
+
     if (divImStr != "")
     {
-        typedef itk::ImageFileReader <WorkImageType> DivideReaderType;
-        typename DivideReaderType::Pointer divImReader = DivideReaderType::New();
-        divImReader->SetFileName(divImStr);
-        divImReader->Update();
-
-        typename DivideFilterType::Pointer divFilter = DivideFilterType::New();
-        divFilter->SetInput1(currentImage);
-        divFilter->SetInput2(divImReader->GetOutput());
-        divFilter->SetNumberOfWorkUnits(nThreads);
-        divFilter->InPlaceOn();
-        
-        divFilter->Update();
-        currentImage = divFilter->GetOutput();
-        currentImage->DisconnectPipeline();
-        
-        itk::ImageRegionIterator <WorkImageType> divImItr (divImReader->GetOutput(),divImReader->GetOutput()->GetLargestPossibleRegion());
-        itk::ImageRegionIterator <ImageType> currentImageItr (currentImage,currentImage->GetLargestPossibleRegion());
-        
-        while (!currentImageItr.IsAtEnd())
-        {
-            // Multiplication by 0.0 since current image may be a vector
-            if (itk::Math::AlmostEquals(divImItr.Get(), itk::NumericTraits<typename WorkImageType::PixelType>::ZeroValue()))
-                currentImageItr.Set(currentImageItr.Get() * 0.0);
-            
-            ++currentImageItr;
-            ++divImItr;
-        }
+        divImage = anima::readImage <WorkImageType> (divImStr);
+        anima::checkImageGeometry(currentImage.GetPointer(),divImage.GetPointer(),divImStr);
     }
-    
+
     if (addImStr != "")
     {
-        typename ImageType::Pointer addedImage = anima::readImage <ImageType> (addImStr);
-        
-        typename AddFilterType::Pointer addFilter = AddFilterType::New();
-        addFilter->SetInput1(currentImage);
-        addFilter->SetInput2(addedImage);
-        addFilter->SetNumberOfWorkUnits(nThreads);
-        addFilter->InPlaceOn();
-        
-        addFilter->Update();
-        currentImage = addFilter->GetOutput();
-        currentImage->DisconnectPipeline();
+        addedImage = anima::readImage <ImageType> (addImStr);
+        anima::checkImageGeometryAndComponents(currentImage.GetPointer(),addedImage.GetPointer(),addImStr);
     }
-    
+
     if (subImStr != "")
     {
-        typename ImageType::Pointer subtractedImage = anima::readImage <ImageType> (subImStr);
-        
-        typename SubtractFilterType::Pointer subFilter = SubtractFilterType::New();
-        subFilter->SetInput1(currentImage);
-        subFilter->SetInput2(subtractedImage);
-        subFilter->SetNumberOfWorkUnits(nThreads);
-        subFilter->InPlaceOn();
-        
-        subFilter->Update();
-        currentImage = subFilter->GetOutput();
-        currentImage->DisconnectPipeline();
+        subtractedImage = anima::readImage <ImageType> (subImStr);
+        anima::checkImageGeometryAndComponents(currentImage.GetPointer(),subtractedImage.GetPointer(),subImStr);
     }
 
-    if (addConstant != 0.0)
-    {
-        typename AddConstantFilterType::Pointer addFilter = AddConstantFilterType::New();
-        addFilter->SetInput1(currentImage);
-        addFilter->SetConstant(addConstant);
-        addFilter->SetNumberOfWorkUnits(nThreads);
-        addFilter->InPlaceOn();
-
-        addFilter->Update();
-        currentImage = addFilter->GetOutput();
-        currentImage->DisconnectPipeline();
-    }
+    bool useDivideConstant = (divideConstant != 0.0)&&(divideConstant != 1.0);
 
-    if (subConstant != 0.0)
-    {
-        typename SubtractConstantFilterType::Pointer subFilter = SubtractConstantFilterType::New();
-        subFilter->SetInput1(currentImage);
-        subFilter->SetConstant(subConstant);
-        subFilter->SetNumberOfWorkUnits(nThreads);
-        subFilter->InPlaceOn();
-
-        subFilter->Update();
-        currentImage = subFilter->GetOutput();
-        currentImage->DisconnectPipeline();
-    }
+    itk::MultiThreaderBase::Pointer threader = itk::MultiThreaderBase::New();
+    threader->SetNumberOfWorkUnits(nThreads);
 
-    if (powConstant != 1.0)
+    threader->template ParallelizeImageRegion <ImageType::ImageDimension> (currentImage->GetLargestPossibleRegion(),
+                                                                          [&](const RegionType &region)
     {
-        typedef itk::Image <typename ImageType::IOPixelType, ImageType::ImageDimension> ScalarImageType;
-        typedef itk::PowImageFilter <ScalarImageType, WorkImageType, ScalarImageType> PowConstantFilterType;
-
-        ScalarImageType *castImage = dynamic_cast <ScalarImageType *> (currentImage.GetPointer());
-        if (castImage)
+        itk::ImageRegionIterator <ImageType> currentImageItr (currentImage,region);
+        itk::ImageRegionConstIterator <WorkImageType> multImItr, divImItr;
+        itk::ImageRegionConstIterator <ImageType> addImItr, subImItr;
+
+        if (multImage)
+            multImItr = itk::ImageRegionConstIterator <WorkImageType> (multImage,region);
+        if (divImage)
+            divImItr = itk::ImageRegionConstIterator <WorkImageType> (divImage,region);
+        if (addedImage)
+            addImItr = itk::ImageRegionConstIterator <ImageType> (addedImage,region);
+        if (subtractedImage)
+            subImItr = itk::ImageRegionConstIterator <ImageType> (subtractedImage,region);
+
+        PixelType value;
+        while (!currentImageItr.IsAtEnd())
         {
-            typename PowConstantFilterType::Pointer powFilter = PowConstantFilterType::New();
-            powFilter->SetInput1(castImage);
-            powFilter->SetConstant(powConstant);
-            powFilter->SetNumberOfWorkUnits(nThreads);
-            powFilter->InPlaceOn();
-
-            powFilter->Update();
-
-            currentImage = dynamic_cast <ImageType *> (powFilter->GetOutput());
-            currentImage->DisconnectPipeline();
+            value = currentImageItr.Get();
+
+            if (multImage)
+            {
+                value *= multImItr.Get();
+                ++multImItr;
+            }
+
+            if (multConstant != 1.0)
+                value *= multConstant;
+
+            if (useDivideConstant)
+                value /= divideConstant;
+
+            if (divImage)
+            {
+                // Multiplication by 0.0 since current image may be a vector
+                double divValue = divImItr.Get();
+                if (itk::Math::AlmostEquals(divValue, itk::NumericTraits<typename WorkImageType::PixelType>::ZeroValue()))
+                    value *= 0.0;
+                else
+                    value /= divValue;
+
+                ++divImItr;
+            }
+
+            if (addedImage)
+            {
+                value += addImItr.Get();
+                ++addImItr;
+            }
+
+            if (subtractedImage)
+            {
+                value -= subImItr.Get();
+                ++subImItr;
+            }
+
+            if (addConstant != 0.0)
+                addConstantValue(value,addConstant);
+
+            if (subConstant != 0.0)
+                addConstantValue(value,- subConstant);
+
+            if (powConstant != 1.0)
+                applyPower(value,powConstant);
+
+            currentImageItr.Set(value);
+            ++currentImageItr;
         }
-    }
+    }, nullptr);
 
     // Finally write the result
     anima::writeImage <ImageType> (outStr,currentImage);
@@ -188,7 +159,7 @@ int main(int argc, char **argv)
 {
     std::string descriptionMessage = "Performs very basic mathematical operations on images: performs ( (I * m * M) / (D * d) + A + a - s - S)^P \n";
     descriptionMessage += "This software has known limitations: you might have to use it several times in a row to perform the operation you want,\n";
-    descriptionMessage += "it requires the divide and multiply images to be scalar, and the add and subtract images to be of the same format as the input (although this is not verified).\n";
+    descriptionMessage += "it requires the divide and multiply images to be scalar, and the add and subtract images to be of the same format as the input.\n";
     descriptionMessage += "INRIA / IRISA - VisAGeS/Empenn Team";
     
     TCLAP::CmdLine cmd(descriptionMessage, ' ',ANIMA_VERSION);
@@ -238,18 +209,26 @@ int main(int argc, char **argv)
     bool vectorImage = (imageIO->GetNumberOfComponents() > 1);
     bool fourDimensionalImage = (imageIO->GetNumberOfDimensions() == 4);
 
-    if (vectorImage)
-        computeArithmetic<VectorImageType>(inArg.getValue(),outArg.getValue(),multImArg.getValue(),divImArg.getValue(),addImArg.getValue(),
+    try
+    {
+        if (vectorImage)
+            computeArithmetic<VectorImageType>(inArg.getValue(),outArg.getValue(),multImArg.getValue(),divImArg.getValue(),addImArg.getValue(),
+                                               subtractImArg.getValue(),multiplyConstantArg.getValue(),divideConstantArg.getValue(),
+                                               addConstantArg.getValue(),subtractConstantArg.getValue(),powArg.getValue(),nbpArg.getValue());
+        else if (fourDimensionalImage)
+            computeArithmetic<Image4DType>(inArg.getValue(),outArg.getValue(),multImArg.getValue(),divImArg.getValue(),addImArg.getValue(),
                                            subtractImArg.getValue(),multiplyConstantArg.getValue(),divideConstantArg.getValue(),
                                            addConstantArg.getValue(),subtractConstantArg.getValue(),powArg.getValue(),nbpArg.getValue());
-    else if (fourDimensionalImage)
-        computeArithmetic<Image4DType>(inArg.getValue(),outArg.getValue(),multImArg.getValue(),divImArg.getValue(),addImArg.getValue(),
-                                       subtractImArg.getValue(),multiplyConstantArg.getValue(),divideConstantArg.getValue(),
-                                       addConstantArg.getValue(),subtractConstantArg.getValue(),powArg.getValue(),nbpArg.getValue());
-    else
-        computeArithmetic<ImageType>(inArg.getValue(),outArg.getValue(),multImArg.getValue(),divImArg.getValue(),addImArg.getValue(),
-                                     subtractImArg.getValue(),multiplyConstantArg.getValue(),divideConstantArg.getValue(),
-                                     addConstantArg.getValue(),subtractConstantArg.getValue(),powArg.getValue(),nbpArg.getValue());
+        else
+            computeArithmetic<ImageType>(inArg.getValue(),outArg.getValue(),multImArg.getValue(),divImArg.getValue(),addImArg.getValue(),
+                                         subtractImArg.getValue(),multiplyConstantArg.getValue(),divideConstantArg.getValue(),
+                                         addConstantArg.getValue(),subtractConstantArg.getValue(),powArg.getValue(),nbpArg.getValue());
+    }
+    catch (itk::ExceptionObject &e)
+    {
+        std::cerr << e << std::endl;
+        return EXIT_FAILURE;
+    }
     
     return EXIT_SUCCESS;
 }
@@ -9,7 +9,8 @@ namespace anima
  * Provides an implementation of fuzzy c-means, as proposed in
  * J. C. Bezdek (1981): "Pattern Recognition with Fuzzy Objective Function Algoritms", Plenum Press, New York.
  * It contains flags for interfacing it with spectral clustering, and to compute spherical distances rather than
- * Euclidean distances.
+ * Euclidean distances. Memberships may also be set to be crisp, each input belonging only to its closest centroid,
+ * which then amounts to k-means clustering.
  */
 template <class ScalarType>
 class FuzzyCMeansFilter
@@ -36,6 +37,7 @@ public:
     void SetRelStopCriterion(double rC) {m_RelStopCriterion = rC;}
     void SetMValue(double mV) {m_MValue = mV;}
     void SetSphericalAverageType(CentroidAverageType spher) {m_SphericalAverageType = spher;}
+    void SetHardMemberships(bool val) {m_HardMemberships = val;}
 
     void ComputeCentroids();
     void UpdateMemberships();
@@ -66,6 +68,7 @@ private:
 
     bool m_Verbose;
     bool m_SpectralClusterInit;
+    bool m_HardMemberships;
 
     CentroidAverageType m_SphericalAverageType;
 
@@ -25,6 +25,7 @@ FuzzyCMeansFilter <ScalarType>
 
     m_Verbose = true;
     m_SpectralClusterInit = false;
+    m_HardMemberships = false;
     m_SphericalAverageType = Euclidean;
 
     m_RelStopCriterion = 1.0e-4;
@@ -111,6 +112,10 @@ FuzzyCMeansFilter <ScalarType>
                 m_TmpVector[k] += m_DataWeights[j] * m_PowMemberships[j][i] * m_InputData[j][k];
         }
 
+        // Empty class (possible with hard memberships): keep its previous centroid
+        if (sumPowMemberShips <= 0)
+            continue;
+
         for (unsigned int k = 0;k < m_NDim;++k)
             m_TmpVector[k] /= sumPowMemberShips;
 
@@ -180,8 +185,17 @@ FuzzyCMeansFilter <ScalarType>
             }
         }
 
-        if (nullDistance)
+        if (nullDistance || m_HardMemberships)
         {
+            if (!nullDistance)
+            {
+                for (unsigned int j = 1;j < m_NbClass;++j)
+                {
+                    if (m_DistancesPointsCentroids[j] < m_DistancesPointsCentroids[minClassIndex])
+                        minClassIndex = j;
+                }
+            }
+
             for (unsigned int j = 0;j < m_NbClass;++j)
                 m_ClassesMembership[i][j] = 0;
 
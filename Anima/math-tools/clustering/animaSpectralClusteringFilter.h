@@ -1,6 +1,7 @@
 #pragma once
 
 #include <vector>
+#include <functional>
 #include <vnl/vnl_matrix.h>
 #include <vnl/vnl_diag_matrix.h>
 
@@ -15,6 +16,16 @@ namespace anima
  * \brief Provides an implementation of spectral clustering, as proposed in
  * A.Y. Ng, M.I. Jordan and Y. Weiss. "On Spectral Clustering: Analysis and an Algorithm."
  * Advances in Neural Information Processing Systems 14. 2001
+ *
+ * Leading eigenvectors of the normalized affinity matrix are computed either exactly from the dense matrix (reference
+ * for small inputs, default), from a sparse symmetric k-nearest neighbors graph with an iterative (subspace iteration
+ * with Rayleigh-Ritz) eigen solver, or from a Nystrom landmark approximation as proposed in
+ * C. Fowlkes, S. Belongie, F. Chung and J. Malik. "Spectral Grouping Using the Nystrom Method."
+ * IEEE Transactions on Pattern Analysis and Machine Intelligence 26(2). 2004
+ * (the Nystrom approximation includes self affinities, unlike the exact and graph versions).
+ * The graph version only stores O(nk) affinities but still evaluates all O(n^2) pairwise distances to find neighbors,
+ * the Nystrom version evaluates O(nm) distances to m landmarks drawn at random with a fixed seed.
+ * Spectral vectors are then clustered either by fuzzy c-means or by k-means (crisp memberships).
  */
 template <class ScalarType>
 class SpectralClusteringFilter
@@ -27,11 +38,29 @@ public:
     typedef typename CMeansFilterType::CentroidAverageType CMeansAverageType;
     typedef itk::SymmetricEigenAnalysis <MatrixType, vnl_diag_matrix<ScalarType>, MatrixType> EigenAnalysisType;
 
+    //! Returns the squared distance between two inputs
+    typedef std::function <double (unsigned int, unsigned int)> DistanceFunctionType;
+
+    enum EigenApproximationType
+    {
+        Exact = 0,
+        NearestNeighborsGraph,
+        NystromLandmarks
+    };
+
+    enum PostClusteringType
+    {
+        FuzzyCMeans = 0,
+        KMeans
+    };
+
     SpectralClusteringFilter();
     virtual ~SpectralClusteringFilter() {}
 
     //! Input data: matrix of squared distances
     void SetInputData(MatrixType &data);
+    //! Input data given as a squared distance function, so that approximations never store all distances
+    void SetInputDistanceFunction(unsigned int numInputs, const DistanceFunctionType &distanceFunction);
     void SetDataWeights(VectorType &val) {m_DataWeights = val;}
     void SetNbClass(unsigned int nbC) {m_NbClass = nbC;}
     void SetSigmaWeighting(double sigma) {m_SigmaWeighting = sigma;}
@@ -42,11 +71,23 @@ public:
     void SetMValue(double mV) {m_MValue = mV;}
 
     void SetCMeansAverageType(CMeansAverageType val) {m_CMeansAverageType = val;}
+    void SetPostClusteringType(PostClusteringType val) {m_PostClusteringType = val;}
+
+    // Parameters for approximate eigen vectors computation
+    void SetEigenApproximationType(EigenApproximationType val) {m_EigenApproximationType = val;}
+    void SetNumberOfNeighbors(unsigned int val) {m_NumberOfNeighbors = val;}
+    void SetNumberOfLandmarks(unsigned int val) {m_NumberOfLandmarks = val;}
+    //! Seed of the random landmarks sampling, the same landmarks being drawn for a given seed
+    void SetLandmarksSeed(unsigned int val) {m_LandmarksSeed = val;}
+    void SetEigenSolverMaxIterations(unsigned int val) {m_EigenSolverMaxIterations = val;}
+    void SetEigenSolverTolerance(double val) {m_EigenSolverTolerance = val;}
 
     void ComputeSpectralVectors();
     void Update();
 
     double ComputeClustersSpreading();
+
+    //! Sets sigma from the mean squared distance, over all O(n^2) pairs except in Nystrom mode where only distances to landmarks are used
     void InitializeSigmaFromDistances();
 
     void SetVerbose(bool verb) {m_Verbose = verb;}
@@ -56,17 +97,43 @@ public:
     VectorType &GetCentroid(unsigned int i) {return m_Centroids[i];}
     std::vector <unsigned int> GetClassMembers(unsigned int i);
 
+protected:
+    double GetSquaredDistance(unsigned int i, unsigned int j) const;
+    //! Landmarks sampled at random without replacement, sorted by increasing index
+    std::vector <unsigned int> GetLandmarkIndexes() const;
+
+    //! Leading eigen vectors (as columns, by decreasing eigenvalues) of the normalized affinity matrix
+    void ComputeExactLeadingEigenVectors(MatrixType &leadingVectors);
+    void ComputeNearestNeighborsLeadingEigenVectors(MatrixType &leadingVectors);
+    void ComputeNystromLeadingEigenVectors(MatrixType &leadingVectors);
+
+    //! Computes the normalized affinity matrix as a sparse symmetric k-nearest neighbors graph. Neighbors are searched exhaustively,
+    //! evaluating all O(n^2) distances (one row at a time, so that memory stays O(nk))
+    void ComputeNearestNeighborsGraph();
+    //! Multiplies the sparse graph (shifted by identity to make it positive) by a block of vectors
+    void MultiplyByShiftedGraph(const MatrixType &vectors, MatrixType &result) const;
+
 private:
     std::vector <VectorType> m_ClassesMembership;
     std::vector <VectorType> m_Centroids;
     std::vector <VectorType> m_SpectralVectors;
     MatrixType m_InputData;
+    DistanceFunctionType m_DistanceFunction;
+    unsigned int m_NumberOfInputs;
     VectorType m_DataWeights;
 
     unsigned int m_NbClass;
 
     CMeansAverageType m_CMeansAverageType;
     CMeansFilterType m_MainFilter;
+    PostClusteringType m_PostClusteringType;
+
+    EigenApproximationType m_EigenApproximationType;
+    unsigned int m_NumberOfNeighbors;
+    unsigned int m_NumberOfLandmarks;
+    unsigned int m_LandmarksSeed;
+    unsigned int m_EigenSolverMaxIterations;
+    double m_EigenSolverTolerance;
 
     bool m_Verbose;
 
@@ -84,6 +151,11 @@ private:
     vnl_diag_matrix<ScalarType> m_EigVals;
     MatrixType m_EigVecs;
     VectorType m_WorkVec;
+
+    // Sparse normalized affinity graph, as compressed rows
+    std::vector <unsigned int> m_GraphRowStarts;
+    std::vector <unsigned int> m_GraphColumns;
+    std::vector <double> m_GraphValues;
 };
 
 } // end namespace anima
@@ -1,6 +1,9 @@
 #pragma once
 #include "animaSpectralClusteringFilter.h"
 
+#include <algorithm>
+#include <random>
+
 namespace anima
 {
 
@@ -12,11 +15,20 @@ SpectralClusteringFilter <ScalarType>
     m_Centroids.clear();
     m_SpectralVectors.clear();
     m_InputData.set_size(1,1);
+    m_NumberOfInputs = 0;
 
     m_NbClass = 0;
     m_MaxIterations = 100;
 
     m_CMeansAverageType = CMeansFilterType::ApproximateSpherical;
+    m_PostClusteringType = FuzzyCMeans;
+
+    m_EigenApproximationType = Exact;
+    m_NumberOfNeighbors = 10;
+    m_NumberOfLandmarks = 100;
+    m_LandmarksSeed = 0;
+    m_EigenSolverMaxIterations = 500;
+    m_EigenSolverTolerance = 1.0e-6;
 
     m_Verbose = true;
     m_RelStopCriterion = 1.0e-4;
@@ -34,6 +46,56 @@ SpectralClusteringFilter <ScalarType>
         return;
 
     m_InputData = data;
+    m_NumberOfInputs = data.rows();
+    m_DistanceFunction = DistanceFunctionType();
+}
+
+template <class ScalarType>
+void
+SpectralClusteringFilter <ScalarType>
+::SetInputDistanceFunction(unsigned int numInputs, const DistanceFunctionType &distanceFunction)
+{
+    if (numInputs == 0)
+        return;
+
+    m_InputData.set_size(1,1);
+    m_NumberOfInputs = numInputs;
+    m_DistanceFunction = distanceFunction;
+}
+
+template <class ScalarType>
+double
+SpectralClusteringFilter <ScalarType>
+::GetSquaredDistance(unsigned int i, unsigned int j) const
+{
+    if (m_DistanceFunction)
+        return m_DistanceFunction(i,j);
+
+    return m_InputData(i,j);
+}
+
+template <class ScalarType>
+std::vector <unsigned int>
+SpectralClusteringFilter <ScalarType>
+::GetLandmarkIndexes() const
+{
+    // Partial Fisher-Yates shuffle: regularly spaced landmarks would follow any ordering of the inputs (e.g. sorted by cluster)
+    unsigned int numLandmarks = std::min(std::max(m_NumberOfLandmarks,m_NbClass),m_NumberOfInputs);
+    std::vector <unsigned int> inputIndexes(m_NumberOfInputs);
+    for (unsigned int i = 0;i < m_NumberOfInputs;++i)
+        inputIndexes[i] = i;
+
+    std::mt19937 generator(m_LandmarksSeed);
+    for (unsigned int i = 0;i < numLandmarks;++i)
+    {
+        std::uniform_int_distribution <unsigned int> indexDistribution(i,m_NumberOfInputs - 1);
+        std::swap(inputIndexes[i],inputIndexes[indexDistribution(generator)]);
+    }
+
+    std::vector <unsigned int> landmarkIndexes(inputIndexes.begin(),inputIndexes.begin() + numLandmarks);
+    std::sort(landmarkIndexes.begin(),landmarkIndexes.end());
+
+    return landmarkIndexes;
 }
 
 template <class ScalarType>
@@ -41,11 +103,11 @@ void
 SpectralClusteringFilter <ScalarType>
 ::Update()
 {
-    if (m_NbClass > m_InputData.rows())
+    if (m_NbClass > m_NumberOfInputs)
         throw itk::ExceptionObject(__FILE__,__LINE__,"More classes than inputs...",ITK_LOCATION);
 
-    m_DataWeights.resize(m_InputData.rows());
-    std::fill(m_DataWeights.begin(),m_DataWeights.end(),1.0 / m_InputData.rows());
+    m_DataWeights.resize(m_NumberOfInputs);
+    std::fill(m_DataWeights.begin(),m_DataWeights.end(),1.0 / m_NumberOfInputs);
 
     this->ComputeSpectralVectors();
 
@@ -59,10 +121,11 @@ SpectralClusteringFilter <ScalarType>
     m_MainFilter.SetVerbose(m_Verbose);
     m_MainFilter.SetFlagSpectralClustering(true);
     m_MainFilter.SetSphericalAverageType(m_CMeansAverageType);
+    m_MainFilter.SetHardMemberships(m_PostClusteringType == KMeans);
 
     m_MainFilter.Update();
 
-    unsigned int inputSize = m_InputData.rows();
+    unsigned int inputSize = m_NumberOfInputs;
     m_ClassesMembership.resize(inputSize);
 
     for (unsigned int i = 0;i < inputSize;++i)
@@ -79,12 +142,31 @@ SpectralClusteringFilter <ScalarType>
 ::InitializeSigmaFromDistances()
 {
     double sigmaTmp = 0;
-    unsigned int inputSize = m_InputData.rows();
+    unsigned int inputSize = m_NumberOfInputs;
     unsigned int numPts = inputSize*(inputSize + 1)/2 - inputSize - 1;
 
-    for (unsigned int i = 0;i < inputSize;++i)
-        for (unsigned int j = i+1;j < inputSize;++j)
-            sigmaTmp += m_InputData(i,j);
+    if (m_EigenApproximationType == NystromLandmarks)
+    {
+        // Only distances to landmarks are used, never all pairs
+        std::vector <unsigned int> landmarkIndexes = this->GetLandmarkIndexes();
+        numPts = 0;
+        for (unsigned int i = 0;i < inputSize;++i)
+            for (unsigned int j = 0;j < landmarkIndexes.size();++j)
+            {
+                if (i == landmarkIndexes[j])
+                    continue;
+
+                sigmaTmp += this->GetSquaredDistance(i,landmarkIndexes[j]);
+                ++numPts;
+            }
+    }
+    else
+    {
+        // All pairs, also in graph mode whose neighbors search evaluates them anyway
+        for (unsigned int i = 0;i < inputSize;++i)
+            for (unsigned int j = i+1;j < inputSize;++j)
+                sigmaTmp += this->GetSquaredDistance(i,j);
+    }
 
     if (sigmaTmp > 0)
         m_SigmaWeighting = std::sqrt(sigmaTmp/numPts);
@@ -97,7 +179,50 @@ void
 SpectralClusteringFilter <ScalarType>
 ::ComputeSpectralVectors()
 {
-    unsigned int inputSize = m_InputData.rows();
+    unsigned int inputSize = m_NumberOfInputs;
+    MatrixType leadingVectors;
+
+    switch (m_EigenApproximationType)
+    {
+        case NearestNeighborsGraph:
+            this->ComputeNearestNeighborsLeadingEigenVectors(leadingVectors);
+            break;
+
+        case NystromLandmarks:
+            this->ComputeNystromLeadingEigenVectors(leadingVectors);
+            break;
+
+        case Exact:
+        default:
+            this->ComputeExactLeadingEigenVectors(leadingVectors);
+            break;
+    }
+
+    m_SpectralVectors.resize(inputSize);
+    m_WorkVec.resize(m_NbClass);
+    for (unsigned int i = 0;i < inputSize;++i)
+    {
+        double tmpSum = 0;
+        for (unsigned int j = 0;j < m_NbClass;++j)
+        {
+            m_WorkVec[j] = leadingVectors(i,j);
+            tmpSum += m_WorkVec[j]*m_WorkVec[j];
+        }
+
+        tmpSum = std::sqrt(tmpSum);
+        for (unsigned int j = 0;j < m_NbClass;++j)
+            m_WorkVec[j] /= tmpSum;
+
+        m_SpectralVectors[i] = m_WorkVec;
+    }
+}
+
+template <class ScalarType>
+void
+SpectralClusteringFilter <ScalarType>
+::ComputeExactLeadingEigenVectors(MatrixType &leadingVectors)
+{
+    unsigned int inputSize = m_NumberOfInputs;
     m_WMatrix.set_size(inputSize,inputSize);
     m_WMatrix.fill(0.0);
     m_DValues.resize(inputSize);
@@ -106,7 +231,7 @@ SpectralClusteringFilter <ScalarType>
     {
         for (unsigned int j = i+1;j < inputSize;++j)
         {
-            m_WMatrix(i,j) = std::exp(- m_InputData(i,j) / (2.0 * m_SigmaWeighting * m_SigmaWeighting));
+            m_WMatrix(i,j) = std::exp(- this->GetSquaredDistance(i,j) / (2.0 * m_SigmaWeighting * m_SigmaWeighting));
             m_WMatrix(j,i) = m_WMatrix(i,j);
         }
     }
@@ -136,22 +261,311 @@ SpectralClusteringFilter <ScalarType>
     m_EigVecs.set_size(inputSize,inputSize);
     m_EigenAnalyzer.ComputeEigenValuesAndVectors(m_WMatrix,m_EigVals,m_EigVecs);
 
-    m_SpectralVectors.resize(inputSize);
-    m_WorkVec.resize(m_NbClass);
+    leadingVectors.set_size(inputSize,m_NbClass);
     for (unsigned int i = 0;i < inputSize;++i)
-    {
-        double tmpSum = 0;
         for (unsigned int j = 0;j < m_NbClass;++j)
+            leadingVectors(i,j) = m_EigVecs.get(inputSize - j - 1,i);
+}
+
+template <class ScalarType>
+void
+SpectralClusteringFilter <ScalarType>
+::ComputeNearestNeighborsGraph()
+{
+    unsigned int inputSize = m_NumberOfInputs;
+    unsigned int numNeighbors = std::min(m_NumberOfNeighbors,inputSize - 1);
+    double sigmaFactor = 2.0 * m_SigmaWeighting * m_SigmaWeighting;
+
+    // Union of the k-nearest neighbors of each input, so that the graph is symmetric
+    typedef std::pair <unsigned int, double> EdgeType;
+    std::vector < std::vector <EdgeType> > adjacency(inputSize);
+    std::vector < std::pair <double, unsigned int> > candidates;
+
+    for (unsigned int i = 0;i < inputSize;++i)
+    {
+        candidates.clear();
+        for (unsigned int j = 0;j < inputSize;++j)
         {
-            m_WorkVec[j] = m_EigVecs.get(inputSize - j - 1,i);
-            tmpSum += m_WorkVec[j]*m_WorkVec[j];
+            if (j != i)
+                candidates.push_back(std::make_pair(this->GetSquaredDistance(i,j),j));
         }
 
-        tmpSum = std::sqrt(tmpSum);
+        if (numNeighbors == 0)
+            continue;
+
+        std::nth_element(candidates.begin(),candidates.begin() + numNeighbors - 1,candidates.end());
+        for (unsigned int k = 0;k < numNeighbors;++k)
+        {
+            double affinity = std::exp(- candidates[k].first / sigmaFactor);
+            adjacency[i].push_back(EdgeType(candidates[k].second,affinity));
+            adjacency[candidates[k].second].push_back(EdgeType(i,affinity));
+        }
+    }
+
+    m_GraphRowStarts.resize(inputSize + 1);
+    m_GraphRowStarts[0] = 0;
+    m_GraphColumns.clear();
+    m_GraphValues.clear();
+    m_DValues.resize(inputSize);
+
+    for (unsigned int i = 0;i < inputSize;++i)
+    {
+        std::sort(adjacency[i].begin(),adjacency[i].end());
+
+        m_DValues[i] = 0;
+        for (unsigned int k = 0;k < adjacency[i].size();++k)
+        {
+            // Edges found from both ends appear twice
+            if ((k > 0) && (adjacency[i][k].first == adjacency[i][k-1].first))
+                continue;
+
+            m_GraphColumns.push_back(adjacency[i][k].first);
+            m_GraphValues.push_back(adjacency[i][k].second);
+            m_DValues[i] += adjacency[i][k].second;
+        }
+
+        m_GraphRowStarts[i + 1] = m_GraphColumns.size();
+        m_DValues[i] = (m_DValues[i] > 0) ? 1.0 / std::sqrt(m_DValues[i]) : 0.0;
+    }
+
+    for (unsigned int i = 0;i < inputSize;++i)
+    {
+        for (unsigned int k = m_GraphRowStarts[i];k < m_GraphRowStarts[i + 1];++k)
+            m_GraphValues[k] *= m_DValues[i] * m_DValues[m_GraphColumns[k]];
+    }
+}
+
+template <class ScalarType>
+void
+SpectralClusteringFilter <ScalarType>
+::MultiplyByShiftedGraph(const MatrixType &vectors, MatrixType &result) const
+{
+    unsigned int inputSize = vectors.rows();
+    unsigned int numVectors = vectors.cols();
+    result = vectors;
+
+    for (unsigned int i = 0;i < inputSize;++i)
+    {
+        for (unsigned int k = m_GraphRowStarts[i];k < m_GraphRowStarts[i + 1];++k)
+        {
+            double graphValue = m_GraphValues[k];
+            unsigned int column = m_GraphColumns[k];
+            for (unsigned int j = 0;j < numVectors;++j)
+                result(i,j) += graphValue * vectors(column,j);
+        }
+    }
+}
+
+template <class ScalarType>
+void
+SpectralClusteringFilter <ScalarType>
+::ComputeNearestNeighborsLeadingEigenVectors(MatrixType &leadingVectors)
+{
+    this->ComputeNearestNeighborsGraph();
+
+    // Subspace iteration with Rayleigh-Ritz projection on the graph shifted by identity, whose eigenvalues lie in
+    // [0,2]. A few more vectors than needed are iterated to speed up convergence of the leading ones.
+    unsigned int inputSize = m_NumberOfInputs;
+    unsigned int blockSize = std::min(inputSize,std::max(2 * m_NbClass,m_NbClass + 4));
+
+    std::mt19937 generator(0);
+    std::normal_distribution <double> normalDistribution(0.0,1.0);
+
+    MatrixType basis(inputSize,blockSize), graphBasis;
+    for (unsigned int i = 0;i < inputSize;++i)
+        for (unsigned int j = 0;j < blockSize;++j)
+            basis(i,j) = normalDistribution(generator);
+
+    MatrixType projectedMatrix(blockSize,blockSize), ritzVectors(blockSize,blockSize);
+    vnl_diag_matrix <ScalarType> ritzValues(blockSize);
+    EigenAnalysisType eigenAnalyzer(blockSize);
+
+    for (unsigned int it = 0;it <= m_EigenSolverMaxIterations;++it)
+    {
+        // Modified Gram-Schmidt orthonormalization, columns collapsing to zero being drawn again
+        for (unsigned int j = 0;j < blockSize;++j)
+        {
+            double columnNorm = 0;
+            for (unsigned int attempt = 0;attempt < 2;++attempt)
+            {
+                for (unsigned int l = 0;l < j;++l)
+                {
+                    double dotProduct = 0;
+                    for (unsigned int i = 0;i < inputSize;++i)
+                        dotProduct += basis(i,l) * basis(i,j);
+
+                    for (unsigned int i = 0;i < inputSize;++i)
+                        basis(i,j) -= dotProduct * basis(i,l);
+                }
+
+                columnNorm = 0;
+                for (unsigned int i = 0;i < inputSize;++i)
+                    columnNorm += basis(i,j) * basis(i,j);
+
+                columnNorm = std::sqrt(columnNorm);
+                if (columnNorm > 1.0e-10)
+                    break;
+
+                for (unsigned int i = 0;i < inputSize;++i)
+                    basis(i,j) = normalDistribution(generator);
+            }
+
+            for (unsigned int i = 0;i < inputSize;++i)
+                basis(i,j) /= columnNorm;
+        }
+
+        this->MultiplyByShiftedGraph(basis,graphBasis);
+
+        projectedMatrix = basis.transpose() * graphBasis;
+        for (unsigned int j = 0;j < blockSize;++j)
+            for (unsigned int l = j + 1;l < blockSize;++l)
+            {
+                double symmetricValue = (projectedMatrix(j,l) + projectedMatrix(l,j)) / 2.0;
+                projectedMatrix(j,l) = symmetricValue;
+                projectedMatrix(l,j) = symmetricValue;
+            }
+
+        // Ritz vectors by decreasing Ritz values (eigen analysis sorts them increasingly, vectors as rows)
+        eigenAnalyzer.ComputeEigenValuesAndVectors(projectedMatrix,ritzValues,ritzVectors);
+        MatrixType rotation(blockSize,blockSize);
+        for (unsigned int j = 0;j < blockSize;++j)
+            for (unsigned int l = 0;l < blockSize;++l)
+                rotation(l,j) = ritzVectors(blockSize - j - 1,l);
+
+        basis = basis * rotation;
+        graphBasis = graphBasis * rotation;
+
+        bool converged = true;
         for (unsigned int j = 0;j < m_NbClass;++j)
-            m_WorkVec[j] /= tmpSum;
+        {
+            double ritzValue = ritzValues[blockSize - j - 1];
+            double residual = 0;
+            for (unsigned int i = 0;i < inputSize;++i)
+                residual += (graphBasis(i,j) - ritzValue * basis(i,j)) * (graphBasis(i,j) - ritzValue * basis(i,j));
 
-        m_SpectralVectors[i] = m_WorkVec;
+            if (std::sqrt(residual) > m_EigenSolverTolerance)
+            {
+                converged = false;
+                break;
+            }
+        }
+
+        if (converged || (it == m_EigenSolverMaxIterations))
+            break;
+
+        basis = graphBasis;
+    }
+
+    leadingVectors = basis.extract(inputSize,m_NbClass);
+}
+
+template <class ScalarType>
+void
+SpectralClusteringFilter <ScalarType>
+::ComputeNystromLeadingEigenVectors(MatrixType &leadingVectors)
+{
+    unsigned int inputSize = m_NumberOfInputs;
+    std::vector <unsigned int> landmarkIndexes = this->GetLandmarkIndexes();
+    unsigned int numLandmarks = landmarkIndexes.size();
+    double sigmaFactor = 2.0 * m_SigmaWeighting * m_SigmaWeighting;
+
+    // Affinities between all inputs and landmarks
+    MatrixType landmarkAffinities(inputSize,numLandmarks);
+    for (unsigned int i = 0;i < inputSize;++i)
+        for (unsigned int j = 0;j < numLandmarks;++j)
+            landmarkAffinities(i,j) = std::exp(- this->GetSquaredDistance(i,landmarkIndexes[j]) / sigmaFactor);
+
+    // Eigen decomposition of landmark affinities, small eigenvalues being discarded as in a pseudo-inverse
+    MatrixType eigenVectors(numLandmarks,numLandmarks);
+    vnl_diag_matrix <ScalarType> eigenValues(numLandmarks);
+    EigenAnalysisType eigenAnalyzer(numLandmarks);
+
+    MatrixType landmarksMatrix(numLandmarks,numLandmarks);
+    for (unsigned int i = 0;i < numLandmarks;++i)
+        for (unsigned int j = 0;j < numLandmarks;++j)
+            landmarksMatrix(i,j) = landmarkAffinities(landmarkIndexes[i],j);
+
+    eigenAnalyzer.ComputeEigenValuesAndVectors(landmarksMatrix,eigenValues,eigenVectors);
+    double eigenThreshold = 1.0e-10 * std::max(1.0,(double)eigenValues[numLandmarks - 1]);
+
+    MatrixType pseudoInverse(numLandmarks,numLandmarks,0.0);
+    for (unsigned int k = 0;k < numLandmarks;++k)
+    {
+        if (eigenValues[k] <= eigenThreshold)
+            continue;
+
+        for (unsigned int i = 0;i < numLandmarks;++i)
+            for (unsigned int j = 0;j < numLandmarks;++j)
+                pseudoInverse(i,j) += eigenVectors(k,i) * eigenVectors(k,j) / eigenValues[k];
+    }
+
+    // Approximate degrees: W 1 ~ C A^+ C^T 1
+    std::vector <double> columnSums(numLandmarks,0.0);
+    for (unsigned int i = 0;i < inputSize;++i)
+        for (unsigned int j = 0;j < numLandmarks;++j)
+            columnSums[j] += landmarkAffinities(i,j);
+
+    std::vector <double> degreeFactors(numLandmarks,0.0);
+    for (unsigned int i = 0;i < numLandmarks;++i)
+        for (unsigned int j = 0;j < numLandmarks;++j)
+            degreeFactors[i] += pseudoInverse(i,j) * columnSums[j];
+
+    m_DValues.resize(inputSize);
+    for (unsigned int i = 0;i < inputSize;++i)
+    {
+        double degreeValue = 0;
+        for (unsigned int j = 0;j < numLandmarks;++j)
+            degreeValue += landmarkAffinities(i,j) * degreeFactors[j];
+
+        m_DValues[i] = (degreeValue > 0) ? 1.0 / std::sqrt(degreeValue) : 0.0;
+    }
+
+    for (unsigned int i = 0;i < inputSize;++i)
+        for (unsigned int j = 0;j < numLandmarks;++j)
+            landmarkAffinities(i,j) *= m_DValues[i] * m_DValues[landmarkIndexes[j]];
+
+    // One shot orthogonalization: with C normalized affinities to landmarks and A their landmarks rows,
+    // S = A^-1/2 C^T C A^-1/2 = U L U^T gives orthonormal approximate eigen vectors C A^-1/2 U L^-1/2
+    for (unsigned int i = 0;i < numLandmarks;++i)
+        for (unsigned int j = 0;j < numLandmarks;++j)
+            landmarksMatrix(i,j) = landmarkAffinities(landmarkIndexes[i],j);
+
+    eigenAnalyzer.ComputeEigenValuesAndVectors(landmarksMatrix,eigenValues,eigenVectors);
+    eigenThreshold = 1.0e-10 * std::max(1.0e-16,(double)eigenValues[numLandmarks - 1]);
+
+    MatrixType inverseSquareRoot(numLandmarks,numLandmarks,0.0);
+    for (unsigned int k = 0;k < numLandmarks;++k)
+    {
+        if (eigenValues[k] <= eigenThreshold)
+            continue;
+
+        double scaleValue = 1.0 / std::sqrt(eigenValues[k]);
+        for (unsigned int i = 0;i < numLandmarks;++i)
+            for (unsigned int j = 0;j < numLandmarks;++j)
+                inverseSquareRoot(i,j) += eigenVectors(k,i) * eigenVectors(k,j) * scaleValue;
+    }
+
+    MatrixType projectedAffinities = landmarkAffinities * inverseSquareRoot;
+    MatrixType orthogonalizationMatrix = projectedAffinities.transpose() * projectedAffinities;
+
+    eigenAnalyzer.ComputeEigenValuesAndVectors(orthogonalizationMatrix,eigenValues,eigenVectors);
+
+    leadingVectors.set_size(inputSize,m_NbClass);
+    leadingVectors.fill(0.0);
+    for (unsigned int j = 0;j < m_NbClass;++j)
+    {
+        double eigenValue = eigenValues[numLandmarks - j - 1];
+        if (eigenValue <= 0)
+            continue;
+
+        double scaleValue = 1.0 / std::sqrt(eigenValue);
+        for (unsigned int i = 0;i < inputSize;++i)
+        {
+            for (unsigned int k = 0;k < numLandmarks;++k)
+                leadingVectors(i,j) += projectedAffinities(i,k) * eigenVectors(numLandmarks - j - 1,k);
+
+            leadingVectors(i,j) *= scaleValue;
+        }
     }
 }
 
@@ -162,10 +576,10 @@ SpectralClusteringFilter <ScalarType>
 {
     std::vector <unsigned int> resVal;
 
-    if (m_ClassesMembership.size() != m_InputData.rows())
+    if (m_ClassesMembership.size() != m_NumberOfInputs)
         return resVal;
 
-    unsigned int inputSize = m_InputData.rows();
+    unsigned int inputSize = m_NumberOfInputs;
 
     for (unsigned int j = 0;j < inputSize;++j)
     {
@@ -191,10 +605,10 @@ double
 SpectralClusteringFilter <ScalarType>
 ::ComputeClustersSpreading()
 {
-    if (m_ClassesMembership.size() != m_InputData.rows())
+    if (m_ClassesMembership.size() != m_NumberOfInputs)
         return -1;
 
-    unsigned int inputSize = m_InputData.rows();
+    unsigned int inputSize = m_NumberOfInputs;
     std::vector <double> classDistance(m_NbClass,0);
 
     for (unsigned int i = 0;i < m_NbClass;++i)
@@ -0,0 +1,155 @@
+#include <cmath>
+#include <algorithm>
+#include <iostream>
+#include <random>
+
+#include <animaSpectralClusteringFilter.h>
+
+typedef anima::SpectralClusteringFilter <double> SpectralClusteringType;
+
+//! Checks that each ground truth cluster is found as a single class, different clusters giving different classes
+bool checkPartition(SpectralClusteringType &clusteringFilter, const std::vector <unsigned int> &trueClasses, unsigned int numClasses)
+{
+    std::vector <int> classOfCluster(numClasses,-1);
+    std::vector <bool> classUsed(numClasses,false);
+    for (unsigned int i = 0;i < trueClasses.size();++i)
+    {
+        SpectralClusteringType::VectorType &membership = clusteringFilter.GetClassesMembership(i);
+        unsigned int bestClass = std::max_element(membership.begin(),membership.end()) - membership.begin();
+
+        if (classOfCluster[trueClasses[i]] < 0)
+        {
+            if (classUsed[bestClass])
+                return false;
+
+            classOfCluster[trueClasses[i]] = bestClass;
+            classUsed[bestClass] = true;
+        }
+        else if (classOfCluster[trueClasses[i]] != (int)bestClass)
+            return false;
+    }
+
+    return true;
+}
+
+int main()
+{
+    // Three Gaussian blobs in the plane, inputs being shuffled so that they are not sorted by cluster
+    const unsigned int numClasses = 3;
+    const unsigned int numPointsPerClass = 60;
+    const unsigned int numInputs = numClasses * numPointsPerClass;
+    const double centers[numClasses][2] = {{0.0, 0.0}, {6.0, 0.0}, {3.0, 5.0}};
+
+    std::mt19937 generator(12);
+    std::normal_distribution <double> normalDistribution(0.0, 1.0);
+
+    std::vector <unsigned int> trueClasses(numInputs);
+    for (unsigned int i = 0;i < numInputs;++i)
+        trueClasses[i] = i % numClasses;
+
+    std::shuffle(trueClasses.begin(),trueClasses.end(),generator);
+
+    std::vector < std::vector <double> > points(numInputs,std::vector <double> (2));
+    for (unsigned int i = 0;i < numInputs;++i)
+        for (unsigned int j = 0;j < 2;++j)
+            points[i][j] = centers[trueClasses[i]][j] + 0.7 * normalDistribution(generator);
+
+    SpectralClusteringType::MatrixType distances(numInputs,numInputs);
+    for (unsigned int i = 0;i < numInputs;++i)
+        for (unsigned int j = 0;j < numInputs;++j)
+            distances(i,j) = (points[i][0] - points[j][0]) * (points[i][0] - points[j][0]) +
+                    (points[i][1] - points[j][1]) * (points[i][1] - points[j][1]);
+
+    SpectralClusteringType::DistanceFunctionType distanceFunction = [&distances](unsigned int i, unsigned int j)
+    {
+        return distances(i,j);
+    };
+
+    const SpectralClusteringType::EigenApproximationType approximationTypes[3] = {SpectralClusteringType::Exact,
+                                                                                  SpectralClusteringType::NearestNeighborsGraph,
+                                                                                  SpectralClusteringType::NystromLandmarks};
+    const char *approximationNames[3] = {"exact", "graph", "Nystrom"};
+    const SpectralClusteringType::PostClusteringType postClusteringTypes[2] = {SpectralClusteringType::FuzzyCMeans,
+                                                                               SpectralClusteringType::KMeans};
+    const char *postClusteringNames[2] = {"fuzzy c-means", "k-means"};
+
+    bool testPassed = true;
+    for (unsigned int a = 0;a < 3;++a)
+    {
+        for (unsigned int p = 0;p < 2;++p)
+        {
+            SpectralClusteringType clusteringFilter;
+            if (approximationTypes[a] == SpectralClusteringType::Exact)
+                clusteringFilter.SetInputData(distances);
+            else
+                clusteringFilter.SetInputDistanceFunction(numInputs,distanceFunction);
+
+            clusteringFilter.SetNbClass(numClasses);
+            clusteringFilter.SetVerbose(false);
+            clusteringFilter.SetSigmaWeighting(1.0);
+            clusteringFilter.SetEigenApproximationType(approximationTypes[a]);
+            clusteringFilter.SetNumberOfNeighbors(10);
+            clusteringFilter.SetNumberOfLandmarks(30);
+            clusteringFilter.SetPostClusteringType(postClusteringTypes[p]);
+            clusteringFilter.SetCMeansAverageType(SpectralClusteringType::CMeansFilterType::Euclidean);
+            clusteringFilter.Update();
+
+            bool partitionFound = checkPartition(clusteringFilter,trueClasses,numClasses);
+            std::cout << approximationNames[a] << " eigen vectors, " << postClusteringNames[p] << ": "
+                      << (partitionFound ? "clusters found" : "wrong clusters") << std::endl;
+
+            if (!partitionFound)
+                testPassed = false;
+        }
+    }
+
+    // With all inputs as neighbors, the graph is the dense affinity matrix. Spectral vectors are then compared through
+    // their scalar products, which do not depend on the basis chosen for the leading eigen space
+    SpectralClusteringType exactFilter, graphFilter;
+    exactFilter.SetInputData(distances);
+    graphFilter.SetInputDistanceFunction(numInputs,distanceFunction);
+    graphFilter.SetEigenApproximationType(SpectralClusteringType::NearestNeighborsGraph);
+    graphFilter.SetNumberOfNeighbors(numInputs - 1);
+    graphFilter.SetEigenSolverTolerance(1.0e-12);
+    graphFilter.SetEigenSolverMaxIterations(5000);
+
+    SpectralClusteringType *filters[2] = {&exactFilter, &graphFilter};
+    for (unsigned int f = 0;f < 2;++f)
+    {
+        filters[f]->SetNbClass(numClasses);
+        filters[f]->SetVerbose(false);
+        // Larger sigma so that clusters interact and leading eigenvalues are distinct
+        filters[f]->SetSigmaWeighting(2.0);
+        filters[f]->Update();
+    }
+
+    double maxDeviation = 0.0;
+    for (unsigned int i = 0;i < numInputs;++i)
+    {
+        for (unsigned int j = i;j < numInputs;++j)
+        {
+            double exactProduct = 0.0;
+            double graphProduct = 0.0;
+            for (unsigned int k = 0;k < numClasses;++k)
+            {
+                exactProduct += exactFilter.GetSpectralVector(i)[k] * exactFilter.GetSpectralVector(j)[k];
+                graphProduct += graphFilter.GetSpectralVector(i)[k] * graphFilter.GetSpectralVector(j)[k];
+            }
+
+            maxDeviation = std::max(maxDeviation, std::abs(exactProduct - graphProduct));
+        }
+    }
+
+    std::cout << "Full graph against exact spectral vectors deviation " << maxDeviation << std::endl;
+    const double tolerance = 1.0e-6;
+    if (maxDeviation > tolerance)
+    {
+        std::cerr << "Full graph spectral vectors differ from exact ones" << std::endl;
+        testPassed = false;
+    }
+
+    if (!testPassed)
+        return EXIT_FAILURE;
+
+    return EXIT_SUCCESS;
+}
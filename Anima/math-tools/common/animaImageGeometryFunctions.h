@@ -0,0 +1,71 @@
+#pragma once
+
+#include <itkMacro.h>
+
+#include <cmath>
+#include <string>
+
+namespace anima
+{
+
+/**
+ * Checks that two images share the same largest possible region, spacing, origin and direction. Tolerances follow
+ * those used by ITK filters to verify their inputs: spacing and origin are compared relative to the reference spacing.
+ */
+template <class ReferenceImageType, class ImageType>
+bool haveSameImageGeometry(const ReferenceImageType *referenceImage, const ImageType *image, double tolerance = 1.0e-6)
+{
+    const unsigned int dimension = ReferenceImageType::ImageDimension;
+    if (dimension != ImageType::ImageDimension)
+        return false;
+
+    for (unsigned int i = 0;i < dimension;++i)
+    {
+        if (referenceImage->GetLargestPossibleRegion().GetIndex()[i] != image->GetLargestPossibleRegion().GetIndex()[i])
+            return false;
+
+        if (referenceImage->GetLargestPossibleRegion().GetSize()[i] != image->GetLargestPossibleRegion().GetSize()[i])
+            return false;
+
+        double spacingTolerance = tolerance * std::abs(referenceImage->GetSpacing()[i]);
+        if (std::abs(referenceImage->GetSpacing()[i] - image->GetSpacing()[i]) > spacingTolerance)
+            return false;
+
+        if (std::abs(referenceImage->GetOrigin()[i] - image->GetOrigin()[i]) > spacingTolerance)
+            return false;
+
+        for (unsigned int j = 0;j < dimension;++j)
+        {
+            if (std::abs(referenceImage->GetDirection()(i,j) - image->GetDirection()(i,j)) > tolerance)
+                return false;
+        }
+    }
+
+    return true;
+}
+
+//! Throws an exception naming the faulty image if it does not have the geometry of the reference image
+template <class ReferenceImageType, class ImageType>
+void checkImageGeometry(const ReferenceImageType *referenceImage, const ImageType *image, const std::string &imageName)
+{
+    if (!haveSameImageGeometry(referenceImage,image))
+    {
+        std::string errorMessage = "Image " + imageName + " does not have the same geometry (size, spacing, origin or direction) as the reference image";
+        throw itk::ExceptionObject(__FILE__, __LINE__,errorMessage,ITK_LOCATION);
+    }
+}
+
+//! Same as checkImageGeometry, also checking the number of components per pixel
+template <class ReferenceImageType, class ImageType>
+void checkImageGeometryAndComponents(const ReferenceImageType *referenceImage, const ImageType *image, const std::string &imageName)
+{
+    anima::checkImageGeometry(referenceImage,image,imageName);
+
+    if (referenceImage->GetNumberOfComponentsPerPixel() != image->GetNumberOfComponentsPerPixel())
+    {
+        std::string errorMessage = "Image " + imageName + " does not have the same number of components as the reference image";
+        throw itk::ExceptionObject(__FILE__, __LINE__,errorMessage,ITK_LOCATION);
+    }
+}
+
+} // end of namespace anima
@@ -56,6 +56,9 @@ private:
     ITK_DISALLOW_COPY_AND_ASSIGN(MaskedImageToImageFilter);
 
     MaskImagePointer m_ComputationMask;
+
+    //! Output requested region for which the computation region was computed
+    OutputImageRegionType m_ComputationRequestedRegion;
 };
 
 } //end namespace anima
@@ -31,7 +31,9 @@ void
 MaskedImageToImageFilter < TInputImage, TOutputImage >
 ::BeforeThreadedGenerateData()
 {
-    if (this->GetComputationRegion().GetSize(0) == 0)
+    // The requested region changes between updates when streaming, the computation region has then to follow it
+    if ((this->GetComputationRegion().GetSize(0) == 0) ||
+            (this->GetOutput(0)->GetRequestedRegion() != m_ComputationRequestedRegion))
         this->InitializeComputationRegionFromMask();
 
     Superclass::BeforeThreadedGenerateData();
@@ -47,19 +49,24 @@ MaskedImageToImageFilter < TInputImage, TOutputImage >
 
     typedef itk::ImageRegionConstIterator< MaskImageType > MaskRegionIteratorType;
 
-    MaskRegionIteratorType maskItr(m_ComputationMask,m_ComputationMask->GetLargestPossibleRegion());
-    maskItr.GoToBegin();
+    // Only the part of the mask inside the requested region is of interest
+    m_ComputationRequestedRegion = this->GetOutput(0)->GetRequestedRegion();
+    MaskRegionType maskRegion = m_ComputationMask->GetLargestPossibleRegion();
+    bool overlappingRegions = maskRegion.Crop(m_ComputationRequestedRegion);
 
     MaskIndexType minPos, maxPos;
 
     for (unsigned int i = 0;i < m_ComputationMask->GetImageDimension();++i)
     {
-        minPos[i] = m_ComputationMask->GetLargestPossibleRegion().GetIndex()[i] + m_ComputationMask->GetLargestPossibleRegion().GetSize()[i];
+        minPos[i] = maskRegion.GetIndex()[i] + maskRegion.GetSize()[i];
         maxPos[i] = 0;
     }
 
     unsigned int numPoints = 0;
-    while (!maskItr.IsAtEnd())
+    MaskRegionIteratorType maskItr(m_ComputationMask,maskRegion);
+    maskItr.GoToBegin();
+
+    while (overlappingRegions && !maskItr.IsAtEnd())
     {
         if (maskItr.Get() != 0)
         {
@@ -82,6 +89,17 @@ MaskedImageToImageFilter < TInputImage, TOutputImage >
     this->SetNumberOfPointsToProcess(numPoints);
 
     OutputImageRegionType computationRegion;
+    if (numPoints == 0)
+    {
+        // Nothing to compute in this region: process a single voxel outside the mask to leave the output at zero
+        computationRegion.SetIndex(m_ComputationRequestedRegion.GetIndex());
+        for (unsigned int i = 0;i < m_ComputationMask->GetImageDimension();++i)
+            computationRegion.SetSize(i,1);
+
+        this->SetComputationRegion(computationRegion);
+        return;
+    }
+
     computationRegion.SetIndex(minPos);
 
     MaskSizeType tmpSize;
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <itkImageRegionSplitterSlowDimension.h>
+#include <itkImageAlgorithm.h>
+
+#include <cmath>
+#include <vector>
+
+namespace anima
+{
+
+/**
+ * Computes the number of slabs along the slowest dimension of region so that one slab of all inputs, extended by
+ * marginSlices on each side, fits in memoryBudget bytes. bytesPerVoxel is the memory needed for a voxel of all inputs
+ * together. A budget lower or equal to zero means no streaming.
+ */
+template <class RegionType>
+unsigned int
+computeNumberOfStreamDivisions(const RegionType &region, double bytesPerVoxel, unsigned int marginSlices, double memoryBudget)
+{
+    unsigned int numSlices = region.GetSize()[RegionType::ImageDimension - 1];
+    if ((memoryBudget <= 0) || (numSlices == 0))
+        return 1;
+
+    double bytesPerSlice = bytesPerVoxel * region.GetNumberOfPixels() / numSlices;
+    double maxSlicesPerSlab = std::floor(memoryBudget / bytesPerSlice) - 2.0 * marginSlices;
+
+    // Slabs can't be thinner than a slice, whatever the budget
+    if (maxSlicesPerSlab < 1.0)
+        return numSlices;
+
+    return std::ceil(numSlices / maxSlicesPerSlab);
+}
+
+/**
+ * Updates a (multiple outputs) filter by slabs along the slowest dimension, only the input part needed for the current slab
+ * being requested upstream. Each slab is pasted into full size copies of the filter outputs that are returned.
+ */
+template <class OutputImageType, class FilterType>
+std::vector < itk::SmartPointer <OutputImageType> >
+updateByStreamDivisions(FilterType *filter, unsigned int numDivisions)
+{
+    typedef typename OutputImageType::RegionType RegionType;
+
+    filter->UpdateOutputInformation();
+    RegionType largestRegion = filter->GetOutput(0)->GetLargestPossibleRegion();
+    unsigned int numOutputs = filter->GetNumberOfIndexedOutputs();
+
+    std::vector < itk::SmartPointer <OutputImageType> > outputImages(numOutputs);
+    for (unsigned int i = 0;i < numOutputs;++i)
+    {
+        outputImages[i] = OutputImageType::New();
+        outputImages[i]->CopyInformation(filter->GetOutput(i));
+        outputImages[i]->SetRegions(largestRegion);
+        outputImages[i]->Allocate();
+    }
+
+    itk::ImageRegionSplitterSlowDimension::Pointer splitter = itk::ImageRegionSplitterSlowDimension::New();
+    unsigned int numPieces = splitter->GetNumberOfSplits(largestRegion,numDivisions);
+
+    for (unsigned int i = 0;i < numPieces;++i)
+    {
+        RegionType pieceRegion = largestRegion;
+        splitter->GetSplit(i,numPieces,pieceRegion);
+
+        // Requested region is propagated to all outputs and then to the inputs
+        filter->GetOutput(0)->SetRequestedRegion(pieceRegion);
+        filter->GetOutput(0)->PropagateRequestedRegion();
+        filter->GetOutput(0)->UpdateOutputData();
+
+        for (unsigned int j = 0;j < numOutputs;++j)
+            itk::ImageAlgorithm::Copy(filter->GetOutput(j),outputImages[j].GetPointer(),pieceRegion,pieceRegion);
+    }
+
+    return outputImages;
+}
+
+} // end of namespace anima
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+namespace anima
+{
+
+/**
+ * Anima binary tractogram format (.atg), in the byte order of the writing machine (little endian on all supported
+ * platforms), recorded by the header byte order mark so that readers reject files of a foreign byte order:
+ * - BinaryTractogramHeader
+ * - point arrays then cell arrays descriptions: uint32 number of components, uint32 name length, name (not padded),
+ *   the whole descriptions block being padded to 8 bytes
+ * - chunks, each one holding complete fibers: uint64 number of fibers F, uint64 number of points P, uint64 point offsets
+ *   of fibers in the chunk (F + 1 values), float32 points (3 P), float32 point arrays (P x components each), float32 cell
+ *   arrays (F x components each), padded to 8 bytes
+ * Chunks are independent so that files may be read chunk by chunk and written in append mode. Header counts are
+ * updated when a writer is closed.
+ */
+struct BinaryTractogramHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t numberOfPointArrays;
+    uint32_t numberOfCellArrays;
+    uint32_t byteOrderMark;
+    uint64_t numberOfFibers;
+    uint64_t numberOfPoints;
+    uint64_t numberOfChunks;
+};
+
+struct BinaryTractogramArrayDescription
+{
+    std::string name;
+    unsigned int numberOfComponents;
+};
+
+const char BinaryTractogramMagic[8] = {'A','N','I','M','A','T','G','\0'};
+const uint32_t BinaryTractogramVersion = 1;
+const uint32_t BinaryTractogramByteOrderMark = 0x01020304;
+
+//! Size of a chunk in bytes, padding included
+inline uint64_t GetBinaryTractogramChunkSize(uint64_t numFibers, uint64_t numPoints,
+                                             unsigned int numPointComponents, unsigned int numCellComponents)
+{
+    uint64_t chunkSize = 2 * sizeof(uint64_t) + (numFibers + 1) * sizeof(uint64_t);
+    chunkSize += (3 + numPointComponents) * numPoints * sizeof(float) + numCellComponents * numFibers * sizeof(float);
+
+    return (chunkSize + 7) / 8 * 8;
+}
+
+} // end namespace anima
@@ -0,0 +1,317 @@
+#include <animaBinaryTractogramReader.h>
+#include <itkMacro.h>
+
+#include <vtkPoints.h>
+#include <vtkCellArray.h>
+#include <vtkPointData.h>
+#include <vtkCellData.h>
+#include <vtkDoubleArray.h>
+#include <vtkVersion.h>
+
+#include <cstring>
+#include <algorithm>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace anima
+{
+
+BinaryTractogramReader::BinaryTractogramReader()
+{
+    m_FileName = "";
+    m_NumberOfPointComponents = 0;
+    m_NumberOfCellComponents = 0;
+    m_FileSize = 0;
+    m_Opened = false;
+    std::memset(&m_Header,0,sizeof(BinaryTractogramHeader));
+
+#ifndef _WIN32
+    m_MappedData = 0;
+#endif
+}
+
+BinaryTractogramReader::~BinaryTractogramReader()
+{
+    this->Close();
+}
+
+bool BinaryTractogramReader::IsBinaryTractogramFile(const std::string &fileName)
+{
+    std::size_t lastDotPos = fileName.find_last_of('.');
+    if (lastDotPos == std::string::npos)
+        return false;
+
+    return (fileName.substr(lastDotPos + 1) == "atg");
+}
+
+void BinaryTractogramReader::ReadBytes(uint64_t position, uint64_t size, void *buffer)
+{
+    if (position + size > m_FileSize)
+        throw itk::ExceptionObject(__FILE__, __LINE__,"Truncated binary tractogram file " + m_FileName,ITK_LOCATION);
+
+#ifdef _WIN32
+    m_FileStream.seekg(position);
+    m_FileStream.read(static_cast <char *> (buffer),size);
+#else
+    std::memcpy(buffer,m_MappedData + position,size);
+#endif
+}
+
+void BinaryTractogramReader::Open()
+{
+    this->Close();
+
+#ifdef _WIN32
+    m_FileStream.open(m_FileName.c_str(),std::ios::binary | std::ios::ate);
+    if (!m_FileStream.is_open())
+        throw itk::ExceptionObject(__FILE__, __LINE__,"Unable to open binary tractogram file " + m_FileName,ITK_LOCATION);
+
+    m_FileSize = m_FileStream.tellg();
+#else
+    int fileDescriptor = open(m_FileName.c_str(),O_RDONLY);
+    if (fileDescriptor < 0)
+        throw itk::ExceptionObject(__FILE__, __LINE__,"Unable to open binary tractogram file " + m_FileName,ITK_LOCATION);
+
+    struct stat fileStatus;
+    fstat(fileDescriptor,&fileStatus);
+    m_FileSize = fileStatus.st_size;
+
+    void *mappedData = MAP_FAILED;
+    if (m_FileSize > 0)
+        mappedData = mmap(0,m_FileSize,PROT_READ,MAP_SHARED,fileDescriptor,0);
+
+    close(fileDescriptor);
+
+    if (mappedData == MAP_FAILED)
+        throw itk::ExceptionObject(__FILE__, __LINE__,"Unable to map binary tractogram file " + m_FileName,ITK_LOCATION);
+
+    m_MappedData = static_cast <const char *> (mappedData);
+#endif
+
+    m_Opened = true;
+
+    this->ReadBytes(0,sizeof(BinaryTractogramHeader),&m_Header);
+    if ((std::memcmp(m_Header.magic,BinaryTractogramMagic,8) != 0) || (m_Header.version > BinaryTractogramVersion))
+        throw itk::ExceptionObject(__FILE__, __LINE__,"Unsupported binary tractogram file " + m_FileName,ITK_LOCATION);
+
+    if (m_Header.byteOrderMark != BinaryTractogramByteOrderMark)
+        throw itk::ExceptionObject(__FILE__, __LINE__,"Binary tractogram file " + m_FileName + " was written with a different byte order",ITK_LOCATION);
+
+    // Each array description takes at least 8 bytes, rejects corrupted counts before allocating them
+    uint64_t numArrays = (uint64_t)m_Header.numberOfPointArrays + m_Header.numberOfCellArrays;
+    if (sizeof(BinaryTractogramHeader) + 2 * sizeof(uint32_t) * numArrays > m_FileSize)
+        throw itk::ExceptionObject(__FILE__, __LINE__,"Truncated binary tractogram file " + m_FileName,ITK_LOCATION);
+
+    // Arrays descriptions
+    uint64_t position = sizeof(BinaryTractogramHeader);
+    m_PointArrays.resize(m_Header.numberOfPointArrays);
+    m_CellArrays.resize(m_Header.numberOfCellArrays);
+    m_NumberOfPointComponents = 0;
+    m_NumberOfCellComponents = 0;
+
+    for (unsigned int i = 0;i < m_Header.numberOfPointArrays + m_Header.numberOfCellArrays;++i)
+    {
+        bool pointArray = (i < m_Header.numberOfPointArrays);
+        BinaryTractogramArrayDescription &description = pointArray ? m_PointArrays[i] : m_CellArrays[i - m_Header.numberOfPointArrays];
+
+        uint32_t descriptionValues[2];
+        this->ReadBytes(position,2 * sizeof(uint32_t),descriptionValues);
+        position += 2 * sizeof(uint32_t);
+
+        description.numberOfComponents = descriptionValues[0];
+        description.name.resize(descriptionValues[1]);
+        if (descriptionValues[1] > 0)
+            this->ReadBytes(position,descriptionValues[1],&description.name[0]);
+
+        position += descriptionValues[1];
+
+        if (pointArray)
+            m_NumberOfPointComponents += description.numberOfComponents;
+        else
+            m_NumberOfCellComponents += description.numberOfComponents;
+    }
+
+    position = (position + 7) / 8 * 8;
+
+    // Index chunks from their headers
+    uint64_t chunkSizes[2];
+    while (position + 2 * sizeof(uint64_t) <= m_FileSize)
+    {
+        this->ReadBytes(position,2 * sizeof(uint64_t),chunkSizes);
+
+        // Bound counts by the remaining file size (offsets and point coordinates) before computing the chunk size
+        uint64_t remainingSize = m_FileSize - position;
+        if ((chunkSizes[0] >= remainingSize / sizeof(uint64_t)) || (chunkSizes[1] > remainingSize / (3 * sizeof(float))))
+            throw itk::ExceptionObject(__FILE__, __LINE__,"Corrupted chunk header in binary tractogram file " + m_FileName,ITK_LOCATION);
+
+        m_ChunkPositions.push_back(position);
+        m_ChunkNumberOfFibers.push_back(chunkSizes[0]);
+        m_ChunkNumberOfPoints.push_back(chunkSizes[1]);
+
+        uint64_t chunkSize = GetBinaryTractogramChunkSize(chunkSizes[0],chunkSizes[1],m_NumberOfPointComponents,m_NumberOfCellComponents);
+        if (chunkSize > remainingSize)
+            throw itk::ExceptionObject(__FILE__, __LINE__,"Truncated binary tractogram file " + m_FileName,ITK_LOCATION);
+
+        position += chunkSize;
+    }
+
+    if (position != m_FileSize)
+        throw itk::ExceptionObject(__FILE__, __LINE__,"Truncated binary tractogram file " + m_FileName,ITK_LOCATION);
+
+    // Counts are recomputed from chunks in case the writer was not closed properly
+    m_Header.numberOfChunks = m_ChunkPositions.size();
+    m_Header.numberOfFibers = 0;
+    m_Header.numberOfPoints = 0;
+    for (unsigned int i = 0;i < m_ChunkPositions.size();++i)
+    {
+        m_Header.numberOfFibers += m_ChunkNumberOfFibers[i];
+        m_Header.numberOfPoints += m_ChunkNumberOfPoints[i];
+    }
+}
+
+void BinaryTractogramReader::Close()
+{
+    if (!m_Opened)
+        return;
+
+#ifdef _WIN32
+    m_FileStream.close();
+#else
+    if (m_MappedData)
+        munmap(const_cast <char *> (m_MappedData),m_FileSize);
+
+    m_MappedData = 0;
+#endif
+
+    m_ChunkPositions.clear();
+    m_ChunkNumberOfFibers.clear();
+    m_ChunkNumberOfPoints.clear();
+    m_Opened = false;
+}
+
+vtkSmartPointer <vtkPolyData> BinaryTractogramReader::ReadChunks(unsigned int firstChunk, unsigned int lastChunk)
+{
+    if (!m_Opened)
+        this->Open();
+
+    lastChunk = std::min(lastChunk,this->GetNumberOfChunks());
+    firstChunk = std::min(firstChunk,lastChunk);
+
+    uint64_t numFibers = 0;
+    uint64_t numPoints = 0;
+    for (unsigned int i = firstChunk;i < lastChunk;++i)
+    {
+        numFibers += m_ChunkNumberOfFibers[i];
+        numPoints += m_ChunkNumberOfPoints[i];
+    }
+
+    vtkSmartPointer <vtkPoints> outputPoints = vtkSmartPointer <vtkPoints>::New();
+    outputPoints->SetDataTypeToFloat();
+    outputPoints->SetNumberOfPoints(numPoints);
+    float *pointsBuffer = static_cast <float *> (outputPoints->GetVoidPointer(0));
+
+    vtkSmartPointer <vtkCellArray> outputLines = vtkSmartPointer <vtkCellArray>::New();
+#if VTK_MAJOR_VERSION >= 9
+    outputLines->AllocateExact(numFibers,numPoints);
+#else
+    // Legacy cell arrays store the number of points of each cell in front of its point ids
+    outputLines->Allocate(numFibers + numPoints);
+#endif
+
+    std::vector < vtkSmartPointer <vtkDoubleArray> > pointArrays(m_PointArrays.size());
+    for (unsigned int i = 0;i < m_PointArrays.size();++i)
+    {
+        pointArrays[i] = vtkSmartPointer <vtkDoubleArray>::New();
+        pointArrays[i]->SetName(m_PointArrays[i].name.c_str());
+        pointArrays[i]->SetNumberOfComponents(m_PointArrays[i].numberOfComponents);
+        pointArrays[i]->SetNumberOfTuples(numPoints);
+    }
+
+    std::vector < vtkSmartPointer <vtkDoubleArray> > cellArrays(m_CellArrays.size());
+    for (unsigned int i = 0;i < m_CellArrays.size();++i)
+    {
+        cellArrays[i] = vtkSmartPointer <vtkDoubleArray>::New();
+        cellArrays[i]->SetName(m_CellArrays[i].name.c_str());
+        cellArrays[i]->SetNumberOfComponents(m_CellArrays[i].numberOfComponents);
+        cellArrays[i]->SetNumberOfTuples(numFibers);
+    }
+
+    std::vector <uint64_t> offsets;
+    std::vector <float> arrayValues;
+    uint64_t firstPoint = 0;
+    uint64_t firstFiber = 0;
+    for (unsigned int i = firstChunk;i < lastChunk;++i)
+    {
+        uint64_t chunkFibers = m_ChunkNumberOfFibers[i];
+        uint64_t chunkPoints = m_ChunkNumberOfPoints[i];
+        uint64_t position = m_ChunkPositions[i] + 2 * sizeof(uint64_t);
+
+        offsets.resize(chunkFibers + 1);
+        this->ReadBytes(position,offsets.size() * sizeof(uint64_t),offsets.data());
+        position += offsets.size() * sizeof(uint64_t);
+
+        // Offsets index points of the chunk: they must start at 0, be non decreasing and end at the number of points
+        bool validOffsets = (offsets[0] == 0) && (offsets[chunkFibers] == chunkPoints);
+        for (uint64_t j = 0;validOffsets && (j < chunkFibers);++j)
+            validOffsets = (offsets[j] <= offsets[j + 1]);
+
+        if (!validOffsets)
+            throw itk::ExceptionObject(__FILE__, __LINE__,"Corrupted fiber offsets in binary tractogram file " + m_FileName,ITK_LOCATION);
+
+        this->ReadBytes(position,3 * chunkPoints * sizeof(float),pointsBuffer + 3 * firstPoint);
+        position += 3 * chunkPoints * sizeof(float);
+
+        for (uint64_t j = 0;j < chunkFibers;++j)
+        {
+            outputLines->InsertNextCell(offsets[j + 1] - offsets[j]);
+            for (uint64_t k = offsets[j];k < offsets[j + 1];++k)
+                outputLines->InsertCellPoint(firstPoint + k);
+        }
+
+        for (unsigned int j = 0;j < m_PointArrays.size();++j)
+        {
+            unsigned int numComponents = m_PointArrays[j].numberOfComponents;
+            arrayValues.resize(chunkPoints * numComponents);
+            this->ReadBytes(position,arrayValues.size() * sizeof(float),arrayValues.data());
+            position += arrayValues.size() * sizeof(float);
+
+            double *arrayBuffer = pointArrays[j]->GetPointer(firstPoint * numComponents);
+            for (uint64_t k = 0;k < arrayValues.size();++k)
+                arrayBuffer[k] = arrayValues[k];
+        }
+
+        for (unsigned int j = 0;j < m_CellArrays.size();++j)
+        {
+            unsigned int numComponents = m_CellArrays[j].numberOfComponents;
+            arrayValues.resize(chunkFibers * numComponents);
+            this->ReadBytes(position,arrayValues.size() * sizeof(float),arrayValues.data());
+            position += arrayValues.size() * sizeof(float);
+
+            double *arrayBuffer = cellArrays[j]->GetPointer(firstFiber * numComponents);
+            for (uint64_t k = 0;k < arrayValues.size();++k)
+                arrayBuffer[k] = arrayValues[k];
+        }
+
+        firstPoint += chunkPoints;
+        firstFiber += chunkFibers;
+    }
+
+    vtkSmartPointer <vtkPolyData> outputData = vtkSmartPointer <vtkPolyData>::New();
+    outputData->SetPoints(outputPoints);
+    outputData->SetLines(outputLines);
+
+    for (unsigned int i = 0;i < pointArrays.size();++i)
+        outputData->GetPointData()->AddArray(pointArrays[i]);
+
+    for (unsigned int i = 0;i < cellArrays.size();++i)
+        outputData->GetCellData()->AddArray(cellArrays[i]);
+
+    return outputData;
+}
+
+} // end namespace anima
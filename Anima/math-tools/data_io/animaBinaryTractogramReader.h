@@ -0,0 +1,69 @@
+#pragma once
+
+#include <animaBinaryTractogramHeader.h>
+
+#include <vtkSmartPointer.h>
+#include <vtkPolyData.h>
+
+#include <string>
+#include <vector>
+#include <fstream>
+
+#include "AnimaDataIOExport.h"
+
+namespace anima
+{
+
+/**
+ * @brief Reader of binary tractograms (.atg). The file is memory mapped (read through a file stream on Windows) and only
+ * chunk headers are read when opening it, so that chunks may be processed one at a time without holding the whole
+ * tractogram in memory.
+ */
+class ANIMADATAIO_EXPORT BinaryTractogramReader
+{
+public:
+    BinaryTractogramReader();
+    ~BinaryTractogramReader();
+
+    void SetFileName(const std::string &name) {m_FileName = name;}
+
+    //! Opens the file and indexes its chunks
+    void Open();
+    void Close();
+
+    unsigned int GetNumberOfChunks() const {return m_ChunkPositions.size();}
+    uint64_t GetNumberOfFibers() const {return m_Header.numberOfFibers;}
+    uint64_t GetNumberOfPoints() const {return m_Header.numberOfPoints;}
+
+    const std::vector <BinaryTractogramArrayDescription> &GetPointArrays() const {return m_PointArrays;}
+    const std::vector <BinaryTractogramArrayDescription> &GetCellArrays() const {return m_CellArrays;}
+
+    //! Builds a polydata holding fibers of chunks firstChunk to lastChunk (excluded), arrays being double arrays
+    vtkSmartPointer <vtkPolyData> ReadChunks(unsigned int firstChunk, unsigned int lastChunk);
+    vtkSmartPointer <vtkPolyData> ReadChunk(unsigned int chunk) {return this->ReadChunks(chunk, chunk + 1);}
+
+    static bool IsBinaryTractogramFile(const std::string &fileName);
+
+protected:
+    void ReadBytes(uint64_t position, uint64_t size, void *buffer);
+
+private:
+    std::string m_FileName;
+    BinaryTractogramHeader m_Header;
+    std::vector <BinaryTractogramArrayDescription> m_PointArrays, m_CellArrays;
+    unsigned int m_NumberOfPointComponents, m_NumberOfCellComponents;
+
+    std::vector <uint64_t> m_ChunkPositions;
+    std::vector <uint64_t> m_ChunkNumberOfFibers, m_ChunkNumberOfPoints;
+
+    uint64_t m_FileSize;
+    bool m_Opened;
+
+#ifdef _WIN32
+    std::ifstream m_FileStream;
+#else
+    const char *m_MappedData;
+#endif
+};
+
+} // end namespace anima
@@ -0,0 +1,282 @@
+#include <animaBinaryTractogramWriter.h>
+#include <animaBinaryTractogramReader.h>
+#include <itkMacro.h>
+
+#include <vtkSmartPointer.h>
+#include <vtkIdList.h>
+#include <vtkPointData.h>
+#include <vtkCellData.h>
+#include <vtkDataArray.h>
+
+#include <cstring>
+#include <algorithm>
+
+namespace anima
+{
+
+BinaryTractogramWriter::BinaryTractogramWriter()
+{
+    m_FileName = "";
+    m_AppendMode = false;
+    m_Opened = false;
+    std::memset(&m_Header,0,sizeof(BinaryTractogramHeader));
+}
+
+BinaryTractogramWriter::~BinaryTractogramWriter()
+{
+    this->Close();
+}
+
+void BinaryTractogramWriter::GetArraysDescriptions(vtkPolyData *data, std::vector <BinaryTractogramArrayDescription> &pointArrays,
+                                                   std::vector <BinaryTractogramArrayDescription> &cellArrays)
+{
+    pointArrays.clear();
+    cellArrays.clear();
+
+    BinaryTractogramArrayDescription description;
+    for (int i = 0;i < data->GetPointData()->GetNumberOfArrays();++i)
+    {
+        vtkDataArray *array = data->GetPointData()->GetArray(i);
+        if ((!array) || (!array->GetName()))
+            continue;
+
+        description.name = array->GetName();
+        description.numberOfComponents = array->GetNumberOfComponents();
+        pointArrays.push_back(description);
+    }
+
+    for (int i = 0;i < data->GetCellData()->GetNumberOfArrays();++i)
+    {
+        vtkDataArray *array = data->GetCellData()->GetArray(i);
+        if ((!array) || (!array->GetName()))
+            continue;
+
+        description.name = array->GetName();
+        description.numberOfComponents = array->GetNumberOfComponents();
+        cellArrays.push_back(description);
+    }
+}
+
+void BinaryTractogramWriter::Open(vtkPolyData *data)
+{
+    std::vector <BinaryTractogramArrayDescription> pointArrays, cellArrays;
+    this->GetArraysDescriptions(data,pointArrays,cellArrays);
+
+    std::ifstream testFile(m_FileName.c_str(),std::ios::binary);
+    bool existingFile = testFile.is_open();
+    testFile.close();
+
+    if (m_AppendMode && existingFile)
+    {
+        BinaryTractogramReader reader;
+        reader.SetFileName(m_FileName);
+        reader.Open();
+
+        m_PointArrays = reader.GetPointArrays();
+        m_CellArrays = reader.GetCellArrays();
+
+        // Counts are recomputed by the reader from chunks
+        uint64_t numChunks = reader.GetNumberOfChunks();
+        uint64_t numFibers = reader.GetNumberOfFibers();
+        uint64_t numPoints = reader.GetNumberOfPoints();
+        reader.Close();
+
+        bool sameArrays = (m_PointArrays.size() == pointArrays.size()) && (m_CellArrays.size() == cellArrays.size());
+        for (unsigned int i = 0;sameArrays && (i < m_PointArrays.size());++i)
+            sameArrays = (m_PointArrays[i].name == pointArrays[i].name) && (m_PointArrays[i].numberOfComponents == pointArrays[i].numberOfComponents);
+
+        for (unsigned int i = 0;sameArrays && (i < m_CellArrays.size());++i)
+            sameArrays = (m_CellArrays[i].name == cellArrays[i].name) && (m_CellArrays[i].numberOfComponents == cellArrays[i].numberOfComponents);
+
+        if (!sameArrays)
+            throw itk::ExceptionObject(__FILE__, __LINE__,"Appended fibers arrays do not match those of " + m_FileName,ITK_LOCATION);
+
+        m_FileStream.open(m_FileName.c_str(),std::ios::binary | std::ios::in | std::ios::out);
+        if (!m_FileStream.is_open())
+            throw itk::ExceptionObject(__FILE__, __LINE__,"Unable to open binary tractogram file " + m_FileName,ITK_LOCATION);
+
+        m_FileStream.read(reinterpret_cast <char *> (&m_Header),sizeof(BinaryTractogramHeader));
+
+        m_Header.numberOfChunks = numChunks;
+        m_Header.numberOfFibers = numFibers;
+        m_Header.numberOfPoints = numPoints;
+
+        m_FileStream.seekp(0,std::ios::end);
+        m_Opened = true;
+        return;
+    }
+
+    m_PointArrays = pointArrays;
+    m_CellArrays = cellArrays;
+
+    m_FileStream.open(m_FileName.c_str(),std::ios::binary | std::ios::in | std::ios::out | std::ios::trunc);
+    if (!m_FileStream.is_open())
+        throw itk::ExceptionObject(__FILE__, __LINE__,"Unable to open binary tractogram file " + m_FileName,ITK_LOCATION);
+
+    std::memset(&m_Header,0,sizeof(BinaryTractogramHeader));
+    std::memcpy(m_Header.magic,BinaryTractogramMagic,8);
+    m_Header.version = BinaryTractogramVersion;
+    m_Header.byteOrderMark = BinaryTractogramByteOrderMark;
+    m_Header.numberOfPointArrays = m_PointArrays.size();
+    m_Header.numberOfCellArrays = m_CellArrays.size();
+
+    m_FileStream.write(reinterpret_cast <const char *> (&m_Header),sizeof(BinaryTractogramHeader));
+
+    uint64_t position = sizeof(BinaryTractogramHeader);
+    for (unsigned int i = 0;i < m_PointArrays.size() + m_CellArrays.size();++i)
+    {
+        const BinaryTractogramArrayDescription &description = (i < m_PointArrays.size()) ? m_PointArrays[i] : m_CellArrays[i - m_PointArrays.size()];
+
+        uint32_t descriptionValues[2] = {description.numberOfComponents, (uint32_t)description.name.size()};
+        m_FileStream.write(reinterpret_cast <const char *> (descriptionValues),2 * sizeof(uint32_t));
+        m_FileStream.write(description.name.c_str(),description.name.size());
+        position += 2 * sizeof(uint32_t) + description.name.size();
+    }
+
+    const char padding[8] = {0,0,0,0,0,0,0,0};
+    m_FileStream.write(padding,(8 - position % 8) % 8);
+
+    m_Opened = true;
+}
+
+void BinaryTractogramWriter::WriteChunk(vtkPolyData *data)
+{
+    std::vector <vtkIdType> cellIds(data->GetNumberOfCells());
+    for (unsigned int i = 0;i < cellIds.size();++i)
+        cellIds[i] = i;
+
+    this->WriteChunk(data,cellIds);
+}
+
+void BinaryTractogramWriter::WriteChunk(vtkPolyData *data, const std::vector <vtkIdType> &cellIds)
+{
+    if (!m_Opened)
+        this->Open(data);
+
+    std::vector <vtkDataArray *> pointArrays(m_PointArrays.size());
+    unsigned int numPointComponents = 0;
+    for (unsigned int i = 0;i < m_PointArrays.size();++i)
+    {
+        pointArrays[i] = data->GetPointData()->GetArray(m_PointArrays[i].name.c_str());
+        if ((!pointArrays[i]) || (pointArrays[i]->GetNumberOfComponents() != (int)m_PointArrays[i].numberOfComponents))
+            throw itk::ExceptionObject(__FILE__, __LINE__,"Missing point array " + m_PointArrays[i].name + " in written fibers",ITK_LOCATION);
+
+        numPointComponents += m_PointArrays[i].numberOfComponents;
+    }
+
+    std::vector <vtkDataArray *> cellArrays(m_CellArrays.size());
+    unsigned int numCellComponents = 0;
+    for (unsigned int i = 0;i < m_CellArrays.size();++i)
+    {
+        cellArrays[i] = data->GetCellData()->GetArray(m_CellArrays[i].name.c_str());
+        if ((!cellArrays[i]) || (cellArrays[i]->GetNumberOfComponents() != (int)m_CellArrays[i].numberOfComponents))
+            throw itk::ExceptionObject(__FILE__, __LINE__,"Missing cell array " + m_CellArrays[i].name + " in written fibers",ITK_LOCATION);
+
+        numCellComponents += m_CellArrays[i].numberOfComponents;
+    }
+
+    // Gather fibers point ids first to know the chunk size
+    uint64_t numFibers = cellIds.size();
+    std::vector <uint64_t> offsets(numFibers + 1,0);
+    std::vector <vtkIdType> pointIds;
+    vtkSmartPointer <vtkIdList> cellPointIds = vtkSmartPointer <vtkIdList>::New();
+    for (uint64_t i = 0;i < numFibers;++i)
+    {
+        data->GetCellPoints(cellIds[i],cellPointIds);
+        for (vtkIdType j = 0;j < cellPointIds->GetNumberOfIds();++j)
+            pointIds.push_back(cellPointIds->GetId(j));
+
+        offsets[i + 1] = pointIds.size();
+    }
+
+    uint64_t numPoints = pointIds.size();
+    uint64_t chunkSize = GetBinaryTractogramChunkSize(numFibers,numPoints,numPointComponents,numCellComponents);
+    m_ChunkBuffer.assign(chunkSize,0);
+
+    uint64_t *chunkSizes = reinterpret_cast <uint64_t *> (m_ChunkBuffer.data());
+    chunkSizes[0] = numFibers;
+    chunkSizes[1] = numPoints;
+    std::copy(offsets.begin(),offsets.end(),chunkSizes + 2);
+
+    float *floatBuffer = reinterpret_cast <float *> (chunkSizes + 3 + numFibers);
+    double ptVals[3];
+    for (uint64_t i = 0;i < numPoints;++i)
+    {
+        data->GetPoint(pointIds[i],ptVals);
+        for (unsigned int j = 0;j < 3;++j)
+            floatBuffer[3 * i + j] = ptVals[j];
+    }
+
+    floatBuffer += 3 * numPoints;
+    for (unsigned int i = 0;i < pointArrays.size();++i)
+    {
+        unsigned int numComponents = m_PointArrays[i].numberOfComponents;
+        for (uint64_t j = 0;j < numPoints;++j)
+        {
+            for (unsigned int k = 0;k < numComponents;++k)
+                floatBuffer[j * numComponents + k] = pointArrays[i]->GetComponent(pointIds[j],k);
+        }
+
+        floatBuffer += numPoints * numComponents;
+    }
+
+    for (unsigned int i = 0;i < cellArrays.size();++i)
+    {
+        unsigned int numComponents = m_CellArrays[i].numberOfComponents;
+        for (uint64_t j = 0;j < numFibers;++j)
+        {
+            for (unsigned int k = 0;k < numComponents;++k)
+                floatBuffer[j * numComponents + k] = cellArrays[i]->GetComponent(cellIds[j],k);
+        }
+
+        floatBuffer += numFibers * numComponents;
+    }
+
+    m_FileStream.write(m_ChunkBuffer.data(),chunkSize);
+    if (!m_FileStream.good())
+        throw itk::ExceptionObject(__FILE__, __LINE__,"Error writing binary tractogram file " + m_FileName,ITK_LOCATION);
+
+    m_Header.numberOfFibers += numFibers;
+    m_Header.numberOfPoints += numPoints;
+    ++m_Header.numberOfChunks;
+}
+
+void BinaryTractogramWriter::WritePolyData(vtkPolyData *data, unsigned int numFibersPerChunk)
+{
+    unsigned int numCells = data->GetNumberOfCells();
+    numFibersPerChunk = std::max(numFibersPerChunk,(unsigned int)1);
+
+    if (numCells == 0)
+    {
+        // Still writes header and arrays
+        std::vector <vtkIdType> cellIds;
+        this->WriteChunk(data,cellIds);
+        return;
+    }
+
+    std::vector <vtkIdType> cellIds;
+    for (unsigned int i = 0;i < numCells;i += numFibersPerChunk)
+    {
+        unsigned int lastCell = std::min(numCells,i + numFibersPerChunk);
+        cellIds.resize(lastCell - i);
+        for (unsigned int j = i;j < lastCell;++j)
+            cellIds[j - i] = j;
+
+        this->WriteChunk(data,cellIds);
+    }
+}
+
+void BinaryTractogramWriter::Close()
+{
+    if (!m_Opened)
+        return;
+
+    m_FileStream.seekp(0,std::ios::beg);
+    m_FileStream.write(reinterpret_cast <const char *> (&m_Header),sizeof(BinaryTractogramHeader));
+    m_FileStream.close();
+
+    m_ChunkBuffer.clear();
+    m_Opened = false;
+}
+
+} // end namespace anima
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <animaBinaryTractogramHeader.h>
+
+#include <vtkPolyData.h>
+
+#include <string>
+#include <vector>
+#include <fstream>
+
+#include "AnimaDataIOExport.h"
+
+namespace anima
+{
+
+/**
+ * @brief Writer of binary tractograms (.atg). Fibers are written chunk by chunk, each call to WriteChunk appending a
+ * new chunk to the file. In append mode, chunks are added at the end of an existing file whose arrays have to match
+ * those of the written data. Header counts are written when closing the writer.
+ */
+class ANIMADATAIO_EXPORT BinaryTractogramWriter
+{
+public:
+    BinaryTractogramWriter();
+    ~BinaryTractogramWriter();
+
+    void SetFileName(const std::string &name) {m_FileName = name;}
+    void SetAppendMode(bool val) {m_AppendMode = val;}
+
+    //! Writes all fibers of data as a new chunk
+    void WriteChunk(vtkPolyData *data);
+
+    //! Writes the fibers cellIds of data as a new chunk
+    void WriteChunk(vtkPolyData *data, const std::vector <vtkIdType> &cellIds);
+
+    //! Writes all fibers of data, splitting them in chunks of numFibersPerChunk fibers
+    void WritePolyData(vtkPolyData *data, unsigned int numFibersPerChunk);
+
+    //! Updates header counts and closes the file
+    void Close();
+
+protected:
+    void Open(vtkPolyData *data);
+    void GetArraysDescriptions(vtkPolyData *data, std::vector <BinaryTractogramArrayDescription> &pointArrays,
+                               std::vector <BinaryTractogramArrayDescription> &cellArrays);
+
+private:
+    std::string m_FileName;
+    bool m_AppendMode;
+
+    BinaryTractogramHeader m_Header;
+    std::vector <BinaryTractogramArrayDescription> m_PointArrays, m_CellArrays;
+
+    std::fstream m_FileStream;
+    bool m_Opened;
+
+    // Output buffer reused between chunks
+    std::vector <char> m_ChunkBuffer;
+};
+
+} // end namespace anima
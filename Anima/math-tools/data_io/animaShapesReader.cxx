@@ -1,4 +1,5 @@
 #include <animaShapesReader.h>
+#include <animaBinaryTractogramReader.h>
 #include <itkMacro.h>
 
 #include <vtkPolyDataReader.h>
@@ -31,6 +32,8 @@ void ShapesReader::Update()
         this->ReadFileAsMedinriaFibers();
     else if (extensionName == "csv")
         this->ReadFileAsCSV();
+    else if (extensionName == "atg")
+        this->ReadFileAsBinaryTractogram();
     else
         throw itk::ExceptionObject(__FILE__, __LINE__,"Unsupported shapes extension.",ITK_LOCATION);
 }
@@ -55,6 +58,15 @@ void ShapesReader::ReadFileAsVTKXML()
     m_OutputData->ShallowCopy(vtkReader->GetOutput());
 }
 
+void ShapesReader::ReadFileAsBinaryTractogram()
+{
+    anima::BinaryTractogramReader binaryReader;
+    binaryReader.SetFileName(m_FileName);
+    binaryReader.Open();
+
+    m_OutputData = binaryReader.ReadChunks(0,binaryReader.GetNumberOfChunks());
+}
+
 void ShapesReader::ReadFileAsMedinriaFibers()
 {
     std::replace(m_FileName.begin(),m_FileName.end(),'\\','/');
@@ -1,4 +1,5 @@
 #include <animaShapesWriter.h>
+#include <animaBinaryTractogramWriter.h>
 #include <itkMacro.h>
 
 #include <vtkPolyDataWriter.h>
@@ -27,6 +28,8 @@ void ShapesWriter::Update()
         this->WriteFileAsMedinriaFibers();
     else if (extensionName == "csv")
         this->WriteFileAsCSV();
+    else if (extensionName == "atg")
+        this->WriteFileAsBinaryTractogram();
     else
         throw itk::ExceptionObject(__FILE__, __LINE__,"Unsupported shapes extension.",ITK_LOCATION);
 }
@@ -50,6 +53,14 @@ void ShapesWriter::WriteFileAsVTKXML()
     vtkWriter->Update();
 }
 
+void ShapesWriter::WriteFileAsBinaryTractogram()
+{
+    anima::BinaryTractogramWriter binaryWriter;
+    binaryWriter.SetFileName(m_FileName);
+    binaryWriter.WritePolyData(m_InputData,m_NumberOfFibersPerChunk);
+    binaryWriter.Close();
+}
+
 void ShapesWriter::WriteFileAsMedinriaFibers()
 {
     std::replace(m_FileName.begin(),m_FileName.end(),'\\','/');
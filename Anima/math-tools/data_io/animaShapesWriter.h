@@ -15,6 +15,7 @@ public:
     {
         m_FileName = "";
         m_InputData = 0;
+        m_NumberOfFibersPerChunk = 10000;
     }
 
     ~ShapesWriter() {}
@@ -22,6 +23,9 @@ public:
     void SetInputData(vtkPolyData *data) {m_InputData = data;}
     void SetFileName(std::string &name) {m_FileName = name;}
 
+    //! Number of fibers per chunk when writing binary tractograms (.atg)
+    void SetNumberOfFibersPerChunk(unsigned int val) {m_NumberOfFibersPerChunk = val;}
+
     void Update();
 
 protected:
@@ -29,10 +33,12 @@ protected:
     void WriteFileAsVTKXML();
     void WriteFileAsMedinriaFibers();
     void WriteFileAsCSV();
+    void WriteFileAsBinaryTractogram();
 
 private:
     vtkSmartPointer <vtkPolyData> m_InputData;
     std::string m_FileName;
+    unsigned int m_NumberOfFibersPerChunk;
 };
 
 } // end namespace anima
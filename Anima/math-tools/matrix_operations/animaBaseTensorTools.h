@@ -73,6 +73,15 @@ template <class T1, class T2, unsigned int NDim>
 void RotateSymmetricMatrix(itk::Matrix <T1,NDim,NDim> &tensor, itk::Matrix <T2,NDim,NDim> &rotationMatrix,
                            itk::Matrix <T2,NDim,NDim> &rotated_tensor);
 
+/**
+ * @brief Closed form eigen decomposition of a 3x3 symmetric matrix given by its vector representation (xx, yx, yy, zx, zy, zz,
+ * non scaled). Eigenvalues are computed with the trigonometric method, refined as Rayleigh quotients and sorted in ascending
+ * order, eigenvectors are stored as rows of eigenVectors (as SymmetricEigenAnalysis does) and computed from cross products of
+ * rows of A - lambda I. When two eigenvalues are equal, any orthonormal basis of their eigenspace is returned.
+ */
+template <class T1, class T2>
+void ComputeClosedFormSymmetricEigenSystem3x3(const T1 *tensorValues, T2 *eigenValues, T2 *eigenVectors);
+
 template <class T1> double ovlScore(vnl_diag_matrix <T1> &eigsX, vnl_matrix <T1> &eigVecsX,
                                     vnl_diag_matrix <T1> &eigsY, vnl_matrix <T1> &eigVecsY);
 
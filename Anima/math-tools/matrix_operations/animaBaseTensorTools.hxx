@@ -5,6 +5,9 @@
 #include <animaVectorOperations.h>
 #include <animaMatrixOperations.h>
 
+#include <algorithm>
+#include <cmath>
+
 namespace anima
 {
 
@@ -336,4 +339,210 @@ ovlScore(vnl_diag_matrix <T1> &eigsX, vnl_matrix <T1> &eigVecsX,
 }
 
 
+namespace internal
+{
+
+//! Unit eigenvector for eigenvalue lambda, as the largest cross product of rows of A - lambda I. Returns false if degenerate
+template <class T>
+bool ComputeEigenVectorFromCrossProducts(const T *a, T lambda, T squaredScale, T *eigenVector)
+{
+    T rows[3][3] = {{a[0] - lambda, a[1], a[3]},
+                    {a[1], a[2] - lambda, a[4]},
+                    {a[3], a[4], a[5] - lambda}};
+
+    T bestNorm = 0;
+    for (unsigned int i = 0;i < 3;++i)
+    {
+        const T *u = rows[i];
+        const T *v = rows[(i + 1) % 3];
+        T crossProduct[3] = {u[1] * v[2] - u[2] * v[1], u[2] * v[0] - u[0] * v[2], u[0] * v[1] - u[1] * v[0]};
+        T norm = crossProduct[0] * crossProduct[0] + crossProduct[1] * crossProduct[1] + crossProduct[2] * crossProduct[2];
+
+        if (norm > bestNorm)
+        {
+            bestNorm = norm;
+            for (unsigned int j = 0;j < 3;++j)
+                eigenVector[j] = crossProduct[j];
+        }
+    }
+
+    // Rank of A - lambda I lower than 2: eigenvalue with multiplicity
+    if (bestNorm <= 1.0e-20 * squaredScale * squaredScale)
+        return false;
+
+    bestNorm = std::sqrt(bestNorm);
+    for (unsigned int j = 0;j < 3;++j)
+        eigenVector[j] /= bestNorm;
+
+    return true;
+}
+
+//! Any unit vector orthogonal to the unit vector u
+template <class T>
+void ComputeOrthogonalUnitVector(const T *u, T *orthogonalVector)
+{
+    // Cross product with the axis least aligned to u
+    unsigned int minAxis = 0;
+    for (unsigned int i = 1;i < 3;++i)
+    {
+        if (std::abs(u[i]) < std::abs(u[minAxis]))
+            minAxis = i;
+    }
+
+    T axis[3] = {0, 0, 0};
+    axis[minAxis] = 1;
+
+    orthogonalVector[0] = u[1] * axis[2] - u[2] * axis[1];
+    orthogonalVector[1] = u[2] * axis[0] - u[0] * axis[2];
+    orthogonalVector[2] = u[0] * axis[1] - u[1] * axis[0];
+
+    T norm = std::sqrt(orthogonalVector[0] * orthogonalVector[0] + orthogonalVector[1] * orthogonalVector[1] +
+                       orthogonalVector[2] * orthogonalVector[2]);
+
+    for (unsigned int i = 0;i < 3;++i)
+        orthogonalVector[i] /= norm;
+}
+
+//! Eigenvectors (as rows) of a 3x3 symmetric matrix given its eigenvalues in ascending order
+template <class T>
+void ComputeEigenVectorsFromEigenValues(const T *a, const T *eigenValues, T squaredScale, T *eigenVectors)
+{
+    T *smallestVector = eigenVectors;
+    T *middleVector = eigenVectors + 3;
+    T *largestVector = eigenVectors + 6;
+
+    bool largestOk = ComputeEigenVectorFromCrossProducts(a,eigenValues[2],squaredScale,largestVector);
+    bool smallestOk = ComputeEigenVectorFromCrossProducts(a,eigenValues[0],squaredScale,smallestVector);
+
+    if (!largestOk && !smallestOk)
+    {
+        // Only reached for numerically isotropic matrices
+        for (unsigned int i = 0;i < 9;++i)
+            eigenVectors[i] = ((i % 4) == 0);
+
+        return;
+    }
+
+    if (!largestOk)
+        ComputeOrthogonalUnitVector(smallestVector,largestVector);
+    else if (!smallestOk)
+        ComputeOrthogonalUnitVector(largestVector,smallestVector);
+    else
+    {
+        // Enforce orthogonality lost for close eigenvalues
+        T dotProduct = 0;
+        for (unsigned int i = 0;i < 3;++i)
+            dotProduct += smallestVector[i] * largestVector[i];
+
+        T norm = 0;
+        for (unsigned int i = 0;i < 3;++i)
+        {
+            smallestVector[i] -= dotProduct * largestVector[i];
+            norm += smallestVector[i] * smallestVector[i];
+        }
+
+        // Both vectors from the same direction: eigenvalues too close to be told apart
+        if (norm <= 1.0e-20)
+            ComputeOrthogonalUnitVector(largestVector,smallestVector);
+        else
+        {
+            norm = std::sqrt(norm);
+            for (unsigned int i = 0;i < 3;++i)
+                smallestVector[i] /= norm;
+        }
+    }
+
+    middleVector[0] = largestVector[1] * smallestVector[2] - largestVector[2] * smallestVector[1];
+    middleVector[1] = largestVector[2] * smallestVector[0] - largestVector[0] * smallestVector[2];
+    middleVector[2] = largestVector[0] * smallestVector[1] - largestVector[1] * smallestVector[0];
+}
+
+//! Rayleigh quotient u^T A u of the unit vector u
+template <class T>
+T ComputeRayleighQuotient(const T *a, const T *u)
+{
+    return a[0] * u[0] * u[0] + a[2] * u[1] * u[1] + a[5] * u[2] * u[2] +
+            2.0 * (a[1] * u[0] * u[1] + a[3] * u[0] * u[2] + a[4] * u[1] * u[2]);
+}
+
+} // end of namespace internal
+
+template <class T1, class T2>
+void ComputeClosedFormSymmetricEigenSystem3x3(const T1 *tensorValues, T2 *eigenValues, T2 *eigenVectors)
+{
+    T2 a[6];
+    for (unsigned int i = 0;i < 6;++i)
+        a[i] = tensorValues[i];
+
+    T2 offDiagonalNorm = a[1] * a[1] + a[3] * a[3] + a[4] * a[4];
+    T2 trace = (a[0] + a[2] + a[5]) / 3.0;
+    T2 diagonalNorm = (a[0] - trace) * (a[0] - trace) + (a[2] - trace) * (a[2] - trace) + (a[5] - trace) * (a[5] - trace);
+    T2 squaredScale = diagonalNorm + 2.0 * offDiagonalNorm;
+
+    if (squaredScale <= 1.0e-28 * trace * trace)
+    {
+        // Isotropic up to rounding errors: any basis is an eigen basis
+        for (unsigned int i = 0;i < 3;++i)
+        {
+            eigenValues[i] = trace;
+            for (unsigned int j = 0;j < 3;++j)
+                eigenVectors[3 * i + j] = (i == j);
+        }
+
+        return;
+    }
+
+    if (offDiagonalNorm <= 1.0e-30 * std::max(squaredScale,(T2)1.0e-300))
+    {
+        // Diagonal matrix: sort diagonal values
+        unsigned int order[3] = {0, 1, 2};
+        T2 diagonal[3] = {a[0], a[2], a[5]};
+        std::sort(order,order + 3,[&diagonal](unsigned int i, unsigned int j){return diagonal[i] < diagonal[j];});
+
+        for (unsigned int i = 0;i < 3;++i)
+        {
+            eigenValues[i] = diagonal[order[i]];
+            for (unsigned int j = 0;j < 3;++j)
+                eigenVectors[3 * i + j] = (j == order[i]);
+        }
+
+        return;
+    }
+
+    T2 p = std::sqrt(squaredScale / 6.0);
+    T2 b[6] = {(a[0] - trace) / p, a[1] / p, (a[2] - trace) / p, a[3] / p, a[4] / p, (a[5] - trace) / p};
+    T2 halfDeterminant = (b[0] * (b[2] * b[5] - b[4] * b[4]) - b[1] * (b[1] * b[5] - b[4] * b[3]) +
+                          b[3] * (b[1] * b[4] - b[2] * b[3])) / 2.0;
+
+    halfDeterminant = std::max((T2)-1.0,std::min((T2)1.0,halfDeterminant));
+    T2 phi = std::acos(halfDeterminant) / 3.0;
+
+    eigenValues[2] = trace + 2.0 * p * std::cos(phi);
+    eigenValues[0] = trace + 2.0 * p * std::cos(phi + 2.0 * M_PI / 3.0);
+    eigenValues[1] = 3.0 * trace - eigenValues[0] - eigenValues[2];
+
+    // Trigonometric eigenvalues are ill-conditioned for close eigenvalues, with errors up to sqrt(eps) in the worst case.
+    // They are refined as Rayleigh quotients of the eigenvectors, which are then recomputed from the refined values
+    for (unsigned int k = 0;k < 2;++k)
+    {
+        internal::ComputeEigenVectorsFromEigenValues(a,eigenValues,squaredScale,eigenVectors);
+        for (unsigned int i = 0;i < 3;++i)
+            eigenValues[i] = internal::ComputeRayleighQuotient(a,eigenVectors + 3 * i);
+    }
+
+    // Refined values of a repeated eigenvalue may swap by rounding errors
+    for (unsigned int i = 0;i < 2;++i)
+    {
+        for (unsigned int j = 0;j < 2 - i;++j)
+        {
+            if (eigenValues[j] > eigenValues[j + 1])
+            {
+                std::swap(eigenValues[j],eigenValues[j + 1]);
+                for (unsigned int l = 0;l < 3;++l)
+                    std::swap(eigenVectors[3 * j + l],eigenVectors[3 * (j + 1) + l]);
+            }
+        }
+    }
+}
+
 } // end of namespace anima
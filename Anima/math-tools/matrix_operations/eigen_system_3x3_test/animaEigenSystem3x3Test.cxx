@@ -0,0 +1,215 @@
+#include <cmath>
+#include <algorithm>
+#include <iostream>
+#include <random>
+
+#include <animaBaseTensorTools.h>
+
+typedef vnl_matrix <double> MatrixType;
+
+//! Tensor vector representation (xx, yx, yy, zx, zy, zz) of R diag(eigenValues) R^T, R being a random rotation
+void buildTensor(const double *eigenValues, std::mt19937 &generator, bool rotate, double *tensorValues)
+{
+    MatrixType rotation(3,3);
+    rotation.set_identity();
+
+    if (rotate)
+    {
+        std::normal_distribution <double> normalDistribution(0.0, 1.0);
+        double q[4];
+        double norm = 0;
+        for (unsigned int i = 0;i < 4;++i)
+        {
+            q[i] = normalDistribution(generator);
+            norm += q[i] * q[i];
+        }
+
+        norm = std::sqrt(norm);
+        for (unsigned int i = 0;i < 4;++i)
+            q[i] /= norm;
+
+        rotation(0,0) = 1 - 2 * (q[2] * q[2] + q[3] * q[3]);
+        rotation(0,1) = 2 * (q[1] * q[2] - q[0] * q[3]);
+        rotation(0,2) = 2 * (q[1] * q[3] + q[0] * q[2]);
+        rotation(1,0) = 2 * (q[1] * q[2] + q[0] * q[3]);
+        rotation(1,1) = 1 - 2 * (q[1] * q[1] + q[3] * q[3]);
+        rotation(1,2) = 2 * (q[2] * q[3] - q[0] * q[1]);
+        rotation(2,0) = 2 * (q[1] * q[3] - q[0] * q[2]);
+        rotation(2,1) = 2 * (q[2] * q[3] + q[0] * q[1]);
+        rotation(2,2) = 1 - 2 * (q[1] * q[1] + q[2] * q[2]);
+    }
+
+    MatrixType tensor(3,3,0.0);
+    for (unsigned int i = 0;i < 3;++i)
+        for (unsigned int j = 0;j < 3;++j)
+            for (unsigned int k = 0;k < 3;++k)
+                tensor(i,j) += rotation(i,k) * eigenValues[k] * rotation(j,k);
+
+    unsigned int pos = 0;
+    for (unsigned int i = 0;i < 3;++i)
+        for (unsigned int j = 0;j <= i;++j)
+            tensorValues[pos++] = tensor(i,j);
+}
+
+/**
+ * Compares the closed form eigen system to SymmetricEigenAnalysis: eigenvalues, residuals, orthonormality of eigenvectors
+ * and projectors on eigen spaces, eigenvalues closer than a relative 1.0e-6 being grouped as one repeated eigenvalue
+ */
+bool checkEigenSystem(const double *tensorValues, const char *caseName)
+{
+    MatrixType tensor(3,3);
+    unsigned int pos = 0;
+    for (unsigned int i = 0;i < 3;++i)
+        for (unsigned int j = 0;j <= i;++j)
+        {
+            tensor(i,j) = tensorValues[pos];
+            tensor(j,i) = tensorValues[pos];
+            ++pos;
+        }
+
+    double eigenValues[3], eigenVectors[9];
+    anima::ComputeClosedFormSymmetricEigenSystem3x3(tensorValues,eigenValues,eigenVectors);
+
+    vnl_diag_matrix <double> refEigenValues(3);
+    MatrixType refEigenVectors(3,3);
+    itk::SymmetricEigenAnalysis <MatrixType,vnl_diag_matrix <double>,MatrixType> eigenAnalysis(3);
+    eigenAnalysis.SetOrderEigenValues(true);
+    eigenAnalysis.ComputeEigenValuesAndVectors(tensor,refEigenValues,refEigenVectors);
+
+    double scale = 0;
+    for (unsigned int i = 0;i < 3;++i)
+        scale = std::max(scale, std::abs(refEigenValues[i]));
+
+    scale = std::max(scale, 1.0e-300);
+
+    double valueDeviation = 0;
+    double residual = 0;
+    double orthonormalityDeviation = 0;
+    for (unsigned int i = 0;i < 3;++i)
+    {
+        valueDeviation = std::max(valueDeviation, std::abs(eigenValues[i] - refEigenValues[i]) / scale);
+
+        for (unsigned int j = 0;j < 3;++j)
+        {
+            double residualValue = - eigenValues[i] * eigenVectors[3 * i + j];
+            for (unsigned int k = 0;k < 3;++k)
+                residualValue += tensor(j,k) * eigenVectors[3 * i + k];
+
+            residual = std::max(residual, std::abs(residualValue) / scale);
+
+            double dotProduct = 0;
+            for (unsigned int k = 0;k < 3;++k)
+                dotProduct += eigenVectors[3 * i + k] * eigenVectors[3 * j + k];
+
+            orthonormalityDeviation = std::max(orthonormalityDeviation, std::abs(dotProduct - (i == j)));
+        }
+    }
+
+    double projectorDeviation = 0;
+    unsigned int groupStart = 0;
+    while (groupStart < 3)
+    {
+        unsigned int groupEnd = groupStart + 1;
+        while ((groupEnd < 3) && (refEigenValues[groupEnd] - refEigenValues[groupEnd - 1] <= 1.0e-6 * scale))
+            ++groupEnd;
+
+        for (unsigned int j = 0;j < 3;++j)
+            for (unsigned int k = 0;k < 3;++k)
+            {
+                double projectorValue = 0;
+                double refProjectorValue = 0;
+                for (unsigned int i = groupStart;i < groupEnd;++i)
+                {
+                    projectorValue += eigenVectors[3 * i + j] * eigenVectors[3 * i + k];
+                    refProjectorValue += refEigenVectors(i,j) * refEigenVectors(i,k);
+                }
+
+                projectorDeviation = std::max(projectorDeviation, std::abs(projectorValue - refProjectorValue));
+            }
+
+        groupStart = groupEnd;
+    }
+
+    bool caseOk = (valueDeviation <= 1.0e-10) && (residual <= 1.0e-9) &&
+            (orthonormalityDeviation <= 1.0e-10) && (projectorDeviation <= 1.0e-9);
+
+    if (!caseOk)
+    {
+        std::cerr << caseName << ": eigenvalue deviation " << valueDeviation << ", residual " << residual
+                  << ", orthonormality deviation " << orthonormalityDeviation << ", eigen space deviation "
+                  << projectorDeviation << std::endl;
+    }
+
+    return caseOk;
+}
+
+int main()
+{
+    std::mt19937 generator(5);
+    std::uniform_real_distribution <double> logDiffusivityDistribution(std::log(1.0e-4), std::log(3.0e-3));
+    std::uniform_real_distribution <double> unitDistribution(-1.0, 1.0);
+
+    unsigned int numCases = 0;
+    unsigned int numFailures = 0;
+    double tensorValues[6];
+    double eigenValues[3];
+
+    // Log-tensors, diffusion tensors and generic symmetric matrices, with distinct eigenvalues
+    for (unsigned int n = 0;n < 300;++n)
+    {
+        for (unsigned int i = 0;i < 3;++i)
+        {
+            eigenValues[i] = logDiffusivityDistribution(generator);
+            if (n % 3 == 1)
+                eigenValues[i] = std::exp(eigenValues[i]);
+            else if (n % 3 == 2)
+                eigenValues[i] = unitDistribution(generator);
+        }
+
+        buildTensor(eigenValues,generator,true,tensorValues);
+        numFailures += !checkEigenSystem(tensorValues,"distinct eigenvalues");
+        ++numCases;
+    }
+
+    // Repeated eigenvalues: pair below or above the third one, isotropic and near repeated
+    for (unsigned int n = 0;n < 100;++n)
+    {
+        double firstValue = logDiffusivityDistribution(generator);
+        double secondValue = logDiffusivityDistribution(generator);
+        const char *caseNames[4] = {"repeated smallest eigenvalue", "repeated largest eigenvalue", "isotropic", "near repeated eigenvalue"};
+
+        for (unsigned int c = 0;c < 4;++c)
+        {
+            eigenValues[0] = std::min(firstValue,secondValue);
+            eigenValues[1] = std::min(firstValue,secondValue);
+            eigenValues[2] = std::max(firstValue,secondValue);
+
+            if (c == 1)
+                eigenValues[0] = std::max(firstValue,secondValue);
+            else if (c == 2)
+                eigenValues[2] = eigenValues[0];
+            else if (c == 3)
+                eigenValues[1] *= 1.0 + 1.0e-10;
+
+            buildTensor(eigenValues,generator,true,tensorValues);
+            numFailures += !checkEigenSystem(tensorValues,caseNames[c]);
+            ++numCases;
+        }
+    }
+
+    // Diagonal matrices, unsorted and with repeated values, and the null tensor found outside of the brain
+    const double diagonalValues[4][3] = {{-6.5, -8.2, -7.1}, {2.0e-3, 5.0e-4, 5.0e-4}, {-7.0, -7.0, -7.0}, {0.0, 0.0, 0.0}};
+    for (unsigned int c = 0;c < 4;++c)
+    {
+        buildTensor(diagonalValues[c],generator,false,tensorValues);
+        numFailures += !checkEigenSystem(tensorValues,"diagonal");
+        ++numCases;
+    }
+
+    std::cout << numCases - numFailures << " out of " << numCases << " eigen systems match SymmetricEigenAnalysis" << std::endl;
+
+    if (numFailures != 0)
+        return EXIT_FAILURE;
+
+    return EXIT_SUCCESS;
+}
@@ -1,10 +1,40 @@
 #include <animaNNLSOptimizer.h>
 #include <vnl/algo/vnl_qr.h>
+#include <algorithm>
 
 namespace anima
 {
 
 const double NNLSOptimizer::m_EpsilonValue = 1.0e-12;
+const unsigned int NNLSOptimizer::m_MaximumCacheSize = 1024;
+
+void NNLSOptimizer::SetDataMatrix(const MatrixType &data)
+{
+    // Same matrix for many problems (e.g. a dictionary used for all voxels): keep cached factorizations
+    if ((data.rows() == m_DataMatrix.rows()) && (data.cols() == m_DataMatrix.cols()) && (data == m_DataMatrix))
+        return;
+
+    m_DataMatrix = data;
+    m_GramMatrixUpToDate = false;
+    this->ClearFactorizations();
+}
+
+void NNLSOptimizer::SetSquaredProblem(bool val)
+{
+    if (val == m_SquaredProblem)
+        return;
+
+    m_SquaredProblem = val;
+    this->ClearFactorizations();
+}
+
+void NNLSOptimizer::ClearFactorizations()
+{
+    m_FactorizationsCache.clear();
+    m_CurrentFactorization.indexes.clear();
+    m_CurrentFactorization.lowerMatrix.clear();
+    m_CurrentFactorization.diagonal.clear();
+}
 
 void NNLSOptimizer::StartOptimization()
 {
@@ -14,6 +44,64 @@ void NNLSOptimizer::StartOptimization()
     if ((numEquations != m_Points.size())||(numEquations == 0)||(parametersSize == 0))
         itkExceptionMacro("Wrongly sized inputs to NNLS, aborting");
 
+    m_UseNormalEquations = m_SquaredProblem || m_UseCachedFactorizations;
+    if (m_UseNormalEquations)
+    {
+        if (m_SquaredProblem)
+            m_AtbVector = m_Points;
+        else
+        {
+            this->UpdateGramMatrix();
+
+            m_AtbVector.set_size(parametersSize);
+            m_AtbVector.fill(0.0);
+            for (unsigned int i = 0;i < numEquations;++i)
+            {
+                for (unsigned int j = 0;j < parametersSize;++j)
+                    m_AtbVector[j] += m_DataMatrix.get(i,j) * m_Points[i];
+            }
+        }
+    }
+
+    this->RunActiveSetIterations();
+}
+
+void NNLSOptimizer::SolveBatch(const MatrixType &rightHandSides, MatrixType &solutions)
+{
+    unsigned int parametersSize = m_DataMatrix.cols();
+    unsigned int numEquations = m_DataMatrix.rows();
+
+    if ((numEquations != rightHandSides.rows())||(numEquations == 0)||(parametersSize == 0))
+        itkExceptionMacro("Wrongly sized inputs to NNLS, aborting");
+
+    // All right hand sides are brought to normal equations at once
+    MatrixType normalRightHandSides;
+    if (m_SquaredProblem)
+        normalRightHandSides = rightHandSides;
+    else
+    {
+        this->UpdateGramMatrix();
+        normalRightHandSides = m_DataMatrix.transpose() * rightHandSides;
+    }
+
+    m_UseNormalEquations = true;
+    unsigned int numProblems = rightHandSides.cols();
+    solutions.set_size(parametersSize,numProblems);
+
+    for (unsigned int i = 0;i < numProblems;++i)
+    {
+        m_AtbVector = normalRightHandSides.get_column(i);
+        this->RunActiveSetIterations();
+
+        for (unsigned int j = 0;j < parametersSize;++j)
+            solutions.put(j,i,m_CurrentPosition[j]);
+    }
+}
+
+void NNLSOptimizer::RunActiveSetIterations()
+{
+    unsigned int parametersSize = m_DataMatrix.cols();
+
     m_CurrentPosition.SetSize(parametersSize);
     m_CurrentPosition.Fill(0.0);
     m_TreatedIndexes.resize(parametersSize);
@@ -131,6 +219,23 @@ void NNLSOptimizer::StartOptimization()
     }
 }
 
+const NNLSOptimizer::MatrixType &NNLSOptimizer::GetNormalMatrix()
+{
+    if (m_SquaredProblem)
+        return m_DataMatrix;
+
+    return m_GramMatrix;
+}
+
+void NNLSOptimizer::UpdateGramMatrix()
+{
+    if (m_GramMatrixUpToDate)
+        return;
+
+    m_GramMatrix = m_DataMatrix.transpose() * m_DataMatrix;
+    m_GramMatrixUpToDate = true;
+}
+
 void NNLSOptimizer::ComputeWVector()
 {
     unsigned int parametersSize = m_DataMatrix.cols();
@@ -139,7 +244,7 @@ void NNLSOptimizer::ComputeWVector()
     m_WVector.resize(parametersSize);
 
     std::fill(m_WVector.begin(),m_WVector.end(),0.0);
-    if (!m_SquaredProblem)
+    if (!m_UseNormalEquations)
     {
         for (unsigned int i = 0;i < numEquations;++i)
         {
@@ -153,11 +258,12 @@ void NNLSOptimizer::ComputeWVector()
     }
     else
     {
-        for (unsigned int i = 0;i < numEquations;++i)
+        const MatrixType &normalMatrix = this->GetNormalMatrix();
+        for (unsigned int i = 0;i < parametersSize;++i)
         {
-            m_WVector[i] = m_Points[i];
+            m_WVector[i] = m_AtbVector[i];
             for (unsigned int j = 0;j < parametersSize;++j)
-                m_WVector[i] -= m_DataMatrix.get(i,j) * m_CurrentPosition[j];
+                m_WVector[i] -= normalMatrix.get(i,j) * m_CurrentPosition[j];
         }
     }
 }
@@ -184,12 +290,79 @@ unsigned int NNLSOptimizer::UpdateProcessedIndexes()
     return numProcessedIndexes;
 }
 
+void NNLSOptimizer::AppendFactorizationColumn(unsigned int index)
+{
+    const MatrixType &normalMatrix = this->GetNormalMatrix();
+    FactorizationType &factorization = m_CurrentFactorization;
+
+    unsigned int factorSize = factorization.indexes.size();
+    unsigned int rowStart = factorSize * (factorSize - 1) / 2;
+    factorization.lowerMatrix.resize(rowStart + factorSize);
+
+    // Solve L D l = A_P^T a_index by forward substitution, the new diagonal term being the Schur complement
+    double *newRow = factorization.lowerMatrix.data() + rowStart;
+    double diagonalValue = normalMatrix.get(index,index);
+    for (unsigned int i = 0;i < factorSize;++i)
+    {
+        const double *lowerRow = factorization.lowerMatrix.data() + i * (i - 1) / 2;
+        double tmpValue = normalMatrix.get(factorization.indexes[i],index);
+        for (unsigned int j = 0;j < i;++j)
+            tmpValue -= lowerRow[j] * newRow[j] * factorization.diagonal[j];
+
+        newRow[i] = tmpValue / factorization.diagonal[i];
+        diagonalValue -= newRow[i] * tmpValue;
+    }
+
+    factorization.indexes.push_back(index);
+    factorization.diagonal.push_back(std::max(diagonalValue, m_EpsilonValue * normalMatrix.get(index,index)));
+}
+
+void NNLSOptimizer::UpdateFactorization()
+{
+    unsigned int parametersSize = m_DataMatrix.cols();
+
+    m_PassiveSetKey = m_ProcessedIndexes;
+    std::sort(m_PassiveSetKey.begin(),m_PassiveSetKey.end());
+
+    auto cacheIterator = m_FactorizationsCache.find(m_PassiveSetKey);
+    if (cacheIterator != m_FactorizationsCache.end())
+    {
+        m_CurrentFactorization = cacheIterator->second;
+        return;
+    }
+
+    // A factorization prefix is the factorization of the leading sub-matrix: keep the longest prefix
+    // still in the passive set, then append the other passive indexes
+    FactorizationType &factorization = m_CurrentFactorization;
+    unsigned int prefixSize = 0;
+    while ((prefixSize < factorization.indexes.size()) && (m_TreatedIndexes[factorization.indexes[prefixSize]] != 0))
+        ++prefixSize;
+
+    factorization.indexes.resize(prefixSize);
+    factorization.lowerMatrix.resize(prefixSize * (prefixSize - 1) / 2);
+    factorization.diagonal.resize(prefixSize);
+
+    m_FactorizationMembers.resize(parametersSize);
+    std::fill(m_FactorizationMembers.begin(),m_FactorizationMembers.end(),0);
+    for (unsigned int i = 0;i < prefixSize;++i)
+        m_FactorizationMembers[factorization.indexes[i]] = 1;
+
+    for (unsigned int i = 0;i < m_PassiveSetKey.size();++i)
+    {
+        if (m_FactorizationMembers[m_PassiveSetKey[i]] == 0)
+            this->AppendFactorizationColumn(m_PassiveSetKey[i]);
+    }
+
+    if (m_FactorizationsCache.size() < m_MaximumCacheSize)
+        m_FactorizationsCache[m_PassiveSetKey] = factorization;
+}
+
 void NNLSOptimizer::ComputeSPVector()
 {
     unsigned int numEquations = m_DataMatrix.rows();
     unsigned int numProcessedIndexes = m_ProcessedIndexes.size();
 
-    if (!m_SquaredProblem)
+    if (!m_UseNormalEquations)
     {
         m_DataMatrixP.set_size(numEquations,numProcessedIndexes);
         m_SPVector.set_size(numProcessedIndexes);
@@ -206,28 +379,37 @@ void NNLSOptimizer::ComputeSPVector()
     }
     else
     {
-        m_DataMatrixP.set_size(numProcessedIndexes,numProcessedIndexes);
-        m_SPVector.set_size(numProcessedIndexes);
-        m_DataMatrixP.fill(0.0);
-        m_SPVector.fill(0.0);
+        this->UpdateFactorization();
 
+        // Solve L D L^T x = AtB restricted to the passive set, in factorization order
+        const FactorizationType &factorization = m_CurrentFactorization;
+        m_FactorizationWorkVector.resize(numProcessedIndexes);
         for (unsigned int i = 0;i < numProcessedIndexes;++i)
         {
-            unsigned int iIndex = m_ProcessedIndexes[i];
-            m_SPVector[i] = m_Points[iIndex];
-            for (unsigned int j = i;j < numProcessedIndexes;++j)
-            {
-                unsigned int jIndex = m_ProcessedIndexes[j];
-                m_DataMatrixP.put(i,j,m_DataMatrix.get(iIndex,jIndex));
+            const double *lowerRow = factorization.lowerMatrix.data() + i * (i - 1) / 2;
+            double tmpValue = m_AtbVector[factorization.indexes[i]];
+            for (unsigned int j = 0;j < i;++j)
+                tmpValue -= lowerRow[j] * m_FactorizationWorkVector[j];
 
-                if (i != j)
-                    m_DataMatrixP.put(j,i,m_DataMatrixP.get(i,j));
-            }
+            m_FactorizationWorkVector[i] = tmpValue;
+        }
+
+        for (unsigned int i = 0;i < numProcessedIndexes;++i)
+            m_FactorizationWorkVector[i] /= factorization.diagonal[i];
+
+        for (int i = (int)numProcessedIndexes - 2;i >= 0;--i)
+        {
+            for (unsigned int j = i + 1;j < numProcessedIndexes;++j)
+                m_FactorizationWorkVector[i] -= factorization.lowerMatrix[j * (j - 1) / 2 + i] * m_FactorizationWorkVector[j];
         }
 
-        m_CholeskySolver.SetInputMatrix(m_DataMatrixP);
-        m_CholeskySolver.PerformDecomposition();
-        m_CholeskySolver.SolveLinearSystemInPlace(m_SPVector);
+        // Back to processed indexes order
+        m_SPVector.set_size(numProcessedIndexes);
+        for (unsigned int i = 0;i < numProcessedIndexes;++i)
+        {
+            unsigned int factorPosition = std::find(factorization.indexes.begin(),factorization.indexes.end(),m_ProcessedIndexes[i]) - factorization.indexes.begin();
+            m_SPVector[i] = m_FactorizationWorkVector[factorPosition];
+        }
     }
 }
 
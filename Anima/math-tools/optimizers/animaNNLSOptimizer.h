@@ -2,6 +2,7 @@
 
 #include <vnl/vnl_matrix.h>
 #include <vector>
+#include <map>
 
 #include <itkOptimizer.h>
 
@@ -14,6 +15,10 @@ namespace anima
  * \brief Non negative least squares optimizer. Implements Lawson et al method,
  * of squared problem is activated, assumes we pass AtA et AtB and uses Bro and de Jong method
  *
+ * When working on normal equations (squared problem, cached factorizations or batch solving), the LDL^T
+ * factorization of the passive set normal matrix is updated incrementally as columns enter and leave the
+ * passive set, and factorizations of visited passive sets are cached as long as the data matrix does not change.
+ *
  * \ingroup Numerics Optimizers
  */
 class ANIMAOPTIMIZERS_EXPORT NNLSOptimizer : public itk::Optimizer
@@ -40,17 +45,30 @@ public:
     /** Start optimization. */
     void StartOptimization() ITK_OVERRIDE;
 
-    void SetDataMatrix(const MatrixType &data) {m_DataMatrix = data;}
+    /** Solves the problem for each column of rightHandSides (sharing the same data matrix),
+     * solutions are stored as columns of the solutions matrix. Always uses normal equations with cached factorizations */
+    void SolveBatch(const MatrixType &rightHandSides, MatrixType &solutions);
+
+    //! Set data matrix, cached factorizations are kept if the matrix is unchanged
+    void SetDataMatrix(const MatrixType &data);
     void SetPoints(const ParametersType &points) {m_Points = points;}
 
     double GetCurrentResidual();
 
-    itkSetMacro(SquaredProblem, bool)
+    void SetSquaredProblem(bool val);
+    itkGetMacro(SquaredProblem, bool)
+
+    //! If true, non squared problems are also solved through normal equations, with cached factorizations
+    itkSetMacro(UseCachedFactorizations, bool)
+    itkGetMacro(UseCachedFactorizations, bool)
 
 protected:
     NNLSOptimizer()
     {
         m_SquaredProblem = false;
+        m_UseCachedFactorizations = false;
+        m_UseNormalEquations = false;
+        m_GramMatrixUpToDate = false;
     }
 
     virtual ~NNLSOptimizer() ITK_OVERRIDE {}
@@ -58,17 +76,46 @@ protected:
 private:
     ITK_DISALLOW_COPY_AND_ASSIGN(NNLSOptimizer);
 
+    //! LDL^T factorization of the normal matrix restricted to a passive set, indexes being in factorization order
+    struct FactorizationType
+    {
+        std::vector <unsigned int> indexes;
+        std::vector <double> lowerMatrix; // packed by rows, without the unit diagonal
+        std::vector <double> diagonal;
+    };
+
+    void RunActiveSetIterations();
+
     unsigned int UpdateProcessedIndexes();
     void ComputeSPVector();
     void ComputeWVector();
 
+    const MatrixType &GetNormalMatrix();
+    void UpdateGramMatrix();
+    void ClearFactorizations();
+    void UpdateFactorization();
+    void AppendFactorizationColumn(unsigned int index);
+
     MatrixType m_DataMatrix;
     ParametersType m_Points;
 
     static const double m_EpsilonValue;
+    static const unsigned int m_MaximumCacheSize;
 
     //! Flag to indicate if the inputs are already AtA and AtB
     bool m_SquaredProblem;
+    bool m_UseCachedFactorizations;
+
+    // Normal equations working values
+    bool m_UseNormalEquations;
+    bool m_GramMatrixUpToDate;
+    MatrixType m_GramMatrix;
+    VectorType m_AtbVector;
+    FactorizationType m_CurrentFactorization;
+    std::map < std::vector <unsigned int>, FactorizationType > m_FactorizationsCache;
+    std::vector <double> m_FactorizationWorkVector;
+    std::vector <unsigned int> m_PassiveSetKey;
+    std::vector <unsigned short> m_FactorizationMembers;
 
     // Working values
     std::vector <unsigned short> m_TreatedIndexes;
@@ -76,8 +123,6 @@ private:
     std::vector <double> m_WVector;
     VectorType m_SPVector;
     MatrixType m_DataMatrixP;
-
-    anima::CholeskyDecomposition m_CholeskySolver;
 };
 
 } // end of namespace anima
@@ -0,0 +1,168 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+
+namespace anima
+{
+
+/**
+ * \class TwoParametersBoundedLevenbergMarquardt
+ * @brief Lightweight bounded Levenberg-Marquardt (damped Gauss-Newton) scheme for two parameter least squares problems,
+ * solved per voxel by relaxometry estimators without the cost function and optimizer objects of BoundedLevenbergMarquardtOptimizer.
+ *
+ * Normal equations are solved in closed form, damping being floored so that the system stays regular when one derivative
+ * vanishes. Steps are projected on bounds, a parameter lying on a bound with a step pointing outwards being kept fixed
+ * while the other one is optimized alone. Steps may be limited per parameter. Damping is increased until the residual decreases.
+ */
+class TwoParametersBoundedLevenbergMarquardt
+{
+public:
+    TwoParametersBoundedLevenbergMarquardt()
+    {
+        for (unsigned int i = 0;i < 2;++i)
+        {
+            m_LowerBounds[i] = 0.0;
+            m_UpperBounds[i] = 1.0;
+            m_MaximalSteps[i] = 0.0;
+            m_RelativeStopConditions[i] = false;
+        }
+
+        m_MaximumNumberOfIterations = 100;
+        m_StopCondition = 1.0e-4;
+    }
+
+    void SetBounds(unsigned int index, double minVal, double maxVal) {m_LowerBounds[index] = minVal; m_UpperBounds[index] = maxVal;}
+
+    //! Maximal absolute step of a parameter, steps being scaled down to fulfill it. 0 (default) means no limit
+    void SetMaximalStep(unsigned int index, double val) {m_MaximalSteps[index] = val;}
+
+    //! If true, the stop condition on a parameter change is relative to the parameter value
+    void SetRelativeStopCondition(unsigned int index, bool val) {m_RelativeStopConditions[index] = val;}
+
+    void SetMaximumNumberOfIterations(unsigned int val) {m_MaximumNumberOfIterations = val;}
+    //! Parameter change under which iterations stop
+    void SetStopCondition(double val) {m_StopCondition = val;}
+
+    /**
+     * Optimizes parameters from their initial values, returns the final residual. Thread safe, all problem data being held by callables:
+     * - computeResidual(const double *parameters) returns the residual at parameters, possibly caching data for that evaluation
+     * - acceptEvaluation() is called when the last evaluated parameters are accepted as the current ones
+     * - computeNormalEquations(const double *parameters, double *jtj, double *jtr) computes at the current parameters
+     * J^T J (as [0,0], [0,1], [1,1] entries) and J^T r, and returns false if the Jacobian cannot be computed
+     */
+    template <class ResidualFunctionType, class AcceptFunctionType, class NormalEquationsFunctionType>
+    double Optimize(double *parameters, ResidualFunctionType &computeResidual, AcceptFunctionType &acceptEvaluation,
+                    NormalEquationsFunctionType &computeNormalEquations) const
+    {
+        for (unsigned int i = 0;i < 2;++i)
+            parameters[i] = std::max(m_LowerBounds[i], std::min(parameters[i], m_UpperBounds[i]));
+
+        double residual = computeResidual(parameters);
+        acceptEvaluation();
+
+        double lambda = 1.0e-3;
+        double jtj[3], jtr[2];
+        double steps[2], trialParameters[2], changes[2];
+
+        for (unsigned int it = 0;it < m_MaximumNumberOfIterations;++it)
+        {
+            if (!computeNormalEquations(parameters, jtj, jtr))
+                break;
+
+            double diagonalFloor = 1.0e-6 * (jtj[0] + jtj[2]);
+
+            bool acceptedStep = false;
+            while (!acceptedStep && (lambda < 1.0e10))
+            {
+                double firstDiagonal = jtj[0] + lambda * std::max(jtj[0], diagonalFloor);
+                double secondDiagonal = jtj[2] + lambda * std::max(jtj[2], diagonalFloor);
+                double determinant = firstDiagonal * secondDiagonal - jtj[1] * jtj[1];
+                if (determinant <= 0.0)
+                    break;
+
+                steps[0] = - (secondDiagonal * jtr[0] - jtj[1] * jtr[1]) / determinant;
+                steps[1] = - (firstDiagonal * jtr[1] - jtj[1] * jtr[0]) / determinant;
+
+                bool blocked[2];
+                for (unsigned int i = 0;i < 2;++i)
+                    blocked[i] = ((parameters[i] >= m_UpperBounds[i]) && (steps[i] > 0.0)) ||
+                            ((parameters[i] <= m_LowerBounds[i]) && (steps[i] < 0.0));
+
+                if (blocked[1] && !blocked[0])
+                {
+                    steps[0] = - jtr[0] / firstDiagonal;
+                    steps[1] = 0.0;
+                }
+                else if (blocked[0] && !blocked[1])
+                {
+                    steps[0] = 0.0;
+                    steps[1] = - jtr[1] / secondDiagonal;
+                }
+
+                double stepScale = 1.0;
+                for (unsigned int i = 0;i < 2;++i)
+                {
+                    if ((m_MaximalSteps[i] > 0.0) && (std::abs(steps[i]) * stepScale > m_MaximalSteps[i]))
+                        stepScale = m_MaximalSteps[i] / std::abs(steps[i]);
+                }
+
+                bool unchangedParameters = true;
+                for (unsigned int i = 0;i < 2;++i)
+                {
+                    trialParameters[i] = parameters[i] + stepScale * steps[i];
+                    trialParameters[i] = std::max(m_LowerBounds[i], std::min(trialParameters[i], m_UpperBounds[i]));
+                    if (trialParameters[i] != parameters[i])
+                        unchangedParameters = false;
+                }
+
+                if (unchangedParameters)
+                    break;
+
+                double trialResidual = computeResidual(trialParameters);
+                if (trialResidual < residual)
+                {
+                    for (unsigned int i = 0;i < 2;++i)
+                    {
+                        changes[i] = trialParameters[i] - parameters[i];
+                        parameters[i] = trialParameters[i];
+                    }
+
+                    residual = trialResidual;
+                    acceptEvaluation();
+
+                    lambda = std::max(lambda / 10.0, 1.0e-10);
+                    acceptedStep = true;
+                }
+                else
+                    lambda *= 10.0;
+            }
+
+            if (!acceptedStep)
+                break;
+
+            bool converged = true;
+            for (unsigned int i = 0;i < 2;++i)
+            {
+                double threshold = m_RelativeStopConditions[i] ? m_StopCondition * std::abs(parameters[i]) : m_StopCondition;
+                if (std::abs(changes[i]) >= threshold)
+                    converged = false;
+            }
+
+            if (converged)
+                break;
+        }
+
+        return residual;
+    }
+
+private:
+    double m_LowerBounds[2], m_UpperBounds[2];
+    double m_MaximalSteps[2];
+    bool m_RelativeStopConditions[2];
+
+    unsigned int m_MaximumNumberOfIterations;
+    double m_StopCondition;
+};
+
+} // end namespace anima
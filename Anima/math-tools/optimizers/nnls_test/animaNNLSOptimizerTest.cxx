@@ -2,6 +2,60 @@
 #include <itkTimeProbe.h>
 #include <iostream>
 #include <fstream>
+#include <random>
+#include <cmath>
+#include <algorithm>
+#include <limits>
+
+/**
+ * Checks the optimality of NNLS solution column k: returns the largest violation of the KKT conditions
+ * (gradient A^T (Ax - b) null on positive weights, non negative on null weights), relative to ||A|| (||A|| ||x|| + ||b||),
+ * and sets the residual norm ||Ax - b||.
+ */
+double computeKKTViolation(const anima::NNLSOptimizer::MatrixType &dataMatrix, const anima::NNLSOptimizer::MatrixType &rightHandSides,
+                           const anima::NNLSOptimizer::MatrixType &solutions, unsigned int k, double &residualNorm)
+{
+    unsigned int numEquations = dataMatrix.rows();
+    unsigned int numAtoms = dataMatrix.cols();
+
+    std::vector <double> residuals(numEquations);
+    residualNorm = 0;
+    double rhsNorm = 0;
+    for (unsigned int i = 0;i < numEquations;++i)
+    {
+        residuals[i] = - rightHandSides(i,k);
+        for (unsigned int j = 0;j < numAtoms;++j)
+            residuals[i] += dataMatrix(i,j) * solutions(j,k);
+
+        residualNorm += residuals[i] * residuals[i];
+        rhsNorm += rightHandSides(i,k) * rightHandSides(i,k);
+    }
+
+    residualNorm = std::sqrt(residualNorm);
+    rhsNorm = std::sqrt(rhsNorm);
+
+    double dataNorm = dataMatrix.frobenius_norm();
+    double solutionNorm = solutions.get_column(k).two_norm();
+    double scale = dataNorm * (dataNorm * solutionNorm + rhsNorm);
+    if (scale <= 0)
+        scale = 1.0;
+
+    double maxViolation = 0;
+    for (unsigned int j = 0;j < numAtoms;++j)
+    {
+        if (solutions(j,k) < 0)
+            return std::numeric_limits <double>::max();
+
+        double gradientValue = 0;
+        for (unsigned int i = 0;i < numEquations;++i)
+            gradientValue += dataMatrix(i,j) * residuals[i];
+
+        double violation = (solutions(j,k) > 0) ? std::abs(gradientValue) : std::max(0.0,- gradientValue);
+        maxViolation = std::max(maxViolation,violation / scale);
+    }
+
+    return maxViolation;
+}
 
 int main()
 {
@@ -44,5 +98,92 @@ int main()
     std::cout << "Computation time: " << tmpTime.GetTotal() << std::endl;
     std::cout << optTest->GetCurrentPosition() << std::endl;
 
+    // Batched solve with cached factorizations against one QR-based solve per right hand side
+    unsigned int numEquations = 72;
+    unsigned int numAtoms = 40;
+    unsigned int numProblems = 2000;
+
+    std::mt19937 generator(42);
+    std::uniform_real_distribution <double> uniformDistribution(0.0,1.0);
+    std::uniform_int_distribution <unsigned int> atomDistribution(0,numAtoms - 1);
+
+    OptimizerType::MatrixType dictionary(numEquations,numAtoms);
+    for (unsigned int j = 0;j < numAtoms;++j)
+    {
+        double relaxationTime = 10.0 * (j + 1.0);
+        for (unsigned int i = 0;i < numEquations;++i)
+            dictionary(i,j) = std::exp(- 10.0 * (i + 1.0) / relaxationTime);
+    }
+
+    OptimizerType::MatrixType rightHandSides(numEquations,numProblems);
+    std::vector <double> atomWeights(numAtoms);
+    for (unsigned int k = 0;k < numProblems;++k)
+    {
+        std::fill(atomWeights.begin(),atomWeights.end(),0.0);
+        for (unsigned int l = 0;l < 3;++l)
+            atomWeights[atomDistribution(generator)] = uniformDistribution(generator);
+
+        for (unsigned int i = 0;i < numEquations;++i)
+        {
+            double signalValue = 0.01 * (uniformDistribution(generator) - 0.5);
+            for (unsigned int j = 0;j < numAtoms;++j)
+                signalValue += dictionary(i,j) * atomWeights[j];
+
+            rightHandSides(i,k) = signalValue;
+        }
+    }
+
+    OptimizerType::Pointer batchOptimizer = OptimizerType::New();
+    batchOptimizer->SetDataMatrix(dictionary);
+
+    OptimizerType::MatrixType referenceSolutions(numAtoms,numProblems);
+    OptimizerType::ParametersType problemPoints(numEquations);
+
+    itk::TimeProbe referenceTime;
+    referenceTime.Start();
+    for (unsigned int k = 0;k < numProblems;++k)
+    {
+        for (unsigned int i = 0;i < numEquations;++i)
+            problemPoints[i] = rightHandSides(i,k);
+
+        batchOptimizer->SetPoints(problemPoints);
+        batchOptimizer->StartOptimization();
+        referenceSolutions.set_column(k,batchOptimizer->GetCurrentPosition());
+    }
+    referenceTime.Stop();
+
+    OptimizerType::MatrixType batchSolutions;
+    itk::TimeProbe batchTime;
+    batchTime.Start();
+    batchOptimizer->SolveBatch(rightHandSides,batchSolutions);
+    batchTime.Stop();
+
+    // The dictionary is ill-conditioned (and squared by normal equations), solutions themselves may thus differ
+    // while being equally optimal: compare residual norms and check KKT conditions instead
+    double maxResidualGap = 0;
+    double maxKKTViolation = 0;
+    double maxReferenceKKTViolation = 0;
+    for (unsigned int k = 0;k < numProblems;++k)
+    {
+        double referenceResidual, batchResidual;
+        maxReferenceKKTViolation = std::max(maxReferenceKKTViolation,computeKKTViolation(dictionary,rightHandSides,referenceSolutions,k,referenceResidual));
+        maxKKTViolation = std::max(maxKKTViolation,computeKKTViolation(dictionary,rightHandSides,batchSolutions,k,batchResidual));
+
+        double rhsNorm = rightHandSides.get_column(k).two_norm();
+        if (rhsNorm > 0)
+            maxResidualGap = std::max(maxResidualGap,std::abs(batchResidual - referenceResidual) / rhsNorm);
+    }
+
+    std::cout << "Per problem QR solve time: " << referenceTime.GetTotal() << ", batched solve time: " << batchTime.GetTotal() << std::endl;
+    std::cout << "Maximal relative residual gap: " << maxResidualGap << ", maximal KKT violation (batch): " << maxKKTViolation
+              << ", (QR): " << maxReferenceKKTViolation << std::endl;
+
+    const double tolerance = 1.0e-10;
+    if ((maxResidualGap > tolerance)||(maxKKTViolation > tolerance)||(maxReferenceKKTViolation > tolerance))
+    {
+        std::cerr << "Batched or reference NNLS solutions are not optimal" << std::endl;
+        return EXIT_FAILURE;
+    }
+
     return EXIT_SUCCESS;
 }
@@ -0,0 +1,428 @@
+#include <animaFastSpecialFunctions.h>
+#include <animaErrorFunctions.h>
+#include <animaBesselFunctions.h>
+
+#include <boost/math/special_functions/bessel.hpp>
+#include <boost/math/special_functions/hypergeometric_1F1.hpp>
+
+namespace anima
+{
+
+PiecewiseChebyshevTable::PiecewiseChebyshevTable()
+{
+    m_MinimumValue = 0;
+    m_MaximumValue = 0;
+    m_IntervalLength = 1.0;
+    m_NumberOfIntervals = 0;
+    m_Degree = 0;
+    m_MaximumError = 0;
+}
+
+double PiecewiseChebyshevTable::Evaluate(double x) const
+{
+    double position = (x - m_MinimumValue) / m_IntervalLength;
+    unsigned int interval = std::min(static_cast <unsigned int> (std::max(position, 0.0)), m_NumberOfIntervals - 1);
+    double t = 2.0 * (position - interval) - 1.0;
+
+    // Clenshaw recurrence
+    const double *coefficients = m_Coefficients.data() + interval * (m_Degree + 1);
+    double b1 = 0;
+    double b2 = 0;
+    for (unsigned int k = m_Degree;k > 0;--k)
+    {
+        double tmpValue = 2.0 * t * b1 - b2 + coefficients[k];
+        b2 = b1;
+        b1 = tmpValue;
+    }
+
+    return t * b1 - b2 + coefficients[0];
+}
+
+void PiecewiseChebyshevTable::Evaluate(const double *x, double *values, unsigned int numValues) const
+{
+    for (unsigned int i = 0;i < numValues;++i)
+        values[i] = this->Evaluate(x[i]);
+}
+
+namespace
+{
+
+// Dawson function divided by x, tabulated on [0, dawsonTableMaximum]
+const double dawsonTableMaximum = 16.0;
+
+double ReferenceScaledDawsonFunction(double x)
+{
+    if (x < 1.0e-3)
+    {
+        double x2 = x * x;
+        return 1.0 - 2.0 * x2 / 3.0 + 4.0 * x2 * x2 / 15.0;
+    }
+
+    return anima::EvaluateDawsonFunction(x) / x;
+}
+
+const PiecewiseChebyshevTable &GetScaledDawsonTable()
+{
+    static const PiecewiseChebyshevTable dawsonTable = []
+    {
+        PiecewiseChebyshevTable table;
+        table.Build(ReferenceScaledDawsonFunction, 0.0, dawsonTableMaximum, 64, 12);
+        return table;
+    }();
+
+    return dawsonTable;
+}
+
+double ScaledDawsonFunction(double x)
+{
+    x = std::abs(x);
+    if (x <= dawsonTableMaximum)
+        return GetScaledDawsonTable().Evaluate(x);
+
+    // Asymptotic expansion D(x) = 1 / (2x) sum_n (2n-1)!! / (2x^2)^n
+    double invTwoXSquare = 1.0 / (2.0 * x * x);
+    double termValue = 1.0;
+    double sumValue = 1.0;
+    for (unsigned int n = 1;n <= 6;++n)
+    {
+        termValue *= (2.0 * n - 1.0) * invTwoXSquare;
+        sumValue += termValue;
+    }
+
+    return invTwoXSquare * sumValue;
+}
+
+// Bessel functions tabulated on [0, besselTableMaximum]: log(I_N(x)) - N log(x/2) + log(N!) which is smooth and null at 0,
+// and I_N(x) / I_{N-1}(x)
+const double besselTableMaximum = 100.0;
+
+const std::vector <PiecewiseChebyshevTable> &GetLogBesselTables()
+{
+    static const std::vector <PiecewiseChebyshevTable> logBesselTables = []
+    {
+        std::vector <PiecewiseChebyshevTable> tables(MaximumFastBesselOrder + 1);
+        for (unsigned int n = 0;n <= MaximumFastBesselOrder;++n)
+        {
+            auto referenceFunction = [n] (double x)
+            {
+                if (x < 1.0e-8)
+                    return 0.0;
+
+                return std::log(boost::math::cyl_bessel_i(n,x)) - n * std::log(x / 2.0) + std::lgamma(n + 1.0);
+            };
+
+            tables[n].Build(referenceFunction, 0.0, besselTableMaximum, 64, 14);
+        }
+
+        return tables;
+    }();
+
+    return logBesselTables;
+}
+
+const std::vector <PiecewiseChebyshevTable> &GetBesselRatioTables()
+{
+    static const std::vector <PiecewiseChebyshevTable> besselRatioTables = []
+    {
+        std::vector <PiecewiseChebyshevTable> tables(MaximumFastBesselOrder + 1);
+        for (unsigned int n = 1;n <= MaximumFastBesselOrder;++n)
+        {
+            auto referenceFunction = [n] (double x)
+            {
+                if (x < 1.0e-8)
+                    return x / (2.0 * n);
+
+                return boost::math::cyl_bessel_i(n,x) / boost::math::cyl_bessel_i(n - 1,x);
+            };
+
+            tables[n].Build(referenceFunction, 0.0, besselTableMaximum, 64, 14);
+        }
+
+        return tables;
+    }();
+
+    return besselRatioTables;
+}
+
+//! Large argument expansion of log(I_N(x)), accurate to machine precision for x above besselTableMaximum and N <= 10
+double AsymptoticLogBesselI(unsigned int N, double x)
+{
+    double muValue = 4.0 * N * N;
+    double termValue = 1.0;
+    double sumValue = 1.0;
+    for (unsigned int k = 1;k <= 30;++k)
+    {
+        double nextTermValue = - termValue * (muValue - (2.0 * k - 1.0) * (2.0 * k - 1.0)) / (8.0 * k * x);
+        if (std::abs(nextTermValue) >= std::abs(termValue))
+            break;
+
+        termValue = nextTermValue;
+        sumValue += termValue;
+
+        if (std::abs(termValue) < 1.0e-17 * std::abs(sumValue))
+            break;
+    }
+
+    return x - 0.5 * std::log(2.0 * M_PI * x) + std::log(sumValue);
+}
+
+// Watson sampling: the absolute cosine s to the mean axis has a density proportional to exp(kappa s^2) on [0,1]. Its
+// quantiles are tabulated against v = -log(u), u in (0,1], s solving ds/dv = -D(sqrt(kappa) s) / sqrt(kappa) with s(0) = 1
+// (D Dawson function). Tables store (1 + kappa) (1 - s^2), which is smooth in kappa and tends to v for large kappa
+const double watsonTableMaximumV = 20.0;
+const unsigned int watsonTableNumberOfIntervals = 1280;
+const double watsonTableMinimumLogKappa = -2.0;
+const double watsonTableMaximumLogKappa = 3.0;
+const unsigned int watsonTableNodesPerDecade = 32;
+
+class WatsonCosineQuantileTable
+{
+public:
+    WatsonCosineQuantileTable()
+    {
+        m_NumberOfLogNodes = (watsonTableMaximumLogKappa - watsonTableMinimumLogKappa) * watsonTableNodesPerDecade + 1;
+        m_MinimumKappa = std::pow(10.0, watsonTableMinimumLogKappa);
+        m_MaximumKappa = std::pow(10.0, watsonTableMaximumLogKappa);
+        m_IntervalLength = watsonTableMaximumV / watsonTableNumberOfIntervals;
+
+        // Nodes are kappa = 0, logarithmic nodes and kappa = infinity
+        m_NodeKappas.resize(m_NumberOfLogNodes + 1);
+        m_NodeKappas[0] = 0;
+        for (unsigned int i = 1;i <= m_NumberOfLogNodes;++i)
+            m_NodeKappas[i] = std::pow(10.0, watsonTableMinimumLogKappa + (i - 1.0) / watsonTableNodesPerDecade);
+
+        unsigned int numValues = watsonTableNumberOfIntervals + 1;
+        m_Values.resize((m_NumberOfLogNodes + 2) * numValues);
+
+        // Runge-Kutta integration, with substeps in between table values
+        const unsigned int numSubSteps = 2;
+        double stepLength = m_IntervalLength / numSubSteps;
+        for (unsigned int i = 0;i <= m_NumberOfLogNodes;++i)
+        {
+            double sqrtKappa = std::sqrt(m_NodeKappas[i]);
+            auto derivative = [sqrtKappa] (double s)
+            {
+                return - s * ScaledDawsonFunction(sqrtKappa * s);
+            };
+
+            double *nodeValues = m_Values.data() + i * numValues;
+            double s = 1.0;
+            nodeValues[0] = 0;
+            for (unsigned int j = 1;j < numValues;++j)
+            {
+                for (unsigned int k = 0;k < numSubSteps;++k)
+                {
+                    double k1 = derivative(s);
+                    double k2 = derivative(s + 0.5 * stepLength * k1);
+                    double k3 = derivative(s + 0.5 * stepLength * k2);
+                    double k4 = derivative(s + stepLength * k3);
+                    s = std::max(s + stepLength * (k1 + 2.0 * k2 + 2.0 * k3 + k4) / 6.0, 0.0);
+                }
+
+                nodeValues[j] = (1.0 + m_NodeKappas[i]) * (1.0 - s * s);
+            }
+        }
+
+        // Infinite kappa: kappa (1 - s^2) is exponentially distributed
+        double *nodeValues = m_Values.data() + (m_NumberOfLogNodes + 1) * numValues;
+        for (unsigned int j = 0;j < numValues;++j)
+            nodeValues[j] = j * m_IntervalLength;
+    }
+
+    double Evaluate(double kappa, double u) const
+    {
+        double position = std::min(- std::log(u), watsonTableMaximumV) / m_IntervalLength;
+        unsigned int interval = std::min(static_cast <unsigned int> (position), watsonTableNumberOfIntervals - 1);
+        double weight = position - interval;
+
+        // Quadratic interpolation in kappa in between logarithmic nodes, linear in kappa (resp. 1 / kappa) below (resp. above)
+        unsigned int firstNode;
+        double nodeWeights[3] = {0.0, 0.0, 0.0};
+        if (kappa <= m_MinimumKappa)
+        {
+            firstNode = 0;
+            nodeWeights[1] = kappa / m_MinimumKappa;
+            nodeWeights[0] = 1.0 - nodeWeights[1];
+        }
+        else if (kappa >= m_MaximumKappa)
+        {
+            firstNode = m_NumberOfLogNodes;
+            nodeWeights[0] = m_MaximumKappa / kappa;
+            nodeWeights[1] = 1.0 - nodeWeights[0];
+        }
+        else
+        {
+            double nodePosition = (std::log10(kappa) - watsonTableMinimumLogKappa) * watsonTableNodesPerDecade;
+            firstNode = 1 + std::min(static_cast <unsigned int> (std::max(nodePosition - 0.5, 0.0)), m_NumberOfLogNodes - 3);
+
+            // Lagrange weights in kappa reproduce the 1 + kappa factor exactly, keeping s = 0 reachable
+            const double *nodeKappas = m_NodeKappas.data() + firstNode;
+            for (unsigned int i = 0;i < 3;++i)
+            {
+                nodeWeights[i] = 1.0;
+                for (unsigned int j = 0;j < 3;++j)
+                {
+                    if (j != i)
+                        nodeWeights[i] *= (kappa - nodeKappas[j]) / (nodeKappas[i] - nodeKappas[j]);
+                }
+            }
+        }
+
+        unsigned int numValues = watsonTableNumberOfIntervals + 1;
+        const double *nodeValues = m_Values.data() + firstNode * numValues + interval;
+        double tableValue = 0;
+        for (unsigned int i = 0;i < 3;++i)
+        {
+            if (nodeWeights[i] != 0)
+                tableValue += nodeWeights[i] * ((1.0 - weight) * nodeValues[i * numValues] + weight * nodeValues[i * numValues + 1]);
+        }
+
+        double squaredCosine = 1.0 - tableValue / (1.0 + kappa);
+        return std::sqrt(std::min(std::max(squaredCosine, 0.0), 1.0));
+    }
+
+private:
+    unsigned int m_NumberOfLogNodes;
+    double m_MinimumKappa, m_MaximumKappa;
+    double m_IntervalLength;
+    std::vector <double> m_NodeKappas;
+
+    // Table values for each kappa node, then each v
+    std::vector <double> m_Values;
+};
+
+const WatsonCosineQuantileTable &GetWatsonCosineQuantileTable()
+{
+    static const WatsonCosineQuantileTable watsonTable;
+    return watsonTable;
+}
+
+} // end of anonymous namespace
+
+double FastEvaluateDawsonIntegral(const double x, const bool scaled)
+{
+    double scaledValue = ScaledDawsonFunction(x);
+    return (scaled) ? scaledValue : x * scaledValue;
+}
+
+void FastEvaluateDawsonIntegral(const double *x, double *values, unsigned int numValues, const bool scaled)
+{
+    for (unsigned int i = 0;i < numValues;++i)
+        values[i] = FastEvaluateDawsonIntegral(x[i], scaled);
+}
+
+double FastEvaluateDawsonFunction(double x)
+{
+    return x * ScaledDawsonFunction(x);
+}
+
+double FastEvaluateWImFunction(double x)
+{
+    return 2.0 * x * ScaledDawsonFunction(x) / std::sqrt(M_PI);
+}
+
+double fast_log_bessel_i(unsigned int N, double x)
+{
+    if (N > MaximumFastBesselOrder)
+        return anima::log_bessel_i(N,x);
+
+    if (x > besselTableMaximum)
+        return AsymptoticLogBesselI(N,x);
+
+    double resVal = GetLogBesselTables()[N].Evaluate(x) - std::lgamma(N + 1.0);
+    if (N > 0)
+        resVal += N * std::log(x / 2.0);
+
+    return resVal;
+}
+
+void fast_log_bessel_i(unsigned int N, const double *x, double *values, unsigned int numValues)
+{
+    for (unsigned int i = 0;i < numValues;++i)
+        values[i] = fast_log_bessel_i(N,x[i]);
+}
+
+double fast_bessel_ratio_i(double x, unsigned int N)
+{
+    if (N == 0)
+        return 0;
+
+    if (N > MaximumFastBesselOrder)
+        return anima::bessel_ratio_i(x,N);
+
+    if (x > besselTableMaximum)
+        return std::exp(AsymptoticLogBesselI(N,x) - AsymptoticLogBesselI(N - 1,x));
+
+    return GetBesselRatioTables()[N].Evaluate(x);
+}
+
+void fast_bessel_ratio_i(const double *x, double *values, unsigned int numValues, unsigned int N)
+{
+    for (unsigned int i = 0;i < numValues;++i)
+        values[i] = fast_bessel_ratio_i(x[i],N);
+}
+
+NegativeKummerFunctionTable::NegativeKummerFunctionTable(double a, double b, double maxValue)
+{
+    m_AValue = a;
+    m_BValue = b;
+
+    auto referenceFunction = [a,b] (double x)
+    {
+        return boost::math::hypergeometric_1F1(a, b, -x);
+    };
+
+    m_Table.Build(referenceFunction, 0.0, maxValue, 64, 12);
+}
+
+double NegativeKummerFunctionTable::Evaluate(double x) const
+{
+    if (m_Table.IsInside(x))
+        return m_Table.Evaluate(x);
+
+    // Large argument expansion M(-x,a,b) = Gamma(b) / Gamma(b-a) x^{-a} sum_n (a)_n (a-b+1)_n / (n! x^n), neglecting
+    // the exponentially small term. The series is finite when a - b + 1 is a non positive integer (e.g. NODDI)
+    // Terms may first grow, summation stops at the smallest one afterwards
+    double termValue = 1.0;
+    double sumValue = 1.0;
+    bool decreasingTerms = false;
+    for (unsigned int n = 0;n < 100;++n)
+    {
+        double nextTermValue = termValue * (m_AValue + n) * (m_AValue - m_BValue + 1.0 + n) / ((n + 1.0) * x);
+        if (nextTermValue == 0)
+            break;
+
+        if (std::abs(nextTermValue) < std::abs(termValue))
+            decreasingTerms = true;
+        else if (decreasingTerms)
+            break;
+
+        termValue = nextTermValue;
+        sumValue += termValue;
+
+        if (std::abs(termValue) < 1.0e-17 * std::abs(sumValue))
+            break;
+    }
+
+    return std::exp(std::lgamma(m_BValue) - std::lgamma(m_BValue - m_AValue) - m_AValue * std::log(x)) * sumValue;
+}
+
+void NegativeKummerFunctionTable::Evaluate(const double *x, double *values, unsigned int numValues) const
+{
+    for (unsigned int i = 0;i < numValues;++i)
+        values[i] = this->Evaluate(x[i]);
+}
+
+double FastEvaluateWatsonCosineQuantile(double kappa, double u)
+{
+    return GetWatsonCosineQuantileTable().Evaluate(kappa,u);
+}
+
+void FastEvaluateWatsonCosineQuantile(double kappa, const double *u, double *values, unsigned int numValues)
+{
+    const WatsonCosineQuantileTable &watsonTable = GetWatsonCosineQuantileTable();
+    for (unsigned int i = 0;i < numValues;++i)
+        values[i] = watsonTable.Evaluate(kappa,u[i]);
+}
+
+} // end namespace anima
@@ -0,0 +1,111 @@
+#pragma once
+
+#include "AnimaSpecialFunctionsExport.h"
+#include <vector>
+
+namespace anima
+{
+
+/**
+ * @brief Piecewise Chebyshev approximation of a one dimensional function on [min,max], computed once from a reference
+ * implementation. Evaluation costs an interval lookup and a Clenshaw recurrence, whatever the cost of the reference.
+ * The maximum error is measured when building the table, between interpolation nodes. It is relative for values above one,
+ * absolute below.
+ */
+class ANIMASPECIALFUNCTIONS_EXPORT PiecewiseChebyshevTable
+{
+public:
+    PiecewiseChebyshevTable();
+
+    //! Tabulates function on [minValue,maxValue] using numIntervals Chebyshev series of a given degree
+    template <class FunctionType>
+    void Build(const FunctionType &function, double minValue, double maxValue, unsigned int numIntervals, unsigned int degree);
+
+    bool IsInside(double x) const {return (x >= m_MinimumValue) && (x <= m_MaximumValue);}
+
+    //! Evaluates the table at x, x has to be inside the tabulated range
+    double Evaluate(double x) const;
+
+    //! Evaluates the table at each value of x, all x being inside the tabulated range
+    void Evaluate(const double *x, double *values, unsigned int numValues) const;
+
+    double GetMaximumError() const {return m_MaximumError;}
+
+private:
+    double m_MinimumValue, m_MaximumValue;
+    double m_IntervalLength;
+    unsigned int m_NumberOfIntervals, m_Degree;
+
+    std::vector <double> m_Coefficients;
+    double m_MaximumError;
+};
+
+/**
+ * Fast versions of the special functions used in the compartment models inner loops. They are computed from tables
+ * built on first use (thread safe) from accurate references (boost or Numerical Recipes) over the ranges used in Anima,
+ * with large argument expansions outside. Maximum errors are below 1e-12 (relative above one, absolute below) on all
+ * arguments, see fast_special_functions_test for the comparison to current and reference implementations.
+ */
+
+//! Fast version of EvaluateDawsonIntegral: Dawson function D(x) or D(x) / x if scaled
+ANIMASPECIALFUNCTIONS_EXPORT double FastEvaluateDawsonIntegral(const double x, const bool scaled = false);
+
+//! Array version of FastEvaluateDawsonIntegral
+ANIMASPECIALFUNCTIONS_EXPORT void FastEvaluateDawsonIntegral(const double *x, double *values, unsigned int numValues, const bool scaled = false);
+
+//! Fast version of EvaluateDawsonFunction
+ANIMASPECIALFUNCTIONS_EXPORT double FastEvaluateDawsonFunction(double x);
+
+//! Fast version of EvaluateWImFunction
+ANIMASPECIALFUNCTIONS_EXPORT double FastEvaluateWImFunction(double x);
+
+//! Maximal order of tabulated Bessel functions, higher orders call the reference implementations
+const unsigned int MaximumFastBesselOrder = 10;
+
+//! Fast version of log_bessel_i: log of modified Bessel function of the first kind I_{N} (N >= 0)
+ANIMASPECIALFUNCTIONS_EXPORT double fast_log_bessel_i(unsigned int N, double x);
+
+//! Array version of fast_log_bessel_i
+ANIMASPECIALFUNCTIONS_EXPORT void fast_log_bessel_i(unsigned int N, const double *x, double *values, unsigned int numValues);
+
+//! Fast version of bessel_ratio_i: ratio of modified Bessel functions of the first kind I_{N} / I_{N-1} (N >= 1)
+ANIMASPECIALFUNCTIONS_EXPORT double fast_bessel_ratio_i(double x, unsigned int N);
+
+//! Array version of fast_bessel_ratio_i
+ANIMASPECIALFUNCTIONS_EXPORT void fast_bessel_ratio_i(const double *x, double *values, unsigned int numValues, unsigned int N);
+
+/**
+ * @brief Table of the Kummer function x -> M(-x, a, b) for fixed a and b (b > a > 0) and x in [0, maxValue].
+ * Above maxValue, the large argument expansion is used. Meant to be built once (e.g. static) for the (a,b) pairs of a model.
+ */
+class ANIMASPECIALFUNCTIONS_EXPORT NegativeKummerFunctionTable
+{
+public:
+    NegativeKummerFunctionTable(double a, double b, double maxValue = 50.0);
+
+    //! Returns M(-x, a, b) for x >= 0
+    double Evaluate(double x) const;
+
+    //! Array version of Evaluate
+    void Evaluate(const double *x, double *values, unsigned int numValues) const;
+
+    double GetMaximumError() const {return m_Table.GetMaximumError();}
+
+private:
+    double m_AValue, m_BValue;
+    PiecewiseChebyshevTable m_Table;
+};
+
+/**
+ * Quantile function of the absolute cosine to the mean axis of a Watson distribution with concentration kappa >= 0, for u
+ * in (0,1]. Used for Watson sampling at a cost independent of kappa. It is tabulated on first use (thread safe) over
+ * concentrations and -log(u), the maximum error on the cumulative distribution being about 1e-4.
+ */
+ANIMASPECIALFUNCTIONS_EXPORT double FastEvaluateWatsonCosineQuantile(double kappa, double u);
+
+//! Array version of FastEvaluateWatsonCosineQuantile, all values sharing the same kappa
+ANIMASPECIALFUNCTIONS_EXPORT void FastEvaluateWatsonCosineQuantile(double kappa, const double *u, double *values, unsigned int numValues);
+
+} // end namespace anima
+
+#include "animaFastSpecialFunctions.hxx"
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "animaFastSpecialFunctions.h"
+#include <cmath>
+#include <algorithm>
+
+namespace anima
+{
+
+template <class FunctionType>
+void
+PiecewiseChebyshevTable::Build(const FunctionType &function, double minValue, double maxValue,
+                               unsigned int numIntervals, unsigned int degree)
+{
+    m_MinimumValue = minValue;
+    m_MaximumValue = maxValue;
+    m_NumberOfIntervals = numIntervals;
+    m_Degree = degree;
+    m_IntervalLength = (maxValue - minValue) / numIntervals;
+
+    unsigned int numNodes = degree + 1;
+    m_Coefficients.resize(numIntervals * numNodes);
+    std::vector <double> nodeValues(numNodes);
+
+    for (unsigned int i = 0;i < numIntervals;++i)
+    {
+        double intervalCenter = minValue + (i + 0.5) * m_IntervalLength;
+
+        for (unsigned int j = 0;j < numNodes;++j)
+        {
+            double nodePosition = std::cos(M_PI * (j + 0.5) / numNodes);
+            nodeValues[j] = function(intervalCenter + 0.5 * m_IntervalLength * nodePosition);
+        }
+
+        double *intervalCoefficients = m_Coefficients.data() + i * numNodes;
+        for (unsigned int k = 0;k < numNodes;++k)
+        {
+            double coefficientValue = 0;
+            for (unsigned int j = 0;j < numNodes;++j)
+                coefficientValue += nodeValues[j] * std::cos(M_PI * k * (j + 0.5) / numNodes);
+
+            intervalCoefficients[k] = 2.0 * coefficientValue / numNodes;
+        }
+
+        intervalCoefficients[0] /= 2.0;
+    }
+
+    // Measure error between nodes
+    m_MaximumError = 0;
+    const unsigned int numCheckPoints = 2 * numNodes;
+    for (unsigned int i = 0;i < numIntervals;++i)
+    {
+        for (unsigned int j = 0;j < numCheckPoints;++j)
+        {
+            double x = minValue + (i + (j + 0.5) / numCheckPoints) * m_IntervalLength;
+            double referenceValue = function(x);
+            double errorValue = std::abs(this->Evaluate(x) - referenceValue) / std::max(1.0, std::abs(referenceValue));
+            m_MaximumError = std::max(m_MaximumError, errorValue);
+        }
+    }
+}
+
+} // end namespace anima
@@ -0,0 +1,204 @@
+#include <animaFastSpecialFunctions.h>
+#include <animaErrorFunctions.h>
+#include <animaBesselFunctions.h>
+#include <animaKummerFunctions.h>
+
+#include <boost/math/special_functions/bessel.hpp>
+#include <boost/math/special_functions/hypergeometric_1F1.hpp>
+#include <boost/math/quadrature/gauss_kronrod.hpp>
+
+#include <itkTimeProbe.h>
+#include <iostream>
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+//! Relative error for values above one, absolute below
+double computeError(double value, double referenceValue)
+{
+    return std::abs(value - referenceValue) / std::max(1.0, std::abs(referenceValue));
+}
+
+//! Dawson function from adaptive quadrature of D(x) = int_0^x exp(-u (2x - u)) du, independent of the Faddeeva based implementations.
+//! The integrand being below exp(-u x), it is negligible beyond u = 40 / x
+double computeReferenceDawsonFunction(double x)
+{
+    if (x <= 0)
+        return 0;
+
+    auto integrand = [x](double u) {return std::exp(- u * (2.0 * x - u));};
+    return boost::math::quadrature::gauss_kronrod<double, 61>::integrate(integrand, 0.0, std::min(x, 40.0 / x), 15, 1.0e-14);
+}
+
+//! Prints errors to current and accurate implementations, returns false if one of them is above its tolerance
+bool checkErrors(const std::string &name, double currentError, double currentTolerance, double referenceError, double referenceTolerance)
+{
+    std::cout << name << ": max error to current implementation " << currentError << ", to reference " << referenceError << std::endl;
+
+    if ((currentError > currentTolerance) || (referenceError > referenceTolerance))
+    {
+        std::cerr << "Error above tolerance for " << name << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+int main()
+{
+    bool testOk = true;
+
+    // Tolerance with respect to accurate references (boost functions or quadratures)
+    const double referenceTolerance = 1.0e-12;
+
+    // Dawson function
+    std::vector <double> xValues;
+    for (double x = 0.0;x < 40.0;x += 1.0e-3)
+        xValues.push_back(x);
+
+    double currentError = 0;
+    double referenceError = 0;
+    double wImCurrentError = 0;
+    double wImReferenceError = 0;
+    double scaledCurrentError = 0;
+    double scaledReferenceError = 0;
+    for (unsigned int i = 0;i < xValues.size();++i)
+    {
+        double x = xValues[i];
+        double referenceDawsonValue = computeReferenceDawsonFunction(x);
+
+        double dawsonValue = anima::FastEvaluateDawsonFunction(x);
+        currentError = std::max(currentError, computeError(dawsonValue, anima::EvaluateDawsonFunction(x)));
+        referenceError = std::max(referenceError, computeError(dawsonValue, referenceDawsonValue));
+
+        double wImValue = anima::FastEvaluateWImFunction(x);
+        wImCurrentError = std::max(wImCurrentError, computeError(wImValue, anima::EvaluateWImFunction(x)));
+        wImReferenceError = std::max(wImReferenceError, computeError(wImValue, 2.0 * referenceDawsonValue / std::sqrt(M_PI)));
+
+        if (x > 0)
+        {
+            double scaledValue = anima::FastEvaluateDawsonIntegral(x,true);
+            scaledCurrentError = std::max(scaledCurrentError, computeError(scaledValue, anima::EvaluateDawsonIntegral(x,true)));
+            scaledReferenceError = std::max(scaledReferenceError, computeError(scaledValue, referenceDawsonValue / x));
+        }
+    }
+
+    testOk &= checkErrors("Dawson function", currentError, referenceTolerance, referenceError, referenceTolerance);
+    testOk &= checkErrors("WIm function", wImCurrentError, referenceTolerance, wImReferenceError, referenceTolerance);
+    // Current scaled Dawson integral uses a 15 points Gauss quadrature, accurate to about 1e-3
+    testOk &= checkErrors("Scaled Dawson integral", scaledCurrentError, 5.0e-3, scaledReferenceError, referenceTolerance);
+
+    std::vector <double> fastValues(xValues.size());
+    itk::TimeProbe currentTime, fastTime;
+    // Sums of current values are printed so that timed loops are not optimized out
+    double sumValues = 0;
+    currentTime.Start();
+    for (unsigned int i = 0;i < xValues.size();++i)
+        sumValues += anima::EvaluateDawsonIntegral(xValues[i],true);
+    currentTime.Stop();
+
+    fastTime.Start();
+    anima::FastEvaluateDawsonIntegral(xValues.data(), fastValues.data(), xValues.size(), true);
+    fastTime.Stop();
+
+    std::cout << "Scaled Dawson integral times: current " << currentTime.GetTotal() << ", fast " << fastTime.GetTotal() << " (sum of current values " << sumValues << ")" << std::endl;
+
+    // Bessel functions, table and large argument expansion
+    xValues.clear();
+    for (double x = 1.0e-4;x < 300.0;x += 1.0e-2)
+        xValues.push_back(x);
+
+    for (unsigned int n = 0;n <= anima::MaximumFastBesselOrder;++n)
+    {
+        double logCurrentError = 0;
+        double logReferenceError = 0;
+        double ratioCurrentError = 0;
+        double ratioReferenceError = 0;
+
+        for (unsigned int i = 0;i < xValues.size();++i)
+        {
+            double x = xValues[i];
+            double logValue = anima::fast_log_bessel_i(n,x);
+            logCurrentError = std::max(logCurrentError, computeError(logValue, anima::log_bessel_i(n,x)));
+            logReferenceError = std::max(logReferenceError, computeError(logValue, std::log(boost::math::cyl_bessel_i(n,x))));
+
+            if (n == 0)
+                continue;
+
+            double ratioValue = anima::fast_bessel_ratio_i(x,n);
+            ratioCurrentError = std::max(ratioCurrentError, computeError(ratioValue, anima::bessel_ratio_i(x,n)));
+            ratioReferenceError = std::max(ratioReferenceError,
+                                           computeError(ratioValue, boost::math::cyl_bessel_i(n,x) / boost::math::cyl_bessel_i(n - 1,x)));
+        }
+
+        // Current Bessel implementations are accurate to about 1e-5
+        testOk &= checkErrors("Log Bessel I order " + std::to_string(n), logCurrentError, 1.0e-4, logReferenceError, referenceTolerance);
+        if (n > 0)
+            testOk &= checkErrors("Bessel I ratio order " + std::to_string(n), ratioCurrentError, 5.0e-4, ratioReferenceError, referenceTolerance);
+    }
+
+    fastValues.resize(xValues.size());
+    currentTime.Reset();
+    fastTime.Reset();
+    sumValues = 0;
+    currentTime.Start();
+    for (unsigned int i = 0;i < xValues.size();++i)
+        sumValues += anima::log_bessel_i(3,xValues[i]);
+    currentTime.Stop();
+
+    fastTime.Start();
+    anima::fast_log_bessel_i(3, xValues.data(), fastValues.data(), xValues.size());
+    fastTime.Stop();
+
+    std::cout << "Log Bessel I times: current " << currentTime.GetTotal() << ", fast " << fastTime.GetTotal() << " (sum of current values " << sumValues << ")" << std::endl;
+
+    // Kummer functions for the parameters used in NODDI, boost references are computed below x = 60
+    xValues.clear();
+    for (double x = 0.0;x < 60.0;x += 1.0e-3)
+        xValues.push_back(x);
+
+    for (unsigned int n = 0;n < 7;++n)
+    {
+        for (unsigned int k = 0;k < 2;++k)
+        {
+            double aValue = n + 0.5 + k;
+            double bValue = 2.0 * n + 1.5 + k;
+            anima::NegativeKummerFunctionTable kummerTable(aValue,bValue);
+
+            double kummerCurrentError = 0;
+            double kummerReferenceError = 0;
+            for (unsigned int i = 0;i < xValues.size();++i)
+            {
+                double x = xValues[i];
+                double kummerValue = kummerTable.Evaluate(x);
+                kummerCurrentError = std::max(kummerCurrentError, computeError(kummerValue, anima::GetKummerFunctionValue(-x,aValue,bValue)));
+                kummerReferenceError = std::max(kummerReferenceError, computeError(kummerValue, boost::math::hypergeometric_1F1(aValue,bValue,-x)));
+            }
+
+            // Current Kummer implementation uses a 15 points Gauss quadrature, less accurate for large arguments
+            testOk &= checkErrors("Kummer function (" + std::to_string(aValue) + "," + std::to_string(bValue) + ")",
+                                  kummerCurrentError, 5.0e-2, kummerReferenceError, referenceTolerance);
+        }
+    }
+
+    anima::NegativeKummerFunctionTable kummerTable(3.5,7.5);
+    fastValues.resize(xValues.size());
+    currentTime.Reset();
+    fastTime.Reset();
+    sumValues = 0;
+    currentTime.Start();
+    for (unsigned int i = 0;i < xValues.size();++i)
+        sumValues += anima::GetKummerFunctionValue(-xValues[i],3.5,7.5);
+    currentTime.Stop();
+
+    fastTime.Start();
+    kummerTable.Evaluate(xValues.data(), fastValues.data(), xValues.size());
+    fastTime.Stop();
+
+    std::cout << "Kummer function times: current " << currentTime.GetTotal() << ", fast " << fastTime.GetTotal() << " (sum of current values " << sumValues << ")" << std::endl;
+
+    if (!testOk)
+        return EXIT_FAILURE;
+
+    return EXIT_SUCCESS;
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <random>
+#include <vector>
 #include <vnl/vnl_matrix.h>
 #include <vnl/vnl_vector_fixed.h>
 
@@ -50,6 +51,25 @@ template <class ScalarType, unsigned int DataDimension>
 void
 SampleFromWatsonDistribution(const ScalarType &kappa, const itk::Vector < ScalarType, DataDimension > &meanDirection, itk::Vector < ScalarType, DataDimension > &resVec, std::mt19937 &generator);
 
+//! Table based VMF sampling on the 2-sphere (closed form inverse CDF as in Wenzel 2012), rotated to the mean direction without trigonometric calls
+template <class VectorType, class ScalarType>
+void FastSampleFromVMFDistribution(const ScalarType &kappa, const VectorType &meanDirection, VectorType &resVec, std::mt19937 &generator);
+
+//! Draws numSamples VMF samples around the same mean direction, rotated all at once
+template <class VectorType, class ScalarType>
+void FastSampleFromVMFDistribution(const ScalarType &kappa, const VectorType &meanDirection, std::vector <VectorType> &resVecs,
+                                   unsigned int numSamples, std::mt19937 &generator);
+
+//! Watson sampling on the 2-sphere from tabulated quantiles (see FastEvaluateWatsonCosineQuantile), at a cost independent of kappa.
+//! Samples lie on the half sphere of the mean direction. Girdle distributions (kappa < 0) use SampleFromWatsonDistribution
+template <class ScalarType, class VectorType>
+void FastSampleFromWatsonDistribution(const ScalarType &kappa, const VectorType &meanDirection, VectorType &resVec, std::mt19937 &generator);
+
+//! Draws numSamples Watson samples around the same mean direction, rotated all at once
+template <class ScalarType, class VectorType>
+void FastSampleFromWatsonDistribution(const ScalarType &kappa, const VectorType &meanDirection, std::vector <VectorType> &resVecs,
+                                      unsigned int numSamples, std::mt19937 &generator);
+
 } // end of namespace anima
 
 #include "animaDistributionSampling.hxx"
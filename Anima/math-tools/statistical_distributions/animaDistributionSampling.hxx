@@ -2,12 +2,14 @@
 #include "animaDistributionSampling.h"
 
 #include <cmath>
+#include <algorithm>
 #include <boost/math/distributions/beta.hpp>
 
 #include <animaVectorOperations.h>
 #include <animaLogarithmFunctions.h>
 #include <animaBaseTensorTools.h>
 #include <animaMatrixOperations.h>
+#include <animaFastSpecialFunctions.h>
 
 #include <itkMacro.h>
 
@@ -371,4 +373,138 @@ SampleFromWatsonDistribution(const ScalarType &kappa, const itk::Vector < Scalar
     SampleFromWatsonDistribution(kappa, meanDirection, resVec, DataDimension, generator);
 }
 
+namespace internal
+{
+
+//! Checks that the mean direction of a distribution on the 2-sphere is of norm 1
+template <class VectorType>
+void CheckUnitMeanDirection(const VectorType &meanDirection, const std::string &distributionName)
+{
+    if (std::abs(anima::ComputeNorm(meanDirection) - 1.0) > 1.0e-6)
+        throw itk::ExceptionObject(__FILE__, __LINE__,distributionName + " sampling requires mean direction of norm 1.",ITK_LOCATION);
+}
+
+//! Completes unit vector direction into an orthonormal basis (firstAxis, secondAxis, direction), from Duff et al. 2017
+template <class VectorType>
+void GetOrthonormalBasisFromDirection(const VectorType &direction, double *firstAxis, double *secondAxis)
+{
+    double signValue = std::copysign(1.0, (double)direction[2]);
+    double a = -1.0 / (signValue + direction[2]);
+    double b = direction[0] * direction[1] * a;
+
+    firstAxis[0] = 1.0 + signValue * direction[0] * direction[0] * a;
+    firstAxis[1] = signValue * b;
+    firstAxis[2] = - signValue * direction[0];
+
+    secondAxis[0] = b;
+    secondAxis[1] = signValue + direction[1] * direction[1] * a;
+    secondAxis[2] = - direction[1];
+}
+
+//! Turns cosines to the mean direction and azimuth angles into samples, the basis around the mean direction being computed once
+template <class VectorType>
+void RotateSamplesToMeanDirection(const VectorType &meanDirection, const double *cosineValues, const double *angleValues,
+                                  VectorType *resVecs, unsigned int numSamples)
+{
+    double firstAxis[3], secondAxis[3], meanAxis[3];
+    GetOrthonormalBasisFromDirection(meanDirection,firstAxis,secondAxis);
+    for (unsigned int i = 0;i < 3;++i)
+        meanAxis[i] = meanDirection[i];
+
+    for (unsigned int i = 0;i < numSamples;++i)
+    {
+        double sinValue = std::sqrt(std::max(1.0 - cosineValues[i] * cosineValues[i], 0.0));
+        double xValue = sinValue * std::cos(angleValues[i]);
+        double yValue = sinValue * std::sin(angleValues[i]);
+
+        for (unsigned int j = 0;j < 3;++j)
+            resVecs[i][j] = xValue * firstAxis[j] + yValue * secondAxis[j] + cosineValues[i] * meanAxis[j];
+    }
+}
+
+//! Closed form inverse CDF of the cosine to the mean direction of a VMF distribution on the 2-sphere, u in (0,1]
+inline double ComputeVMFCosineQuantile(double kappa, double u)
+{
+    if (kappa < 1.0e-6)
+        return 2.0 * u - 1.0;
+
+    return std::max(1.0 + std::log(u + (1.0 - u) * std::exp(-2.0 * kappa)) / kappa, -1.0);
+}
+
+} // end of namespace internal
+
+template <class VectorType, class ScalarType>
+void FastSampleFromVMFDistribution(const ScalarType &kappa, const VectorType &meanDirection, VectorType &resVec, std::mt19937 &generator)
+{
+    internal::CheckUnitMeanDirection(meanDirection,"Von Mises & Fisher");
+
+    double cosineValue = internal::ComputeVMFCosineQuantile(kappa, 1.0 - SampleFromUniformDistribution(0.0, 1.0, generator));
+    double angleValue = SampleFromUniformDistribution(0.0, 2.0 * M_PI, generator);
+
+    internal::RotateSamplesToMeanDirection(meanDirection,&cosineValue,&angleValue,&resVec,1);
+}
+
+template <class VectorType, class ScalarType>
+void FastSampleFromVMFDistribution(const ScalarType &kappa, const VectorType &meanDirection, std::vector <VectorType> &resVecs,
+                                   unsigned int numSamples, std::mt19937 &generator)
+{
+    internal::CheckUnitMeanDirection(meanDirection,"Von Mises & Fisher");
+
+    std::uniform_real_distribution <double> uniDbl(0.0,1.0);
+    std::vector <double> cosineValues(numSamples), angleValues(numSamples);
+    for (unsigned int i = 0;i < numSamples;++i)
+        cosineValues[i] = internal::ComputeVMFCosineQuantile(kappa, 1.0 - uniDbl(generator));
+
+    for (unsigned int i = 0;i < numSamples;++i)
+        angleValues[i] = 2.0 * M_PI * uniDbl(generator);
+
+    resVecs.resize(numSamples);
+    internal::RotateSamplesToMeanDirection(meanDirection,cosineValues.data(),angleValues.data(),resVecs.data(),numSamples);
+}
+
+template <class ScalarType, class VectorType>
+void FastSampleFromWatsonDistribution(const ScalarType &kappa, const VectorType &meanDirection, VectorType &resVec, std::mt19937 &generator)
+{
+    if (kappa < 0)
+    {
+        SampleFromWatsonDistribution(kappa, meanDirection, resVec, 3, generator);
+        return;
+    }
+
+    internal::CheckUnitMeanDirection(meanDirection,"Watson");
+
+    double cosineValue = anima::FastEvaluateWatsonCosineQuantile(kappa, 1.0 - SampleFromUniformDistribution(0.0, 1.0, generator));
+    double angleValue = SampleFromUniformDistribution(0.0, 2.0 * M_PI, generator);
+
+    internal::RotateSamplesToMeanDirection(meanDirection,&cosineValue,&angleValue,&resVec,1);
+}
+
+template <class ScalarType, class VectorType>
+void FastSampleFromWatsonDistribution(const ScalarType &kappa, const VectorType &meanDirection, std::vector <VectorType> &resVecs,
+                                      unsigned int numSamples, std::mt19937 &generator)
+{
+    resVecs.resize(numSamples);
+    if (kappa < 0)
+    {
+        for (unsigned int i = 0;i < numSamples;++i)
+            SampleFromWatsonDistribution(kappa, meanDirection, resVecs[i], 3, generator);
+
+        return;
+    }
+
+    internal::CheckUnitMeanDirection(meanDirection,"Watson");
+
+    std::uniform_real_distribution <double> uniDbl(0.0,1.0);
+    std::vector <double> uValues(numSamples), cosineValues(numSamples), angleValues(numSamples);
+    for (unsigned int i = 0;i < numSamples;++i)
+        uValues[i] = 1.0 - uniDbl(generator);
+
+    anima::FastEvaluateWatsonCosineQuantile(kappa, uValues.data(), cosineValues.data(), numSamples);
+
+    for (unsigned int i = 0;i < numSamples;++i)
+        angleValues[i] = 2.0 * M_PI * uniDbl(generator);
+
+    internal::RotateSamplesToMeanDirection(meanDirection,cosineValues.data(),angleValues.data(),resVecs.data(),numSamples);
+}
+
 } // end of namespace anima
@@ -3,7 +3,7 @@
 
 #include "animaWatsonDistribution.h"
 #include <animaVectorOperations.h>
-#include <animaErrorFunctions.h>
+#include <animaFastSpecialFunctions.h>
 
 #include <itkMacro.h>
 #include <itkObjectFactory.h>
@@ -41,7 +41,7 @@ double EvaluateWatsonPDF(const VectorType &v, const VectorType &meanAxis, const
         double kappaSqrt = std::sqrt(kappa);
         double c = anima::ComputeScalarProduct(v, meanAxis);
         double inExp = kappa * (c * c - 1.0);
-        return kappaSqrt * std::exp(inExp) / (4.0 * M_PI * anima::EvaluateDawsonFunctionNR(kappaSqrt));
+        return kappaSqrt * std::exp(inExp) / (4.0 * M_PI * anima::FastEvaluateDawsonFunction(kappaSqrt));
     }
     else
     {
@@ -88,7 +88,7 @@ template <class ScalarType>
     derivatives.resize(nbCoefs);
     
     double sqrtPi = std::sqrt(M_PI);
-    double dawsonValue = anima::EvaluateDawsonIntegral(std::sqrt(k), true);
+    double dawsonValue = anima::FastEvaluateDawsonIntegral(std::sqrt(k), true);
     double k2 = k * k;
     double k3 = k2 * k;
     double k4 = k3 * k;
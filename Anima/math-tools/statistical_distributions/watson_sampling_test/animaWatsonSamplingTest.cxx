@@ -0,0 +1,176 @@
+#include <animaDistributionSampling.h>
+
+#include <itkTimeProbe.h>
+#include <itkVector.h>
+#include <iostream>
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include <functional>
+
+typedef itk::Vector <double,3> VectorType;
+typedef std::function <void (std::vector <VectorType> &)> SamplerType;
+
+//! Two samples Kolmogorov-Smirnov statistic
+double ComputeKSStatistic(std::vector <double> firstSample, std::vector <double> secondSample)
+{
+    std::sort(firstSample.begin(),firstSample.end());
+    std::sort(secondSample.begin(),secondSample.end());
+
+    unsigned int i = 0;
+    unsigned int j = 0;
+    double resVal = 0;
+    while ((i < firstSample.size()) && (j < secondSample.size()))
+    {
+        if (firstSample[i] <= secondSample[j])
+            ++i;
+        else
+            ++j;
+
+        resVal = std::max(resVal, std::abs((double)i / firstSample.size() - (double)j / secondSample.size()));
+    }
+
+    return resVal;
+}
+
+//! Compares distributions of the cosine to the mean direction and of the projection on a fixed axis, returns false if one of them differs.
+//! For axial distributions, samples are first flipped to the half sphere of the mean direction
+bool compareSamples(const std::string &name, const std::vector <VectorType> &samples, const std::vector <VectorType> &referenceSamples,
+                    const VectorType &meanDirection, bool axialDistribution)
+{
+    VectorType fixedAxis;
+    fixedAxis[0] = 0.6;
+    fixedAxis[1] = 0.0;
+    fixedAxis[2] = 0.8;
+
+    std::vector <double> cosineValues(samples.size()), projectionValues(samples.size());
+    std::vector <double> referenceCosineValues(referenceSamples.size()), referenceProjectionValues(referenceSamples.size());
+    for (unsigned int i = 0;i < samples.size();++i)
+    {
+        double signValue = (axialDistribution && (samples[i] * meanDirection < 0)) ? -1.0 : 1.0;
+        cosineValues[i] = signValue * (samples[i] * meanDirection);
+        projectionValues[i] = signValue * (samples[i] * fixedAxis);
+    }
+
+    for (unsigned int i = 0;i < referenceSamples.size();++i)
+    {
+        double signValue = (axialDistribution && (referenceSamples[i] * meanDirection < 0)) ? -1.0 : 1.0;
+        referenceCosineValues[i] = signValue * (referenceSamples[i] * meanDirection);
+        referenceProjectionValues[i] = signValue * (referenceSamples[i] * fixedAxis);
+    }
+
+    // Critical value at level 0.001
+    double criticalValue = 1.949 * std::sqrt((samples.size() + referenceSamples.size()) / ((double)samples.size() * referenceSamples.size()));
+    double cosineStatistic = ComputeKSStatistic(cosineValues,referenceCosineValues);
+    double projectionStatistic = ComputeKSStatistic(projectionValues,referenceProjectionValues);
+
+    std::cout << name << ": KS statistics " << cosineStatistic << " (cosine), " << projectionStatistic << " (projection), critical value " << criticalValue << std::endl;
+
+    if ((cosineStatistic > criticalValue) || (projectionStatistic > criticalValue))
+    {
+        std::cerr << "Sampled distribution differs from the reference for " << name << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+double runSampler(const SamplerType &sampler, std::vector <VectorType> &samples)
+{
+    itk::TimeProbe timer;
+    timer.Start();
+    sampler(samples);
+    timer.Stop();
+
+    return timer.GetTotal();
+}
+
+int main(int argc, char **argv)
+{
+    unsigned int numSamples = 100000;
+    if (argc > 1)
+        numSamples = std::stoi(argv[1]);
+
+    std::cout << "Comparing table based samplers to current samplers on " << numSamples << " samples" << std::endl;
+
+    bool testOk = true;
+    std::mt19937 generator(42);
+
+    std::vector <VectorType> meanDirections(2);
+    meanDirections[0][0] = 1.0;
+    meanDirections[0][1] = 2.0;
+    meanDirections[0][2] = 3.0;
+    meanDirections[0].Normalize();
+    // Current samplers are undefined for mean directions opposite to the z axis
+    meanDirections[1][0] = 0.1;
+    meanDirections[1][1] = -0.2;
+    meanDirections[1][2] = -1.0;
+    meanDirections[1].Normalize();
+
+    std::vector <double> kappaValues = {0.005, 0.5, 3.0, 30.0, 250.0, 2000.0};
+    std::vector <VectorType> referenceSamples, samples;
+    for (unsigned int i = 0;i < meanDirections.size();++i)
+    {
+        VectorType meanDirection = meanDirections[i];
+        for (double kappa : kappaValues)
+        {
+            std::cout << "Mean direction " << meanDirection << ", kappa " << kappa << std::endl;
+            std::string suffix = " (kappa " + std::to_string(kappa) + ")";
+
+            double referenceTime = runSampler([&] (std::vector <VectorType> &resVecs)
+            {
+                resVecs.resize(numSamples);
+                for (unsigned int j = 0;j < numSamples;++j)
+                    anima::SampleFromWatsonDistribution(kappa,meanDirection,resVecs[j],generator);
+            }, referenceSamples);
+
+            double fastTime = runSampler([&] (std::vector <VectorType> &resVecs)
+            {
+                resVecs.resize(numSamples);
+                for (unsigned int j = 0;j < numSamples;++j)
+                    anima::FastSampleFromWatsonDistribution(kappa,meanDirection,resVecs[j],generator);
+            }, samples);
+
+            testOk &= compareSamples("Watson fast sampler" + suffix, samples, referenceSamples, meanDirection, true);
+
+            double batchTime = runSampler([&] (std::vector <VectorType> &resVecs)
+            {
+                anima::FastSampleFromWatsonDistribution(kappa,meanDirection,resVecs,numSamples,generator);
+            }, samples);
+
+            testOk &= compareSamples("Watson batch sampler" + suffix, samples, referenceSamples, meanDirection, true);
+
+            std::cout << "Watson times: current " << referenceTime << "s, fast " << fastTime << "s, batch " << batchTime << "s" << std::endl;
+
+            referenceTime = runSampler([&] (std::vector <VectorType> &resVecs)
+            {
+                resVecs.resize(numSamples);
+                for (unsigned int j = 0;j < numSamples;++j)
+                    anima::SampleFromVMFDistributionNumericallyStable(kappa,meanDirection,resVecs[j],generator);
+            }, referenceSamples);
+
+            fastTime = runSampler([&] (std::vector <VectorType> &resVecs)
+            {
+                resVecs.resize(numSamples);
+                for (unsigned int j = 0;j < numSamples;++j)
+                    anima::FastSampleFromVMFDistribution(kappa,meanDirection,resVecs[j],generator);
+            }, samples);
+
+            testOk &= compareSamples("VMF fast sampler" + suffix, samples, referenceSamples, meanDirection, false);
+
+            batchTime = runSampler([&] (std::vector <VectorType> &resVecs)
+            {
+                anima::FastSampleFromVMFDistribution(kappa,meanDirection,resVecs,numSamples,generator);
+            }, samples);
+
+            testOk &= compareSamples("VMF batch sampler" + suffix, samples, referenceSamples, meanDirection, false);
+
+            std::cout << "VMF times: current " << referenceTime << "s, fast " << fastTime << "s, batch " << batchTime << "s" << std::endl;
+        }
+    }
+
+    if (!testOk)
+        return EXIT_FAILURE;
+
+    return EXIT_SUCCESS;
+}
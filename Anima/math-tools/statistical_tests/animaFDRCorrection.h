@@ -1,30 +1,33 @@
 #pragma once
 
 #include <vector>
+#include <cstddef>
 #include "AnimaStatisticalTestsExport.h"
 
 namespace anima
 {
     
-    // Pair comparison functor
-    struct pair_increasing_comparator
-    {
-        bool operator()(const std::pair<unsigned int,double> & f, const std::pair<unsigned int,double> & s)
-        {
-            return (f.second < s.second);
-        }
-    };
-    
     /**
-     * In place correction of p-values according to Benjamini Hochberg FDR method
-     * Output is a thresholded list at the specified q-value
+     * Computes the Benjamini Hochberg threshold of a set of p-values at the specified q-value: p-values lower or equal to it
+     * are significant, i.e. the largest p-value p_(k) such that p_(k) <= k q / m, m being the number of tests (divided by
+     * sum_i 1/i for Benjamini Yekutieli correction). Returns -infinity if no p-value is significant.
+     * Only values where mask is non zero are considered (all values if mask is null). P-values are counted in a histogram
+     * in parallel, values being then gathered in a single pass and sorted only in the bins that may contain the threshold.
      * Eq. (1) of Y. Benjamini and Y. Hochberg. Controlling the False Discovery Rate: A Practical and Powerful Approach to Multiple Testing.
      * Journal of the Royal Statistical Society. Series B (Methodological)
      * Vol. 57, No. 1 (1995), pp. 289-300
      */
+    template <class ScalarType>
+    double ComputeFDRThreshold(const ScalarType *pvalues, const unsigned char *mask, std::size_t numValues,
+                               double qValue, bool byCorrection, unsigned int numThreads = 0);
+
+    /**
+     * In place correction of p-values according to Benjamini Hochberg FDR method
+     * Output is a thresholded list at the specified q-value
+     */
     ANIMASTATISTICALTESTS_EXPORT void BHCorrection(std::vector <double> &pvalues, double qValue);
     ANIMASTATISTICALTESTS_EXPORT void BYCorrection(std::vector <double> &pvalues, double qValue);
     
 } // end of namespace anima
 
-
+#include "animaFDRCorrection.hxx"
@@ -0,0 +1,136 @@
+#pragma once
+#include "animaFDRCorrection.h"
+
+#include <itkMultiThreaderBase.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace anima
+{
+
+//! Histogram bin of a p-value, bins being regular on [0,1] (NaN and values above 1 going to the last bin)
+inline unsigned int GetFDRHistogramBin(double pvalue, unsigned int numBins)
+{
+    if (!(pvalue < 1.0))
+        return numBins - 1;
+
+    if (pvalue <= 0.0)
+        return 0;
+
+    return std::min(numBins - 1,(unsigned int)(pvalue * numBins));
+}
+
+template <class ScalarType>
+double ComputeFDRThreshold(const ScalarType *pvalues, const unsigned char *mask, std::size_t numValues,
+                           double qValue, bool byCorrection, unsigned int numThreads)
+{
+    if (numThreads == 0)
+        numThreads = itk::MultiThreaderBase::GetGlobalDefaultNumberOfThreads();
+
+    // Chunks of at least a few thousand values, one histogram per chunk
+    std::size_t numChunks = std::max((std::size_t)1,std::min((std::size_t)numThreads,numValues / 4096));
+    std::size_t chunkSize = (numValues + numChunks - 1) / numChunks;
+
+    // Power of two bins so that bin lower bounds are exact
+    unsigned int numBins = 256;
+    while ((numBins < 65536) && (numBins * 16 < numValues))
+        numBins *= 2;
+
+    itk::MultiThreaderBase::Pointer threader = itk::MultiThreaderBase::New();
+    threader->SetNumberOfWorkUnits(numThreads);
+
+    std::vector < std::vector <std::size_t> > chunkHistograms(numChunks, std::vector <std::size_t> (numBins,0));
+    threader->ParallelizeArray(0, numChunks, [&](itk::SizeValueType chunk)
+    {
+        std::vector <std::size_t> &histogram = chunkHistograms[chunk];
+        std::size_t endValue = std::min(numValues,(chunk + 1) * chunkSize);
+        for (std::size_t i = chunk * chunkSize;i < endValue;++i)
+        {
+            if (mask && (mask[i] == 0))
+                continue;
+
+            ++histogram[GetFDRHistogramBin(pvalues[i],numBins)];
+        }
+    }, nullptr);
+
+    // Cumulative counts: cumulativeCounts[b] values are in bins strictly below b
+    std::vector <std::size_t> cumulativeCounts(numBins + 1,0);
+    for (unsigned int b = 0;b < numBins;++b)
+    {
+        cumulativeCounts[b + 1] = cumulativeCounts[b];
+        for (std::size_t chunk = 0;chunk < numChunks;++chunk)
+            cumulativeCounts[b + 1] += chunkHistograms[chunk][b];
+    }
+
+    std::size_t numTests = cumulativeCounts[numBins];
+    double threshold = - std::numeric_limits <double>::infinity();
+    if (numTests == 0)
+        return threshold;
+
+    double rankFactor = qValue / numTests;
+    if (byCorrection)
+    {
+        double byFactor = 0;
+        for (std::size_t i = 0;i < numTests;++i)
+            byFactor += 1.0 / (i + 1.0);
+
+        rankFactor /= byFactor;
+    }
+
+    // Candidate bins are those where a p-value may be lower than its rank times the factor. Their values are gathered
+    // in a single pass, candidateStarts[b] being the number of gathered values in candidate bins strictly below b
+    std::vector <bool> candidateBins(numBins,false);
+    std::vector <std::size_t> candidateStarts(numBins + 1,0);
+    for (unsigned int b = 0;b < numBins;++b)
+    {
+        std::size_t numInBin = cumulativeCounts[b + 1] - cumulativeCounts[b];
+        double binLowerBound = (double)b / numBins;
+        candidateBins[b] = (numInBin > 0) && (binLowerBound <= rankFactor * cumulativeCounts[b + 1]);
+
+        candidateStarts[b + 1] = candidateStarts[b];
+        if (candidateBins[b])
+            candidateStarts[b + 1] += numInBin;
+    }
+
+    if (candidateStarts[numBins] == 0)
+        return threshold;
+
+    std::vector < std::vector <double> > chunkValues(numChunks);
+    threader->ParallelizeArray(0, numChunks, [&](itk::SizeValueType chunk)
+    {
+        std::vector <double> &values = chunkValues[chunk];
+        std::size_t endValue = std::min(numValues,(chunk + 1) * chunkSize);
+        for (std::size_t i = chunk * chunkSize;i < endValue;++i)
+        {
+            if (mask && (mask[i] == 0))
+                continue;
+
+            // NaN values are never significant, and would break sorting
+            double pvalue = pvalues[i];
+            if ((pvalue == pvalue) && candidateBins[GetFDRHistogramBin(pvalue,numBins)])
+                values.push_back(pvalue);
+        }
+    }, nullptr);
+
+    std::vector <double> candidateValues;
+    candidateValues.reserve(candidateStarts[numBins]);
+    for (std::size_t chunk = 0;chunk < numChunks;++chunk)
+        candidateValues.insert(candidateValues.end(),chunkValues[chunk].begin(),chunkValues[chunk].end());
+
+    std::sort(candidateValues.begin(),candidateValues.end());
+
+    // Step-up: the largest candidate lower than its rank times the factor, ranks following from the bin counts
+    for (std::size_t j = candidateValues.size();j > 0;--j)
+    {
+        unsigned int b = GetFDRHistogramBin(candidateValues[j - 1],numBins);
+        double rank = cumulativeCounts[b] + (j - candidateStarts[b]);
+        if (candidateValues[j - 1] <= rankFactor * rank)
+            return candidateValues[j - 1];
+    }
+
+    return threshold;
+}
+
+} // end of namespace anima
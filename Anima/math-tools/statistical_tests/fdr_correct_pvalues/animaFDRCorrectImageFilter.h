@@ -38,26 +38,34 @@ public:
     itkSetMacro(QValue, double)
     itkSetMacro(BYCorrection, bool)
 
+    //! Threshold below which (or equal) p-values are significant, available after update
+    itkGetConstMacro(PValueThreshold, double)
+
 protected:
     FDRCorrectImageFilter()
     {
         m_MaskImage = NULL;
         m_QValue = 0.05;
         m_BYCorrection = false;
+        m_PValueThreshold = 0;
     }
 
     virtual ~FDRCorrectImageFilter() {}
 
-    void GenerateData() ITK_OVERRIDE;
+    void GenerateInputRequestedRegion() ITK_OVERRIDE;
+    void EnlargeOutputRequestedRegion(itk::DataObject *output) ITK_OVERRIDE;
+
+    void BeforeThreadedGenerateData() ITK_OVERRIDE;
+    void DynamicThreadedGenerateData(const OutputImageRegionType &outputRegionForThread) ITK_OVERRIDE;
 
 private:
     ITK_DISALLOW_COPY_AND_ASSIGN(FDRCorrectImageFilter);
 
-    void CreateFullMask();
-
     MaskImagePointer m_MaskImage;
     double m_QValue;
     bool m_BYCorrection;
+
+    double m_PValueThreshold;
 };
 
 } // end of namespace anima
@@ -5,6 +5,7 @@
 #include <itkImageRegionIterator.h>
 
 #include <animaFDRCorrection.h>
+#include <animaImageGeometryFunctions.h>
 
 namespace anima
 {
@@ -12,85 +13,80 @@ namespace anima
 template <class PixelScalarType>
 void
 FDRCorrectImageFilter <PixelScalarType>
-::GenerateData()
+::GenerateInputRequestedRegion()
 {
-    this->AllocateOutputs();
+    Superclass::GenerateInputRequestedRegion();
 
-    if (!m_MaskImage)
-    {
-        this->CreateFullMask();
-        this->GetOutput()->SetRequestedRegion(this->GetInput()->GetLargestPossibleRegion());
-    }
+    // The threshold depends on all p-values
+    TInputImage *input = const_cast <TInputImage *> (this->GetInput());
+    if (input)
+        input->SetRequestedRegionToLargestPossibleRegion();
+}
 
-    typedef itk::ImageRegionConstIterator <TInputImage> InputImageIteratorType;
-    typedef itk::ImageRegionConstIterator <MaskImageType> MaskIteratorType;
-    typedef itk::ImageRegionIterator <TOutputImage> OutputImageIteratorType;
+template <class PixelScalarType>
+void
+FDRCorrectImageFilter <PixelScalarType>
+::EnlargeOutputRequestedRegion(itk::DataObject *output)
+{
+    Superclass::EnlargeOutputRequestedRegion(output);
+    output->SetRequestedRegionToLargestPossibleRegion();
+}
 
-    MaskIteratorType maskItr(m_MaskImage, this->GetOutput()->GetRequestedRegion());
-    InputImageIteratorType inItr(this->GetInput(), this->GetOutput()->GetRequestedRegion());
-    OutputImageIteratorType outItr(this->GetOutput(), this->GetOutput()->GetRequestedRegion());
+template <class PixelScalarType>
+void
+FDRCorrectImageFilter <PixelScalarType>
+::BeforeThreadedGenerateData()
+{
+    Superclass::BeforeThreadedGenerateData();
 
-    std::vector <double> pvalues;
+    const TInputImage *input = this->GetInput();
+    std::size_t numValues = input->GetBufferedRegion().GetNumberOfPixels();
 
-    while (!maskItr.IsAtEnd())
+    // P-values and mask are read in place from the image buffers
+    const unsigned char *maskBuffer = 0;
+    if (m_MaskImage)
     {
-        if (maskItr.Get() == 0)
-        {
-            ++maskItr;
-            ++inItr;
-            continue;
-        }
-
-        pvalues.push_back(inItr.Get());
+        anima::checkImageGeometry(input,m_MaskImage.GetPointer(),"mask");
+        if (m_MaskImage->GetBufferedRegion() != m_MaskImage->GetLargestPossibleRegion())
+            itkExceptionMacro("Mask image should be fully buffered");
 
-        ++inItr;
-        ++maskItr;
+        maskBuffer = m_MaskImage->GetBufferPointer();
     }
 
-    if (m_BYCorrection)
-        anima::BYCorrection(pvalues, m_QValue);
-    else
-        anima::BHCorrection(pvalues, m_QValue);
-
-    maskItr.GoToBegin();
-
-    unsigned int pos = 0;
-    while (!maskItr.IsAtEnd())
-    {
-        if (maskItr.Get() == 0)
-        {
-            ++maskItr;
-            outItr.Set(0);
-            ++outItr;
-            continue;
-        }
-
-        outItr.Set(pvalues[pos]);
-        ++pos;
-
-        ++outItr;
-        ++maskItr;
-    }
+    m_PValueThreshold = anima::ComputeFDRThreshold(input->GetBufferPointer(), maskBuffer, numValues,
+                                                   m_QValue, m_BYCorrection, this->GetNumberOfWorkUnits());
 }
 
 template <class PixelScalarType>
 void
 FDRCorrectImageFilter <PixelScalarType>
-::CreateFullMask()
+::DynamicThreadedGenerateData(const OutputImageRegionType &outputRegionForThread)
 {
+    typedef itk::ImageRegionConstIterator <TInputImage> InputImageIteratorType;
+    typedef itk::ImageRegionConstIterator <MaskImageType> MaskIteratorType;
+    typedef itk::ImageRegionIterator <TOutputImage> OutputImageIteratorType;
+
+    InputImageIteratorType inItr(this->GetInput(), outputRegionForThread);
+    OutputImageIteratorType outItr(this->GetOutput(), outputRegionForThread);
+
+    MaskIteratorType maskItr;
     if (m_MaskImage)
-        return;
+        maskItr = MaskIteratorType(m_MaskImage, outputRegionForThread);
 
-    m_MaskImage = MaskImageType::New();
-    m_MaskImage->Initialize();
-    m_MaskImage->SetRegions(this->GetInput()->GetLargestPossibleRegion());
-    m_MaskImage->SetOrigin(this->GetInput()->GetOrigin());
-    m_MaskImage->SetDirection(this->GetInput()->GetDirection());
-    m_MaskImage->SetSpacing(this->GetInput()->GetSpacing());
+    while (!outItr.IsAtEnd())
+    {
+        bool inMask = true;
+        if (m_MaskImage)
+        {
+            inMask = (maskItr.Get() != 0);
+            ++maskItr;
+        }
 
-    m_MaskImage->Allocate();
+        outItr.Set(inMask && (inItr.Get() <= m_PValueThreshold));
 
-    m_MaskImage->FillBuffer(1);
+        ++inItr;
+        ++outItr;
+    }
 }
 
 } // end namespace anima
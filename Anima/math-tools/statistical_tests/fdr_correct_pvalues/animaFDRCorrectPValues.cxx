@@ -1,17 +1,19 @@
 #include <animaFDRCorrectImageFilter.h>
 #include <animaReadWriteFunctions.h>
 
+#include <itkMultiThreaderBase.h>
 #include <tclap/CmdLine.h>
 
 int main(int argc, char **argv)
 {
     TCLAP::CmdLine cmd("INRIA / IRISA - VisAGeS/Empenn Team", ' ',ANIMA_VERSION);
 
-    TCLAP::ValueArg<std::string> inArg("i","input","Non corrected P-value image",true,"","Non corrected P-value image",cmd);
-    TCLAP::ValueArg<std::string> resArg("o","output","FDR thresholded output image at q",true,"","FDR corrected output image at q",cmd);
+    TCLAP::MultiArg<std::string> inArg("i","input","Non corrected P-value image (may be repeated to correct several maps)",true,"Non corrected P-value image",cmd);
+    TCLAP::MultiArg<std::string> resArg("o","output","FDR thresholded output image at q (one per input)",true,"FDR corrected output image at q",cmd);
     TCLAP::ValueArg<double> qArg("q","q-val","FDR q value",true,0.05,"FDR q value",cmd);
     TCLAP::SwitchArg byCorrArg("Y", "by-corr", "Use BY correction (if not set, BH correction is used)", cmd, false);
     TCLAP::ValueArg<std::string> maskArg("m","mask","Mask image (default: all pixels are in mask)",false,"","Mask image",cmd);
+    TCLAP::ValueArg<unsigned int> nbpArg("p","numberofthreads","Number of threads to run on (default: all cores)",false,itk::MultiThreaderBase::GetGlobalDefaultNumberOfThreads(),"number of threads",cmd);
 
     try
     {
@@ -23,22 +25,39 @@ int main(int argc, char **argv)
         return(1);
     }
 
+    std::vector <std::string> inputNames = inArg.getValue();
+    std::vector <std::string> outputNames = resArg.getValue();
+    if (inputNames.size() != outputNames.size())
+    {
+        std::cerr << "Error: the number of outputs should match the number of inputs" << std::endl;
+        return(1);
+    }
+
     typedef anima::FDRCorrectImageFilter<double> MainFilterType;
 
-    MainFilterType::Pointer mainFilter = MainFilterType::New();
+    // Mask is read only once for all p-value maps
+    MainFilterType::MaskImagePointer maskImage;
+    if (maskArg.getValue() != "")
+        maskImage = anima::readImage <MainFilterType::MaskImageType> (maskArg.getValue());
 
-    mainFilter->SetInput(anima::readImage<MainFilterType::TInputImage> (inArg.getValue()));
-    mainFilter->SetQValue(qArg.getValue());
-    mainFilter->SetBYCorrection(byCorrArg.isSet());
+    for (unsigned int i = 0;i < inputNames.size();++i)
+    {
+        MainFilterType::Pointer mainFilter = MainFilterType::New();
 
-    if (maskArg.getValue() != "")
-        mainFilter->SetMaskImage(anima::readImage <MainFilterType::MaskImageType> (maskArg.getValue()));
+        mainFilter->SetInput(anima::readImage<MainFilterType::TInputImage> (inputNames[i]));
+        mainFilter->SetQValue(qArg.getValue());
+        mainFilter->SetBYCorrection(byCorrArg.isSet());
+        mainFilter->SetNumberOfWorkUnits(nbpArg.getValue());
 
-    mainFilter->Update();
+        if (maskImage)
+            mainFilter->SetMaskImage(maskImage);
 
-    std::cout << "Writing result to : " << resArg.getValue() << std::endl;
+        mainFilter->Update();
 
-    anima::writeImage<MainFilterType::TOutputImage>(resArg.getValue(), mainFilter->GetOutput());
+        std::cout << "Writing result to : " << outputNames[i] << std::endl;
+
+        anima::writeImage<MainFilterType::TOutputImage>(outputNames[i], mainFilter->GetOutput());
+    }
 
     return 0;
 }
@@ -0,0 +1,144 @@
+#include <cmath>
+#include <algorithm>
+#include <iostream>
+#include <limits>
+#include <random>
+
+#include <animaFDRCorrection.h>
+
+//! Brute force step-up threshold: all masked p-values are sorted, NaN values counting as tests that are never significant
+double computeReferenceThreshold(const std::vector <double> &pvalues, const std::vector <unsigned char> &mask,
+                                 double qValue, bool byCorrection)
+{
+    std::vector <double> sortedValues;
+    std::size_t numTests = 0;
+    for (std::size_t i = 0;i < pvalues.size();++i)
+    {
+        if (mask[i] == 0)
+            continue;
+
+        ++numTests;
+        if (!std::isnan(pvalues[i]))
+            sortedValues.push_back(pvalues[i]);
+    }
+
+    std::sort(sortedValues.begin(),sortedValues.end());
+
+    double rankFactor = qValue / numTests;
+    if (byCorrection)
+    {
+        double byFactor = 0;
+        for (std::size_t i = 0;i < numTests;++i)
+            byFactor += 1.0 / (i + 1.0);
+
+        rankFactor /= byFactor;
+    }
+
+    double threshold = - std::numeric_limits <double>::infinity();
+    for (std::size_t k = 0;k < sortedValues.size();++k)
+    {
+        if (sortedValues[k] <= rankFactor * (k + 1.0))
+            threshold = sortedValues[k];
+    }
+
+    return threshold;
+}
+
+int main()
+{
+    std::mt19937 generator(7);
+    std::uniform_real_distribution <double> uniformDistribution(0.0, 1.0);
+
+    const unsigned int numCases = 5;
+    const char *caseNames[numCases] = {"null", "signal", "ties", "all significant", "small"};
+    const std::size_t caseSizes[numCases] = {300000, 300000, 300000, 20000, 50};
+
+    bool testPassed = true;
+    for (unsigned int c = 0;c < numCases;++c)
+    {
+        std::size_t numValues = caseSizes[c];
+        std::vector <double> pvalues(numValues);
+        std::vector <unsigned char> mask(numValues);
+        std::vector <unsigned char> fullMask(numValues,1);
+
+        for (std::size_t i = 0;i < numValues;++i)
+        {
+            double pvalue = uniformDistribution(generator);
+            switch (c)
+            {
+                case 1:
+                    // One fifth of strong effects, spreading candidates over several histogram bins
+                    if (i % 5 == 0)
+                        pvalue = std::pow(pvalue, 8.0);
+                    break;
+
+                case 2:
+                    // Ties, many of them on histogram bin bounds
+                    if (i % 3 == 0)
+                        pvalue = std::pow(pvalue, 6.0);
+
+                    pvalue = std::round(pvalue * 1024.0) / 1024.0;
+                    break;
+
+                case 3:
+                    pvalue *= 1.0e-6;
+                    break;
+
+                default:
+                    break;
+            }
+
+            pvalues[i] = pvalue;
+            mask[i] = (uniformDistribution(generator) < 0.8);
+        }
+
+        // A few NaN values and values outside of [0,1]
+        pvalues[numValues / 2] = std::numeric_limits <double>::quiet_NaN();
+        pvalues[numValues / 3] = 1.5;
+        pvalues[numValues / 4] = 0.0;
+
+        for (unsigned int byCorrection = 0;byCorrection < 2;++byCorrection)
+        {
+            for (unsigned int useMask = 0;useMask < 2;++useMask)
+            {
+                const std::vector <unsigned char> &currentMask = useMask ? mask : fullMask;
+                double refThreshold = computeReferenceThreshold(pvalues,currentMask,0.05,byCorrection);
+
+                for (unsigned int numThreads : {1, 4})
+                {
+                    double threshold = anima::ComputeFDRThreshold(pvalues.data(),useMask ? mask.data() : 0,numValues,
+                                                                  0.05,byCorrection,numThreads);
+
+                    if (threshold != refThreshold)
+                    {
+                        std::cerr << "Case " << caseNames[c] << (byCorrection ? ", BY" : ", BH") << (useMask ? ", masked" : "")
+                                  << ", " << numThreads << " threads: threshold " << threshold << " instead of " << refThreshold << std::endl;
+                        testPassed = false;
+                    }
+                }
+            }
+        }
+
+        // Corrected lists flag exactly the p-values under the reference threshold
+        double bhThreshold = computeReferenceThreshold(pvalues,fullMask,0.05,false);
+        std::vector <double> correctedValues(pvalues);
+        anima::BHCorrection(correctedValues,0.05);
+
+        std::size_t numSignificant = 0;
+        for (std::size_t i = 0;i < numValues;++i)
+        {
+            if (correctedValues[i] != (pvalues[i] <= bhThreshold))
+                testPassed = false;
+
+            numSignificant += (correctedValues[i] != 0);
+        }
+
+        std::cout << "Case " << caseNames[c] << ": BH threshold " << bhThreshold << ", " << numSignificant
+                  << " significant p-values out of " << numValues << std::endl;
+    }
+
+    if (!testPassed)
+        return EXIT_FAILURE;
+
+    return EXIT_SUCCESS;
+}
@@ -11,14 +11,17 @@
 #include <vtkGenericCell.h>
 #include <vtkDoubleArray.h>
 
+#include <itkMultiThreaderBase.h>
+
 int main(int argc, char **argv)
 {
     TCLAP::CmdLine cmd("INRIA / IRISA - VisAGeS/Empenn Team", ' ',ANIMA_VERSION);
 
-    TCLAP::ValueArg<std::string> inArg("i","input","Non corrected p-value fibers",true,"","Non corrected p-value fibers",cmd);
-    TCLAP::ValueArg<std::string> resArg("o","output","FDR thresholded output fibers at q",true,"","FDR corrected output fibers at q",cmd);
+    TCLAP::MultiArg<std::string> inArg("i","input","Non corrected p-value fibers (may be repeated to correct several files)",true,"Non corrected p-value fibers",cmd);
+    TCLAP::MultiArg<std::string> resArg("o","output","FDR thresholded output fibers at q (one per input)",true,"FDR corrected output fibers at q",cmd);
     TCLAP::ValueArg<double> qArg("q","q-val","FDR q value",true,0.05,"FDR q value",cmd);
     TCLAP::SwitchArg byCorrArg("Y", "by-corr", "Use BY correction (if not set, BH correction is used)", cmd, false);
+    TCLAP::ValueArg<unsigned int> nbpArg("p","numberofthreads","Number of threads to run on (default: all cores)",false,itk::MultiThreaderBase::GetGlobalDefaultNumberOfThreads(),"number of threads",cmd);
 
     try
     {
@@ -30,46 +33,65 @@ int main(int argc, char **argv)
         return EXIT_FAILURE;
     }
 
-    anima::ShapesReader trackReader;
-    trackReader.SetFileName(inArg.getValue());
-    trackReader.Update();
+    std::vector <std::string> inputNames = inArg.getValue();
+    std::vector <std::string> outputNames = resArg.getValue();
+    if (inputNames.size() != outputNames.size())
+    {
+        std::cerr << "Error: the number of outputs should match the number of inputs" << std::endl;
+        return EXIT_FAILURE;
+    }
 
     using PolyDataPointer = vtkSmartPointer <vtkPolyData>;
-    PolyDataPointer dataTracks = trackReader.GetOutput();
+    std::vector <double> pValuesVector;
 
-    vtkIdType nbTotalPts = dataTracks->GetNumberOfPoints();
-    unsigned int numArrays = dataTracks->GetPointData()->GetNumberOfArrays();
-    std::vector <unsigned int> usefulArrays;
-    for (unsigned int i = 0;i < numArrays;++i)
+    for (unsigned int k = 0;k < inputNames.size();++k)
     {
-        if (dataTracks->GetPointData()->GetArray(i)->GetNumberOfComponents() == 1)
-            usefulArrays.push_back(i);
-    }
+        anima::ShapesReader trackReader;
+        trackReader.SetFileName(inputNames[k]);
+        trackReader.Update();
 
-    numArrays = usefulArrays.size();
-    std::vector <double> pValuesVector(nbTotalPts);
+        PolyDataPointer dataTracks = trackReader.GetOutput();
 
-    for (unsigned int i = 0;i < numArrays;++i)
-    {
-        unsigned int iIndex = usefulArrays[i];
-        vtkDoubleArray *currentArray = dynamic_cast <vtkDoubleArray *> (dataTracks->GetPointData()->GetArray(iIndex));
+        vtkIdType nbTotalPts = dataTracks->GetNumberOfPoints();
+        unsigned int numArrays = dataTracks->GetPointData()->GetNumberOfArrays();
+        std::vector <unsigned int> usefulArrays;
+        for (unsigned int i = 0;i < numArrays;++i)
+        {
+            if (dataTracks->GetPointData()->GetArray(i)->GetNumberOfComponents() == 1)
+                usefulArrays.push_back(i);
+        }
 
-        for (unsigned int j = 0;j < nbTotalPts;++j)
-            pValuesVector[j] = currentArray->GetValue(j);
+        numArrays = usefulArrays.size();
 
-        if (byCorrArg.isSet())
-            anima::BYCorrection(pValuesVector, qArg.getValue());
-        else
-            anima::BHCorrection(pValuesVector, qArg.getValue());
+        for (unsigned int i = 0;i < numArrays;++i)
+        {
+            vtkDataArray *currentArray = dataTracks->GetPointData()->GetArray(usefulArrays[i]);
+            vtkDoubleArray *currentDoubleArray = vtkDoubleArray::SafeDownCast(currentArray);
 
-        for (unsigned int j = 0;j < nbTotalPts;++j)
-            currentArray->SetValue(j,pValuesVector[j]);
-    }
+            // Double arrays are thresholded in place, other types are copied first
+            const double *pValues = 0;
+            if (currentDoubleArray)
+                pValues = currentDoubleArray->GetPointer(0);
+            else
+            {
+                pValuesVector.resize(nbTotalPts);
+                for (vtkIdType j = 0;j < nbTotalPts;++j)
+                    pValuesVector[j] = currentArray->GetTuple1(j);
+
+                pValues = pValuesVector.data();
+            }
+
+            double threshold = anima::ComputeFDRThreshold(pValues, 0, nbTotalPts, qArg.getValue(), byCorrArg.isSet(), nbpArg.getValue());
 
-    anima::ShapesWriter writer;
-    writer.SetInputData(dataTracks);
-    writer.SetFileName(resArg.getValue());
-    writer.Update();
+            for (vtkIdType j = 0;j < nbTotalPts;++j)
+                currentArray->SetTuple1(j,(pValues[j] <= threshold));
+        }
+
+        anima::ShapesWriter writer;
+        writer.SetInputData(dataTracks);
+        writer.SetFileName(outputNames[k]);
+        writer.Update();
+    }
 
     return EXIT_SUCCESS;
 }
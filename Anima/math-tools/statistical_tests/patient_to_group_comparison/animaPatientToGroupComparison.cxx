@@ -1,8 +1,14 @@
 #include <iostream>
+#include <cmath>
 #include <tclap/CmdLine.h>
 
 #include <animaReadWriteFunctions.h>
+#include <animaStreamingFunctions.h>
 #include <animaPatientToGroupComparisonImageFilter.h>
+#include <animaPatientToGroupControlModelImageFilter.h>
+
+typedef itk::VectorImage<double,3> LogTensorImageType;
+typedef itk::ImageFileReader <LogTensorImageType> ReaderType;
 
 //Update progression of the process
 void eventCallback (itk::Object* caller, const itk::EventObject& event, void* clientData)
@@ -11,22 +17,74 @@ void eventCallback (itk::Object* caller, const itk::EventObject& event, void* cl
     std::cout<<"\033[K\rProgression: "<<(int)(processObject->GetProgress() * 100)<<"%"<<std::flush;
 }
 
+//! Creates readers for all images of a list, only their headers being read
+bool createDatabaseReaders(const std::string &fileName, std::vector <ReaderType::Pointer> &databaseReaders)
+{
+    std::ifstream fileIn(fileName);
+    if (!fileIn.is_open())
+    {
+        std::cerr << "Could not open data file (" << fileName << ")" << std::endl;
+        return false;
+    }
+
+    while (!fileIn.eof())
+    {
+        char tmpStr[2048];
+        fileIn.getline(tmpStr,2048);
+
+        if (strcmp(tmpStr,"") == 0)
+            continue;
+
+        std::cout << "Adding tensor image " << tmpStr << "..." << std::endl;
+        ReaderType::Pointer reader = ReaderType::New();
+        reader->SetFileName(tmpStr);
+        reader->UpdateOutputInformation();
+
+        databaseReaders.push_back(reader);
+    }
+
+    fileIn.close();
+    return true;
+}
+
+//! Reads the PCA parameters a control model was built with, stored in each of its voxels: only the first one is read
+void readControlModelParameters(ReaderType *modelReader, double &explainedRatio, unsigned int &numEigenValuesPCA)
+{
+    LogTensorImageType::RegionType firstVoxelRegion = modelReader->GetOutput()->GetLargestPossibleRegion();
+    firstVoxelRegion.SetSize(itk::Size <3>::Filled(1));
+
+    modelReader->GetOutput()->SetRequestedRegion(firstVoxelRegion);
+    modelReader->Update();
+
+    LogTensorImageType::PixelType modelValue = modelReader->GetOutput()->GetPixel(firstVoxelRegion.GetIndex());
+
+    typedef anima::PatientToGroupControlModel <double> ControlModelType;
+    explainedRatio = ControlModelType::GetExplainedRatio(modelValue);
+    numEigenValuesPCA = ControlModelType::GetNumEigenValuesPCA(modelValue);
+}
+
 int main(int argc, char **argv)
 {
-    TCLAP::CmdLine cmd("INRIA / IRISA - VisAGeS/Empenn Team", ' ',ANIMA_VERSION);
+    TCLAP::CmdLine cmd("Patient to group comparison. The control model (database mean, PCA basis and inverse covariance) may be saved once (-s) "
+                       "and reused (-c) to score patients without reading the database.\nINRIA / IRISA - VisAGeS/Empenn Team", ' ',ANIMA_VERSION);
     
-    TCLAP::ValueArg<std::string> refLTArg("i","input","Test Image",true,"","test image",cmd);
-    TCLAP::ValueArg<std::string> dataLTArg("I","database","Database Image List",true,"","database image list",cmd);
+    TCLAP::ValueArg<std::string> refLTArg("i","input","Test Image",false,"","test image",cmd);
+    TCLAP::ValueArg<std::string> dataLTArg("I","database","Database Image List",false,"","database image list",cmd);
+    TCLAP::ValueArg<std::string> modelArg("c","control-model","Precomputed control model image, replacing the database",false,"","control model image",cmd);
+    TCLAP::ValueArg<std::string> saveModelArg("s","save-model","Output control model image computed from the database",false,"","output control model image",cmd);
     
     TCLAP::ValueArg<std::string> maskArg("m","maskname","Computation mask",true,"","computation mask",cmd);
-    TCLAP::ValueArg<std::string> resArg("o","outputname","Z-Score output image",true,"","Z-Score output image",cmd);
-    TCLAP::ValueArg<std::string> resPValArg("O","outpvalname","P-value output image",true,"","P-Value output image",cmd);
+    TCLAP::ValueArg<std::string> resArg("o","outputname","Z-Score output image",false,"","Z-Score output image",cmd);
+    TCLAP::ValueArg<std::string> resPValArg("O","outpvalname","P-value output image",false,"","P-Value output image",cmd);
 
     TCLAP::ValueArg<std::string> statTestArg("t","stat-test","Statistical test to use ([fisher],chi)",false,"fisher","statistical test",cmd);
-    TCLAP::ValueArg<double> expVarArg("e","expvar","PCA threshold: threshold on eigenvalues to compute the new basis (default: 0.5)",false,0.5,"PCA threshold",cmd);
-    TCLAP::ValueArg<unsigned int> numEigenArg("E","numeigenpca","Number of eigenvalues to keep (default: 6)",false,6,"Number of PCA eigen values",cmd);
+    TCLAP::ValueArg<double> expVarArg("e","expvar","PCA threshold: threshold on eigenvalues to compute the new basis (default: 0.5, "
+                                      "the one stored in the control model with -c)",false,0.5,"PCA threshold",cmd);
+    TCLAP::ValueArg<unsigned int> numEigenArg("E","numeigenpca","Number of eigenvalues to keep (default: 6, the one stored in the control model with -c)",
+                                              false,6,"Number of PCA eigen values",cmd);
 
     TCLAP::ValueArg<unsigned int> nbpArg("p","numberofthreads","Number of threads to run on (default: all cores)",false,itk::MultiThreaderBase::GetGlobalDefaultNumberOfThreads(),"number of threads",cmd);
+    TCLAP::ValueArg<double> memoryArg("M","memory","Memory budget in MB for input images, processed by slabs to fit in it (default: 0, whole images in memory)",false,0,"memory budget",cmd);
 
     try
     {
@@ -37,18 +95,90 @@ int main(int argc, char **argv)
         std::cerr << "Error: " << e.error() << "for argument " << e.argId() << std::endl;
         return EXIT_FAILURE;
     }
-    
-    typedef itk::VectorImage<double,3> LogTensorImageType;
+
+    bool scorePatient = (refLTArg.getValue() != "");
+    bool saveModel = (saveModelArg.getValue() != "");
+
+    if (!scorePatient && !saveModel)
+    {
+        std::cerr << "Error: either a test image (-i) or an output control model (-s) is required" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    if (scorePatient && ((resArg.getValue() == "") || (resPValArg.getValue() == "")))
+    {
+        std::cerr << "Error: z-score (-o) and p-value (-O) outputs are required to test an image" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    if ((dataLTArg.getValue() == "") == (modelArg.getValue() == "") || (saveModel && (modelArg.getValue() != "")))
+    {
+        std::cerr << "Error: provide either a database (-I) or a control model (-c), a control model being saved only from a database" << std::endl;
+        return EXIT_FAILURE;
+    }
+
     typedef anima::PatientToGroupComparisonImageFilter<double> MAZScoreImageFilterType;
+    typedef anima::PatientToGroupControlModelImageFilter<double> ControlModelFilterType;
+    typedef itk::Image <unsigned char, 3> MaskImageType;
 
     itk::CStyleCommand::Pointer callback = itk::CStyleCommand::New();
     callback->SetCallback(eventCallback);
 
+    MaskImageType::Pointer maskImage = anima::readImage <MaskImageType> (maskArg.getValue());
+    double memoryBudget = memoryArg.getValue() * 1024.0 * 1024.0;
+
+    // Images are only read when filters request them, slab by slab when streaming. Readers are kept alive for that purpose
+    std::vector <ReaderType::Pointer> databaseReaders;
+    if ((dataLTArg.getValue() != "") && (!createDatabaseReaders(dataLTArg.getValue(),databaseReaders)))
+        return EXIT_FAILURE;
+
+    LogTensorImageType::Pointer controlModel;
+    if (saveModel)
+    {
+        ControlModelFilterType::Pointer modelFilter = ControlModelFilterType::New();
+        modelFilter->SetComputationMask(maskImage);
+        modelFilter->SetNumberOfWorkUnits(nbpArg.getValue());
+        modelFilter->SetExplainedRatio(expVarArg.getValue());
+        modelFilter->SetNumEigenValuesPCA(numEigenArg.getValue());
+        modelFilter->AddObserver(itk::ProgressEvent(), callback);
+
+        for (unsigned int i = 0;i < databaseReaders.size();++i)
+            modelFilter->SetInput(i,databaseReaders[i]->GetOutput());
+
+        try
+        {
+            if (databaseReaders.size() == 0)
+                throw itk::ExceptionObject(__FILE__, __LINE__,"No database image found",ITK_LOCATION);
+
+            LogTensorImageType *firstImage = databaseReaders[0]->GetOutput();
+            double bytesPerVoxel = databaseReaders.size() * firstImage->GetNumberOfComponentsPerPixel() * sizeof(double);
+            unsigned int numDivisions = anima::computeNumberOfStreamDivisions(firstImage->GetLargestPossibleRegion(),
+                                                                              bytesPerVoxel,0,memoryBudget);
+
+            controlModel = anima::updateByStreamDivisions <LogTensorImageType> (modelFilter.GetPointer(),numDivisions)[0];
+        }
+        catch (itk::ExceptionObject &e)
+        {
+            std::cerr << e << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        std::cout << std::endl << "Writing control model to " << saveModelArg.getValue() << std::endl;
+        anima::writeImage <LogTensorImageType> (saveModelArg.getValue(),controlModel);
+
+        if (!scorePatient)
+            return EXIT_SUCCESS;
+    }
+
     MAZScoreImageFilterType::Pointer mainFilter = MAZScoreImageFilterType::New();
-    mainFilter->SetComputationMask(anima::readImage < itk::Image <unsigned char, 3> > (maskArg.getValue()));
+    mainFilter->SetComputationMask(maskImage);
     mainFilter->SetNumberOfWorkUnits(nbpArg.getValue());
 
-    mainFilter->SetInput(anima::readImage <LogTensorImageType> (refLTArg.getValue()));
+    ReaderType::Pointer patientReader = ReaderType::New();
+    patientReader->SetFileName(refLTArg.getValue());
+    patientReader->UpdateOutputInformation();
+
+    mainFilter->SetInput(patientReader->GetOutput());
     mainFilter->SetExplainedRatio(expVarArg.getValue());
     mainFilter->SetNumEigenValuesPCA(numEigenArg.getValue());
 
@@ -57,31 +187,75 @@ int main(int argc, char **argv)
     else
         mainFilter->SetStatisticalTestType(MAZScoreImageFilterType::FISHER);
 
-    std::ifstream fileIn(dataLTArg.getValue());
-    if (!fileIn.is_open())
+    unsigned int ndim = patientReader->GetOutput()->GetNumberOfComponentsPerPixel();
+    double bytesPerVoxel = ndim * sizeof(double);
+
+    ReaderType::Pointer modelReader;
+    if (modelArg.getValue() != "")
     {
-        std::cerr << "Could not open data file (" << dataLTArg.getValue() << ")" << std::endl;
-        return EXIT_FAILURE;
+        modelReader = ReaderType::New();
+        modelReader->SetFileName(modelArg.getValue());
+        modelReader->UpdateOutputInformation();
+
+        if (modelReader->GetOutput()->GetNumberOfComponentsPerPixel() != ControlModelFilterType::ControlModelType::GetPackedModelSize(ndim))
+        {
+            std::cerr << "Error: control model " << modelArg.getValue() << " does not match the test image dimension" << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        // The model was estimated once with its own PCA parameters, explicit ones have to agree with them
+        double modelExplainedRatio = 0;
+        unsigned int modelNumEigenValues = 0;
+        try
+        {
+            readControlModelParameters(modelReader,modelExplainedRatio,modelNumEigenValues);
+        }
+        catch (itk::ExceptionObject &e)
+        {
+            std::cerr << e << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        if (expVarArg.isSet() && (std::abs(expVarArg.getValue() - modelExplainedRatio) > 1.0e-6))
+        {
+            std::cerr << "Error: PCA threshold " << expVarArg.getValue() << " differs from the one of the control model ("
+                      << modelExplainedRatio << ")" << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        if (numEigenArg.isSet() && (std::min(numEigenArg.getValue(),ndim) != modelNumEigenValues))
+        {
+            std::cerr << "Error: number of PCA eigen values " << numEigenArg.getValue() << " differs from the one of the control model ("
+                      << modelNumEigenValues << ")" << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        mainFilter->SetExplainedRatio(modelExplainedRatio);
+        mainFilter->SetNumEigenValuesPCA(modelNumEigenValues);
+        mainFilter->SetControlModel(modelReader->GetOutput());
+        bytesPerVoxel += modelReader->GetOutput()->GetNumberOfComponentsPerPixel() * sizeof(double);
     }
-    
-    while (!fileIn.eof())
+    else if (controlModel)
+        mainFilter->SetControlModel(controlModel);
+    else
     {
-        char tmpStr[2048];
-        fileIn.getline(tmpStr,2048);
-        
-        if (strcmp(tmpStr,"") == 0)
-            continue;
-        
-        std::cout << "Loading tensor image " << tmpStr << "..." << std::endl;
-        mainFilter->AddDatabaseInput(anima::readImage <LogTensorImageType> (tmpStr));
+        for (unsigned int i = 0;i < databaseReaders.size();++i)
+            mainFilter->AddDatabaseInput(databaseReaders[i]->GetOutput());
+
+        bytesPerVoxel += databaseReaders.size() * ndim * sizeof(double);
     }
-    fileIn.close();
 
     mainFilter->AddObserver(itk::ProgressEvent(), callback);
 
+    typedef itk::Image <double, 3> OutputImageType;
+    std::vector <OutputImageType::Pointer> outputImages;
+
     try
     {
-        mainFilter->Update();
+        unsigned int numDivisions = anima::computeNumberOfStreamDivisions(patientReader->GetOutput()->GetLargestPossibleRegion(),
+                                                                          bytesPerVoxel,0,memoryBudget);
+
+        outputImages = anima::updateByStreamDivisions <OutputImageType> (mainFilter.GetPointer(),numDivisions);
     }
     catch (itk::ExceptionObject &e)
     {
@@ -89,8 +263,8 @@ int main(int argc, char **argv)
         return EXIT_FAILURE;
     }
     
-    anima::writeImage < itk::Image <double, 3> > (resArg.getValue(),mainFilter->GetOutput(0));
-    anima::writeImage < itk::Image <double, 3> > (resPValArg.getValue(),mainFilter->GetOutput(1));
+    anima::writeImage <OutputImageType> (resArg.getValue(),outputImages[0]);
+    anima::writeImage <OutputImageType> (resPValArg.getValue(),outputImages[1]);
 
     return EXIT_SUCCESS;
 }
@@ -2,6 +2,7 @@
 
 #include <iostream>
 #include <animaMaskedImageToImageFilter.h>
+#include <animaPatientToGroupControlModel.h>
 #include <itkVectorImage.h>
 #include <itkImage.h>
 
@@ -15,7 +16,10 @@ namespace anima
      *
      * Provides an ITK implementation of z-score and p-value computation telling how much different a single vector image is
      * from a database of controls. It can virtually process any type of input, however for tensor images, be warned
-     * that they should be expressed as log-vectors.
+     * that they should be expressed as log-vectors. Database images are pipeline inputs (after the patient image), so that
+     * the filter may be streamed, only the requested region of each of them being then read.
+     * Control statistics may alternatively be given as a precomputed control model image (see PatientToGroupControlModel and
+     * PatientToGroupControlModelImageFilter), database images being then unused.
      *
      */
 template <class PixelScalarType>
@@ -55,13 +59,28 @@ public:
     typedef typename Superclass::MaskImageType MaskImageType;
     typedef typename Superclass::OutputImageRegionType OutputImageRegionType;
 
-    typedef vnl_matrix<double> CovMatrixType;
+    typedef anima::PatientToGroupControlModel <PixelScalarType> ControlModelType;
 
     void AddDatabaseInput(InputImageType *tmpIm)
     {
-        m_DatabaseImages.push_back(tmpIm);
+        // Input 0 is kept for the patient image
+        unsigned int inputIndex = this->GetNumberOfIndexedInputs();
+        if (inputIndex == 0)
+            inputIndex = 1;
+
+        this->SetNthInput(inputIndex,tmpIm);
     }
 
+    unsigned int GetNumberOfDatabaseImages()
+    {
+        unsigned int numInputs = this->GetNumberOfIndexedInputs();
+        return (numInputs > 0) ? numInputs - 1 : 0;
+    }
+
+    //! Precomputed control model image, replacing database images when set
+    itkSetInputMacro(ControlModel, InputImageType)
+    itkGetInputMacro(ControlModel, InputImageType)
+
     itkSetMacro(NumEigenValuesPCA, unsigned int);
     itkSetMacro(ExplainedRatio, double);
 
@@ -78,8 +97,9 @@ protected:
         m_ExplainedRatio = 0.9;
         m_NumEigenValuesPCA = 6;
 
-        m_DatabaseImages.clear();
         m_StatisticalTestType = FISHER;
+
+        this->AddOptionalInputName("ControlModel");
     }
 
     virtual ~PatientToGroupComparisonImageFilter() {}
@@ -96,15 +116,11 @@ protected:
 private:
     ITK_DISALLOW_COPY_AND_ASSIGN(PatientToGroupComparisonImageFilter);
 
-    bool isZero(const VectorType &vec);
-
-    unsigned int GetPCAVectorsFromData(std::vector < itk::VariableLengthVector <double> > &databaseVectors,
-                                       itk::VariableLengthVector <double> &patientVectorValue);
-
     unsigned int m_NumEigenValuesPCA;
     double m_ExplainedRatio;
 
-    std::vector <InputImagePointer> m_DatabaseImages;
+    ControlModelType m_ControlModelEstimator;
+
     TestType m_StatisticalTestType;
 };
 
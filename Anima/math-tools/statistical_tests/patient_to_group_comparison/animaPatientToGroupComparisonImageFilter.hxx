@@ -2,10 +2,7 @@
 #include "animaPatientToGroupComparisonImageFilter.h"
 
 #include <itkImageRegionIterator.h>
-#include <itkImageRegionIteratorWithIndex.h>
 #include <itkImageRegionConstIterator.h>
-#include <itkImageRegionConstIteratorWithIndex.h>
-#include <itkSymmetricEigenAnalysis.h>
 
 #include <boost/math/distributions/fisher_f.hpp>
 #include <boost/math/distributions/chi_squared.hpp>
@@ -33,7 +30,18 @@ PatientToGroupComparisonImageFilter<PixelScalarType>
     if (m_NumEigenValuesPCA > ndim)
         m_NumEigenValuesPCA = ndim;
 
-    if (m_DatabaseImages.size() <= this->GetInput(0)->GetNumberOfComponentsPerPixel())
+    m_ControlModelEstimator.SetNumEigenValuesPCA(m_NumEigenValuesPCA);
+    m_ControlModelEstimator.SetExplainedRatio(m_ExplainedRatio);
+
+    if (this->GetControlModel())
+    {
+        if (this->GetControlModel()->GetNumberOfComponentsPerPixel() != ControlModelType::GetPackedModelSize(ndim))
+            itkExceptionMacro("Error: Control model does not match the input dimension...");
+
+        return;
+    }
+
+    if (this->GetNumberOfDatabaseImages() <= ndim)
         itkExceptionMacro("Error: Not enough inputs available...");
 }
 
@@ -42,25 +50,30 @@ void
 PatientToGroupComparisonImageFilter<PixelScalarType>
 ::DynamicThreadedGenerateData(const OutputImageRegionType &outputRegionForThread)
 {
-    typedef itk::ImageRegionConstIteratorWithIndex< InputImageType > InIteratorType;
+    typedef itk::ImageRegionConstIterator< InputImageType > InIteratorType;
 
-    typedef itk::ImageRegionIteratorWithIndex< OutputImageType > OutRegionIteratorType;
-    typedef itk::ImageRegionConstIteratorWithIndex < MaskImageType > MaskRegionIteratorType;
+    typedef itk::ImageRegionIterator< OutputImageType > OutRegionIteratorType;
+    typedef itk::ImageRegionConstIterator < MaskImageType > MaskRegionIteratorType;
 
     OutRegionIteratorType outIterator(this->GetOutput(0), outputRegionForThread);
     OutRegionIteratorType outPValIterator(this->GetOutput(1), outputRegionForThread);
     MaskRegionIteratorType maskIterator (this->GetComputationMask(), outputRegionForThread);
 
-    unsigned int numSamplesDatabase = m_DatabaseImages.size();
+    const InputImageType *controlModel = this->GetControlModel();
+    InIteratorType modelIterator;
+    if (controlModel)
+        modelIterator = InIteratorType(controlModel, outputRegionForThread);
+
+    // Database images are only visited when no control model is provided
+    unsigned int numSamplesDatabase = controlModel ? 0 : this->GetNumberOfDatabaseImages();
     std::vector < InIteratorType > databaseIterators;
     InIteratorType patientIterator(this->GetInput(0), outputRegionForThread);
 
     for (unsigned int i = 0;i < numSamplesDatabase;++i)
-        databaseIterators.push_back(InIteratorType(m_DatabaseImages[i],outputRegionForThread));
+        databaseIterators.push_back(InIteratorType(this->GetInput(i + 1),outputRegionForThread));
 
     unsigned int ndim = this->GetInput(0)->GetNumberOfComponentsPerPixel();
-    CovMatrixType tmpCovMatrix(ndim,ndim), tmpCovMatrixInv;
-    VectorType tmpMean(ndim);
+    VectorType modelValue(ControlModelType::GetPackedModelSize(ndim));
 
     std::vector < VectorType > databaseValues(numSamplesDatabase);
     VectorType patientVectorValue;
@@ -68,244 +81,89 @@ PatientToGroupComparisonImageFilter<PixelScalarType>
     while (!outIterator.IsAtEnd())
     {
         patientVectorValue = patientIterator.Get();
-        ndim = patientVectorValue.GetSize();
 
-        if ((maskIterator.Get() == 0)||(this->isZero(patientVectorValue)))
-        {
-            outIterator.Set(0.0);
-            outPValIterator.Set(0.0);
-            ++outIterator;
-            ++outPValIterator;
-            ++maskIterator;
-            ++patientIterator;
-
-            for (unsigned int i = 0;i < numSamplesDatabase;++i)
-                ++databaseIterators[i];
-
-            continue;
-        }
+        double squaredDistance = 0;
+        double scalarDifference = 0;
+        bool validVoxel = (maskIterator.Get() != 0) && (!ControlModelType::IsZero(patientVectorValue));
 
-        databaseValues.resize(numSamplesDatabase);
-
-        unsigned int numEffectiveSamples = 0;
-        for (unsigned int i = 0;i < numSamplesDatabase;++i)
+        if (validVoxel)
         {
-            databaseValues[numEffectiveSamples] = databaseIterators[i].Get();
-            if (!this->isZero(databaseValues[numEffectiveSamples]))
-                numEffectiveSamples++;
-        }
-
-        databaseValues.resize(numEffectiveSamples);
-
-        ndim = this->SampleFromDiffusionModels(databaseValues,patientVectorValue);
-        unsigned int ndim_afterpca = ndim;
-
-        if ((m_NumEigenValuesPCA < ndim)||(m_ExplainedRatio < 1))
-            ndim_afterpca = this->GetPCAVectorsFromData(databaseValues,patientVectorValue);
-
-        if (numEffectiveSamples <= ndim_afterpca)
-        {
-            outIterator.Set(0.0);
-            outPValIterator.Set(0.0);
-            ++outIterator;
-            ++outPValIterator;
-            ++maskIterator;
-            ++patientIterator;
+            if (controlModel)
+            {
+                modelValue = modelIterator.Get();
+                databaseValues.clear();
+                this->SampleFromDiffusionModels(databaseValues,patientVectorValue);
+            }
+            else
+            {
+                databaseValues.resize(numSamplesDatabase);
 
-            for (unsigned int i = 0;i < numSamplesDatabase;++i)
-                ++databaseIterators[i];
+                unsigned int numEffectiveSamples = 0;
+                for (unsigned int i = 0;i < numSamplesDatabase;++i)
+                {
+                    databaseValues[numEffectiveSamples] = databaseIterators[i].Get();
+                    if (!ControlModelType::IsZero(databaseValues[numEffectiveSamples]))
+                        numEffectiveSamples++;
+                }
 
-            continue;
-        }
+                databaseValues.resize(numEffectiveSamples);
 
-        tmpCovMatrix.set_size(ndim_afterpca,ndim_afterpca);
-        tmpCovMatrix.fill(0);
-        tmpMean.SetSize(ndim_afterpca);
-        tmpMean.Fill(0);
+                this->SampleFromDiffusionModels(databaseValues,patientVectorValue);
+                m_ControlModelEstimator.Estimate(databaseValues,modelValue);
+            }
 
-        for (unsigned int i = 0;i < numEffectiveSamples;++i)
-        {
-            for (unsigned int j = 0;j < ndim_afterpca;++j)
-                tmpMean[j] += databaseValues[i][j];
+            validVoxel = ControlModelType::ComputeSquaredDistance(modelValue,patientVectorValue,squaredDistance,scalarDifference);
         }
 
-        tmpMean /= numEffectiveSamples;
-
-        for (unsigned int i = 0;i < numEffectiveSamples;++i)
+        if (validVoxel)
         {
-            for (unsigned int j = 0;j < ndim_afterpca;++j)
-                for (unsigned int k = j;k < ndim_afterpca;++k)
-                    tmpCovMatrix(j,k) += (databaseValues[i][j] - tmpMean[j])*(databaseValues[i][k] - tmpMean[k]);
-        }
-
-        for (unsigned int j = 0;j < ndim_afterpca;++j)
-            for (unsigned int k = j;k < ndim_afterpca;++k)
-            {
-                tmpCovMatrix(j,k) /= (numEffectiveSamples - 1.0);
-                if (j != k)
-                    tmpCovMatrix(k,j) = tmpCovMatrix(j,k);
-            }
-
-        vnl_matrix_inverse <double> matrixInverter(tmpCovMatrix);
-        tmpCovMatrixInv = matrixInverter.inverse();
+            unsigned int numEffectiveSamples = ControlModelType::GetNumberOfSamples(modelValue);
+            unsigned int ndim_afterpca = ControlModelType::GetModelDimension(modelValue);
 
-        double resValue = 0;
-
-        for (unsigned int i = 0;i < ndim_afterpca;++i)
-            for (unsigned int j = i;j < ndim_afterpca;++j)
+            switch (m_StatisticalTestType)
             {
-                // This is because we are working only on triangular superior for being faster
-                // The input data has to be in the right log-vector form
-                double factor = 2.0;
-                if (i == j)
-                    factor = 1;
-
-                resValue += factor*tmpCovMatrixInv(i,j)*(patientVectorValue[i] - tmpMean[i])*(patientVectorValue[j] - tmpMean[j]);
+                case FISHER:
+                {
+                    double testScore = numEffectiveSamples * (numEffectiveSamples - ndim_afterpca) * squaredDistance / ((numEffectiveSamples * numEffectiveSamples - 1.0) * ndim_afterpca);
+                    boost::math::fisher_f_distribution <double> fisherDist(ndim_afterpca,numEffectiveSamples - ndim_afterpca);
+                    outPValIterator.Set (1.0 - boost::math::cdf(fisherDist, testScore));
+                    break;
+                }
+
+                case CHI_SQUARE:
+                default:
+                {
+                    boost::math::chi_squared_distribution <double> chiDist(ndim_afterpca);
+                    outPValIterator.Set (1.0 - boost::math::cdf(chiDist, squaredDistance));
+                    break;
+                }
             }
 
-        switch (m_StatisticalTestType)
-        {
-            case FISHER:
-            {
-                double testScore = numEffectiveSamples * (numEffectiveSamples - ndim_afterpca) * resValue / ((numEffectiveSamples * numEffectiveSamples - 1) * ndim_afterpca);
-                boost::math::fisher_f_distribution <double> fisherDist(ndim_afterpca,numEffectiveSamples - ndim_afterpca);
-                outPValIterator.Set (1.0 - boost::math::cdf(fisherDist, testScore));
-                break;
-            }
+            double resValue = std::sqrt(squaredDistance);
+            // If scalar values, put a sign on out z-score
+            if ((patientVectorValue.GetSize() == 1) && (scalarDifference < 0))
+                resValue *= -1;
 
-            case CHI_SQUARE:
-            default:
-            {
-                boost::math::chi_squared_distribution <double> chiDist(ndim_afterpca);
-                outPValIterator.Set (1.0 - boost::math::cdf(chiDist, resValue));
-                break;
-            }
+            outIterator.Set(resValue);
+            this->IncrementNumberOfProcessedPoints();
         }
-
-        resValue = sqrt(resValue);
-        // If scalar values, put a sign on out z-score
-        if (ndim == 1)
+        else
         {
-            if (tmpMean[0] > patientVectorValue[0])
-                resValue *= -1;
+            outIterator.Set(0.0);
+            outPValIterator.Set(0.0);
         }
 
-        this->IncrementNumberOfProcessedPoints();
-        outIterator.Set(resValue);
         ++outIterator;
         ++outPValIterator;
         ++maskIterator;
         ++patientIterator;
 
+        if (controlModel)
+            ++modelIterator;
+
         for (unsigned int i = 0;i < numSamplesDatabase;++i)
             ++databaseIterators[i];
     }
 }
 
-
-template <class PixelScalarType>
-unsigned int
-PatientToGroupComparisonImageFilter<PixelScalarType>
-::GetPCAVectorsFromData(std::vector < itk::VariableLengthVector <double> > &databaseVectors,
-                                                                        itk::VariableLengthVector <double> &patientVectorValue)
-{
-    unsigned int refNDim = patientVectorValue.GetSize();
-    vnl_matrix <double> allCovarianceMatrix(refNDim,refNDim);
-
-    for (unsigned int i = 0;i < refNDim;++i)
-        for (unsigned int j = 0;j < refNDim;++j)
-            allCovarianceMatrix(i,j) = 0;
-
-    unsigned int numData = databaseVectors.size();
-    std::vector <double> dataMean(refNDim,0);
-
-    for (unsigned int i = 0;i < numData;++i)
-        for (unsigned int j = 0;j < refNDim;++j)
-            dataMean[j] += databaseVectors[i][j];
-
-    for (unsigned int j = 0;j < refNDim;++j)
-        dataMean[j] /= numData;
-
-    for (unsigned int i = 0;i < numData;++i)
-        for (unsigned int j = 0;j < refNDim;++j)
-            for (unsigned int k = j;k < refNDim;++k)
-                allCovarianceMatrix(j,k) += (databaseVectors[i][j] - dataMean[j])*(databaseVectors[i][k] - dataMean[k]);
-
-    for (unsigned int j = 0;j < refNDim;++j)
-        for (unsigned int k = j;k < refNDim;++k)
-        {
-            allCovarianceMatrix(j,k) /= (numData - 1.0);
-            if (j != k)
-                allCovarianceMatrix(k,j) = allCovarianceMatrix(j,k);
-        }
-
-    vnl_matrix <double> eigenVectors(refNDim,refNDim);
-    vnl_diag_matrix <double> eigenValues(refNDim);
-
-    itk::SymmetricEigenAnalysis <vnl_matrix <double>, vnl_diag_matrix <double>, vnl_matrix <double> > EigenAnalysis(refNDim);
-    EigenAnalysis.SetOrderEigenValues(true);
-    EigenAnalysis.ComputeEigenValuesAndVectors(allCovarianceMatrix,eigenValues,eigenVectors);
-
-    double sumEigVal = 0;
-    for (unsigned int i = 0;i < refNDim;++i)
-        sumEigVal += eigenValues[i];
-
-    unsigned int outNDim = 0;
-    double cumulEigs = 0;
-    while (cumulEigs/sumEigVal < m_ExplainedRatio)
-    {
-        cumulEigs += eigenValues[refNDim - 1 - outNDim];
-        ++outNDim;
-    }
-
-    if (outNDim < m_NumEigenValuesPCA)
-        outNDim = m_NumEigenValuesPCA;
-
-    vnl_matrix <double> basisMatrix(outNDim,refNDim);
-    for (unsigned int i = 0;i < outNDim;++i)
-        for (unsigned int j = 0;j < refNDim;++j)
-            basisMatrix(i,j) = eigenVectors(refNDim - 1 - i,j);
-
-    itk::VariableLengthVector <double> tmpVec, resData(outNDim);
-    for (unsigned int i = 0;i < numData;++i)
-    {
-        tmpVec = databaseVectors[i];
-        for (unsigned int j = 0;j < outNDim;++j)
-        {
-            resData[j] = 0;
-            for (unsigned int k = 0;k < refNDim;++k)
-                resData[j] += basisMatrix(j,k)*(tmpVec[k] - dataMean[k]);
-        }
-
-        databaseVectors[i] = resData;
-    }
-
-    for (unsigned int j = 0;j < outNDim;++j)
-    {
-        resData[j] = 0;
-        for (unsigned int k = 0;k < refNDim;++k)
-            resData[j] += basisMatrix(j,k)*(patientVectorValue[k] - dataMean[k]);
-    }
-
-    patientVectorValue = resData;
-
-    return outNDim;
-}
-
-template <class PixelScalarType>
-bool
-PatientToGroupComparisonImageFilter<PixelScalarType>
-::isZero(const VectorType &vec)
-{
-    unsigned int ndim = vec.Size();
-
-    for (unsigned int i = 0;i < ndim;++i)
-    {
-        if (vec[i] != 0)
-            return false;
-    }
-
-    return true;
-}
-
 } //end namespace anima
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <itkVariableLengthVector.h>
+#include <vector>
+
+namespace anima
+{
+
+/**
+ * \brief Per voxel model of a control database for patient to group comparison.
+ *
+ * Holds everything that depends only on the database: number of non zero samples, dimension kept after PCA, database mean
+ * and a whitening matrix, product of the inverse square root of the (PCA reduced) covariance by the PCA basis. The squared
+ * Mahalanobis distance of a patient vector x is then the squared norm of W (x - mean), at a cost of dimension^2.
+ * The model is packed in a vector: [number of samples, model dimension, explained ratio, number of PCA eigen values,
+ * mean (n values), W (n x n values, row major, rows after the model dimension being zero)]. A null number of samples means
+ * no model could be estimated at that voxel. PCA parameters are stored in every voxel, so that a saved model tells how it
+ * was built whatever the image format.
+ */
+template <class ScalarType>
+class PatientToGroupControlModel
+{
+public:
+    typedef itk::VariableLengthVector <ScalarType> VectorType;
+
+    PatientToGroupControlModel()
+    {
+        m_ExplainedRatio = 0.9;
+        m_NumEigenValuesPCA = 6;
+    }
+
+    void SetExplainedRatio(double val) {m_ExplainedRatio = val;}
+    void SetNumEigenValuesPCA(unsigned int val) {m_NumEigenValuesPCA = val;}
+
+    static unsigned int GetPackedModelSize(unsigned int ndim) {return 4 + ndim + ndim * ndim;}
+
+    //! Sets an empty model (no sample) holding the PCA parameters, packedModel being already sized
+    void InitializePackedModel(VectorType &packedModel) const;
+
+    //! Estimates the packed model from (non zero) database samples
+    void Estimate(const std::vector <VectorType> &databaseValues, VectorType &packedModel) const;
+
+    /**
+     * Computes the squared Mahalanobis distance of a patient vector to a packed model, and the signed difference to the
+     * mean for scalar data. Returns false if there is no model at that voxel.
+     */
+    static bool ComputeSquaredDistance(const VectorType &packedModel, const VectorType &patientValue,
+                                       double &squaredDistance, double &scalarDifference);
+
+    static unsigned int GetNumberOfSamples(const VectorType &packedModel) {return packedModel[0];}
+    static unsigned int GetModelDimension(const VectorType &packedModel) {return packedModel[1];}
+    static double GetExplainedRatio(const VectorType &packedModel) {return packedModel[2];}
+    static unsigned int GetNumEigenValuesPCA(const VectorType &packedModel) {return packedModel[3];}
+
+    //! Null vectors are voxels without data, in patient as well as database images
+    static bool IsZero(const VectorType &vec);
+
+private:
+    double m_ExplainedRatio;
+    unsigned int m_NumEigenValuesPCA;
+};
+
+} // end namespace anima
+
+#include "animaPatientToGroupControlModel.hxx"
@@ -0,0 +1,158 @@
+#pragma once
+#include "animaPatientToGroupControlModel.h"
+
+#include <itkSymmetricEigenAnalysis.h>
+#include <vnl/vnl_matrix.h>
+#include <vnl/vnl_diag_matrix.h>
+
+#include <cmath>
+
+namespace anima
+{
+
+template <class ScalarType>
+void
+PatientToGroupControlModel <ScalarType>
+::InitializePackedModel(VectorType &packedModel) const
+{
+    packedModel.Fill(0);
+    packedModel[2] = m_ExplainedRatio;
+    packedModel[3] = m_NumEigenValuesPCA;
+}
+
+template <class ScalarType>
+void
+PatientToGroupControlModel <ScalarType>
+::Estimate(const std::vector <VectorType> &databaseValues, VectorType &packedModel) const
+{
+    unsigned int numSamples = databaseValues.size();
+    if (numSamples > 0)
+    {
+        unsigned int packedSize = GetPackedModelSize(databaseValues[0].GetSize());
+        if (packedModel.GetSize() != packedSize)
+            packedModel.SetSize(packedSize);
+    }
+
+    this->InitializePackedModel(packedModel);
+    if (numSamples < 2)
+        return;
+
+    unsigned int ndim = databaseValues[0].GetSize();
+    std::vector <double> dataMean(ndim,0);
+
+    for (unsigned int i = 0;i < numSamples;++i)
+        for (unsigned int j = 0;j < ndim;++j)
+            dataMean[j] += databaseValues[i][j];
+
+    for (unsigned int j = 0;j < ndim;++j)
+        dataMean[j] /= numSamples;
+
+    vnl_matrix <double> covarianceMatrix(ndim,ndim,0.0);
+    for (unsigned int i = 0;i < numSamples;++i)
+        for (unsigned int j = 0;j < ndim;++j)
+            for (unsigned int k = j;k < ndim;++k)
+                covarianceMatrix(j,k) += (databaseValues[i][j] - dataMean[j])*(databaseValues[i][k] - dataMean[k]);
+
+    for (unsigned int j = 0;j < ndim;++j)
+        for (unsigned int k = j;k < ndim;++k)
+        {
+            covarianceMatrix(j,k) /= (numSamples - 1.0);
+            if (j != k)
+                covarianceMatrix(k,j) = covarianceMatrix(j,k);
+        }
+
+    vnl_matrix <double> eigenVectors(ndim,ndim);
+    vnl_diag_matrix <double> eigenValues(ndim);
+
+    itk::SymmetricEigenAnalysis <vnl_matrix <double>, vnl_diag_matrix <double>, vnl_matrix <double> > EigenAnalysis(ndim);
+    EigenAnalysis.SetOrderEigenValues(true);
+    EigenAnalysis.ComputeEigenValuesAndVectors(covarianceMatrix,eigenValues,eigenVectors);
+
+    unsigned int modelDimension = ndim;
+    if ((m_NumEigenValuesPCA < ndim)||(m_ExplainedRatio < 1))
+    {
+        double sumEigVal = 0;
+        for (unsigned int i = 0;i < ndim;++i)
+            sumEigVal += eigenValues[i];
+
+        unsigned int outNDim = 0;
+        double cumulEigs = 0;
+        while ((outNDim < ndim) && (cumulEigs/sumEigVal < m_ExplainedRatio))
+        {
+            cumulEigs += eigenValues[ndim - 1 - outNDim];
+            ++outNDim;
+        }
+
+        if (outNDim < m_NumEigenValuesPCA)
+            outNDim = m_NumEigenValuesPCA;
+
+        modelDimension = std::min(outNDim,ndim);
+    }
+
+    if (numSamples <= modelDimension)
+        return;
+
+    packedModel[0] = numSamples;
+    packedModel[1] = modelDimension;
+    for (unsigned int j = 0;j < ndim;++j)
+        packedModel[4 + j] = dataMean[j];
+
+    // The reduced covariance is diagonal in the PCA basis: whitening rows are basis vectors scaled by inverse standard deviations
+    unsigned int whiteningStart = 4 + ndim;
+    for (unsigned int i = 0;i < modelDimension;++i)
+    {
+        double eigenValue = eigenValues[ndim - 1 - i];
+        if (eigenValue <= 0)
+            continue;
+
+        double scale = 1.0 / std::sqrt(eigenValue);
+        for (unsigned int j = 0;j < ndim;++j)
+            packedModel[whiteningStart + i * ndim + j] = scale * eigenVectors(ndim - 1 - i,j);
+    }
+}
+
+template <class ScalarType>
+bool
+PatientToGroupControlModel <ScalarType>
+::ComputeSquaredDistance(const VectorType &packedModel, const VectorType &patientValue,
+                         double &squaredDistance, double &scalarDifference)
+{
+    squaredDistance = 0;
+    scalarDifference = 0;
+
+    unsigned int ndim = patientValue.GetSize();
+    if ((packedModel.GetSize() != GetPackedModelSize(ndim)) || (packedModel[0] == 0))
+        return false;
+
+    unsigned int modelDimension = packedModel[1];
+    unsigned int whiteningStart = 4 + ndim;
+    for (unsigned int i = 0;i < modelDimension;++i)
+    {
+        double whitenedValue = 0;
+        for (unsigned int j = 0;j < ndim;++j)
+            whitenedValue += packedModel[whiteningStart + i * ndim + j] * (patientValue[j] - packedModel[4 + j]);
+
+        squaredDistance += whitenedValue * whitenedValue;
+    }
+
+    scalarDifference = patientValue[0] - packedModel[4];
+    return true;
+}
+
+template <class ScalarType>
+bool
+PatientToGroupControlModel <ScalarType>
+::IsZero(const VectorType &vec)
+{
+    unsigned int ndim = vec.Size();
+
+    for (unsigned int i = 0;i < ndim;++i)
+    {
+        if (vec[i] != 0)
+            return false;
+    }
+
+    return true;
+}
+
+} // end namespace anima
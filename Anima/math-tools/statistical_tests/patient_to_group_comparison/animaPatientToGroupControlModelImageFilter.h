@@ -0,0 +1,75 @@
+#pragma once
+
+#include <animaMaskedImageToImageFilter.h>
+#include <animaPatientToGroupControlModel.h>
+#include <itkVectorImage.h>
+
+#include <vector>
+
+namespace anima
+{
+
+/**
+ * \brief Computes the per voxel control model (see PatientToGroupControlModel) of a database of images, to be saved once
+ * and reused by PatientToGroupComparisonImageFilter to score any number of patients.
+ *
+ * Inputs are the database images, output is the packed model vector image. Voxels outside of the computation mask
+ * hold empty models, so that the PCA parameters may be read from any voxel.
+ */
+template <class PixelScalarType>
+class PatientToGroupControlModelImageFilter :
+        public anima::MaskedImageToImageFilter< itk::VectorImage <PixelScalarType, 3> , itk::VectorImage <PixelScalarType, 3> >
+{
+public:
+    /** Standard class typedefs. */
+    typedef PatientToGroupControlModelImageFilter<PixelScalarType> Self;
+    typedef itk::SmartPointer<Self> Pointer;
+    typedef itk::SmartPointer<const Self>  ConstPointer;
+
+    /** Method for creation through the object factory. */
+    itkNewMacro(Self)
+
+    /** Run-time type information (and related methods) */
+    itkTypeMacro(PatientToGroupControlModelImageFilter, MaskedImageToImageFilter)
+
+    /** Image typedef support */
+    typedef itk::VectorImage <PixelScalarType, 3> InputImageType;
+    typedef itk::VectorImage <PixelScalarType, 3> OutputImageType;
+    typedef typename InputImageType::PixelType VectorType;
+
+    typedef anima::MaskedImageToImageFilter< InputImageType, OutputImageType > Superclass;
+    typedef anima::PatientToGroupControlModel <PixelScalarType> ControlModelType;
+
+    /** Superclass typedefs. */
+    typedef typename Superclass::MaskImageType MaskImageType;
+    typedef typename Superclass::OutputImageRegionType OutputImageRegionType;
+
+    itkSetMacro(NumEigenValuesPCA, unsigned int)
+    itkSetMacro(ExplainedRatio, double)
+
+protected:
+    PatientToGroupControlModelImageFilter()
+        : Superclass()
+    {
+        m_ExplainedRatio = 0.9;
+        m_NumEigenValuesPCA = 6;
+    }
+
+    virtual ~PatientToGroupControlModelImageFilter() {}
+
+    void GenerateOutputInformation() ITK_OVERRIDE;
+    void BeforeThreadedGenerateData() ITK_OVERRIDE;
+    void DynamicThreadedGenerateData(const OutputImageRegionType &outputRegionForThread) ITK_OVERRIDE;
+
+private:
+    ITK_DISALLOW_COPY_AND_ASSIGN(PatientToGroupControlModelImageFilter);
+
+    unsigned int m_NumEigenValuesPCA;
+    double m_ExplainedRatio;
+
+    ControlModelType m_ControlModelEstimator;
+};
+
+} // end namespace anima
+
+#include "animaPatientToGroupControlModelImageFilter.hxx"
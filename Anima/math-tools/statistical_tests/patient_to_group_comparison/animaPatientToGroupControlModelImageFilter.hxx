@@ -0,0 +1,94 @@
+#pragma once
+#include "animaPatientToGroupControlModelImageFilter.h"
+
+#include <itkImageRegionIterator.h>
+#include <itkImageRegionConstIterator.h>
+
+namespace anima
+{
+
+template <class PixelScalarType>
+void
+PatientToGroupControlModelImageFilter<PixelScalarType>
+::GenerateOutputInformation()
+{
+    Superclass::GenerateOutputInformation();
+
+    unsigned int ndim = this->GetInput(0)->GetNumberOfComponentsPerPixel();
+    this->GetOutput()->SetVectorLength(ControlModelType::GetPackedModelSize(ndim));
+}
+
+template <class PixelScalarType>
+void
+PatientToGroupControlModelImageFilter<PixelScalarType>
+::BeforeThreadedGenerateData()
+{
+    Superclass::BeforeThreadedGenerateData();
+
+    unsigned int ndim = this->GetInput(0)->GetNumberOfComponentsPerPixel();
+    if (this->GetNumberOfIndexedInputs() <= ndim)
+        itkExceptionMacro("Error: Not enough inputs available...");
+
+    m_ControlModelEstimator.SetNumEigenValuesPCA(std::min(m_NumEigenValuesPCA,ndim));
+    m_ControlModelEstimator.SetExplainedRatio(m_ExplainedRatio);
+
+    // Only the mask bounding box is processed: fill the whole output with empty models so that PCA parameters are in every voxel
+    VectorType emptyModel(ControlModelType::GetPackedModelSize(ndim));
+    m_ControlModelEstimator.InitializePackedModel(emptyModel);
+    this->GetOutput()->FillBuffer(emptyModel);
+}
+
+template <class PixelScalarType>
+void
+PatientToGroupControlModelImageFilter<PixelScalarType>
+::DynamicThreadedGenerateData(const OutputImageRegionType &outputRegionForThread)
+{
+    typedef itk::ImageRegionConstIterator< InputImageType > InIteratorType;
+    typedef itk::ImageRegionIterator< OutputImageType > OutRegionIteratorType;
+    typedef itk::ImageRegionConstIterator < MaskImageType > MaskRegionIteratorType;
+
+    OutRegionIteratorType outIterator(this->GetOutput(), outputRegionForThread);
+    MaskRegionIteratorType maskIterator (this->GetComputationMask(), outputRegionForThread);
+
+    unsigned int numSamplesDatabase = this->GetNumberOfIndexedInputs();
+    std::vector < InIteratorType > databaseIterators;
+    for (unsigned int i = 0;i < numSamplesDatabase;++i)
+        databaseIterators.push_back(InIteratorType(this->GetInput(i),outputRegionForThread));
+
+    unsigned int ndim = this->GetInput(0)->GetNumberOfComponentsPerPixel();
+    VectorType modelValue(ControlModelType::GetPackedModelSize(ndim));
+    std::vector < VectorType > databaseValues(numSamplesDatabase);
+
+    while (!outIterator.IsAtEnd())
+    {
+        m_ControlModelEstimator.InitializePackedModel(modelValue);
+
+        if (maskIterator.Get() != 0)
+        {
+            databaseValues.resize(numSamplesDatabase);
+
+            unsigned int numEffectiveSamples = 0;
+            for (unsigned int i = 0;i < numSamplesDatabase;++i)
+            {
+                databaseValues[numEffectiveSamples] = databaseIterators[i].Get();
+                if (!ControlModelType::IsZero(databaseValues[numEffectiveSamples]))
+                    numEffectiveSamples++;
+            }
+
+            databaseValues.resize(numEffectiveSamples);
+            m_ControlModelEstimator.Estimate(databaseValues,modelValue);
+
+            this->IncrementNumberOfProcessedPoints();
+        }
+
+        outIterator.Set(modelValue);
+
+        ++outIterator;
+        ++maskIterator;
+
+        for (unsigned int i = 0;i < numSamplesDatabase;++i)
+            ++databaseIterators[i];
+    }
+}
+
+} // end namespace anima
@@ -0,0 +1,196 @@
+#include <cmath>
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+#include <random>
+
+#include <itkImageRegionConstIterator.h>
+#include <itkImageRegionIterator.h>
+#include <itkImageRegionIteratorWithIndex.h>
+
+#include <animaReadWriteFunctions.h>
+#include <animaPatientToGroupComparisonImageFilter.h>
+#include <animaPatientToGroupControlModelImageFilter.h>
+
+typedef anima::PatientToGroupComparisonImageFilter <double> ComparisonFilterType;
+typedef anima::PatientToGroupControlModelImageFilter <double> ControlModelFilterType;
+typedef ComparisonFilterType::InputImageType VectorImageType;
+typedef ComparisonFilterType::OutputImageType ScoreImageType;
+typedef ComparisonFilterType::MaskImageType MaskImageType;
+
+//! Random vector image, a few voxels being zero as outside of the acquisition
+VectorImageType::Pointer createImage(const VectorImageType::RegionType &region, unsigned int ndim, std::mt19937 &generator)
+{
+    VectorImageType::Pointer image = VectorImageType::New();
+    image->SetRegions(region);
+    image->SetVectorLength(ndim);
+    image->Allocate();
+
+    std::normal_distribution <double> normalDistribution(0.0, 1.0);
+    std::uniform_real_distribution <double> zeroDistribution(0.0, 1.0);
+    VectorImageType::PixelType value(ndim);
+
+    itk::ImageRegionIterator <VectorImageType> imageItr(image, region);
+    while (!imageItr.IsAtEnd())
+    {
+        // Correlated components, the first one having the largest variance
+        for (unsigned int j = 0;j < ndim;++j)
+            value[j] = (ndim - j) * normalDistribution(generator) + ((j > 0) ? 0.5 * value[j - 1] : 0.0);
+
+        if (zeroDistribution(generator) < 0.05)
+            value.Fill(0);
+
+        imageItr.Set(value);
+        ++imageItr;
+    }
+
+    return image;
+}
+
+//! Maximal difference between two score images
+double compareScores(ScoreImageType *firstImage, ScoreImageType *secondImage)
+{
+    itk::ImageRegionConstIterator <ScoreImageType> firstItr(firstImage, firstImage->GetLargestPossibleRegion());
+    itk::ImageRegionConstIterator <ScoreImageType> secondItr(secondImage, secondImage->GetLargestPossibleRegion());
+
+    double maxDifference = 0;
+    while (!firstItr.IsAtEnd())
+    {
+        maxDifference = std::max(maxDifference, std::abs(firstItr.Get() - secondItr.Get()));
+        ++firstItr;
+        ++secondItr;
+    }
+
+    return maxDifference;
+}
+
+int main()
+{
+    VectorImageType::RegionType region;
+    region.SetSize(0,8);
+    region.SetSize(1,6);
+    region.SetSize(2,5);
+
+    std::mt19937 generator(21);
+    std::uniform_real_distribution <double> maskDistribution(0.0, 1.0);
+
+    // Random mask covering the whole image and mask inside the image, its bounding box not touching the image border
+    MaskImageType::RegionType innerRegion;
+    innerRegion.SetIndex(0,2);
+    innerRegion.SetIndex(1,1);
+    innerRegion.SetIndex(2,1);
+    innerRegion.SetSize(0,4);
+    innerRegion.SetSize(1,3);
+    innerRegion.SetSize(2,3);
+
+    std::vector <MaskImageType::Pointer> masks(2);
+    for (unsigned int m = 0;m < 2;++m)
+    {
+        masks[m] = MaskImageType::New();
+        masks[m]->SetRegions(region);
+        masks[m]->Allocate();
+
+        itk::ImageRegionIteratorWithIndex <MaskImageType> maskItr(masks[m], region);
+        while (!maskItr.IsAtEnd())
+        {
+            bool insideMask = (maskDistribution(generator) < 0.85);
+            if (m == 1)
+                insideMask = insideMask && innerRegion.IsInside(maskItr.GetIndex());
+
+            maskItr.Set(insideMask);
+            ++maskItr;
+        }
+    }
+
+    const unsigned int numDatabaseImages = 12;
+    const double explainedRatio = 0.8;
+    const unsigned int numEigenValuesPCA = 2;
+    const char *modelFileName = "animaPatientToGroupComparisonTestModel.nrrd";
+    const double tolerance = 1.0e-12;
+
+    bool testPassed = true;
+    const char *maskNames[2] = {"whole image mask", "inner mask"};
+    for (unsigned int c = 0;c < 4;++c)
+    {
+        unsigned int ndim = (c % 2 == 0) ? 1 : 4;
+        MaskImageType *mask = masks[c / 2];
+
+        std::vector <VectorImageType::Pointer> databaseImages(numDatabaseImages);
+        for (unsigned int i = 0;i < numDatabaseImages;++i)
+            databaseImages[i] = createImage(region,ndim,generator);
+
+        VectorImageType::Pointer patientImage = createImage(region,ndim,generator);
+
+        // Model saved to disk and read back, as done by the comparison tool
+        ControlModelFilterType::Pointer modelFilter = ControlModelFilterType::New();
+        modelFilter->SetComputationMask(mask);
+        modelFilter->SetExplainedRatio(explainedRatio);
+        modelFilter->SetNumEigenValuesPCA(numEigenValuesPCA);
+        modelFilter->SetNumberOfWorkUnits(3);
+        for (unsigned int i = 0;i < numDatabaseImages;++i)
+            modelFilter->SetInput(i,databaseImages[i]);
+
+        modelFilter->Update();
+        anima::writeImage <VectorImageType> (modelFileName,modelFilter->GetOutput());
+        VectorImageType::Pointer savedModel = anima::readImage <VectorImageType> (modelFileName);
+        std::remove(modelFileName);
+
+        // Stored PCA parameters, in all voxels including those outside of the mask
+        itk::ImageRegionConstIterator <VectorImageType> modelItr(savedModel, region);
+        while (!modelItr.IsAtEnd())
+        {
+            VectorImageType::PixelType modelValue = modelItr.Get();
+            if ((ControlModelFilterType::ControlModelType::GetExplainedRatio(modelValue) != explainedRatio) ||
+                    (ControlModelFilterType::ControlModelType::GetNumEigenValuesPCA(modelValue) != std::min(numEigenValuesPCA,ndim)))
+            {
+                std::cerr << "Dimension " << ndim << ", " << maskNames[c / 2] << ": wrong PCA parameters stored in the control model" << std::endl;
+                testPassed = false;
+                break;
+            }
+
+            ++modelItr;
+        }
+
+        for (unsigned int t = 0;t < 2;++t)
+        {
+            ComparisonFilterType::TestType testType = (t == 0) ? ComparisonFilterType::FISHER : ComparisonFilterType::CHI_SQUARE;
+
+            ComparisonFilterType::Pointer databaseFilter = ComparisonFilterType::New();
+            ComparisonFilterType::Pointer modelComparisonFilter = ComparisonFilterType::New();
+            ComparisonFilterType *filters[2] = {databaseFilter.GetPointer(), modelComparisonFilter.GetPointer()};
+            for (unsigned int f = 0;f < 2;++f)
+            {
+                filters[f]->SetInput(patientImage);
+                filters[f]->SetComputationMask(mask);
+                filters[f]->SetExplainedRatio(explainedRatio);
+                filters[f]->SetNumEigenValuesPCA(numEigenValuesPCA);
+                filters[f]->SetStatisticalTestType(testType);
+                filters[f]->SetNumberOfWorkUnits(3);
+            }
+
+            for (unsigned int i = 0;i < numDatabaseImages;++i)
+                databaseFilter->AddDatabaseInput(databaseImages[i]);
+
+            modelComparisonFilter->SetControlModel(savedModel);
+
+            databaseFilter->Update();
+            modelComparisonFilter->Update();
+
+            double zScoreDeviation = compareScores(databaseFilter->GetOutput(0),modelComparisonFilter->GetOutput(0));
+            double pValueDeviation = compareScores(databaseFilter->GetOutput(1),modelComparisonFilter->GetOutput(1));
+            std::cout << "Dimension " << ndim << ", " << maskNames[c / 2] << ((t == 0) ? ", Fisher" : ", chi square") << " test: z-score deviation "
+                      << zScoreDeviation << ", p-value deviation " << pValueDeviation << std::endl;
+
+            if ((zScoreDeviation > tolerance) || (pValueDeviation > tolerance))
+            {
+                std::cerr << "Scores from the saved control model differ from the ones computed from the database" << std::endl;
+                testPassed = false;
+            }
+        }
+    }
+
+    if (!testPassed)
+        return EXIT_FAILURE;
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace anima
+{
+
+/**
+ * \brief Per label statistics of images, computed in a single parallel pass over each image buffer.
+ *
+ * Labels are read once from a label buffer (zero being the background) and mapped to consecutive indices, sorted by
+ * increasing label value. Each update then streams a data buffer of the same size once and accumulates, for every label,
+ * the number of values, minimum, maximum, mean and centered sum of squares. Moments use Welford updates in each thread
+ * chunk, chunks being merged with Chan et al. pairwise formula, so that variances remain accurate on large regions.
+ * If quantiles are needed, values are also kept per label and quantiles are computed exactly by selection.
+ */
+template <class LabelType>
+class LabelStatisticsAccumulator
+{
+public:
+    struct Moments
+    {
+        Moments() : count(0), mean(0), centeredSquares(0), min(0), max(0) {}
+
+        void AddValue(double value);
+        void Merge(const Moments &other);
+
+        //! Unbiased variance (zero for less than two values)
+        double GetVariance() const {return (count > 1) ? centeredSquares / (count - 1.0) : 0.0;}
+
+        std::size_t count;
+        double mean;
+        double centeredSquares;
+        double min, max;
+    };
+
+    LabelStatisticsAccumulator();
+
+    void SetNumberOfThreads(unsigned int val) {m_NumberOfThreads = val;}
+    void SetKeepValues(bool val) {m_KeepValues = val;}
+
+    //! Reads labels from a label buffer of numValues elements
+    void SetLabels(const LabelType *labels, std::size_t numValues);
+
+    unsigned int GetNumberOfLabels() const {return m_Labels.size();}
+    const std::vector <LabelType> &GetLabels() const {return m_Labels;}
+
+    //! Accumulates statistics of a data buffer of the same size as the label buffer, replacing previous ones
+    template <class ScalarType> void Update(const ScalarType *values);
+
+    const Moments &GetMoments(unsigned int labelIndex) const {return m_Moments[labelIndex];}
+
+    /**
+     * Quantile (in [0,1]) of the values of a label, taken as the element of rank floor(quantile * count) in increasing
+     * order (the median being the element of rank floor(count / 2)). Requires values to be kept.
+     */
+    double GetQuantile(unsigned int labelIndex, double quantile);
+
+private:
+    //! Splits the buffer into chunks of consecutive values, one per work unit
+    std::size_t GetNumberOfChunks() const;
+
+    unsigned int m_NumberOfThreads;
+    bool m_KeepValues;
+
+    std::size_t m_NumberOfValues;
+    std::vector <LabelType> m_Labels;
+    //! Label index of each value, the number of labels marking the background
+    std::vector <unsigned int> m_LabelIndexes;
+
+    std::vector <Moments> m_Moments;
+    std::vector < std::vector <double> > m_Values;
+};
+
+} // end namespace anima
+
+#include "animaLabelStatisticsAccumulator.hxx"
@@ -0,0 +1,209 @@
+#pragma once
+#include "animaLabelStatisticsAccumulator.h"
+
+#include <itkMultiThreaderBase.h>
+#include <itkMacro.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace anima
+{
+
+template <class LabelType>
+void
+LabelStatisticsAccumulator <LabelType>::Moments
+::AddValue(double value)
+{
+    if (count == 0)
+    {
+        min = value;
+        max = value;
+    }
+    else
+    {
+        min = std::min(min,value);
+        max = std::max(max,value);
+    }
+
+    ++count;
+    double delta = value - mean;
+    mean += delta / count;
+    centeredSquares += delta * (value - mean);
+}
+
+template <class LabelType>
+void
+LabelStatisticsAccumulator <LabelType>::Moments
+::Merge(const Moments &other)
+{
+    if (other.count == 0)
+        return;
+
+    if (count == 0)
+    {
+        *this = other;
+        return;
+    }
+
+    double totalCount = count + other.count;
+    double delta = other.mean - mean;
+
+    mean += delta * other.count / totalCount;
+    centeredSquares += other.centeredSquares + delta * delta * count * other.count / totalCount;
+    min = std::min(min,other.min);
+    max = std::max(max,other.max);
+    count += other.count;
+}
+
+template <class LabelType>
+LabelStatisticsAccumulator <LabelType>
+::LabelStatisticsAccumulator()
+{
+    m_NumberOfThreads = itk::MultiThreaderBase::GetGlobalDefaultNumberOfThreads();
+    m_KeepValues = false;
+    m_NumberOfValues = 0;
+}
+
+template <class LabelType>
+std::size_t
+LabelStatisticsAccumulator <LabelType>
+::GetNumberOfChunks() const
+{
+    return std::max((std::size_t)1,std::min((std::size_t)m_NumberOfThreads,m_NumberOfValues / 4096));
+}
+
+template <class LabelType>
+void
+LabelStatisticsAccumulator <LabelType>
+::SetLabels(const LabelType *labels, std::size_t numValues)
+{
+    m_NumberOfValues = numValues;
+    std::size_t numChunks = this->GetNumberOfChunks();
+    std::size_t chunkSize = (numValues + numChunks - 1) / numChunks;
+
+    itk::MultiThreaderBase::Pointer threader = itk::MultiThreaderBase::New();
+    threader->SetNumberOfWorkUnits(m_NumberOfThreads);
+
+    // Labels are spatially coherent: consecutive duplicates are skipped before sorting
+    std::vector < std::vector <LabelType> > chunkLabels(numChunks);
+    threader->ParallelizeArray(0, numChunks, [&](itk::SizeValueType chunk)
+    {
+        std::vector <LabelType> &foundLabels = chunkLabels[chunk];
+        std::size_t endValue = std::min(numValues,(chunk + 1) * chunkSize);
+        for (std::size_t i = chunk * chunkSize;i < endValue;++i)
+        {
+            if ((labels[i] != 0) && (foundLabels.empty() || (foundLabels.back() != labels[i])))
+                foundLabels.push_back(labels[i]);
+        }
+
+        std::sort(foundLabels.begin(),foundLabels.end());
+        foundLabels.erase(std::unique(foundLabels.begin(),foundLabels.end()),foundLabels.end());
+    }, nullptr);
+
+    m_Labels.clear();
+    for (std::size_t chunk = 0;chunk < numChunks;++chunk)
+        m_Labels.insert(m_Labels.end(),chunkLabels[chunk].begin(),chunkLabels[chunk].end());
+
+    std::sort(m_Labels.begin(),m_Labels.end());
+    m_Labels.erase(std::unique(m_Labels.begin(),m_Labels.end()),m_Labels.end());
+
+    unsigned int numLabels = m_Labels.size();
+    m_LabelIndexes.resize(numValues);
+    threader->ParallelizeArray(0, numChunks, [&](itk::SizeValueType chunk)
+    {
+        LabelType previousLabel = 0;
+        unsigned int previousIndex = numLabels;
+
+        std::size_t endValue = std::min(numValues,(chunk + 1) * chunkSize);
+        for (std::size_t i = chunk * chunkSize;i < endValue;++i)
+        {
+            if (labels[i] != previousLabel)
+            {
+                previousLabel = labels[i];
+                previousIndex = numLabels;
+                if (previousLabel != 0)
+                    previousIndex = std::lower_bound(m_Labels.begin(),m_Labels.end(),previousLabel) - m_Labels.begin();
+            }
+
+            m_LabelIndexes[i] = previousIndex;
+        }
+    }, nullptr);
+
+    m_Moments.clear();
+    m_Values.clear();
+}
+
+template <class LabelType>
+template <class ScalarType>
+void
+LabelStatisticsAccumulator <LabelType>
+::Update(const ScalarType *values)
+{
+    unsigned int numLabels = m_Labels.size();
+    std::size_t numChunks = this->GetNumberOfChunks();
+    std::size_t chunkSize = (m_NumberOfValues + numChunks - 1) / numChunks;
+
+    std::vector < std::vector <Moments> > chunkMoments(numChunks, std::vector <Moments> (numLabels));
+    std::vector < std::vector < std::vector <double> > > chunkValues(numChunks);
+    if (m_KeepValues)
+    {
+        for (std::size_t chunk = 0;chunk < numChunks;++chunk)
+            chunkValues[chunk].resize(numLabels);
+    }
+
+    itk::MultiThreaderBase::Pointer threader = itk::MultiThreaderBase::New();
+    threader->SetNumberOfWorkUnits(m_NumberOfThreads);
+    threader->ParallelizeArray(0, numChunks, [&](itk::SizeValueType chunk)
+    {
+        std::vector <Moments> &moments = chunkMoments[chunk];
+        std::size_t endValue = std::min(m_NumberOfValues,(chunk + 1) * chunkSize);
+        for (std::size_t i = chunk * chunkSize;i < endValue;++i)
+        {
+            unsigned int labelIndex = m_LabelIndexes[i];
+            if (labelIndex == numLabels)
+                continue;
+
+            double value = values[i];
+            moments[labelIndex].AddValue(value);
+            if (m_KeepValues)
+                chunkValues[chunk][labelIndex].push_back(value);
+        }
+    }, nullptr);
+
+    m_Moments.assign(numLabels,Moments());
+    m_Values.clear();
+    if (m_KeepValues)
+        m_Values.resize(numLabels);
+
+    for (unsigned int j = 0;j < numLabels;++j)
+    {
+        for (std::size_t chunk = 0;chunk < numChunks;++chunk)
+        {
+            m_Moments[j].Merge(chunkMoments[chunk][j]);
+            if (m_KeepValues)
+                m_Values[j].insert(m_Values[j].end(),chunkValues[chunk][j].begin(),chunkValues[chunk][j].end());
+        }
+    }
+}
+
+template <class LabelType>
+double
+LabelStatisticsAccumulator <LabelType>
+::GetQuantile(unsigned int labelIndex, double quantile)
+{
+    if (labelIndex >= m_Values.size())
+        throw itk::ExceptionObject(__FILE__, __LINE__,"Values should be kept to compute quantiles",ITK_LOCATION);
+
+    std::vector <double> &labelValues = m_Values[labelIndex];
+    std::size_t numValues = labelValues.size();
+    if (numValues == 0)
+        return 0.0;
+
+    std::size_t rank = std::min(numValues - 1,(std::size_t)std::floor(quantile * numValues));
+    std::nth_element(labelValues.begin(),labelValues.begin() + rank,labelValues.end());
+
+    return labelValues[rank];
+}
+
+} // end namespace anima
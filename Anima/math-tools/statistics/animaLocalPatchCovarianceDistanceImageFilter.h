@@ -10,6 +10,14 @@
 namespace anima
 {
 
+/**
+ * \brief Computes, at each voxel, the average and standard deviation of log-Euclidean distances between the local patch
+ * covariances of all pairs of database images.
+ *
+ * Each patch covariance logarithm is computed once per image and voxel, and stored in a packed symmetric form (off-diagonal
+ * terms weighted by sqrt(2)) so that pairwise distances are plain Euclidean norms. Patch sums are updated incrementally
+ * when sliding along scanlines, only the entering and leaving planes of the patch being visited.
+ */
 template <class PixelScalarType>
 class LocalPatchCovarianceDistanceImageFilter :
 public anima::MaskedImageToImageFilter< itk::VectorImage <PixelScalarType, 3> , itk::Image <PixelScalarType, 3> >
@@ -57,9 +65,16 @@ protected:
 
     virtual ~LocalPatchCovarianceDistanceImageFilter() {}
 
+    //! Inputs are requested on the output requested region padded by the patch half size, allowing streaming
+    void GenerateInputRequestedRegion() ITK_OVERRIDE;
+
     void BeforeThreadedGenerateData() ITK_OVERRIDE;
     void DynamicThreadedGenerateData(const OutputImageRegionType &outputRegionForThread) ITK_OVERRIDE;
 
+    //! Adds (weight = 1) or removes (weight = -1) a plane of voxels, centered by shifts, from first and second order sums of all images
+    void UpdatePatchSums(const OutputImageRegionType &planeRegion, double weight, const vnl_matrix <double> &shifts,
+                         vnl_matrix <double> &firstOrderSums, vnl_matrix <double> &secondOrderSums);
+
 private:
     ITK_DISALLOW_COPY_AND_ASSIGN(LocalPatchCovarianceDistanceImageFilter);
 
@@ -1,14 +1,35 @@
 #pragma once
 #include "animaLocalPatchCovarianceDistanceImageFilter.h"
 
-#include <itkImageRegionIteratorWithIndex.h>
+#include <itkImageRegionConstIterator.h>
+#include <itkImageRegionConstIteratorWithIndex.h>
 #include <itkSymmetricEigenAnalysis.h>
-
-#include <animaVectorImagePatchStatistics.h>
+#include <vnl/vnl_diag_matrix.h>
 
 namespace anima
 {
 
+template <class PixelScalarType>
+void
+LocalPatchCovarianceDistanceImageFilter<PixelScalarType>
+::GenerateInputRequestedRegion()
+{
+    Superclass::GenerateInputRequestedRegion();
+
+    for (unsigned int i = 0;i < this->GetNumberOfIndexedInputs();++i)
+    {
+        InputImageType *input = const_cast <InputImageType *> (this->GetInput(i));
+        if (!input)
+            continue;
+
+        typename InputImageType::RegionType requestedRegion = input->GetRequestedRegion();
+        requestedRegion.PadByRadius(m_PatchHalfSize);
+        requestedRegion.Crop(input->GetLargestPossibleRegion());
+
+        input->SetRequestedRegion(requestedRegion);
+    }
+}
+
 template <class PixelScalarType>
 void
 LocalPatchCovarianceDistanceImageFilter<PixelScalarType>
@@ -28,87 +49,226 @@ void
 LocalPatchCovarianceDistanceImageFilter<PixelScalarType>
 ::DynamicThreadedGenerateData(const OutputImageRegionType &outputRegionForThread)
 {
-    typedef itk::ImageRegionIteratorWithIndex< OutputImageType > OutRegionIteratorType;
     typedef itk::ImageRegionConstIteratorWithIndex < MaskImageType > MaskRegionIteratorType;
 
-    OutRegionIteratorType outMeanIterator(this->GetOutput(0), outputRegionForThread);
-    OutRegionIteratorType outStdIterator(this->GetOutput(1), outputRegionForThread);
-
-    MaskRegionIteratorType maskIterator (this->GetComputationMask(), outputRegionForThread);
+    MaskImageType *maskImage = this->GetComputationMask();
+    OutputImageType *outMeanImage = this->GetOutput(0);
+    OutputImageType *outStdImage = this->GetOutput(1);
 
     unsigned int numSamplesDatabase = this->GetNumberOfIndexedInputs();
+    unsigned int numDistances = numSamplesDatabase * (numSamplesDatabase + 1) / 2 - numSamplesDatabase;
 
     unsigned int ndim = this->GetInput(0)->GetNumberOfComponentsPerPixel();
-    CovarianceType baseVar(ndim,ndim,0);
-    VectorType patchMean(ndim);
+    unsigned int packedSize = ndim * (ndim + 1) / 2;
 
-    std::vector <CovarianceType> varianceVector(numSamplesDatabase, baseVar);
-    std::vector <CovarianceType> logVarianceVector(numSamplesDatabase, baseVar);
-    OutputImageRegionType tmpBlockRegion;
-
-    unsigned int numDistances = numSamplesDatabase * (numSamplesDatabase + 1) / 2 - numSamplesDatabase;
+    // Patch sums of all images, centered by a per scanline shift to avoid cancellations
+    vnl_matrix <double> shifts(numSamplesDatabase,ndim);
+    vnl_matrix <double> firstOrderSums(numSamplesDatabase,ndim);
+    vnl_matrix <double> secondOrderSums(numSamplesDatabase,packedSize);
+    vnl_matrix <double> packedLogCovariances(numSamplesDatabase,packedSize);
 
+    CovarianceType patchCovariance(ndim,ndim);
     CovarianceType eVec(ndim,ndim);
     vnl_diag_matrix <double> eVals(ndim);
     itk::SymmetricEigenAnalysis <vnl_matrix <double>, vnl_diag_matrix <double>, vnl_matrix <double> > EigenAnalysis(ndim);
 
+    // Scanlines go along the largest dimension of the processed region
+    unsigned int scanDimension = 0;
+    for (unsigned int i = 1;i < 3;++i)
+    {
+        if (outputRegionForThread.GetSize(i) > outputRegionForThread.GetSize(scanDimension))
+            scanDimension = i;
+    }
+
+    unsigned int scanLength = outputRegionForThread.GetSize(scanDimension);
+    OutputImageRegionType linesRegion = outputRegionForThread;
+    linesRegion.SetSize(scanDimension,1);
+
+    OutputImageRegionType largestRegionOut = outMeanImage->GetLargestPossibleRegion();
+    int lowestScanIndex = largestRegionOut.GetIndex(scanDimension);
+    int highestScanIndex = lowestScanIndex + largestRegionOut.GetSize(scanDimension) - 1;
+
+    MaskRegionIteratorType lineStartIterator(maskImage, linesRegion);
     InputImageIndexType curIndex;
-    OutputImageRegionType largestRegionOut = this->GetOutput(0)->GetLargestPossibleRegion();
+    OutputImageRegionType planeRegion;
 
-    while (!maskIterator.IsAtEnd())
+    while (!lineStartIterator.IsAtEnd())
     {
-        if (maskIterator.Get() == 0)
+        curIndex = lineStartIterator.GetIndex();
+
+        // Patch section orthogonal to the scanline, clipped to the image
+        unsigned int planeNumPixels = 1;
+        for (unsigned int i = 0;i < 3;++i)
         {
-            outMeanIterator.Set(0.0);
-            outStdIterator.Set(0.0);
+            if (i == scanDimension)
+            {
+                planeRegion.SetSize(i,1);
+                continue;
+            }
 
-            ++outMeanIterator;
-            ++outStdIterator;
-            ++maskIterator;
-            continue;
+            int lowerIndex = std::max((int)largestRegionOut.GetIndex(i),(int)curIndex[i] - (int)m_PatchHalfSize);
+            int upperIndex = std::min((int)(largestRegionOut.GetIndex(i) + largestRegionOut.GetSize(i)) - 1,(int)curIndex[i] + (int)m_PatchHalfSize);
+            planeRegion.SetIndex(i,lowerIndex);
+            planeRegion.SetSize(i,upperIndex - lowerIndex + 1);
+            planeNumPixels *= upperIndex - lowerIndex + 1;
         }
 
-        curIndex = maskIterator.GetIndex();
+        bool validWindow = false;
+        int windowStart = 0;
+        int windowEnd = -1;
 
-        for (unsigned int i = 0;i < 3;++i)
+        int lineStartIndex = curIndex[scanDimension];
+        for (unsigned int pos = 0;pos < scanLength;++pos)
         {
-            tmpBlockRegion.SetIndex(i,std::max(0,(int)curIndex[i] - (int)m_PatchHalfSize));
-            tmpBlockRegion.SetSize(i,std::min((unsigned int)(largestRegionOut.GetSize()[i] - 1),(unsigned int)(curIndex[i] + m_PatchHalfSize)) - tmpBlockRegion.GetIndex(i) + 1);
-        }
+            curIndex[scanDimension] = lineStartIndex + pos;
 
-        for (unsigned int i = 0;i < numSamplesDatabase;++i)
-        {
-            anima::computePatchMeanAndCovariance(this->GetInput(i),tmpBlockRegion,patchMean,varianceVector[i]);
-            EigenAnalysis.ComputeEigenValuesAndVectors(varianceVector[i], eVals, eVec);
+            if (maskImage->GetPixel(curIndex) == 0)
+            {
+                outMeanImage->SetPixel(curIndex,0.0);
+                outStdImage->SetPixel(curIndex,0.0);
+                continue;
+            }
 
-            for (unsigned int j = 0;j < ndim;++j)
-                eVals[j] = log(eVals[j]);
+            int newWindowStart = std::max(lowestScanIndex,(int)curIndex[scanDimension] - (int)m_PatchHalfSize);
+            int newWindowEnd = std::min(highestScanIndex,(int)curIndex[scanDimension] + (int)m_PatchHalfSize);
 
-            logVarianceVector[i] = eVec.transpose() * eVals * eVec;
-        }
+            // Sliding costs two planes per step, recomputing costs the whole patch: choose the cheapest
+            if ((!validWindow) || (2 * (newWindowEnd - windowEnd) > newWindowEnd - newWindowStart + 1))
+            {
+                for (unsigned int i = 0;i < numSamplesDatabase;++i)
+                {
+                    VectorType shiftValue = this->GetInput(i)->GetPixel(curIndex);
+                    for (unsigned int j = 0;j < ndim;++j)
+                        shifts(i,j) = shiftValue[j];
+                }
 
-        double meanDist = 0;
-        double varDist = 0;
-        for (unsigned int i = 0;i < numSamplesDatabase;++i)
-            for (unsigned int j = i+1;j < numSamplesDatabase;++j)
+                firstOrderSums.fill(0.0);
+                secondOrderSums.fill(0.0);
+                windowStart = newWindowStart;
+                windowEnd = newWindowStart - 1;
+                validWindow = true;
+            }
+
+            for (;windowStart < newWindowStart;++windowStart)
             {
-                double tmpDist = anima::VectorCovarianceTest(logVarianceVector[i], varianceVector[j]);
-                meanDist += tmpDist;
-                varDist += tmpDist * tmpDist;
+                planeRegion.SetIndex(scanDimension,windowStart);
+                this->UpdatePatchSums(planeRegion,-1.0,shifts,firstOrderSums,secondOrderSums);
             }
 
-        varDist /= numDistances;
-        meanDist /= numDistances;
-        varDist -= meanDist * meanDist;
-        varDist *= numDistances / (numDistances - 1.0);
+            for (;windowEnd < newWindowEnd;++windowEnd)
+            {
+                planeRegion.SetIndex(scanDimension,windowEnd + 1);
+                this->UpdatePatchSums(planeRegion,1.0,shifts,firstOrderSums,secondOrderSums);
+            }
 
-        outMeanIterator.Set(meanDist);
-        outStdIterator.Set(sqrt(varDist));
+            double numPixels = planeNumPixels * (windowEnd - windowStart + 1.0);
 
-        this->IncrementNumberOfProcessedPoints();
-        ++outMeanIterator;
-        ++outStdIterator;
-        ++maskIterator;
+            // Packed covariance logarithms, computed once per image
+            for (unsigned int i = 0;i < numSamplesDatabase;++i)
+            {
+                unsigned int packedPos = 0;
+                for (unsigned int j = 0;j < ndim;++j)
+                    for (unsigned int k = j;k < ndim;++k)
+                    {
+                        patchCovariance(j,k) = (secondOrderSums(i,packedPos) - firstOrderSums(i,j) * firstOrderSums(i,k) / numPixels) / (numPixels - 1.0);
+                        patchCovariance(k,j) = patchCovariance(j,k);
+                        ++packedPos;
+                    }
+
+                EigenAnalysis.ComputeEigenValuesAndVectors(patchCovariance, eVals, eVec);
+
+                for (unsigned int j = 0;j < ndim;++j)
+                    eVals[j] = std::log(eVals[j]);
+
+                packedPos = 0;
+                for (unsigned int j = 0;j < ndim;++j)
+                    for (unsigned int k = j;k < ndim;++k)
+                    {
+                        double logValue = 0;
+                        for (unsigned int l = 0;l < ndim;++l)
+                            logValue += eVec(l,j) * eVals[l] * eVec(l,k);
+
+                        if (j != k)
+                            logValue *= M_SQRT2;
+
+                        packedLogCovariances(i,packedPos) = logValue;
+                        ++packedPos;
+                    }
+            }
+
+            double meanDist = 0;
+            double varDist = 0;
+            for (unsigned int i = 0;i < numSamplesDatabase;++i)
+            {
+                const double *firstLog = packedLogCovariances[i];
+                for (unsigned int j = i+1;j < numSamplesDatabase;++j)
+                {
+                    const double *secondLog = packedLogCovariances[j];
+                    double tmpDist = 0;
+                    for (unsigned int k = 0;k < packedSize;++k)
+                        tmpDist += (firstLog[k] - secondLog[k]) * (firstLog[k] - secondLog[k]);
+
+                    tmpDist = std::sqrt(tmpDist);
+                    meanDist += tmpDist;
+                    varDist += tmpDist * tmpDist;
+                }
+            }
+
+            varDist /= numDistances;
+            meanDist /= numDistances;
+            varDist -= meanDist * meanDist;
+            varDist *= numDistances / (numDistances - 1.0);
+
+            outMeanImage->SetPixel(curIndex,meanDist);
+            outStdImage->SetPixel(curIndex,std::sqrt(varDist));
+
+            this->IncrementNumberOfProcessedPoints();
+        }
+
+        ++lineStartIterator;
+    }
+}
+
+template <class PixelScalarType>
+void
+LocalPatchCovarianceDistanceImageFilter<PixelScalarType>
+::UpdatePatchSums(const OutputImageRegionType &planeRegion, double weight, const vnl_matrix <double> &shifts,
+                  vnl_matrix <double> &firstOrderSums, vnl_matrix <double> &secondOrderSums)
+{
+    typedef itk::ImageRegionConstIterator <InputImageType> InIteratorType;
+
+    unsigned int numSamplesDatabase = this->GetNumberOfIndexedInputs();
+    unsigned int ndim = shifts.columns();
+    std::vector <double> centeredValue(ndim);
+
+    for (unsigned int i = 0;i < numSamplesDatabase;++i)
+    {
+        InIteratorType inputIterator(this->GetInput(i), planeRegion);
+        double *firstOrderSum = firstOrderSums[i];
+        double *secondOrderSum = secondOrderSums[i];
+
+        while (!inputIterator.IsAtEnd())
+        {
+            const VectorType &inputValue = inputIterator.Get();
+            for (unsigned int j = 0;j < ndim;++j)
+            {
+                centeredValue[j] = inputValue[j] - shifts(i,j);
+                firstOrderSum[j] += weight * centeredValue[j];
+            }
+
+            unsigned int packedPos = 0;
+            for (unsigned int j = 0;j < ndim;++j)
+            {
+                double weightedValue = weight * centeredValue[j];
+                for (unsigned int k = j;k < ndim;++k)
+                {
+                    secondOrderSum[packedPos] += weightedValue * centeredValue[k];
+                    ++packedPos;
+                }
+            }
+
+            ++inputIterator;
+        }
     }
 }
 
@@ -10,6 +10,17 @@
 namespace anima
 {
 
+/**
+ * \class LocalPatchMeanDistanceImageFilter
+ * @brief Computes, in each voxel, the mean and standard deviation of the distances between patch means of all pairs
+ * of database images (inputs).
+ *
+ * Patch means and covariances are read from VectorImagePatchMomentsTable summed-area tables, built slice by slice.
+ * Each thread holds one table per database image, of (X + 2r + 1) x (Y + 2r + 1) x (n + n(n+1)/2) doubles, with X x Y
+ * the in-plane size of its region, r the patch half size and n the number of components. E.g. for 256 x 256 slices,
+ * r = 1 and 6 components, this is about 14 MB per database image and thread: the number of threads should be lowered
+ * for large databases.
+ */
 template <class PixelScalarType>
 class LocalPatchMeanDistanceImageFilter :
 public anima::MaskedImageToImageFilter< itk::VectorImage <PixelScalarType, 3> , itk::Image <PixelScalarType, 3> >
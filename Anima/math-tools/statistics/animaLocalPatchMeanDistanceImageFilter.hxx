@@ -30,11 +30,7 @@ LocalPatchMeanDistanceImageFilter<PixelScalarType>
 {
     typedef itk::ImageRegionIteratorWithIndex< OutputImageType > OutRegionIteratorType;
     typedef itk::ImageRegionConstIteratorWithIndex < MaskImageType > MaskRegionIteratorType;
-
-    OutRegionIteratorType outMeanIterator(this->GetOutput(0), outputRegionForThread);
-    OutRegionIteratorType outStdIterator(this->GetOutput(1), outputRegionForThread);
-
-    MaskRegionIteratorType maskIterator (this->GetComputationMask(), outputRegionForThread);
+    typedef anima::VectorImagePatchMomentsTable <PixelScalarType, 3> MomentsTableType;
 
     unsigned int numSamplesDatabase = this->GetNumberOfIndexedInputs();
 
@@ -52,53 +48,82 @@ LocalPatchMeanDistanceImageFilter<PixelScalarType>
     InputImageIndexType curIndex;
     OutputImageRegionType largestRegionOut = this->GetOutput(0)->GetLargestPossibleRegion();
 
-    while (!maskIterator.IsAtEnd())
-    {
-        if (maskIterator.Get() == 0)
-        {
-            outMeanIterator.Set(0.0);
-            outStdIterator.Set(0.0);
+    // Patch moments are read from summed-area tables, computed slice by slice over the slice of the thread region
+    // padded by the patch half size, and summed over the patch extent across slices (one table per database image,
+    // see the class documentation for their memory footprint)
+    std::vector <MomentsTableType> momentsTables(numSamplesDatabase);
+    OutputImageRegionType sliceRegion = outputRegionForThread;
+    sliceRegion.SetSize(2,1);
 
-            ++outMeanIterator;
-            ++outStdIterator;
-            ++maskIterator;
-            continue;
-        }
+    for (unsigned int z = 0;z < outputRegionForThread.GetSize(2);++z)
+    {
+        sliceRegion.SetIndex(2,outputRegionForThread.GetIndex(2) + z);
 
-        curIndex = maskIterator.GetIndex();
+        OutRegionIteratorType outMeanIterator(this->GetOutput(0), sliceRegion);
+        OutRegionIteratorType outStdIterator(this->GetOutput(1), sliceRegion);
+        MaskRegionIteratorType maskIterator (this->GetComputationMask(), sliceRegion);
 
-        for (unsigned int i = 0;i < 3;++i)
+        bool tablesComputed = false;
+        while (!maskIterator.IsAtEnd())
         {
-            tmpBlockRegion.SetIndex(i,std::max(0,(int)curIndex[i] - (int)m_PatchHalfSize));
-            tmpBlockRegion.SetSize(i,std::min((unsigned int)(largestRegionOut.GetSize()[i] - 1),(unsigned int)(curIndex[i] + m_PatchHalfSize)) - tmpBlockRegion.GetIndex(i) + 1);
-        }
+            if (maskIterator.Get() == 0)
+            {
+                outMeanIterator.Set(0.0);
+                outStdIterator.Set(0.0);
 
-        for (unsigned int i = 0;i < numSamplesDatabase;++i)
-            numPixels[i] = anima::computePatchMeanAndCovariance(this->GetInput(i),tmpBlockRegion,meanVectors[i],varianceVector[i]);
+                ++outMeanIterator;
+                ++outStdIterator;
+                ++maskIterator;
+                continue;
+            }
 
-        double meanDist = 0;
-        double varDist = 0;
-        for (unsigned int i = 0;i < numSamplesDatabase;++i)
-            for (unsigned int j = i+1;j < numSamplesDatabase;++j)
+            if (!tablesComputed)
             {
-                double tmpDist = anima::VectorMeansTest(meanVectors[i], meanVectors[j], numPixels[i], numPixels[j],
-                                                        varianceVector[i], varianceVector[j]);
-                meanDist += tmpDist;
-                varDist += tmpDist * tmpDist;
+                OutputImageRegionType tableRegion = sliceRegion;
+                tableRegion.PadByRadius(m_PatchHalfSize);
+                tableRegion.Crop(largestRegionOut);
+
+                for (unsigned int i = 0;i < numSamplesDatabase;++i)
+                    momentsTables[i].Initialize(this->GetInput(i),tableRegion);
+
+                tablesComputed = true;
             }
 
-        varDist /= numDistances;
-        meanDist /= numDistances;
-        varDist -= meanDist * meanDist;
-        varDist *= numDistances / (numDistances - 1.0);
+            curIndex = maskIterator.GetIndex();
 
-        outMeanIterator.Set(meanDist);
-        outStdIterator.Set(std::sqrt(varDist));
+            for (unsigned int i = 0;i < 3;++i)
+            {
+                tmpBlockRegion.SetIndex(i,std::max(0,(int)curIndex[i] - (int)m_PatchHalfSize));
+                tmpBlockRegion.SetSize(i,std::min((unsigned int)(largestRegionOut.GetSize()[i] - 1),(unsigned int)(curIndex[i] + m_PatchHalfSize)) - tmpBlockRegion.GetIndex(i) + 1);
+            }
 
-        this->IncrementNumberOfProcessedPoints();
-        ++outMeanIterator;
-        ++outStdIterator;
-        ++maskIterator;
+            for (unsigned int i = 0;i < numSamplesDatabase;++i)
+                numPixels[i] = momentsTables[i].ComputePatchMeanAndCovariance(tmpBlockRegion,meanVectors[i],varianceVector[i]);
+
+            double meanDist = 0;
+            double varDist = 0;
+            for (unsigned int i = 0;i < numSamplesDatabase;++i)
+                for (unsigned int j = i+1;j < numSamplesDatabase;++j)
+                {
+                    double tmpDist = anima::VectorMeansTest(meanVectors[i], meanVectors[j], numPixels[i], numPixels[j],
+                                                            varianceVector[i], varianceVector[j]);
+                    meanDist += tmpDist;
+                    varDist += tmpDist * tmpDist;
+                }
+
+            varDist /= numDistances;
+            meanDist /= numDistances;
+            varDist -= meanDist * meanDist;
+            varDist *= numDistances / (numDistances - 1.0);
+
+            outMeanIterator.Set(meanDist);
+            outStdIterator.Set(std::sqrt(varDist));
+
+            this->IncrementNumberOfProcessedPoints();
+            ++outMeanIterator;
+            ++outStdIterator;
+            ++maskIterator;
+        }
     }
 }
 
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <itkVectorImage.h>
+#include <vector>
 
 namespace anima
 {
@@ -10,6 +11,41 @@ template <class T1, class T2, unsigned int Dimension>
 unsigned int computePatchMeanAndCovariance(const itk::VectorImage <T1, Dimension> *inputImage, const itk::ImageRegion<Dimension> &patchRegion,
                                            itk::VariableLengthVector <T2> &patchMean, vnl_matrix <T2> &patchCov);
 
+/**
+ * \brief Summed-area tables of the first and second order moments of a vector image over a region.
+ *
+ * Tables run along the first two dimensions of the region, the other dimensions being summed over the whole region.
+ * The mean and covariance of any patch spanning the region along those other dimensions (e.g. all patches centered
+ * on a slice, the region covering the patch extent across slices) are then obtained from four table lookups, whatever
+ * the patch size. Values are shifted by the first voxel of the region before summation to limit cancellation when
+ * computing covariances.
+ */
+template <class T1, unsigned int Dimension>
+class VectorImagePatchMomentsTable
+{
+public:
+    typedef itk::VectorImage <T1, Dimension> ImageType;
+    typedef itk::ImageRegion <Dimension> RegionType;
+
+    VectorImagePatchMomentsTable() : m_NumberOfComponents(0), m_NumberOfMoments(0) {}
+
+    //! Computes the tables of inputImage over region
+    void Initialize(const ImageType *inputImage, const RegionType &region);
+
+    //! Same as computePatchMeanAndCovariance, patchRegion being inside the table region and spanning it beyond the first two dimensions
+    template <class T2>
+    unsigned int ComputePatchMeanAndCovariance(const RegionType &patchRegion, itk::VariableLengthVector <T2> &patchMean,
+                                               vnl_matrix <T2> &patchCov) const;
+
+private:
+    RegionType m_Region;
+    unsigned int m_NumberOfComponents, m_NumberOfMoments;
+    std::vector <double> m_Reference;
+
+    //! Moments summed over [0,x[ x [0,y[ (relative to the region start) at position (y * (sizeX + 1) + x) * numMoments
+    std::vector <double> m_Table;
+};
+
 //! Noise estimation for a patch of a vector image
 template <class T1, class T2, unsigned int Dimension>
 void computeAverageLocalCovariance(vnl_matrix <T2> &resVariance, itk::VectorImage <T1, Dimension> *inputImage,
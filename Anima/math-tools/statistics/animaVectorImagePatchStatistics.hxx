@@ -61,6 +61,127 @@ unsigned int computePatchMeanAndCovariance(const itk::VectorImage <T1, Dimension
     return numPixels;
 }
 
+template <class T1, unsigned int Dimension>
+void
+VectorImagePatchMomentsTable <T1, Dimension>
+::Initialize(const ImageType *inputImage, const RegionType &region)
+{
+    static_assert(Dimension >= 2, "Patch moments tables need at least two dimensions");
+
+    m_Region = region;
+    m_NumberOfComponents = inputImage->GetNumberOfComponentsPerPixel();
+    unsigned int ndim = m_NumberOfComponents;
+    m_NumberOfMoments = ndim + ndim * (ndim + 1) / 2;
+
+    unsigned int tableSizeX = region.GetSize()[0] + 1;
+    unsigned int tableSizeY = region.GetSize()[1] + 1;
+    m_Table.assign(tableSizeX * tableSizeY * m_NumberOfMoments,0.0);
+
+    const T1 *inputBuffer = inputImage->GetBufferPointer();
+    const T1 *referenceValue = inputBuffer + ndim * inputImage->ComputeOffset(region.GetIndex());
+    m_Reference.assign(referenceValue,referenceValue + ndim);
+
+    // Accumulates shifted moments of each voxel at its (x + 1, y + 1) table position
+    typedef itk::ImageRegionConstIteratorWithIndex <ImageType> InIteratorType;
+    InIteratorType imageIt(inputImage,region);
+    std::vector <double> shiftedValue(ndim);
+
+    while (!imageIt.IsAtEnd())
+    {
+        typename ImageType::IndexType currentIndex = imageIt.GetIndex();
+        const T1 *currentValue = inputBuffer + ndim * inputImage->ComputeOffset(currentIndex);
+        for (unsigned int i = 0;i < ndim;++i)
+            shiftedValue[i] = currentValue[i] - m_Reference[i];
+
+        unsigned int x = currentIndex[0] - region.GetIndex()[0] + 1;
+        unsigned int y = currentIndex[1] - region.GetIndex()[1] + 1;
+        double *tableCell = &m_Table[(y * tableSizeX + x) * m_NumberOfMoments];
+
+        unsigned int pos = ndim;
+        for (unsigned int i = 0;i < ndim;++i)
+        {
+            tableCell[i] += shiftedValue[i];
+            for (unsigned int j = i;j < ndim;++j)
+            {
+                tableCell[pos] += shiftedValue[i] * shiftedValue[j];
+                ++pos;
+            }
+        }
+
+        ++imageIt;
+    }
+
+    // Cumulative sums along x, then along y
+    for (unsigned int y = 1;y < tableSizeY;++y)
+    {
+        for (unsigned int x = 2;x < tableSizeX;++x)
+        {
+            double *tableCell = &m_Table[(y * tableSizeX + x) * m_NumberOfMoments];
+            const double *previousCell = tableCell - m_NumberOfMoments;
+            for (unsigned int k = 0;k < m_NumberOfMoments;++k)
+                tableCell[k] += previousCell[k];
+        }
+    }
+
+    for (unsigned int y = 2;y < tableSizeY;++y)
+    {
+        for (unsigned int x = 1;x < tableSizeX;++x)
+        {
+            double *tableCell = &m_Table[(y * tableSizeX + x) * m_NumberOfMoments];
+            const double *previousCell = tableCell - tableSizeX * m_NumberOfMoments;
+            for (unsigned int k = 0;k < m_NumberOfMoments;++k)
+                tableCell[k] += previousCell[k];
+        }
+    }
+}
+
+template <class T1, unsigned int Dimension>
+template <class T2>
+unsigned int
+VectorImagePatchMomentsTable <T1, Dimension>
+::ComputePatchMeanAndCovariance(const RegionType &patchRegion, itk::VariableLengthVector <T2> &patchMean,
+                                vnl_matrix <T2> &patchCov) const
+{
+    unsigned int ndim = m_NumberOfComponents;
+    if (patchMean.GetSize() != ndim)
+        patchMean.SetSize(ndim);
+
+    patchCov.set_size(ndim,ndim);
+
+    unsigned int tableSizeX = m_Region.GetSize()[0] + 1;
+    unsigned int xStart = patchRegion.GetIndex()[0] - m_Region.GetIndex()[0];
+    unsigned int xEnd = xStart + patchRegion.GetSize()[0];
+    unsigned int yStart = patchRegion.GetIndex()[1] - m_Region.GetIndex()[1];
+    unsigned int yEnd = yStart + patchRegion.GetSize()[1];
+
+    const double *cornerEE = &m_Table[(yEnd * tableSizeX + xEnd) * m_NumberOfMoments];
+    const double *cornerES = &m_Table[(yEnd * tableSizeX + xStart) * m_NumberOfMoments];
+    const double *cornerSE = &m_Table[(yStart * tableSizeX + xEnd) * m_NumberOfMoments];
+    const double *cornerSS = &m_Table[(yStart * tableSizeX + xStart) * m_NumberOfMoments];
+
+    unsigned int numPixels = patchRegion.GetSize()[0] * patchRegion.GetSize()[1];
+    for (unsigned int i = 2;i < Dimension;++i)
+        numPixels *= m_Region.GetSize()[i];
+
+    std::vector <double> patchMoments(m_NumberOfMoments);
+    for (unsigned int k = 0;k < m_NumberOfMoments;++k)
+        patchMoments[k] = cornerEE[k] - cornerES[k] - cornerSE[k] + cornerSS[k];
+
+    unsigned int pos = ndim;
+    for (unsigned int i = 0;i < ndim;++i)
+    {
+        patchMean[i] = m_Reference[i] + patchMoments[i] / numPixels;
+        for (unsigned int j = i;j < ndim;++j)
+        {
+            patchCov(i,j) = (patchMoments[pos] - patchMoments[i] * patchMoments[j] / numPixels) / (numPixels - 1.0);
+            patchCov(j,i) = patchCov(i,j);
+            ++pos;
+        }
+    }
+
+    return numPixels;
+}
+
 template <class T1, class T2, unsigned int Dimension>
 void computeAverageLocalCovariance(vnl_matrix <T2> &resVariance, itk::VectorImage <T1, Dimension> *inputImage,
                                    itk::Image<unsigned char, Dimension> *maskImage, const itk::ImageRegion<Dimension> &averagingRegion,
@@ -2,8 +2,6 @@
 #include <tclap/CmdLine.h>
 
 #include <itkTimeProbe.h>
-#include <itkImageConstIterator.h>
-#include <itkImageRegionConstIterator.h>
 #include <itkImageRegionConstIteratorWithIndex.h>
 #include <animaReadWriteFunctions.h>
 
@@ -31,8 +29,28 @@ int main(int argc, char **argv)
 
     MaskIterator iterMaskImage(maskImage,maskImage->GetRequestedRegion());
 
+    // Mask is scanned once: samples are then gathered from each image buffer at these offsets
+    std::vector<unsigned int> xSample;
+    std::vector<unsigned int> ySample;
+    std::vector<unsigned int> zSample;
+    std::vector<size_t> sampleOffsets;
+    size_t currentOffset = 0;
+
+    while (!iterMaskImage.IsAtEnd())
+    {
+        if (iterMaskImage.Value() != 0)
+        {
+            xSample.push_back(iterMaskImage.GetIndex()[0]);
+            ySample.push_back(iterMaskImage.GetIndex()[1]);
+            zSample.push_back(iterMaskImage.GetIndex()[2]);
+            sampleOffsets.push_back(currentOffset);
+        }
+
+        ++currentOffset;
+        ++iterMaskImage;
+    }
+
     typedef itk::Image <double, 3> ImageType;
-    typedef itk::ImageRegionConstIterator<ImageType>  ImageIterator;
 
     // load filenames file
     std::ifstream fileIn(dataListArg.getValue());
@@ -40,11 +58,8 @@ int main(int argc, char **argv)
     std::vector< std::vector<double> > allSamples;
     std::string oneLine;
 
-    unsigned int nbImg=0;
     std::vector<std::string> labels;
-    std::vector<unsigned int> xSample;
-    std::vector<unsigned int> ySample;
-    std::vector<unsigned int> zSample;
+    unsigned int numSamples = sampleOffsets.size();
     
     while (std::getline(fileIn, oneLine))
     {
@@ -63,32 +78,20 @@ int main(int argc, char **argv)
             labels.pop_back();
             continue;
         }
-        ImageIterator iterCurrentImage( ltReader, ltReader->GetRequestedRegion() );
 
-        iterMaskImage.GoToBegin();
-        iterCurrentImage.GoToBegin();
-        std::vector<double> oneSample;
-        while(!iterCurrentImage.IsAtEnd())
+        if (ltReader->GetBufferedRegion().GetNumberOfPixels() != currentOffset)
         {
-            if(iterMaskImage.Value()!=0)
-            {    oneSample.push_back(iterCurrentImage.Value());
-
-                if(nbImg==0)
-                {
-                    const unsigned int x=iterCurrentImage.GetIndex()[0];
-                    const unsigned int y=iterCurrentImage.GetIndex()[1];
-                    const unsigned int z=iterCurrentImage.GetIndex()[2];
-                    xSample.push_back(x);
-                    ySample.push_back(y);
-                    zSample.push_back(z);
-                }
-            }
-
-            ++iterMaskImage;
-            ++iterCurrentImage;
+            std::cout<<"file for field "<<labels.back()<<" does not match the mask size"<<std::endl;
+            labels.pop_back();
+            continue;
         }
+
+        const double *imageBuffer = ltReader->GetBufferPointer();
+        std::vector<double> oneSample(numSamples);
+        for (unsigned int i = 0;i < numSamples;++i)
+            oneSample[i] = imageBuffer[sampleOffsets[i]];
+
         allSamples.push_back(oneSample);
-        ++nbImg;
     }
 
     if (resNameArg.getValue() != "")
@@ -105,7 +108,7 @@ int main(int argc, char **argv)
         file<<",indexX,indexY,indexZ";
         file<<std::endl;
 
-        for(unsigned int indexJ=0;indexJ<allSamples[0].size();++indexJ)
+        for(unsigned int indexJ=0;indexJ<numSamples;++indexJ)
         {
             for(unsigned int indexI=0;indexI<allSamples.size();++indexI)
             {
@@ -0,0 +1,116 @@
+#include <cmath>
+#include <algorithm>
+#include <iostream>
+#include <random>
+
+#include <animaLabelStatisticsAccumulator.h>
+
+int main()
+{
+    std::mt19937 generator(2024);
+
+    // Labels come in runs of random length as in label images, some labels being absent, values having a large offset
+    // so that inaccurate variance formulas would show
+    const std::size_t numValues = 200000;
+    const unsigned short maxLabel = 9;
+    std::uniform_int_distribution <unsigned short> labelDistribution(0, maxLabel);
+    std::uniform_int_distribution <unsigned int> runDistribution(1, 40);
+    std::normal_distribution <double> valueDistribution(0.0, 1.0);
+
+    std::vector <unsigned short> labels(numValues);
+    std::vector <double> values(numValues);
+    std::size_t pos = 0;
+    while (pos < numValues)
+    {
+        unsigned short label = labelDistribution(generator);
+        if (label == 4)
+            label = 0;
+
+        unsigned int runLength = runDistribution(generator);
+        for (unsigned int i = 0;(i < runLength) && (pos < numValues);++i, ++pos)
+        {
+            labels[pos] = label;
+            values[pos] = 1.0e6 + 10.0 * label + (label + 1.0) * valueDistribution(generator);
+        }
+    }
+
+    // Some values are rounded so that medians are taken among ties
+    for (std::size_t i = 0;i < numValues;i += 3)
+        values[i] = std::round(values[i]);
+
+    bool testPassed = true;
+    const double tolerance = 1.0e-10;
+    for (unsigned int numThreads : {1, 4})
+    {
+        anima::LabelStatisticsAccumulator <unsigned short> labelStatistics;
+        labelStatistics.SetNumberOfThreads(numThreads);
+        labelStatistics.SetKeepValues(true);
+        labelStatistics.SetLabels(labels.data(),numValues);
+        labelStatistics.Update(values.data());
+
+        std::vector <unsigned short> refLabels;
+        for (unsigned short label = 1;label <= maxLabel;++label)
+        {
+            if (std::find(labels.begin(),labels.end(),label) != labels.end())
+                refLabels.push_back(label);
+        }
+
+        if (labelStatistics.GetLabels() != refLabels)
+        {
+            std::cerr << "Wrong labels with " << numThreads << " threads" << std::endl;
+            testPassed = false;
+            continue;
+        }
+
+        double maxMeanDeviation = 0.0;
+        double maxVarianceDeviation = 0.0;
+        bool orderStatisticsMatch = true;
+        for (unsigned int j = 0;j < refLabels.size();++j)
+        {
+            // Naive two pass statistics
+            std::vector <double> labelValues;
+            for (std::size_t i = 0;i < numValues;++i)
+            {
+                if (labels[i] == refLabels[j])
+                    labelValues.push_back(values[i]);
+            }
+
+            std::size_t count = labelValues.size();
+            double mean = 0.0;
+            for (double value : labelValues)
+                mean += value;
+
+            mean /= count;
+            double variance = 0.0;
+            for (double value : labelValues)
+                variance += (value - mean) * (value - mean);
+
+            variance /= (count - 1.0);
+
+            std::sort(labelValues.begin(),labelValues.end());
+            double median = labelValues[count / 2];
+
+            const anima::LabelStatisticsAccumulator <unsigned short>::Moments &moments = labelStatistics.GetMoments(j);
+            maxMeanDeviation = std::max(maxMeanDeviation, std::abs(moments.mean - mean) / std::abs(mean));
+            maxVarianceDeviation = std::max(maxVarianceDeviation, std::abs(moments.GetVariance() - variance) / variance);
+
+            if ((moments.count != count) || (moments.min != labelValues.front()) || (moments.max != labelValues.back())
+                    || (labelStatistics.GetQuantile(j,0.5) != median))
+                orderStatisticsMatch = false;
+        }
+
+        std::cout << numThreads << " threads: mean deviation " << maxMeanDeviation << ", variance deviation "
+                  << maxVarianceDeviation << std::endl;
+
+        if ((maxMeanDeviation > tolerance) || (maxVarianceDeviation > tolerance) || !orderStatisticsMatch)
+        {
+            std::cerr << "Label statistics differ from naive ones with " << numThreads << " threads" << std::endl;
+            testPassed = false;
+        }
+    }
+
+    if (!testPassed)
+        return EXIT_FAILURE;
+
+    return EXIT_SUCCESS;
+}
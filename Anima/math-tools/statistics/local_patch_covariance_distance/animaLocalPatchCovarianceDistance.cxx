@@ -2,6 +2,7 @@
 #include <tclap/CmdLine.h>
 
 #include <animaReadWriteFunctions.h>
+#include <animaStreamingFunctions.h>
 #include <animaLocalPatchCovarianceDistanceImageFilter.h>
 
 //Update progression of the process
@@ -25,6 +26,7 @@ int main(int argc, char **argv)
     TCLAP::ValueArg<unsigned int> nbpArg("p","numberofthreads","Number of threads to run on (default: all cores)",false,itk::MultiThreaderBase::GetGlobalDefaultNumberOfThreads(),"number of threads",cmd);
 
     TCLAP::ValueArg<unsigned int> patchHSArg("","patchhalfsize","Patch half size in each direction (default: 1)",false,1,"patch half size",cmd);
+    TCLAP::ValueArg<double> memoryArg("M","memory","Memory budget in MB for input images, processed by slabs to fit in it (default: 0, whole images in memory)",false,0,"memory budget",cmd);
     
     try
     {
@@ -37,6 +39,7 @@ int main(int argc, char **argv)
     }
     
     typedef itk::VectorImage<double,3> LogTensorImageType;
+    typedef itk::ImageFileReader <LogTensorImageType> ReaderType;
     typedef anima::LocalPatchCovarianceDistanceImageFilter<double> MainFilterType;
 
     itk::CStyleCommand::Pointer callback = itk::CStyleCommand::New();
@@ -49,6 +52,8 @@ int main(int argc, char **argv)
     mainFilter->SetPatchHalfSize(patchHSArg.getValue());
     mainFilter->AddObserver(itk::ProgressEvent(), callback);
 
+    // Readers are kept alive for the filter to request slabs from them
+    std::vector <ReaderType::Pointer> databaseReaders;
     std::ifstream fileIn(dataLTArg.getValue());
     
     unsigned int count = 0;
@@ -60,15 +65,35 @@ int main(int argc, char **argv)
         if (strcmp(tmpStr,"") == 0)
             continue;
         
-        std::cout << "Loading database image " << tmpStr << "..." << std::endl;
-        mainFilter->SetInput(count,anima::readImage <LogTensorImageType> (tmpStr));
+        // Images are only read when the filter requests them, slab by slab when streaming
+        std::cout << "Adding database image " << tmpStr << "..." << std::endl;
+        ReaderType::Pointer reader = ReaderType::New();
+        reader->SetFileName(tmpStr);
+        reader->UpdateOutputInformation();
+
+        mainFilter->SetInput(count,reader->GetOutput());
+        databaseReaders.push_back(reader);
         ++count;
     }
     fileIn.close();
 
+    if (count == 0)
+    {
+        std::cerr << "No database image found in " << dataLTArg.getValue() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    typedef itk::Image <double, 3> OutputImageType;
+    std::vector <OutputImageType::Pointer> outputImages;
+
     try
     {
-        mainFilter->Update();
+        double bytesPerVoxel = count * mainFilter->GetInput(0)->GetNumberOfComponentsPerPixel() * sizeof(double);
+        unsigned int numDivisions = anima::computeNumberOfStreamDivisions(mainFilter->GetInput(0)->GetLargestPossibleRegion(),
+                                                                          bytesPerVoxel,patchHSArg.getValue(),
+                                                                          memoryArg.getValue() * 1024.0 * 1024.0);
+
+        outputImages = anima::updateByStreamDivisions <OutputImageType> (mainFilter.GetPointer(),numDivisions);
     }
     catch(itk::ExceptionObject &e)
     {
@@ -76,10 +101,10 @@ int main(int argc, char **argv)
         return EXIT_FAILURE;
     }
     
-    anima::writeImage < itk::Image <double, 3> > (resArg.getValue(),mainFilter->GetOutput(0));
+    anima::writeImage <OutputImageType> (resArg.getValue(),outputImages[0]);
     
     if (resStdArg.getValue() != "")
-        anima::writeImage < itk::Image <double, 3> > (resStdArg.getValue(),mainFilter->GetOutput(1));
+        anima::writeImage <OutputImageType> (resStdArg.getValue(),outputImages[1]);
     
     return EXIT_SUCCESS;
 }
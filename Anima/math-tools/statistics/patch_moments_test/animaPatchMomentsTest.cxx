@@ -0,0 +1,115 @@
+#include <cmath>
+#include <algorithm>
+#include <iostream>
+#include <random>
+
+#include <animaVectorImagePatchStatistics.h>
+
+int main()
+{
+    const unsigned int Dimension = 3;
+    typedef itk::VectorImage <double, Dimension> ImageType;
+    typedef ImageType::RegionType RegionType;
+
+    const unsigned int ndim = 3;
+    RegionType largestRegion;
+    largestRegion.SetSize(0,13);
+    largestRegion.SetSize(1,11);
+    largestRegion.SetSize(2,6);
+
+    ImageType::Pointer image = ImageType::New();
+    image->SetRegions(largestRegion);
+    image->SetNumberOfComponentsPerPixel(ndim);
+    image->Allocate();
+
+    // Correlated random components with a large offset, so that covariances computed from raw moments would lose accuracy
+    std::mt19937 generator(42);
+    std::normal_distribution <double> valueDistribution(0.0, 1.0);
+    double *imageBuffer = image->GetBufferPointer();
+    for (unsigned int i = 0;i < largestRegion.GetNumberOfPixels();++i)
+    {
+        double firstValue = valueDistribution(generator);
+        imageBuffer[i * ndim] = 1.0e4 + firstValue;
+        imageBuffer[i * ndim + 1] = 1.0e4 + 0.5 * firstValue + valueDistribution(generator);
+        imageBuffer[i * ndim + 2] = 2.0e4 + 2.0 * valueDistribution(generator);
+    }
+
+    // Tables over the whole slice and over a sub-region, patches spanning the table region along z
+    RegionType tableRegions[2];
+    tableRegions[0] = largestRegion;
+    tableRegions[0].SetIndex(2,1);
+    tableRegions[0].SetSize(2,3);
+    tableRegions[1] = tableRegions[0];
+    tableRegions[1].SetIndex(0,2);
+    tableRegions[1].SetIndex(1,3);
+    tableRegions[1].SetSize(0,8);
+    tableRegions[1].SetSize(1,6);
+
+    bool testPassed = true;
+    const double tolerance = 1.0e-8;
+    for (unsigned int r = 0;r < 2;++r)
+    {
+        anima::VectorImagePatchMomentsTable <double, Dimension> momentsTable;
+        momentsTable.Initialize(image.GetPointer(),tableRegions[r]);
+
+        double maxMeanDeviation = 0.0;
+        double maxCovarianceDeviation = 0.0;
+        bool numPixelsMatch = true;
+
+        // Patches of radius 1 and 2 centered on each voxel of the table region, cropped to it as in the distance filters
+        for (int patchRadius = 1;patchRadius <= 2;++patchRadius)
+        {
+            for (unsigned int y = 0;y < tableRegions[r].GetSize()[1];++y)
+            {
+                for (unsigned int x = 0;x < tableRegions[r].GetSize()[0];++x)
+                {
+                    RegionType patchRegion = tableRegions[r];
+                    int centerIndex[2] = {(int)(tableRegions[r].GetIndex()[0] + x), (int)(tableRegions[r].GetIndex()[1] + y)};
+                    for (unsigned int d = 0;d < 2;++d)
+                    {
+                        int regionStart = tableRegions[r].GetIndex()[d];
+                        int regionEnd = regionStart + tableRegions[r].GetSize()[d];
+                        int patchStart = std::max(centerIndex[d] - patchRadius, regionStart);
+                        int patchEnd = std::min(centerIndex[d] + patchRadius + 1, regionEnd);
+                        patchRegion.SetIndex(d,patchStart);
+                        patchRegion.SetSize(d,patchEnd - patchStart);
+                    }
+
+                    itk::VariableLengthVector <double> refMean, tableMean;
+                    vnl_matrix <double> refCov, tableCov;
+                    unsigned int refNumPixels = anima::computePatchMeanAndCovariance(image.GetPointer(),patchRegion,refMean,refCov);
+                    unsigned int tableNumPixels = momentsTable.ComputePatchMeanAndCovariance(patchRegion,tableMean,tableCov);
+
+                    if (refNumPixels != tableNumPixels)
+                        numPixelsMatch = false;
+
+                    double covarianceScale = 0.0;
+                    for (unsigned int i = 0;i < ndim;++i)
+                        covarianceScale = std::max(covarianceScale, std::abs(refCov(i,i)));
+
+                    for (unsigned int i = 0;i < ndim;++i)
+                    {
+                        maxMeanDeviation = std::max(maxMeanDeviation, std::abs(tableMean[i] - refMean[i]) / std::abs(refMean[i]));
+                        for (unsigned int j = 0;j < ndim;++j)
+                            maxCovarianceDeviation = std::max(maxCovarianceDeviation,
+                                                              std::abs(tableCov(i,j) - refCov(i,j)) / covarianceScale);
+                    }
+                }
+            }
+        }
+
+        std::cout << "Table region " << r << ": mean deviation " << maxMeanDeviation << ", covariance deviation "
+                  << maxCovarianceDeviation << std::endl;
+
+        if ((maxMeanDeviation > tolerance) || (maxCovarianceDeviation > tolerance) || !numPixelsMatch)
+        {
+            std::cerr << "Patch moments table differs from two pass statistics on table region " << r << std::endl;
+            testPassed = false;
+        }
+    }
+
+    if (!testPassed)
+        return EXIT_FAILURE;
+
+    return EXIT_SUCCESS;
+}
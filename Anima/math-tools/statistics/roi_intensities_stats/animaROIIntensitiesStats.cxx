@@ -1,10 +1,12 @@
 #include <iostream>
-#include <algorithm>
+#include <sstream>
 #include <tclap/CmdLine.h>
 
-#include <itkImageRegionConstIterator.h>
+#include <itkMultiThreaderBase.h>
 #include <vnl/vnl_matrix.h>
 #include <animaReadWriteFunctions.h>
+#include <animaImageGeometryFunctions.h>
+#include <animaLabelStatisticsAccumulator.h>
 
 int main(int argc, char **argv)
 {
@@ -12,9 +14,10 @@ int main(int argc, char **argv)
                        " INRIA / IRISA - VisAGeS/Empenn Team", ' ',ANIMA_VERSION);
     TCLAP::ValueArg <std::string> dataListArg("i","input","image or image list",true,"","images",cmd);
     TCLAP::ValueArg <std::string> roiArg("r","roi","ROI image",true,"","ROI image",cmd);
-    TCLAP::ValueArg <std::string> statArg("s","stat","Type of statistic computed (choose from median, [average], variance, max)",false,"average","statistic type",cmd);
+    TCLAP::ValueArg <std::string> statArg("s","stat","Type of statistic computed (choose from median, [average], variance, std, min, max, count), several statistics may be given separated by commas",false,"average","statistic type",cmd);
     TCLAP::ValueArg <std::string> resNameArg("o","output","CSV file name",true,"","file name for the output csv file",cmd);
     TCLAP::ValueArg <unsigned int> precisionArg("p","precision","Precision of values output (integer, default: 12)",false,12,"precision",cmd);
+    TCLAP::ValueArg <unsigned int> nbpArg("T","numberofthreads","Number of threads to run on (default: all cores)",false,itk::MultiThreaderBase::GetGlobalDefaultNumberOfThreads(),"number of threads",cmd);
 
     try
     {
@@ -26,49 +29,44 @@ int main(int argc, char **argv)
         return EXIT_FAILURE;
     }
 
-    // load mask file
-    using ROIImageType = itk::Image <unsigned short, 3>;
-    ROIImageType::Pointer roiImage = anima::readImage <ROIImageType> (roiArg.getValue());
-    using ROIIterator = itk::ImageRegionConstIterator <ROIImageType>;
-
-    ROIIterator iterROIImage(roiImage,roiImage->GetRequestedRegion());
-
-    std::vector <unsigned short> roiLabels;
-
-    // First find labels in ROI image
-    while (!iterROIImage.IsAtEnd())
+    std::vector <std::string> statNames;
+    std::istringstream statStream(statArg.getValue());
+    std::string statName;
+    bool needValues = false;
+    while (std::getline(statStream, statName, ','))
     {
-        unsigned short roiValue = iterROIImage.Get();
-        if (roiValue == 0)
+        if ((statName != "median") && (statName != "average") && (statName != "variance") && (statName != "std")
+                && (statName != "min") && (statName != "max") && (statName != "count"))
         {
-            ++iterROIImage;
-            continue;
-        }
-
-        bool foundLabel = false;
-        for (unsigned int i = 0;i < roiLabels.size();++i)
-        {
-            if (roiValue == roiLabels[i])
-            {
-                foundLabel = true;
-                break;
-            }
+            std::cerr << "Error: unknown statistic " << statName << std::endl;
+            return EXIT_FAILURE;
         }
 
-        if (!foundLabel)
-            roiLabels.push_back(roiValue);
+        needValues = needValues || (statName == "median");
+        statNames.push_back(statName);
+    }
 
-        ++iterROIImage;
+    unsigned int numStats = statNames.size();
+    if (numStats == 0)
+    {
+        std::cerr << "Error: no statistic required" << std::endl;
+        return EXIT_FAILURE;
     }
 
-    std::sort(roiLabels.begin(),roiLabels.end());
-    unsigned int numLabels = roiLabels.size();
-    std::map <unsigned short, unsigned short> reverseLabels;
-    for (unsigned int i = 0;i < numLabels;++i)
-        reverseLabels[roiLabels[i]] = i;
+    // load mask file
+    using ROIImageType = itk::Image <unsigned short, 3>;
+    ROIImageType::Pointer roiImage = anima::readImage <ROIImageType> (roiArg.getValue());
+
+    // Labels are read once, all statistics of an image being then computed in a single pass
+    anima::LabelStatisticsAccumulator <unsigned short> labelStatistics;
+    labelStatistics.SetNumberOfThreads(nbpArg.getValue());
+    labelStatistics.SetKeepValues(needValues);
+    labelStatistics.SetLabels(roiImage->GetBufferPointer(),roiImage->GetBufferedRegion().GetNumberOfPixels());
+
+    const std::vector <unsigned short> &roiLabels = labelStatistics.GetLabels();
+    unsigned int numLabels = labelStatistics.GetNumberOfLabels();
 
     using ImageType = itk::Image <double, 3>;
-    using ImageIterator = itk::ImageRegionConstIterator<ImageType>;
 
     // load filenames file    
     std::vector <std::string> dataFileNames;
@@ -87,80 +85,45 @@ int main(int argc, char **argv)
 
     //Now process voxels for each image
     unsigned int numDataFiles = dataFileNames.size();
-    std::vector < std::vector <double> > roiLabelValues(numLabels);
-    vnl_matrix <double> statsValues(numLabels, numDataFiles);
+    vnl_matrix <double> statsValues(numLabels, numDataFiles * numStats);
 
     for (unsigned int i = 0;i < numDataFiles;++i)
     {
-        for (unsigned int j = 0;j < numLabels;++j)
-            roiLabelValues[j].clear();
-
         ImageType::Pointer currentImage = anima::readImage <ImageType> (dataFileNames[i]);
-        ImageIterator imageIt(currentImage, currentImage->GetLargestPossibleRegion());
 
-        iterROIImage.GoToBegin();
-        while (!iterROIImage.IsAtEnd())
+        // Statistics are computed on buffers voxel by voxel: images have to be defined on the ROI image grid
+        try
         {
-            unsigned short roiValue = iterROIImage.Get();
-
-            if (roiValue == 0)
-            {
-                ++iterROIImage;
-                ++imageIt;
-
-                continue;
-            }
-
-            roiLabelValues[reverseLabels[roiValue]].push_back(imageIt.Get());
-
-            ++iterROIImage;
-            ++imageIt;
+            anima::checkImageGeometry(roiImage.GetPointer(),currentImage.GetPointer(),dataFileNames[i]);
+        }
+        catch (itk::ExceptionObject &e)
+        {
+            std::cerr << e << std::endl;
+            return EXIT_FAILURE;
         }
 
-        // Now we have the data, let's compute the stats
+        labelStatistics.Update(currentImage->GetBufferPointer());
+
         for (unsigned int j = 0;j < numLabels;++j)
         {
-            if (statArg.getValue() == "median")
+            const anima::LabelStatisticsAccumulator <unsigned short>::Moments &labelMoments = labelStatistics.GetMoments(j);
+            for (unsigned int k = 0;k < numStats;++k)
             {
-                unsigned int numValues = roiLabelValues[j].size();
-                unsigned int indexTaken = std::floor(numValues / 2.0);
-                std::partial_sort(roiLabelValues[j].begin(),roiLabelValues[j].begin() + indexTaken + 1,roiLabelValues[j].end());
-                statsValues(j,i) = roiLabelValues[j][indexTaken];
-            }
-            else if (statArg.getValue() == "max")
-            {
-                unsigned int numValues = roiLabelValues[j].size();
-                double maxValue = roiLabelValues[j][0];
-                for (unsigned int k = 1;k < numValues;++k)
-                {
-                    if (maxValue < roiLabelValues[j][k])
-                        maxValue = roiLabelValues[j][k];
-                }
-
-                statsValues(j,i) = maxValue;
-            }
-            else
-            {
-                double meanValue = 0.0;
-                unsigned int numValues = roiLabelValues[j].size();
-                for (unsigned int k = 0;k < numValues;++k)
-                    meanValue += roiLabelValues[j][k];
-
-                meanValue /= numValues;
-
-                if (statArg.getValue() == "variance")
-                {
-                    double varianceValue = 0.0;
-                    for (unsigned int k = 0;k < numValues;++k)
-                        varianceValue += (meanValue - roiLabelValues[j][k]) * (meanValue - roiLabelValues[j][k]);
-
-                    if (numValues > 1)
-                        varianceValue /= (numValues - 1.0);
-
-                    statsValues(j,i) = varianceValue;
-                }
-                else
-                    statsValues(j,i) = meanValue;
+                double statValue = labelMoments.mean;
+                if (statNames[k] == "median")
+                    statValue = labelStatistics.GetQuantile(j,0.5);
+                else if (statNames[k] == "variance")
+                    statValue = labelMoments.GetVariance();
+                else if (statNames[k] == "std")
+                    statValue = std::sqrt(labelMoments.GetVariance());
+                else if (statNames[k] == "min")
+                    statValue = labelMoments.min;
+                else if (statNames[k] == "max")
+                    statValue = labelMoments.max;
+                else if (statNames[k] == "count")
+                    statValue = labelMoments.count;
+
+                statsValues(j,i * numStats + k) = statValue;
             }
         }
     }
@@ -169,23 +132,31 @@ int main(int argc, char **argv)
     std::ofstream file(resNameArg.getValue());
     file.precision(precisionArg.getValue());
 
+    // Columns are named after the statistic when several are computed
     file << "Label,";
     for (unsigned int i = 0;i < numDataFiles;++i)
     {
-        file << dataFileNames[i];
-        if (i != numDataFiles - 1)
-            file << ",";
-        else
-            file << std::endl;
+        for (unsigned int k = 0;k < numStats;++k)
+        {
+            file << dataFileNames[i];
+            if (numStats > 1)
+                file << ":" << statNames[k];
+
+            if ((i != numDataFiles - 1) || (k != numStats - 1))
+                file << ",";
+            else
+                file << std::endl;
+        }
     }
 
+    unsigned int numColumns = numDataFiles * numStats;
     for (unsigned int i = 0;i < numLabels;++i)
     {
         file << roiLabels[i] << ",";
-        for (unsigned int j = 0;j < numDataFiles;++j)
+        for (unsigned int j = 0;j < numColumns;++j)
         {
             file << statsValues(i,j);
-            if (j != numDataFiles - 1)
+            if (j != numColumns - 1)
                 file << ",";
             else
                 file << std::endl;
@@ -39,6 +39,9 @@ B1GMMRelaxometryCostFunction::PrepareDataForLLS() const
     unsigned int numT2Signals = m_T2RelaxometrySignals.size();
     unsigned int numDistributions = m_GaussianMeans.size();
 
+    if (m_KernelTable && (m_KernelTable->GetNumberOfEchoes() != numT2Signals))
+        itkExceptionMacro("EPG kernel table and T2 relaxometry signals have different numbers of echoes");
+
     m_T2SignalSimulator.SetNumberOfEchoes(numT2Signals);
     m_T2SignalSimulator.SetEchoSpacing(m_EchoSpacing);
     m_T2SignalSimulator.SetExcitationFlipAngle(m_ExcitationFlipAngle);
@@ -64,7 +67,24 @@ B1GMMRelaxometryCostFunction::PrepareDataForLLS() const
         t2Integrand.SetGaussianMean(m_GaussianMeans[i]);
         t2Integrand.SetGaussianVariance(m_GaussianVariances[i]);
 
-        if (m_UniformPulses)
+        if (m_KernelTable)
+        {
+            // Weighted sum of tabulated EPG values over T2 nodes, slice profile being already included in the table
+            double gaussStd = std::sqrt(m_GaussianVariances[i]);
+            unsigned int firstIndex, endIndex;
+            m_KernelTable->GetT2IndexRange(m_GaussianMeans[i] - 10.0 * gaussStd, m_GaussianMeans[i] + 10.0 * gaussStd, firstIndex, endIndex);
+
+            m_T2Weights.resize(m_KernelTable->GetNumberOfT2Values());
+            for (unsigned int k = firstIndex;k < endIndex;++k)
+            {
+                double t2Value = m_KernelTable->GetT2Value(k);
+                double gaussianExponent = (t2Value - m_GaussianMeans[i]) * (t2Value - m_GaussianMeans[i]) / (2.0 * m_GaussianVariances[i]);
+                m_T2Weights[k] = m_KernelTable->GetT2QuadratureWeight(k) * std::exp(- gaussianExponent) / (std::sqrt(2.0 * M_PI * m_GaussianVariances[i]));
+            }
+
+            m_KernelTable->GetWeightedSignals(m_T1Value, m_TestedParameters[0], m_T2Weights, firstIndex, endIndex, predictedSignals);
+        }
+        else if (m_UniformPulses)
         {
             anima::GaussLaguerreQuadrature glQuad;
             glQuad.SetNumberOfComponents(numT2Signals);
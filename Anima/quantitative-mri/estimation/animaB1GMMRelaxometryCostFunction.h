@@ -3,6 +3,7 @@
 #include "AnimaRelaxometryExport.h"
 
 #include <animaEPGSignalSimulator.h>
+#include <animaEPGT2KernelTable.h>
 #include <animaCholeskyDecomposition.h>
 #include <animaNNLSOptimizer.h>
 
@@ -55,6 +56,9 @@ public:
     void SetPulseProfile(std::vector < std::pair <double, double> > &profile) {m_PulseProfile = profile;}
     void SetExcitationProfile(std::vector < std::pair <double, double> > &profile) {m_ExcitationProfile = profile;}
 
+    //! Optional precomputed EPG table (shared between threads), replacing quadratures over T2 and slice profile when set
+    void SetKernelTable(const anima::EPGT2KernelTable *table) {m_KernelTable = table;}
+
     unsigned int GetNumberOfParameters() const ITK_OVERRIDE
     {
         return 1;
@@ -73,6 +77,8 @@ protected:
 
         m_UniformPulses = true;
         m_PixelWidth = 3.0;
+
+        m_KernelTable = 0;
     }
 
     virtual ~B1GMMRelaxometryCostFunction() {}
@@ -105,6 +111,9 @@ private:
     std::vector < std::pair <double, double> > m_ExcitationProfile;
     double m_PixelWidth;
 
+    const anima::EPGT2KernelTable *m_KernelTable;
+    mutable std::vector <double> m_T2Weights;
+
     mutable ParametersType m_FSignals;
     mutable ParametersType m_Residuals;
     mutable vnl_matrix <double> m_PredictedSignalAttenuations, m_CholeskyMatrix;
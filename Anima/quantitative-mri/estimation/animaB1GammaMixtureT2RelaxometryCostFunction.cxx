@@ -7,6 +7,9 @@
 #include <animaB1GammaDistributionIntegrand.h>
 #include <animaB1GammaDerivativeDistributionIntegrand.h>
 
+#include <boost/math/special_functions/gamma.hpp>
+#include <boost/math/special_functions/digamma.hpp>
+
 namespace anima
 {
 
@@ -43,6 +46,9 @@ B1GammaMixtureT2RelaxometryCostFunction::PrepareDataForLLS() const
 
     double b1Value = m_TestedParameters[0];
 
+    if (m_KernelTable && (m_KernelTable->GetNumberOfEchoes() != numT2Signals))
+        itkExceptionMacro("EPG kernel table and T2 relaxometry signals have different numbers of echoes");
+
     m_T2SignalSimulator.SetNumberOfEchoes(numT2Signals);
     m_T2SignalSimulator.SetEchoSpacing(m_EchoSpacing);
     m_T2SignalSimulator.SetExcitationFlipAngle(m_ExcitationFlipAngle);
@@ -61,7 +67,13 @@ B1GammaMixtureT2RelaxometryCostFunction::PrepareDataForLLS() const
         t2Integrand.SetGammaMean(m_GammaMeans[i]);
         t2Integrand.SetGammaVariance(m_GammaVariances[i]);
 
-        if (m_UniformPulses)
+        if (m_KernelTable)
+        {
+            unsigned int firstIndex, endIndex;
+            this->ComputeKernelTableWeights(i, false, firstIndex, endIndex);
+            m_KernelTable->GetWeightedSignals(m_T1Value, b1Value, m_T2Weights, firstIndex, endIndex, predictedSignals);
+        }
+        else if (m_UniformPulses)
         {
             anima::GaussLaguerreQuadrature glQuad;
 
@@ -342,7 +354,7 @@ B1GammaMixtureT2RelaxometryCostFunction::PrepareDataForDerivative() const
 
     double b1Value = m_TestedParameters[0];
 
-    std::vector <double> dataVector;
+    std::vector <double> dataVector, predictedSignals;
     B1GammaDerivativeDistributionIntegrand t2DerivativeIntegrand;
     t2DerivativeIntegrand.SetEPGSimulator(m_T2SignalSimulator);
     t2DerivativeIntegrand.SetT1Value(m_T1Value);
@@ -353,7 +365,27 @@ B1GammaMixtureT2RelaxometryCostFunction::PrepareDataForDerivative() const
         t2DerivativeIntegrand.SetGammaMean(m_GammaMeans[i]);
         t2DerivativeIntegrand.SetGammaVariance(m_GammaVariances[i]);
 
-        if (m_UniformPulses)
+        if (m_KernelTable)
+        {
+            // B1 derivative from the flip angle derivative of the table interpolation
+            unsigned int firstIndex, endIndex;
+            this->ComputeKernelTableWeights(i, false, firstIndex, endIndex);
+            m_KernelTable->GetWeightedSignals(m_T1Value, b1Value, m_T2Weights, firstIndex, endIndex, predictedSignals, &dataVector);
+
+            for (unsigned int j = 0;j < numT2Signals;++j)
+                m_SignalAttenuationsJacobian[0](j,i) = dataVector[j];
+
+            // Mean parameter derivative from the derivative of the gamma density
+            if ((i == 1)||(!m_ConstrainedParameters))
+            {
+                this->ComputeKernelTableWeights(i, true, firstIndex, endIndex);
+                m_KernelTable->GetWeightedSignals(m_T1Value, b1Value, m_T2Weights, firstIndex, endIndex, dataVector);
+                unsigned int index = 1 + (!m_ConstrainedParameters) * i;
+                for (unsigned int j = 0;j < numT2Signals;++j)
+                    m_SignalAttenuationsJacobian[index](j,i) = dataVector[j];
+            }
+        }
+        else if (m_UniformPulses)
         {
             t2DerivativeIntegrand.SetB1DerivativeFlag(true);
 
@@ -413,4 +445,30 @@ B1GammaMixtureT2RelaxometryCostFunction::PrepareDataForDerivative() const
     }
 }
 
+void
+B1GammaMixtureT2RelaxometryCostFunction::ComputeKernelTableWeights(unsigned int i, bool meanDerivative,
+                                                                   unsigned int &firstIndex, unsigned int &endIndex) const
+{
+    double gammaStd = std::sqrt(m_GammaVariances[i]);
+    m_KernelTable->GetT2IndexRange(m_GammaMeans[i] - 10.0 * gammaStd, m_GammaMeans[i] + 10.0 * gammaStd, firstIndex, endIndex);
+    m_T2Weights.resize(m_KernelTable->GetNumberOfT2Values());
+
+    double shape = m_GammaMeans[i] * m_GammaMeans[i] / m_GammaVariances[i];
+    double scale = m_GammaVariances[i] / m_GammaMeans[i];
+    double digammaShape = 0.0;
+    if (meanDerivative)
+        digammaShape = boost::math::digamma(shape);
+
+    for (unsigned int k = firstIndex;k < endIndex;++k)
+    {
+        double t2Value = m_KernelTable->GetT2Value(k);
+        double gammaValue = boost::math::gamma_p_derivative(shape, t2Value / scale) / scale;
+
+        if (meanDerivative)
+            gammaValue *= (2.0 * std::log(t2Value / scale) - 2.0 * digammaShape + 1.0) / scale - t2Value / m_GammaVariances[i];
+
+        m_T2Weights[k] = m_KernelTable->GetT2QuadratureWeight(k) * gammaValue;
+    }
+}
+
 } // end namespace anima
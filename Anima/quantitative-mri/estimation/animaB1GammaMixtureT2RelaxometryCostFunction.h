@@ -7,6 +7,7 @@
 #include <vnl/vnl_matrix.h>
 
 #include <animaEPGSignalSimulator.h>
+#include <animaEPGT2KernelTable.h>
 #include <animaCholeskyDecomposition.h>
 #include <animaNNLSOptimizer.h>
 #include <animaBaseTensorTools.h>
@@ -59,6 +60,9 @@ public:
     void SetPulseProfile(std::vector < std::pair <double, double> > &profile) {m_PulseProfile = profile;}
     void SetExcitationProfile(std::vector < std::pair <double, double> > &profile) {m_ExcitationProfile = profile;}
 
+    //! Optional precomputed EPG table (shared between threads), replacing quadratures over T2 and slice profile when set
+    void SetKernelTable(const anima::EPGT2KernelTable *table) {m_KernelTable = table;}
+
     itkSetMacro(ConstrainedParameters, bool)
 
     unsigned int GetNumberOfParameters() const ITK_OVERRIDE
@@ -83,6 +87,8 @@ protected:
 
             m_UniformPulses = true;
             m_PixelWidth = 3.0;
+
+            m_KernelTable = 0;
     }
 
     virtual ~B1GammaMixtureT2RelaxometryCostFunction() {}
@@ -90,6 +96,9 @@ protected:
     void PrepareDataForLLS() const;
     void PrepareDataForDerivative() const;
 
+    //! Fills m_T2Weights with kernel table quadrature weights times the ith gamma density (or its derivative against the mean)
+    void ComputeKernelTableWeights(unsigned int i, bool meanDerivative, unsigned int &firstIndex, unsigned int &endIndex) const;
+
     //! Computes maximum likelihood estimates of weights
     void SolveLinearLeastSquares() const;
 
@@ -117,6 +126,9 @@ private:
     std::vector < std::pair <double, double> > m_ExcitationProfile;
     double m_PixelWidth;
 
+    const anima::EPGT2KernelTable *m_KernelTable;
+    mutable std::vector <double> m_T2Weights;
+
     mutable ParametersType m_FSignals;
     mutable ParametersType m_Residuals;
     mutable vnl_matrix <double> m_PredictedSignalAttenuations, m_CholeskyMatrix;
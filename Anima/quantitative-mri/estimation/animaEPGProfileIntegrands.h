@@ -12,7 +12,7 @@ namespace anima
 
 /**
  * \class EPGMonoT2Integrand
- * @brief Integrand to compute the internal integral of EPG along slice profile in T2EPGRelaxometryCostFunction
+ * @brief Integrand to compute the internal integral of EPG along slice profile in MultiT2EPGRelaxometryCostFunction
  *
  * Integration over slice profile is inspired from Lebel et al. MRM 64:1005–1014 (2010) and freely adapted for Gauss quadrature
  */
@@ -0,0 +1,315 @@
+#include "animaEPGT2KernelTable.h"
+
+#include <animaEPGBatchSignalSimulator.h>
+#include <animaGaussLegendreQuadrature.h>
+
+#include <itkMultiThreaderBase.h>
+#include <itkMacro.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+
+//! Linear interpolation of a slice profile, constant outside of its support
+double GetProfileValue(const std::vector < std::pair <double, double> > &profile, double t)
+{
+    if (t <= profile[0].first)
+        return profile[0].second;
+
+    if (t >= profile.back().first)
+        return profile.back().second;
+
+    using PulseIteratorType = std::vector < std::pair <double, double> >::const_iterator;
+    PulseIteratorType it = std::lower_bound(profile.begin(), profile.end(), std::make_pair(t, 0.0));
+    PulseIteratorType itUp = it;
+    ++itUp;
+    if (itUp == profile.end())
+        return it->second;
+
+    double weight = (t - it->first) / (itUp->first - it->first);
+    return weight * itUp->second + (1.0 - weight) * it->second;
+}
+
+} // end anonymous namespace
+
+namespace anima
+{
+
+EPGT2KernelTable::EPGT2KernelTable()
+{
+    m_EchoSpacing = 10;
+    m_ExcitationFlipAngle = M_PI / 2.0;
+    m_NumberOfEchoes = 1;
+
+    m_MinimalT2 = 0.5;
+    m_MaximalT2 = 5000;
+    m_MaximalT2LogStep = 0.03;
+
+    m_MinimalFlipAngle = M_PI / 2.0;
+    m_MaximalFlipAngle = M_PI;
+    m_NumberOfFlipAngleValues = 65;
+
+    m_MinimalT1 = 1000;
+    m_MaximalT1 = 1000;
+    m_NumberOfT1Values = 0;
+
+    m_UniformPulses = true;
+    m_PixelWidth = 3.0;
+
+    m_NumberOfWorkUnits = itk::MultiThreaderBase::GetGlobalDefaultNumberOfThreads();
+    m_Updated = false;
+
+    m_LogT2Step = 0;
+    m_FlipAngleStep = 0;
+}
+
+void EPGT2KernelTable::SetT2RangeFromDistributions(const std::vector <double> &means, const std::vector <double> &variances)
+{
+    double maxT2 = 0.0;
+    double minRelativeWidth = 1.0;
+    for (unsigned int i = 0;i < means.size();++i)
+    {
+        double distributionStd = std::sqrt(variances[i]);
+        maxT2 = std::max(maxT2, means[i] + 10.0 * distributionStd);
+        minRelativeWidth = std::min(minRelativeWidth, distributionStd / means[i]);
+    }
+
+    this->SetT2Range(m_EchoSpacing / 20.0, maxT2);
+    this->SetMaximalT2LogStep(std::min(0.03, 0.75 * minRelativeWidth));
+}
+
+void EPGT2KernelTable::SetSliceProfiles(const std::vector < std::pair <double, double> > &pulseProfile,
+                                        const std::vector < std::pair <double, double> > &excitationProfile, double pixelWidth)
+{
+    m_UniformPulses = false;
+    m_PulseProfile = pulseProfile;
+    m_ExcitationProfile = excitationProfile;
+    m_PixelWidth = pixelWidth;
+}
+
+void EPGT2KernelTable::Update()
+{
+    if ((m_MinimalT2 <= 0.0) || (m_MaximalT2 <= m_MinimalT2) || (m_MaximalT2LogStep <= 0.0))
+        throw itk::ExceptionObject(__FILE__, __LINE__,"EPG kernel table requires a positive T2 range and T2 step",ITK_LOCATION);
+
+    if ((m_MaximalFlipAngle <= m_MinimalFlipAngle) || (m_NumberOfFlipAngleValues < 2))
+        throw itk::ExceptionObject(__FILE__, __LINE__,"EPG kernel table requires a flip angle range and at least two flip angle values",ITK_LOCATION);
+
+    if ((m_MinimalT1 <= 0.0) || (m_MaximalT1 < m_MinimalT1))
+        throw itk::ExceptionObject(__FILE__, __LINE__,"EPG kernel table requires a positive T1 range",ITK_LOCATION);
+
+    if ((!m_UniformPulses) && ((m_PulseProfile.size() == 0) || (m_ExcitationProfile.size() == 0)))
+        throw itk::ExceptionObject(__FILE__, __LINE__,"EPG kernel table requires pulse profiles for non uniform pulses",ITK_LOCATION);
+
+    // T2 nodes, uniform in log(T2), integrated with the trapezoidal rule in log(T2)
+    double logT2Range = std::log(m_MaximalT2 / m_MinimalT2);
+    unsigned int numT2Values = 1 + std::max(1.0, std::ceil(logT2Range / m_MaximalT2LogStep));
+    m_LogT2Step = logT2Range / (numT2Values - 1.0);
+    m_T2Values.resize(numT2Values);
+    m_T2QuadratureWeights.resize(numT2Values);
+    for (unsigned int i = 0;i < numT2Values;++i)
+    {
+        m_T2Values[i] = m_MinimalT2 * std::exp(i * m_LogT2Step);
+        m_T2QuadratureWeights[i] = m_LogT2Step * m_T2Values[i];
+    }
+
+    m_T2QuadratureWeights[0] /= 2.0;
+    m_T2QuadratureWeights[numT2Values - 1] /= 2.0;
+
+    m_FlipAngleStep = (m_MaximalFlipAngle - m_MinimalFlipAngle) / (m_NumberOfFlipAngleValues - 1.0);
+
+    // T1 nodes, uniform in 1/T1 since EPG relaxation terms are exponentials of -ES/T1. Automatic spacing keeps
+    // the longest T1 decay over the echo train, N ES / (2 T1), within 0.05 between nodes
+    unsigned int numT1Values = m_NumberOfT1Values;
+    if (numT1Values == 0)
+    {
+        double inverseT1Range = 1.0 / m_MinimalT1 - 1.0 / m_MaximalT1;
+        numT1Values = 1 + std::ceil(10.0 * m_NumberOfEchoes * m_EchoSpacing * inverseT1Range);
+    }
+
+    if ((numT1Values < 2) || (m_MaximalT1 == m_MinimalT1))
+        numT1Values = 1;
+
+    m_InverseT1Values.resize(numT1Values);
+    m_InverseT1Values[0] = 1.0 / m_MaximalT1;
+    for (unsigned int i = 1;i < numT1Values;++i)
+        m_InverseT1Values[i] = 1.0 / m_MaximalT1 + i * (1.0 / m_MinimalT1 - 1.0 / m_MaximalT1) / (numT1Values - 1.0);
+
+    unsigned int numEntries = numT1Values * m_NumberOfFlipAngleValues;
+    m_EPGValues.resize(numEntries * m_NumberOfEchoes * numT2Values);
+    m_EPGFlipAngleDerivatives.resize(m_EPGValues.size());
+
+    itk::MultiThreaderBase::Pointer threader = itk::MultiThreaderBase::New();
+    threader->SetNumberOfWorkUnits(m_NumberOfWorkUnits);
+    threader->ParallelizeArray(0, numEntries, [&](itk::SizeValueType entry)
+    {
+        this->ComputeTableEntry(entry / m_NumberOfFlipAngleValues, entry % m_NumberOfFlipAngleValues);
+    }, nullptr);
+
+    m_Updated = true;
+}
+
+void EPGT2KernelTable::ComputeTableEntry(unsigned int t1Index, unsigned int flipAngleIndex)
+{
+    double t1Value = 1.0 / m_InverseT1Values[t1Index];
+    double flipAngle = m_MinimalFlipAngle + flipAngleIndex * m_FlipAngleStep;
+
+    anima::EPGBatchSignalSimulator epgSimulator;
+    epgSimulator.SetNumberOfEchoes(m_NumberOfEchoes);
+    epgSimulator.SetEchoSpacing(m_EchoSpacing);
+    epgSimulator.SetExcitationFlipAngle(m_ExcitationFlipAngle);
+    anima::EPGBatchSignalSimulator::Workspace workspace;
+
+    unsigned int numT2Values = m_T2Values.size();
+    unsigned int basePosition = (t1Index * m_NumberOfFlipAngleValues + flipAngleIndex) * m_NumberOfEchoes * numT2Values;
+
+    // All T2 nodes are simulated in a single batched sweep, epgValues being ordered as the table:
+    // EPG values then derivatives, echo by echo, T2 nodes being the fastest varying
+    unsigned int numValues = m_NumberOfEchoes * numT2Values;
+    vnl_matrix <double> signalValues, derivativeValues;
+    auto computeEPGValues = [&](double pulseProfileValue, std::vector <double> &epgValues)
+    {
+        epgSimulator.GetValues(t1Value, m_T2Values, pulseProfileValue * flipAngle, 1.0, workspace, signalValues, &derivativeValues);
+
+        epgValues.resize(2 * numValues);
+        for (unsigned int j = 0;j < m_NumberOfEchoes;++j)
+        {
+            for (unsigned int i = 0;i < numT2Values;++i)
+            {
+                epgValues[j * numT2Values + i] = signalValues(i,j);
+                epgValues[numValues + j * numT2Values + i] = pulseProfileValue * derivativeValues(i,j);
+            }
+        }
+    };
+
+    std::vector <double> epgValues;
+    if (m_UniformPulses)
+        computeEPGValues(1.0, epgValues);
+    else
+    {
+        // Average over the slice profile of EPG values and of their derivative, including the pulse profile factor
+        anima::GaussLegendreQuadrature spIntegral;
+        spIntegral.SetInterestZone(- m_PixelWidth / 2.0, m_PixelWidth / 2.0);
+        spIntegral.SetNumberOfComponents(2 * numValues);
+
+        auto sliceIntegrand = [&](double const t)
+        {
+            double pulseProfileValue = GetProfileValue(m_PulseProfile, t);
+            double excitationProfileValue = GetProfileValue(m_ExcitationProfile, t);
+
+            std::vector <double> sliceValues;
+            epgSimulator.SetExcitationFlipAngle(excitationProfileValue * m_ExcitationFlipAngle);
+            computeEPGValues(pulseProfileValue, sliceValues);
+
+            return sliceValues;
+        };
+
+        epgValues = spIntegral.GetVectorIntegralValue(sliceIntegrand);
+        for (unsigned int j = 0;j < 2 * numValues;++j)
+            epgValues[j] /= m_PixelWidth;
+    }
+
+    std::copy(epgValues.begin(), epgValues.begin() + numValues, m_EPGValues.begin() + basePosition);
+    std::copy(epgValues.begin() + numValues, epgValues.end(), m_EPGFlipAngleDerivatives.begin() + basePosition);
+}
+
+void EPGT2KernelTable::GetT2IndexRange(double minT2, double maxT2, unsigned int &firstIndex, unsigned int &endIndex) const
+{
+    unsigned int numT2Values = m_T2Values.size();
+    firstIndex = 0;
+    endIndex = numT2Values;
+
+    if (minT2 > m_MinimalT2)
+    {
+        double position = std::ceil(std::log(minT2 / m_MinimalT2) / m_LogT2Step);
+        firstIndex = (unsigned int)std::min(position, (double)numT2Values);
+    }
+
+    if (maxT2 < m_MinimalT2)
+        endIndex = 0;
+    else if (maxT2 < m_T2Values.back())
+    {
+        double position = std::floor(std::log(maxT2 / m_MinimalT2) / m_LogT2Step) + 1.0;
+        endIndex = (unsigned int)std::min(position, (double)numT2Values);
+    }
+
+    if (endIndex < firstIndex)
+        endIndex = firstIndex;
+}
+
+void EPGT2KernelTable::GetWeightedSignals(double t1Value, double flipAngle, const std::vector <double> &t2Weights,
+                                          unsigned int firstIndex, unsigned int endIndex, std::vector <double> &signals,
+                                          std::vector <double> *flipAngleDerivatives) const
+{
+    signals.assign(m_NumberOfEchoes, 0.0);
+    if (flipAngleDerivatives)
+        flipAngleDerivatives->assign(m_NumberOfEchoes, 0.0);
+
+    // Linear interpolation in 1/T1, constant outside of the table range
+    unsigned int numT1Values = m_InverseT1Values.size();
+    unsigned int t1Index = 0;
+    double t1Weight = 0.0;
+    if (numT1Values > 1)
+    {
+        double t1Position = (1.0 / t1Value - m_InverseT1Values[0]) / (m_InverseT1Values[1] - m_InverseT1Values[0]);
+        if (t1Position >= numT1Values - 1.0)
+            t1Index = numT1Values - 1;
+        else if (t1Position > 0.0)
+        {
+            t1Index = std::floor(t1Position);
+            t1Weight = t1Position - t1Index;
+        }
+    }
+
+    // Cubic Hermite interpolation in flip angle from EPG values and derivatives
+    double flipAnglePosition = (flipAngle - m_MinimalFlipAngle) / m_FlipAngleStep;
+    flipAnglePosition = std::max(0.0, std::min(flipAnglePosition, m_NumberOfFlipAngleValues - 1.0));
+    unsigned int flipAngleIndex = std::min((unsigned int)std::floor(flipAnglePosition), m_NumberOfFlipAngleValues - 2);
+    double t = flipAnglePosition - flipAngleIndex;
+    double tSquare = t * t;
+    double tCube = tSquare * t;
+
+    double valueCoefficients[2] = {2.0 * tCube - 3.0 * tSquare + 1.0, - 2.0 * tCube + 3.0 * tSquare};
+    double derivativeCoefficients[2] = {(tCube - 2.0 * tSquare + t) * m_FlipAngleStep, (tCube - tSquare) * m_FlipAngleStep};
+    double valueDerivativeCoefficients[2] = {(6.0 * tSquare - 6.0 * t) / m_FlipAngleStep, (- 6.0 * tSquare + 6.0 * t) / m_FlipAngleStep};
+    double derivativeDerivativeCoefficients[2] = {3.0 * tSquare - 4.0 * t + 1.0, 3.0 * tSquare - 2.0 * t};
+
+    unsigned int numT2Values = m_T2Values.size();
+    endIndex = std::min(endIndex, numT2Values);
+
+    for (unsigned int c = 0;c < 2;++c)
+    {
+        double t1CornerWeight = (c == 0) ? 1.0 - t1Weight : t1Weight;
+        if (t1CornerWeight == 0.0)
+            continue;
+
+        for (unsigned int m = 0;m < 2;++m)
+        {
+            unsigned int basePosition = ((t1Index + c) * m_NumberOfFlipAngleValues + flipAngleIndex + m) * m_NumberOfEchoes * numT2Values;
+
+            for (unsigned int j = 0;j < m_NumberOfEchoes;++j)
+            {
+                const float *epgValues = &m_EPGValues[basePosition + j * numT2Values];
+                const float *epgDerivatives = &m_EPGFlipAngleDerivatives[basePosition + j * numT2Values];
+
+                double weightedValue = 0.0;
+                double weightedDerivative = 0.0;
+                for (unsigned int k = firstIndex;k < endIndex;++k)
+                {
+                    weightedValue += t2Weights[k] * epgValues[k];
+                    weightedDerivative += t2Weights[k] * epgDerivatives[k];
+                }
+
+                signals[j] += t1CornerWeight * (valueCoefficients[m] * weightedValue + derivativeCoefficients[m] * weightedDerivative);
+
+                if (flipAngleDerivatives)
+                    (*flipAngleDerivatives)[j] += t1CornerWeight * (valueDerivativeCoefficients[m] * weightedValue +
+                                                                    derivativeDerivativeCoefficients[m] * weightedDerivative);
+            }
+        }
+    }
+}
+
+} // end namespace anima
@@ -0,0 +1,161 @@
+#pragma once
+#include "AnimaRelaxometryExport.h"
+
+#include <itkImageRegionConstIterator.h>
+
+#include <vector>
+#include <utility>
+#include <algorithm>
+
+namespace anima
+{
+
+/**
+ * \class EPGT2KernelTable
+ * @brief Table of EPG echo trains sampled once on a (T1, flip angle, T2) grid, used to replace nested quadratures
+ * over T2 distributions and slice profiles in B1GMMRelaxometryCostFunction and B1GammaMixtureT2RelaxometryCostFunction.
+ *
+ * T2 values are sampled on a logarithmic grid, so that integrals against T2 distributions become weighted sums
+ * over T2 nodes (trapezoidal rule in log(T2)). Flip angle derivatives are tabulated in closed form along with EPG values,
+ * which provides cubic Hermite interpolation in flip angle and consistent derivatives for the optimizers. T1 values
+ * are sampled uniformly in 1/T1 and linearly interpolated. When pulses are not uniform, EPG values are averaged over
+ * the slice profile at build time.
+ */
+class ANIMARELAXOMETRY_EXPORT EPGT2KernelTable
+{
+public:
+    EPGT2KernelTable();
+    virtual ~EPGT2KernelTable() {}
+
+    void SetEchoSpacing(double val) {m_EchoSpacing = val;}
+    void SetExcitationFlipAngle(double val) {m_ExcitationFlipAngle = val;}
+    void SetNumberOfEchoes(unsigned int val) {m_NumberOfEchoes = val;}
+    unsigned int GetNumberOfEchoes() const {return m_NumberOfEchoes;}
+
+    void SetT2Range(double minVal, double maxVal) {m_MinimalT2 = minVal; m_MaximalT2 = maxVal;}
+
+    //! Maximal spacing of T2 nodes in log(T2). Should stay below the relative width (std / mean) of T2 distributions
+    void SetMaximalT2LogStep(double val) {m_MaximalT2LogStep = val;}
+
+    /**
+     * Sets the T2 range and log step so that nodes cover all T2 distributions (given by their largest means and
+     * variances) up to ten standard deviations, EPG signals vanishing below ES / 20, with a log step below 0.75 times
+     * their smallest relative width. The echo spacing has to be set beforehand
+     */
+    void SetT2RangeFromDistributions(const std::vector <double> &means, const std::vector <double> &variances);
+
+    void SetFlipAngleRange(double minVal, double maxVal) {m_MinimalFlipAngle = minVal; m_MaximalFlipAngle = maxVal;}
+    void SetNumberOfFlipAngleValues(unsigned int val) {m_NumberOfFlipAngleValues = val;}
+
+    //! T1 range of the table, a single T1 value being used when both bounds are equal
+    void SetT1Range(double minVal, double maxVal) {m_MinimalT1 = minVal; m_MaximalT1 = maxVal;}
+
+    /**
+     * Sets the T1 range from the T1 map values inside the mask (non positive values standing for 1000 ms), clamped
+     * to [200, 6000] ms, outliers being clamped to the table range at interpolation. A single 1000 ms T1 is used without map
+     */
+    template <class T1ImageType, class MaskImageType>
+    void SetT1RangeFromMap(const T1ImageType *t1Map, const MaskImageType *mask)
+    {
+        m_MinimalT1 = 1000.0;
+        m_MaximalT1 = 1000.0;
+        if (!t1Map)
+            return;
+
+        itk::ImageRegionConstIterator <T1ImageType> t1MapItr(t1Map,t1Map->GetLargestPossibleRegion());
+        itk::ImageRegionConstIterator <MaskImageType> maskItr(mask,t1Map->GetLargestPossibleRegion());
+        while (!maskItr.IsAtEnd())
+        {
+            if (maskItr.Get() != 0)
+            {
+                double t1Value = t1MapItr.Get();
+                if (t1Value <= 0.0)
+                    t1Value = 1000.0;
+
+                m_MinimalT1 = std::min(m_MinimalT1, t1Value);
+                m_MaximalT1 = std::max(m_MaximalT1, t1Value);
+            }
+
+            ++maskItr;
+            ++t1MapItr;
+        }
+
+        m_MinimalT1 = std::max(m_MinimalT1, 200.0);
+        m_MaximalT1 = std::min(m_MaximalT1, 6000.0);
+    }
+
+    /**
+     * Number of T1 nodes, if 0 (default) it is deduced from the T1 range, echo spacing and number of echoes so that
+     * N ES (1/T1) varies by at most 0.1 between nodes. The table size grows linearly with it (each node holds
+     * 2 x flip angles x echoes x T2 nodes floats), setting it explicitly bounds the table size for long echo trains
+     */
+    void SetNumberOfT1Values(unsigned int val) {m_NumberOfT1Values = val;}
+
+    void SetUniformPulses(bool val) {m_UniformPulses = val;}
+    void SetPixelWidth(double val) {m_PixelWidth = val;}
+    void SetPulseProfile(const std::vector < std::pair <double, double> > &profile) {m_PulseProfile = profile;}
+    void SetExcitationProfile(const std::vector < std::pair <double, double> > &profile) {m_ExcitationProfile = profile;}
+
+    //! Sets non uniform pulses and their slice profiles
+    void SetSliceProfiles(const std::vector < std::pair <double, double> > &pulseProfile,
+                          const std::vector < std::pair <double, double> > &excitationProfile, double pixelWidth);
+
+    void SetNumberOfWorkUnits(unsigned int val) {m_NumberOfWorkUnits = val;}
+
+    //! Simulates all EPG echo trains of the table, has to be called before any weighted signal computation
+    void Update();
+    bool IsUpdated() const {return m_Updated;}
+
+    unsigned int GetNumberOfT2Values() const {return m_T2Values.size();}
+    double GetT2Value(unsigned int index) const {return m_T2Values[index];}
+
+    //! Quadrature weight of a T2 node, the integral of f over T2 being approximated by sum_k weight_k f(t2_k)
+    double GetT2QuadratureWeight(unsigned int index) const {return m_T2QuadratureWeights[index];}
+
+    //! Range [firstIndex,endIndex) of T2 nodes inside [minT2,maxT2]
+    void GetT2IndexRange(double minT2, double maxT2, unsigned int &firstIndex, unsigned int &endIndex) const;
+
+    /**
+     * Computes signals[j] = sum_{k in [firstIndex,endIndex)} t2Weights[k] EPG(T1, T2_k, flipAngle, jth echo),
+     * and, if flipAngleDerivatives is provided, its derivative with respect to the flip angle. Thread safe.
+     */
+    void GetWeightedSignals(double t1Value, double flipAngle, const std::vector <double> &t2Weights,
+                            unsigned int firstIndex, unsigned int endIndex, std::vector <double> &signals,
+                            std::vector <double> *flipAngleDerivatives = 0) const;
+
+protected:
+    //! Computes EPG values and flip angle derivatives (averaged on the slice profile if needed) for one T1 and flip angle
+    void ComputeTableEntry(unsigned int t1Index, unsigned int flipAngleIndex);
+
+private:
+    double m_EchoSpacing;
+    double m_ExcitationFlipAngle;
+    unsigned int m_NumberOfEchoes;
+
+    double m_MinimalT2, m_MaximalT2;
+    double m_MaximalT2LogStep;
+    double m_MinimalFlipAngle, m_MaximalFlipAngle;
+    unsigned int m_NumberOfFlipAngleValues;
+    double m_MinimalT1, m_MaximalT1;
+    unsigned int m_NumberOfT1Values;
+
+    bool m_UniformPulses;
+    double m_PixelWidth;
+    std::vector < std::pair <double, double> > m_PulseProfile;
+    std::vector < std::pair <double, double> > m_ExcitationProfile;
+
+    unsigned int m_NumberOfWorkUnits;
+    bool m_Updated;
+
+    // Grids, T1 nodes being stored as 1/T1
+    std::vector <double> m_T2Values, m_T2QuadratureWeights;
+    double m_LogT2Step;
+    std::vector <double> m_InverseT1Values;
+    double m_FlipAngleStep;
+
+    //! EPG values and flip angle derivatives, indexed as [((t1 * numFlipAngles + flipAngle) * numEchoes + echo) * numT2 + t2].
+    //! Stored in single precision, well below interpolation errors, to halve the table footprint
+    std::vector <float> m_EPGValues, m_EPGFlipAngleDerivatives;
+};
+
+} // end namespace anima
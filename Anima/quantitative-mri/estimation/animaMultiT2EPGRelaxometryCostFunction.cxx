@@ -1,5 +1,6 @@
 #include <animaMultiT2EPGRelaxometryCostFunction.h>
 #include <animaEPGSignalSimulator.h>
+#include <animaEPGBatchSignalSimulator.h>
 
 #include <animaGaussLegendreQuadrature.h>
 #include <animaEPGProfileIntegrands.h>
@@ -15,19 +16,33 @@ MultiT2EPGRelaxometryCostFunction::GetValue(const ParametersType & parameters) c
 
     m_AMatrix.set_size(numT2Signals, numT2Peaks);
 
-    anima::EPGSignalSimulator t2SignalSimulator;
-    t2SignalSimulator.SetNumberOfEchoes(numT2Signals);
-    t2SignalSimulator.SetEchoSpacing(m_EchoSpacing);
-    t2SignalSimulator.SetExcitationFlipAngle(m_ExcitationFlipAngle);
+    if (m_UniformPulses)
+    {
+        // All T2 peaks share T1 and flip angle: a single batched EPG sweep
+        anima::EPGBatchSignalSimulator t2SignalSimulator;
+        t2SignalSimulator.SetNumberOfEchoes(numT2Signals);
+        t2SignalSimulator.SetEchoSpacing(m_EchoSpacing);
+        t2SignalSimulator.SetExcitationFlipAngle(m_ExcitationFlipAngle);
 
-    anima::EPGSignalSimulator::RealVectorType simulatedT2Values(numT2Signals,0);
-    anima::EPGSignalSimulator::RealVectorType subSignalData(numT2Signals,0);
+        vnl_matrix <double> peakSignals;
+        t2SignalSimulator.GetValues(m_T1Value,m_T2Values,parameters[0],1.0,peakSignals);
 
-    for (unsigned int i = 0;i < numT2Peaks;++i)
+        for (unsigned int i = 0;i < numT2Peaks;++i)
+        {
+            for (unsigned int j = 0;j < numT2Signals;++j)
+                m_AMatrix(j,i) = peakSignals(i,j);
+        }
+    }
+    else
     {
-        if (m_UniformPulses)
-            subSignalData = t2SignalSimulator.GetValue(m_T1Value,m_T2Values[i],parameters[0],1.0);
-        else
+        anima::EPGSignalSimulator t2SignalSimulator;
+        t2SignalSimulator.SetNumberOfEchoes(numT2Signals);
+        t2SignalSimulator.SetEchoSpacing(m_EchoSpacing);
+        t2SignalSimulator.SetExcitationFlipAngle(m_ExcitationFlipAngle);
+
+        anima::EPGSignalSimulator::RealVectorType subSignalData(numT2Signals,0);
+
+        for (unsigned int i = 0;i < numT2Peaks;++i)
         {
             double halfPixelWidth = m_PixelWidth / 2.0;
             anima::GaussLegendreQuadrature integral;
@@ -43,12 +58,9 @@ MultiT2EPGRelaxometryCostFunction::GetValue(const ParametersType & parameters) c
             integrand.SetSliceExcitationProfile(m_ExcitationProfile);
 
             subSignalData = integral.GetVectorIntegralValue(integrand);
-            for (unsigned int i = 0;i < numT2Signals;++i)
-                subSignalData[i] /= m_PixelWidth;
+            for (unsigned int j = 0;j < numT2Signals;++j)
+                m_AMatrix(j,i) = subSignalData[j] / m_PixelWidth;
         }
-
-        for (unsigned int j = 0;j < numT2Signals;++j)
-            m_AMatrix(j,i) = subSignalData[j];
     }
 
     m_NNLSOptimizer->SetDataMatrix(m_AMatrix);
@@ -6,6 +6,14 @@
 
 namespace anima
 {
+
+/**
+ * \class T1SERelaxometryEstimationImageFilter
+ * @brief Estimates M0 and T1 maps from spin echo images acquired at several repetition times.
+ *
+ * Saturation recovery curves 1 - exp(-TR / T1) are tabulated once on a T1 grid shared by all voxels. Each voxel is
+ * initialized from that table, then refined by TwoParametersBoundedLevenbergMarquardt on (M0, log(T1)).
+ */
 template <typename TInputImage, typename TOutputImage>
 class T1SERelaxometryEstimationImageFilter :
 public anima::MaskedImageToImageFilter<TInputImage,TOutputImage>
@@ -69,8 +77,12 @@ protected:
 
     void CheckComputationMask() ITK_OVERRIDE;
 
+    void BeforeThreadedGenerateData() ITK_OVERRIDE;
     void DynamicThreadedGenerateData(const OutputImageRegionType &outputRegionForThread) ITK_OVERRIDE;
 
+    //! Dictionary lookup and bounded Levenberg-Marquardt refinement of M0 and T1 for one voxel
+    void EstimateVoxel(const std::vector <double> &data, double &m0Value, double &t1Value) const;
+
 private:
     ITK_DISALLOW_COPY_AND_ASSIGN(T1SERelaxometryEstimationImageFilter);
 
@@ -84,6 +96,11 @@ private:
 
     double m_M0UpperBound;
     double m_T1UpperBound;
+
+    //! Saturation recovery curves on a logarithmic T1 grid, shared by all voxels
+    std::vector <double> m_DictionaryT1Values;
+    std::vector < std::vector <double> > m_DictionaryCurves;
+    std::vector <double> m_DictionarySquaredNorms;
 };
     
 } // end namespace anima
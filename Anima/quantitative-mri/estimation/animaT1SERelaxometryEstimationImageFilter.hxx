@@ -4,8 +4,7 @@
 #include <itkImageRegionIterator.h>
 #include <itkImageRegionConstIterator.h>
 
-#include <animaNLOPTOptimizers.h>
-#include <animaT1SERelaxometryCostFunction.h>
+#include <animaTwoParametersBoundedLevenbergMarquardt.h>
 
 namespace anima
 {
@@ -58,6 +57,38 @@ T1SERelaxometryEstimationImageFilter <TInputImage,TOutputImage>
     this->SetComputationMask(maskImage);
 }
 
+template <typename TInputImage, typename TOutputImage>
+void
+T1SERelaxometryEstimationImageFilter <TInputImage,TOutputImage>
+::BeforeThreadedGenerateData()
+{
+    if (this->GetNumberOfIndexedInputs() != m_TRValues.size())
+        itkExceptionMacro("There should be the same number of inputs and repetition times");
+
+    Superclass::BeforeThreadedGenerateData();
+
+    // T1 nodes from 1 ms to the T1 upper bound, 64 nodes being enough for a starting point of the refinement
+    const unsigned int numDictionaryValues = 64;
+    unsigned int numInputs = m_TRValues.size();
+    double minT1Value = std::min(1.0, m_T1UpperBound / 2.0);
+    double logT1Step = std::log(m_T1UpperBound / minT1Value) / (numDictionaryValues - 1.0);
+
+    m_DictionaryT1Values.resize(numDictionaryValues);
+    m_DictionaryCurves.resize(numDictionaryValues);
+    m_DictionarySquaredNorms.resize(numDictionaryValues);
+    for (unsigned int i = 0;i < numDictionaryValues;++i)
+    {
+        m_DictionaryT1Values[i] = minT1Value * std::exp(i * logT1Step);
+        m_DictionaryCurves[i].resize(numInputs);
+        m_DictionarySquaredNorms[i] = 0.0;
+        for (unsigned int j = 0;j < numInputs;++j)
+        {
+            m_DictionaryCurves[i][j] = 1.0 - std::exp(- m_TRValues[j] / m_DictionaryT1Values[i]);
+            m_DictionarySquaredNorms[i] += m_DictionaryCurves[i][j] * m_DictionaryCurves[i][j];
+        }
+    }
+}
+
 template <typename TInputImage, typename TOutputImage>
 void
 T1SERelaxometryEstimationImageFilter <TInputImage,TOutputImage>
@@ -77,22 +108,7 @@ T1SERelaxometryEstimationImageFilter <TInputImage,TOutputImage>
     typedef itk::ImageRegionIterator <MaskImageType> MaskIteratorType;
     MaskIteratorType maskItr(this->GetComputationMask(),outputRegionForThread);
 
-    anima::T1SERelaxometryCostFunction::Pointer cost = anima::T1SERelaxometryCostFunction::New();
-    cost->SetTRValues(m_TRValues);
-
     std::vector <double> relaxoData(numInputs,0);
-    typedef anima::NLOPTOptimizers OptimizerType;
-
-    unsigned int dimension = cost->GetNumberOfParameters();
-    itk::Array<double> lowerBounds(dimension);
-    itk::Array<double> upperBounds(dimension);
-    OptimizerType::ParametersType p(dimension);
-
-    lowerBounds[0] = 1.0e-4;
-    upperBounds[0] = m_M0UpperBound;
-
-    lowerBounds[1] = 1.0e-4;
-    upperBounds[1] = m_T1UpperBound;
 
     while (!maskItr.IsAtEnd())
     {
@@ -114,39 +130,110 @@ T1SERelaxometryEstimationImageFilter <TInputImage,TOutputImage>
         for (unsigned int i = 0;i < numInputs;++i)
             relaxoData[i] = inIterators[i].Get();
 
-        cost->SetRelaxometrySignals(relaxoData);
+        double m0Value, t1Value;
+        this->EstimateVoxel(relaxoData, m0Value, t1Value);
+
+        outM0Iterator.Set(m0Value);
+        outT1Iterator.Set(t1Value);
+
+        ++maskItr;
+        ++outT1Iterator;
+        ++outM0Iterator;
+
+        for (unsigned int i = 0;i < numInputs;++i)
+            ++inIterators[i];
+    }
+}
+
+template <typename TInputImage, typename TOutputImage>
+void
+T1SERelaxometryEstimationImageFilter <TInputImage,TOutputImage>
+::EstimateVoxel(const std::vector <double> &data, double &m0Value, double &t1Value) const
+{
+    unsigned int numInputs = data.size();
+    const double minimalValue = 1.0e-4;
+
+    // Dictionary lookup, maximizing the explained energy <y,e>^2 / |e|^2 with M0 = <y,e> / |e|^2
+    double bestScore = - 1.0;
+    unsigned int bestIndex = 0;
+    for (unsigned int i = 0;i < m_DictionaryT1Values.size();++i)
+    {
+        double scalarProduct = 0.0;
+        for (unsigned int j = 0;j < numInputs;++j)
+            scalarProduct += data[j] * m_DictionaryCurves[i][j];
+
+        if (scalarProduct <= 0.0)
+            continue;
+
+        double score = scalarProduct * scalarProduct / m_DictionarySquaredNorms[i];
+        if (score > bestScore)
+        {
+            bestScore = score;
+            bestIndex = i;
+        }
+    }
 
-        OptimizerType::Pointer optimizer = OptimizerType::New();
-        optimizer->SetAlgorithm(NLOPT_LN_BOBYQA);
+    double logT1Value = std::log(m_DictionaryT1Values[bestIndex]);
+    m0Value = 0.0;
+    for (unsigned int j = 0;j < numInputs;++j)
+        m0Value += data[j] * m_DictionaryCurves[bestIndex][j];
 
-        optimizer->SetMaxEval(m_MaximumOptimizerIterations);
-        optimizer->SetXTolRel(m_OptimizerStopCondition);
+    m0Value /= m_DictionarySquaredNorms[bestIndex];
+    m0Value = std::max(minimalValue, std::min(m0Value, m_M0UpperBound));
 
-        optimizer->SetLowerBoundParameters(lowerBounds);
-        optimizer->SetUpperBoundParameters(upperBounds);
+    auto computeResidual = [&](const double *parameters)
+    {
+        double t1 = std::exp(parameters[1]);
+        double residual = 0.0;
+        for (unsigned int j = 0;j < numInputs;++j)
+        {
+            double simulatedSignal = parameters[0] * (1.0 - std::exp(- m_TRValues[j] / t1));
+            residual += (simulatedSignal - data[j]) * (simulatedSignal - data[j]);
+        }
 
-        p[0] = 1500;
-        p[1] = 1500;
+        return residual;
+    };
 
-        optimizer->SetMaximize(false);
+    auto acceptEvaluation = [](){};
 
-        optimizer->SetCostFunction(cost);
+    auto computeNormalEquations = [&](const double *parameters, double *jtj, double *jtr)
+    {
+        double t1 = std::exp(parameters[1]);
+        for (unsigned int i = 0;i < 3;++i)
+            jtj[i] = 0.0;
 
-        optimizer->SetInitialPosition(p);
-        optimizer->StartOptimization();
+        jtr[0] = 0.0;
+        jtr[1] = 0.0;
+        for (unsigned int j = 0;j < numInputs;++j)
+        {
+            double expValue = std::exp(- m_TRValues[j] / t1);
+            double m0Derivative = 1.0 - expValue;
+            double t1Derivative = - parameters[0] * m_TRValues[j] * expValue / t1;
+            double residualValue = parameters[0] * m0Derivative - data[j];
+
+            jtj[0] += m0Derivative * m0Derivative;
+            jtj[1] += m0Derivative * t1Derivative;
+            jtj[2] += t1Derivative * t1Derivative;
+            jtr[0] += m0Derivative * residualValue;
+            jtr[1] += t1Derivative * residualValue;
+        }
 
-        p = optimizer->GetCurrentPosition();
+        return true;
+    };
 
-        outM0Iterator.Set(p[0]);
-        outT1Iterator.Set(p[1]);
+    // Bounded Levenberg-Marquardt on (M0, log(T1))
+    anima::TwoParametersBoundedLevenbergMarquardt optimizer;
+    optimizer.SetBounds(0, minimalValue, m_M0UpperBound);
+    optimizer.SetBounds(1, std::log(minimalValue), std::log(m_T1UpperBound));
+    optimizer.SetRelativeStopCondition(0, true);
+    optimizer.SetMaximumNumberOfIterations(m_MaximumOptimizerIterations);
+    optimizer.SetStopCondition(m_OptimizerStopCondition);
 
-        ++maskItr;
-        ++outT1Iterator;
-        ++outM0Iterator;
+    double parameters[2] = {m0Value, logT1Value};
+    optimizer.Optimize(parameters, computeResidual, acceptEvaluation, computeNormalEquations);
 
-        for (unsigned int i = 0;i < numInputs;++i)
-            ++inIterators[i];
-    }
+    m0Value = parameters[0];
+    t1Value = std::exp(parameters[1]);
 }
 
 } // end of namespace anima
@@ -0,0 +1,420 @@
+#include "animaT2EPGBatchEstimator.h"
+
+#include <animaGaussLegendreQuadrature.h>
+#include <animaTwoParametersBoundedLevenbergMarquardt.h>
+
+#include <itkMultiThreaderBase.h>
+#include <itkMacro.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace
+{
+
+//! Linear interpolation of a slice profile, constant outside of its support
+double GetProfileValue(const std::vector < std::pair <double, double> > &profile, double t)
+{
+    if (t <= profile[0].first)
+        return profile[0].second;
+
+    if (t >= profile.back().first)
+        return profile.back().second;
+
+    using PulseIteratorType = std::vector < std::pair <double, double> >::const_iterator;
+    PulseIteratorType it = std::lower_bound(profile.begin(), profile.end(), std::make_pair(t, 0.0));
+    PulseIteratorType itUp = it;
+    ++itUp;
+    if (itUp == profile.end())
+        return it->second;
+
+    double weight = (t - it->first) / (itUp->first - it->first);
+    return weight * itUp->second + (1.0 - weight) * it->second;
+}
+
+} // end anonymous namespace
+
+namespace anima
+{
+
+T2EPGBatchEstimator::T2EPGBatchEstimator()
+{
+    m_EchoSpacing = 10;
+    m_ExcitationFlipAngle = M_PI / 2.0;
+    m_FlipAngle = M_PI;
+    m_NumberOfEchoes = 1;
+
+    m_MinimalT2 = 1.0;
+    m_MaximalT2 = 1000;
+    m_MinimalB1 = 0.5;
+    m_MaximalB1 = 1.0;
+
+    m_DictionaryT1Value = 1000;
+    m_NumberOfDictionaryT2Values = 64;
+    m_NumberOfDictionaryB1Values = 11;
+
+    m_UniformPulses = true;
+    m_PixelWidth = 3.0;
+
+    m_MaximumNumberOfIterations = 100;
+    m_StopCondition = 1.0e-4;
+
+    m_NumberOfWorkUnits = itk::MultiThreaderBase::GetGlobalDefaultNumberOfThreads();
+}
+
+void T2EPGBatchEstimator::BuildDictionary()
+{
+    if ((m_MinimalT2 <= 0.0) || (m_MaximalT2 <= m_MinimalT2) || (m_NumberOfDictionaryT2Values < 2))
+        throw itk::ExceptionObject(__FILE__, __LINE__,"T2 EPG dictionary requires a positive T2 range and at least two T2 values",ITK_LOCATION);
+
+    if ((m_MaximalB1 <= m_MinimalB1) || (m_NumberOfDictionaryB1Values < 2))
+        throw itk::ExceptionObject(__FILE__, __LINE__,"T2 EPG dictionary requires a B1 range and at least two B1 values",ITK_LOCATION);
+
+    if ((!m_UniformPulses) && ((m_PulseProfile.size() == 0) || (m_ExcitationProfile.size() == 0)))
+        throw itk::ExceptionObject(__FILE__, __LINE__,"T2 EPG dictionary requires pulse profiles for non uniform pulses",ITK_LOCATION);
+
+    m_DictionaryT2Values.resize(m_NumberOfDictionaryT2Values);
+    double logT2Step = std::log(m_MaximalT2 / m_MinimalT2) / (m_NumberOfDictionaryT2Values - 1.0);
+    for (unsigned int i = 0;i < m_NumberOfDictionaryT2Values;++i)
+        m_DictionaryT2Values[i] = m_MinimalT2 * std::exp(i * logT2Step);
+
+    // B1 nodes at cell centers: EPG signals being even functions of the flip angle around pi, the B1 derivative vanishes
+    // at B1 = 1 which would stall the refinement if used as initialization
+    m_DictionaryB1Values.resize(m_NumberOfDictionaryB1Values);
+    for (unsigned int i = 0;i < m_NumberOfDictionaryB1Values;++i)
+        m_DictionaryB1Values[i] = m_MinimalB1 + (i + 0.5) * (m_MaximalB1 - m_MinimalB1) / m_NumberOfDictionaryB1Values;
+
+    unsigned int numAtoms = m_NumberOfDictionaryB1Values * m_NumberOfDictionaryT2Values;
+    m_DictionarySignals.set_size(numAtoms, m_NumberOfEchoes);
+    m_DictionarySums.resize(numAtoms);
+    m_DictionarySquaredNorms.resize(numAtoms);
+
+    itk::MultiThreaderBase::Pointer threader = itk::MultiThreaderBase::New();
+    threader->SetNumberOfWorkUnits(m_NumberOfWorkUnits);
+    threader->ParallelizeArray(0, m_NumberOfDictionaryB1Values, [&](itk::SizeValueType b1Index)
+    {
+        SimulatorWorkspaceType workspace;
+        vnl_matrix <double> b1Signals;
+        this->ComputeDictionarySignals(workspace, m_DictionaryB1Values[b1Index], b1Signals);
+
+        for (unsigned int i = 0;i < m_NumberOfDictionaryT2Values;++i)
+        {
+            unsigned int atom = b1Index * m_NumberOfDictionaryT2Values + i;
+
+            double sumSignals = 0.0;
+            double squaredNorm = 0.0;
+            for (unsigned int j = 0;j < m_NumberOfEchoes;++j)
+            {
+                m_DictionarySignals(atom,j) = b1Signals(i,j);
+                sumSignals += b1Signals(i,j);
+                squaredNorm += b1Signals(i,j) * b1Signals(i,j);
+            }
+
+            m_DictionarySums[atom] = sumSignals;
+            m_DictionarySquaredNorms[atom] = squaredNorm;
+        }
+    }, nullptr);
+}
+
+anima::EPGBatchSignalSimulator T2EPGBatchEstimator::GetSignalSimulator(double excitationFlipAngle) const
+{
+    anima::EPGBatchSignalSimulator simulator;
+    simulator.SetNumberOfEchoes(m_NumberOfEchoes);
+    simulator.SetEchoSpacing(m_EchoSpacing);
+    simulator.SetExcitationFlipAngle(excitationFlipAngle);
+
+    return simulator;
+}
+
+void T2EPGBatchEstimator::ComputeSignals(SimulatorWorkspaceType &workspace, double t1Value, double t2Value, double b1Value,
+                                         std::vector <double> &signals, std::vector <double> *b1Derivatives) const
+{
+    double flipAngle = b1Value * m_FlipAngle;
+
+    if (m_UniformPulses)
+    {
+        this->GetSignalSimulator(m_ExcitationFlipAngle).GetValue(t1Value, t2Value, flipAngle, 1.0, workspace, signals, b1Derivatives);
+        if (b1Derivatives)
+        {
+            for (unsigned int j = 0;j < m_NumberOfEchoes;++j)
+                (*b1Derivatives)[j] *= m_FlipAngle;
+        }
+
+        return;
+    }
+
+    // Average over the slice profile of EPG values and of their B1 derivative, including the pulse profile factor
+    unsigned int numComponents = m_NumberOfEchoes;
+    if (b1Derivatives)
+        numComponents *= 2;
+
+    std::vector <double> derivativeValues;
+    auto sliceIntegrand = [&](double const t)
+    {
+        double pulseProfileValue = GetProfileValue(m_PulseProfile, t);
+        double excitationProfileValue = GetProfileValue(m_ExcitationProfile, t);
+
+        std::vector <double> sliceValues;
+        anima::EPGBatchSignalSimulator simulator = this->GetSignalSimulator(excitationProfileValue * m_ExcitationFlipAngle);
+        simulator.GetValue(t1Value, t2Value, pulseProfileValue * flipAngle, 1.0, workspace, sliceValues,
+                           b1Derivatives ? &derivativeValues : 0);
+
+        if (b1Derivatives)
+        {
+            sliceValues.resize(numComponents);
+            for (unsigned int j = 0;j < m_NumberOfEchoes;++j)
+                sliceValues[m_NumberOfEchoes + j] = pulseProfileValue * m_FlipAngle * derivativeValues[j];
+        }
+
+        return sliceValues;
+    };
+
+    anima::GaussLegendreQuadrature spIntegral;
+    spIntegral.SetInterestZone(- m_PixelWidth / 2.0, m_PixelWidth / 2.0);
+    spIntegral.SetNumberOfComponents(numComponents);
+
+    std::vector <double> integralValues = spIntegral.GetVectorIntegralValue(sliceIntegrand);
+
+    signals.resize(m_NumberOfEchoes);
+    for (unsigned int j = 0;j < m_NumberOfEchoes;++j)
+        signals[j] = integralValues[j] / m_PixelWidth;
+
+    if (b1Derivatives)
+    {
+        b1Derivatives->resize(m_NumberOfEchoes);
+        for (unsigned int j = 0;j < m_NumberOfEchoes;++j)
+            (*b1Derivatives)[j] = integralValues[m_NumberOfEchoes + j] / m_PixelWidth;
+    }
+}
+
+void T2EPGBatchEstimator::ComputeDictionarySignals(SimulatorWorkspaceType &workspace, double b1Value, vnl_matrix <double> &signals) const
+{
+    double flipAngle = b1Value * m_FlipAngle;
+
+    if (m_UniformPulses)
+    {
+        this->GetSignalSimulator(m_ExcitationFlipAngle).GetValues(m_DictionaryT1Value, m_DictionaryT2Values, flipAngle, 1.0,
+                                                                  workspace, signals);
+        return;
+    }
+
+    // Slice profile average of all T2 values at once, components being ordered by T2 value then echo
+    unsigned int numT2Values = m_DictionaryT2Values.size();
+    unsigned int numComponents = numT2Values * m_NumberOfEchoes;
+
+    vnl_matrix <double> sliceSignals;
+    auto sliceIntegrand = [&](double const t)
+    {
+        double pulseProfileValue = GetProfileValue(m_PulseProfile, t);
+        double excitationProfileValue = GetProfileValue(m_ExcitationProfile, t);
+
+        anima::EPGBatchSignalSimulator simulator = this->GetSignalSimulator(excitationProfileValue * m_ExcitationFlipAngle);
+        simulator.GetValues(m_DictionaryT1Value, m_DictionaryT2Values, pulseProfileValue * flipAngle, 1.0, workspace, sliceSignals);
+
+        std::vector <double> sliceValues(numComponents);
+        for (unsigned int i = 0;i < numT2Values;++i)
+        {
+            for (unsigned int j = 0;j < m_NumberOfEchoes;++j)
+                sliceValues[i * m_NumberOfEchoes + j] = sliceSignals(i,j);
+        }
+
+        return sliceValues;
+    };
+
+    anima::GaussLegendreQuadrature spIntegral;
+    spIntegral.SetInterestZone(- m_PixelWidth / 2.0, m_PixelWidth / 2.0);
+    spIntegral.SetNumberOfComponents(numComponents);
+
+    std::vector <double> integralValues = spIntegral.GetVectorIntegralValue(sliceIntegrand);
+
+    signals.set_size(numT2Values, m_NumberOfEchoes);
+    for (unsigned int i = 0;i < numT2Values;++i)
+    {
+        for (unsigned int j = 0;j < m_NumberOfEchoes;++j)
+            signals(i,j) = integralValues[i * m_NumberOfEchoes + j] / m_PixelWidth;
+    }
+}
+
+void T2EPGBatchEstimator::EstimateBatch(const vnl_matrix <double> &signals, const std::vector <double> &t1Values,
+                                        const std::vector <double> &t2UpperBounds, std::vector <double> &t2Values,
+                                        std::vector <double> &b1Values, std::vector <double> &m0Values) const
+{
+    if (m_DictionarySignals.rows() == 0)
+        throw itk::ExceptionObject(__FILE__, __LINE__,"T2 EPG dictionary has to be built before estimation",ITK_LOCATION);
+
+    unsigned int numVoxels = signals.rows();
+    t2Values.resize(numVoxels);
+    b1Values.resize(numVoxels);
+    m0Values.resize(numVoxels);
+
+    // Scalar products of all voxels of the block with all dictionary atoms, computed as a single matrix product
+    unsigned int numAtoms = m_DictionarySignals.rows();
+    vnl_matrix <double> scalarProducts = signals * m_DictionarySignals.transpose();
+
+    SimulatorWorkspaceType workspace;
+    std::vector <double> data(m_NumberOfEchoes);
+
+    for (unsigned int i = 0;i < numVoxels;++i)
+    {
+        double sumData = 0.0;
+        for (unsigned int j = 0;j < m_NumberOfEchoes;++j)
+        {
+            data[j] = signals(i,j);
+            sumData += data[j];
+        }
+
+        // Not estimated, outputs being set to the value of voxels outside of the computation mask
+        if (sumData <= 0.0)
+        {
+            t2Values[i] = 0.0;
+            b1Values[i] = 0.0;
+            m0Values[i] = 0.0;
+            continue;
+        }
+
+        // Dictionary lookup, the residual being (up to a constant) M0^2 |s|^2 - 2 M0 <s,y> with M0 = sum(y) / sum(s)
+        double bestResidual = std::numeric_limits <double>::max();
+        unsigned int bestAtom = 0;
+        for (unsigned int k = 0;k < numAtoms;++k)
+        {
+            if ((m_DictionaryT2Values[k % m_NumberOfDictionaryT2Values] > t2UpperBounds[i]) && (k % m_NumberOfDictionaryT2Values != 0))
+                continue;
+
+            if (m_DictionarySums[k] <= 0.0)
+                continue;
+
+            double m0Value = sumData / m_DictionarySums[k];
+            double residual = m0Value * (m0Value * m_DictionarySquaredNorms[k] - 2.0 * scalarProducts(i,k));
+            if (residual < bestResidual)
+            {
+                bestResidual = residual;
+                bestAtom = k;
+            }
+        }
+
+        double t2UpperBound = std::max(m_MinimalT2, t2UpperBounds[i]);
+        double t2Value = std::min(m_DictionaryT2Values[bestAtom % m_NumberOfDictionaryT2Values], t2UpperBound);
+        double b1Value = m_DictionaryB1Values[bestAtom / m_NumberOfDictionaryT2Values];
+
+        double m0Value = 0.0;
+        double residual = this->RefineEstimate(workspace, data, t1Values[i], t2UpperBound, t2Value, b1Value, m0Value);
+
+        // The B1 derivative vanishing at B1 = 1, refinement may stall on the upper bound: retry from inside the B1 range
+        if (b1Value >= m_MaximalB1)
+        {
+            double retryT2Value = t2Value;
+            double retryB1Value = m_MaximalB1 - (m_MaximalB1 - m_MinimalB1) / m_NumberOfDictionaryB1Values;
+            double retryM0Value = 0.0;
+            double retryResidual = this->RefineEstimate(workspace, data, t1Values[i], t2UpperBound, retryT2Value, retryB1Value, retryM0Value);
+
+            if (retryResidual < residual)
+            {
+                t2Value = retryT2Value;
+                b1Value = retryB1Value;
+                m0Value = retryM0Value;
+            }
+        }
+
+        t2Values[i] = t2Value;
+        b1Values[i] = b1Value;
+        m0Values[i] = m0Value;
+    }
+}
+
+double T2EPGBatchEstimator::RefineEstimate(SimulatorWorkspaceType &workspace, const std::vector <double> &data, double t1Value,
+                                           double t2UpperBound, double &t2Value, double &b1Value, double &m0Value) const
+{
+    double sumData = 0.0;
+    for (unsigned int j = 0;j < m_NumberOfEchoes;++j)
+        sumData += data[j];
+
+    // Signals of the current and last evaluated parameters (log(T2), B1), M0 being the ratio of data and simulated signal sums
+    std::vector <double> simulatedSignals, b1Derivatives, t2ShiftedSignals;
+    std::vector <double> trialSignals, trialB1Derivatives;
+    double trialM0Value = 0.0;
+
+    auto computeResidual = [&](const double *parameters)
+    {
+        this->ComputeSignals(workspace, t1Value, std::exp(parameters[0]), parameters[1], trialSignals, &trialB1Derivatives);
+
+        double sumSignals = 0.0;
+        for (unsigned int j = 0;j < m_NumberOfEchoes;++j)
+            sumSignals += trialSignals[j];
+
+        trialM0Value = (sumSignals > 0.0) ? sumData / sumSignals : 0.0;
+
+        double residual = 0.0;
+        for (unsigned int j = 0;j < m_NumberOfEchoes;++j)
+            residual += (trialM0Value * trialSignals[j] - data[j]) * (trialM0Value * trialSignals[j] - data[j]);
+
+        return residual;
+    };
+
+    auto acceptEvaluation = [&]()
+    {
+        std::swap(simulatedSignals, trialSignals);
+        std::swap(b1Derivatives, trialB1Derivatives);
+        m0Value = trialM0Value;
+    };
+
+    // Jacobian of M0 s(T2,B1), the log(T2) derivative being approximated by forward differences
+    const double logT2DifferenceStep = 1.0e-5;
+    std::vector <double> t2Jacobian(m_NumberOfEchoes), b1Jacobian(m_NumberOfEchoes);
+    auto computeNormalEquations = [&](const double *parameters, double *jtj, double *jtr)
+    {
+        this->ComputeSignals(workspace, t1Value, std::exp(parameters[0] + logT2DifferenceStep), parameters[1], t2ShiftedSignals, 0);
+
+        double sumSignals = 0.0;
+        double sumT2Derivatives = 0.0;
+        double sumB1Derivatives = 0.0;
+        for (unsigned int j = 0;j < m_NumberOfEchoes;++j)
+        {
+            t2Jacobian[j] = (t2ShiftedSignals[j] - simulatedSignals[j]) / logT2DifferenceStep;
+            sumSignals += simulatedSignals[j];
+            sumT2Derivatives += t2Jacobian[j];
+            sumB1Derivatives += b1Derivatives[j];
+        }
+
+        if (sumSignals <= 0.0)
+            return false;
+
+        jtj[0] = 0.0;
+        jtj[1] = 0.0;
+        jtj[2] = 0.0;
+        jtr[0] = 0.0;
+        jtr[1] = 0.0;
+        for (unsigned int j = 0;j < m_NumberOfEchoes;++j)
+        {
+            t2Jacobian[j] = m0Value * (t2Jacobian[j] - sumT2Derivatives * simulatedSignals[j] / sumSignals);
+            b1Jacobian[j] = m0Value * (b1Derivatives[j] - sumB1Derivatives * simulatedSignals[j] / sumSignals);
+            double residualValue = m0Value * simulatedSignals[j] - data[j];
+
+            jtj[0] += t2Jacobian[j] * t2Jacobian[j];
+            jtj[1] += t2Jacobian[j] * b1Jacobian[j];
+            jtj[2] += b1Jacobian[j] * b1Jacobian[j];
+            jtr[0] += t2Jacobian[j] * residualValue;
+            jtr[1] += b1Jacobian[j] * residualValue;
+        }
+
+        return true;
+    };
+
+    // Steps are limited to one dictionary cell in B1, so that they do not overshoot to B1 = 1 where the B1 derivative vanishes
+    anima::TwoParametersBoundedLevenbergMarquardt optimizer;
+    optimizer.SetBounds(0, std::log(m_MinimalT2), std::log(t2UpperBound));
+    optimizer.SetBounds(1, m_MinimalB1, m_MaximalB1);
+    optimizer.SetMaximalStep(1, (m_MaximalB1 - m_MinimalB1) / m_NumberOfDictionaryB1Values);
+    optimizer.SetRelativeStopCondition(1, true);
+    optimizer.SetMaximumNumberOfIterations(m_MaximumNumberOfIterations);
+    optimizer.SetStopCondition(m_StopCondition);
+
+    double parameters[2] = {std::log(t2Value), b1Value};
+    double residual = optimizer.Optimize(parameters, computeResidual, acceptEvaluation, computeNormalEquations);
+
+    t2Value = std::exp(parameters[0]);
+    b1Value = parameters[1];
+    return residual;
+}
+
+} // end namespace anima
@@ -0,0 +1,112 @@
+#pragma once
+#include "AnimaRelaxometryExport.h"
+
+#include <animaEPGBatchSignalSimulator.h>
+#include <vnl/vnl_matrix.h>
+
+#include <vector>
+#include <utility>
+
+namespace anima
+{
+
+/**
+ * \class T2EPGBatchEstimator
+ * @brief Estimates mono-T2 EPG parameters (T2, B1, M0) on blocks of voxels, used by T2EPGRelaxometryEstimationImageFilter.
+ *
+ * A coarse dictionary of EPG echo trains is simulated once on a (B1, T2) grid (one batched EPG sweep per B1 value),
+ * each echo train being shared by all voxels of a block. Each voxel is initialized by a dictionary lookup minimizing the
+ * squared difference between data and M0 times the simulated echo train (M0 being the ratio of signal sums), scalar products
+ * of a block with all atoms being one matrix product. It is then refined by TwoParametersBoundedLevenbergMarquardt on
+ * (log(T2), B1), with the analytical flip angle derivative of the EPG signal.
+ */
+class ANIMARELAXOMETRY_EXPORT T2EPGBatchEstimator
+{
+public:
+    T2EPGBatchEstimator();
+    virtual ~T2EPGBatchEstimator() {}
+
+    void SetEchoSpacing(double val) {m_EchoSpacing = val;}
+    void SetExcitationFlipAngle(double val) {m_ExcitationFlipAngle = val;}
+    //! Refocusing flip angle, scaled by B1
+    void SetFlipAngle(double val) {m_FlipAngle = val;}
+    void SetNumberOfEchoes(unsigned int val) {m_NumberOfEchoes = val;}
+
+    void SetT2Range(double minVal, double maxVal) {m_MinimalT2 = minVal; m_MaximalT2 = maxVal;}
+    void SetB1Range(double minVal, double maxVal) {m_MinimalB1 = minVal; m_MaximalB1 = maxVal;}
+
+    //! T1 value used to simulate the dictionary, the refinement using the T1 value of each voxel
+    void SetDictionaryT1Value(double val) {m_DictionaryT1Value = val;}
+    void SetNumberOfDictionaryT2Values(unsigned int val) {m_NumberOfDictionaryT2Values = val;}
+    void SetNumberOfDictionaryB1Values(unsigned int val) {m_NumberOfDictionaryB1Values = val;}
+
+    void SetUniformPulses(bool val) {m_UniformPulses = val;}
+    void SetPixelWidth(double val) {m_PixelWidth = val;}
+    void SetPulseProfile(const std::vector < std::pair <double, double> > &profile) {m_PulseProfile = profile;}
+    void SetExcitationProfile(const std::vector < std::pair <double, double> > &profile) {m_ExcitationProfile = profile;}
+
+    void SetMaximumNumberOfIterations(unsigned int val) {m_MaximumNumberOfIterations = val;}
+    //! Relative parameter change under which refinement stops
+    void SetStopCondition(double val) {m_StopCondition = val;}
+
+    void SetNumberOfWorkUnits(unsigned int val) {m_NumberOfWorkUnits = val;}
+
+    //! Simulates dictionary echo trains, has to be called before any estimation
+    void BuildDictionary();
+
+    /**
+     * Estimates T2, B1 and M0 for a block of voxels, signals holding one echo train per row. T1 values and T2 upper bounds
+     * are given for each voxel. Voxels with a non positive signal sum are not estimated, all their values being set to 0.
+     * Thread safe once the dictionary is built.
+     */
+    void EstimateBatch(const vnl_matrix <double> &signals, const std::vector <double> &t1Values,
+                       const std::vector <double> &t2UpperBounds, std::vector <double> &t2Values,
+                       std::vector <double> &b1Values, std::vector <double> &m0Values) const;
+
+protected:
+    typedef anima::EPGBatchSignalSimulator::Workspace SimulatorWorkspaceType;
+
+    //! EPG simulator set up with the sequence parameters, for a given excitation flip angle
+    anima::EPGBatchSignalSimulator GetSignalSimulator(double excitationFlipAngle) const;
+
+    //! Simulated echo train (averaged over the slice profile if needed), and optionally its derivative with respect to B1
+    void ComputeSignals(SimulatorWorkspaceType &workspace, double t1Value, double t2Value, double b1Value,
+                        std::vector <double> &signals, std::vector <double> *b1Derivatives) const;
+
+    //! Echo trains of all dictionary T2 values at a given B1 value (averaged over the slice profile if needed), one row per T2 value
+    void ComputeDictionarySignals(SimulatorWorkspaceType &workspace, double b1Value, vnl_matrix <double> &signals) const;
+
+    //! Bounded Levenberg-Marquardt refinement of T2 and B1 from their initial values, returns the final residual
+    double RefineEstimate(SimulatorWorkspaceType &workspace, const std::vector <double> &data, double t1Value,
+                          double t2UpperBound, double &t2Value, double &b1Value, double &m0Value) const;
+
+private:
+    double m_EchoSpacing;
+    double m_ExcitationFlipAngle;
+    double m_FlipAngle;
+    unsigned int m_NumberOfEchoes;
+
+    double m_MinimalT2, m_MaximalT2;
+    double m_MinimalB1, m_MaximalB1;
+
+    double m_DictionaryT1Value;
+    unsigned int m_NumberOfDictionaryT2Values;
+    unsigned int m_NumberOfDictionaryB1Values;
+
+    bool m_UniformPulses;
+    double m_PixelWidth;
+    std::vector < std::pair <double, double> > m_PulseProfile;
+    std::vector < std::pair <double, double> > m_ExcitationProfile;
+
+    unsigned int m_MaximumNumberOfIterations;
+    double m_StopCondition;
+
+    unsigned int m_NumberOfWorkUnits;
+
+    //! Dictionary echo trains, one row per atom, atoms being ordered by B1 then T2
+    vnl_matrix <double> m_DictionarySignals;
+    std::vector <double> m_DictionaryT2Values, m_DictionaryB1Values;
+    std::vector <double> m_DictionarySums, m_DictionarySquaredNorms;
+};
+
+} // end namespace anima
@@ -4,9 +4,18 @@
 #include <itkVectorImage.h>
 #include <itkImage.h>
 
+#include <animaT2EPGBatchEstimator.h>
+
 namespace anima
 {
 
+/**
+ * \class T2EPGRelaxometryEstimationImageFilter
+ * @brief Estimates T2, M0 and B1 maps from multi-echo T2 relaxometry images with a mono-T2 EPG model.
+ *
+ * Masked voxels of each thread region are fitted by blocks with anima::T2EPGBatchEstimator: dictionary lookup shared
+ * by all voxels, followed by a bounded Gauss-Newton refinement in each voxel.
+ */
 template <typename TInputImage, typename TOutputImage>
 class T2EPGRelaxometryEstimationImageFilter :
 public anima::MaskedImageToImageFilter<TInputImage,TOutputImage>
@@ -46,6 +55,9 @@ public:
     itkSetMacro(MaximumOptimizerIterations, unsigned int)
     itkSetMacro(OptimizerStopCondition, double)
 
+    //! Number of voxels fitted together by the batch estimator
+    itkSetMacro(BatchSize, unsigned int)
+
     itkSetMacro(T2ExcitationFlipAngle, double)
 
     void SetT2FlipAngles(std::vector <double> & flipAngles) {m_T2FlipAngles = flipAngles;}
@@ -76,6 +88,7 @@ protected:
 
         m_MaximumOptimizerIterations = 5000;
         m_OptimizerStopCondition = 1.0e-4;
+        m_BatchSize = 256;
 
         m_UniformPulses = true;
         m_ReferenceSliceThickness = 3.0;
@@ -101,8 +114,8 @@ private:
     // T1 relaxometry specific values
     OutputImagePointer m_T1Map;
 
-    // T2 initial values
-    OutputImagePointer m_InitialT2Image;
+    unsigned int m_BatchSize;
+    anima::T2EPGBatchEstimator m_BatchEstimator;
 
     // T2 relaxometry specific values
     double m_EchoSpacing;
@@ -1,13 +1,9 @@
 #pragma once
 #include "animaT2EPGRelaxometryEstimationImageFilter.h"
-#include <animaT2RelaxometryEstimationImageFilter.h>
 
 #include <itkImageRegionIterator.h>
 #include <itkImageRegionConstIterator.h>
 
-#include <animaT2EPGRelaxometryCostFunction.h>
-#include <animaNLOPTOptimizers.h>
-
 namespace anima
 {
 
@@ -66,27 +62,6 @@ T2EPGRelaxometryEstimationImageFilter <TInputImage,TOutputImage>
 {
     this->Superclass::BeforeThreadedGenerateData();
 
-    typedef anima::T2RelaxometryEstimationImageFilter <TInputImage,TOutputImage> InitT2FilterType;
-    typename InitT2FilterType::Pointer initFilter = InitT2FilterType::New();
-
-    for (unsigned int i = 0;i < this->GetNumberOfIndexedInputs();++i)
-        initFilter->SetInput(i,this->GetInput(i));
-
-    initFilter->SetT1Map(m_T1Map);
-
-    initFilter->SetEchoSpacing(m_EchoSpacing);
-    initFilter->SetNumberOfWorkUnits(this->GetNumberOfWorkUnits());
-    initFilter->SetComputationMask(this->GetComputationMask());
-    initFilter->SetTRValue(m_TRValue);
-    initFilter->SetT2UpperBoundValue(m_T2UpperBound);
-    initFilter->SetOptimizerStopCondition(m_OptimizerStopCondition);
-    initFilter->SetMaximumOptimizerIterations(m_MaximumOptimizerIterations);
-
-    initFilter->Update();
-
-    m_InitialT2Image = initFilter->GetOutput();
-    m_InitialT2Image->DisconnectPipeline();
-
     // Prepare pixel width data from pulse profiles if present
     if (!m_UniformPulses)
     {
@@ -123,6 +98,54 @@ T2EPGRelaxometryEstimationImageFilter <TInputImage,TOutputImage>
         for (unsigned int i = 0;i < m_PulseProfile.size();++i)
             m_PulseProfile[i].first *= pulseRatioToProfile;
     }
+
+    // Dictionary is simulated at the average T1 inside the mask, T1 being only a second order effect for initialization
+    double dictionaryT1Value = m_T2UpperBound;
+    if (m_T1Map)
+    {
+        typedef itk::ImageRegionConstIterator <OutputImageType> T1IteratorType;
+        typedef itk::ImageRegionConstIterator <MaskImageType> MaskIteratorType;
+
+        T1IteratorType t1MapItr(m_T1Map,this->GetOutput()->GetLargestPossibleRegion());
+        MaskIteratorType maskItr(this->GetComputationMask(),this->GetOutput()->GetLargestPossibleRegion());
+
+        double sumT1Values = 0.0;
+        unsigned int numT1Values = 0;
+        while (!maskItr.IsAtEnd())
+        {
+            if ((maskItr.Get() != 0) && (t1MapItr.Get() > 0.0))
+            {
+                sumT1Values += t1MapItr.Get();
+                ++numT1Values;
+            }
+
+            ++maskItr;
+            ++t1MapItr;
+        }
+
+        dictionaryT1Value = (numT1Values > 0) ? sumT1Values / numT1Values : 1000.0;
+    }
+
+    m_BatchEstimator.SetEchoSpacing(m_EchoSpacing);
+    m_BatchEstimator.SetExcitationFlipAngle(m_T2ExcitationFlipAngle);
+    m_BatchEstimator.SetFlipAngle(m_T2FlipAngles[0]);
+    m_BatchEstimator.SetNumberOfEchoes(this->GetNumberOfIndexedInputs());
+    m_BatchEstimator.SetT2Range(1.0, m_T2UpperBound);
+    m_BatchEstimator.SetB1Range(0.5, 1.0);
+    m_BatchEstimator.SetDictionaryT1Value(dictionaryT1Value);
+    m_BatchEstimator.SetMaximumNumberOfIterations(m_MaximumOptimizerIterations);
+    m_BatchEstimator.SetStopCondition(m_OptimizerStopCondition);
+    m_BatchEstimator.SetNumberOfWorkUnits(this->GetNumberOfWorkUnits());
+
+    m_BatchEstimator.SetUniformPulses(m_UniformPulses);
+    if (!m_UniformPulses)
+    {
+        m_BatchEstimator.SetPulseProfile(m_PulseProfile);
+        m_BatchEstimator.SetExcitationProfile(m_ExcitationProfile);
+        m_BatchEstimator.SetPixelWidth(m_ExcitationPixelWidth);
+    }
+
+    m_BatchEstimator.BuildDictionary();
 }
 
 template <typename TInputImage, typename TOutputImage>
@@ -133,7 +156,6 @@ T2EPGRelaxometryEstimationImageFilter <TInputImage,TOutputImage>
     typedef itk::ImageRegionConstIterator <InputImageType> ImageIteratorType;
     typedef itk::ImageRegionIterator <OutputImageType> OutImageIteratorType;
 
-    OutImageIteratorType initT2Iterator(m_InitialT2Image,outputRegionForThread);
     OutImageIteratorType outT2Iterator(this->GetOutput(0),outputRegionForThread);
     OutImageIteratorType outM0Iterator(this->GetOutput(1),outputRegionForThread);
     OutImageIteratorType outB1Iterator(this->GetOutput(2),outputRegionForThread);
@@ -150,122 +172,118 @@ T2EPGRelaxometryEstimationImageFilter <TInputImage,TOutputImage>
     if (m_T1Map)
         t1MapItr = OutImageIteratorType(m_T1Map,outputRegionForThread);
 
-    std::vector <double> relaxoT2Data(numInputs,0);
-
-    typedef anima::NLOPTOptimizers OptimizerType;
-    typedef anima::T2EPGRelaxometryCostFunction CostFunctionType;
-
-    typename CostFunctionType::Pointer cost = CostFunctionType::New();
-    cost->SetT2EchoSpacing(m_EchoSpacing);
-    cost->SetT2ExcitationFlipAngle(m_T2ExcitationFlipAngle);
-    cost->SetT2FlipAngles(m_T2FlipAngles);
-
-    cost->SetUniformPulses(m_UniformPulses);
-    if (!m_UniformPulses)
-    {
-        cost->SetPulseProfile(m_PulseProfile);
-        cost->SetExcitationProfile(m_ExcitationProfile);
-        cost->SetPixelWidth(m_ExcitationPixelWidth);
-    }
-
-    unsigned int dimension = cost->GetNumberOfParameters();
-    itk::Array<double> lowerBounds(dimension);
-    itk::Array<double> upperBounds(dimension);
-    OptimizerType::ParametersType p(dimension);
-
-    while (!maskItr.IsAtEnd())
+    // Estimated voxels are gathered in blocks, fitted together by the batch estimator. Output iterators lag behind
+    // input ones, and are moved forward when a block is estimated, skipping voxels left out since the previous estimated one
+    unsigned int batchSize = std::max(m_BatchSize, (unsigned int)1);
+    vnl_matrix <double> batchSignals(batchSize, numInputs);
+    std::vector <double> batchT1Values, batchT2UpperBounds;
+    std::vector <unsigned int> batchSkippedVoxels;
+    std::vector <double> t2Values, b1Values, m0Values;
+    std::vector <double> voxelSignals(numInputs);
+    unsigned int numSkippedVoxels = 0;
+
+    auto writeSkippedVoxels = [&](unsigned int numVoxels)
     {
-        double t1Value = m_T2UpperBound;
-
-        if (m_T1Map)
-        {
-            t1Value = t1MapItr.Get();
-            if (t1Value <= 0.0)
-                t1Value = 1000;
-        }
-
-        double b1Value = 0.9;
-        double t2Value = initT2Iterator.Get();
-
-        if (maskItr.Get() == 0)
+        for (unsigned int i = 0;i < numVoxels;++i)
         {
             outT2Iterator.Set(0);
             outM0Iterator.Set(0);
             outB1Iterator.Set(0);
 
-            ++maskItr;
             ++outT2Iterator;
             ++outM0Iterator;
             ++outB1Iterator;
-            ++initT2Iterator;
-
-            for (unsigned int i = 0;i < numInputs;++i)
-                ++inIterators[i];
+        }
+    };
 
-            if (m_T1Map)
-                ++t1MapItr;
+    auto processBatch = [&]()
+    {
+        unsigned int numVoxels = batchSkippedVoxels.size();
+        if (numVoxels == 0)
+            return;
 
-            continue;
-        }
+        if (numVoxels < batchSize)
+            m_BatchEstimator.EstimateBatch(batchSignals.extract(numVoxels, numInputs), batchT1Values,
+                                           batchT2UpperBounds, t2Values, b1Values, m0Values);
+        else
+            m_BatchEstimator.EstimateBatch(batchSignals, batchT1Values, batchT2UpperBounds, t2Values, b1Values, m0Values);
 
-        cost->SetT1Value(t1Value);
+        for (unsigned int i = 0;i < numVoxels;++i)
+        {
+            writeSkippedVoxels(batchSkippedVoxels[i]);
 
-        // Here go the T2 and B1 estimation
-        for (unsigned int i = 0;i < numInputs;++i)
-            relaxoT2Data[i] = inIterators[i].Get();
+            outT2Iterator.Set(t2Values[i]);
+            outM0Iterator.Set(m0Values[i]);
+            outB1Iterator.Set(b1Values[i]);
 
-        cost->SetT2RelaxometrySignals(relaxoT2Data);
+            ++outT2Iterator;
+            ++outM0Iterator;
+            ++outB1Iterator;
 
-        OptimizerType::Pointer optimizer = OptimizerType::New();
-        optimizer->SetAlgorithm(NLOPT_LN_BOBYQA);
-        optimizer->SetXTolRel(m_OptimizerStopCondition);
-        optimizer->SetFTolRel(1.0e-2 * m_OptimizerStopCondition);
-        optimizer->SetMaxEval(m_MaximumOptimizerIterations);
-        optimizer->SetVectorStorageSize(2000);
+            this->IncrementNumberOfProcessedPoints();
+        }
 
-        lowerBounds[0] = 1.0;
-        upperBounds[0] = m_T2UpperBound;
-        if (m_T1Map && (m_T2UpperBound > t1Value))
-            upperBounds[0] = t1Value;
+        batchSkippedVoxels.clear();
+        batchT1Values.clear();
+        batchT2UpperBounds.clear();
+    };
 
-        lowerBounds[1] = 0.5;
-        upperBounds[1] = 1.0;
+    while (!maskItr.IsAtEnd())
+    {
+        // Voxels with a non positive signal sum cannot be fitted, they get the values of voxels outside of the mask
+        bool estimatedVoxel = (maskItr.Get() != 0);
+        if (estimatedVoxel)
+        {
+            double sumSignals = 0.0;
+            for (unsigned int i = 0;i < numInputs;++i)
+            {
+                voxelSignals[i] = inIterators[i].Get();
+                sumSignals += voxelSignals[i];
+            }
 
-        p[0] = t2Value;
-        p[1] = b1Value;
+            estimatedVoxel = (sumSignals > 0.0);
+        }
 
-        optimizer->SetLowerBoundParameters(lowerBounds);
-        optimizer->SetUpperBoundParameters(upperBounds);
-        optimizer->SetMaximize(false);
+        if (estimatedVoxel)
+        {
+            double t1Value = m_T2UpperBound;
+            double t2UpperBound = m_T2UpperBound;
 
-        optimizer->SetCostFunction(cost);
+            if (m_T1Map)
+            {
+                t1Value = t1MapItr.Get();
+                if (t1Value <= 0.0)
+                    t1Value = 1000;
 
-        optimizer->SetInitialPosition(p);
-        optimizer->StartOptimization();
+                if (m_T2UpperBound > t1Value)
+                    t2UpperBound = t1Value;
+            }
 
-        p = optimizer->GetCurrentPosition();
+            unsigned int batchPosition = batchSkippedVoxels.size();
+            for (unsigned int i = 0;i < numInputs;++i)
+                batchSignals(batchPosition,i) = voxelSignals[i];
 
-        t2Value = p[0];
-        b1Value = p[1];
-        cost->GetValue(p);
+            batchSkippedVoxels.push_back(numSkippedVoxels);
+            batchT1Values.push_back(t1Value);
+            batchT2UpperBounds.push_back(t2UpperBound);
+            numSkippedVoxels = 0;
 
-        outT2Iterator.Set(t2Value);
-        outM0Iterator.Set(cost->GetM0Value());
-        outB1Iterator.Set(b1Value);
+            if (batchSkippedVoxels.size() == batchSize)
+                processBatch();
+        }
+        else
+            ++numSkippedVoxels;
 
-        this->IncrementNumberOfProcessedPoints();
         ++maskItr;
-        ++outT2Iterator;
-        ++outM0Iterator;
-        ++outB1Iterator;
-        ++initT2Iterator;
-
         for (unsigned int i = 0;i < numInputs;++i)
             ++inIterators[i];
 
         if (m_T1Map)
             ++t1MapItr;
     }
+
+    processBatch();
+    writeSkippedVoxels(numSkippedVoxels);
 }
 
 } // end namespace anima
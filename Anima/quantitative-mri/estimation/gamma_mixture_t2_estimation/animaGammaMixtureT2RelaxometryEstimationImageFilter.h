@@ -4,6 +4,8 @@
 #include <itkVectorImage.h>
 #include <itkImage.h>
 
+#include <animaEPGT2KernelTable.h>
+
 namespace anima
 {
 
@@ -67,6 +69,9 @@ public:
     void SetPulseProfile(std::vector < std::pair <double, double> > &profile) {m_PulseProfile = profile;}
     void SetExcitationProfile(std::vector < std::pair <double, double> > &profile) {m_ExcitationProfile = profile;}
 
+    //! Use EPG signals precomputed once on a (T1, B1, T2) grid instead of nested quadratures (default: true)
+    itkSetMacro(UseKernelTable, bool)
+
 protected:
     GammaMixtureT2RelaxometryEstimationImageFilter()
         : Superclass()
@@ -100,6 +105,8 @@ protected:
         m_UniformPulses = true;
         m_ReferenceSliceThickness = 3.0;
         m_PulseWidthFactor = 1.5;
+
+        m_UseKernelTable = true;
     }
 
     virtual ~GammaMixtureT2RelaxometryEstimationImageFilter() {}
@@ -109,6 +116,9 @@ protected:
     void BeforeThreadedGenerateData() ITK_OVERRIDE;
     void DynamicThreadedGenerateData(const OutputImageRegionType &outputRegionForThread) ITK_OVERRIDE;
 
+    //! Builds the EPG kernel table from acquisition parameters, distributions and T1 map range
+    void PrepareKernelTable();
+
 private:
     ITK_DISALLOW_COPY_AND_ASSIGN(GammaMixtureT2RelaxometryEstimationImageFilter);
 
@@ -145,6 +155,9 @@ private:
     double m_ReferenceSliceThickness;
     double m_ExcitationPixelWidth;
     double m_PulseWidthFactor;
+
+    bool m_UseKernelTable;
+    anima::EPGT2KernelTable m_KernelTable;
 };
 
 } // end namespace anima
@@ -79,6 +79,43 @@ GammaMixtureT2RelaxometryEstimationImageFilter <TPixelScalarType>
         for (unsigned int i = 0;i < m_PulseProfile.size();++i)
             m_PulseProfile[i].first *= pulseRatioToProfile;
     }
+
+    if (m_UseKernelTable)
+        this->PrepareKernelTable();
+}
+
+template <class TPixelScalarType>
+void
+GammaMixtureT2RelaxometryEstimationImageFilter <TPixelScalarType>
+::PrepareKernelTable()
+{
+    m_KernelTable.SetEchoSpacing(m_EchoSpacing);
+    m_KernelTable.SetExcitationFlipAngle(m_T2ExcitationFlipAngle);
+    m_KernelTable.SetNumberOfEchoes(this->GetNumberOfIndexedInputs());
+
+    // Flip angles are optimized in between those bounds
+    m_KernelTable.SetFlipAngleRange(0.5 * m_T2FlipAngles[0], m_T2FlipAngles[0]);
+
+    // T2 nodes cover all distributions for any optimized mean, T1 nodes the T1 map inside the computation mask
+    std::vector <double> maxMeans(3);
+    maxMeans[0] = std::max(m_ShortT2Mean, m_UpperShortT2);
+    maxMeans[1] = m_UpperMediumT2;
+    maxMeans[2] = std::max(m_HighT2Mean, m_UpperHighT2);
+
+    std::vector <double> variances(3);
+    variances[0] = m_ShortT2Var;
+    variances[1] = m_MediumT2Var;
+    variances[2] = m_HighT2Var;
+
+    m_KernelTable.SetT2RangeFromDistributions(maxMeans,variances);
+    m_KernelTable.SetT1RangeFromMap(m_T1Map.GetPointer(),this->GetComputationMask());
+
+    m_KernelTable.SetUniformPulses(m_UniformPulses);
+    if (!m_UniformPulses)
+        m_KernelTable.SetSliceProfiles(m_PulseProfile,m_ExcitationProfile,m_ExcitationPixelWidth);
+
+    m_KernelTable.SetNumberOfWorkUnits(this->GetNumberOfWorkUnits());
+    m_KernelTable.Update();
 }
 
 template <class TPixelScalarType>
@@ -191,6 +228,9 @@ GammaMixtureT2RelaxometryEstimationImageFilter <TPixelScalarType>
         cost->SetPixelWidth(m_ExcitationPixelWidth);
     }
 
+    if (m_UseKernelTable)
+        cost->SetKernelTable(&m_KernelTable);
+
     unsigned int dimension = cost->GetNumberOfParameters();
 
     itk::Array<double> lowerBounds(dimension);
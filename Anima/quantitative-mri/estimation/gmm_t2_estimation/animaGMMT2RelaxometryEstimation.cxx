@@ -42,6 +42,8 @@ int main(int argc, char **argv)
     TCLAP::ValueArg<double> t2FlipAngleArg("","t2-flip","All flip angles for T2 (in degrees, default: 180)",false,180,"T2 flip angle",cmd);
     TCLAP::ValueArg<double> backgroundSignalThresholdArg("t","signal-thr","Background signal threshold (default: 10)",false,10,"Background signal threshold",cmd);
 
+    TCLAP::SwitchArg quadratureArg("Q","quadrature","Integrate EPG signals with nested quadratures instead of a precomputed table (slower, default: no)",cmd,false);
+
     TCLAP::ValueArg<unsigned int> nbpArg("T","numberofthreads","Number of threads to run on (default : all cores)",false,itk::MultiThreaderBase::GetGlobalDefaultNumberOfThreads(),"number of threads",cmd);
 	
     try
@@ -70,6 +72,7 @@ int main(int argc, char **argv)
     mainFilter->SetT2ExcitationFlipAngle(excitationT2FlipAngleArg.getValue() * M_PI / 180.0);
 
     mainFilter->SetUniformPulses(!nonUniformPulsesArg.isSet());
+    mainFilter->SetUseKernelTable(!quadratureArg.isSet());
     if (nonUniformPulsesArg.isSet())
     {
         mainFilter->SetReferenceSliceThickness(refSliceThicknesshArg.getValue());
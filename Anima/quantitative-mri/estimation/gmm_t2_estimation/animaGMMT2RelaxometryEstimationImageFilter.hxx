@@ -145,6 +145,33 @@ GMMT2RelaxometryEstimationImageFilter <TPixelScalarType>
         for (unsigned int i = 0;i < m_PulseProfile.size();++i)
             m_PulseProfile[i].first *= pulseRatioToProfile;
     }
+
+    if (m_UseKernelTable)
+        this->PrepareKernelTable();
+}
+
+template <class TPixelScalarType>
+void
+GMMT2RelaxometryEstimationImageFilter <TPixelScalarType>
+::PrepareKernelTable()
+{
+    m_KernelTable.SetEchoSpacing(m_EchoSpacing);
+    m_KernelTable.SetExcitationFlipAngle(m_T2ExcitationFlipAngle);
+    m_KernelTable.SetNumberOfEchoes(this->GetNumberOfIndexedInputs());
+
+    // Flip angles are optimized in between those bounds
+    m_KernelTable.SetFlipAngleRange(0.5 * m_T2FlipAngles[0], m_T2FlipAngles[0]);
+
+    // T2 nodes cover all distributions, T1 nodes the T1 map inside the computation mask
+    m_KernelTable.SetT2RangeFromDistributions(m_GaussianMeans,m_GaussianVariances);
+    m_KernelTable.SetT1RangeFromMap(m_T1Map.GetPointer(),this->GetComputationMask());
+
+    m_KernelTable.SetUniformPulses(m_UniformPulses);
+    if (!m_UniformPulses)
+        m_KernelTable.SetSliceProfiles(m_PulseProfile,m_ExcitationProfile,m_ExcitationPixelWidth);
+
+    m_KernelTable.SetNumberOfWorkUnits(this->GetNumberOfWorkUnits());
+    m_KernelTable.Update();
 }
 
 template <class TPixelScalarType>
@@ -252,6 +279,9 @@ GMMT2RelaxometryEstimationImageFilter <TPixelScalarType>
         cost->SetPixelWidth(m_ExcitationPixelWidth);
     }
 
+    if (m_UseKernelTable)
+        cost->SetKernelTable(&m_KernelTable);
+
     while (!maskItr.IsAtEnd())
     {
         outputT2Weights.Fill(0);
@@ -1,8 +1,29 @@
 #include <cmath>
+#include <algorithm>
 #include <iostream>
 #include <fstream>
 
 #include <animaB1GMMRelaxometryCostFunction.h>
+#include <animaB1GammaMixtureT2RelaxometryCostFunction.h>
+#include <animaEPGT2KernelTable.h>
+
+//! Maximal difference of weights, relative to the total weight
+double GetWeightsDeviation(const anima::B1GMMRelaxometryCostFunction::ParametersType &refWeights,
+                           const anima::B1GMMRelaxometryCostFunction::ParametersType &testedWeights)
+{
+    double weightsSum = 0.0;
+    double maxDifference = 0.0;
+    for (unsigned int i = 0;i < refWeights.size();++i)
+    {
+        weightsSum += refWeights[i];
+        maxDifference = std::max(maxDifference, std::abs(refWeights[i] - testedWeights[i]));
+    }
+
+    if (weightsSum <= 0.0)
+        return maxDifference;
+
+    return maxDifference / weightsSum;
+}
 
 int main(int argc, char **argv)
 {
@@ -35,14 +56,114 @@ int main(int argc, char **argv)
     cost->SetGaussianVariances(variances);
     cost->SetT1Value(1000);
 
+    // Same model with EPG signals precomputed on a (B1, T2) grid
+    anima::EPGT2KernelTable kernelTable;
+    kernelTable.SetEchoSpacing(9);
+    kernelTable.SetExcitationFlipAngle(M_PI / 2.0);
+    kernelTable.SetNumberOfEchoes(numSignals);
+    kernelTable.SetFlipAngleRange(M_PI, 1.3 * M_PI);
+    kernelTable.SetT2Range(9.0 / 20.0, 3000);
+    kernelTable.SetT1Range(1000, 1000);
+    kernelTable.Update();
+
+    anima::B1GMMRelaxometryCostFunction::Pointer tableCost = anima::B1GMMRelaxometryCostFunction::New();
+    tableCost->SetEchoSpacing(9);
+    tableCost->SetExcitationFlipAngle(M_PI / 2.0);
+    tableCost->SetT2RelaxometrySignals(signals);
+    tableCost->SetGaussianMeans(means);
+    tableCost->SetGaussianVariances(variances);
+    tableCost->SetT1Value(1000);
+    tableCost->SetKernelTable(&kernelTable);
+
+    // Maximal relative deviations of cost values and weights allowed between quadratures and table
+    const double tolerance = 1.0e-3;
+    bool testPassed = true;
+
     anima::B1GMMRelaxometryCostFunction::ParametersType b1(1);
-    b1[0] = 1.1 * M_PI;
-    std::cout << "Value for " << b1 << " " << cost->GetValue(b1) << std::endl;
-    std::cout << cost->GetOptimalT2Weights() << std::endl;
+    for (unsigned int i = 0;i < 2;++i)
+    {
+        b1[0] = (1.1 + 0.1 * i) * M_PI;
+        double refValue = cost->GetValue(b1);
+        std::cout << "Value for " << b1 << " " << refValue << std::endl;
+        std::cout << cost->GetOptimalT2Weights() << std::endl;
+
+        double tableValue = tableCost->GetValue(b1);
+        std::cout << "Table value for " << b1 << " " << tableValue << std::endl;
+        std::cout << tableCost->GetOptimalT2Weights() << std::endl;
+
+        double valueDeviation = std::abs(tableValue - refValue) / std::max(refValue, 1.0e-12);
+        double weightsDeviation = GetWeightsDeviation(cost->GetOptimalT2Weights(), tableCost->GetOptimalT2Weights());
+        std::cout << "GMM deviations: value " << valueDeviation << ", weights " << weightsDeviation << std::endl;
+
+        if ((valueDeviation > tolerance) || (weightsDeviation > tolerance))
+            testPassed = false;
+    }
 
-    b1[0] = 1.2 * M_PI;
-    std::cout << "Value for " << b1 << " " << cost->GetValue(b1) << std::endl;
-    std::cout << cost->GetOptimalT2Weights() << std::endl;
+    // Gamma mixture values and derivatives
+    std::vector <double> gammaMeans(means), gammaVariances(variances);
+    gammaMeans[1] = 110;
+    anima::B1GammaMixtureT2RelaxometryCostFunction::Pointer gammaCosts[2];
+    for (unsigned int i = 0;i < 2;++i)
+    {
+        gammaCosts[i] = anima::B1GammaMixtureT2RelaxometryCostFunction::New();
+        gammaCosts[i]->SetEchoSpacing(9);
+        gammaCosts[i]->SetExcitationFlipAngle(M_PI / 2.0);
+        gammaCosts[i]->SetT2RelaxometrySignals(signals);
+        gammaCosts[i]->SetGammaMeans(gammaMeans);
+        gammaCosts[i]->SetGammaVariances(gammaVariances);
+        gammaCosts[i]->SetConstrainedParameters(true);
+        gammaCosts[i]->SetT1Value(1000);
+    }
+
+    anima::B1GammaMixtureT2RelaxometryCostFunction::Pointer gammaCost = gammaCosts[0];
+    anima::B1GammaMixtureT2RelaxometryCostFunction::Pointer gammaTableCost = gammaCosts[1];
+    gammaTableCost->SetKernelTable(&kernelTable);
+
+    anima::B1GammaMixtureT2RelaxometryCostFunction::ParametersType gammaParameters(2);
+    anima::B1GammaMixtureT2RelaxometryCostFunction::DerivativeType refDerivative, tableDerivative;
+    gammaParameters[0] = 1.15 * M_PI;
+    gammaParameters[1] = 110;
+
+    double refValue = gammaCost->GetValue(gammaParameters);
+    gammaCost->GetDerivative(gammaParameters,refDerivative);
+    double tableValue = gammaTableCost->GetValue(gammaParameters);
+    gammaTableCost->GetDerivative(gammaParameters,tableDerivative);
+
+    std::cout << "Gamma value " << refValue << " derivative " << refDerivative << std::endl;
+    std::cout << "Gamma table value " << tableValue << " derivative " << tableDerivative << std::endl;
+
+    double valueDeviation = std::abs(tableValue - refValue) / std::max(refValue, 1.0e-12);
+    double weightsDeviation = GetWeightsDeviation(gammaCost->GetOptimalT2Weights(), gammaTableCost->GetOptimalT2Weights());
+    std::cout << "Gamma mixture deviations: value " << valueDeviation << ", weights " << weightsDeviation << std::endl;
+
+    if ((valueDeviation > tolerance) || (weightsDeviation > tolerance))
+        testPassed = false;
+
+    // Derivatives (flip angle and medium mean) relative to the largest reference derivative component,
+    // table ones coming from Hermite interpolation and being thus less accurate than values
+    const double derivativeTolerance = 1.0e-2;
+    double derivativeScale = 0.0;
+    double derivativeDifference = 0.0;
+    for (unsigned int i = 0;i < refDerivative.size();++i)
+    {
+        derivativeScale = std::max(derivativeScale, std::abs(refDerivative[i]));
+        derivativeDifference = std::max(derivativeDifference, std::abs(tableDerivative[i] - refDerivative[i]));
+    }
+
+    double derivativeDeviation = derivativeDifference / std::max(derivativeScale, 1.0e-12);
+    std::cout << "Gamma mixture derivative deviation " << derivativeDeviation << std::endl;
+
+    if ((tableDerivative.size() != refDerivative.size()) || (derivativeDeviation > derivativeTolerance))
+    {
+        std::cerr << "Table derivative deviation above " << derivativeTolerance << std::endl;
+        testPassed = false;
+    }
+
+    if (!testPassed)
+    {
+        std::cerr << "Table deviation above tolerance" << std::endl;
+        return EXIT_FAILURE;
+    }
 
     return EXIT_SUCCESS;
 }
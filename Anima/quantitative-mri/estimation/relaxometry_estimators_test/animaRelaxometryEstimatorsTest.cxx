@@ -0,0 +1,314 @@
+#include <cmath>
+#include <algorithm>
+#include <iostream>
+#include <random>
+
+#include <animaT2EPGBatchEstimator.h>
+#include <animaEPGBatchSignalSimulator.h>
+#include <animaT1SERelaxometryEstimationImageFilter.h>
+#include <animaT2EPGRelaxometryEstimationImageFilter.h>
+
+#include <itkImage.h>
+#include <itkImageRegionIterator.h>
+
+typedef itk::Image <double,3> ImageType;
+typedef itk::Image <unsigned char,3> MaskImageType;
+
+//! Relative deviation of an estimate, both values being 0 for voxels that should not be estimated
+double GetRelativeDeviation(double refValue, double testedValue)
+{
+    if (refValue == 0.0)
+        return std::abs(testedValue);
+
+    return std::abs(testedValue - refValue) / std::abs(refValue);
+}
+
+ImageType::Pointer CreateImage(unsigned int sizeX, unsigned int sizeY)
+{
+    ImageType::RegionType region;
+    region.SetSize(0,sizeX);
+    region.SetSize(1,sizeY);
+    region.SetSize(2,1);
+
+    ImageType::Pointer image = ImageType::New();
+    image->SetRegions(region);
+    image->Allocate();
+    image->FillBuffer(0.0);
+
+    return image;
+}
+
+//! Noise free T2 EPG signals of random voxels, fitted in one block, a last voxel with zero signals being left out
+bool TestT2EPGBatchEstimator(std::mt19937 &generator)
+{
+    const unsigned int numEchoes = 16;
+    const double echoSpacing = 10;
+    const unsigned int numVoxels = 20;
+
+    anima::T2EPGBatchEstimator estimator;
+    estimator.SetEchoSpacing(echoSpacing);
+    estimator.SetExcitationFlipAngle(M_PI / 2.0);
+    estimator.SetFlipAngle(M_PI);
+    estimator.SetNumberOfEchoes(numEchoes);
+    estimator.SetT2Range(1.0, 1000);
+    estimator.SetB1Range(0.5, 1.0);
+    estimator.SetDictionaryT1Value(1000);
+    estimator.SetMaximumNumberOfIterations(200);
+    estimator.SetStopCondition(1.0e-8);
+    estimator.BuildDictionary();
+
+    anima::EPGBatchSignalSimulator simulator;
+    simulator.SetNumberOfEchoes(numEchoes);
+    simulator.SetEchoSpacing(echoSpacing);
+    simulator.SetExcitationFlipAngle(M_PI / 2.0);
+    anima::EPGBatchSignalSimulator::Workspace workspace;
+
+    std::uniform_real_distribution <double> logT2Distribution(std::log(20.0), std::log(300.0));
+    std::uniform_real_distribution <double> b1Distribution(0.6, 0.95);
+    std::uniform_real_distribution <double> m0Distribution(100.0, 1000.0);
+    std::uniform_real_distribution <double> t1Distribution(500.0, 2000.0);
+
+    vnl_matrix <double> signals(numVoxels + 1, numEchoes);
+    signals.fill(0.0);
+    std::vector <double> t1Values(numVoxels + 1, 1000.0), t2UpperBounds(numVoxels + 1, 1000.0);
+    std::vector <double> refT2Values(numVoxels + 1, 0.0), refB1Values(numVoxels + 1, 0.0), refM0Values(numVoxels + 1, 0.0);
+    std::vector <double> simulatedSignals;
+    for (unsigned int i = 0;i < numVoxels;++i)
+    {
+        refT2Values[i] = std::exp(logT2Distribution(generator));
+        refB1Values[i] = b1Distribution(generator);
+        refM0Values[i] = m0Distribution(generator);
+        t1Values[i] = t1Distribution(generator);
+
+        simulator.GetValue(t1Values[i], refT2Values[i], refB1Values[i] * M_PI, refM0Values[i], workspace, simulatedSignals);
+        for (unsigned int j = 0;j < numEchoes;++j)
+            signals(i,j) = simulatedSignals[j];
+    }
+
+    std::vector <double> t2Values, b1Values, m0Values;
+    estimator.EstimateBatch(signals, t1Values, t2UpperBounds, t2Values, b1Values, m0Values);
+
+    double maxDeviation = 0.0;
+    for (unsigned int i = 0;i <= numVoxels;++i)
+    {
+        maxDeviation = std::max(maxDeviation, GetRelativeDeviation(refT2Values[i], t2Values[i]));
+        maxDeviation = std::max(maxDeviation, GetRelativeDeviation(refB1Values[i], b1Values[i]));
+        maxDeviation = std::max(maxDeviation, GetRelativeDeviation(refM0Values[i], m0Values[i]));
+    }
+
+    const double tolerance = 1.0e-6;
+    std::cout << "T2 EPG batch estimator maximal relative deviation " << maxDeviation << std::endl;
+    return (maxDeviation <= tolerance);
+}
+
+//! Noise free saturation recovery signals on a small image, masked voxels having zero signals
+bool TestT1SEEstimationFilter(std::mt19937 &generator)
+{
+    const unsigned int sizeX = 5;
+    const unsigned int sizeY = 4;
+    std::vector <double> trValues = {200, 500, 1000, 2000, 4000};
+
+    std::uniform_real_distribution <double> m0Distribution(100.0, 2000.0);
+    std::uniform_real_distribution <double> t1Distribution(300.0, 3000.0);
+
+    ImageType::Pointer refM0Image = CreateImage(sizeX,sizeY);
+    ImageType::Pointer refT1Image = CreateImage(sizeX,sizeY);
+    std::vector <ImageType::Pointer> inputImages(trValues.size());
+    for (unsigned int i = 0;i < trValues.size();++i)
+        inputImages[i] = CreateImage(sizeX,sizeY);
+
+    typedef itk::ImageRegionIterator <ImageType> IteratorType;
+    IteratorType refM0Itr(refM0Image,refM0Image->GetLargestPossibleRegion());
+    IteratorType refT1Itr(refT1Image,refT1Image->GetLargestPossibleRegion());
+    std::vector <IteratorType> inputItrs;
+    for (unsigned int i = 0;i < trValues.size();++i)
+        inputItrs.push_back(IteratorType(inputImages[i],inputImages[i]->GetLargestPossibleRegion()));
+
+    unsigned int voxelIndex = 0;
+    while (!refM0Itr.IsAtEnd())
+    {
+        // Every third voxel is left empty and thus masked out
+        if (voxelIndex % 3 != 1)
+        {
+            double m0Value = m0Distribution(generator);
+            double t1Value = t1Distribution(generator);
+            refM0Itr.Set(m0Value);
+            refT1Itr.Set(t1Value);
+
+            for (unsigned int i = 0;i < trValues.size();++i)
+                inputItrs[i].Set(m0Value * (1.0 - std::exp(- trValues[i] / t1Value)));
+        }
+
+        ++refM0Itr;
+        ++refT1Itr;
+        for (unsigned int i = 0;i < trValues.size();++i)
+            ++inputItrs[i];
+
+        ++voxelIndex;
+    }
+
+    typedef anima::T1SERelaxometryEstimationImageFilter <ImageType,ImageType> FilterType;
+    FilterType::Pointer mainFilter = FilterType::New();
+    for (unsigned int i = 0;i < trValues.size();++i)
+        mainFilter->SetInput(i,inputImages[i]);
+
+    mainFilter->SetTRValues(trValues);
+    mainFilter->SetMaximumOptimizerIterations(200);
+    mainFilter->SetOptimizerStopCondition(1.0e-8);
+    mainFilter->SetNumberOfWorkUnits(2);
+    mainFilter->Update();
+
+    IteratorType m0Itr(mainFilter->GetOutput(0),refM0Image->GetLargestPossibleRegion());
+    IteratorType t1Itr(mainFilter->GetOutput(1),refM0Image->GetLargestPossibleRegion());
+    refM0Itr.GoToBegin();
+    refT1Itr.GoToBegin();
+
+    double maxDeviation = 0.0;
+    while (!refM0Itr.IsAtEnd())
+    {
+        maxDeviation = std::max(maxDeviation, GetRelativeDeviation(refM0Itr.Get(), m0Itr.Get()));
+        maxDeviation = std::max(maxDeviation, GetRelativeDeviation(refT1Itr.Get(), t1Itr.Get()));
+
+        ++refM0Itr;
+        ++refT1Itr;
+        ++m0Itr;
+        ++t1Itr;
+    }
+
+    const double tolerance = 1.0e-6;
+    std::cout << "T1 SE estimation maximal relative deviation " << maxDeviation << std::endl;
+    return (maxDeviation <= tolerance);
+}
+
+/**
+ * T2 EPG filter on a small image with blocks smaller than thread regions: estimates have to land on their voxels,
+ * voxels outside of the mask and voxels with zero signals inside of it being set to 0
+ */
+bool TestT2EPGEstimationFilter(std::mt19937 &generator)
+{
+    const unsigned int sizeX = 6;
+    const unsigned int sizeY = 5;
+    const unsigned int numEchoes = 16;
+    const double echoSpacing = 10;
+
+    anima::EPGBatchSignalSimulator simulator;
+    simulator.SetNumberOfEchoes(numEchoes);
+    simulator.SetEchoSpacing(echoSpacing);
+    simulator.SetExcitationFlipAngle(M_PI / 2.0);
+    anima::EPGBatchSignalSimulator::Workspace workspace;
+
+    std::uniform_real_distribution <double> logT2Distribution(std::log(20.0), std::log(300.0));
+    std::uniform_real_distribution <double> b1Distribution(0.6, 0.95);
+    std::uniform_real_distribution <double> m0Distribution(100.0, 1000.0);
+
+    // Reference values ordered as outputs: T2, M0, B1
+    std::vector <ImageType::Pointer> refImages(3);
+    for (unsigned int i = 0;i < 3;++i)
+        refImages[i] = CreateImage(sizeX,sizeY);
+
+    std::vector <ImageType::Pointer> inputImages(numEchoes);
+    for (unsigned int i = 0;i < numEchoes;++i)
+        inputImages[i] = CreateImage(sizeX,sizeY);
+
+    MaskImageType::Pointer maskImage = MaskImageType::New();
+    maskImage->SetRegions(refImages[0]->GetLargestPossibleRegion());
+    maskImage->Allocate();
+    maskImage->FillBuffer(0);
+
+    typedef itk::ImageRegionIterator <ImageType> IteratorType;
+    typedef itk::ImageRegionIterator <MaskImageType> MaskIteratorType;
+    std::vector <IteratorType> refItrs, inputItrs;
+    for (unsigned int i = 0;i < 3;++i)
+        refItrs.push_back(IteratorType(refImages[i],refImages[i]->GetLargestPossibleRegion()));
+
+    for (unsigned int i = 0;i < numEchoes;++i)
+        inputItrs.push_back(IteratorType(inputImages[i],inputImages[i]->GetLargestPossibleRegion()));
+
+    MaskIteratorType maskItr(maskImage,maskImage->GetLargestPossibleRegion());
+
+    std::vector <double> simulatedSignals;
+    unsigned int voxelIndex = 0;
+    while (!maskItr.IsAtEnd())
+    {
+        // Every fifth voxel is outside of the mask, every seventh one has zero signals inside of it
+        bool insideMask = (voxelIndex % 5 != 2);
+        bool emptyVoxel = (voxelIndex % 7 == 3);
+        bool estimatedVoxel = insideMask && !emptyVoxel;
+
+        double t2Value = std::exp(logT2Distribution(generator));
+        double b1Value = b1Distribution(generator);
+        double m0Value = m0Distribution(generator);
+        simulator.GetValue(1000.0, t2Value, b1Value * M_PI, m0Value, workspace, simulatedSignals);
+
+        maskItr.Set(insideMask ? 1 : 0);
+        if (estimatedVoxel)
+        {
+            refItrs[0].Set(t2Value);
+            refItrs[1].Set(m0Value);
+            refItrs[2].Set(b1Value);
+        }
+
+        for (unsigned int i = 0;i < numEchoes;++i)
+            inputItrs[i].Set(emptyVoxel ? 0.0 : simulatedSignals[i]);
+
+        ++maskItr;
+        for (unsigned int i = 0;i < 3;++i)
+            ++refItrs[i];
+
+        for (unsigned int i = 0;i < numEchoes;++i)
+            ++inputItrs[i];
+
+        ++voxelIndex;
+    }
+
+    typedef anima::T2EPGRelaxometryEstimationImageFilter <ImageType,ImageType> FilterType;
+    FilterType::Pointer mainFilter = FilterType::New();
+    for (unsigned int i = 0;i < numEchoes;++i)
+        mainFilter->SetInput(i,inputImages[i]);
+
+    mainFilter->SetEchoSpacing(echoSpacing);
+    mainFilter->SetT2FlipAngles(M_PI,numEchoes);
+    mainFilter->SetT2ExcitationFlipAngle(M_PI / 2.0);
+    mainFilter->SetT2UpperBound(1000);
+    mainFilter->SetMaximumOptimizerIterations(200);
+    mainFilter->SetOptimizerStopCondition(1.0e-8);
+    mainFilter->SetBatchSize(4);
+    mainFilter->SetComputationMask(maskImage);
+    mainFilter->SetNumberOfWorkUnits(3);
+    mainFilter->Update();
+
+    double maxDeviation = 0.0;
+    for (unsigned int i = 0;i < 3;++i)
+    {
+        IteratorType refItr(refImages[i],refImages[i]->GetLargestPossibleRegion());
+        IteratorType outItr(mainFilter->GetOutput(i),refImages[i]->GetLargestPossibleRegion());
+        while (!refItr.IsAtEnd())
+        {
+            maxDeviation = std::max(maxDeviation, GetRelativeDeviation(refItr.Get(), outItr.Get()));
+
+            ++refItr;
+            ++outItr;
+        }
+    }
+
+    const double tolerance = 1.0e-6;
+    std::cout << "T2 EPG estimation maximal relative deviation " << maxDeviation << std::endl;
+    return (maxDeviation <= tolerance);
+}
+
+int main(int argc, char **argv)
+{
+    std::mt19937 generator(42);
+
+    bool testPassed = TestT2EPGBatchEstimator(generator);
+    testPassed &= TestT1SEEstimationFilter(generator);
+    testPassed &= TestT2EPGEstimationFilter(generator);
+
+    if (!testPassed)
+    {
+        std::cerr << "Relaxometry estimation deviation above tolerance" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,355 @@
+#include <cmath>
+#include <algorithm>
+
+#include "animaEPGBatchSignalSimulator.h"
+
+namespace anima
+{
+
+namespace
+{
+
+// Padding states after the last EPG state, so that transitions may read neighbouring states without bound checks
+const unsigned int EPGStatePadding = 6;
+
+// Signed coefficients of the transition between refocusings, each stored for the whole batch
+enum EPGCoefficientIndex
+{
+    FirstCoefficient = 0,
+    SecondCoefficient,
+    MinusSecondCoefficient,
+    ThirdCoefficient,
+    FourthCoefficient,
+    FifthCoefficient,
+    HalfSecondCoefficient,
+    MinusHalfSecondCoefficient,
+    ZeroCoefficient,
+    NumberOfEPGCoefficients
+};
+
+/**
+ * Computes one state after a refocusing as a combination of three states before it (coefficient and state indexes
+ * given for each term). With derivatives, propagates d(E s) = dE s + E ds in the same pass. Without values, only
+ * derivatives are computed from states of a previous sweep.
+ */
+template <bool WithValues, bool WithDerivatives>
+inline void CombineEPGStates(unsigned int k, unsigned int firstCoefficient, unsigned int firstState,
+                             unsigned int secondCoefficient, unsigned int secondState,
+                             unsigned int thirdCoefficient, unsigned int thirdState,
+                             const double *coefficients, const double *derivativeCoefficients, const double *states,
+                             const double *derivativeStates, double *nextStates, double *nextDerivativeStates,
+                             unsigned int batchSize)
+{
+    const double *firstCoefs = coefficients + firstCoefficient * batchSize;
+    const double *secondCoefs = coefficients + secondCoefficient * batchSize;
+    const double *thirdCoefs = coefficients + thirdCoefficient * batchSize;
+
+    const double *firstStates = states + firstState * batchSize;
+    const double *secondStates = states + secondState * batchSize;
+    const double *thirdStates = states + thirdState * batchSize;
+
+    if (WithValues)
+    {
+        double *outputStates = nextStates + k * batchSize;
+        for (unsigned int b = 0;b < batchSize;++b)
+            outputStates[b] = firstCoefs[b] * firstStates[b] + secondCoefs[b] * secondStates[b] + thirdCoefs[b] * thirdStates[b];
+    }
+
+    if (!WithDerivatives)
+        return;
+
+    const double *firstDerivativeCoefs = derivativeCoefficients + firstCoefficient * batchSize;
+    const double *secondDerivativeCoefs = derivativeCoefficients + secondCoefficient * batchSize;
+    const double *thirdDerivativeCoefs = derivativeCoefficients + thirdCoefficient * batchSize;
+
+    const double *firstDerivativeStates = derivativeStates + firstState * batchSize;
+    const double *secondDerivativeStates = derivativeStates + secondState * batchSize;
+    const double *thirdDerivativeStates = derivativeStates + thirdState * batchSize;
+
+    double *outputDerivativeStates = nextDerivativeStates + k * batchSize;
+    for (unsigned int b = 0;b < batchSize;++b)
+        outputDerivativeStates[b] = firstDerivativeCoefs[b] * firstStates[b] + secondDerivativeCoefs[b] * secondStates[b]
+                + thirdDerivativeCoefs[b] * thirdStates[b] + firstCoefs[b] * firstDerivativeStates[b]
+                + secondCoefs[b] * secondDerivativeStates[b] + thirdCoefs[b] * thirdDerivativeStates[b];
+}
+
+/**
+ * Applies the transition between refocusings to the first numStates states, the vector layout being F0,
+ * then blocks of three states. Terms of the (k - 6) and (k - 5) states refer to F0 for the first block.
+ * The single T2 value version lets the compiler drop batch loops.
+ */
+template <bool WithValues, bool WithDerivatives, bool SingleT2Value>
+void ApplyEPGTransition(const double *coefficients, const double *derivativeCoefficients, const double *states,
+                        const double *derivativeStates, double *nextStates, double *nextDerivativeStates,
+                        unsigned int numStates, unsigned int inputBatchSize)
+{
+    const unsigned int batchSize = SingleT2Value ? 1 : inputBatchSize;
+    auto combineStates = [&](unsigned int k, unsigned int c1, unsigned int s1, unsigned int c2, unsigned int s2,
+            unsigned int c3, unsigned int s3)
+    {
+        CombineEPGStates<WithValues,WithDerivatives>(k,c1,s1,c2,s2,c3,s3,coefficients,derivativeCoefficients,states,
+                                                     derivativeStates,nextStates,nextDerivativeStates,batchSize);
+    };
+
+    combineStates(0,FirstCoefficient,0,MinusSecondCoefficient,3,ThirdCoefficient,5);
+    if (numStates > 1)
+        combineStates(1,FourthCoefficient,2,ZeroCoefficient,0,ZeroCoefficient,0);
+
+    for (unsigned int k = 2;k < numStates;k += 3)
+    {
+        combineStates(k,FirstCoefficient,k - 1,MinusSecondCoefficient,k + 4,ThirdCoefficient,k + 6);
+
+        if (k + 1 < numStates)
+            combineStates(k + 1,FifthCoefficient,k + 1,HalfSecondCoefficient,k + 3,
+                          MinusHalfSecondCoefficient,(k > 2) ? k - 4 : 0);
+
+        if (k + 2 < numStates)
+            combineStates(k + 2,SecondCoefficient,k + 1,FirstCoefficient,k + 3,
+                          ThirdCoefficient,(k > 2) ? k - 4 : 0);
+    }
+}
+
+} // end of anonymous namespace
+
+EPGBatchSignalSimulator::EPGBatchSignalSimulator()
+{
+    m_NumberOfEchoes = 1;
+    m_EchoSpacing = 10;
+    m_ExcitationFlipAngle = M_PI / 2.0;
+}
+
+unsigned int EPGBatchSignalSimulator::GetNumberOfActiveStates(unsigned int index) const
+{
+    // A refocusing spreads non zero states by 6 positions, and a state needs at least
+    // one refocusing per 6 positions to come back to the echo position
+    if (index >= m_NumberOfEchoes)
+        return 1;
+
+    unsigned int numStates = std::min(3 * m_NumberOfEchoes + 1, 6 * (m_NumberOfEchoes - index));
+    if (index > 0)
+        numStates = std::min(numStates, 6 * index - 1);
+
+    return numStates;
+}
+
+void EPGBatchSignalSimulator::ComputeEchoTrains(double t1Value, const double *t2Values, unsigned int batchSize, double flipAngle,
+                                                double m0Value, Workspace &workspace, double *signals, double *faDerivatives,
+                                                bool keepStateHistory) const
+{
+    // Rotation terms, shared by the whole batch
+    double cosB1alpha = std::cos(flipAngle);
+    double cosB1alpha2 = std::cos(flipAngle / 2.0);
+    double sinB1alpha = std::sin(flipAngle);
+    double sinB1alpha2 = std::sin(flipAngle / 2.0);
+
+    double espT1Value = 0.0;
+    if (t1Value != 0.0)
+        espT1Value = std::exp(- m_EchoSpacing / (2 * t1Value));
+
+    // Derivative coefficients are also needed by a later derivative pass on kept states
+    bool withDerivatives = (faDerivatives != 0);
+    bool withDerivativeCoefficients = withDerivatives || keepStateHistory;
+    workspace.coefficients.resize(NumberOfEPGCoefficients * batchSize);
+    if (withDerivativeCoefficients)
+        workspace.derivativeCoefficients.resize(NumberOfEPGCoefficients * batchSize);
+
+    double *coefs = workspace.coefficients.data();
+    double *derivativeCoefs = workspace.derivativeCoefficients.data();
+    for (unsigned int b = 0;b < batchSize;++b)
+    {
+        double espT2Value = 0.0;
+        if (t2Values[b] != 0.0)
+            espT2Value = std::exp(- m_EchoSpacing / (2 * t2Values[b]));
+
+        double squaredEspT2Value = espT2Value * espT2Value;
+        double secondValue = sinB1alpha * espT1Value * espT2Value;
+
+        coefs[FirstCoefficient * batchSize + b] = sinB1alpha2 * sinB1alpha2 * squaredEspT2Value;
+        coefs[SecondCoefficient * batchSize + b] = secondValue;
+        coefs[MinusSecondCoefficient * batchSize + b] = - secondValue;
+        coefs[ThirdCoefficient * batchSize + b] = cosB1alpha2 * cosB1alpha2 * squaredEspT2Value;
+        coefs[FourthCoefficient * batchSize + b] = squaredEspT2Value;
+        coefs[FifthCoefficient * batchSize + b] = cosB1alpha * espT1Value * espT1Value;
+        coefs[HalfSecondCoefficient * batchSize + b] = secondValue / 2.0;
+        coefs[MinusHalfSecondCoefficient * batchSize + b] = - secondValue / 2.0;
+        coefs[ZeroCoefficient * batchSize + b] = 0.0;
+
+        if (!withDerivativeCoefficients)
+            continue;
+
+        double firstDerivativeValue = cosB1alpha2 * sinB1alpha2 * squaredEspT2Value;
+        double secondDerivativeValue = cosB1alpha * espT1Value * espT2Value;
+
+        derivativeCoefs[FirstCoefficient * batchSize + b] = firstDerivativeValue;
+        derivativeCoefs[SecondCoefficient * batchSize + b] = secondDerivativeValue;
+        derivativeCoefs[MinusSecondCoefficient * batchSize + b] = - secondDerivativeValue;
+        derivativeCoefs[ThirdCoefficient * batchSize + b] = - firstDerivativeValue;
+        derivativeCoefs[FourthCoefficient * batchSize + b] = 0.0;
+        derivativeCoefs[FifthCoefficient * batchSize + b] = - sinB1alpha * espT1Value * espT1Value;
+        derivativeCoefs[HalfSecondCoefficient * batchSize + b] = secondDerivativeValue / 2.0;
+        derivativeCoefs[MinusHalfSecondCoefficient * batchSize + b] = - secondDerivativeValue / 2.0;
+        derivativeCoefs[ZeroCoefficient * batchSize + b] = 0.0;
+    }
+
+    // States outside the active band of a vector are either zero or never read afterwards,
+    // but buffers have to be cleared since they may come from a previous call
+    unsigned int stateSize = (3 * m_NumberOfEchoes + 1 + EPGStatePadding) * batchSize;
+    if (keepStateHistory)
+        workspace.stateHistory.assign((m_NumberOfEchoes + 1) * stateSize,0.0);
+    else
+    {
+        workspace.states.assign(stateSize,0.0);
+        workspace.nextStates.assign(stateSize,0.0);
+    }
+
+    if (withDerivatives)
+    {
+        workspace.derivativeStates.assign(stateSize,0.0);
+        workspace.nextDerivativeStates.assign(stateSize,0.0);
+    }
+
+    double baseValue = m0Value * std::sin(m_ExcitationFlipAngle);
+    double *initialStates = keepStateHistory ? workspace.stateHistory.data() : workspace.states.data();
+    for (unsigned int b = 0;b < batchSize;++b)
+        initialStates[b] = baseValue;
+
+    for (unsigned int i = 0;i < m_NumberOfEchoes;++i)
+    {
+        unsigned int numStates = this->GetNumberOfActiveStates(i + 1);
+
+        // Kept states are written in successive slots of the history instead of swapping buffers
+        const double *states = keepStateHistory ? workspace.stateHistory.data() + i * stateSize : workspace.states.data();
+        double *nextStates = keepStateHistory ? workspace.stateHistory.data() + (i + 1) * stateSize : workspace.nextStates.data();
+
+        if (batchSize == 1)
+        {
+            if (withDerivatives)
+            {
+                ApplyEPGTransition<true,true,true>(coefs,derivativeCoefs,states,workspace.derivativeStates.data(),
+                                                   nextStates,workspace.nextDerivativeStates.data(),numStates,batchSize);
+                workspace.derivativeStates.swap(workspace.nextDerivativeStates);
+            }
+            else
+                ApplyEPGTransition<true,false,true>(coefs,0,states,0,nextStates,0,numStates,batchSize);
+        }
+        else if (withDerivatives)
+        {
+            ApplyEPGTransition<true,true,false>(coefs,derivativeCoefs,states,workspace.derivativeStates.data(),
+                                                nextStates,workspace.nextDerivativeStates.data(),numStates,batchSize);
+            workspace.derivativeStates.swap(workspace.nextDerivativeStates);
+        }
+        else
+            ApplyEPGTransition<true,false,false>(coefs,0,states,0,nextStates,0,numStates,batchSize);
+
+        std::copy(nextStates,nextStates + batchSize,signals + i * batchSize);
+        if (!keepStateHistory)
+            workspace.states.swap(workspace.nextStates);
+
+        if (withDerivatives)
+            std::copy(workspace.derivativeStates.begin(),workspace.derivativeStates.begin() + batchSize,faDerivatives + i * batchSize);
+    }
+}
+
+bool EPGBatchSignalSimulator::ComputeEchoTrainDerivatives(unsigned int batchSize, Workspace &workspace, double *faDerivatives) const
+{
+    unsigned int stateSize = (3 * m_NumberOfEchoes + 1 + EPGStatePadding) * batchSize;
+    if (workspace.stateHistory.size() != (m_NumberOfEchoes + 1) * stateSize)
+        return false;
+
+    // Excitation does not depend on the refocusing flip angle: derivatives start from zero
+    workspace.derivativeStates.assign(stateSize,0.0);
+    workspace.nextDerivativeStates.assign(stateSize,0.0);
+
+    const double *coefs = workspace.coefficients.data();
+    const double *derivativeCoefs = workspace.derivativeCoefficients.data();
+    for (unsigned int i = 0;i < m_NumberOfEchoes;++i)
+    {
+        unsigned int numStates = this->GetNumberOfActiveStates(i + 1);
+        const double *states = workspace.stateHistory.data() + i * stateSize;
+
+        if (batchSize == 1)
+            ApplyEPGTransition<false,true,true>(coefs,derivativeCoefs,states,workspace.derivativeStates.data(),
+                                                0,workspace.nextDerivativeStates.data(),numStates,batchSize);
+        else
+            ApplyEPGTransition<false,true,false>(coefs,derivativeCoefs,states,workspace.derivativeStates.data(),
+                                                 0,workspace.nextDerivativeStates.data(),numStates,batchSize);
+
+        workspace.derivativeStates.swap(workspace.nextDerivativeStates);
+        std::copy(workspace.derivativeStates.begin(),workspace.derivativeStates.begin() + batchSize,faDerivatives + i * batchSize);
+    }
+
+    return true;
+}
+
+void EPGBatchSignalSimulator::GetValues(double t1Value, const std::vector <double> &t2Values, double flipAngle, double m0Value,
+                                        vnl_matrix <double> &signals, vnl_matrix <double> *faDerivatives) const
+{
+    Workspace workspace;
+    this->GetValues(t1Value,t2Values,flipAngle,m0Value,workspace,signals,faDerivatives);
+}
+
+void EPGBatchSignalSimulator::GetValues(double t1Value, const std::vector <double> &t2Values, double flipAngle, double m0Value,
+                                        Workspace &workspace, vnl_matrix <double> &signals, vnl_matrix <double> *faDerivatives) const
+{
+    unsigned int batchSize = t2Values.size();
+    if (batchSize == 0)
+    {
+        signals.set_size(0,m_NumberOfEchoes);
+        if (faDerivatives)
+            faDerivatives->set_size(0,m_NumberOfEchoes);
+        return;
+    }
+
+    // Sweep outputs are echo major, transposed into one row per T2 value
+    std::vector <double> echoSignals(m_NumberOfEchoes * batchSize);
+    std::vector <double> echoDerivatives;
+    if (faDerivatives)
+        echoDerivatives.resize(m_NumberOfEchoes * batchSize);
+
+    this->ComputeEchoTrains(t1Value,t2Values.data(),batchSize,flipAngle,m0Value,workspace,echoSignals.data(),
+                            faDerivatives ? echoDerivatives.data() : 0);
+
+    signals.set_size(batchSize,m_NumberOfEchoes);
+    for (unsigned int b = 0;b < batchSize;++b)
+    {
+        for (unsigned int i = 0;i < m_NumberOfEchoes;++i)
+            signals(b,i) = echoSignals[i * batchSize + b];
+    }
+
+    if (faDerivatives)
+    {
+        faDerivatives->set_size(batchSize,m_NumberOfEchoes);
+        for (unsigned int b = 0;b < batchSize;++b)
+        {
+            for (unsigned int i = 0;i < m_NumberOfEchoes;++i)
+                (*faDerivatives)(b,i) = echoDerivatives[i * batchSize + b];
+        }
+    }
+}
+
+void EPGBatchSignalSimulator::GetValue(double t1Value, double t2Value, double flipAngle, double m0Value, Workspace &workspace,
+                                       std::vector <double> &signals, std::vector <double> *faDerivatives) const
+{
+    signals.resize(m_NumberOfEchoes);
+    if (faDerivatives)
+        faDerivatives->resize(m_NumberOfEchoes);
+
+    this->ComputeEchoTrains(t1Value,&t2Value,1,flipAngle,m0Value,workspace,signals.data(),
+                            faDerivatives ? faDerivatives->data() : 0);
+}
+
+void EPGBatchSignalSimulator::GetValueAndKeepStates(double t1Value, double t2Value, double flipAngle, double m0Value,
+                                                    Workspace &workspace, std::vector <double> &signals) const
+{
+    signals.resize(m_NumberOfEchoes);
+    this->ComputeEchoTrains(t1Value,&t2Value,1,flipAngle,m0Value,workspace,signals.data(),0,true);
+}
+
+void EPGBatchSignalSimulator::GetFADerivative(Workspace &workspace, std::vector <double> &faDerivatives) const
+{
+    // Zero derivatives if no states were kept for the current number of echoes
+    faDerivatives.assign(m_NumberOfEchoes,0.0);
+    this->ComputeEchoTrainDerivatives(1,workspace,faDerivatives.data());
+}
+
+} // end of namespace anima
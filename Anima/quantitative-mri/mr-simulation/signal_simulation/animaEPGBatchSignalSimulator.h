@@ -0,0 +1,92 @@
+#pragma once
+
+#include <vector>
+#include <vnl/vnl_matrix.h>
+
+#include "AnimaSignalSimulationExport.h"
+
+namespace anima
+{
+
+/**
+ * \class EPGBatchSignalSimulator
+ * @brief Reentrant EPG simulator computing echo trains of a batch of T2 values (sharing T1 and flip angle) in a single sweep.
+ *
+ * EPG states are stored for the whole batch (batch index being the fastest varying), only the band of states that is
+ * non zero and still contributes to a later echo being updated at each refocusing. Rotation terms are computed once
+ * per sweep, relaxation terms once per T2 value, and flip angle derivatives are propagated in the same pass as values.
+ * The simulator itself holds no work variable, so that one simulator may be shared by several threads, each one
+ * providing its own workspace to avoid reallocations between calls.
+ */
+class ANIMASIGNALSIMULATION_EXPORT EPGBatchSignalSimulator
+{
+public:
+    EPGBatchSignalSimulator();
+    virtual ~EPGBatchSignalSimulator() {}
+
+    //! Work buffers of a sweep, to be reused between calls by a single thread
+    struct Workspace
+    {
+        std::vector <double> coefficients, derivativeCoefficients;
+        std::vector <double> states, nextStates;
+        std::vector <double> derivativeStates, nextDerivativeStates;
+        //! States after each refocusing (the first one being the excitation) of the last sweep keeping them
+        std::vector <double> stateHistory;
+    };
+
+    void SetEchoSpacing(double val) {m_EchoSpacing = val;}
+    double GetEchoSpacing() const {return m_EchoSpacing;}
+
+    void SetExcitationFlipAngle(double val) {m_ExcitationFlipAngle = val;}
+    double GetExcitationFlipAngle() const {return m_ExcitationFlipAngle;}
+
+    void SetNumberOfEchoes(unsigned int val) {m_NumberOfEchoes = val;}
+    unsigned int GetNumberOfEchoes() const {return m_NumberOfEchoes;}
+
+    /**
+     * Computes echo trains (one row per T2 value) and, if faDerivatives is provided, their derivatives with respect
+     * to the refocusing flip angle. Thread safe.
+     */
+    void GetValues(double t1Value, const std::vector <double> &t2Values, double flipAngle, double m0Value,
+                   vnl_matrix <double> &signals, vnl_matrix <double> *faDerivatives = 0) const;
+
+    //! Same as above, using the provided workspace
+    void GetValues(double t1Value, const std::vector <double> &t2Values, double flipAngle, double m0Value,
+                   Workspace &workspace, vnl_matrix <double> &signals, vnl_matrix <double> *faDerivatives = 0) const;
+
+    //! Echo train for a single T2 value, outputs being resized to the number of echoes
+    void GetValue(double t1Value, double t2Value, double flipAngle, double m0Value, Workspace &workspace,
+                  std::vector <double> &signals, std::vector <double> *faDerivatives = 0) const;
+
+    /**
+     * Echo train for a single T2 value, EPG states of the sweep being kept in the workspace so that flip angle
+     * derivatives may be computed afterwards by GetFADerivative without running the value sweep again
+     */
+    void GetValueAndKeepStates(double t1Value, double t2Value, double flipAngle, double m0Value, Workspace &workspace,
+                               std::vector <double> &signals) const;
+
+    //! Flip angle derivatives of the last GetValueAndKeepStates call on that workspace (zero if there was none)
+    void GetFADerivative(Workspace &workspace, std::vector <double> &faDerivatives) const;
+
+protected:
+    /**
+     * Runs the sweep, echo i of batch element b being written at position i * batchSize + b of outputs. If keepStateHistory
+     * is true, states after each refocusing are kept in the workspace instead of being overwritten
+     */
+    void ComputeEchoTrains(double t1Value, const double *t2Values, unsigned int batchSize, double flipAngle,
+                           double m0Value, Workspace &workspace, double *signals, double *faDerivatives,
+                           bool keepStateHistory = false) const;
+
+    //! Propagates flip angle derivatives along states kept by a previous sweep, returns false if there are none
+    bool ComputeEchoTrainDerivatives(unsigned int batchSize, Workspace &workspace, double *faDerivatives) const;
+
+    //! Number of states of a given state vector index (0 being the excitation) needed to compute all echoes
+    unsigned int GetNumberOfActiveStates(unsigned int index) const;
+
+private:
+    double m_EchoSpacing;
+    double m_ExcitationFlipAngle;
+    unsigned int m_NumberOfEchoes;
+};
+
+} // end namespace of anima
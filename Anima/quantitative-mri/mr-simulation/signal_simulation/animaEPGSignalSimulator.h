@@ -1,13 +1,19 @@
 #pragma once
 
 #include <vector>
-#include <vnl/vnl_matrix.h>
 
+#include "animaEPGBatchSignalSimulator.h"
 #include "AnimaSignalSimulationExport.h"
 
 namespace anima
 {
-    
+
+/**
+ * \class EPGSignalSimulator
+ * @brief Single voxel EPG simulator, computing values then flip angle derivatives at the same point.
+ * Relies on EPGBatchSignalSimulator, but keeps its own workspace and outputs: one instance per thread. EPG states of
+ * the value sweep are kept, so that derivatives only require a derivative propagation along them.
+ */
 class ANIMASIGNALSIMULATION_EXPORT EPGSignalSimulator
 {
 public:
@@ -23,26 +29,17 @@ public:
     //! Get EPG derivative values at same point that was used for getting EPG values. Requires a run of GetValue first
     RealVectorType &GetFADerivative();
 
-    void SetEchoSpacing(double val) {m_EchoSpacing = val;}
-    void SetExcitationFlipAngle(double val) {m_ExcitationFlipAngle = val;}
-    double GetExcitationFlipAngle() {return m_ExcitationFlipAngle;}
+    void SetEchoSpacing(double val) {m_Simulator.SetEchoSpacing(val);}
+    void SetExcitationFlipAngle(double val) {m_Simulator.SetExcitationFlipAngle(val);}
+    double GetExcitationFlipAngle() {return m_Simulator.GetExcitationFlipAngle();}
 
-    void SetNumberOfEchoes(unsigned int val) {m_NumberOfEchoes = val;}
-
-protected:
-    void ComputeT2SignalMatrixElements(double t1Value, double t2Value, double flipAngle);
+    void SetNumberOfEchoes(unsigned int val) {m_Simulator.SetNumberOfEchoes(val);}
 
 private:
-    double m_EchoSpacing;
-    double m_ExcitationFlipAngle;
-    unsigned int m_NumberOfEchoes;
-
-    double m_FirstEPGProduct, m_SecondEPGProduct, m_ThirdEPGProduct, m_FourthEPGProduct, m_FifthEPGProduct;
-    double m_FirstDerivativeProduct, m_SecondDerivativeProduct, m_ThirdDerivativeProduct;
+    EPGBatchSignalSimulator m_Simulator;
 
-    // Internal work variables. Because of this, not thread safe !
-    vnl_matrix <double> m_SimulatedT2Values;
-    vnl_matrix <double> m_SimulatedDerivativeT2Values;
+    // Internal work variables, the workspace keeping the EPG states of the last GetValue call. Because of this, not thread safe !
+    EPGBatchSignalSimulator::Workspace m_Workspace;
     RealVectorType m_OutputVector;
     RealVectorType m_OutputB1Derivative;
 };
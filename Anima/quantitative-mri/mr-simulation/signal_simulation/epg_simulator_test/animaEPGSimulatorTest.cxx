@@ -0,0 +1,296 @@
+#include <cmath>
+#include <algorithm>
+#include <iostream>
+#include <random>
+
+#include <animaEPGBatchSignalSimulator.h>
+#include <animaEPGSignalSimulator.h>
+
+/**
+ * Reference EPG simulation: dense propagation of all states, as done by the former single voxel simulator.
+ * Flip angle derivatives propagate dE s + E ds along states, and are only available for at least two echoes
+ * (the single echo derivative being given in closed form in main).
+ */
+class ReferenceEPGSimulator
+{
+public:
+    ReferenceEPGSimulator(unsigned int numEchoes, double echoSpacing, double excitationFlipAngle)
+    {
+        m_NumberOfEchoes = numEchoes;
+        m_EchoSpacing = echoSpacing;
+        m_ExcitationFlipAngle = excitationFlipAngle;
+    }
+
+    void GetValue(double t1Value, double t2Value, double flipAngle, double m0Value, std::vector <double> &signals)
+    {
+        unsigned int n = m_NumberOfEchoes;
+        m_States.set_size(n + 1,3 * n + 1);
+        m_States.fill(0.0);
+        signals.resize(n);
+
+        this->ComputeProducts(t1Value,t2Value,flipAngle);
+        m_States(0,0) = m0Value * std::sin(m_ExcitationFlipAngle);
+
+        for (unsigned int i = 0;i < n;++i)
+        {
+            m_States(i+1,0) = m_First * m_States(i,0) - m_Second * m_States(i,3);
+            if (n > 1)
+                m_States(i+1,0) += m_Third * m_States(i,5);
+
+            m_States(i+1,1) = m_Fourth * m_States(i,2);
+            m_States(i+1,2) = m_First * m_States(i,1);
+            m_States(i+1,3) = m_Fifth * m_States(i,3) - m_Second * m_States(i,0) / 2.0;
+
+            if (n > 1)
+            {
+                m_States(i+1,2) -= m_Second * m_States(i,6);
+                m_States(i+1,3) += m_Second * m_States(i,5) / 2.0;
+
+                if (n > 2)
+                    m_States(i+1,2) += m_Third * m_States(i,8);
+            }
+
+            for (unsigned int j = 1;j < n;++j)
+            {
+                m_States(i+1,1 + j * 3) = m_Second * m_States(i,3 + (j - 1) * 3) + m_First * m_States(i,2 + j * 3);
+                if (j > 1)
+                    m_States(i+1,1 + j * 3) += m_Third * m_States(i,1 + (j - 2) * 3);
+                else
+                    m_States(i+1,1 + j * 3) += m_Third * m_States(i,0);
+
+                m_States(i+1,2 + j * 3) = m_First * m_States(i,1 + j * 3);
+                m_States(i+1,3 + j * 3) = m_Fifth * m_States(i,3 + j * 3) - m_Second * m_States(i,1 + (j - 1) * 3) / 2.0;
+
+                if ((j + 1) < n)
+                {
+                    m_States(i+1,2 + j * 3) -= m_Second * m_States(i,3 + (j + 1) * 3);
+                    m_States(i+1,3 + j * 3) += m_Second * m_States(i,2 + (j + 1) * 3) / 2.0;
+
+                    if ((j + 2) < n)
+                        m_States(i+1,2 + j * 3) += m_Third * m_States(i,2 + (j + 2) * 3);
+                }
+            }
+
+            signals[i] = m_States(i+1,0);
+        }
+    }
+
+    //! Derivatives at the point of the last GetValue call, requires at least two echoes
+    void GetFADerivative(std::vector <double> &derivatives)
+    {
+        unsigned int n = m_NumberOfEchoes;
+        const vnl_matrix <double> &s = m_States;
+        vnl_matrix <double> ds(n + 1,3 * n + 1);
+        ds.fill(0.0);
+        derivatives.resize(n);
+
+        for (unsigned int i = 0;i < n;++i)
+        {
+            // dE s
+            ds(i+1,0) = m_FirstDerivative * s(i,0) - m_SecondDerivative * s(i,3) - m_FirstDerivative * s(i,5);
+            ds(i+1,2) = m_FirstDerivative * s(i,1) - m_SecondDerivative * s(i,6);
+            if (n > 2)
+                ds(i+1,2) -= m_FirstDerivative * s(i,8);
+
+            ds(i+1,3) = m_ThirdDerivative * s(i,3) - m_SecondDerivative * s(i,0) / 2.0 + m_SecondDerivative * s(i,5) / 2.0;
+
+            for (unsigned int j = 1;j < n;++j)
+            {
+                ds(i+1,1 + j * 3) = m_SecondDerivative * s(i,3 + (j - 1) * 3) + m_FirstDerivative * s(i,2 + j * 3);
+                ds(i+1,1 + j * 3) -= m_FirstDerivative * s(i,(j > 1) ? 1 + (j - 2) * 3 : 0);
+
+                ds(i+1,2 + j * 3) = ((j + 1) < n) ? m_FirstDerivative * s(i,1 + j * 3) : 0.0;
+                ds(i+1,3 + j * 3) = m_ThirdDerivative * s(i,3 + j * 3) - m_SecondDerivative * s(i,1 + (j - 1) * 3) / 2.0;
+
+                if ((j + 1) < n)
+                {
+                    ds(i+1,2 + j * 3) -= m_SecondDerivative * s(i,3 + (j + 1) * 3);
+                    ds(i+1,3 + j * 3) += m_SecondDerivative * s(i,2 + (j + 1) * 3) / 2.0;
+
+                    if ((j + 2) < n)
+                        ds(i+1,2 + j * 3) -= m_FirstDerivative * s(i,2 + (j + 2) * 3);
+                }
+            }
+
+            // E ds
+            ds(i+1,0) += m_First * ds(i,0) - m_Second * ds(i,3) + m_Third * ds(i,5);
+            ds(i+1,1) += m_Fourth * ds(i,2);
+            ds(i+1,2) += m_First * ds(i,1) - m_Second * ds(i,6);
+            if (n > 2)
+                ds(i+1,2) += m_Third * ds(i,8);
+
+            ds(i+1,3) += m_Fifth * ds(i,3) - m_Second * ds(i,0) / 2.0 + m_Second * ds(i,5) / 2.0;
+
+            for (unsigned int j = 1;j < n;++j)
+            {
+                ds(i+1,1 + j * 3) += m_Second * ds(i,3 + (j - 1) * 3) + m_First * ds(i,2 + j * 3);
+                ds(i+1,1 + j * 3) += m_Third * ds(i,(j > 1) ? 1 + (j - 2) * 3 : 0);
+
+                if ((j + 1) < n)
+                    ds(i+1,2 + j * 3) += m_First * ds(i,1 + j * 3);
+
+                ds(i+1,3 + j * 3) += m_Fifth * ds(i,3 + j * 3) - m_Second * ds(i,1 + (j - 1) * 3) / 2.0;
+
+                if ((j + 1) < n)
+                {
+                    ds(i+1,2 + j * 3) -= m_Second * ds(i,3 + (j + 1) * 3);
+                    ds(i+1,3 + j * 3) += m_Second * ds(i,2 + (j + 1) * 3) / 2.0;
+
+                    if ((j + 2) < n)
+                        ds(i+1,2 + j * 3) += m_Third * ds(i,2 + (j + 2) * 3);
+                }
+            }
+
+            derivatives[i] = ds(i+1,0);
+        }
+    }
+
+private:
+    void ComputeProducts(double t1Value, double t2Value, double flipAngle)
+    {
+        double espT2Value = (t2Value != 0.0) ? std::exp(- m_EchoSpacing / (2 * t2Value)) : 0.0;
+        double espT1Value = (t1Value != 0.0) ? std::exp(- m_EchoSpacing / (2 * t1Value)) : 0.0;
+
+        double cosAlpha = std::cos(flipAngle);
+        double cosAlpha2 = std::cos(flipAngle / 2.0);
+        double sinAlpha = std::sin(flipAngle);
+        double sinAlpha2 = std::sin(flipAngle / 2.0);
+
+        m_First = sinAlpha2 * sinAlpha2 * espT2Value * espT2Value;
+        m_Second = sinAlpha * espT1Value * espT2Value;
+        m_Third = cosAlpha2 * cosAlpha2 * espT2Value * espT2Value;
+        m_Fourth = espT2Value * espT2Value;
+        m_Fifth = cosAlpha * espT1Value * espT1Value;
+
+        m_FirstDerivative = cosAlpha2 * sinAlpha2 * espT2Value * espT2Value;
+        m_SecondDerivative = cosAlpha * espT1Value * espT2Value;
+        m_ThirdDerivative = - sinAlpha * espT1Value * espT1Value;
+    }
+
+    unsigned int m_NumberOfEchoes;
+    double m_EchoSpacing, m_ExcitationFlipAngle;
+
+    double m_First, m_Second, m_Third, m_Fourth, m_Fifth;
+    double m_FirstDerivative, m_SecondDerivative, m_ThirdDerivative;
+    vnl_matrix <double> m_States;
+};
+
+//! Maximal difference of two echo trains, relative to the largest reference value
+double GetRelativeDeviation(const std::vector <double> &refValues, const std::vector <double> &testedValues)
+{
+    if (refValues.size() != testedValues.size())
+        return 1.0;
+
+    double scale = 0.0;
+    double maxDifference = 0.0;
+    for (unsigned int i = 0;i < refValues.size();++i)
+    {
+        scale = std::max(scale, std::abs(refValues[i]));
+        maxDifference = std::max(maxDifference, std::abs(refValues[i] - testedValues[i]));
+    }
+
+    return maxDifference / std::max(scale, 1.0e-300);
+}
+
+int main()
+{
+    std::mt19937 generator(12345);
+    std::uniform_real_distribution <double> t1Distribution(200.0, 3000.0);
+    std::uniform_real_distribution <double> logT2Distribution(std::log(5.0), std::log(500.0));
+    std::uniform_real_distribution <double> flipAngleDistribution(0.5 * M_PI, 1.2 * M_PI);
+    std::uniform_real_distribution <double> excitationDistribution(0.3 * M_PI, 0.6 * M_PI);
+    std::uniform_real_distribution <double> m0Distribution(1.0, 1000.0);
+
+    const unsigned int numCasesPerEchoCount = 20;
+    const unsigned int batchSize = 7;
+    std::vector <unsigned int> echoCounts = {1, 2, 3, 4, 7, 16, 32, 50};
+
+    // Deviations of the batched sweep (active band of states, rotation terms shared) from the dense reference
+    const double tolerance = 1.0e-12;
+    double maxValueDeviation = 0.0;
+    double maxDerivativeDeviation = 0.0;
+
+    for (unsigned int numEchoes : echoCounts)
+    {
+        for (unsigned int c = 0;c < numCasesPerEchoCount;++c)
+        {
+            double echoSpacing = 5.0 + 10.0 * c / numCasesPerEchoCount;
+            double excitationFlipAngle = excitationDistribution(generator);
+            double t1Value = t1Distribution(generator);
+            double flipAngle = flipAngleDistribution(generator);
+            double m0Value = m0Distribution(generator);
+
+            std::vector <double> t2Values(batchSize);
+            for (unsigned int b = 0;b < batchSize;++b)
+                t2Values[b] = std::exp(logT2Distribution(generator));
+
+            ReferenceEPGSimulator referenceSimulator(numEchoes,echoSpacing,excitationFlipAngle);
+
+            anima::EPGBatchSignalSimulator batchSimulator;
+            batchSimulator.SetNumberOfEchoes(numEchoes);
+            batchSimulator.SetEchoSpacing(echoSpacing);
+            batchSimulator.SetExcitationFlipAngle(excitationFlipAngle);
+
+            anima::EPGSignalSimulator singleSimulator;
+            singleSimulator.SetNumberOfEchoes(numEchoes);
+            singleSimulator.SetEchoSpacing(echoSpacing);
+            singleSimulator.SetExcitationFlipAngle(excitationFlipAngle);
+
+            // The workspace is shared by all calls, as done by estimators
+            anima::EPGBatchSignalSimulator::Workspace workspace;
+            vnl_matrix <double> batchSignals, batchDerivatives;
+            batchSimulator.GetValues(t1Value,t2Values,flipAngle,m0Value,workspace,batchSignals,&batchDerivatives);
+
+            std::vector <double> refSignals, refDerivatives;
+            std::vector <double> signals, derivatives, rowSignals(numEchoes), rowDerivatives(numEchoes);
+            for (unsigned int b = 0;b < batchSize;++b)
+            {
+                referenceSimulator.GetValue(t1Value,t2Values[b],flipAngle,m0Value,refSignals);
+                if (numEchoes > 1)
+                    referenceSimulator.GetFADerivative(refDerivatives);
+                else
+                {
+                    // Single echo: M0 sin(excitation) sin^2(alpha / 2) exp(-ES / T2), whose derivative is known in closed form
+                    double espT2Value = std::exp(- echoSpacing / (2 * t2Values[b]));
+                    refDerivatives.assign(1, m0Value * std::sin(excitationFlipAngle) * std::sin(flipAngle / 2.0)
+                                          * std::cos(flipAngle / 2.0) * espT2Value * espT2Value);
+                }
+
+                for (unsigned int i = 0;i < numEchoes;++i)
+                {
+                    rowSignals[i] = batchSignals(b,i);
+                    rowDerivatives[i] = batchDerivatives(b,i);
+                }
+
+                maxValueDeviation = std::max(maxValueDeviation, GetRelativeDeviation(refSignals,rowSignals));
+                maxDerivativeDeviation = std::max(maxDerivativeDeviation, GetRelativeDeviation(refDerivatives,rowDerivatives));
+
+                // Single T2 sweeps, with and without derivatives
+                batchSimulator.GetValue(t1Value,t2Values[b],flipAngle,m0Value,workspace,signals);
+                maxValueDeviation = std::max(maxValueDeviation, GetRelativeDeviation(refSignals,signals));
+
+                batchSimulator.GetValue(t1Value,t2Values[b],flipAngle,m0Value,workspace,signals,&derivatives);
+                maxValueDeviation = std::max(maxValueDeviation, GetRelativeDeviation(refSignals,signals));
+                maxDerivativeDeviation = std::max(maxDerivativeDeviation, GetRelativeDeviation(refDerivatives,derivatives));
+
+                // Wrapper: derivatives computed from the states kept by the value sweep, values being left untouched
+                std::vector <double> wrapperSignals = singleSimulator.GetValue(t1Value,t2Values[b],flipAngle,m0Value);
+                std::vector <double> wrapperDerivatives = singleSimulator.GetFADerivative();
+                maxValueDeviation = std::max(maxValueDeviation, GetRelativeDeviation(refSignals,wrapperSignals));
+                maxValueDeviation = std::max(maxValueDeviation, GetRelativeDeviation(refSignals,singleSimulator.GetValue(t1Value,t2Values[b],flipAngle,m0Value)));
+                maxDerivativeDeviation = std::max(maxDerivativeDeviation, GetRelativeDeviation(refDerivatives,wrapperDerivatives));
+            }
+        }
+    }
+
+    std::cout << "EPG simulation maximal relative deviations: values " << maxValueDeviation
+              << ", flip angle derivatives " << maxDerivativeDeviation << std::endl;
+
+    if ((maxValueDeviation > tolerance) || (maxDerivativeDeviation > tolerance))
+    {
+        std::cerr << "EPG simulation deviation above " << tolerance << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
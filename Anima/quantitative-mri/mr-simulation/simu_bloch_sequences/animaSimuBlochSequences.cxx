@@ -0,0 +1,267 @@
+#include <tclap/CmdLine.h>
+
+#include <itkImage.h>
+#include <itkImageFileReader.h>
+#include <itkImageFileWriter.h>
+
+#include <fstream>
+#include <sstream>
+
+#include "animaSimuBlochSequences.h"
+
+typedef itk::Image<double, 3> ImageType;
+typedef itk::Image<double, 4> OutputImageType;
+typedef anima::SimuBlochSequences<ImageType,OutputImageType> FilterType;
+
+//! Sequence names in sequence files, in FilterType::SequenceType order
+const unsigned int NumberOfSequenceTypes = 6;
+const char *SequenceTypeNames[NumberOfSequenceTypes] = {"SE", "GRE", "IR-SE", "IR-GRE", "SP-GRE", "COHERENT-GRE"};
+
+//! Parses a value or a sweep start:step:end into a list of values
+bool parseValues(const std::string &field, std::vector <double> &values)
+{
+    values.clear();
+    std::vector <double> bounds;
+    std::stringstream fieldStream(field);
+    std::string item;
+    while (std::getline(fieldStream,item,':'))
+    {
+        std::stringstream itemStream(item);
+        double value;
+        if (!(itemStream >> value) || !(itemStream >> std::ws).eof())
+            return false;
+
+        bounds.push_back(value);
+    }
+
+    if (bounds.size() == 1)
+    {
+        values.push_back(bounds[0]);
+        return true;
+    }
+
+    if ((bounds.size() != 3) || (bounds[1] <= 0) || (bounds[2] < bounds[0]))
+        return false;
+
+    unsigned int numValues = std::floor((bounds[2] - bounds[0]) / bounds[1] + 1.0e-8) + 1;
+    for (unsigned int i = 0;i < numValues;++i)
+        values.push_back(bounds[0] + i * bounds[1]);
+
+    return true;
+}
+
+//! Reads a sequence file, each line being TYPE TR TE [TI|FA], numeric fields being values or sweeps start:step:end
+bool readSequences(const std::string &fileName, FilterType *filter)
+{
+    std::ifstream sequencesFile(fileName.c_str());
+    if (!sequencesFile.is_open())
+    {
+        std::cerr << "Unable to open sequence file " << fileName << std::endl;
+        return false;
+    }
+
+    std::string line;
+    unsigned int lineNumber = 0;
+    while (std::getline(sequencesFile,line))
+    {
+        ++lineNumber;
+        std::stringstream lineStream(line);
+        std::string typeName;
+        if (!(lineStream >> typeName) || (typeName[0] == '#'))
+            continue;
+
+        FilterType::SequenceParameters sequence;
+        sequence.ti = 0;
+        sequence.fa = 0;
+        unsigned int numFields = 2;
+        unsigned int typeIndex = 0;
+        while ((typeIndex < NumberOfSequenceTypes) && (typeName != SequenceTypeNames[typeIndex]))
+            ++typeIndex;
+
+        if (typeIndex == NumberOfSequenceTypes)
+        {
+            std::cerr << "Unknown sequence type " << typeName << " at line " << lineNumber << std::endl;
+            return false;
+        }
+
+        sequence.type = (FilterType::SequenceType)typeIndex;
+        if (sequence.type != FilterType::SE && sequence.type != FilterType::GRE)
+            numFields = 3;
+
+        std::vector < std::vector <double> > fieldValues(numFields);
+        for (unsigned int i = 0;i < numFields;++i)
+        {
+            std::string field;
+            if (!(lineStream >> field) || !parseValues(field,fieldValues[i]))
+            {
+                std::cerr << "Invalid sequence parameters at line " << lineNumber << std::endl;
+                return false;
+            }
+        }
+
+        std::string trailingField;
+        if (lineStream >> trailingField)
+        {
+            std::cerr << "Unexpected field " << trailingField << " after " << typeName << " parameters at line " << lineNumber << std::endl;
+            return false;
+        }
+
+        // Expand sweeps as all combinations of parameter values
+        std::vector <unsigned int> indexes(numFields,0);
+        bool done = false;
+        while (!done)
+        {
+            sequence.tr = fieldValues[0][indexes[0]];
+            sequence.te = fieldValues[1][indexes[1]];
+            if ((sequence.type == FilterType::IR_SE) || (sequence.type == FilterType::IR_GRE))
+                sequence.ti = fieldValues[2][indexes[2]];
+            else if (numFields == 3)
+                sequence.fa = fieldValues[2][indexes[2]];
+
+            if ((sequence.tr < 0) || (sequence.te < 0) || (sequence.te >= sequence.tr) || (sequence.ti < 0) ||
+                    (sequence.fa < 0) || (sequence.fa > 180))
+            {
+                std::cerr << "Invalid sequence parameters at line " << lineNumber << ", please set 0 <= TE < TR, TI >= 0 and FA in [0, 180]" << std::endl;
+                return false;
+            }
+
+            filter->AddSequence(sequence);
+
+            unsigned int pos = 0;
+            while (pos < numFields)
+            {
+                ++indexes[pos];
+                if (indexes[pos] < fieldValues[pos].size())
+                    break;
+
+                indexes[pos] = 0;
+                ++pos;
+            }
+
+            done = (pos == numFields);
+        }
+    }
+
+    return true;
+}
+
+//! Writes the parameters of the sequence simulated in each output volume, one line per volume
+bool writeSequencesList(const std::string &fileName, FilterType *filter)
+{
+    std::ofstream listFile(fileName.c_str());
+    if (!listFile.is_open())
+    {
+        std::cerr << "Unable to write sequence list " << fileName << std::endl;
+        return false;
+    }
+
+    listFile << "# volume type TR TE TI FA" << std::endl;
+    for (unsigned int i = 0;i < filter->GetNumberOfSequences();++i)
+    {
+        const FilterType::SequenceParameters &sequence = filter->GetSequence(i);
+        listFile << i << " " << SequenceTypeNames[sequence.type] << " " << sequence.tr << " " << sequence.te << " "
+                 << sequence.ti << " " << sequence.fa << std::endl;
+    }
+
+    return true;
+}
+
+ImageType::Pointer readMap(const std::string &fileName)
+{
+    typedef itk::ImageFileReader<ImageType> ReaderType;
+    ReaderType::Pointer reader = ReaderType::New();
+    reader->SetFileName(fileName);
+    reader->Update();
+
+    ImageType::Pointer outputMap = reader->GetOutput();
+    outputMap->DisconnectPipeline();
+    return outputMap;
+}
+
+int main(int argc, char *argv[] )
+{
+    TCLAP::CmdLine cmd("SimuBlochSequences: Simulator for a list of sequences (SE, GRE, IR-SE, IR-GRE, SP-GRE, COHERENT-GRE) in a single pass.\n"
+                       "Sequence file lines are TYPE TR TE [TI|FA] (ms, degrees), numeric fields being values or sweeps start:step:end\n"
+                       "INRIA / IRISA - VisAGeS/Empenn Team", ' ',ANIMA_VERSION);
+
+    TCLAP::ValueArg<std::string> t1MapArg("","t1","Input T1 map",true,"","T1 map",cmd);
+    TCLAP::ValueArg<std::string> m0ImageArg("","m0","Input M0 image",true,"","M0 image",cmd);
+    TCLAP::ValueArg<std::string> t2MapArg("","t2","Input T2 map (required for SE, IR-SE and COHERENT-GRE)",false,"","T2 map",cmd);
+    TCLAP::ValueArg<std::string> t2sMapArg("","t2s","Input T2* map (required for GRE, IR-GRE, SP-GRE and COHERENT-GRE)",false,"","T2* map",cmd);
+    TCLAP::ValueArg<std::string> b1ImageArg("","b1","Input B1 image (used by SP-GRE)",false,"","B1 image",cmd);
+    TCLAP::ValueArg<std::string> sequencesArg("s","sequences","Sequence list file",true,"","sequence file",cmd);
+    TCLAP::ValueArg<std::string> resArg("o","output","Output 4D simulated image, one volume per sequence",true,"","output simulated image",cmd);
+    TCLAP::ValueArg<std::string> listArg("l","list","Output list of sequence parameters per volume (default: output image name with _sequences.txt extension)",false,"","sequence list",cmd);
+
+    TCLAP::ValueArg<unsigned int> nbpArg("T","numberofthreads","Number of threads to run on (default : all cores)",false,itk::MultiThreaderBase::GetGlobalDefaultNumberOfThreads(),"number of threads",cmd);
+
+    try
+    {
+        cmd.parse(argc,argv);
+    }
+    catch (TCLAP::ArgException& e)
+    {
+        std::cerr << "Error: " << e.error() << "for argument " << e.argId() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    FilterType::Pointer filter = FilterType::New();
+    if (!readSequences(sequencesArg.getValue(),filter))
+        return EXIT_FAILURE;
+
+    if (filter->GetNumberOfSequences() == 0)
+    {
+        std::cerr << "Error: no sequence found in " << sequencesArg.getValue() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // Each map is read once and shared by all sequences
+    filter->SetInputT1(readMap(t1MapArg.getValue()));
+    filter->SetInputM0(readMap(m0ImageArg.getValue()));
+
+    if (t2MapArg.getValue() != "")
+        filter->SetT2Map(readMap(t2MapArg.getValue()));
+
+    if (t2sMapArg.getValue() != "")
+        filter->SetT2sMap(readMap(t2sMapArg.getValue()));
+
+    if (b1ImageArg.getValue() != "")
+        filter->SetB1Map(readMap(b1ImageArg.getValue()));
+
+    filter->SetNumberOfWorkUnits(nbpArg.getValue());
+
+    try
+    {
+        filter->Update();
+    }
+    catch (itk::ExceptionObject &e)
+    {
+        std::cerr << e << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::cout << "Simulated " << filter->GetNumberOfSequences() << " sequences" << std::endl;
+
+    // Save the output image, already ordered as one volume per sequence
+    typedef itk::ImageFileWriter <OutputImageType> WriterType;
+    WriterType::Pointer writer = WriterType::New();
+    writer->SetFileName(resArg.getValue());
+    writer->SetInput(filter->GetOutput());
+    writer->Update();
+
+    std::string listFileName = listArg.getValue();
+    if (listFileName == "")
+    {
+        std::size_t pointLocation = resArg.getValue().find_last_of('.');
+        listFileName = resArg.getValue().substr(0,pointLocation);
+        if (resArg.getValue().substr(pointLocation + 1) == "gz")
+            listFileName = listFileName.substr(0,listFileName.find_last_of('.'));
+
+        listFileName += "_sequences.txt";
+    }
+
+    if (!writeSequencesList(listFileName,filter))
+        return EXIT_FAILURE;
+
+    return EXIT_SUCCESS;
+}
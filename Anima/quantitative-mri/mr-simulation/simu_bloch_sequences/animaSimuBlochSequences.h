@@ -0,0 +1,105 @@
+#pragma once
+
+#include <itkImageToImageFilter.h>
+#include <vector>
+
+namespace anima
+{
+
+/**
+ * \class SimuBlochSequences
+ * @brief Simulates a list of sequences (spin echo, gradient echo, inversion recovery, spoiled and coherent gradient echo)
+ * from tissue maps in a single pass.
+ *
+ * The output image has one more dimension than the input maps, each volume along the last dimension being one sequence,
+ * so that it is written without any reordering of the simulated values.
+ * Signal equations are the ones of SimuBlochSE, SimuBlochGRE, SimuBlochIR_SE, SimuBlochIR_GRE, SimuBlochSP_GRE and
+ * SimuBlochCoherentGRE. Inputs are T1 (0) and M0 (1) maps, T2, T2* and B1 maps being optional and only required by
+ * sequences using them.
+ */
+template <class TImage, class TOutputImage>
+class SimuBlochSequences : public itk::ImageToImageFilter <TImage, TOutputImage>
+{
+public:
+    /** Standard class typedefs. */
+    typedef SimuBlochSequences Self;
+    typedef itk::ImageToImageFilter <TImage, TOutputImage> Superclass;
+    typedef itk::SmartPointer <Self> Pointer;
+
+    itkStaticConstMacro(InputImageDimension, unsigned int, TImage::ImageDimension);
+    static_assert(TOutputImage::ImageDimension == TImage::ImageDimension + 1,
+                  "Output image should have one more dimension than input maps, indexing sequences");
+
+    typedef typename TImage::ConstPointer InputImageConstPointer;
+    typedef typename TImage::RegionType InputImageRegionType;
+    typedef TOutputImage OutputImageType;
+    typedef typename Superclass::OutputImageRegionType OutputImageRegionType;
+
+    enum SequenceType
+    {
+        SE = 0,
+        GRE,
+        IR_SE,
+        IR_GRE,
+        SP_GRE,
+        COHERENT_GRE
+    };
+
+    //! Sequence parameters, times in ms and flip angle in degrees. TI is only used by inversion recovery sequences, FA by SP and coherent GRE
+    struct SequenceParameters
+    {
+        SequenceType type;
+        double tr, te, ti, fa;
+    };
+
+    /** Method for creation through the object factory. */
+    itkNewMacro(Self)
+
+    /** Run-time type information (and related methods). */
+    itkTypeMacro(SimuBlochSequences, itk::ImageToImageFilter)
+
+    /** T1 map */
+    void SetInputT1(const TImage* T1);
+
+    /** M0 image / Rho map */
+    void SetInputM0(const TImage* M0);
+
+    void SetT2Map(const TImage* T2) {m_T2Map = T2;}
+    void SetT2sMap(const TImage* T2s) {m_T2sMap = T2s;}
+    void SetB1Map(const TImage* B1) {m_B1Map = B1;}
+
+    void AddSequence(const SequenceParameters &sequence) {m_Sequences.push_back(sequence); this->Modified();}
+    void ClearSequences() {m_Sequences.clear(); this->Modified();}
+    unsigned int GetNumberOfSequences() {return m_Sequences.size();}
+    //! Parameters of the sequence simulated in output volume i
+    const SequenceParameters &GetSequence(unsigned int i) const {return m_Sequences[i];}
+
+protected:
+    SimuBlochSequences();
+    virtual ~SimuBlochSequences() {}
+
+    //! Output geometry is the one of the T1 map, extended by one sequence per volume
+    void GenerateOutputInformation() ITK_OVERRIDE;
+    void GenerateInputRequestedRegion() ITK_OVERRIDE;
+    void BeforeThreadedGenerateData() ITK_OVERRIDE;
+
+    /** Does the real work. */
+    virtual void DynamicThreadedGenerateData(const OutputImageRegionType &outputRegionForThread) ITK_OVERRIDE;
+
+    //! Signal of one sequence in a voxel, flip angle sine and cosine being precomputed without B1 map
+    double ComputeSignal(const SequenceParameters &sequence, double t1Value, double m0Value, double t2Value,
+                         double t2sValue, double b1Value, double sinFA, double cosFA) const;
+
+private:
+    ITK_DISALLOW_COPY_AND_ASSIGN(SimuBlochSequences);
+
+    InputImageRegionType GetInputRegion(const OutputImageRegionType &outputRegion) const;
+
+    std::vector <SequenceParameters> m_Sequences;
+
+    InputImageConstPointer m_T2Map, m_T2sMap, m_B1Map;
+};
+
+} // end of namespace anima
+
+#include "animaSimuBlochSequences.hxx"
@@ -0,0 +1,270 @@
+#pragma once
+#include "animaSimuBlochSequences.h"
+
+#include <itkImageRegionIterator.h>
+#include <itkImageRegionConstIterator.h>
+
+#include <cmath>
+
+namespace anima
+{
+
+template <class TImage, class TOutputImage>
+SimuBlochSequences <TImage,TOutputImage>
+::SimuBlochSequences()
+{
+    this->SetNumberOfRequiredInputs(2);
+}
+
+template <class TImage, class TOutputImage>
+void SimuBlochSequences <TImage,TOutputImage>
+::SetInputT1(const TImage* T1)
+{
+    this->SetInput(0, const_cast<TImage*>(T1));
+}
+
+template <class TImage, class TOutputImage>
+void SimuBlochSequences <TImage,TOutputImage>
+::SetInputM0(const TImage* M0)
+{
+    this->SetInput(1, const_cast<TImage*>(M0));
+}
+
+template <class TImage, class TOutputImage>
+void
+SimuBlochSequences <TImage,TOutputImage>
+::GenerateOutputInformation()
+{
+    // Superclass information copy does not handle the extra dimension
+    const TImage *inputT1 = this->GetInput(0);
+    OutputImageType *output = this->GetOutput();
+    if (!inputT1 || !output)
+        return;
+
+    InputImageRegionType inputRegion = inputT1->GetLargestPossibleRegion();
+    OutputImageRegionType outputRegion;
+    typename OutputImageType::SpacingType outputSpacing;
+    typename OutputImageType::PointType outputOrigin;
+    typename OutputImageType::DirectionType outputDirection;
+    outputDirection.SetIdentity();
+
+    for (unsigned int i = 0;i < InputImageDimension;++i)
+    {
+        outputRegion.SetIndex(i,inputRegion.GetIndex()[i]);
+        outputRegion.SetSize(i,inputRegion.GetSize()[i]);
+        outputSpacing[i] = inputT1->GetSpacing()[i];
+        outputOrigin[i] = inputT1->GetOrigin()[i];
+        for (unsigned int j = 0;j < InputImageDimension;++j)
+            outputDirection(i,j) = inputT1->GetDirection()(i,j);
+    }
+
+    outputRegion.SetIndex(InputImageDimension,0);
+    outputRegion.SetSize(InputImageDimension,m_Sequences.size());
+    outputSpacing[InputImageDimension] = 1;
+    outputOrigin[InputImageDimension] = 0;
+
+    output->SetLargestPossibleRegion(outputRegion);
+    output->SetSpacing(outputSpacing);
+    output->SetOrigin(outputOrigin);
+    output->SetDirection(outputDirection);
+}
+
+template <class TImage, class TOutputImage>
+typename SimuBlochSequences <TImage,TOutputImage>::InputImageRegionType
+SimuBlochSequences <TImage,TOutputImage>
+::GetInputRegion(const OutputImageRegionType &outputRegion) const
+{
+    InputImageRegionType inputRegion;
+    for (unsigned int i = 0;i < InputImageDimension;++i)
+    {
+        inputRegion.SetIndex(i,outputRegion.GetIndex()[i]);
+        inputRegion.SetSize(i,outputRegion.GetSize()[i]);
+    }
+
+    return inputRegion;
+}
+
+template <class TImage, class TOutputImage>
+void
+SimuBlochSequences <TImage,TOutputImage>
+::GenerateInputRequestedRegion()
+{
+    InputImageRegionType inputRegion = this->GetInputRegion(this->GetOutput()->GetRequestedRegion());
+    for (unsigned int i = 0;i < this->GetNumberOfIndexedInputs();++i)
+    {
+        TImage *input = const_cast <TImage *> (this->GetInput(i));
+        if (input)
+            input->SetRequestedRegion(inputRegion);
+    }
+}
+
+template <class TImage, class TOutputImage>
+void
+SimuBlochSequences <TImage,TOutputImage>
+::BeforeThreadedGenerateData()
+{
+    this->Superclass::BeforeThreadedGenerateData();
+
+    if (m_Sequences.size() == 0)
+        itkExceptionMacro("At least one sequence has to be simulated");
+
+    bool t2Required = false;
+    bool t2sRequired = false;
+    for (unsigned int i = 0;i < m_Sequences.size();++i)
+    {
+        switch (m_Sequences[i].type)
+        {
+            case SE:
+            case IR_SE:
+                t2Required = true;
+                break;
+
+            case COHERENT_GRE:
+                t2Required = true;
+                t2sRequired = true;
+                break;
+
+            default:
+                t2sRequired = true;
+                break;
+        }
+
+        if (m_Sequences[i].te >= m_Sequences[i].tr)
+            itkExceptionMacro("TE should be smaller than TR for all sequences");
+    }
+
+    if (t2Required && !m_T2Map)
+        itkExceptionMacro("A T2 map is required for spin echo and coherent gradient echo sequences");
+
+    if (t2sRequired && !m_T2sMap)
+        itkExceptionMacro("A T2* map is required for gradient echo sequences");
+
+    typename TImage::RegionType largestRegion = this->GetInput(0)->GetLargestPossibleRegion();
+    if ((this->GetInput(1)->GetLargestPossibleRegion() != largestRegion) ||
+            (m_T2Map && (m_T2Map->GetLargestPossibleRegion() != largestRegion)) ||
+            (m_T2sMap && (m_T2sMap->GetLargestPossibleRegion() != largestRegion)) ||
+            (m_B1Map && (m_B1Map->GetLargestPossibleRegion() != largestRegion)))
+        itkExceptionMacro("All input maps should have the same size");
+}
+
+template <class TImage, class TOutputImage>
+void SimuBlochSequences <TImage,TOutputImage>
+::DynamicThreadedGenerateData(const OutputImageRegionType &outputRegionForThread)
+{
+    typedef itk::ImageRegionConstIterator <TImage> InputIteratorType;
+    typedef itk::ImageRegionIterator <TOutputImage> OutputIteratorType;
+
+    // Each sequence of the thread region is one volume, maps being iterated over the matching input region
+    InputImageRegionType inputRegion = this->GetInputRegion(outputRegionForThread);
+    OutputImageRegionType volumeRegion = outputRegionForThread;
+    volumeRegion.SetSize(InputImageDimension,1);
+
+    unsigned int firstSequence = outputRegionForThread.GetIndex()[InputImageDimension];
+    unsigned int endSequence = firstSequence + outputRegionForThread.GetSize()[InputImageDimension];
+
+    for (unsigned int i = firstSequence;i < endSequence;++i)
+    {
+        const SequenceParameters &sequence = m_Sequences[i];
+        volumeRegion.SetIndex(InputImageDimension,i);
+
+        OutputIteratorType outputIterator(this->GetOutput(), volumeRegion);
+        InputIteratorType inputIteratorT1(this->GetInput(0), inputRegion);
+        InputIteratorType inputIteratorM0(this->GetInput(1), inputRegion);
+
+        InputIteratorType inputIteratorT2, inputIteratorT2s, inputIteratorB1;
+        if (m_T2Map)
+            inputIteratorT2 = InputIteratorType(m_T2Map, inputRegion);
+        if (m_T2sMap)
+            inputIteratorT2s = InputIteratorType(m_T2sMap, inputRegion);
+        if (m_B1Map)
+            inputIteratorB1 = InputIteratorType(m_B1Map, inputRegion);
+
+        // Flip angle terms are voxel independent unless a B1 map is given
+        double sinFA = std::sin(M_PI * sequence.fa / 180.0);
+        double cosFA = std::cos(M_PI * sequence.fa / 180.0);
+
+        while (!outputIterator.IsAtEnd())
+        {
+            double t2Value = m_T2Map ? inputIteratorT2.Get() : 0.0;
+            double t2sValue = m_T2sMap ? inputIteratorT2s.Get() : 0.0;
+            double b1Value = m_B1Map ? inputIteratorB1.Get() : 1.0;
+
+            outputIterator.Set(this->ComputeSignal(sequence, inputIteratorT1.Get(), inputIteratorM0.Get(),
+                                                   t2Value, t2sValue, b1Value, sinFA, cosFA));
+
+            ++inputIteratorT1;
+            ++inputIteratorM0;
+            if (m_T2Map)
+                ++inputIteratorT2;
+            if (m_T2sMap)
+                ++inputIteratorT2s;
+            if (m_B1Map)
+                ++inputIteratorB1;
+
+            ++outputIterator;
+        }
+    }
+}
+
+template <class TImage, class TOutputImage>
+double SimuBlochSequences <TImage,TOutputImage>
+::ComputeSignal(const SequenceParameters &sequence, double t1Value, double m0Value, double t2Value,
+                double t2sValue, double b1Value, double sinFA, double cosFA) const
+{
+    if (t1Value <= 0)
+        return 0.0;
+
+    double t1Relaxation = std::exp(- sequence.tr / t1Value);
+
+    switch (sequence.type)
+    {
+        case SE:
+            if (t2Value <= 0)
+                return 0.0;
+
+            return m0Value * (1.0 - t1Relaxation) * std::exp(- sequence.te / t2Value);
+
+        case GRE:
+            if (t2sValue <= 0)
+                return 0.0;
+
+            return m0Value * (1.0 - t1Relaxation) * std::exp(- sequence.te / t2sValue);
+
+        case IR_SE:
+            if (t2Value <= 0)
+                return 0.0;
+
+            return m0Value * std::abs(1.0 - 2.0 * std::exp(- sequence.ti / t1Value) + t1Relaxation) *
+                    std::exp(- sequence.te / t2Value);
+
+        case IR_GRE:
+            if (t2sValue <= 0)
+                return 0.0;
+
+            return m0Value * std::abs(1.0 - 2.0 * std::exp(- sequence.ti / t1Value) + t1Relaxation) *
+                    std::exp(- sequence.te / t2sValue);
+
+        case SP_GRE:
+            if (t2sValue <= 0)
+                return 0.0;
+
+            if (m_B1Map)
+            {
+                sinFA = std::sin(M_PI * b1Value * sequence.fa / 180.0);
+                cosFA = std::cos(M_PI * b1Value * sequence.fa / 180.0);
+            }
+
+            return m0Value * (1.0 - t1Relaxation) * sinFA / (1.0 - t1Relaxation * cosFA) *
+                    std::exp(- sequence.te / t2sValue);
+
+        case COHERENT_GRE:
+        default:
+            if ((t2Value <= 0) || (t2sValue <= 0))
+                return 0.0;
+
+            return m0Value * sinFA / (1.0 + t1Value / t2Value - cosFA * (t1Value / t2Value - 1.0)) *
+                    std::exp(- sequence.te / t2sValue);
+    }
+}
+
+} // end of namespace anima
@@ -0,0 +1,224 @@
+#include <cmath>
+#include <algorithm>
+#include <iostream>
+#include <random>
+
+#include <itkImageRegionConstIterator.h>
+#include <itkImageRegionIterator.h>
+
+#include <animaSimuBlochSequences.h>
+#include <animaSimuBlochSE.h>
+#include <animaSimuBlochGRE.h>
+#include <animaSimuBlochIR-SE.h>
+#include <animaSimuBlochIR-GRE.h>
+#include <animaSimuBlochSP-GRE.h>
+#include <animaSimuBlochCoherentGRE.h>
+
+typedef itk::Image <double, 3> ImageType;
+typedef itk::Image <double, 4> OutputImageType;
+typedef anima::SimuBlochSequences <ImageType, OutputImageType> SequencesFilterType;
+
+//! Random map, a few voxels being set to zero as outside of the brain
+ImageType::Pointer createMap(double minValue, double maxValue, std::mt19937 &generator)
+{
+    ImageType::RegionType region;
+    region.SetSize(0,7);
+    region.SetSize(1,5);
+    region.SetSize(2,4);
+
+    ImageType::SpacingType spacing;
+    spacing[0] = 0.9;
+    spacing[1] = 1.1;
+    spacing[2] = 2.5;
+
+    ImageType::Pointer map = ImageType::New();
+    map->SetRegions(region);
+    map->SetSpacing(spacing);
+    map->Allocate();
+
+    std::uniform_real_distribution <double> valueDistribution(minValue, maxValue);
+    std::uniform_real_distribution <double> zeroDistribution(0.0, 1.0);
+    itk::ImageRegionIterator <ImageType> mapItr(map, region);
+    while (!mapItr.IsAtEnd())
+    {
+        double value = valueDistribution(generator);
+        if (zeroDistribution(generator) < 0.05)
+            value = 0;
+
+        mapItr.Set(value);
+        ++mapItr;
+    }
+
+    return map;
+}
+
+//! Maximal difference between a simulated volume and a single sequence simulation, relative to the largest signal
+double compareVolume(OutputImageType *simulatedImage, unsigned int volume, ImageType *referenceImage)
+{
+    OutputImageType::RegionType volumeRegion = simulatedImage->GetLargestPossibleRegion();
+    volumeRegion.SetIndex(3,volume);
+    volumeRegion.SetSize(3,1);
+
+    itk::ImageRegionConstIterator <OutputImageType> simulatedItr(simulatedImage, volumeRegion);
+    itk::ImageRegionConstIterator <ImageType> referenceItr(referenceImage, referenceImage->GetLargestPossibleRegion());
+
+    double maxDifference = 0;
+    double maxSignal = 0;
+    while (!referenceItr.IsAtEnd())
+    {
+        maxDifference = std::max(maxDifference, std::abs(simulatedItr.Get() - referenceItr.Get()));
+        maxSignal = std::max(maxSignal, std::abs(referenceItr.Get()));
+
+        ++simulatedItr;
+        ++referenceItr;
+    }
+
+    return maxDifference / std::max(maxSignal, 1.0e-12);
+}
+
+int main()
+{
+    std::mt19937 generator(3);
+    ImageType::Pointer t1Map = createMap(300.0, 3000.0, generator);
+    ImageType::Pointer t2Map = createMap(40.0, 200.0, generator);
+    ImageType::Pointer t2sMap = createMap(20.0, 100.0, generator);
+    ImageType::Pointer m0Map = createMap(500.0, 1500.0, generator);
+    ImageType::Pointer b1Map = createMap(0.7, 1.3, generator);
+
+    SequencesFilterType::SequenceParameters sequences[6];
+    const double trValues[6] = {2000, 500, 6000, 3000, 20, 8};
+    const double teValues[6] = {80, 10, 90, 5, 4, 3};
+    const double tiValues[6] = {0, 0, 2200, 800, 0, 0};
+    const double faValues[6] = {0, 0, 0, 0, 18, 35};
+    for (unsigned int i = 0;i < 6;++i)
+    {
+        sequences[i].type = (SequencesFilterType::SequenceType)i;
+        sequences[i].tr = trValues[i];
+        sequences[i].te = teValues[i];
+        sequences[i].ti = tiValues[i];
+        sequences[i].fa = faValues[i];
+    }
+
+    // Single sequence simulations
+    std::vector <ImageType::Pointer> referenceImages(6);
+
+    typedef anima::SimuBlochSE <ImageType> SEFilterType;
+    SEFilterType::Pointer seFilter = SEFilterType::New();
+    seFilter->SetInputT1(t1Map);
+    seFilter->SetInputT2(t2Map);
+    seFilter->SetInputM0(m0Map);
+    seFilter->SetTR(trValues[0]);
+    seFilter->SetTE(teValues[0]);
+    seFilter->Update();
+    referenceImages[0] = seFilter->GetOutput();
+
+    typedef anima::SimuBlochGRE <ImageType> GREFilterType;
+    GREFilterType::Pointer greFilter = GREFilterType::New();
+    greFilter->SetInputT1(t1Map);
+    greFilter->SetInputT2s(t2sMap);
+    greFilter->SetInputM0(m0Map);
+    greFilter->SetTR(trValues[1]);
+    greFilter->SetTE(teValues[1]);
+    greFilter->Update();
+    referenceImages[1] = greFilter->GetOutput();
+
+    typedef anima::SimuBlochIRSE <ImageType> IRSEFilterType;
+    IRSEFilterType::Pointer irseFilter = IRSEFilterType::New();
+    irseFilter->SetInputT1(t1Map);
+    irseFilter->SetInputT2(t2Map);
+    irseFilter->SetInputM0(m0Map);
+    irseFilter->SetTR(trValues[2]);
+    irseFilter->SetTE(teValues[2]);
+    irseFilter->SetTI(tiValues[2]);
+    irseFilter->Update();
+    referenceImages[2] = irseFilter->GetOutput();
+
+    typedef anima::SimuBlochIRGRE <ImageType> IRGREFilterType;
+    IRGREFilterType::Pointer irgreFilter = IRGREFilterType::New();
+    irgreFilter->SetInputT1(t1Map);
+    irgreFilter->SetInputT2s(t2sMap);
+    irgreFilter->SetInputM0(m0Map);
+    irgreFilter->SetTR(trValues[3]);
+    irgreFilter->SetTE(teValues[3]);
+    irgreFilter->SetTI(tiValues[3]);
+    irgreFilter->Update();
+    referenceImages[3] = irgreFilter->GetOutput();
+
+    typedef anima::SimuBlochSPGRE <ImageType> SPGREFilterType;
+    SPGREFilterType::Pointer spgreFilter = SPGREFilterType::New();
+    spgreFilter->SetInputT1(t1Map);
+    spgreFilter->SetInputT2s(t2sMap);
+    spgreFilter->SetInputM0(m0Map);
+    spgreFilter->SetInputB1(b1Map);
+    spgreFilter->SetTR(trValues[4]);
+    spgreFilter->SetTE(teValues[4]);
+    spgreFilter->SetFA(faValues[4]);
+    spgreFilter->Update();
+    referenceImages[4] = spgreFilter->GetOutput();
+
+    typedef anima::SimuBlochCoherentGRE <ImageType> CoherentGREFilterType;
+    CoherentGREFilterType::Pointer coherentFilter = CoherentGREFilterType::New();
+    coherentFilter->SetInputT1(t1Map);
+    coherentFilter->SetInputT2s(t2sMap);
+    coherentFilter->SetInputM0(m0Map);
+    coherentFilter->SetInputT2(t2Map);
+    coherentFilter->SetTR(trValues[5]);
+    coherentFilter->SetTE(teValues[5]);
+    coherentFilter->SetFA(faValues[5]);
+    coherentFilter->Update();
+    referenceImages[5] = coherentFilter->GetOutput();
+
+    // All sequences at once, twice in shuffled order so that volumes do not follow sequence types
+    std::vector <unsigned int> sequenceOrder;
+    for (unsigned int k = 0;k < 2;++k)
+        for (unsigned int i = 0;i < 6;++i)
+            sequenceOrder.push_back(i);
+
+    std::shuffle(sequenceOrder.begin(),sequenceOrder.end(),generator);
+
+    SequencesFilterType::Pointer sequencesFilter = SequencesFilterType::New();
+    sequencesFilter->SetInputT1(t1Map);
+    sequencesFilter->SetInputM0(m0Map);
+    sequencesFilter->SetT2Map(t2Map);
+    sequencesFilter->SetT2sMap(t2sMap);
+    sequencesFilter->SetB1Map(b1Map);
+    for (unsigned int i = 0;i < sequenceOrder.size();++i)
+        sequencesFilter->AddSequence(sequences[sequenceOrder[i]]);
+
+    sequencesFilter->SetNumberOfWorkUnits(5);
+    sequencesFilter->Update();
+
+    OutputImageType *simulatedImage = sequencesFilter->GetOutput();
+
+    bool testPassed = true;
+    for (unsigned int i = 0;i < 3;++i)
+    {
+        if ((simulatedImage->GetLargestPossibleRegion().GetSize()[i] != t1Map->GetLargestPossibleRegion().GetSize()[i]) ||
+                (simulatedImage->GetSpacing()[i] != t1Map->GetSpacing()[i]))
+            testPassed = false;
+    }
+
+    if (simulatedImage->GetLargestPossibleRegion().GetSize()[3] != sequenceOrder.size())
+        testPassed = false;
+
+    if (!testPassed)
+        std::cerr << "Wrong output geometry" << std::endl;
+
+    const double tolerance = 1.0e-12;
+    for (unsigned int i = 0;i < sequenceOrder.size();++i)
+    {
+        double deviation = compareVolume(simulatedImage,i,referenceImages[sequenceOrder[i]]);
+        std::cout << "Volume " << i << " (sequence type " << sequenceOrder[i] << ") deviation " << deviation << std::endl;
+
+        if (deviation > tolerance)
+        {
+            std::cerr << "Volume " << i << " differs from the single sequence simulation" << std::endl;
+            testPassed = false;
+        }
+    }
+
+    if (!testPassed)
+        return EXIT_FAILURE;
+
+    return EXIT_SUCCESS;
+}
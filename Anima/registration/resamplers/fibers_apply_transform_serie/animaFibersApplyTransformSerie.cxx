@@ -2,8 +2,11 @@
 #include <animaTransformSeriesReader.h>
 #include <animaShapesReader.h>
 #include <animaShapesWriter.h>
+#include <animaBinaryTractogramReader.h>
+#include <animaBinaryTractogramWriter.h>
 
 #include <vtkPolyData.h>
+#include <algorithm>
 
 void ApplyTransformToTracks(vtkPoints *dataPoints, anima::TransformSeriesReader <double, 3>::OutputTransformType *transform)
 {
@@ -55,6 +58,31 @@ int main(int ac, const char** av)
     trsfReader.SetNumberOfWorkUnits(nbpArg.getValue());
     trsfReader.Update();
 
+    // Binary tractograms are streamed chunk by chunk
+    if (anima::BinaryTractogramReader::IsBinaryTractogramFile(inArg.getValue()) &&
+            anima::BinaryTractogramReader::IsBinaryTractogramFile(outArg.getValue()))
+    {
+        anima::BinaryTractogramReader binaryReader;
+        binaryReader.SetFileName(inArg.getValue());
+        binaryReader.Open();
+
+        anima::BinaryTractogramWriter binaryWriter;
+        binaryWriter.SetFileName(outArg.getValue());
+        std::cout << "Writing tracks: " << outArg.getValue() << std::endl;
+
+        // An input without chunks is read as one empty chunk so that the output file is still written
+        unsigned int numChunks = std::max(binaryReader.GetNumberOfChunks(),(unsigned int)1);
+        for (unsigned int i = 0;i < numChunks;++i)
+        {
+            vtkSmartPointer <vtkPolyData> tracks = binaryReader.ReadChunk(i);
+            ApplyTransformToTracks(tracks->GetPoints(), trsfReader.GetOutputTransform());
+            binaryWriter.WriteChunk(tracks);
+        }
+
+        binaryWriter.Close();
+        return EXIT_SUCCESS;
+    }
+
     anima::ShapesReader trackReader;
     trackReader.SetFileName(inArg.getValue());
     trackReader.Update();
@@ -74,13 +74,26 @@ private:
     void estimateSVFFromRigidTransforms();
     void estimateSVFFromAffineTransforms();
 
+    /**
+     * Extrapolates block transformations (as log-vectors with their weights) to a dense field.
+     * Outlier rejection is computed at block positions only, from a sparse truncated Gaussian
+     * smoothing among neighboring blocks. The dense field is then obtained from a single smoothing
+     * pass over an image holding both the weighted log-vectors and the weights.
+     */
     template <unsigned int NDegreesOfFreedom>
     void
-    filterInputs(WeightImageType *weights, typename itk::Image < itk::Vector <ScalarType, NDegreesOfFreedom>, NDimensions >::Pointer &output,
-                 std::vector < itk::Vector <ScalarType, NDegreesOfFreedom> > &curTrsfs,
-                 std::vector < typename itk::Image < itk::Vector <ScalarType, NDegreesOfFreedom>, NDimensions >::IndexType > &posIndexes);
-
-    double m_ZeroWeight;
+    filterInputs(std::vector <double> &weights, std::vector < itk::Vector <ScalarType, NDegreesOfFreedom> > &curTrsfs,
+                 typename itk::Image < itk::Vector <ScalarType, NDegreesOfFreedom>, NDimensions >::Pointer &output);
+
+    /**
+     * Computes at each block position the Gaussian weighted average of neighboring block transformations,
+     * neighbors being looked for in a bucket grid of cell size the Gaussian support (3 sigmas).
+     * Blocks are processed in parallel over m_NumberOfThreads work units
+     */
+    template <unsigned int NDegreesOfFreedom>
+    void
+    computeSparseSmoothedTransforms(std::vector <double> &weights, std::vector < itk::Vector <ScalarType, NDegreesOfFreedom> > &curTrsfs,
+                                    std::vector < itk::Vector <ScalarType, NDegreesOfFreedom> > &smoothedTrsfs);
 };
 
 } // end of namespace anima
@@ -8,6 +8,11 @@
 
 #include <animaMatrixLogExp.h>
 #include <itkTimeProbe.h>
+#include <itkMultiThreaderBase.h>
+#include <itkImageRegionConstIterator.h>
+
+#include <array>
+#include <map>
 
 namespace anima
 {
@@ -18,7 +23,6 @@ BalooSVFTransformAgregator() : Superclass()
 {
     m_ExtrapolationSigma = 4.0;
     m_OutlierRejectionSigma = 3.0;
-    m_ZeroWeight = 0.0;
 
     m_NumberOfThreads = itk::MultiThreaderBase::GetGlobalDefaultNumberOfThreads();
 }
@@ -71,37 +75,10 @@ BalooSVFTransformAgregator <NDimensions>::
 estimateSVFFromTranslations()
 {
     unsigned int nbPts = this->GetInputRegions().size();
-    VelocityFieldPointer velocityField = VelocityFieldType::New();
-    velocityField->Initialize();
-
-    velocityField->SetRegions (m_LargestRegion);
-    velocityField->SetSpacing (m_Spacing);
-    velocityField->SetOrigin (m_Origin);
-    velocityField->SetDirection (m_Direction);
-    velocityField->Allocate();
-
-    VelocityFieldPixelType zeroDisp;
-    zeroDisp.Fill(0);
-    itk::ImageRegionIterator < VelocityFieldType > svfIterator(velocityField,m_LargestRegion);
-    while (!svfIterator.IsAtEnd())
-    {
-        svfIterator.Set(zeroDisp);
-        ++svfIterator;
-    }
-
-    WeightImagePointer weights = WeightImageType::New();
-    weights->Initialize();
-
-    weights->SetRegions (m_LargestRegion);
-    weights->SetSpacing (m_Spacing);
-    weights->SetOrigin (m_Origin);
-    weights->SetDirection (m_Direction);
-    weights->Allocate();
-    weights->FillBuffer(m_ZeroWeight);
 
     ParametersType tmpParams(NDimensions);
     std::vector <VelocityFieldPixelType> curDisps(nbPts);
-    std::vector <VelocityFieldIndexType> posIndexes(nbPts);
+    std::vector <double> weights(nbPts);
 
     for (unsigned int i = 0;i < nbPts;++i)
     {
@@ -114,17 +91,14 @@ estimateSVFFromTranslations()
                 tmpParams[j] = tmpTr->GetOffset()[j];
         }
 
-        double tmpWeight = this->GetInputWeight(i);
-        weights->TransformPhysicalPointToIndex(this->GetInputOrigin(i),posIndexes[i]);
+        weights[i] = this->GetInputWeight(i);
 
         for (unsigned int j = 0;j < NDimensions;++j)
             curDisps[i][j] = tmpParams[j];
-
-        velocityField->SetPixel(posIndexes[i],curDisps[i] * tmpWeight);
-        weights->SetPixel(posIndexes[i],tmpWeight);
     }
 
-    this->filterInputs<NDimensions>(weights,velocityField,curDisps,posIndexes);
+    VelocityFieldPointer velocityField;
+    this->filterInputs<NDimensions>(weights,curDisps,velocityField);
 
     // Create the final transform
     typename BaseOutputTransformType::Pointer resultTransform = BaseOutputTransformType::New();
@@ -145,56 +119,27 @@ estimateSVFFromRigidTransforms()
     typedef itk::Vector <ScalarType, NDegreesFreedom> RigidVectorType;
 
     unsigned int nbPts = this->GetInputRegions().size();
-    RigidFieldPointer rigidField = RigidFieldType::New();
-    rigidField->Initialize();
-
-    rigidField->SetRegions (m_LargestRegion);
-    rigidField->SetSpacing (m_Spacing);
-    rigidField->SetOrigin (m_Origin);
-    rigidField->SetDirection (m_Direction);
-    rigidField->Allocate();
-
-    RigidVectorType zeroDisp;
-    zeroDisp.Fill(0);
-    itk::ImageRegionIterator < RigidFieldType > rigidIterator(rigidField,m_LargestRegion);
-    while (!rigidIterator.IsAtEnd())
-    {
-        rigidIterator.Set(zeroDisp);
-        ++rigidIterator;
-    }
-
-    WeightImagePointer weights = WeightImageType::New();
-    weights->Initialize();
-
-    weights->SetRegions (m_LargestRegion);
-    weights->SetSpacing (m_Spacing);
-    weights->SetOrigin (m_Origin);
-    weights->SetDirection (m_Direction);
-    weights->Allocate();
-    weights->FillBuffer(m_ZeroWeight);
 
     RigidVectorType curLog;
 
     vnl_matrix <InternalScalarType> tmpMatrix(NDimensions+1,NDimensions+1,0);
     tmpMatrix(NDimensions,NDimensions) = 1;
     std::vector < RigidVectorType > logVectors(nbPts);
-    std::vector <VelocityFieldIndexType> posIndexes(nbPts);
+    std::vector <double> weights(nbPts);
     VelocityFieldPointType curPoint;
 
     typedef anima::LogRigid3DTransform <InternalScalarType> LogRigidTransformType;
 
     for (unsigned int i = 0;i < nbPts;++i)
     {
-        double tmpWeight = this->GetInputWeight(i);
-        weights->TransformPhysicalPointToIndex(this->GetInputOrigin(i),posIndexes[i]);
+        weights[i] = this->GetInputWeight(i);
 
         LogRigidTransformType *tmpTrsf = (LogRigidTransformType *)this->GetInputTransform(i);
         logVectors[i] = tmpTrsf->GetLogVector();
-        rigidField->SetPixel(posIndexes[i],logVectors[i] * tmpWeight);
-        weights->SetPixel(posIndexes[i],tmpWeight);
     }
 
-    this->filterInputs<NDegreesFreedom>(weights,rigidField,logVectors,posIndexes);
+    RigidFieldPointer rigidField;
+    this->filterInputs<NDegreesFreedom>(weights,logVectors,rigidField);
 
     VelocityFieldPointer velocityField = VelocityFieldType::New();
     velocityField->Initialize();
@@ -210,7 +155,7 @@ estimateSVFFromRigidTransforms()
     VelocityFieldIndexType curIndex;
     VelocityFieldPixelType curDisp;
 
-    rigidIterator = itk::ImageRegionIterator < RigidFieldType > (rigidField,m_LargestRegion);
+    itk::ImageRegionIterator < RigidFieldType > rigidIterator(rigidField,m_LargestRegion);
     while (!svfIterator.IsAtEnd())
     {
         curLog = rigidIterator.Get();
@@ -264,33 +209,6 @@ estimateSVFFromAffineTransforms()
     typedef itk::Vector <ScalarType, NDegreesFreedom> AffineVectorType;
 
     unsigned int nbPts = this->GetInputRegions().size();
-    AffineFieldPointer affineField = AffineFieldType::New();
-    affineField->Initialize();
-
-    affineField->SetRegions (m_LargestRegion);
-    affineField->SetSpacing (m_Spacing);
-    affineField->SetOrigin (m_Origin);
-    affineField->SetDirection (m_Direction);
-    affineField->Allocate();
-
-    AffineVectorType zeroDisp;
-    zeroDisp.Fill(0);
-    itk::ImageRegionIterator < AffineFieldType > affineIterator(affineField,m_LargestRegion);
-    while (!affineIterator.IsAtEnd())
-    {
-        affineIterator.Set(zeroDisp);
-        ++affineIterator;
-    }
-
-    WeightImagePointer weights = WeightImageType::New();
-    weights->Initialize();
-
-    weights->SetRegions (m_LargestRegion);
-    weights->SetSpacing (m_Spacing);
-    weights->SetOrigin (m_Origin);
-    weights->SetDirection (m_Direction);
-    weights->Allocate();
-    weights->FillBuffer(m_ZeroWeight);
 
     AffineVectorType curLog;
     VelocityFieldPointType curPoint;
@@ -298,7 +216,7 @@ estimateSVFFromAffineTransforms()
     vnl_matrix <InternalScalarType> tmpMatrix(NDimensions+1,NDimensions+1,0);
     tmpMatrix(NDimensions,NDimensions) = 1;
     std::vector < AffineVectorType > logVectors(nbPts);
-    std::vector < VelocityFieldIndexType > posIndexes(nbPts);
+    std::vector <double> weights(nbPts);
 
     if (dynamic_cast <anima::DirectionScaleSkewTransform <InternalScalarType> *> (this->GetInputTransform(0)) == 0)
     {
@@ -327,20 +245,17 @@ estimateSVFFromAffineTransforms()
 
     for (unsigned int i = 0;i < nbPts;++i)
     {
-        double tmpWeight = this->GetInputWeight(i);
-        weights->TransformPhysicalPointToIndex(this->GetInputOrigin(i),posIndexes[i]);
+        weights[i] = this->GetInputWeight(i);
 
         if (std::isnan(logVectors[i][0]))
         {
             logVectors[i].Fill(0);
-            tmpWeight = 0;
+            weights[i] = 0;
         }
-
-        affineField->SetPixel(posIndexes[i],logVectors[i] * tmpWeight);
-        weights->SetPixel(posIndexes[i],tmpWeight);
     }
 
-    this->filterInputs<NDegreesFreedom>(weights,affineField,logVectors,posIndexes);
+    AffineFieldPointer affineField;
+    this->filterInputs<NDegreesFreedom>(weights,logVectors,affineField);
 
     VelocityFieldPointer velocityField = VelocityFieldType::New();
     velocityField->Initialize();
@@ -356,7 +271,7 @@ estimateSVFFromAffineTransforms()
     VelocityFieldIndexType curIndex;
     VelocityFieldPixelType curDisp;
 
-    affineIterator = itk::ImageRegionIterator < AffineFieldType > (affineField,m_LargestRegion);
+    itk::ImageRegionIterator < AffineFieldType > affineIterator(affineField,m_LargestRegion);
     while (!svfIterator.IsAtEnd())
     {
         curLog = affineIterator.Get();
@@ -396,102 +311,211 @@ template <unsigned int NDimensions>
 template <unsigned int NDegreesOfFreedom>
 void
 BalooSVFTransformAgregator <NDimensions>::
-filterInputs(WeightImageType *weights, typename itk::Image < itk::Vector <ScalarType, NDegreesOfFreedom>, NDimensions >::Pointer &output,
-             std::vector < itk::Vector <ScalarType, NDegreesOfFreedom> > &curTrsfs,
-             std::vector < typename itk::Image < itk::Vector <ScalarType, NDegreesOfFreedom>, NDimensions >::IndexType > &posIndexes)
+computeSparseSmoothedTransforms(std::vector <double> &weights, std::vector < itk::Vector <ScalarType, NDegreesOfFreedom> > &curTrsfs,
+                                std::vector < itk::Vector <ScalarType, NDegreesOfFreedom> > &smoothedTrsfs)
 {
-    typedef itk::Image < itk::Vector <ScalarType, NDegreesOfFreedom>, NDimensions > FieldType;
     typedef itk::Vector <ScalarType, NDegreesOfFreedom> FieldPixelType;
+    typedef std::array <int, NDimensions> CellKeyType;
 
-    typedef itk::Image <ScalarType,NDimensions> WeightImageType;
+    unsigned int nbPts = curTrsfs.size();
+    smoothedTrsfs.resize(nbPts);
 
-    FieldPixelType zeroTrsf;
-    zeroTrsf.Fill(0);
+    double supportRadius = 3.0 * m_ExtrapolationSigma;
+    double squaredSupportRadius = supportRadius * supportRadius;
+    double gaussianFactor = 1.0 / (2.0 * m_ExtrapolationSigma * m_ExtrapolationSigma);
 
-    typedef anima::SmoothingRecursiveYvvGaussianImageFilter<WeightImageType,WeightImageType> WeightSmootherType;
-    typename WeightSmootherType::Pointer weightSmooth = WeightSmootherType::New();
+    // Bucket block positions, only neighboring cells are then explored for each block
+    std::vector <PointType> blockPositions(nbPts);
+    std::vector <CellKeyType> blockCells(nbPts);
+    std::map < CellKeyType, std::vector <unsigned int> > cellsMap;
 
-    weightSmooth->SetInput(weights);
-    weightSmooth->SetSigma(m_ExtrapolationSigma);
-    weightSmooth->SetNumberOfWorkUnits(m_NumberOfThreads);
+    for (unsigned int i = 0;i < nbPts;++i)
+    {
+        blockPositions[i] = this->GetInputOrigin(i);
+        for (unsigned int j = 0;j < NDimensions;++j)
+            blockCells[i][j] = static_cast <int> (std::floor(blockPositions[i][j] / supportRadius));
 
-    weightSmooth->Update();
+        cellsMap[blockCells[i]].push_back(i);
+    }
 
-    typename WeightImageType::Pointer smoothedWeights = weightSmooth->GetOutput();
-    smoothedWeights->DisconnectPipeline();
-    weightSmooth = 0;
+    unsigned int numNeighborCells = 1;
+    for (unsigned int j = 0;j < NDimensions;++j)
+        numNeighborCells *= 3;
 
-    typedef anima::SmoothingRecursiveYvvGaussianImageFilter <FieldType, FieldType> SVFSmoothingFilterType;
-    typename SVFSmoothingFilterType::Pointer smootherPtr = SVFSmoothingFilterType::New();
+    // Each block only writes its own smoothed transformation, blocks are therefore processed in parallel
+    itk::MultiThreaderBase::Pointer threader = itk::MultiThreaderBase::New();
+    threader->SetNumberOfWorkUnits(m_NumberOfThreads);
+    threader->ParallelizeArray(0, nbPts, [&](itk::SizeValueType i)
+    {
+        FieldPixelType curTrsf;
+        CellKeyType neighborCell;
+        curTrsf.Fill(0);
+        double sumWeights = 0;
 
-    smootherPtr->SetInput(output);
-    smootherPtr->SetSigma(m_ExtrapolationSigma);
-    smootherPtr->SetNumberOfWorkUnits(m_NumberOfThreads);
+        for (unsigned int k = 0;k < numNeighborCells;++k)
+        {
+            unsigned int cellCode = k;
+            for (unsigned int j = 0;j < NDimensions;++j)
+            {
+                neighborCell[j] = blockCells[i][j] + (int)(cellCode % 3) - 1;
+                cellCode /= 3;
+            }
 
-    smootherPtr->Update();
+            auto cellIterator = cellsMap.find(neighborCell);
+            if (cellIterator == cellsMap.end())
+                continue;
 
-    typename FieldType::Pointer smoothedField = smootherPtr->GetOutput();
-    smoothedField->DisconnectPipeline();
-    smootherPtr = 0;
+            const std::vector <unsigned int> &cellBlocks = cellIterator->second;
+            for (unsigned int l = 0;l < cellBlocks.size();++l)
+            {
+                unsigned int neighborIndex = cellBlocks[l];
+                if (weights[neighborIndex] <= 0)
+                    continue;
+
+                double squaredDist = 0;
+                for (unsigned int j = 0;j < NDimensions;++j)
+                {
+                    double diffValue = blockPositions[i][j] - blockPositions[neighborIndex][j];
+                    squaredDist += diffValue * diffValue;
+                }
+
+                if (squaredDist > squaredSupportRadius)
+                    continue;
+
+                double kernelWeight = weights[neighborIndex] * std::exp(- squaredDist * gaussianFactor);
+                curTrsf += curTrsfs[neighborIndex] * kernelWeight;
+                sumWeights += kernelWeight;
+            }
+        }
 
-    // Now reweight outlier with Welsch function
-    FieldPixelType curTrsf;
+        if (sumWeights > 0)
+            curTrsf /= sumWeights;
 
-    unsigned int nbPts = this->GetInputRegions().size();
+        smoothedTrsfs[i] = curTrsf;
+    }, nullptr);
+}
+
+template <unsigned int NDimensions>
+template <unsigned int NDegreesOfFreedom>
+void
+BalooSVFTransformAgregator <NDimensions>::
+filterInputs(std::vector <double> &weights, std::vector < itk::Vector <ScalarType, NDegreesOfFreedom> > &curTrsfs,
+             typename itk::Image < itk::Vector <ScalarType, NDegreesOfFreedom>, NDimensions >::Pointer &output)
+{
+    typedef itk::Image < itk::Vector <ScalarType, NDegreesOfFreedom>, NDimensions > FieldType;
+    typedef itk::Vector <ScalarType, NDegreesOfFreedom> FieldPixelType;
+
+    // Weighted transformations and weights are smoothed together, weight being the last component
+    typedef itk::Vector <ScalarType, NDegreesOfFreedom + 1> AugmentedPixelType;
+    typedef itk::Image <AugmentedPixelType, NDimensions> AugmentedFieldType;
+
+    // Now reweight outlier with Welsch function, smoothed transformations being needed only at block positions
+    std::vector <FieldPixelType> smoothedTrsfs;
+    this->computeSparseSmoothedTransforms<NDegreesOfFreedom>(weights,curTrsfs,smoothedTrsfs);
+
+    unsigned int nbPts = curTrsfs.size();
     std::vector < double > residuals(nbPts);
     double averageResidual = 0;
     for (unsigned int i = 0;i < nbPts;++i)
     {
-        double weightSmoothed = smoothedWeights->GetPixel(posIndexes[i]);
-        if (weightSmoothed > 0)
-        {
-            curTrsf = smoothedField->GetPixel(posIndexes[i]);
-            curTrsf /= weightSmoothed;
-        }
-        else
-            curTrsf = zeroTrsf;
-
         double residual = 0;
 
         for (unsigned int j = 0;j < NDegreesOfFreedom;++j)
-            residual += (curTrsf[j] - curTrsfs[i][j]) * (curTrsf[j] - curTrsfs[i][j]);
+            residual += (smoothedTrsfs[i][j] - curTrsfs[i][j]) * (smoothedTrsfs[i][j] - curTrsfs[i][j]);
 
         averageResidual += residual;
         residuals[i] = residual;
     }
 
-    smoothedField = 0;
-    smoothedWeights = 0;
-
     averageResidual /= nbPts;
 
-    for (unsigned int i = 0;i < nbPts;++i)
+    if (averageResidual > 0)
     {
-        double newWeight = weights->GetPixel(posIndexes[i]) * std::exp(- residuals[i] / (averageResidual * m_OutlierRejectionSigma));
-        weights->SetPixel(posIndexes[i],newWeight);
+        for (unsigned int i = 0;i < nbPts;++i)
+            weights[i] *= std::exp(- residuals[i] / (averageResidual * m_OutlierRejectionSigma));
     }
 
-    weightSmooth = WeightSmootherType::New();
+    // Splat weighted block transformations and weights into a single image
+    typename AugmentedFieldType::Pointer augmentedField = AugmentedFieldType::New();
+    augmentedField->Initialize();
+
+    augmentedField->SetRegions (m_LargestRegion);
+    augmentedField->SetSpacing (m_Spacing);
+    augmentedField->SetOrigin (m_Origin);
+    augmentedField->SetDirection (m_Direction);
+    augmentedField->Allocate();
 
-    weightSmooth->SetInput(weights);
-    weightSmooth->SetSigma(m_ExtrapolationSigma);
-    weightSmooth->SetNumberOfWorkUnits(m_NumberOfThreads);
+    AugmentedPixelType augmentedValue;
+    augmentedValue.Fill(0);
+    augmentedField->FillBuffer(augmentedValue);
+
+    typename AugmentedFieldType::IndexType posIndex;
+    for (unsigned int i = 0;i < nbPts;++i)
+    {
+        augmentedField->TransformPhysicalPointToIndex(this->GetInputOrigin(i),posIndex);
+        if (!m_LargestRegion.IsInside(posIndex))
+            continue;
 
-    weightSmooth->Update();
+        augmentedValue = augmentedField->GetPixel(posIndex);
+        for (unsigned int j = 0;j < NDegreesOfFreedom;++j)
+            augmentedValue[j] += curTrsfs[i][j] * weights[i];
 
-    smoothedWeights = weightSmooth->GetOutput();
-    smoothedWeights->DisconnectPipeline();
+        augmentedValue[NDegreesOfFreedom] += weights[i];
+        augmentedField->SetPixel(posIndex,augmentedValue);
+    }
 
-    smootherPtr = SVFSmoothingFilterType::New();
+    typedef anima::SmoothingRecursiveYvvGaussianImageFilter <AugmentedFieldType, AugmentedFieldType> SmoothingFilterType;
+    typename SmoothingFilterType::Pointer smootherPtr = SmoothingFilterType::New();
 
-    smootherPtr->SetInput(output);
+    smootherPtr->SetInput(augmentedField);
     smootherPtr->SetSigma(m_ExtrapolationSigma);
     smootherPtr->SetNumberOfWorkUnits(m_NumberOfThreads);
 
     smootherPtr->Update();
 
-    output = smootherPtr->GetOutput();
-    output->DisconnectPipeline();
+    augmentedField = smootherPtr->GetOutput();
+    augmentedField->DisconnectPipeline();
+    smootherPtr = 0;
+
+    // Split back smoothed field and weights
+    output = FieldType::New();
+    output->Initialize();
+
+    output->SetRegions (m_LargestRegion);
+    output->SetSpacing (m_Spacing);
+    output->SetOrigin (m_Origin);
+    output->SetDirection (m_Direction);
+    output->Allocate();
+
+    WeightImagePointer smoothedWeights = WeightImageType::New();
+    smoothedWeights->Initialize();
+
+    smoothedWeights->SetRegions (m_LargestRegion);
+    smoothedWeights->SetSpacing (m_Spacing);
+    smoothedWeights->SetOrigin (m_Origin);
+    smoothedWeights->SetDirection (m_Direction);
+    smoothedWeights->Allocate();
+
+    itk::ImageRegionConstIterator <AugmentedFieldType> augmentedIterator(augmentedField,m_LargestRegion);
+    itk::ImageRegionIterator <FieldType> outputIterator(output,m_LargestRegion);
+    itk::ImageRegionIterator <WeightImageType> weightIterator(smoothedWeights,m_LargestRegion);
+    FieldPixelType curTrsf;
+
+    while (!outputIterator.IsAtEnd())
+    {
+        augmentedValue = augmentedIterator.Get();
+        for (unsigned int j = 0;j < NDegreesOfFreedom;++j)
+            curTrsf[j] = augmentedValue[j];
+
+        outputIterator.Set(curTrsf);
+        weightIterator.Set(augmentedValue[NDegreesOfFreedom]);
+
+        ++augmentedIterator;
+        ++outputIterator;
+        ++weightIterator;
+    }
+
+    augmentedField = 0;
 
     typedef anima::BalooExternalExtrapolateImageFilter <ScalarType, NDegreesOfFreedom, NDimensions> ExtrapolateFilterType;
     typename ExtrapolateFilterType::Pointer extrapolateFilter = ExtrapolateFilterType::New();
@@ -73,8 +73,17 @@ private:
     unsigned int m_MaxNumIterations;
     double m_ConvergenceThreshold;
 
-    std::vector <double> m_InternalSpatialKernelWeights;
-    std::vector <InputIndexType> m_InternalSpatialKernelIndexes;
+    //! Compact storage of block samples (voxels with a positive weight), in image memory order
+    std::vector <double> m_BlockWeights;
+    std::vector <double> m_BlockLogVectors;
+
+    //! Row-wise index of block samples: blocks of row r are in [m_RowStarts[r], m_RowStarts[r+1]), sorted along the first dimension
+    std::vector <unsigned int> m_RowStarts;
+    std::vector <int> m_RowBlockPositions;
+
+    //! Spatial kernel stored row by row: offsets along dimensions 1 to N-1, dense weights along the first dimension
+    std::vector < std::vector <int> > m_KernelRowOffsets;
+    std::vector < std::vector <double> > m_KernelRowWeights;
 
     //Internal parameter
     double m_AverageResidualValue;
@@ -2,11 +2,13 @@
 #include "animaMEstimateSVFImageFilter.h"
 
 #include <itkImageRegionIteratorWithIndex.h>
-#include <itkImageRegionConstIteratorWithIndex.h>
-#include <itkThresholdLabelerImageFilter.h>
+#include <itkImageRegionConstIterator.h>
+#include <itkImageRegionIterator.h>
 
 #include <animaSmoothingRecursiveYvvGaussianImageFilter.h>
 
+#include <algorithm>
+
 namespace anima
 {
 
@@ -19,80 +21,119 @@ BeforeThreadedGenerateData ()
     if (nbInputs != 1)
         itkExceptionMacro("Error: There should be one input...");
 
-    typedef itk::ImageRegionIterator <WeightImageType> WeightIteratorType;
-    typedef itk::ThresholdLabelerImageFilter <WeightImageType, WeightImageType> ThresholdFilterType;
-
-    typename ThresholdFilterType::Pointer thrFilter = ThresholdFilterType::New();
-    thrFilter->SetInput(m_WeightImage);
-    typename ThresholdFilterType::RealThresholdVector thr(1);
-    thr[0] = 0.0;
-    thrFilter->SetRealThresholds(thr);
-    thrFilter->SetNumberOfWorkUnits(this->GetNumberOfWorkUnits());
-    thrFilter->Update();
+    // Log-vectors and block indicator are smoothed at once, the indicator being the last component
+    typedef itk::Vector <TScalarType, NDegreesOfFreedom + 1> AugmentedPixelType;
+    typedef itk::Image <AugmentedPixelType, NDimensions> AugmentedImageType;
+    typedef typename AugmentedImageType::Pointer AugmentedImagePointer;
+
+    OutputImageRegionType largestRegion = this->GetInput()->GetLargestPossibleRegion();
+
+    AugmentedImagePointer augmentedImage = AugmentedImageType::New();
+    augmentedImage->Initialize();
+    augmentedImage->SetRegions (largestRegion);
+    augmentedImage->SetSpacing (this->GetInput()->GetSpacing());
+    augmentedImage->SetOrigin (this->GetInput()->GetOrigin());
+    augmentedImage->SetDirection (this->GetInput()->GetDirection());
+    augmentedImage->Allocate();
+
+    // Gather at the same time block samples in a compact row-wise structure
+    unsigned int rowSize = largestRegion.GetSize()[0];
+    unsigned int numRows = largestRegion.GetNumberOfPixels() / rowSize;
+    m_RowStarts.assign(numRows + 1,0);
+    m_RowBlockPositions.clear();
+    m_BlockWeights.clear();
+    m_BlockLogVectors.clear();
+
+    typedef itk::ImageRegionConstIterator <TInputImage> InputIteratorType;
+    typedef itk::ImageRegionConstIterator <WeightImageType> WeightIteratorType;
+    typedef itk::ImageRegionIterator <AugmentedImageType> AugmentedIteratorType;
+
+    InputIteratorType inputItr(this->GetInput(),largestRegion);
+    WeightIteratorType weightItr(m_WeightImage,largestRegion);
+    AugmentedIteratorType augmentedItr(augmentedImage,largestRegion);
+
+    InputPixelType inputValue;
+    AugmentedPixelType augmentedValue;
+    unsigned int linearPosition = 0;
+    while (!inputItr.IsAtEnd())
+    {
+        inputValue = inputItr.Get();
+        double weight = weightItr.Get();
 
-    WeightImagePointer tmpWeights = thrFilter->GetOutput();
-    tmpWeights->DisconnectPipeline();
+        for (unsigned int i = 0;i < NDegreesOfFreedom;++i)
+            augmentedValue[i] = inputValue[i];
 
-    typedef anima::SmoothingRecursiveYvvGaussianImageFilter<WeightImageType,WeightImageType> WeightSmootherType;
-    typename WeightSmootherType::Pointer weightSmooth = WeightSmootherType::New();
+        augmentedValue[NDegreesOfFreedom] = (weight > 0.0);
+        augmentedItr.Set(augmentedValue);
 
-    weightSmooth->SetInput(tmpWeights);
-    weightSmooth->SetSigma(m_FluidSigma);
-    weightSmooth->SetNumberOfWorkUnits(this->GetNumberOfWorkUnits());
+        if (weight > 0.0)
+        {
+            ++m_RowStarts[linearPosition / rowSize + 1];
+            m_RowBlockPositions.push_back(linearPosition % rowSize);
+            m_BlockWeights.push_back(weight);
+            for (unsigned int i = 0;i < NDegreesOfFreedom;++i)
+                m_BlockLogVectors.push_back(inputValue[i]);
+        }
 
-    weightSmooth->Update();
+        ++linearPosition;
+        ++inputItr;
+        ++weightItr;
+        ++augmentedItr;
+    }
 
-    typedef anima::SmoothingRecursiveYvvGaussianImageFilter<TInputImage,TInputImage> FieldSmootherType;
-    typename FieldSmootherType::Pointer fieldSmooth = FieldSmootherType::New();
+    for (unsigned int i = 0;i < numRows;++i)
+        m_RowStarts[i + 1] += m_RowStarts[i];
 
-    fieldSmooth->SetInput(this->GetInput());
-    fieldSmooth->SetSigma(m_FluidSigma);
-    fieldSmooth->SetNumberOfWorkUnits(this->GetNumberOfWorkUnits());
+    typedef anima::SmoothingRecursiveYvvGaussianImageFilter<AugmentedImageType,AugmentedImageType> AugmentedSmootherType;
+    typename AugmentedSmootherType::Pointer augmentedSmooth = AugmentedSmootherType::New();
 
-    fieldSmooth->Update();
+    augmentedSmooth->SetInput(augmentedImage);
+    augmentedSmooth->SetSigma(m_FluidSigma);
+    augmentedSmooth->SetNumberOfWorkUnits(this->GetNumberOfWorkUnits());
 
-    InputImagePointer smoothSVFImage = fieldSmooth->GetOutput();
-    smoothSVFImage->DisconnectPipeline();
+    augmentedSmooth->Update();
 
-    WeightImagePointer smoothWeightImage = weightSmooth->GetOutput();
+    augmentedImage = augmentedSmooth->GetOutput();
+    augmentedImage->DisconnectPipeline();
+    augmentedSmooth = 0;
 
-    OutputPixelType curDisp;
-    OutputPixelType originDisp;
     double averageDist = 0;
     unsigned int numPairings = 0;
-    InputIndexType tmpIndex;
 
-    typedef itk::ImageRegionIterator <WeightImageType> WeightIteratorWithIndexType;
-    WeightIteratorWithIndexType tmpWeightIteratorWithIndex(tmpWeights,tmpWeights->GetLargestPossibleRegion());
+    typedef itk::ImageRegionConstIterator <AugmentedImageType> AugmentedConstIteratorType;
+    AugmentedConstIteratorType smoothItr(augmentedImage,largestRegion);
+    inputItr.GoToBegin();
+    weightItr.GoToBegin();
 
-    while (!tmpWeightIteratorWithIndex.IsAtEnd())
+    while (!weightItr.IsAtEnd())
     {
-        if (tmpWeightIteratorWithIndex.Value() <= 0)
+        if (weightItr.Get() > 0)
         {
-            ++tmpWeightIteratorWithIndex;
-            continue;
-        }
-
-        tmpIndex = tmpWeightIteratorWithIndex.GetIndex();
-        curDisp = smoothSVFImage->GetPixel(tmpIndex);
-        curDisp /= smoothWeightImage->GetPixel(tmpIndex);
+            augmentedValue = smoothItr.Get();
+            inputValue = inputItr.Get();
 
-        originDisp = this->GetInput()->GetPixel(tmpIndex);
-
-        double dist = 0;
-        for (unsigned int i = 0;i < NDegreesOfFreedom;++i)
-            dist += (curDisp[i] - originDisp[i]) * (curDisp[i] - originDisp[i]);
+            double dist = 0;
+            for (unsigned int i = 0;i < NDegreesOfFreedom;++i)
+            {
+                double diffValue = augmentedValue[i] / augmentedValue[NDegreesOfFreedom] - inputValue[i];
+                dist += diffValue * diffValue;
+            }
 
-        averageDist += std::sqrt(dist);
+            averageDist += std::sqrt(dist);
+            ++numPairings;
+        }
 
-        ++numPairings;
-        ++tmpWeightIteratorWithIndex;
+        ++smoothItr;
+        ++inputItr;
+        ++weightItr;
     }
 
+    augmentedImage = 0;
+
     m_AverageResidualValue = averageDist / numPairings;
     m_AverageResidualValue *= m_AverageResidualValue;
 
-    // Now compute image of spatial weights
+    // Now compute spatial weights, stored row by row
     OutputImageRegionType tmpRegion;
     InputIndexType centerIndex, curIndex;
     InputPointType curPosition, centerPosition;
@@ -115,17 +156,32 @@ BeforeThreadedGenerateData ()
     internalSpatialWeight->SetDirection (this->GetInput()->GetDirection());
     internalSpatialWeight->Allocate();
 
+    typedef itk::ImageRegionIteratorWithIndex <WeightImageType> WeightIteratorWithIndexType;
     WeightIteratorWithIndexType spatialWeightItr(internalSpatialWeight,tmpRegion);
     internalSpatialWeight->TransformIndexToPhysicalPoint(centerIndex,centerPosition);
 
-    m_InternalSpatialKernelWeights.clear();
-    m_InternalSpatialKernelIndexes.clear();
+    m_KernelRowOffsets.clear();
+    m_KernelRowWeights.clear();
+
+    unsigned int kernelRowSize = tmpRegion.GetSize()[0];
+    std::vector <int> rowOffsets(NDimensions - 1);
+    std::vector <double> rowWeights(kernelRowSize);
+    bool nonZeroRow = false;
 
     while (!spatialWeightItr.IsAtEnd())
     {
         curIndex = spatialWeightItr.GetIndex();
         internalSpatialWeight->TransformIndexToPhysicalPoint(curIndex,curPosition);
 
+        if (curIndex[0] == 0)
+        {
+            for (unsigned int i = 1;i < NDimensions;++i)
+                rowOffsets[i - 1] = curIndex[i] - m_NeighborhoodHalfSizes[i];
+
+            std::fill(rowWeights.begin(),rowWeights.end(),0.0);
+            nonZeroRow = false;
+        }
+
         double centerDist = 0;
         for (unsigned int i = 0;i < NDimensions;++i)
             centerDist += (centerPosition[i] - curPosition[i]) * (centerPosition[i] - curPosition[i]);
@@ -134,8 +190,14 @@ BeforeThreadedGenerateData ()
 
         if (weightFunctionValue > 0.01)
         {
-            m_InternalSpatialKernelWeights.push_back(weightFunctionValue);
-            m_InternalSpatialKernelIndexes.push_back(curIndex);
+            rowWeights[curIndex[0]] = weightFunctionValue;
+            nonZeroRow = true;
+        }
+
+        if ((curIndex[0] == kernelRowSize - 1) && nonZeroRow)
+        {
+            m_KernelRowOffsets.push_back(rowOffsets);
+            m_KernelRowWeights.push_back(rowWeights);
         }
 
         ++spatialWeightItr;
@@ -150,61 +212,74 @@ DynamicThreadedGenerateData (const OutputImageRegionType &outputRegionForThread)
     typedef itk::ImageRegionIteratorWithIndex <TOutputImage> OutRegionIteratorType;
     OutRegionIteratorType outIterator(this->GetOutput(), outputRegionForThread);
 
-    unsigned int numMaxEltsRegion = m_InternalSpatialKernelIndexes.size();
-
-    std::vector <double> weightsVector(numMaxEltsRegion);
-    std::vector <double> deltaVector(numMaxEltsRegion);
-    std::vector <InputPixelType> logTrsfsVector(numMaxEltsRegion);
+    // Neighbors are gathered contiguously so that the reweighting loop runs on packed data
+    std::vector <double> weightsVector;
+    std::vector <double> deltaVector;
+    std::vector <double> logTrsfsVector;
 
     InputIndexType centerIndex;
 
     OutputImageRegionType largestRegion = this->GetOutput()->GetLargestPossibleRegion();
-    std::vector <unsigned int> largestBound(NDimensions,0);
-    for (unsigned int i = 0;i < NDimensions;++i)
-        largestBound[i] = largestRegion.GetIndex()[i] + largestRegion.GetSize()[i] - 1;
+    const int halfSizeX = m_NeighborhoodHalfSizes[0];
 
-    InputIndexType inputIndex;
     OutputPixelType outValue, outValueOld;
-    unsigned int numKernelWeights = m_InternalSpatialKernelWeights.size();
+    unsigned int numKernelRows = m_KernelRowOffsets.size();
 
     while (!outIterator.IsAtEnd())
     {
         outValue.Fill(0);
         centerIndex = outIterator.GetIndex();
 
+        weightsVector.clear();
+        logTrsfsVector.clear();
         double sumAbsoluteWeights = 0;
-        unsigned int pos = 0;
 
-        for (unsigned int i = 0;i < numKernelWeights;++i)
+        int minX = centerIndex[0] - largestRegion.GetIndex()[0] - halfSizeX;
+        int maxX = minX + 2 * halfSizeX;
+
+        for (unsigned int i = 0;i < numKernelRows;++i)
         {
             bool indexOk = true;
-            for (unsigned int j = 0;j < NDimensions;++j)
+            unsigned int rowIndex = 0;
+            unsigned int rowStride = 1;
+            for (unsigned int j = 1;j < NDimensions;++j)
             {
-                int testIndex = m_InternalSpatialKernelIndexes[i][j] + centerIndex[j] - m_NeighborhoodHalfSizes[j];
-                if ((testIndex < 0)||(testIndex > largestBound[j]))
+                int testIndex = centerIndex[j] - largestRegion.GetIndex()[j] + m_KernelRowOffsets[i][j - 1];
+                if ((testIndex < 0)||(testIndex >= (int)largestRegion.GetSize()[j]))
                 {
                     indexOk = false;
                     break;
                 }
 
-                inputIndex[j] = testIndex;
+                rowIndex += testIndex * rowStride;
+                rowStride *= largestRegion.GetSize()[j];
             }
 
-            double weight = 0.0;
-            if (indexOk)
-                weight = m_WeightImage->GetPixel(inputIndex);
+            if (!indexOk)
+                continue;
+
+            unsigned int rowEnd = m_RowStarts[rowIndex + 1];
+            std::vector <int>::const_iterator firstBlock = std::lower_bound(m_RowBlockPositions.begin() + m_RowStarts[rowIndex],
+                                                                            m_RowBlockPositions.begin() + rowEnd, std::max(minX,0));
 
-            if (weight > 0.0)
+            for (unsigned int k = firstBlock - m_RowBlockPositions.begin();k < rowEnd;++k)
             {
-                logTrsfsVector[pos] = this->GetInput()->GetPixel(inputIndex);
-                weightsVector[pos] = weight;
-                sumAbsoluteWeights += weightsVector[pos];
-                weightsVector[pos] *= m_InternalSpatialKernelWeights[i];
-                ++pos;
+                int blockX = m_RowBlockPositions[k];
+                if (blockX > maxX)
+                    break;
+
+                double kernelWeight = m_KernelRowWeights[i][blockX - minX];
+                if (kernelWeight <= 0.0)
+                    continue;
+
+                sumAbsoluteWeights += m_BlockWeights[k];
+                weightsVector.push_back(m_BlockWeights[k] * kernelWeight);
+                for (unsigned int j = 0;j < NDegreesOfFreedom;++j)
+                    logTrsfsVector.push_back(m_BlockLogVectors[k * NDegreesOfFreedom + j]);
             }
         }
 
-        unsigned int numEltsRegion = pos;
+        unsigned int numEltsRegion = weightsVector.size();
 
         if (sumAbsoluteWeights == 0)
         {
@@ -215,7 +290,7 @@ DynamicThreadedGenerateData (const OutputImageRegionType &outputRegionForThread)
 
         bool stopLoop = false;
         unsigned int numIter = 0;
-        std::fill(deltaVector.begin(),deltaVector.begin()+numEltsRegion,1.0);
+        deltaVector.assign(numEltsRegion,1.0);
 
         while (!stopLoop)
         {
@@ -228,8 +303,9 @@ DynamicThreadedGenerateData (const OutputImageRegionType &outputRegionForThread)
             for (unsigned int i = 0;i < numEltsRegion;++i)
             {
                 double tmpWeight = weightsVector[i] * deltaVector[i];
+                const double *logTrsf = logTrsfsVector.data() + i * NDegreesOfFreedom;
                 for (unsigned int j = 0;j < NDegreesOfFreedom;++j)
-                    outValue[j] += logTrsfsVector[i][j] * tmpWeight;
+                    outValue[j] += logTrsf[j] * tmpWeight;
 
                 sumWeights += tmpWeight;
             }
@@ -237,7 +313,8 @@ DynamicThreadedGenerateData (const OutputImageRegionType &outputRegionForThread)
             for (unsigned int j = 0;j < NDegreesOfFreedom;++j)
                 outValue[j] /= sumWeights;
 
-            if (numIter == m_MaxNumIterations)
+            // A single neighbor leads to an exact solution, no need to iterate
+            if ((numIter == m_MaxNumIterations)||(numEltsRegion == 1))
                 stopLoop = true;
 
             if (!stopLoop)
@@ -245,13 +322,15 @@ DynamicThreadedGenerateData (const OutputImageRegionType &outputRegionForThread)
 
             if (!stopLoop)
             {
+                double residualFactor = 1.0 / (m_AverageResidualValue * m_MEstimateFactor);
                 for (unsigned int i = 0;i < numEltsRegion;++i)
                 {
+                    const double *logTrsf = logTrsfsVector.data() + i * NDegreesOfFreedom;
                     double residual = 0;
                     for (unsigned int j = 0;j < NDegreesOfFreedom;++j)
-                        residual += (outValue[j] - logTrsfsVector[i][j]) * (outValue[j] - logTrsfsVector[i][j]);
+                        residual += (outValue[j] - logTrsf[j]) * (outValue[j] - logTrsf[j]);
 
-                    deltaVector[i] = std::exp(- residual / (m_AverageResidualValue * m_MEstimateFactor));
+                    deltaVector[i] = std::exp(- residual * residualFactor);
                 }
             }
         }
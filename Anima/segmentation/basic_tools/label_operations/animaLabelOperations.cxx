@@ -0,0 +1,304 @@
+#include <tclap/CmdLine.h>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <cmath>
+#include <algorithm>
+
+#include <itkSignedMaurerDistanceMapImageFilter.h>
+#include <itkSignedDanielssonDistanceMapImageFilter.h>
+#include <itkConnectedComponentImageFilter.h>
+#include <itkRelabelComponentImageFilter.h>
+#include <itkRegionalMaximaImageFilter.h>
+#include <itkGrayscaleDilateImageFilter.h>
+#include <itkBinaryBallStructuringElement.h>
+#include <itkImageRegionIterator.h>
+#include <itkImageRegionConstIterator.h>
+
+#include <animaReadWriteFunctions.h>
+
+typedef itk::Image <unsigned short,3> MaskImageType;
+typedef itk::Image <unsigned int,3> LabelImageType;
+typedef itk::Image <float,3> DistanceImageType;
+
+/**
+ * Squared euclidean distance (in mm) of each voxel to the closest non zero voxel of the input mask.
+ * If complement is true, the distance is computed to the closest zero voxel instead.
+ */
+DistanceImageType::Pointer computeSquaredDistance(MaskImageType *mask, bool complement, unsigned int nThreads)
+{
+    MaskImageType::Pointer workMask = mask;
+    if (complement)
+    {
+        workMask = MaskImageType::New();
+        workMask->SetRegions(mask->GetLargestPossibleRegion());
+        workMask->CopyInformation(mask);
+        workMask->Allocate();
+
+        itk::ImageRegionConstIterator <MaskImageType> inItr(mask,mask->GetLargestPossibleRegion());
+        itk::ImageRegionIterator <MaskImageType> workItr(workMask,mask->GetLargestPossibleRegion());
+        while (!inItr.IsAtEnd())
+        {
+            workItr.Set(inItr.Get() == 0);
+            ++inItr;
+            ++workItr;
+        }
+    }
+
+    typedef itk::SignedMaurerDistanceMapImageFilter <MaskImageType,DistanceImageType> DistanceFilterType;
+    DistanceFilterType::Pointer distFilter = DistanceFilterType::New();
+    distFilter->SetInput(workMask);
+    distFilter->SetSquaredDistance(true);
+    distFilter->SetBackgroundValue(0);
+    distFilter->InsideIsPositiveOff();
+    distFilter->UseImageSpacingOn();
+    distFilter->SetNumberOfWorkUnits(nThreads);
+    distFilter->Update();
+
+    DistanceImageType::Pointer output = distFilter->GetOutput();
+    output->DisconnectPipeline();
+
+    return output;
+}
+
+/**
+ * Dilation (or erosion) with an euclidean ball of radius in mm. Computed from a distance map, the cost does not
+ * depend on the radius. Erosion is the complement of the dilation of the complement.
+ */
+void dilateOrErode(MaskImageType::Pointer &mask, double radius, bool erode, unsigned int nThreads)
+{
+    DistanceImageType::Pointer distImage = computeSquaredDistance(mask,erode,nThreads);
+    double squaredRadius = radius * radius;
+
+    itk::ImageRegionConstIterator <DistanceImageType> distItr(distImage,mask->GetLargestPossibleRegion());
+    itk::ImageRegionIterator <MaskImageType> maskItr(mask,mask->GetLargestPossibleRegion());
+
+    while (!maskItr.IsAtEnd())
+    {
+        // Maurer distance is negative inside the object
+        bool insideBall = (distItr.Get() <= squaredRadius);
+        if (erode)
+            maskItr.Set(!insideBall);
+        else
+            maskItr.Set(insideBall);
+
+        ++distItr;
+        ++maskItr;
+    }
+}
+
+//! Removes connected components smaller or equal to minSize (in mm3), labels are kept as consecutive integers
+void connectedComponents(MaskImageType::Pointer &mask, double minSize, bool fullyConnected, unsigned int nThreads)
+{
+    typedef itk::ConnectedComponentImageFilter <MaskImageType,MaskImageType> CCFilterType;
+    typedef itk::RelabelComponentImageFilter <MaskImageType,MaskImageType> RelabelFilterType;
+
+    CCFilterType::Pointer ccFilter = CCFilterType::New();
+    ccFilter->SetInput(mask);
+    ccFilter->SetFullyConnected(fullyConnected);
+    ccFilter->SetNumberOfWorkUnits(nThreads);
+
+    MaskImageType::SpacingType spacing = mask->GetSpacing();
+    double spacingTot = spacing[0] * spacing[1] * spacing[2];
+    unsigned int minSizeInVoxel = static_cast <unsigned int> (std::floor(minSize / spacingTot)) + 1;
+
+    RelabelFilterType::Pointer relabelFilter = RelabelFilterType::New();
+    relabelFilter->SetInput(ccFilter->GetOutput());
+    relabelFilter->SetMinimumObjectSize(minSizeInVoxel);
+    relabelFilter->SetNumberOfWorkUnits(nThreads);
+    relabelFilter->Update();
+
+    std::cout << "Number of objects: " << relabelFilter->GetOriginalNumberOfObjects() << ", after cleaning objects smaller than "
+              << minSize << " mm3: " << relabelFilter->GetNumberOfObjects() << std::endl;
+
+    mask = relabelFilter->GetOutput();
+    mask->DisconnectPipeline();
+}
+
+//! Fills holes, i.e. background regions (6-connectivity) not connected to the main background component
+void fillHoles(MaskImageType::Pointer &mask, unsigned int nThreads)
+{
+    MaskImageType::Pointer backgroundImage = MaskImageType::New();
+    backgroundImage->SetRegions(mask->GetLargestPossibleRegion());
+    backgroundImage->CopyInformation(mask);
+    backgroundImage->Allocate();
+
+    itk::ImageRegionIterator <MaskImageType> maskItr(mask,mask->GetLargestPossibleRegion());
+    itk::ImageRegionIterator <MaskImageType> backgroundItr(backgroundImage,mask->GetLargestPossibleRegion());
+    while (!maskItr.IsAtEnd())
+    {
+        backgroundItr.Set(maskItr.Get() == 0);
+        ++maskItr;
+        ++backgroundItr;
+    }
+
+    typedef itk::ConnectedComponentImageFilter <MaskImageType,LabelImageType> CCFilterType;
+    CCFilterType::Pointer ccFilter = CCFilterType::New();
+    ccFilter->SetInput(backgroundImage);
+    ccFilter->SetFullyConnected(false);
+    ccFilter->SetNumberOfWorkUnits(nThreads);
+    ccFilter->Update();
+
+    itk::ImageRegionConstIterator <LabelImageType> ccItr(ccFilter->GetOutput(),mask->GetLargestPossibleRegion());
+    maskItr.GoToBegin();
+    while (!maskItr.IsAtEnd())
+    {
+        if (ccItr.Get() > 1)
+            maskItr.Set(1);
+
+        ++ccItr;
+        ++maskItr;
+    }
+}
+
+//! Influence zones of the mask: labels of the Voronoi cells of the distance map regional maxima, restricted to the mask
+void influenceZones(MaskImageType::Pointer &mask, unsigned int radius, unsigned int nThreads)
+{
+    typedef itk::Image <double,3> DoubleImageType;
+    typedef itk::Image <unsigned char,3> BinaryImageType;
+
+    BinaryImageType::Pointer binaryMask = BinaryImageType::New();
+    binaryMask->SetRegions(mask->GetLargestPossibleRegion());
+    binaryMask->CopyInformation(mask);
+    binaryMask->Allocate();
+
+    itk::ImageRegionIterator <MaskImageType> maskItr(mask,mask->GetLargestPossibleRegion());
+    itk::ImageRegionIterator <BinaryImageType> binaryItr(binaryMask,mask->GetLargestPossibleRegion());
+    while (!maskItr.IsAtEnd())
+    {
+        binaryItr.Set(maskItr.Get() != 0);
+        ++maskItr;
+        ++binaryItr;
+    }
+
+    typedef itk::SignedDanielssonDistanceMapImageFilter <BinaryImageType, DoubleImageType, MaskImageType> DistanceMapFilterType;
+    DistanceMapFilterType::Pointer distanceMap = DistanceMapFilterType::New();
+    distanceMap->SetInput(binaryMask);
+    distanceMap->InsideIsPositiveOn();
+    distanceMap->SetUseImageSpacing(true);
+    distanceMap->SetNumberOfWorkUnits(nThreads);
+
+    typedef itk::RegionalMaximaImageFilter <DoubleImageType,BinaryImageType> RegionalMaximaFilterType;
+    RegionalMaximaFilterType::Pointer regionalFilter = RegionalMaximaFilterType::New();
+    regionalFilter->SetInput(distanceMap->GetOutput());
+    regionalFilter->SetFullyConnected(true);
+    regionalFilter->SetNumberOfWorkUnits(nThreads);
+
+    typedef itk::BinaryBallStructuringElement<BinaryImageType::PixelType,3> StructuringElementType;
+    StructuringElementType structuringElement;
+    structuringElement.SetRadius(radius);
+    structuringElement.CreateStructuringElement();
+
+    typedef itk::GrayscaleDilateImageFilter <BinaryImageType,BinaryImageType,StructuringElementType> DilateFilterType;
+    DilateFilterType::Pointer dilateFilter = DilateFilterType::New();
+    dilateFilter->SetInput(regionalFilter->GetOutput());
+    dilateFilter->SetKernel(structuringElement);
+    dilateFilter->SetNumberOfWorkUnits(nThreads);
+
+    typedef itk::ConnectedComponentImageFilter <BinaryImageType,MaskImageType> CCFilterType;
+    CCFilterType::Pointer ccFilter = CCFilterType::New();
+    ccFilter->SetInput(dilateFilter->GetOutput());
+    ccFilter->SetFullyConnected(true);
+    ccFilter->SetNumberOfWorkUnits(nThreads);
+
+    typedef itk::SignedDanielssonDistanceMapImageFilter <MaskImageType, DoubleImageType, MaskImageType> VoronoiMapFilterType;
+    VoronoiMapFilterType::Pointer voronoiFilter = VoronoiMapFilterType::New();
+    voronoiFilter->SetInput(ccFilter->GetOutput());
+    voronoiFilter->SetUseImageSpacing(true);
+    voronoiFilter->InsideIsPositiveOff();
+    voronoiFilter->SetNumberOfWorkUnits(nThreads);
+    voronoiFilter->Update();
+
+    itk::ImageRegionConstIterator <MaskImageType> voronoiItr(voronoiFilter->GetVoronoiMap(),mask->GetLargestPossibleRegion());
+    maskItr.GoToBegin();
+    while (!maskItr.IsAtEnd())
+    {
+        if (maskItr.Get() != 0)
+            maskItr.Set(voronoiItr.Get());
+
+        ++voronoiItr;
+        ++maskItr;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    std::string descriptionMessage = "Chains operations on a mask in memory, reading and writing it only once.\n";
+    descriptionMessage += "Operations are given as a comma separated list of operation[:value], applied in order, among:\n";
+    descriptionMessage += "dil:r, er:r, open:r, clos:r (morphology with an euclidean ball of radius r in mm, computed from distance maps),\n";
+    descriptionMessage += "cc:s (connected components, removing components of size smaller or equal to s mm3), fill (fill holes),\n";
+    descriptionMessage += "iz:r (influence zones, r being the dilation radius in voxels of the regional maxima).\n";
+    descriptionMessage += "Example: -a dil:2,fill,er:2,cc:10\n";
+    descriptionMessage += "INRIA / IRISA - VisAGeS/Empenn Team";
+
+    TCLAP::CmdLine cmd(descriptionMessage, ' ',ANIMA_VERSION);
+
+    TCLAP::ValueArg<std::string> inArg("i","input","Input mask",true,"","input mask",cmd);
+    TCLAP::ValueArg<std::string> outArg("o","output","Output image",true,"","output image",cmd);
+    TCLAP::ValueArg<std::string> actArg("a","actions","Comma separated list of operations to perform",true,"","operations list",cmd);
+    TCLAP::SwitchArg fullConnectArg("F","full-connect","Use 26-connectivity instead of 6-connectivity for connected components",cmd,false);
+
+    TCLAP::ValueArg<unsigned int> numThreadsArg("T","threads","Number of execution threads (default: all cores)",false,itk::MultiThreaderBase::GetGlobalDefaultNumberOfThreads(),"number of threads",cmd);
+
+    try
+    {
+        cmd.parse(argc,argv);
+    }
+    catch (TCLAP::ArgException& e)
+    {
+        std::cerr << "Error: " << e.error() << "for argument " << e.argId() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    MaskImageType::Pointer mask = anima::readImage <MaskImageType> (inArg.getValue());
+    unsigned int nThreads = numThreadsArg.getValue();
+
+    std::stringstream actionsStream(actArg.getValue());
+    std::string action;
+    while (std::getline(actionsStream,action,','))
+    {
+        if (action == "")
+            continue;
+
+        std::string actionName = action;
+        double actionValue = 0;
+        std::size_t separatorPos = action.find(':');
+        if (separatorPos != std::string::npos)
+        {
+            actionName = action.substr(0,separatorPos);
+            actionValue = std::stod(action.substr(separatorPos + 1));
+        }
+
+        std::cout << "Performing " << action << "..." << std::endl;
+
+        if (actionName == "dil")
+            dilateOrErode(mask,actionValue,false,nThreads);
+        else if (actionName == "er")
+            dilateOrErode(mask,actionValue,true,nThreads);
+        else if (actionName == "open")
+        {
+            dilateOrErode(mask,actionValue,true,nThreads);
+            dilateOrErode(mask,actionValue,false,nThreads);
+        }
+        else if (actionName == "clos")
+        {
+            dilateOrErode(mask,actionValue,false,nThreads);
+            dilateOrErode(mask,actionValue,true,nThreads);
+        }
+        else if (actionName == "cc")
+            connectedComponents(mask,actionValue,fullConnectArg.isSet(),nThreads);
+        else if (actionName == "fill")
+            fillHoles(mask,nThreads);
+        else if (actionName == "iz")
+            influenceZones(mask,std::max(1,(int)actionValue),nThreads);
+        else
+        {
+            std::cerr << "Unknown operation " << actionName << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    anima::writeImage <MaskImageType> (outArg.getValue(),mask);
+
+    return EXIT_SUCCESS;
+}